@@ -0,0 +1,50 @@
+// Throughput of the batch decoder kernels. Input is sample_t records
+// (64 bytes each) as produced by the stream decoder and log reader.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "batch_decode.hpp"
+
+int main(int argc, char **argv) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4000000;
+    const int repeats = 10;
+
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> temp(-5000, 12000);
+    std::uniform_int_distribution<int> heading(0, 3599);
+    std::uniform_int_distribution<int> tilt(-90, 90);
+    std::vector<sample_t> samples(count);
+    for (size_t i = 0; i < count; ++i) {
+        sample_clear(&samples[i], i * 50000ull);
+        sample_set(&samples[i], SAMPLE_CH_TEMP, temp(rng));
+        sample_set(&samples[i], SAMPLE_CH_HEADING, heading(rng));
+        sample_set(&samples[i], SAMPLE_CH_PITCH, tilt(rng));
+        sample_set(&samples[i], SAMPLE_CH_ROLL, tilt(rng));
+    }
+
+    host::EngColumns out;
+    out.resize(count);
+    double input_gb = double(count) * sizeof(sample_t) / 1e9;
+
+    std::printf("%zu records, %.0f MB in, best of %d runs\n", count, input_gb * 1e3, repeats);
+    for (host::Kernel k : {host::Kernel::Scalar, host::Kernel::Sse41, host::Kernel::Avx2}) {
+        if (!host::kernel_supported(k)) {
+            std::printf("%-8s not supported\n", host::kernel_name(k));
+            continue;
+        }
+        double best = 1e9;
+        for (int r = 0; r < repeats; ++r) {
+            auto t0 = std::chrono::steady_clock::now();
+            host::decode_batch(samples.data(), count, out, 0, k);
+            auto t1 = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+        }
+        std::printf("%-8s %8.1f Mrecords/s  %6.2f GB/s\n", host::kernel_name(k), count / best / 1e6,
+                    input_gb / best);
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+// Size and speed of the delta codec on synthetic traces shaped like the
+// real sensors, compared with the fixed-size packed sample format.
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "delta_codec.h"
+#include "sample.h"
+
+namespace {
+
+struct Trace {
+    std::string name;
+    std::vector<sample_t> samples;
+};
+
+// TMP117 at 1 Hz: slow drift plus sensor noise, in Q7 degrees
+Trace temperature_trace(size_t n) {
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0.0, 1.0);
+    Trace t{"temperature 1 Hz", {}};
+    for (size_t i = 0; i < n; ++i) {
+        sample_t s;
+        sample_clear(&s, i * 1000000ull);
+        double celsius = 22.0 + 2.0 * std::sin(i / 3600.0);
+        sample_set(&s, SAMPLE_CH_TEMP, static_cast<int32_t>(celsius * 128 + noise(rng)));
+        t.samples.push_back(s);
+    }
+    return t;
+}
+
+// CMPS12 at 20 Hz, all five channels, with a little jitter on the timer
+Trace compass_trace(size_t n, bool moving) {
+    std::mt19937 rng(2);
+    std::normal_distribution<double> noise(0.0, 0.7);
+    std::uniform_int_distribution<int> jitter(-40, 40);
+    Trace t{moving ? "compass 20 Hz turning" : "compass 20 Hz stationary", {}};
+    double heading = 3500.0;
+    for (size_t i = 0; i < n; ++i) {
+        sample_t s;
+        sample_clear(&s, i * 50000ull + jitter(rng));
+        if (moving) {
+            heading = std::fmod(heading + 4.0, 3600.0);    // 8 degrees/s, crosses north
+        }
+        int32_t h = static_cast<int32_t>(heading + noise(rng) + 3600) % 3600;
+        sample_set(&s, SAMPLE_CH_HEADING, h);
+        sample_set(&s, SAMPLE_CH_ANGLE8, h * 256 / 3600);
+        sample_set(&s, SAMPLE_CH_PITCH, static_cast<int32_t>(3 + noise(rng)));
+        sample_set(&s, SAMPLE_CH_ROLL, static_cast<int32_t>(-2 + noise(rng)));
+        sample_set(&s, SAMPLE_CH_TEMP, 2900 + static_cast<int32_t>(noise(rng)));
+        t.samples.push_back(s);
+    }
+    return t;
+}
+
+void run(const Trace &trace, uint16_t interval) {
+    const std::vector<sample_t> &in = trace.samples;
+    std::vector<uint8_t> encoded(in.size() * DELTA_RECORD_MAX);
+    delta_codec_t codec;
+
+    size_t packed_bytes = 0;
+    uint8_t packed[SAMPLE_PACKED_MAX];
+    for (const sample_t &s : in) {
+        packed_bytes += sample_pack(&s, packed, sizeof(packed));
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    delta_codec_init(&codec, interval);
+    size_t pos = 0;
+    for (const sample_t &s : in) {
+        pos += delta_encode(&codec, &s, &encoded[pos], encoded.size() - pos);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    delta_codec_init(&codec, interval);
+    size_t at = 0;
+    size_t decoded = 0;
+    sample_t out;
+    while (at < pos) {
+        size_t used = 0;
+        if (delta_decode(&codec, &encoded[at], pos - at, &out, &used) != DELTA_OK) {
+            std::printf("decode error at byte %zu\n", at);
+            return;
+        }
+        at += used;
+        decoded++;
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    double enc_s = std::chrono::duration<double>(t1 - t0).count();
+    double dec_s = std::chrono::duration<double>(t2 - t1).count();
+    std::printf("%-26s kf=%-4u %6.2f B/sample (packed %5.2f)  ratio %5.2fx  "
+                "enc %6.1f Msample/s  dec %6.1f Msample/s %7.1f MB/s\n",
+                trace.name.c_str(), interval, double(pos) / in.size(), double(packed_bytes) / in.size(),
+                double(packed_bytes) / pos, in.size() / enc_s / 1e6, decoded / dec_s / 1e6,
+                pos / dec_s / 1e6);
+}
+
+}  // namespace
+
+int main() {
+    const size_t n = 1000000;
+    std::vector<Trace> traces = {temperature_trace(n), compass_trace(n, false), compass_trace(n, true)};
+    for (const Trace &trace : traces) {
+        for (uint16_t interval : {16, 64, 256}) {
+            run(trace, interval);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+// Block write latency of the flash ring log with and without erasing
+// ahead in idle time. The chip is host::FileFlashDev in virtual time with
+// W25Q-series timings, so the numbers come from that model, not from a
+// board.
+//
+// Blocks arrive at a fixed rate. Between arrivals the storage side calls
+// flash_log_service (when erasing ahead) until the next block is due. A
+// block's latency runs from its arrival to the end of its program,
+// including any wait for an erase still running. After five laps of the
+// ring the erase counts show how evenly it wore.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "file_flash_dev.hpp"
+#include "flash_log.h"
+
+namespace {
+
+const uint32_t REGION_BYTES = 2u * 1024 * 1024;     // Half of a Pico 2's flash
+const uint32_t LAPS = 5;
+
+struct Run {
+    host::FileFlashDev *chip;
+    flash_log_t flash;
+    log_writer_t writer;
+    bool erase_ahead;
+    uint64_t period_us;
+    uint64_t arrival_us = 0;
+    std::vector<uint64_t> latency_us;
+
+    static bool emit(void *ctx, const uint8_t *block) {
+        auto *self = static_cast<Run *>(ctx);
+        host::FileFlashDev &chip = *self->chip;
+
+        // Idle until the block is due, erasing ahead meanwhile
+        while (self->erase_ahead && chip.now_us() < self->arrival_us && flash_log_service(&self->flash)) {
+        }
+        if (chip.now_us() < self->arrival_us) {
+            chip.advance(self->arrival_us - chip.now_us());
+        }
+        uint64_t start = std::min(chip.now_us(), self->arrival_us);
+        self->writer.write(self->writer.ctx, block, LOG_BLOCK_SIZE);
+        self->latency_us.push_back(chip.now_us() - start);
+        self->arrival_us += self->period_us;
+        return true;
+    }
+};
+
+uint64_t percentile(std::vector<uint64_t> sorted, double p) {
+    return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    uint32_t slow_every = argc > 1 ? uint32_t(std::atoi(argv[1])) : 64;
+
+    host::FlashTiming timing;
+    timing.erase_slow_every = slow_every;
+    std::printf("model: erase %u us (%u us every %u erases), program %u us/page; %u KiB ring, %u laps\n\n",
+                timing.erase_us, timing.erase_slow_us, timing.erase_slow_every, timing.page_program_us,
+                REGION_BYTES / 1024 - 4, LAPS);
+    std::printf("%-14s %9s %9s %9s %9s %9s %7s %9s\n", "mode", "blocks/s", "p50 us", "p99 us", "max us",
+                "stalls", "wear", "erases");
+
+    std::string path = "bench_flash_log.img";
+    for (double rate : {2.0, 8.0, 16.0}) {
+        for (bool ahead : {false, true}) {
+            host::FileFlashDev chip(path, REGION_BYTES, timing);
+            chip.set_virtual_time(true);
+            uint8_t scratch[LOG_BLOCK_SIZE];
+
+            Run run;
+            run.chip = &chip;
+            run.erase_ahead = ahead;
+            run.period_us = uint64_t(1e6 / rate);
+            flash_log_init(&run.flash, chip.dev());
+            flash_log_mount(&run.flash, scratch);
+            flash_log_writer(&run.flash, &run.writer);
+
+            static block_log_t log;
+            block_log_config_t config = {1, 0xB10C, 0, 0, LOG_NO_BLOCK, 0, 0};
+            block_log_init(&log, &config, Run::emit, &run);
+            for (uint32_t i = 0; log.seq < LAPS * run.flash.ring_sectors; ++i) {
+                sample_t s;
+                sample_clear(&s, i * 10000ull);
+                sample_set(&s, SAMPLE_CH_TEMP, int32_t(i * 37 % 400));
+                sample_set(&s, SAMPLE_CH_HEADING, int32_t(i * 7919 % SAMPLE_HEADING_MODULUS));
+                sample_set(&s, SAMPLE_CH_PITCH, int32_t(i * 13 % 90) - 45);
+                block_log_add(&log, &s);
+            }
+
+            std::vector<uint64_t> sorted(run.latency_us.begin() + 1, run.latency_us.end());
+            std::sort(sorted.begin(), sorted.end());
+            const std::vector<uint32_t> &wear = chip.erase_counts();
+            auto ring = std::minmax_element(wear.begin(), wear.begin() + run.flash.ring_sectors);
+            std::printf("%-14s %9.0f %9llu %9llu %9llu %9u %3u-%-3u %9llu\n", ahead ? "erase-ahead" : "erase-on-write",
+                        rate, (unsigned long long)percentile(sorted, 0.50),
+                        (unsigned long long)percentile(sorted, 0.99), (unsigned long long)sorted.back(),
+                        run.flash.stats.erase_stalls, *ring.first, *ring.second,
+                        (unsigned long long)chip.erases());
+        }
+    }
+    std::remove(path.c_str());
+    return 0;
+}
@@ -0,0 +1,93 @@
+// Parallel export of a large block log. Writes a synthetic log of the
+// given size (MiB, default 2048), maps it, and exports it as CSV and as
+// columns into a sink that only counts bytes, at 1, 2, 4... threads up to
+// the hardware thread count. The first pass also pulls the file into the
+// page cache, so the timed passes measure decoding, not the disk.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log_export.hpp"
+#include "mapped_file.hpp"
+
+namespace {
+
+bool write_block(void *ctx, const uint8_t *block) {
+    return std::fwrite(block, 1, LOG_BLOCK_SIZE, static_cast<FILE *>(ctx)) == LOG_BLOCK_SIZE;
+}
+
+// Samples every 10 ms with slowly moving values, like a real recording
+bool make_log(const std::string &path, uint64_t bytes) {
+    FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    static block_log_t log;
+    block_log_config_t config = {1, 0x5EED, 0, 0, LOG_NO_BLOCK, 0, 0};
+    block_log_init(&log, &config, write_block, f);
+    for (uint32_t i = 0; uint64_t(log.seq) * LOG_BLOCK_SIZE < bytes; ++i) {
+        sample_t s;
+        sample_clear(&s, i * 10000ull);
+        sample_set(&s, SAMPLE_CH_TEMP, 2900 + int32_t(i / 64 % 600));
+        sample_set(&s, SAMPLE_CH_HEADING, int32_t(i / 8 % SAMPLE_HEADING_MODULUS));
+        sample_set(&s, SAMPLE_CH_PITCH, int32_t(i / 32 % 90) - 45);
+        sample_set(&s, SAMPLE_CH_ROLL, int32_t(i / 16 % 60) - 30);
+        block_log_add(&log, &s);
+    }
+    block_log_flush(&log);
+    return std::fclose(f) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    uint64_t mib = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2048;
+    std::string path = argc > 2 ? argv[2] : "bench_log_export.bin";
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+
+    if (!make_log(path, mib << 20)) {
+        std::fprintf(stderr, "cannot write %s\n", path.c_str());
+        return 1;
+    }
+    host::MappedFile file(path);
+    host::LogExporter exporter(file.data(), file.size());
+    std::printf("%.0f MiB log, %u hardware threads\n", file.size() / 1048576.0, hw);
+
+    std::vector<unsigned> thread_counts;
+    for (unsigned t = 1; t < hw; t *= 2) {
+        thread_counts.push_back(t);
+    }
+    thread_counts.push_back(hw);
+
+    for (host::ExportFormat format : {host::ExportFormat::Csv, host::ExportFormat::Columnar}) {
+        host::ExportOptions options;
+        options.format = format;
+        double base = 0;
+        for (unsigned threads : thread_counts) {
+            host::ThreadPool pool(threads);
+            uint64_t out = 0;
+            auto count = [&out](const char *, size_t len) {
+                out += len;
+                return true;
+            };
+            if (threads == 1 && format == host::ExportFormat::Csv) {
+                exporter.run(pool, options, count);      // Warm the page cache
+            }
+            auto t0 = std::chrono::steady_clock::now();
+            host::ExportStats stats = exporter.run(pool, options, count);
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            if (threads == 1) {
+                base = secs;
+            }
+            std::printf("%-8s %2u threads  %6.2f GB/s of log  %7.1f Msamples/s  %6.2f GB out  %5.2fx\n",
+                        format == host::ExportFormat::Csv ? "csv" : "columnar", threads, file.size() / secs / 1e9,
+                        stats.samples / secs / 1e6, out / 1e9, base / secs);
+        }
+    }
+    std::remove(path.c_str());
+    return 0;
+}
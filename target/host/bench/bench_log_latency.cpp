@@ -0,0 +1,174 @@
+// Log buffer write latency on an emulated SD card: appending through the
+// FAT (metadata rewritten at every sync) against a preallocated contiguous
+// file written by raw sector. The card is host::FileBlockDev in virtual
+// time, so the numbers come from its latency model, not from a real card.
+//
+// Each 4 KiB buffer's service time is the sum of the modelled latencies of
+// every write it caused. Those times then drive a replay of the sd_log
+// double buffer at several producer rates to count the bytes dropped.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "file_block_dev.hpp"
+#include "sd_log.h"
+
+// sd_log's write timer; unused here, service times come from the model
+extern "C" uint32_t sd_log_port_time_us(void) {
+    return 0;
+}
+
+namespace {
+
+// Card layout: FAT sectors, a directory sector, then two file regions used
+// in turn, as if each full file were deleted before the next one is made
+const uint32_t FAT_LBA = 32;
+const uint32_t DIR_LBA = 1000;
+const uint32_t DATA_LBA = 1024;
+const uint32_t FILE_BLOCKS = 8u * 1024 * 1024 / BLOCK_SIZE;
+const uint32_t CLUSTER_BLOCKS = 64;
+const uint32_t FAT_ENTRIES_PER_SECTOR = BLOCK_SIZE / 4;
+
+// Stand-in for fatfs_log: the same data path, with the metadata writes
+// either mode makes put in explicitly
+struct ModelWriter {
+    host::FileBlockDev *card;
+    bool fat_append;
+    raw_log_writer_t raw;
+    log_writer_t data;
+    uint32_t files = 0;
+    uint8_t sector[BLOCK_SIZE] = {};
+
+    void meta(uint32_t lba) { block_dev_write(card->dev(), lba, sector, 1); }
+
+    // Creating a file writes its directory entry and its FAT chain
+    void create() {
+        uint32_t start = DATA_LBA + (files++ % 2) * FILE_BLOCKS;
+        raw_log_writer_init(&raw, card->dev(), start, FILE_BLOCKS, &data);
+        meta(DIR_LBA);
+        if (!fat_append) {
+            uint32_t first = (start - DATA_LBA) / CLUSTER_BLOCKS / FAT_ENTRIES_PER_SECTOR;
+            uint32_t sectors = FILE_BLOCKS / CLUSTER_BLOCKS / FAT_ENTRIES_PER_SECTOR;
+            for (uint32_t i = 0; i < sectors; ++i) {
+                meta(FAT_LBA + first + i);
+            }
+        }
+    }
+
+    static int write(void *ctx, const uint8_t *buf, size_t len) {
+        auto *self = static_cast<ModelWriter *>(ctx);
+        int status = self->data.write(self->data.ctx, buf, len);
+        if (status == BLOCK_RANGE) {
+            self->create();
+            status = self->data.write(self->data.ctx, buf, len);
+        }
+        return status;
+    }
+
+    // An append sync rewrites the FAT sector holding the newest clusters
+    // and the directory entry with the new size; a raw sync writes nothing
+    static int sync(void *ctx) {
+        auto *self = static_cast<ModelWriter *>(ctx);
+        if (self->fat_append) {
+            uint32_t cluster = (self->raw.next_lba - DATA_LBA) / CLUSTER_BLOCKS;
+            self->meta(FAT_LBA + cluster / FAT_ENTRIES_PER_SECTOR);
+            self->meta(DIR_LBA);
+        }
+        return block_dev_sync(self->card->dev());
+    }
+};
+
+// Service time of every buffer, in microseconds
+std::vector<uint64_t> service_times(bool fat_append, const host::LatencyModel &model, size_t buffers) {
+    std::string path = "bench_log_latency.img";
+    host::FileBlockDev card(path, DATA_LBA + 2 * FILE_BLOCKS, model);
+    card.set_virtual_time(true);
+    block_dev_init(card.dev());
+
+    ModelWriter w;
+    w.card = &card;
+    w.fat_append = fat_append;
+    w.create();
+
+    std::vector<uint8_t> buf(SD_LOG_BUFFER_SIZE, 0x55);
+    std::vector<uint64_t> times(buffers);
+    for (size_t i = 0; i < buffers; ++i) {
+        size_t before = card.latencies().size();
+        ModelWriter::write(&w, buf.data(), buf.size());
+        if ((i + 1) % SD_LOG_SYNC_BUFFERS == 0) {
+            ModelWriter::sync(&w);
+        }
+        for (size_t n = before; n < card.latencies().size(); ++n) {
+            times[i] += card.latencies()[n];
+        }
+    }
+    std::remove(path.c_str());
+    return times;
+}
+
+// Replay the ring of SD_LOG_BUFFER_COUNT buffers against a producer of
+// 'rate' bytes per second; returns the fraction of bytes dropped
+double drop_fraction(const std::vector<uint64_t> &service, double rate) {
+    const double fill_s = SD_LOG_BUFFER_SIZE / rate;
+    std::vector<double> free_at(SD_LOG_BUFFER_COUNT, 0.0);
+    double producer = 0.0;      // When the producer wants the next buffer
+    double storage = 0.0;       // When the storage side is next idle
+    double dropped = 0.0;
+
+    for (size_t i = 0; i < service.size(); ++i) {
+        double &slot = free_at[i % SD_LOG_BUFFER_COUNT];
+        if (slot > producer) {
+            dropped += (slot - producer) * rate;
+            producer = slot;
+        }
+        double full = producer + fill_s;
+        storage = std::max(storage, full) + service[i] * 1e-6;
+        slot = storage;
+        producer = full;
+    }
+    return dropped / (dropped + double(service.size()) * SD_LOG_BUFFER_SIZE);
+}
+
+uint64_t percentile(std::vector<uint64_t> sorted, double p) {
+    return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    size_t buffers = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 50000;
+
+    // A modest card: about 8 MB/s sequential, a few ms to leave the open
+    // allocation unit, and a long internal erase now and then
+    host::LatencyModel model;
+    model.base_us = 300;
+    model.per_block_us = 25;
+    model.nonsequential_us = 3000;
+    model.spike_every = 500;
+    model.spike_us = 60000;
+
+    std::printf("%zu buffers of %d bytes, sync every %d buffers, %d buffers in the ring\n", buffers,
+                SD_LOG_BUFFER_SIZE, SD_LOG_SYNC_BUFFERS, SD_LOG_BUFFER_COUNT);
+    std::printf("model: %u us + %u us/block, +%u us non-sequential, +%u us every %u writes\n\n",
+                model.base_us, model.per_block_us, model.nonsequential_us, model.spike_us,
+                model.spike_every);
+
+    const double rates[] = {64e3, 256e3, 1024e3};
+    std::printf("%-11s %8s %8s %8s %8s   drops at %.0f / %.0f / %.0f KB/s\n", "mode", "p50 us", "p99 us",
+                "p999 us", "max us", rates[0] / 1e3, rates[1] / 1e3, rates[2] / 1e3);
+    for (bool fat_append : {true, false}) {
+        std::vector<uint64_t> times = service_times(fat_append, model, buffers);
+        std::vector<uint64_t> sorted = times;
+        std::sort(sorted.begin(), sorted.end());
+        std::printf("%-11s %8llu %8llu %8llu %8llu  ", fat_append ? "fat-append" : "contiguous",
+                    (unsigned long long)percentile(sorted, 0.50), (unsigned long long)percentile(sorted, 0.99),
+                    (unsigned long long)percentile(sorted, 0.999), (unsigned long long)sorted.back());
+        for (double rate : rates) {
+            std::printf(" %8.4f%%", 100.0 * drop_fraction(times, rate));
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
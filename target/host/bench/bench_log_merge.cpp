@@ -0,0 +1,128 @@
+// Merging the logs of a fleet. Writes one synthetic log per device (256
+// devices of 20000 samples by default), each starting at its own time
+// and sampling at its own rate, then merges them into a sink that only
+// counts bytes, for several read sizes and I/O thread counts.
+//
+//   bench_log_merge [devices] [samples per device] [dir]
+//
+// For each setting it prints rows per second, MB/s of log read, the read
+// buffers held and how long the merge stood waiting for reads. On Linux
+// the logs are dropped from the page cache before each pass, so reads go
+// to the disk as they would for logs just copied off the cards; elsewhere
+// they come from the cache after the first pass.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "log_merge.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+bool write_block(void *ctx, const uint8_t *block) {
+    return std::fwrite(block, 1, LOG_BLOCK_SIZE, static_cast<FILE *>(ctx)) == LOG_BLOCK_SIZE;
+}
+
+// Device d samples every 10 + d % 7 ms from d * 1.3 s on, with slowly
+// moving values
+bool make_log(const std::string &path, uint32_t device, uint32_t samples) {
+    FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    static block_log_t log;
+    block_log_config_t config = {0xD0000000ull + device, 0x5EED + device, 0, 0, LOG_NO_BLOCK, 0, 0};
+    block_log_init(&log, &config, write_block, f);
+    uint64_t period_us = 10000 + device % 7 * 1000;
+    for (uint32_t i = 0; i < samples; ++i) {
+        sample_t s;
+        sample_clear(&s, device * 1300000ull + i * period_us);
+        sample_set(&s, SAMPLE_CH_TEMP, 2900 + int32_t((i + device) / 64 % 600));
+        sample_set(&s, SAMPLE_CH_HEADING, int32_t((i + device * 40) / 8 % SAMPLE_HEADING_MODULUS));
+        sample_set(&s, SAMPLE_CH_PITCH, int32_t(i / 32 % 90) - 45);
+        sample_set(&s, SAMPLE_CH_ROLL, int32_t(i / 16 % 60) - 30);
+        block_log_add(&log, &s);
+    }
+    block_log_flush(&log);
+    return std::fclose(f) == 0;
+}
+
+void drop_cache(const std::string &path) {
+#ifdef __linux__
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#else
+    (void)path;
+#endif
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    uint32_t devices = argc > 1 ? uint32_t(std::atoi(argv[1])) : 256;
+    uint32_t samples = argc > 2 ? uint32_t(std::atoi(argv[2])) : 20000;
+    std::string dir = argc > 3 ? std::string(argv[3]) + "/" : "";
+
+    std::vector<std::string> paths;
+    uint64_t log_bytes = 0;
+    for (uint32_t d = 0; d < devices; ++d) {
+        paths.push_back(dir + "bench_log_merge_" + std::to_string(d) + ".bin");
+        if (!make_log(paths.back(), d, samples)) {
+            std::fprintf(stderr, "cannot write %s\n", paths.back().c_str());
+            return 1;
+        }
+        FILE *f = std::fopen(paths.back().c_str(), "rb");
+        std::fseek(f, 0, SEEK_END);
+        log_bytes += uint64_t(std::ftell(f));
+        std::fclose(f);
+    }
+    std::printf("%u devices, %u samples each, %.0f MiB of logs\n\n", devices, samples, log_bytes / 1048576.0);
+    std::printf("%-8s %11s %7s %10s %8s %11s %11s %9s\n", "format", "read blocks", "io thr", "Mrows/s", "MB/s",
+                "buffers MiB", "read wait s", "disorder");
+
+    struct Setting {
+        host::ExportFormat format;
+        size_t read_blocks;
+        unsigned io_threads;
+    };
+    const Setting settings[] = {
+        {host::ExportFormat::Csv, 1, 1},      {host::ExportFormat::Csv, 8, 1},
+        {host::ExportFormat::Csv, 8, 4},      {host::ExportFormat::Csv, 32, 4},
+        {host::ExportFormat::Columnar, 8, 4}, {host::ExportFormat::Columnar, 32, 8},
+    };
+    for (const Setting &setting : settings) {
+        for (const std::string &path : paths) {
+            drop_cache(path);
+        }
+        host::MergeOptions options;
+        options.format = setting.format;
+        options.read_blocks = setting.read_blocks;
+        options.io_threads = setting.io_threads;
+        host::LogMerger merger(options);
+        for (const std::string &path : paths) {
+            merger.add(path);
+        }
+        auto start = std::chrono::steady_clock::now();
+        host::MergeStats stats = merger.run([](const char *, size_t) { return true; });
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%-8s %11zu %7u %10.2f %8.0f %11.1f %11.2f %9llu\n",
+                    setting.format == host::ExportFormat::Csv ? "csv" : "columnar", setting.read_blocks,
+                    setting.io_threads, stats.samples / secs / 1e6, log_bytes / secs / 1e6,
+                    stats.buffer_bytes / 1048576.0, stats.read_wait_us / 1e6,
+                    (unsigned long long)stats.out_of_order);
+    }
+
+    for (const std::string &path : paths) {
+        std::remove(path.c_str());
+    }
+    return 0;
+}
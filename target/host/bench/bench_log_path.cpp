@@ -0,0 +1,108 @@
+// The whole logging path at several sample rates against emulated SD
+// and flash backends, to size buffers before raising the compass rate.
+// Samples go through a modelled sample ring into the real sd-log sink,
+// block encoder and sd_log buffers; the backends are host::FileBlockDev
+// and host::FileFlashDev in virtual time, so every figure comes from
+// their latency models, not from hardware.
+//
+//   bench_log_path [seconds] [ring size...]
+//
+// For each backend, rate and ring size it prints sustained write
+// throughput, high-water marks of the ring, the sink queue and the
+// sd_log buffers, samples dropped, and percentiles of commit latency:
+// from a buffer filling to its write finishing.
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "log_path_sim.hpp"
+
+// Timers the device modules ask for; virtual time is the harness's
+extern "C" uint32_t sd_log_port_time_us(void) {
+    return 0;
+}
+
+extern "C" uint64_t sink_port_time_us(void) {
+    return 0;
+}
+
+namespace {
+
+struct Backend {
+    const char *name;
+    std::function<std::unique_ptr<host::LogBackend>()> make;
+};
+
+// A decent card, then a worn one: slower, with long internal erases at
+// random on top of the periodic ones
+host::LatencyModel sd_card(bool worn) {
+    host::LatencyModel model;
+    model.base_us = 300;
+    model.per_block_us = 25;
+    model.spike_every = 500;
+    model.spike_us = 60000;
+    model.jitter_us = 200;
+    if (worn) {
+        model.base_us = 1500;
+        model.per_block_us = 60;
+        model.spike_every = 50;
+        model.spike_us = 250000;
+        model.jitter_us = 5000;
+    }
+    return model;
+}
+
+// W25Q typical erase with the datasheet-maximum erase now and then
+host::FlashTiming flash_chip() {
+    host::FlashTiming timing;
+    timing.erase_slow_every = 64;
+    timing.erase_jitter_us = 5000;
+    return timing;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    host::LogPathConfig config;
+    config.seconds = argc > 1 ? std::atof(argv[1]) : 3600;
+    std::vector<uint32_t> rings;
+    for (int i = 2; i < argc; ++i) {
+        rings.push_back(uint32_t(std::atoi(argv[i])));
+    }
+    if (rings.empty()) {
+        rings = {SAMPLE_RING_SIZE};
+    }
+
+    std::vector<Backend> backends = {
+        {"sd", [] { return std::make_unique<host::SdBackend>("bench_log_path.img", sd_card(false)); }},
+        {"sd-worn", [] { return std::make_unique<host::SdBackend>("bench_log_path.img", sd_card(true)); }},
+        {"flash", [] { return std::make_unique<host::FlashBackend>("bench_log_path.img", flash_chip(), false); }},
+        {"flash-ahead",
+         [] { return std::make_unique<host::FlashBackend>("bench_log_path.img", flash_chip(), true); }},
+    };
+
+    std::printf("%.0f s of samples per run, %d buffers of %d bytes, sink queue %d\n\n", config.seconds,
+                SD_LOG_BUFFER_COUNT, SD_LOG_BUFFER_SIZE, SINK_QUEUE_LEN);
+    std::printf("%-12s %6s %5s %9s %5s %5s %4s %9s %9s %9s %9s %9s %6s\n", "backend", "Hz", "ring", "KB/s",
+                "ring", "queue", "bufs", "dropped", "p50 us", "p99 us", "p999 us", "max us", "busy");
+    for (const Backend &b : backends) {
+        for (double rate : {20.0, 100.0, 500.0, 2000.0}) {
+            for (uint32_t ring : rings) {
+                config.rate_hz = rate;
+                config.ring_size = ring;
+                std::unique_ptr<host::LogBackend> backend = b.make();
+                host::LogPathReport r = host::run_log_path(*backend, config);
+                std::printf("%-12s %6.0f %5u %9.1f %5u %5u %4u %9llu %9llu %9llu %9llu %9llu %5.1f%%\n", b.name,
+                            rate, ring, r.throughput() / 1e3, r.ring_high_water, r.queue_high_water,
+                            r.buffers_high_water, (unsigned long long)(r.ring_dropped + r.queue_dropped),
+                            (unsigned long long)r.commit_percentile(0.50),
+                            (unsigned long long)r.commit_percentile(0.99),
+                            (unsigned long long)r.commit_percentile(0.999),
+                            (unsigned long long)r.commit_percentile(1.0), 100.0 * r.busy_us / r.elapsed_us);
+            }
+        }
+    }
+    return 0;
+}
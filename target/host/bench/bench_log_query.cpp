@@ -0,0 +1,140 @@
+// Time-range queries over a year of one device's logs. Writes a synthetic
+// recording (default one sample a second; the first argument sets the
+// rate in Hz) as 32 MiB log files, maps them, and times a few typical
+// queries at 1, 2, 4... threads up to the hardware thread count. The files
+// are in the page cache after writing, so this measures the query, not
+// the disk.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log_query.hpp"
+#include "mapped_file.hpp"
+
+namespace {
+
+const uint64_t HOUR_US = 3600000000ull;
+const uint32_t FILE_BLOCKS = 8192;
+
+struct Writer {
+    std::string prefix;
+    std::vector<std::string> paths;
+    FILE *file = nullptr;
+
+    // A FILE block starts the next log file
+    static bool emit(void *ctx, const uint8_t *block) {
+        auto *w = static_cast<Writer *>(ctx);
+        log_block_header_t hdr;
+        log_block_peek(block, &hdr);
+        if (hdr.type == LOG_BLOCK_FILE) {
+            if (w->file) {
+                std::fclose(w->file);
+            }
+            char name[32];
+            std::snprintf(name, sizeof(name), "%04zu.BIN", w->paths.size());
+            w->paths.push_back(w->prefix + name);
+            w->file = std::fopen(w->paths.back().c_str(), "wb");
+        }
+        return w->file && std::fwrite(block, 1, LOG_BLOCK_SIZE, w->file) == LOG_BLOCK_SIZE;
+    }
+};
+
+// Daily temperature cycle, slow heading drift and some tilt
+void record_year(Writer &writer, double rate_hz) {
+    static block_log_t log;
+    block_log_config_t config = {1, 0x5EED, FILE_BLOCKS, 0, LOG_NO_BLOCK, 0, 0};
+    block_log_init(&log, &config, Writer::emit, &writer);
+    uint64_t step_us = uint64_t(1e6 / rate_hz);
+    uint64_t samples = uint64_t(365 * 24 * 3600 * rate_hz);
+    for (uint64_t i = 0; i < samples; ++i) {
+        uint64_t t = i * step_us;
+        uint32_t minute = uint32_t(t / 60000000);
+        sample_t s;
+        sample_clear(&s, t);
+        sample_set(&s, SAMPLE_CH_TEMP, 2500 + int32_t(minute % 1440 < 720 ? minute % 720 : 720 - minute % 720));
+        sample_set(&s, SAMPLE_CH_HEADING, int32_t(minute / 7 % SAMPLE_HEADING_MODULUS));
+        sample_set(&s, SAMPLE_CH_PITCH, int32_t(i / 600 % 21) - 10);
+        sample_set(&s, SAMPLE_CH_ROLL, int32_t(i / 900 % 11) - 5);
+        block_log_add(&log, &s);
+    }
+    block_log_flush(&log);
+    std::fclose(writer.file);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    double rate_hz = argc > 1 ? std::strtod(argv[1], nullptr) : 1.0;
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+
+    Writer writer;
+    writer.prefix = argc > 2 ? argv[2] : "bench_log_query_";
+    record_year(writer, rate_hz);
+
+    std::vector<std::unique_ptr<host::MappedFile>> files;
+    host::LogQuery query;
+    uint64_t bytes = 0;
+    for (const std::string &path : writer.paths) {
+        files.push_back(std::make_unique<host::MappedFile>(path));
+        query.add_log(files.back()->data(), files.back()->size());
+        bytes += files.back()->size();
+    }
+    uint64_t end = query.last_time_us() + 1;
+    std::printf("one year at %g Hz: %zu logs, %.0f MiB, %u hardware threads\n", rate_hz, files.size(),
+                bytes / 1048576.0, hw);
+
+    struct Case {
+        const char *name;
+        host::QuerySpec spec;
+    };
+    std::vector<Case> cases(3);
+    cases[0].name = "hourly, whole year, all channels";
+    cases[0].spec.bucket_us = HOUR_US;
+    cases[1].name = "hourly, last 30 days, temperature";
+    cases[1].spec.t0 = end - 30 * 24 * HOUR_US;
+    cases[1].spec.bucket_us = HOUR_US;
+    cases[1].spec.channels = 1u << SAMPLE_CH_TEMP;
+    cases[2].name = "daily, whole year, heading";
+    cases[2].spec.bucket_us = 24 * HOUR_US;
+    cases[2].spec.channels = 1u << SAMPLE_CH_HEADING;
+
+    std::vector<unsigned> thread_counts;
+    for (unsigned t = 1; t < hw; t *= 2) {
+        thread_counts.push_back(t);
+    }
+    thread_counts.push_back(hw);
+
+    for (const Case &c : cases) {
+        std::printf("%s\n", c.name);
+        double base = 0;
+        for (unsigned threads : thread_counts) {
+            host::ThreadPool pool(threads);
+            double best = 1e9;
+            host::QueryResult result;
+            for (int r = 0; r < 3; ++r) {
+                auto t0 = std::chrono::steady_clock::now();
+                result = query.run(pool, c.spec);
+                best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+            }
+            if (threads == 1) {
+                base = best;
+            }
+            std::printf("  %2u threads %8.1f ms  %7.1f Msamples/s  %5zu buckets  %6llu blocks decoded  "
+                        "%6llu skipped  %5.2fx\n",
+                        threads, best * 1e3, result.stats.samples / best / 1e6, result.buckets.size(),
+                        (unsigned long long)result.stats.blocks_decoded,
+                        (unsigned long long)(result.stats.blocks_skipped), base / best);
+        }
+    }
+
+    files.clear();
+    for (const std::string &path : writer.paths) {
+        std::remove(path.c_str());
+    }
+    return 0;
+}
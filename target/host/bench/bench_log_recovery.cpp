@@ -0,0 +1,149 @@
+// Mount-to-first-logged-sample time after a power cut, for logs of
+// several GB. The card is host::FileBlockDev and all times come from its
+// read model, not from a real card.
+//
+// The checkpoint and tail search really run, against the last file of
+// the log cut off at random points. Only the last file matters to them,
+// so the earlier files are not written out. FatFs work is estimated from
+// the sectors it has to read: the boot sector, the FSInfo sector and a
+// directory scan for each of the two files opened. A scan of every block
+// header in the log, the approach the checkpoint replaces, is worked out
+// from the same model.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "file_block_dev.hpp"
+#include "log_checkpoint.h"
+#include "sd_log.h"
+
+// sd_log's write timer; not used here
+extern "C" uint32_t sd_log_port_time_us(void) {
+    return 0;
+}
+
+namespace {
+
+const uint32_t CKPT_LBA = 0;
+const uint32_t FILE_LBA = 8;
+const uint64_t FILE_BYTES = 32ull * 1024 * 1024;     // As FATFS_LOG_FILE_BYTES
+const uint32_t FILE_BLOCKS = uint32_t(FILE_BYTES / LOG_BLOCK_SIZE);
+const uint32_t SYNC_BLOCKS = 8;                      // As SD_LOG_SYNC_BUFFERS
+const uint32_t MOUNT_SECTORS = 2;
+const uint32_t DIR_ENTRY_BYTES = 32;
+
+// Straight from block_log to the card, with checkpoints at sync points
+struct Writer {
+    block_dev_t *dev;
+    raw_log_writer_t raw;
+    log_writer_t raw_writer;
+    log_checkpointer_t ckpt;
+    uint32_t since_sync = 0;
+
+    static bool emit(void *ctx, const uint8_t *block) {
+        auto *self = static_cast<Writer *>(ctx);
+        self->raw_writer.write(self->raw_writer.ctx, block, LOG_BLOCK_SIZE);
+        log_checkpointer_wrote(&self->ckpt, block, LOG_BLOCK_SIZE);
+        if (++self->since_sync == SYNC_BLOCKS) {
+            self->since_sync = 0;
+            if (block_dev_sync(self->dev) == BLOCK_OK) {
+                log_checkpointer_save(&self->ckpt, false);
+            }
+        }
+        return true;
+    }
+};
+
+struct Recovery {
+    uint64_t reads;
+    uint64_t read_us;
+};
+
+// Log into the file until the power goes after 'cut' writes, then recover
+Recovery cut_and_recover(host::FileBlockDev &card, uint32_t file_number, uint32_t log_id, uint64_t cut) {
+    Writer w;
+    w.dev = card.dev();
+    raw_log_writer_init(&w.raw, w.dev, FILE_LBA, FILE_BLOCKS * LOG_SECTORS_PER_BLOCK, &w.raw_writer);
+    log_checkpointer_init(&w.ckpt, w.dev, CKPT_LBA);
+    log_checkpointer_new_file(&w.ckpt, file_number, FILE_LBA, FILE_BLOCKS);
+    log_checkpointer_save(&w.ckpt, true);
+
+    static block_log_t log;
+    block_log_config_t config = {1, log_id, 0, 0, LOG_NO_BLOCK, 0, 0};
+    block_log_init(&log, &config, Writer::emit, &w);
+    card.cut_power_after(cut);
+    for (uint32_t i = 0; card.powered(); ++i) {
+        sample_t s;
+        sample_clear(&s, i * 10000ull);
+        sample_set(&s, SAMPLE_CH_TEMP, int32_t(i * 37 % 400));
+        sample_set(&s, SAMPLE_CH_HEADING, int32_t(i * 7919 % SAMPLE_HEADING_MODULUS));
+        sample_set(&s, SAMPLE_CH_PITCH, int32_t(i * 13 % 90) - 45);
+        block_log_add(&log, &s);
+    }
+    card.restore_power();
+
+    uint64_t reads = card.reads();
+    uint64_t read_us = card.read_time_us();
+    log_checkpointer_t ckpt;
+    log_checkpoint_t cp;
+    log_checkpoint_t rec;
+    uint32_t blocks_read;
+    static uint8_t scratch[LOG_BLOCK_SIZE];
+    log_checkpointer_init(&ckpt, card.dev(), CKPT_LBA);
+    if (log_checkpointer_load(&ckpt, &cp) == 1) {
+        log_recover(card.dev(), &cp, scratch, &rec, &blocks_read);
+    }
+    return {card.reads() - reads, card.read_time_us() - read_us};
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int trials = argc > 1 ? std::atoi(argv[1]) : 10;
+
+    // SD card in SPI mode at 25 MHz: about 170 us to move a sector, plus
+    // the command and the wait for the data token
+    host::LatencyModel model;
+    model.read_base_us = 300;
+    model.read_per_block_us = 170;
+    const double sector_us = model.read_base_us + model.read_per_block_us;
+
+    std::string path = "bench_log_recovery.img";
+    host::FileBlockDev card(path, FILE_LBA + FILE_BLOCKS * LOG_SECTORS_PER_BLOCK, model);
+    card.set_virtual_time(true);
+    block_dev_init(card.dev());
+
+    std::printf("read model: %u us + %u us/sector; %d power cuts per size, %llu MiB files\n\n",
+                model.read_base_us, model.read_per_block_us, trials, (unsigned long long)(FILE_BYTES >> 20));
+    std::printf("%8s %6s %10s %12s %12s %12s %14s\n", "log GiB", "files", "FatFs ms", "recover ms",
+                "max ms", "first sample", "header scan s");
+
+    std::mt19937 rng(11);
+    for (uint32_t gib : {1u, 4u, 16u, 64u}) {
+        uint32_t files = uint32_t((uint64_t(gib) << 30) / FILE_BYTES);
+        std::uniform_int_distribution<uint64_t> cut(2, FILE_BLOCKS - 1);
+
+        double total_us = 0;
+        double max_us = 0;
+        uint64_t reads = 0;
+        for (int t = 0; t < trials; ++t) {
+            Recovery r = cut_and_recover(card, files - 1, uint32_t(rng()), cut(rng));
+            total_us += double(r.read_us);
+            max_us = std::max(max_us, double(r.read_us));
+            reads += r.reads;
+        }
+
+        // Mount, then two opens that each scan the root directory
+        uint32_t dir_sectors = ((files + 2) * DIR_ENTRY_BYTES + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        double fatfs_us = (MOUNT_SECTORS + 2 * dir_sectors) * sector_us;
+        double recover_us = total_us / trials;
+        double scan_s = double(uint64_t(gib) << 30) / LOG_BLOCK_SIZE * sector_us / 1e6;
+        std::printf("%8u %6u %10.1f %12.1f %12.1f %9.1f ms %14.0f   (%.1f reads)\n", gib, files, fatfs_us / 1e3,
+                    recover_us / 1e3, max_us / 1e3, (fatfs_us + recover_us) / 1e3, scan_s, double(reads) / trials);
+    }
+    std::remove(path.c_str());
+    return 0;
+}
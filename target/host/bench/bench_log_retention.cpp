@@ -0,0 +1,117 @@
+// Months of logging to an emulated card, to show that rotating the log and
+// dropping old data never hold up acquisition. Samples take the device's
+// logging path (see bench_log_path) into a pool of segments on a
+// host::SegmentStore, with the log cut once a day or when a segment is
+// full, in virtual time.
+//
+//   bench_log_retention [days] [rate Hz] [retain days]
+//
+// Three ways of running the pool:
+//
+//   grow     a new segment allocated at each rotation and nothing
+//            dropped, as the firmware did before segments
+//   recycle  at the pool's limit the oldest segment is renamed into the
+//            next one; no upkeep while idle
+//   retain   spares allocated ahead and expired segments retired while
+//            idle, so a rotation is a rename
+//
+// For each it prints the segment operations, the card space the pool
+// reached, the median and worst write that rotated, the worst idle step,
+// commit latency percentiles and what was dropped. Every figure comes
+// from the emulated card's latency model.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "log_path_sim.hpp"
+
+// Timers the device modules ask for; virtual time is the harness's
+extern "C" uint32_t sd_log_port_time_us(void) {
+    return 0;
+}
+
+extern "C" uint64_t sink_port_time_us(void) {
+    return 0;
+}
+
+namespace {
+
+struct Mode {
+    const char *name;
+    bool upkeep;
+    bool bounded;
+};
+
+// A decent card that pays for leaving its sequential run, reading the
+// FAT and directory as it goes
+host::LatencyModel sd_card() {
+    host::LatencyModel model;
+    model.base_us = 300;
+    model.per_block_us = 25;
+    model.spike_every = 500;
+    model.spike_us = 60000;
+    model.nonsequential_us = 2000;
+    model.jitter_us = 200;
+    model.read_base_us = 200;
+    model.read_per_block_us = 20;
+    return model;
+}
+
+uint64_t percentile(std::vector<uint64_t> us, double p) {
+    if (us.empty()) {
+        return 0;
+    }
+    std::sort(us.begin(), us.end());
+    return us[std::min(us.size() - 1, size_t(p * us.size()))];
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    double days = argc > 1 ? std::atof(argv[1]) : 180;
+    double rate = argc > 2 ? std::atof(argv[2]) : 1;
+    double retain_days = argc > 3 ? std::atof(argv[3]) : 30;
+    const uint64_t day_us = 86400ull * 1000000;
+
+    host::LogPathConfig config;
+    config.rate_hz = rate;
+    config.seconds = days * 86400;
+    config.poll_us = 10000;
+    config.file_us = day_us;
+
+    // A day of samples fits a segment, with room to spare
+    host::SegmentStoreConfig store;
+    store.segment_blocks = 256;
+    config.file_blocks = store.segment_blocks;
+    uint32_t budget = uint32_t(retain_days) + 4;
+
+    std::printf("%.0f days at %.0f Hz, %u KiB segments cut daily, %.0f days kept, pool of %u\n\n", days, rate,
+                unsigned(store.segment_blocks * LOG_BLOCK_SIZE / 1024), retain_days, budget);
+    std::printf("%-8s %5s %6s %6s %6s %6s %6s %8s %9s %9s %10s %9s %9s %9s %7s\n", "mode", "rot", "inline",
+                "recyc", "prep", "retire", "remove", "peak MiB", "rot p50", "rot max", "upkeep max", "p50 us",
+                "p999 us", "max us", "dropped");
+
+    for (const Mode &mode : {Mode{"grow", false, false}, Mode{"recycle", false, true}, Mode{"retain", true, true}}) {
+        log_segments_config_t segments = {};
+        segments.max_segments = mode.bounded ? budget : UINT32_MAX;
+        segments.spares = mode.upkeep ? LOG_SEGMENTS_SPARES : 0;
+        segments.retain_us = mode.upkeep ? uint64_t(retain_days * day_us) : 0;
+        store.slots = mode.bounded ? budget : uint32_t(days) + 4;
+
+        host::SegmentBackend backend("bench_log_retention.img", sd_card(), store, segments, mode.upkeep);
+        host::LogPathReport r = host::run_log_path(backend, config);
+        const log_segments_stats_t &st = backend.segments().stats;
+        std::printf("%-8s %5u %6u %6u %6u %6u %6u %8.0f %9llu %9llu %10llu %9llu %9llu %9llu %7llu\n",
+                    mode.name, st.rotations, st.inline_creates, st.recycled, st.prepared, st.retired, st.removed,
+                    backend.peak_slots() * store.segment_blocks * (LOG_BLOCK_SIZE / 1024.0) / 1024.0,
+                    (unsigned long long)percentile(backend.rotation_us(), 0.5),
+                    (unsigned long long)percentile(backend.rotation_us(), 1.0),
+                    (unsigned long long)percentile(backend.upkeep_us(), 1.0),
+                    (unsigned long long)r.commit_percentile(0.5),
+                    (unsigned long long)r.commit_percentile(0.999),
+                    (unsigned long long)r.commit_percentile(1.0),
+                    (unsigned long long)(r.ring_dropped + r.queue_dropped));
+    }
+    return 0;
+}
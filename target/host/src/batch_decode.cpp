@@ -0,0 +1,344 @@
+#include "batch_decode.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <limits>
+
+// The SIMD kernels are built with per-function target attributes and picked
+// at run time, so the library still runs on CPUs without AVX2.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_DECODE_X86 1
+#define BATCH_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define BATCH_DECODE_X86 1
+#define BATCH_TARGET(isa)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace host {
+
+// The transposing kernels rely on this layout: the first 32 bytes of each
+// sample hold the time, valid and the five channels decoded here. The
+// channels after them are not loaded.
+static_assert(sizeof(sample_t) >= 32, "sample_t layout changed");
+static_assert(offsetof(sample_t, valid) == 8, "sample_t layout changed");
+static_assert(offsetof(sample_t, value) == 12, "sample_t layout changed");
+static_assert(SAMPLE_CH_TEMP == 0 && SAMPLE_CH_HEADING == 1 && SAMPLE_CH_PITCH == 3 && SAMPLE_CH_ROLL == 4,
+              "sample_t layout changed");
+
+namespace {
+
+constexpr float kNaN = std::numeric_limits<float>::quiet_NaN();
+constexpr float kQ7 = 1.0f / 128.0f;
+constexpr float kTenths = 10.0f;
+
+// Pointers to the first output row of a batch
+struct OutRows {
+    uint64_t *time_us;
+    uint32_t *valid;
+    int32_t *temp_centi;
+    float *temp_c;
+    float *heading_deg;
+    float *pitch_deg;
+    float *roll_deg;
+};
+
+// raw * scale_mul / 2^scale_shift / 10^decimals, worked out in double so
+// the float is the nearest to the exact value
+void decode_others(const sample_t *in, size_t count, EngColumns &out, size_t offset) {
+    for (size_t k = 0; k < kOtherColumnCount; ++k) {
+        const OtherColumn &c = kOtherColumns[k];
+        const sample_channel_info_t &info = sample_channels[c.channel];
+        double scale = static_cast<double>(info.scale_mul) / static_cast<double>(1u << info.scale_shift);
+        for (int d = 0; d < info.decimals; ++d) {
+            scale /= 10;
+        }
+        float *column = (out.*c.column).data() + offset;
+        uint32_t bit = 1u << c.channel;
+        for (size_t i = 0; i < count; ++i) {
+            column[i] = (in[i].valid & bit) ? static_cast<float>(in[i].value[c.channel] * scale) : kNaN;
+        }
+    }
+}
+
+// Reference conversion; the SIMD kernels must match it bit for bit
+void decode_scalar(const sample_t *in, size_t count, const OutRows &out) {
+    for (size_t i = 0; i < count; ++i) {
+        const sample_t &s = in[i];
+        out.time_us[i] = s.time_us;
+        out.valid[i] = s.valid;
+
+        bool temp = (s.valid & (1u << SAMPLE_CH_TEMP)) != 0;
+        // Same expression as the firmware's text output (main.c)
+        out.temp_centi[i] = temp ? s.value[SAMPLE_CH_TEMP] * 100 >> 7 : 0;
+        out.temp_c[i] = temp ? static_cast<float>(s.value[SAMPLE_CH_TEMP]) * kQ7 : kNaN;
+        out.heading_deg[i] = (s.valid & (1u << SAMPLE_CH_HEADING))
+                                 ? static_cast<float>(s.value[SAMPLE_CH_HEADING]) / kTenths
+                                 : kNaN;
+        out.pitch_deg[i] = (s.valid & (1u << SAMPLE_CH_PITCH)) ? static_cast<float>(s.value[SAMPLE_CH_PITCH]) : kNaN;
+        out.roll_deg[i] = (s.valid & (1u << SAMPLE_CH_ROLL)) ? static_cast<float>(s.value[SAMPLE_CH_ROLL]) : kNaN;
+    }
+}
+
+#ifdef BATCH_DECODE_X86
+
+// Lanes whose sample has channel 'ch'
+BATCH_TARGET("sse4.1") inline __m128i has_ch_128(__m128i valid, int ch) {
+    __m128i bit = _mm_set1_epi32(1 << ch);
+    return _mm_cmpeq_epi32(_mm_and_si128(valid, bit), bit);
+}
+
+BATCH_TARGET("sse4.1") inline __m128 channel_or_nan_128(__m128i mask, __m128 value) {
+    return _mm_blendv_ps(_mm_set1_ps(kNaN), value, _mm_castsi128_ps(mask));
+}
+
+// Four samples per step: 4x4 transposes of the two 16-byte halves
+BATCH_TARGET("sse4.1") void decode_sse41(const sample_t *in, size_t count, const OutRows &out) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i *p0 = reinterpret_cast<const __m128i *>(&in[i]);
+        const __m128i *p1 = reinterpret_cast<const __m128i *>(&in[i + 1]);
+        const __m128i *p2 = reinterpret_cast<const __m128i *>(&in[i + 2]);
+        const __m128i *p3 = reinterpret_cast<const __m128i *>(&in[i + 3]);
+        // Per sample: a = time lo, time hi, valid, temp; b = heading, angle8, pitch, roll
+        __m128i a0 = _mm_loadu_si128(p0), b0 = _mm_loadu_si128(p0 + 1);
+        __m128i a1 = _mm_loadu_si128(p1), b1 = _mm_loadu_si128(p1 + 1);
+        __m128i a2 = _mm_loadu_si128(p2), b2 = _mm_loadu_si128(p2 + 1);
+        __m128i a3 = _mm_loadu_si128(p3), b3 = _mm_loadu_si128(p3 + 1);
+
+        // Times are already contiguous 64-bit values in the a rows
+        __m128i t01 = _mm_unpacklo_epi64(a0, a1);
+        __m128i t23 = _mm_unpacklo_epi64(a2, a3);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.time_us[i]), t01);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.time_us[i + 2]), t23);
+
+        __m128i ah01 = _mm_unpackhi_epi32(a0, a1);      // v0 v1 t0 t1
+        __m128i ah23 = _mm_unpackhi_epi32(a2, a3);
+        __m128i valid = _mm_unpacklo_epi64(ah01, ah23);
+        __m128i temp = _mm_unpackhi_epi64(ah01, ah23);
+
+        __m128i bl01 = _mm_unpacklo_epi32(b0, b1);      // h0 h1 x0 x1
+        __m128i bl23 = _mm_unpacklo_epi32(b2, b3);
+        __m128i bh01 = _mm_unpackhi_epi32(b0, b1);      // p0 p1 r0 r1
+        __m128i bh23 = _mm_unpackhi_epi32(b2, b3);
+        __m128i heading = _mm_unpacklo_epi64(bl01, bl23);
+        __m128i pitch = _mm_unpacklo_epi64(bh01, bh23);
+        __m128i roll = _mm_unpackhi_epi64(bh01, bh23);
+
+        __m128i has_temp = has_ch_128(valid, SAMPLE_CH_TEMP);
+        __m128i centi = _mm_srai_epi32(_mm_mullo_epi32(temp, _mm_set1_epi32(100)), 7);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.valid[i]), valid);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&out.temp_centi[i]), _mm_and_si128(centi, has_temp));
+        _mm_storeu_ps(&out.temp_c[i],
+                      channel_or_nan_128(has_temp, _mm_mul_ps(_mm_cvtepi32_ps(temp), _mm_set1_ps(kQ7))));
+        _mm_storeu_ps(&out.heading_deg[i],
+                      channel_or_nan_128(has_ch_128(valid, SAMPLE_CH_HEADING),
+                                         _mm_div_ps(_mm_cvtepi32_ps(heading), _mm_set1_ps(kTenths))));
+        _mm_storeu_ps(&out.pitch_deg[i],
+                      channel_or_nan_128(has_ch_128(valid, SAMPLE_CH_PITCH), _mm_cvtepi32_ps(pitch)));
+        _mm_storeu_ps(&out.roll_deg[i], channel_or_nan_128(has_ch_128(valid, SAMPLE_CH_ROLL), _mm_cvtepi32_ps(roll)));
+    }
+
+    OutRows tail = {out.time_us + i, out.valid + i, out.temp_centi + i, out.temp_c + i,
+                    out.heading_deg + i, out.pitch_deg + i, out.roll_deg + i};
+    decode_scalar(in + i, count - i, tail);
+}
+
+BATCH_TARGET("avx2") inline __m256i has_ch_256(__m256i valid, int ch) {
+    __m256i bit = _mm256_set1_epi32(1 << ch);
+    return _mm256_cmpeq_epi32(_mm256_and_si256(valid, bit), bit);
+}
+
+BATCH_TARGET("avx2") inline __m256 channel_or_nan_256(__m256i mask, __m256 value) {
+    return _mm256_blendv_ps(_mm256_set1_ps(kNaN), value, _mm256_castsi256_ps(mask));
+}
+
+// Eight samples per step: one 8x8 transpose of 32-bit words
+BATCH_TARGET("avx2") void decode_avx2(const sample_t *in, size_t count, const OutRows &out) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i r[8];
+        for (int k = 0; k < 8; ++k) {
+            r[k] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&in[i + k]));
+        }
+
+        // Rows are samples (tlo thi valid temp heading angle8 pitch roll);
+        // after the transpose, c[k] holds word k of all eight samples
+        __m256i u0 = _mm256_unpacklo_epi32(r[0], r[1]);
+        __m256i u1 = _mm256_unpackhi_epi32(r[0], r[1]);
+        __m256i u2 = _mm256_unpacklo_epi32(r[2], r[3]);
+        __m256i u3 = _mm256_unpackhi_epi32(r[2], r[3]);
+        __m256i u4 = _mm256_unpacklo_epi32(r[4], r[5]);
+        __m256i u5 = _mm256_unpackhi_epi32(r[4], r[5]);
+        __m256i u6 = _mm256_unpacklo_epi32(r[6], r[7]);
+        __m256i u7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+        __m256i w0 = _mm256_unpacklo_epi64(u0, u2);
+        __m256i w1 = _mm256_unpackhi_epi64(u0, u2);
+        __m256i w2 = _mm256_unpacklo_epi64(u1, u3);
+        __m256i w3 = _mm256_unpackhi_epi64(u1, u3);
+        __m256i w4 = _mm256_unpacklo_epi64(u4, u6);
+        __m256i w5 = _mm256_unpackhi_epi64(u4, u6);
+        __m256i w6 = _mm256_unpacklo_epi64(u5, u7);
+        __m256i w7 = _mm256_unpackhi_epi64(u5, u7);
+
+        __m256i tlo = _mm256_permute2x128_si256(w0, w4, 0x20);
+        __m256i thi = _mm256_permute2x128_si256(w1, w5, 0x20);
+        __m256i valid = _mm256_permute2x128_si256(w2, w6, 0x20);
+        __m256i temp = _mm256_permute2x128_si256(w3, w7, 0x20);
+        __m256i heading = _mm256_permute2x128_si256(w0, w4, 0x31);
+        __m256i pitch = _mm256_permute2x128_si256(w2, w6, 0x31);
+        __m256i roll = _mm256_permute2x128_si256(w3, w7, 0x31);
+
+        // Re-pair the time halves into 64-bit values in sample order
+        __m256i tl = _mm256_unpacklo_epi32(tlo, thi);   // t0 t1 | t4 t5
+        __m256i th = _mm256_unpackhi_epi32(tlo, thi);   // t2 t3 | t6 t7
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&out.time_us[i]), _mm256_permute2x128_si256(tl, th, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&out.time_us[i + 4]),
+                            _mm256_permute2x128_si256(tl, th, 0x31));
+
+        __m256i has_temp = has_ch_256(valid, SAMPLE_CH_TEMP);
+        __m256i centi = _mm256_srai_epi32(_mm256_mullo_epi32(temp, _mm256_set1_epi32(100)), 7);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&out.valid[i]), valid);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&out.temp_centi[i]), _mm256_and_si256(centi, has_temp));
+        _mm256_storeu_ps(&out.temp_c[i],
+                         channel_or_nan_256(has_temp, _mm256_mul_ps(_mm256_cvtepi32_ps(temp), _mm256_set1_ps(kQ7))));
+        _mm256_storeu_ps(&out.heading_deg[i],
+                         channel_or_nan_256(has_ch_256(valid, SAMPLE_CH_HEADING),
+                                            _mm256_div_ps(_mm256_cvtepi32_ps(heading), _mm256_set1_ps(kTenths))));
+        _mm256_storeu_ps(&out.pitch_deg[i],
+                         channel_or_nan_256(has_ch_256(valid, SAMPLE_CH_PITCH), _mm256_cvtepi32_ps(pitch)));
+        _mm256_storeu_ps(&out.roll_deg[i],
+                         channel_or_nan_256(has_ch_256(valid, SAMPLE_CH_ROLL), _mm256_cvtepi32_ps(roll)));
+    }
+
+    OutRows tail = {out.time_us + i, out.valid + i, out.temp_centi + i, out.temp_c + i,
+                    out.heading_deg + i, out.pitch_deg + i, out.roll_deg + i};
+    decode_sse41(in + i, count - i, tail);
+}
+
+#if defined(_MSC_VER) && !defined(__clang__)
+bool cpu_has(Kernel kernel) {
+    int info[4];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (kernel == Kernel::Sse41) {
+        return sse41;
+    }
+    if (!osxsave || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+}
+#else
+bool cpu_has(Kernel kernel) {
+    __builtin_cpu_init();
+    return kernel == Kernel::Sse41 ? __builtin_cpu_supports("sse4.1") : __builtin_cpu_supports("avx2");
+}
+#endif
+
+#endif  // BATCH_DECODE_X86
+
+}  // namespace
+
+const OtherColumn kOtherColumns[] = {
+    {SAMPLE_CH_ANGLE8, "angle8", &EngColumns::angle8},
+    {SAMPLE_CH_UVA, "uva", &EngColumns::uva},
+    {SAMPLE_CH_UVB, "uvb", &EngColumns::uvb},
+    {SAMPLE_CH_UV_INDEX, "uv_index", &EngColumns::uv_index},
+    {SAMPLE_CH_PRESSURE, "pressure_pa", &EngColumns::pressure_pa},
+    {SAMPLE_CH_PRESSURE_TEMP, "press_temp_c", &EngColumns::pressure_temp_c},
+    {SAMPLE_CH_HUMIDITY, "humidity_pct", &EngColumns::humidity_pct},
+    {SAMPLE_CH_HUMIDITY_TEMP, "humid_temp_c", &EngColumns::humidity_temp_c},
+};
+const size_t kOtherColumnCount = sizeof(kOtherColumns) / sizeof(kOtherColumns[0]);
+
+// A new channel needs a column here, or it would not be exported
+static_assert(sizeof(kOtherColumns) / sizeof(kOtherColumns[0]) == SAMPLE_CH_COUNT - 4,
+              "every channel needs an export column");
+
+void EngColumns::resize(size_t n) {
+    time_us.resize(n);
+    valid.resize(n);
+    temp_centi.resize(n);
+    temp_c.resize(n);
+    heading_deg.resize(n);
+    pitch_deg.resize(n);
+    roll_deg.resize(n);
+    for (size_t k = 0; k < kOtherColumnCount; ++k) {
+        (this->*kOtherColumns[k].column).resize(n);
+    }
+}
+
+// Whether this build and CPU can run a kernel
+bool kernel_supported(Kernel kernel) {
+    switch (kernel) {
+    case Kernel::Auto:
+    case Kernel::Scalar:
+        return true;
+#ifdef BATCH_DECODE_X86
+    case Kernel::Sse41:
+        return cpu_has(Kernel::Sse41);
+    case Kernel::Avx2:
+        return cpu_has(Kernel::Avx2) && cpu_has(Kernel::Sse41);
+#else
+    default:
+        return false;
+#endif
+    }
+    return false;
+}
+
+// Widest supported kernel, detected once
+Kernel best_kernel() {
+    static const Kernel best = kernel_supported(Kernel::Avx2)    ? Kernel::Avx2
+                               : kernel_supported(Kernel::Sse41) ? Kernel::Sse41
+                                                                 : Kernel::Scalar;
+    return best;
+}
+
+const char *kernel_name(Kernel kernel) {
+    switch (kernel) {
+    case Kernel::Auto:
+        return kernel_name(best_kernel());
+    case Kernel::Scalar:
+        return "scalar";
+    case Kernel::Sse41:
+        return "sse4.1";
+    case Kernel::Avx2:
+        return "avx2";
+    }
+    return "?";
+}
+
+void decode_batch(const sample_t *samples, size_t count, EngColumns &out, size_t offset, Kernel kernel) {
+    if (kernel == Kernel::Auto || !kernel_supported(kernel)) {
+        kernel = best_kernel();
+    }
+
+    OutRows rows = {out.time_us.data() + offset, out.valid.data() + offset, out.temp_centi.data() + offset,
+                    out.temp_c.data() + offset, out.heading_deg.data() + offset, out.pitch_deg.data() + offset,
+                    out.roll_deg.data() + offset};
+    switch (kernel) {
+#ifdef BATCH_DECODE_X86
+    case Kernel::Avx2:
+        decode_avx2(samples, count, rows);
+        break;
+    case Kernel::Sse41:
+        decode_sse41(samples, count, rows);
+        break;
+#endif
+    default:
+        decode_scalar(samples, count, rows);
+        break;
+    }
+    decode_others(samples, count, out, offset);
+}
+
+}  // namespace host
@@ -0,0 +1,62 @@
+#ifndef BATCH_DECODE_HPP
+#define BATCH_DECODE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "sample.h"
+
+namespace host {
+
+// Engineering-unit columns for a batch of samples. Channels missing from a
+// sample come out as NaN (and 0 in temp_centi).
+struct EngColumns {
+    std::vector<uint64_t> time_us;
+    std::vector<uint32_t> valid;
+    std::vector<int32_t> temp_centi;    // Hundredths of a degree, exactly as the device prints it
+    std::vector<float> temp_c;
+    std::vector<float> heading_deg;
+    std::vector<float> pitch_deg;
+    std::vector<float> roll_deg;
+    // The other channels, in engineering units
+    std::vector<float> angle8;
+    std::vector<float> uva;
+    std::vector<float> uvb;
+    std::vector<float> uv_index;
+    std::vector<float> pressure_pa;
+    std::vector<float> pressure_temp_c;
+    std::vector<float> humidity_pct;
+    std::vector<float> humidity_temp_c;
+
+    void resize(size_t n);
+    size_t size() const { return time_us.size(); }
+};
+
+// The channels that the kernels below do not transpose, in channel order.
+// Each is scaled as its sample_channels entry says. The exports take
+// their column names and order from here.
+struct OtherColumn {
+    sample_channel_t channel;
+    const char *name;           // Up to 12 characters, for the columnar export
+    std::vector<float> EngColumns::*column;
+};
+
+extern const OtherColumn kOtherColumns[];
+extern const size_t kOtherColumnCount;
+
+// Conversion kernels; Auto picks the widest one the CPU supports
+enum class Kernel { Auto, Scalar, Sse41, Avx2 };
+
+bool kernel_supported(Kernel kernel);
+Kernel best_kernel();
+const char *kernel_name(Kernel kernel);
+
+// Convert 'count' samples into out[offset, offset + count). 'out' must
+// already be large enough; disjoint ranges may be filled from several threads.
+void decode_batch(const sample_t *samples, size_t count, EngColumns &out, size_t offset = 0,
+                  Kernel kernel = Kernel::Auto);
+
+}  // namespace host
+
+#endif
@@ -0,0 +1,114 @@
+#include "block_log_reader.hpp"
+
+namespace host {
+
+// Check the FILE block and learn the channel table
+BlockLogReader::BlockLogReader(const uint8_t *data, size_t size)
+    : data_(data), blocks_(size / LOG_BLOCK_SIZE) {
+    log_block_header_t hdr;
+    if (blocks_ == 0 || parse(0, &hdr) != LOG_OK || hdr.type != LOG_BLOCK_FILE) {
+        return;
+    }
+    channels_.resize(LOG_CHANNELS_MAX);
+    channels_.resize(log_file_channels(block(0), &hdr, channels_.data(), channels_.size()));
+    device_id_ = hdr.device_id;
+    log_id_ = log_file_id(block(0), &hdr);
+    valid_ = true;
+}
+
+int BlockLogReader::parse(size_t i, log_block_header_t *hdr) {
+    stats_.blocks_parsed++;
+    int rc = log_block_parse(block(i), log_id_, hdr);
+    if (rc != LOG_OK && rc != LOG_ERR_MAGIC) {
+        stats_.bad_blocks++;
+    }
+    return rc;
+}
+
+// The newest index block is at most one interval from the end
+size_t BlockLogReader::find_last_index() {
+    log_block_header_t hdr;
+    size_t stop = blocks_ > LOG_INDEX_INTERVAL + 1 ? blocks_ - LOG_INDEX_INTERVAL - 1 : 0;
+    for (size_t i = blocks_; i-- > stop;) {
+        if (parse(i, &hdr) == LOG_OK && hdr.type == LOG_BLOCK_INDEX) {
+            return i;
+        }
+    }
+    return LOG_NO_BLOCK;
+}
+
+// Fallback: the first data block whose time range reaches time_us
+size_t BlockLogReader::scan(uint64_t time_us) {
+    log_block_header_t hdr;
+    for (size_t i = 1; i < blocks_; ++i) {
+        if (parse(i, &hdr) == LOG_OK && hdr.type == LOG_BLOCK_DATA && hdr.last_time_us >= time_us) {
+            return i;
+        }
+    }
+    return blocks_;
+}
+
+// Walk the index chain back from the newest index block to the one
+// covering time_us, then pick the entry for it. Entries are trusted only
+// if the block they name says it was written there.
+size_t BlockLogReader::seek(uint64_t time_us) {
+    log_index_entry_t entries[LOG_INDEX_INTERVAL];
+    log_block_header_t hdr;
+
+    size_t at = find_last_index();
+    if (at == LOG_NO_BLOCK) {
+        return scan(time_us);
+    }
+    while (true) {
+        stats_.index_blocks++;
+        if (parse(at, &hdr) != LOG_OK || hdr.type != LOG_BLOCK_INDEX || hdr.seq != at) {
+            return scan(time_us);
+        }
+        uint32_t prev = LOG_NO_BLOCK;
+        size_t count = log_index_entries(block(at), &hdr, entries, LOG_INDEX_INTERVAL, &prev);
+        if (count == 0) {
+            return scan(time_us);
+        }
+        if (time_us >= entries[0].first_time_us || prev == LOG_NO_BLOCK || prev >= at) {
+            size_t target = entries[log_index_find(entries, count, time_us)].block;
+            log_block_header_t data;
+            if (target >= blocks_ || parse(target, &data) != LOG_OK || data.seq != target) {
+                return scan(time_us);
+            }
+            return target;
+        }
+        at = prev;
+    }
+}
+
+// Blocks are in time order, so reading stops at the first block that
+// starts at or after t1
+size_t BlockLogReader::read_range(uint64_t t0, uint64_t t1, const SampleCallback &on_sample) {
+    log_block_header_t hdr;
+    log_cursor_t cursor;
+    sample_t s;
+    size_t delivered = 0;
+
+    for (size_t i = seek(t0); i < blocks_; ++i) {
+        if (parse(i, &hdr) != LOG_OK || hdr.type != LOG_BLOCK_DATA) {
+            continue;
+        }
+        if (hdr.first_time_us >= t1) {
+            break;
+        }
+        if (hdr.last_time_us < t0) {
+            continue;
+        }
+        log_cursor_init(&cursor, block(i), &hdr);
+        while (log_cursor_next(&cursor, &s) == 1) {
+            if (s.time_us >= t0 && s.time_us < t1) {
+                on_sample(s);
+                delivered++;
+            }
+        }
+    }
+    stats_.samples += delivered;
+    return delivered;
+}
+
+}  // namespace host
@@ -0,0 +1,62 @@
+#ifndef BLOCK_LOG_READER_HPP
+#define BLOCK_LOG_READER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "block_log.h"
+#include "sample.h"
+
+namespace host {
+
+// Reads a block log (block_log.h) held in memory. Time-range reads find
+// their first block through the sparse index, touching one index block
+// per LOG_INDEX_INTERVAL data blocks instead of every block; damaged or
+// missing index blocks fall back to a scan.
+class BlockLogReader {
+public:
+    struct Stats {
+        uint64_t blocks_parsed = 0;     // Headers checked, including index blocks
+        uint64_t index_blocks = 0;      // Index blocks read while seeking
+        uint64_t bad_blocks = 0;        // CRC or format errors (skipped)
+        uint64_t samples = 0;           // Samples delivered
+    };
+
+    using SampleCallback = std::function<void(const sample_t &)>;
+
+    BlockLogReader(const uint8_t *data, size_t size);
+
+    bool valid() const { return valid_; }
+    uint64_t device_id() const { return device_id_; }
+    uint32_t log_id() const { return log_id_; }
+    size_t block_count() const { return blocks_; }
+    const std::vector<log_channel_desc_t> &channels() const { return channels_; }
+
+    // Position of the first block that can hold samples at or after time_us
+    size_t seek(uint64_t time_us);
+
+    // Deliver every sample with t0 <= time < t1, in order; returns the count
+    size_t read_range(uint64_t t0, uint64_t t1, const SampleCallback &on_sample);
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    const uint8_t *block(size_t i) const { return data_ + i * LOG_BLOCK_SIZE; }
+    int parse(size_t i, log_block_header_t *hdr);
+    size_t find_last_index();
+    size_t scan(uint64_t time_us);
+
+    const uint8_t *data_;
+    size_t blocks_;
+    bool valid_ = false;
+    uint64_t device_id_ = 0;
+    uint32_t log_id_ = 0;
+    std::vector<log_channel_desc_t> channels_;
+    Stats stats_;
+};
+
+}  // namespace host
+
+#endif
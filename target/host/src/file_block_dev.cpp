@@ -0,0 +1,127 @@
+#include "file_block_dev.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace host {
+
+// Create (or truncate) the backing file, filled with 0xFF like an erased card
+FileBlockDev::FileBlockDev(const std::string &path, uint32_t block_count, LatencyModel latency)
+    : path_(path), capacity_(block_count), latency_(latency), rng_(latency.seed), dev_() {
+    file_.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file_) {
+        throw std::runtime_error("cannot create " + path);
+    }
+    std::vector<char> erased(BLOCK_SIZE, '\xFF');
+    for (uint32_t i = 0; i < block_count; ++i) {
+        file_.write(erased.data(), BLOCK_SIZE);
+    }
+    file_.flush();
+
+    static const block_dev_ops_t ops = {init, read, write_start, write_poll, sync};
+    dev_.ops = &ops;
+    dev_.ctx = this;
+}
+
+int FileBlockDev::init(block_dev_t *dev) {
+    auto *self = static_cast<FileBlockDev *>(dev->ctx);
+    dev->block_count = self->capacity_;
+    return BLOCK_OK;
+}
+
+int FileBlockDev::read(block_dev_t *dev, uint32_t lba, uint8_t *buf, uint32_t count) {
+    auto *self = static_cast<FileBlockDev *>(dev->ctx);
+    if (self->pending_) {
+        return BLOCK_BUSY;
+    }
+    if (uint64_t(lba) + count > self->capacity_) {
+        return BLOCK_RANGE;
+    }
+    self->reads_++;
+    self->read_time_us_ += self->latency_.read_base_us + uint64_t(self->latency_.read_per_block_us) * count;
+    self->file_.seekg(std::streamoff(lba) * BLOCK_SIZE);
+    self->file_.read(reinterpret_cast<char *>(buf), std::streamsize(count) * BLOCK_SIZE);
+    return self->file_ ? BLOCK_OK : BLOCK_ERROR;
+}
+
+// Accept the write and work out when the emulated device will be done
+int FileBlockDev::write_start(block_dev_t *dev, uint32_t lba, const uint8_t *buf, uint32_t count) {
+    auto *self = static_cast<FileBlockDev *>(dev->ctx);
+    if (self->pending_) {
+        return BLOCK_BUSY;
+    }
+    if (uint64_t(lba) + count > self->capacity_) {
+        return BLOCK_RANGE;
+    }
+    if (self->fail_writes_ || self->power_off_) {
+        return BLOCK_ERROR;
+    }
+    if (self->writes_ == self->cut_at_) {
+        self->power_off_ = true;
+        uint32_t landed = std::min(self->torn_blocks_, count);
+        self->file_.seekp(std::streamoff(lba) * BLOCK_SIZE);
+        self->file_.write(reinterpret_cast<const char *>(buf), std::streamsize(landed) * BLOCK_SIZE);
+        self->file_.flush();
+        return BLOCK_ERROR;
+    }
+
+    const LatencyModel &m = self->latency_;
+    uint64_t us = m.base_us + uint64_t(m.per_block_us) * count;
+    self->writes_++;
+    if (m.spike_every && self->writes_ % m.spike_every == 0) {
+        us += m.spike_us;
+    }
+    if (lba != self->next_lba_ && self->writes_ > 1) {
+        us += m.nonsequential_us;
+    }
+    if (m.jitter_us) {
+        us += uint64_t(std::exponential_distribution<double>(1.0 / m.jitter_us)(self->rng_));
+    }
+    self->next_lba_ = lba + count;
+    self->latencies_.push_back(uint32_t(us));
+    self->deadline_ = std::chrono::steady_clock::now() + std::chrono::microseconds(self->virtual_time_ ? 0 : us);
+    self->pending_ = true;
+    self->pending_lba_ = lba;
+    self->pending_buf_ = buf;
+    self->pending_count_ = count;
+    return BLOCK_OK;
+}
+
+// The data is only copied once the latency has passed, so a caller that
+// reuses the buffer too early sees its mistake in the file
+int FileBlockDev::write_poll(block_dev_t *dev) {
+    auto *self = static_cast<FileBlockDev *>(dev->ctx);
+    if (!self->pending_) {
+        return BLOCK_OK;
+    }
+    if (std::chrono::steady_clock::now() < self->deadline_) {
+        self->busy_polls_++;
+        return BLOCK_BUSY;
+    }
+    self->pending_ = false;
+    self->file_.seekp(std::streamoff(self->pending_lba_) * BLOCK_SIZE);
+    self->file_.write(reinterpret_cast<const char *>(self->pending_buf_),
+                      std::streamsize(self->pending_count_) * BLOCK_SIZE);
+    return self->file_ ? BLOCK_OK : BLOCK_ERROR;
+}
+
+void FileBlockDev::cut_power_after(uint64_t writes, uint32_t torn_blocks) {
+    cut_at_ = writes_ + writes;
+    torn_blocks_ = torn_blocks;
+}
+
+void FileBlockDev::restore_power() {
+    cut_at_ = UINT64_MAX;
+    power_off_ = false;
+}
+
+int FileBlockDev::sync(block_dev_t *dev) {
+    auto *self = static_cast<FileBlockDev *>(dev->ctx);
+    if (self->pending_) {
+        return BLOCK_BUSY;
+    }
+    self->file_.flush();
+    return self->file_ ? BLOCK_OK : BLOCK_ERROR;
+}
+
+}  // namespace host
@@ -0,0 +1,100 @@
+#ifndef FILE_BLOCK_DEV_HPP
+#define FILE_BLOCK_DEV_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "block_dev.h"
+
+namespace host {
+
+// How long an emulated write keeps the device busy. Every spike_every-th
+// write takes spike_us extra, like a card stopping to erase or remap. A
+// write that does not start where the previous one ended costs
+// nonsequential_us extra: the card has to leave its open allocation unit.
+// On top of that each write takes a random extra time, exponentially
+// distributed with mean jitter_us, drawn from a generator seeded with
+// 'seed' so runs repeat. Reads are never delayed; their modelled time is
+// only added up.
+struct LatencyModel {
+    uint32_t base_us = 0;
+    uint32_t per_block_us = 0;
+    uint32_t spike_every = 0;
+    uint32_t spike_us = 0;
+    uint32_t nonsequential_us = 0;
+    uint32_t jitter_us = 0;
+    uint32_t seed = 1;
+    uint32_t read_base_us = 0;
+    uint32_t read_per_block_us = 0;
+};
+
+// A block device backed by a file, for testing storage code on the host.
+// Writes report BLOCK_BUSY until their modelled latency has passed, then
+// land in the file. In virtual time writes finish at once and the modelled
+// latency is only recorded, so benchmarks can replay millions of writes.
+class FileBlockDev {
+public:
+    FileBlockDev(const std::string &path, uint32_t block_count, LatencyModel latency = {});
+
+    block_dev_t *dev() { return &dev_; }
+    const std::string &path() const { return path_; }
+    uint64_t writes() const { return writes_; }
+    uint64_t busy_polls() const { return busy_polls_; }
+    uint64_t reads() const { return reads_; }
+    uint64_t read_time_us() const { return read_time_us_; }
+
+    // Modelled latency of every write so far, in microseconds
+    const std::vector<uint32_t> &latencies() const { return latencies_; }
+    void set_virtual_time(bool on) { virtual_time_ = on; }
+
+    // Fail every write from now on with BLOCK_ERROR (e.g. card removed)
+    void fail_writes(bool fail) { fail_writes_ = fail; }
+
+    // Lose power once 'writes' more writes have completed: the next write
+    // lands only its first 'torn_blocks' blocks, and nothing after it does.
+    // restore_power() brings the card back as the cut left it.
+    void cut_power_after(uint64_t writes, uint32_t torn_blocks = 0);
+    void restore_power();
+    bool powered() const { return !power_off_; }
+
+private:
+    static int init(block_dev_t *dev);
+    static int read(block_dev_t *dev, uint32_t lba, uint8_t *buf, uint32_t count);
+    static int write_start(block_dev_t *dev, uint32_t lba, const uint8_t *buf, uint32_t count);
+    static int write_poll(block_dev_t *dev);
+    static int sync(block_dev_t *dev);
+
+    std::string path_;
+    std::fstream file_;
+    uint32_t capacity_;
+    LatencyModel latency_;
+    std::mt19937 rng_;
+    block_dev_t dev_;
+
+    // Write in flight
+    bool pending_ = false;
+    uint32_t pending_lba_ = 0;
+    const uint8_t *pending_buf_ = nullptr;
+    uint32_t pending_count_ = 0;
+    std::chrono::steady_clock::time_point deadline_;
+
+    uint32_t next_lba_ = 0;     // Where a sequential write would start
+    bool virtual_time_ = false;
+    bool fail_writes_ = false;
+    uint64_t cut_at_ = UINT64_MAX;      // Write count at which power goes
+    uint32_t torn_blocks_ = 0;
+    bool power_off_ = false;
+    std::vector<uint32_t> latencies_;
+    uint64_t writes_ = 0;
+    uint64_t reads_ = 0;
+    uint64_t read_time_us_ = 0;
+    uint64_t busy_polls_ = 0;
+};
+
+}  // namespace host
+
+#endif
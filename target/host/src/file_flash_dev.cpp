@@ -0,0 +1,137 @@
+#include "file_flash_dev.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace host {
+
+// Create (or truncate) the backing file, filled with 0xFF like a new chip
+FileFlashDev::FileFlashDev(const std::string &path, uint32_t size, FlashTiming timing)
+    : path_(path), timing_(timing), rng_(timing.seed), dev_(), erase_counts_(size / FLASH_DEV_SECTOR_SIZE) {
+    if (size % FLASH_DEV_SECTOR_SIZE) {
+        throw std::invalid_argument("flash size must be whole sectors");
+    }
+    file_.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file_) {
+        throw std::runtime_error("cannot create " + path);
+    }
+    std::vector<char> erased(FLASH_DEV_SECTOR_SIZE, '\xFF');
+    for (uint32_t i = 0; i < size / FLASH_DEV_SECTOR_SIZE; ++i) {
+        file_.write(erased.data(), FLASH_DEV_SECTOR_SIZE);
+    }
+    file_.flush();
+
+    static const flash_dev_ops_t ops = {read, erase_start, program_start, poll};
+    dev_.ops = &ops;
+    dev_.ctx = this;
+    dev_.size = size;
+}
+
+int FileFlashDev::read(flash_dev_t *dev, uint32_t offset, uint8_t *buf, size_t len) {
+    auto *self = static_cast<FileFlashDev *>(dev->ctx);
+    if (self->pending_) {
+        return BLOCK_BUSY;
+    }
+    self->file_.seekg(std::streamoff(offset));
+    self->file_.read(reinterpret_cast<char *>(buf), std::streamsize(len));
+    return self->file_ ? BLOCK_OK : BLOCK_ERROR;
+}
+
+int FileFlashDev::erase_start(flash_dev_t *dev, uint32_t offset) {
+    auto *self = static_cast<FileFlashDev *>(dev->ctx);
+    const FlashTiming &t = self->timing_;
+    bool slow = t.erase_slow_every && (self->erases_ + 1) % t.erase_slow_every == 0;
+    uint64_t us = slow ? t.erase_slow_us : t.erase_us;
+    if (t.erase_jitter_us) {
+        us += uint64_t(std::exponential_distribution<double>(1.0 / t.erase_jitter_us)(self->rng_));
+    }
+    int status = self->start(offset, nullptr, FLASH_DEV_SECTOR_SIZE, us);
+    if (status == BLOCK_OK) {
+        self->erases_++;
+        self->erase_counts_[offset / FLASH_DEV_SECTOR_SIZE]++;
+    }
+    return status;
+}
+
+int FileFlashDev::program_start(flash_dev_t *dev, uint32_t offset, const uint8_t *buf, size_t len) {
+    auto *self = static_cast<FileFlashDev *>(dev->ctx);
+    uint64_t us = uint64_t(self->timing_.page_program_us) * (len / FLASH_DEV_PAGE_SIZE);
+    int status = self->start(offset, buf, len, us);
+    if (status == BLOCK_OK) {
+        self->programs_++;
+    }
+    return status;
+}
+
+// Accept an operation and work out when the emulated chip will be done.
+// At a power cut only part of it happens, at once.
+int FileFlashDev::start(uint32_t offset, const uint8_t *buf, size_t len, uint64_t us) {
+    if (pending_) {
+        return BLOCK_BUSY;
+    }
+    if (power_off_) {
+        return BLOCK_ERROR;
+    }
+    if (ops_++ == cut_at_) {
+        power_off_ = true;
+        apply(offset, buf, std::min<size_t>(size_t(torn_pages_) * FLASH_DEV_PAGE_SIZE, len));
+        return BLOCK_ERROR;
+    }
+    pending_ = true;
+    pending_offset_ = offset;
+    pending_buf_ = buf;
+    pending_len_ = len;
+    deadline_us_ = now_us_ + us;
+    deadline_ = std::chrono::steady_clock::now() + std::chrono::microseconds(virtual_time_ ? 0 : us);
+    return BLOCK_OK;
+}
+
+// Erase (null 'buf') or program the file. Programming ANDs the new data
+// into what is there, as flash cells can only go from 1 to 0.
+void FileFlashDev::apply(uint32_t offset, const uint8_t *buf, size_t len) {
+    std::vector<uint8_t> cells(len, 0xFF);
+    if (buf) {
+        file_.seekg(std::streamoff(offset));
+        file_.read(reinterpret_cast<char *>(cells.data()), std::streamsize(len));
+        for (size_t i = 0; i < len; ++i) {
+            if ((cells[i] & buf[i]) != buf[i]) {
+                overprograms_++;
+            }
+            cells[i] &= buf[i];
+        }
+    }
+    file_.seekp(std::streamoff(offset));
+    file_.write(reinterpret_cast<const char *>(cells.data()), std::streamsize(len));
+    file_.flush();
+}
+
+int FileFlashDev::poll(flash_dev_t *dev) {
+    auto *self = static_cast<FileFlashDev *>(dev->ctx);
+    if (!self->pending_) {
+        return BLOCK_OK;
+    }
+    bool busy = self->virtual_time_ ? self->now_us_ < self->deadline_us_
+                                    : std::chrono::steady_clock::now() < self->deadline_;
+    if (busy) {
+        self->busy_polls_++;
+        if (self->virtual_time_) {
+            self->now_us_ = std::min(self->now_us_ + self->timing_.poll_us, self->deadline_us_);
+        }
+        return BLOCK_BUSY;
+    }
+    self->pending_ = false;
+    self->apply(self->pending_offset_, self->pending_buf_, self->pending_len_);
+    return self->file_ ? BLOCK_OK : BLOCK_ERROR;
+}
+
+void FileFlashDev::cut_power_after(uint64_t ops, uint32_t torn_pages) {
+    cut_at_ = ops_ + ops;
+    torn_pages_ = torn_pages;
+}
+
+void FileFlashDev::restore_power() {
+    cut_at_ = UINT64_MAX;
+    power_off_ = false;
+}
+
+}  // namespace host
@@ -0,0 +1,107 @@
+#ifndef FILE_FLASH_DEV_HPP
+#define FILE_FLASH_DEV_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "flash_dev.h"
+
+namespace host {
+
+// How long emulated flash operations take. The defaults are typical
+// figures for the W25Q-series QSPI flash on Pico boards: 45 ms to erase a
+// 4 KiB sector and 0.4 ms to program a 256-byte page. Every
+// erase_slow_every-th erase takes erase_slow_us instead, up to the
+// datasheet maximum. Every erase also takes a random extra time,
+// exponentially distributed with mean erase_jitter_us, from a generator
+// seeded with 'seed'. poll_us is what one busy poll costs in virtual time.
+struct FlashTiming {
+    uint32_t erase_us = 45000;
+    uint32_t erase_slow_every = 0;
+    uint32_t erase_slow_us = 400000;
+    uint32_t erase_jitter_us = 0;
+    uint32_t seed = 1;
+    uint32_t page_program_us = 400;
+    uint32_t poll_us = 10;
+};
+
+// NOR flash backed by a file, for testing flash storage code on the host.
+// Erasing sets a sector to 0xFF and programming can only clear bits, as
+// on the real chip. Operations report BLOCK_BUSY until their time has
+// passed, and only then change the file.
+//
+// In virtual time the clock only moves when it is told to (advance())
+// and by poll_us for every busy poll. A caller that waits for an erase
+// spends exactly the erase time, and work done in between shows up as
+// time the erase did not cost.
+class FileFlashDev {
+public:
+    FileFlashDev(const std::string &path, uint32_t size, FlashTiming timing = {});
+
+    flash_dev_t *dev() { return &dev_; }
+    const std::string &path() const { return path_; }
+    uint64_t erases() const { return erases_; }
+    uint64_t programs() const { return programs_; }
+    uint64_t busy_polls() const { return busy_polls_; }
+
+    // Programs that tried to set a bit erasing had not: a caller bug
+    uint64_t overprograms() const { return overprograms_; }
+
+    // Erases of each sector so far
+    const std::vector<uint32_t> &erase_counts() const { return erase_counts_; }
+
+    void set_virtual_time(bool on) { virtual_time_ = on; }
+    void advance(uint64_t us) { now_us_ += us; }
+    uint64_t now_us() const { return now_us_; }
+
+    // Lose power once 'ops' more erases or programs have started: a
+    // program at the cut lands only its first 'torn_pages' pages, an erase
+    // clears only that many pages, and nothing after it happens.
+    // restore_power() brings the chip back as the cut left it.
+    void cut_power_after(uint64_t ops, uint32_t torn_pages = 0);
+    void restore_power();
+    bool powered() const { return !power_off_; }
+
+private:
+    static int read(flash_dev_t *dev, uint32_t offset, uint8_t *buf, size_t len);
+    static int erase_start(flash_dev_t *dev, uint32_t offset);
+    static int program_start(flash_dev_t *dev, uint32_t offset, const uint8_t *buf, size_t len);
+    static int poll(flash_dev_t *dev);
+
+    int start(uint32_t offset, const uint8_t *buf, size_t len, uint64_t us);
+    void apply(uint32_t offset, const uint8_t *buf, size_t len);
+
+    std::string path_;
+    std::fstream file_;
+    FlashTiming timing_;
+    std::mt19937 rng_;
+    flash_dev_t dev_;
+
+    // Operation in flight; a null buffer is an erase
+    bool pending_ = false;
+    uint32_t pending_offset_ = 0;
+    const uint8_t *pending_buf_ = nullptr;
+    size_t pending_len_ = 0;
+    uint64_t deadline_us_ = 0;
+    std::chrono::steady_clock::time_point deadline_;
+
+    bool virtual_time_ = false;
+    uint64_t now_us_ = 0;
+    uint64_t ops_ = 0;
+    uint64_t cut_at_ = UINT64_MAX;
+    uint32_t torn_pages_ = 0;
+    bool power_off_ = false;
+    std::vector<uint32_t> erase_counts_;
+    uint64_t erases_ = 0;
+    uint64_t programs_ = 0;
+    uint64_t busy_polls_ = 0;
+    uint64_t overprograms_ = 0;
+};
+
+}  // namespace host
+
+#endif
@@ -0,0 +1,256 @@
+#include "log_download.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+
+#include "crc.h"
+
+namespace host {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Reads from the port at a time; a window of frames fits in a few
+const size_t kReadChunk = 64 * 1024;
+
+void put16(uint8_t *p, uint16_t v) {
+    p[0] = uint8_t(v);
+    p[1] = uint8_t(v >> 8);
+}
+
+void put32(uint8_t *p, uint32_t v) {
+    p[0] = uint8_t(v);
+    p[1] = uint8_t(v >> 8);
+    p[2] = uint8_t(v >> 16);
+    p[3] = uint8_t(v >> 24);
+}
+
+uint16_t get16(const uint8_t *p) {
+    return uint16_t(p[0] | p[1] << 8);
+}
+
+uint32_t get32(const uint8_t *p) {
+    return p[0] | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+// Whole frame length for a frame type, or 0 if there is no such type
+size_t frame_length(uint8_t type) {
+    switch (type) {
+    case LOG_XFER_DATA:
+        return LOG_XFER_HEADER_SIZE + LOG_BLOCK_SIZE + 4;
+    case LOG_XFER_LIST:
+    case LOG_XFER_INFO:
+    case LOG_XFER_END:
+    case LOG_XFER_ERROR:
+        return LOG_XFER_HEADER_SIZE + 4;
+    default:
+        return 0;
+    }
+}
+
+}  // namespace
+
+LogDownloader::LogDownloader(SerialPort &port, const DownloadOptions &options)
+    : port_(port), options_(options), payload_(LOG_BLOCK_SIZE) {
+    options_.window = std::clamp(options_.window, 1u, unsigned(LOG_XFER_WINDOW_MAX));
+    // Frames left over from another run on the port are then unlikely to
+    // carry a tag this one uses
+    tag_ = uint16_t(Clock::now().time_since_epoch().count());
+}
+
+void LogDownloader::send(uint8_t op, uint32_t file, uint32_t first, uint32_t count, uint8_t window) {
+    uint8_t rq[LOG_XFER_REQUEST_SIZE] = {};
+    put32(&rq[0], LOG_XFER_REQUEST_MAGIC);
+    rq[4] = op;
+    rq[5] = window;
+    put16(&rq[6], tag_);
+    put32(&rq[8], file);
+    put32(&rq[12], first);
+    put32(&rq[16], count);
+    put32(&rq[20], crc32(CRC32_INIT, rq, 20));
+    port_.write(rq, sizeof(rq));
+}
+
+// The next frame that passes its CRC. Bytes that do not start a frame are
+// skipped; a frame that fails its CRC is reported, and its first byte
+// skipped, so the caller can ask again at once.
+LogDownloader::Got LogDownloader::receive(Frame &frame, int timeout_ms, DownloadStats &stats) {
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true) {
+        while (in_.size() - head_ >= LOG_XFER_HEADER_SIZE + 4) {
+            const uint8_t *p = in_.data() + head_;
+            size_t len = get32(p) == LOG_XFER_FRAME_MAGIC ? frame_length(p[4]) : 0;
+            if (len == 0) {
+                head_++;
+                continue;
+            }
+            if (in_.size() - head_ < len) {
+                break;
+            }
+            if (get32(p + len - 4) != crc32(CRC32_INIT, p, len - 4)) {
+                head_++;
+                stats.crc_errors++;
+                return Got::Corrupt;
+            }
+            frame.type = p[4];
+            frame.status = int8_t(p[5]);
+            frame.tag = get16(p + 6);
+            frame.file = get32(p + 8);
+            frame.arg0 = get32(p + 12);
+            frame.arg1 = get32(p + 16);
+            if (frame.type == LOG_XFER_DATA) {
+                std::copy(p + LOG_XFER_HEADER_SIZE, p + LOG_XFER_HEADER_SIZE + LOG_BLOCK_SIZE, payload_.begin());
+            }
+            head_ += len;
+            return Got::Frame;
+        }
+
+        // Keep the unparsed tail only, then wait for more
+        in_.erase(in_.begin(), in_.begin() + ptrdiff_t(head_));
+        head_ = 0;
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        if (left <= 0) {
+            return Got::Timeout;
+        }
+        size_t had = in_.size();
+        in_.resize(had + kReadChunk);
+        size_t n = port_.read(in_.data() + had, kReadChunk, int(left));
+        in_.resize(had + n);
+        stats.bytes += n;
+    }
+}
+
+// A LIST or INFO request and its answer, asked again while none comes
+LogDownloader::Frame LogDownloader::ask(uint8_t op, uint32_t file) {
+    DownloadStats stats;
+    for (unsigned attempt = 0; attempt <= options_.retries; ++attempt) {
+        ++tag_;
+        send(op, file, 0, 0);
+        Frame frame;
+        Got got;
+        while ((got = receive(frame, options_.timeout_ms, stats)) == Got::Frame) {
+            if (frame.tag == tag_ && frame.type == op) {
+                return frame;
+            }
+        }
+    }
+    throw std::runtime_error("no answer from " + port_.path());
+}
+
+std::pair<uint32_t, uint32_t> LogDownloader::list() {
+    Frame frame = ask(LOG_XFER_LIST, 0);
+    if (frame.status != BLOCK_OK) {
+        throw std::runtime_error("no log on the device (status " + std::to_string(frame.status) + ")");
+    }
+    return {frame.arg0, frame.arg1};
+}
+
+uint32_t LogDownloader::blocks(uint32_t file) {
+    Frame frame = ask(LOG_XFER_INFO, file);
+    if (frame.status != BLOCK_OK) {
+        throw std::runtime_error("no file " + std::to_string(file) + " on the device (status " +
+                                 std::to_string(frame.status) + ")");
+    }
+    return frame.arg0;
+}
+
+DownloadStats LogDownloader::fetch(uint32_t file, uint32_t first, uint32_t count, const BlockSink &sink) {
+    DownloadStats stats;
+    stats.resumed_from = first;
+    Clock::time_point start = Clock::now();
+    uint64_t end = uint64_t(first) + count;
+    uint32_t ack_every = std::max(1u, options_.window / 2);
+    uint32_t next = first;
+    uint32_t acked = first;
+    unsigned failures = 0;
+
+    auto read_from = [&]() {
+        ++tag_;
+        send(LOG_XFER_READ, file, next, uint32_t(end - next), uint8_t(options_.window));
+        acked = next;
+    };
+    auto retry = [&](const char *why) {
+        if (++failures > options_.retries) {
+            send(LOG_XFER_STOP, file, 0, 0);
+            throw std::runtime_error("download of file " + std::to_string(file) + " stopped at block " +
+                                     std::to_string(next) + ": " + why);
+        }
+        stats.retries++;
+        read_from();
+    };
+
+    read_from();
+    while (true) {
+        Frame frame;
+        Got got = receive(frame, options_.timeout_ms, stats);
+        if (got == Got::Timeout) {
+            retry("no answer");
+            continue;
+        }
+        if (got == Got::Corrupt) {
+            retry("CRC errors");
+            continue;
+        }
+        if (frame.tag != tag_ || frame.file != file) {
+            continue;               // From a request given up on
+        }
+        if (frame.type == LOG_XFER_DATA) {
+            if (frame.arg0 != next) {
+                retry("blocks lost");
+                continue;
+            }
+            if (!sink(next, payload_.data())) {
+                send(LOG_XFER_STOP, file, 0, 0);
+                stats.write_failed = true;
+                break;
+            }
+            next++;
+            stats.blocks++;
+            failures = 0;
+            if (next - acked >= ack_every) {
+                send(LOG_XFER_ACK, file, next, 0);
+                acked = next;
+            }
+        } else if (frame.type == LOG_XFER_END) {
+            if (frame.arg0 != next) {
+                retry("blocks lost");
+                continue;
+            }
+            break;                  // All of the range, or the file ended first
+        } else if (frame.type == LOG_XFER_ERROR) {
+            retry("read error on the device");
+        }
+    }
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return stats;
+}
+
+DownloadStats LogDownloader::fetch_to(uint32_t file, const std::string &path) {
+    std::error_code ec;
+    uint64_t have = std::filesystem::file_size(path, ec);
+    if (ec) {
+        have = 0;
+    } else if (have % LOG_BLOCK_SIZE) {
+        have -= have % LOG_BLOCK_SIZE;
+        std::filesystem::resize_file(path, have);
+    }
+
+    std::unique_ptr<FILE, int (*)(FILE *)> out(std::fopen(path.c_str(), "ab"), std::fclose);
+    if (!out) {
+        throw std::runtime_error("cannot write " + path);
+    }
+    DownloadStats stats = fetch(file, uint32_t(have / LOG_BLOCK_SIZE), UINT32_MAX, [&](uint32_t, const uint8_t *data) {
+        return std::fwrite(data, 1, LOG_BLOCK_SIZE, out.get()) == LOG_BLOCK_SIZE;
+    });
+    if (std::fclose(out.release()) != 0) {
+        stats.write_failed = true;
+    }
+    return stats;
+}
+
+}  // namespace host
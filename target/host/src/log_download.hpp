@@ -0,0 +1,96 @@
+#ifndef LOG_DOWNLOAD_HPP
+#define LOG_DOWNLOAD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "log_xfer.h"
+#include "serial_port.hpp"
+
+namespace host {
+
+struct DownloadOptions {
+    unsigned window = 16;           // Blocks in flight, 1 to LOG_XFER_WINDOW_MAX
+    int timeout_ms = 1000;          // Silence before a request is sent again
+    unsigned retries = 5;           // Attempts in a row that get nowhere before giving up
+};
+
+struct DownloadStats {
+    uint64_t blocks = 0;            // Blocks received and handed on
+    uint64_t bytes = 0;             // Bytes received, frames and all
+    uint64_t crc_errors = 0;        // Frames that failed their CRC
+    uint64_t retries = 0;           // READs sent again from the first missing block
+    uint64_t resumed_from = 0;      // First block asked for
+    double seconds = 0;
+    bool write_failed = false;      // The sink refused a block; the transfer stopped there
+};
+
+// Receives one block of a file; false stops the transfer
+using BlockSink = std::function<bool(uint32_t block, const uint8_t *data)>;
+
+// The host end of the bulk download protocol (log_xfer.h) on the
+// device's download port.
+//
+// A READ asks for a range of blocks and the device streams them, never
+// more than the window ahead of the last ACK; the host ACKs every half
+// window so the stream does not stall. Blocks must arrive in order: a
+// frame that fails its CRC, a block out of sequence, an ERROR frame or a
+// timeout makes the host send a new READ from the first block it is
+// missing, under a new tag, and frames still arriving from the old one
+// are dropped. Nothing is asked for twice once received, and the device
+// keeps no state to lose, so a transfer stopped by an unplugged cable or
+// a killed process goes on later from wherever the host got to
+// (fetch_to does this for files on disk).
+class LogDownloader {
+public:
+    explicit LogDownloader(SerialPort &port, const DownloadOptions &options = DownloadOptions());
+
+    LogDownloader(const LogDownloader &) = delete;
+    LogDownloader &operator=(const LogDownloader &) = delete;
+
+    // The files the device has, as [first, end). Throws std::runtime_error
+    // if it does not answer or has no log.
+    std::pair<uint32_t, uint32_t> list();
+
+    // A file's length in blocks; throws std::runtime_error as list()
+    uint32_t blocks(uint32_t file);
+
+    // Blocks [first, first + count) of a file, or as many as there are, in
+    // order. Throws std::runtime_error once retries attempts in a row have
+    // got no further.
+    DownloadStats fetch(uint32_t file, uint32_t first, uint32_t count, const BlockSink &sink);
+
+    // The whole of a file into path, carrying on from the blocks already
+    // there; a part block left by an interrupted run is cut off first.
+    DownloadStats fetch_to(uint32_t file, const std::string &path);
+
+private:
+    struct Frame {
+        uint8_t type;
+        int8_t status;
+        uint16_t tag;
+        uint32_t file;
+        uint32_t arg0;
+        uint32_t arg1;
+    };
+    enum class Got { Frame, Corrupt, Timeout };
+
+    void send(uint8_t op, uint32_t file, uint32_t first, uint32_t count, uint8_t window = 0);
+    Got receive(Frame &frame, int timeout_ms, DownloadStats &stats);
+    Frame ask(uint8_t op, uint32_t file);
+
+    SerialPort &port_;
+    DownloadOptions options_;
+    uint16_t tag_;
+    std::vector<uint8_t> in_;       // Bytes received and not yet parsed, from head_
+    size_t head_ = 0;
+    std::vector<uint8_t> payload_;  // Block of the last DATA frame
+};
+
+}  // namespace host
+
+#endif
@@ -0,0 +1,315 @@
+#include "log_export.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <future>
+#include <string>
+#include <utility>
+
+namespace host {
+
+namespace {
+
+// Columns of the columnar export, in file order
+enum ColumnType : uint8_t { kU64 = 1, kU32 = 2, kI32 = 3, kF32 = 4 };
+
+struct ColumnDesc {
+    const char *name;
+    ColumnType type;
+};
+
+// The fixed columns; kOtherColumns (batch_decode.hpp) follow them as f32
+const ColumnDesc kColumns[] = {
+    {"time_us", kU64},    {"valid", kU32},     {"temp_centi", kI32}, {"temp_c", kF32},
+    {"heading_deg", kF32}, {"pitch_deg", kF32}, {"roll_deg", kF32},
+};
+const ColumnDesc kDeviceColumn = {"device_id", kU64};
+constexpr size_t kColumnNameSize = 12;
+
+// Little-endian fields, whatever the host
+void put_le(std::string &out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+// Column arrays are copied as they are, so the host must be little-endian
+// like every target this builds for
+template <typename T>
+void put_column(std::string &out, const std::vector<T> &column, size_t rows) {
+    out.append(reinterpret_cast<const char *>(column.data()), rows * sizeof(T));
+}
+
+void put_descriptor(std::string &out, const ColumnDesc &c) {
+    size_t len = std::strlen(c.name);
+    out.append(c.name, len);
+    out.append(kColumnNameSize - len, '\0');
+    put_le(out, c.type, 4);
+}
+
+// Fixed-point value with one or two decimals, e.g. -0.05
+char *put_fixed(char *p, int32_t value, int decimals) {
+    if (value < 0) {
+        *p++ = '-';
+        value = -value;
+    }
+    int32_t scale = decimals == 2 ? 100 : 10;
+    p = std::to_chars(p, p + 12, value / scale).ptr;
+    *p++ = '.';
+    if (decimals == 2) {
+        *p++ = static_cast<char>('0' + value / 10 % 10);
+    }
+    *p++ = static_cast<char>('0' + value % 10);
+    return p;
+}
+
+}  // namespace
+
+const std::string &csv_header() {
+    static const std::string header = [] {
+        std::string h = "time_us,temp_c,heading_deg,pitch_deg,roll_deg";
+        for (size_t k = 0; k < kOtherColumnCount; ++k) {
+            h += ',';
+            h += kOtherColumns[k].name;
+        }
+        return h + '\n';
+    }();
+    return header;
+}
+
+// One CSV line, with exact decimal values: temperature to 0.01 °C as the
+// device prints it, heading to its 0.1° resolution, and the other
+// channels as the device formats them (sample_format_value())
+void append_csv_line(std::string &out, const sample_t &s) {
+    char line[96 + 24 * SAMPLE_CH_COUNT];
+    char *p = std::to_chars(line, line + 24, s.time_us).ptr;
+    *p++ = ',';
+    if (s.valid & (1u << SAMPLE_CH_TEMP)) {
+        p = put_fixed(p, s.value[SAMPLE_CH_TEMP] * 100 >> 7, 2);
+    }
+    *p++ = ',';
+    if (s.valid & (1u << SAMPLE_CH_HEADING)) {
+        p = put_fixed(p, s.value[SAMPLE_CH_HEADING], 1);
+    }
+    *p++ = ',';
+    if (s.valid & (1u << SAMPLE_CH_PITCH)) {
+        p = std::to_chars(p, p + 12, s.value[SAMPLE_CH_PITCH]).ptr;
+    }
+    *p++ = ',';
+    if (s.valid & (1u << SAMPLE_CH_ROLL)) {
+        p = std::to_chars(p, p + 12, s.value[SAMPLE_CH_ROLL]).ptr;
+    }
+    for (size_t k = 0; k < kOtherColumnCount; ++k) {
+        sample_channel_t ch = kOtherColumns[k].channel;
+        *p++ = ',';
+        if (s.valid & (1u << ch)) {
+            p += sample_format_value(ch, s.value[ch], 0, p, 24);
+        }
+    }
+    *p++ = '\n';
+    out.append(line, static_cast<size_t>(p - line));
+}
+
+std::string columnar_header(uint64_t device_id, uint32_t log_id, bool device_column) {
+    std::string out;
+    size_t columns = sizeof(kColumns) / sizeof(kColumns[0]) + kOtherColumnCount + device_column;
+    put_le(out, kColumnarMagic, 4);
+    put_le(out, kColumnarVersion, 2);
+    put_le(out, columns, 2);
+    put_le(out, device_id, 8);
+    put_le(out, log_id, 4);
+    put_le(out, 0, 4);
+    for (const ColumnDesc &c : kColumns) {
+        put_descriptor(out, c);
+    }
+    for (size_t k = 0; k < kOtherColumnCount; ++k) {
+        put_descriptor(out, {kOtherColumns[k].name, kF32});
+    }
+    if (device_column) {
+        put_descriptor(out, kDeviceColumn);
+    }
+    return out;
+}
+
+void append_row_group(std::string &out, const EngColumns &columns, size_t rows, const uint64_t *device_ids) {
+    put_le(out, kColumnarRowsMagic, 4);
+    put_le(out, rows, 4);
+    put_column(out, columns.time_us, rows);
+    put_column(out, columns.valid, rows);
+    put_column(out, columns.temp_centi, rows);
+    put_column(out, columns.temp_c, rows);
+    put_column(out, columns.heading_deg, rows);
+    put_column(out, columns.pitch_deg, rows);
+    put_column(out, columns.roll_deg, rows);
+    for (size_t k = 0; k < kOtherColumnCount; ++k) {
+        put_column(out, columns.*kOtherColumns[k].column, rows);
+    }
+    if (device_ids) {
+        out.append(reinterpret_cast<const char *>(device_ids), rows * sizeof(uint64_t));
+    }
+}
+
+// One task's output. Kept from wave to wave so the buffers are reused.
+struct LogExporter::Chunk {
+    std::vector<sample_t> samples;
+    EngColumns columns;
+    std::string bytes;
+    uint64_t blocks = 0;
+    uint64_t bad_blocks = 0;
+};
+
+// A log file starts with its FILE block; a flash ring dump ends with it
+LogExporter::LogExporter(const uint8_t *data, size_t size) : data_(data), blocks_(size / LOG_BLOCK_SIZE) {
+    log_block_header_t hdr;
+    if (blocks_ == 0) {
+        return;
+    }
+    size_t file_block = 0;
+    if (log_block_parse(data_, 0, &hdr) != LOG_OK || hdr.type != LOG_BLOCK_FILE) {
+        file_block = blocks_ - 1;
+        const uint8_t *last = data_ + file_block * LOG_BLOCK_SIZE;
+        if (log_block_parse(last, 0, &hdr) != LOG_OK || hdr.type != LOG_BLOCK_FILE) {
+            return;
+        }
+    }
+    device_id_ = hdr.device_id;
+    log_id_ = log_file_id(data_ + file_block * LOG_BLOCK_SIZE, &hdr);
+    if (file_block != 0) {
+        find_ring_order(file_block);
+    }
+    valid_ = true;
+}
+
+// Block seq s sits in ring sector (s - 1) % ring. Blocks that are
+// somewhere else, or from an earlier log, are not part of this one.
+void LogExporter::find_ring_order(size_t ring) {
+    std::vector<std::pair<uint32_t, uint32_t>> found;
+    log_block_header_t hdr;
+    for (size_t i = 0; i < ring; ++i) {
+        if (log_block_parse(data_ + i * LOG_BLOCK_SIZE, log_id_, &hdr) == LOG_OK && hdr.type != LOG_BLOCK_FILE &&
+            hdr.seq >= 1 && (hdr.seq - 1) % ring == i) {
+            found.emplace_back(hdr.seq, static_cast<uint32_t>(i));
+        }
+    }
+    std::sort(found.begin(), found.end());
+    is_ring_ = true;
+    for (const auto &f : found) {
+        order_.push_back(f.second);
+    }
+}
+
+size_t LogExporter::block_count() const {
+    return is_ring_ ? order_.size() : blocks_ - 1;
+}
+
+const uint8_t *LogExporter::block(size_t k) const {
+    return data_ + (is_ring_ ? order_[k] : k + 1) * LOG_BLOCK_SIZE;
+}
+
+// Decode one run of blocks and format it
+void LogExporter::decode_chunk(size_t first, size_t count, const ExportOptions &options, Chunk &out) const {
+    log_block_header_t hdr;
+    log_cursor_t cursor;
+    sample_t s;
+
+    out.samples.clear();
+    out.bytes.clear();
+    out.blocks = 0;
+    out.bad_blocks = 0;
+    for (size_t k = first; k < first + count; ++k) {
+        int rc = log_block_parse(block(k), log_id_, &hdr);
+        if (rc != LOG_OK) {
+            out.bad_blocks += rc != LOG_ERR_MAGIC;      // Unused space is not damage
+            continue;
+        }
+        if (hdr.type != LOG_BLOCK_DATA) {
+            continue;
+        }
+        log_cursor_init(&cursor, block(k), &hdr);
+        while ((rc = log_cursor_next(&cursor, &s)) == 1) {
+            out.samples.push_back(s);
+        }
+        out.blocks++;
+        out.bad_blocks += rc < 0;
+    }
+
+    size_t rows = out.samples.size();
+    if (options.format == ExportFormat::Csv) {
+        out.bytes.reserve(rows * 40);
+        for (const sample_t &sample : out.samples) {
+            append_csv_line(out.bytes, sample);
+        }
+    } else if (rows) {
+        out.columns.resize(rows);
+        decode_batch(out.samples.data(), rows, out.columns, 0, options.kernel);
+        append_row_group(out.bytes, out.columns, rows);
+    }
+}
+
+// Waves of tasks, two per thread so uneven chunks even out. While one
+// wave is written to the sink, the pool decodes the next.
+ExportStats LogExporter::run(ThreadPool &pool, const ExportOptions &options, const ExportSink &sink) const {
+    ExportStats stats;
+    if (!valid_) {
+        return stats;
+    }
+    auto emit = [&](const std::string &bytes) {
+        if (bytes.empty()) {
+            return true;
+        }
+        if (!sink(bytes.data(), bytes.size())) {
+            stats.write_failed = true;
+            return false;
+        }
+        stats.bytes_out += bytes.size();
+        return true;
+    };
+    if (options.header &&
+        !emit(options.format == ExportFormat::Csv ? csv_header() : columnar_header(device_id_, log_id_))) {
+        return stats;
+    }
+
+    size_t per_chunk = std::max<size_t>(options.chunk_blocks, 1);
+    size_t total = block_count();
+    size_t chunks = (total + per_chunk - 1) / per_chunk;
+    size_t wave = size_t(pool.size()) * 2;
+    std::vector<Chunk> buffers[2] = {std::vector<Chunk>(wave), std::vector<Chunk>(wave)};
+
+    auto decode_wave = [&](size_t first_chunk, std::vector<Chunk> &out) {
+        size_t n = std::min(wave, chunks - first_chunk);
+        pool.parallel_for(n, [&](size_t i) {
+            size_t first = (first_chunk + i) * per_chunk;
+            decode_chunk(first, std::min(per_chunk, total - first), options, out[i]);
+        });
+    };
+
+    if (chunks) {
+        decode_wave(0, buffers[0]);
+    }
+    for (size_t first = 0, cur = 0; first < chunks; first += wave, cur ^= 1) {
+        std::future<void> ahead;
+        if (first + wave < chunks) {
+            ahead = std::async(std::launch::async, decode_wave, first + wave, std::ref(buffers[cur ^ 1]));
+        }
+        bool ok = true;
+        for (size_t i = 0; i < std::min(wave, chunks - first) && ok; ++i) {
+            const Chunk &c = buffers[cur][i];
+            ok = emit(c.bytes);
+            if (ok) {
+                stats.blocks += c.blocks;
+                stats.bad_blocks += c.bad_blocks;
+                stats.samples += c.samples.size();
+            }
+        }
+        if (ahead.valid()) {
+            ahead.wait();
+        }
+        if (!ok) {
+            break;
+        }
+    }
+    return stats;
+}
+
+}  // namespace host
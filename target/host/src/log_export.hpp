@@ -0,0 +1,87 @@
+#ifndef LOG_EXPORT_HPP
+#define LOG_EXPORT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "batch_decode.hpp"
+#include "block_log.h"
+#include "thread_pool.hpp"
+
+namespace host {
+
+// Magic numbers of the columnar export (docs/log_format.md)
+constexpr uint32_t kColumnarMagic = 0x4C4F4353;     // "SCOL"
+constexpr uint32_t kColumnarRowsMagic = 0x53574F52; // "ROWS"
+constexpr uint16_t kColumnarVersion = 1;
+
+enum class ExportFormat { Csv, Columnar };
+
+struct ExportOptions {
+    ExportFormat format = ExportFormat::Csv;
+    bool header = true;             // CSV header line or columnar file header first
+    size_t chunk_blocks = 64;       // Blocks per task: 256 KiB of log
+    Kernel kernel = Kernel::Auto;
+};
+
+struct ExportStats {
+    uint64_t blocks = 0;            // Data blocks decoded
+    uint64_t bad_blocks = 0;        // Failed their CRC or format checks; skipped
+    uint64_t samples = 0;
+    uint64_t bytes_out = 0;
+    bool write_failed = false;      // The sink refused some output; the export stopped there
+};
+
+// Where output goes, in order; returns false to stop the export
+using ExportSink = std::function<bool(const char *data, size_t len)>;
+
+// Pieces of the two output formats, shared with the log merge
+// (log_merge.hpp). With 'device_column' the columnar file gets a u64
+// device_id column after the others, and each row group needs the IDs.
+const std::string &csv_header();
+void append_csv_line(std::string &out, const sample_t &s);
+std::string columnar_header(uint64_t device_id, uint32_t log_id, bool device_column = false);
+void append_row_group(std::string &out, const EngColumns &columns, size_t rows,
+                      const uint64_t *device_ids = nullptr);
+
+// Decodes every data block of a log held in memory, normally a
+// MappedFile, across a thread pool, and writes the samples out as CSV or
+// as columns. Runs of blocks are decoded into per-task buffers and written
+// in log order, so memory use depends on the pool size, not the log size.
+//
+// Takes a log file (FILE block first) or a dump of a flash ring (FILE
+// block last, flash_log.h). The ring's blocks are put in order by seq.
+class LogExporter {
+public:
+    LogExporter(const uint8_t *data, size_t size);
+
+    bool valid() const { return valid_; }
+    bool ring() const { return is_ring_; }
+    uint64_t device_id() const { return device_id_; }
+    uint32_t log_id() const { return log_id_; }
+
+    ExportStats run(ThreadPool &pool, const ExportOptions &options, const ExportSink &sink) const;
+
+private:
+    struct Chunk;
+
+    size_t block_count() const;
+    const uint8_t *block(size_t k) const;
+    void decode_chunk(size_t first, size_t count, const ExportOptions &options, Chunk &out) const;
+    void find_ring_order(size_t ring);
+
+    const uint8_t *data_;
+    size_t blocks_;
+    bool valid_ = false;
+    uint64_t device_id_ = 0;
+    uint32_t log_id_ = 0;
+    bool is_ring_ = false;
+    std::vector<uint32_t> order_;   // Ring positions in seq order
+};
+
+}  // namespace host
+
+#endif
@@ -0,0 +1,326 @@
+#include "log_merge.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace host {
+
+namespace {
+
+const char kMergeCsvHeader[] = "device_id,";
+
+// Device IDs as the 16 hex digits the device shows
+void put_device(std::string &out, uint64_t id) {
+    static const char digits[] = "0123456789abcdef";
+    char text[17];
+    for (int i = 15; i >= 0; --i, id >>= 4) {
+        text[i] = digits[id & 15];
+    }
+    text[16] = ',';
+    out.append(text, sizeof(text));
+}
+
+}  // namespace
+
+// Reads for all the inputs, on a few threads of their own. Each input has
+// at most one read queued, and reads its file front to back, so no seek
+// is needed and no two threads touch the same file at once.
+class LogMerger::ReadQueue {
+public:
+    explicit ReadQueue(unsigned threads) {
+        for (unsigned i = 0; i < std::max(threads, 1u); ++i) {
+            threads_.emplace_back([this] { work(); });
+        }
+    }
+
+    ~ReadQueue() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread &t : threads_) {
+            t.join();
+        }
+    }
+
+    // Bytes read, fewer than 'len' at the end of the file
+    std::future<size_t> read(std::FILE *file, uint8_t *buffer, size_t len) {
+        std::packaged_task<size_t()> job([=] { return std::fread(buffer, 1, len, file); });
+        std::future<size_t> done = job.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        wake_.notify_one();
+        return done;
+    }
+
+private:
+    void work() {
+        for (;;) {
+            std::packaged_task<size_t()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+                if (jobs_.empty()) {
+                    return;
+                }
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::packaged_task<size_t()>> jobs_;
+    bool stop_ = false;
+};
+
+// One log being merged. The read in flight always fills buffer[cur ^ 1].
+struct LogMerger::Input {
+    std::FILE *file = nullptr;
+    uint64_t device_id = 0;
+    uint32_t log_id = 0;
+    std::vector<uint8_t> buffer[2];
+    size_t filled = 0;              // Blocks in buffer[cur]
+    size_t pos = 0;                 // Next of them to decode
+    int cur = 1;
+    std::future<size_t> ahead;
+    std::vector<sample_t> samples;  // Of the block being merged
+    size_t next = 0;
+
+    ~Input() {
+        if (file) {
+            std::fclose(file);
+        }
+    }
+};
+
+// A run of merged rows, formatted and written as one
+struct LogMerger::Batch {
+    std::vector<sample_t> samples;
+    std::vector<uint64_t> devices;
+    EngColumns columns;
+    std::string bytes;
+};
+
+LogMerger::LogMerger(const MergeOptions &options) : options_(options) {
+    options_.read_blocks = std::max<size_t>(options_.read_blocks, 1);
+    options_.batch_rows = std::max<size_t>(options_.batch_rows, 1);
+}
+
+LogMerger::~LogMerger() = default;
+
+bool LogMerger::add(const std::string &path) {
+    auto in = std::make_unique<Input>();
+    in->file = std::fopen(path.c_str(), "rb");
+    if (!in->file) {
+        throw std::runtime_error("cannot open " + path);
+    }
+    in->buffer[0].resize(LOG_BLOCK_SIZE);
+    size_t got = std::fread(in->buffer[0].data(), 1, LOG_BLOCK_SIZE, in->file);
+    if (got != LOG_BLOCK_SIZE && std::ferror(in->file)) {
+        throw std::runtime_error("cannot read " + path);
+    }
+    log_block_header_t hdr;
+    if (got != LOG_BLOCK_SIZE || log_block_parse(in->buffer[0].data(), 0, &hdr) != LOG_OK ||
+        hdr.type != LOG_BLOCK_FILE) {
+        return false;
+    }
+    in->device_id = hdr.device_id;
+    in->log_id = log_file_id(in->buffer[0].data(), &hdr);
+    inputs_.push_back(std::move(in));
+    return true;
+}
+
+// Bring the input's next sample up, decoding blocks and switching buffers
+// as needed. False once the log is used up.
+bool LogMerger::advance(Input &in, ReadQueue &reads, MergeStats &stats) {
+    const size_t read_bytes = options_.read_blocks * LOG_BLOCK_SIZE;
+    log_block_header_t hdr;
+    log_cursor_t cursor;
+    sample_t s;
+
+    while (in.next == in.samples.size()) {
+        if (in.pos == in.filled) {
+            if (!in.ahead.valid()) {
+                return false;
+            }
+            if (in.ahead.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                auto start = std::chrono::steady_clock::now();
+                in.ahead.wait();
+                stats.read_wait_us += uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                                                   std::chrono::steady_clock::now() - start)
+                                                   .count());
+            }
+            size_t got = in.ahead.get();
+            in.cur ^= 1;
+            in.filled = got / LOG_BLOCK_SIZE;
+            in.pos = 0;
+            if (got == read_bytes) {
+                stats.reads++;
+                in.ahead = reads.read(in.file, in.buffer[in.cur ^ 1].data(), read_bytes);
+            }
+            continue;
+        }
+
+        const uint8_t *block = in.buffer[in.cur].data() + in.pos++ * LOG_BLOCK_SIZE;
+        in.samples.clear();
+        in.next = 0;
+        int rc = log_block_parse(block, in.log_id, &hdr);
+        if (rc != LOG_OK) {
+            stats.bad_blocks += rc != LOG_ERR_MAGIC;    // Unused space is not damage
+            continue;
+        }
+        if (hdr.type != LOG_BLOCK_DATA) {
+            continue;
+        }
+        log_cursor_init(&cursor, block, &hdr);
+        while ((rc = log_cursor_next(&cursor, &s)) == 1) {
+            in.samples.push_back(s);
+        }
+        stats.blocks++;
+        stats.bad_blocks += rc < 0;
+    }
+    return true;
+}
+
+void LogMerger::format(Batch &batch) const {
+    size_t rows = batch.samples.size();
+    batch.bytes.clear();
+    if (options_.format == ExportFormat::Csv) {
+        batch.bytes.reserve(rows * 60);
+        for (size_t i = 0; i < rows; ++i) {
+            put_device(batch.bytes, batch.devices[i]);
+            append_csv_line(batch.bytes, batch.samples[i]);
+        }
+    } else if (rows) {
+        batch.columns.resize(rows);
+        decode_batch(batch.samples.data(), rows, batch.columns, 0, options_.kernel);
+        append_row_group(batch.bytes, batch.columns, rows, batch.devices.data());
+    }
+}
+
+MergeStats LogMerger::run(const ExportSink &sink) {
+    MergeStats stats;
+    stats.inputs = inputs_.size();
+    std::set<uint64_t> devices;
+    for (const auto &in : inputs_) {
+        devices.insert(in->device_id);
+    }
+    stats.devices = devices.size();
+
+    bool failed = false;
+    auto emit = [&](const std::string &bytes) {
+        if (failed || bytes.empty()) {
+            return !failed;
+        }
+        failed = !sink(bytes.data(), bytes.size());
+        if (!failed) {
+            stats.bytes_out += bytes.size();
+        }
+        return !failed;
+    };
+    if (options_.header) {
+        bool csv = options_.format == ExportFormat::Csv;
+        if (!emit(csv ? std::string(kMergeCsvHeader) + csv_header() : columnar_header(0, 0, true))) {
+            stats.write_failed = true;
+            return stats;
+        }
+    }
+
+    // Start every input's first read, then take the first sample of each
+    const size_t read_bytes = options_.read_blocks * LOG_BLOCK_SIZE;
+    ReadQueue reads(options_.io_threads);
+    for (const auto &in : inputs_) {
+        in->buffer[0].resize(read_bytes);
+        in->buffer[1].resize(read_bytes);
+        stats.buffer_bytes += 2 * read_bytes;
+        stats.reads++;
+        in->ahead = reads.read(in->file, in->buffer[0].data(), read_bytes);
+    }
+    using Head = std::pair<uint64_t, size_t>;     // Time of the input's next sample, input
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heap;
+    for (size_t i = 0; i < inputs_.size(); ++i) {
+        if (advance(*inputs_[i], reads, stats)) {
+            heap.emplace(inputs_[i]->samples[0].time_us, i);
+        }
+    }
+
+    // One batch fills while the other is formatted and written. 'failed'
+    // belongs to the writer until its future has been collected.
+    Batch batches[2];
+    std::future<void> writing;
+    int cur = 0;
+    auto flush = [&] {
+        if (writing.valid()) {
+            writing.get();
+        }
+        if (failed) {
+            return false;
+        }
+        if (!batches[cur].samples.empty()) {
+            Batch &batch = batches[cur];
+            writing = std::async(std::launch::async, [this, &batch, &emit] {
+                format(batch);
+                emit(batch.bytes);
+            });
+            cur ^= 1;
+        }
+        batches[cur].samples.clear();
+        batches[cur].devices.clear();
+        return true;
+    };
+
+    uint64_t last_us = 0;
+    bool ok = true;
+    while (!heap.empty() && ok) {
+        size_t i = heap.top().second;
+        Input &in = *inputs_[i];
+        heap.pop();
+        const sample_t &s = in.samples[in.next++];
+        stats.out_of_order += s.time_us < last_us;
+        last_us = s.time_us;
+        batches[cur].samples.push_back(s);
+        batches[cur].devices.push_back(in.device_id);
+        stats.samples++;
+        if (advance(in, reads, stats)) {
+            heap.emplace(in.samples[in.next].time_us, i);
+        }
+        if (batches[cur].samples.size() == options_.batch_rows) {
+            ok = flush();
+        }
+    }
+    if (ok) {
+        flush();
+    }
+    if (writing.valid()) {
+        writing.get();
+    }
+
+    // Let reads still in flight finish before the buffers go
+    for (const auto &in : inputs_) {
+        if (in->ahead.valid()) {
+            in->ahead.wait();
+        }
+    }
+    stats.write_failed = failed;
+    return stats;
+}
+
+}  // namespace host
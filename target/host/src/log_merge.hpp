@@ -0,0 +1,87 @@
+#ifndef LOG_MERGE_HPP
+#define LOG_MERGE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "log_export.hpp"
+
+namespace host {
+
+struct MergeOptions {
+    ExportFormat format = ExportFormat::Csv;
+    bool header = true;             // CSV header line or columnar file header first
+    size_t read_blocks = 8;         // Blocks per read: each input holds two reads of 32 KiB
+    unsigned io_threads = 4;        // Reads in flight across all inputs
+    size_t batch_rows = 8192;       // Rows formatted and written at a time
+    Kernel kernel = Kernel::Auto;
+};
+
+struct MergeStats {
+    uint64_t inputs = 0;
+    uint64_t devices = 0;           // Distinct device IDs among the inputs
+    uint64_t blocks = 0;            // Data blocks decoded
+    uint64_t bad_blocks = 0;        // Failed their CRC or format checks; skipped
+    uint64_t samples = 0;
+    uint64_t out_of_order = 0;      // Samples earlier than the row before them; see LogMerger
+    uint64_t reads = 0;
+    uint64_t read_wait_us = 0;      // Time the merge stood waiting for a read
+    uint64_t bytes_out = 0;
+    size_t buffer_bytes = 0;        // Read buffers held for all the inputs
+    bool write_failed = false;      // The sink refused some output; the merge stopped there
+};
+
+// Merges the logs of many devices (or many logs of one) into a single
+// stream in time order, each row tagged with the device that recorded
+// it. CSV rows gain a leading device_id column in hex; columnar output
+// gains a device_id column after the others, and its header carries
+// device and log ID 0 (docs/log_format.md).
+//
+// Each log is read in turn from its file rather than mapped, two buffers
+// of read_blocks blocks at a time: while the merge takes samples from one
+// buffer, a small pool of I/O threads fills the other. Memory is bounded
+// by the number of inputs and read_blocks, whatever the logs' length. A
+// min-heap holds the next sample of every log; ties go to the log added
+// first. Formatting and writing a batch of rows overlap merging the next.
+//
+// Times are each device's own log time, so devices are only as well
+// aligned as their clocks were. Within a log, samples are in time order
+// by construction; if a log breaks that, its samples still come out
+// where the heap puts them and are counted in out_of_order.
+class LogMerger {
+public:
+    explicit LogMerger(const MergeOptions &options = MergeOptions());
+    ~LogMerger();
+
+    LogMerger(const LogMerger &) = delete;
+    LogMerger &operator=(const LogMerger &) = delete;
+
+    // Open a log file and read its FILE block. False if it is not a block
+    // log; it is left out. Throws std::runtime_error if it cannot be read.
+    // Every input stays open until the merge, so the number of inputs is
+    // limited by the process's open files.
+    bool add(const std::string &path);
+
+    size_t input_count() const { return inputs_.size(); }
+
+    // Merge everything added so far; inputs are used up, so this runs once
+    MergeStats run(const ExportSink &sink);
+
+private:
+    struct Input;
+    class ReadQueue;
+    struct Batch;
+
+    bool advance(Input &in, ReadQueue &reads, MergeStats &stats);
+    void format(Batch &batch) const;
+
+    MergeOptions options_;
+    std::vector<std::unique_ptr<Input>> inputs_;
+};
+
+}  // namespace host
+
+#endif
@@ -0,0 +1,290 @@
+#include "log_path_sim.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <stdexcept>
+
+namespace host {
+
+SdBackend::SdBackend(const std::string &path, LatencyModel latency, uint32_t region_blocks)
+    : card_(path, region_blocks, latency), region_blocks_(region_blocks), raw_(), data_() {
+    card_.set_virtual_time(true);
+    if (block_dev_init(card_.dev()) != BLOCK_OK) {
+        throw std::runtime_error("cannot open emulated card " + path);
+    }
+    raw_log_writer_init(&raw_, card_.dev(), 0, region_blocks_, &data_);
+}
+
+SdBackend::~SdBackend() {
+    std::remove(card_.path().c_str());
+}
+
+void SdBackend::attach(sd_log_t *log) {
+    log_writer_t writer = {write, sync, this};
+    sd_log_attach(log, &writer);
+}
+
+// A full region starts over at its first block
+int SdBackend::write(void *ctx, const uint8_t *data, size_t len) {
+    auto *self = static_cast<SdBackend *>(ctx);
+    int status = self->data_.write(self->data_.ctx, data, len);
+    if (status == BLOCK_RANGE) {
+        raw_log_writer_init(&self->raw_, self->card_.dev(), 0, self->region_blocks_, &self->data_);
+        status = self->data_.write(self->data_.ctx, data, len);
+    }
+    return status;
+}
+
+int SdBackend::sync(void *ctx) {
+    auto *self = static_cast<SdBackend *>(ctx);
+    return self->data_.sync(self->data_.ctx);
+}
+
+// The card finishes writes at once in virtual time; what they would have
+// taken is in its latency record
+uint64_t SdBackend::service(sd_log_t *log, uint64_t now_us) {
+    (void)now_us;
+    size_t before = card_.latencies().size();
+    sd_log_service(log);
+    uint64_t busy = 0;
+    for (size_t i = before; i < card_.latencies().size(); ++i) {
+        busy += card_.latencies()[i];
+    }
+    return busy;
+}
+
+FlashBackend::FlashBackend(const std::string &path, FlashTiming timing, bool erase_ahead, uint32_t size)
+    : chip_(path, size, timing), erase_ahead_(erase_ahead), flash_() {
+    chip_.set_virtual_time(true);
+    std::vector<uint8_t> scratch(LOG_BLOCK_SIZE);
+    if (flash_log_init(&flash_, chip_.dev()) != BLOCK_OK || flash_log_mount(&flash_, scratch.data()) != BLOCK_OK) {
+        throw std::runtime_error("cannot open emulated flash " + path);
+    }
+}
+
+FlashBackend::~FlashBackend() {
+    std::remove(chip_.path().c_str());
+}
+
+void FlashBackend::attach(sd_log_t *log) {
+    log_writer_t writer;
+    flash_log_writer(&flash_, &writer);
+    sd_log_attach(log, &writer);
+}
+
+// Bring the chip's clock up to the simulation's, so an erase in flight
+// has progressed by however long the storage side was doing other things
+void FlashBackend::catch_up(uint64_t now_us) {
+    if (chip_.now_us() < now_us) {
+        chip_.advance(now_us - chip_.now_us());
+    }
+}
+
+uint64_t FlashBackend::service(sd_log_t *log, uint64_t now_us) {
+    catch_up(now_us);
+    sd_log_service(log);
+    return chip_.now_us() - now_us;
+}
+
+bool FlashBackend::idle(uint64_t now_us, uint64_t *busy_us) {
+    if (!erase_ahead_) {
+        return false;
+    }
+    catch_up(now_us);
+    bool worked = flash_log_service(&flash_) != 0;
+    *busy_us = chip_.now_us() - now_us;
+    return worked;
+}
+
+SegmentBackend::SegmentBackend(const std::string &path, LatencyModel latency, SegmentStoreConfig store,
+                               log_segments_config_t segments, bool upkeep)
+    : card_(path, SegmentStore::sectors(store), latency), ckpt_(std::make_unique<log_checkpointer_t>()),
+      segs_(std::make_unique<log_segments_t>()), upkeep_(upkeep) {
+    card_.set_virtual_time(true);
+    if (block_dev_init(card_.dev()) != BLOCK_OK) {
+        throw std::runtime_error("cannot open emulated card " + path);
+    }
+    store_ = std::make_unique<SegmentStore>(card_.dev(), store);
+    segments.file_blocks = store.segment_blocks;
+    log_checkpointer_init(ckpt_.get(), card_.dev(), SegmentStore::CHECKPOINT_LBA);
+    log_segments_init(segs_.get(), &segments, &store_->ops(), card_.dev(), ckpt_.get());
+    if (log_segments_start(segs_.get(), 0) != BLOCK_OK) {
+        throw std::runtime_error("cannot start a segment on " + path);
+    }
+    elapsed();
+}
+
+SegmentBackend::~SegmentBackend() {
+    std::remove(card_.path().c_str());
+}
+
+void SegmentBackend::attach(sd_log_t *log) {
+    log_writer_t writer;
+    log_segments_writer(segs_.get(), &writer);
+    sd_log_attach(log, &writer);
+}
+
+// Modelled device time since the last call: writes, and reads the
+// directory and FAT take
+uint64_t SegmentBackend::elapsed() {
+    uint64_t busy = card_.read_time_us() - seen_read_us_;
+    for (; seen_writes_ < card_.latencies().size(); ++seen_writes_) {
+        busy += card_.latencies()[seen_writes_];
+    }
+    seen_read_us_ = card_.read_time_us();
+    peak_slots_ = std::max(peak_slots_, store_->slots_used());
+    return busy;
+}
+
+uint64_t SegmentBackend::service(sd_log_t *log, uint64_t now_us) {
+    (void)now_us;
+    uint32_t rotations = segs_->stats.rotations;
+    sd_log_service(log);
+    uint64_t busy = elapsed();
+    if (segs_->stats.rotations != rotations) {
+        rotation_us_.push_back(busy);
+    }
+    return busy;
+}
+
+bool SegmentBackend::idle(uint64_t now_us, uint64_t *busy_us) {
+    (void)now_us;
+    if (!upkeep_ || log_segments_service(segs_.get()) <= 0) {
+        return false;
+    }
+    *busy_us = elapsed();
+    upkeep_us_.push_back(*busy_us);
+    return true;
+}
+
+uint64_t LogPathReport::commit_percentile(double p) const {
+    if (commit_us.empty()) {
+        return 0;
+    }
+    return commit_us[std::min(commit_us.size() - 1, size_t(p * commit_us.size()))];
+}
+
+double LogPathReport::throughput() const {
+    return elapsed_us ? bytes_written * 1e6 / elapsed_us : 0.0;
+}
+
+namespace {
+
+// Slow temperature drift, a compass turning back and forth, some tilt
+sample_t synthetic_sample(uint64_t i, uint64_t time_us) {
+    sample_t s;
+    sample_clear(&s, time_us);
+    sample_set(&s, SAMPLE_CH_TEMP, 3200 + int32_t(i / 200 % 64));
+    sample_set(&s, SAMPLE_CH_HEADING, int32_t((i * 3 + i % 17) % SAMPLE_HEADING_MODULUS));
+    sample_set(&s, SAMPLE_CH_PITCH, int32_t(i / 40 % 21) - 10);
+    sample_set(&s, SAMPLE_CH_ROLL, int32_t(i % 7) - 3);
+    return s;
+}
+
+// The device's sd-log sink, set up as sink_sd_log_init does. That lives
+// in output_sinks.c beside the UART and USB sinks, whose port layers the
+// host does not have.
+bool emit_block(void *ctx, const uint8_t *block) {
+    sd_log_t *log = static_cast<sd_log_t *>(ctx);
+    return sd_log_free(log) >= LOG_BLOCK_SIZE && sd_log_append(log, block, LOG_BLOCK_SIZE);
+}
+
+int sink_write(sink_t *sink, const record_t *record, uint64_t now_us) {
+    (void)now_us;
+    block_log_t *blocks = static_cast<block_log_t *>(sink->ctx);
+    uint32_t before = blocks->bytes_logged;
+    if (block_log_add(blocks, &record->sample) != LOG_OK) {
+        return SINK_BUSY;
+    }
+    return int(blocks->bytes_logged - before);
+}
+
+}  // namespace
+
+// One pass of the device's main loop per iteration: publish what the ring
+// holds, then let the storage side write a full buffer, do idle work, or
+// sleep for one poll period
+LogPathReport run_log_path(LogBackend &backend, const LogPathConfig &config) {
+    if (config.rate_hz <= 0 || config.ring_size == 0 || config.poll_us == 0) {
+        throw std::invalid_argument("log path needs a sample rate, a ring and a poll period");
+    }
+    auto log = std::make_unique<sd_log_t>();
+    auto sink = std::make_unique<sink_t>();
+    auto blocks = std::make_unique<block_log_t>();
+    sink_hub_t hub;
+    sd_log_init(log.get());
+    backend.attach(log.get());
+    block_log_config_t block_config = {1, 0x5EED, config.file_blocks, 0, LOG_NO_BLOCK, 0, config.file_us};
+    block_log_init(blocks.get(), &block_config, emit_block, log.get());
+    sink_init(sink.get(), "sd-log", sink_write, blocks.get(), SINK_POLICY_DROP);
+    sink_hub_init(&hub);
+    sink_hub_add(&hub, sink.get());
+
+    LogPathReport report;
+    const uint64_t end_us = uint64_t(config.seconds * 1e6);
+    std::deque<sample_t> ring;
+    std::deque<uint64_t> filled_us;     // When each full buffer filled, oldest first
+    uint64_t now_us = 0;
+    uint64_t next_us = 0;
+    record_t record;
+    record.kind = RECORD_SAMPLE;
+
+    while (now_us < end_us) {
+        // Samples the sampling side took by now
+        while (next_us <= now_us) {
+            if (ring.size() < config.ring_size) {
+                ring.push_back(synthetic_sample(report.samples, next_us));
+                report.ring_high_water = std::max(report.ring_high_water, uint32_t(ring.size()));
+            } else {
+                report.ring_dropped++;
+            }
+            report.samples++;
+            next_us = uint64_t(report.samples * 1e6 / config.rate_hz);
+        }
+
+        while (!ring.empty()) {
+            record.sample = ring.front();
+            ring.pop_front();
+            sink_hub_publish(&hub, &record, now_us);
+        }
+        sink_hub_service(&hub, now_us);
+
+        uint32_t full = 0;
+        for (int i = 0; i < SD_LOG_BUFFER_COUNT; ++i) {
+            full += log->full[i];
+        }
+        while (filled_us.size() < full) {
+            filled_us.push_back(now_us);
+        }
+        report.buffers_high_water = std::max(report.buffers_high_water, full);
+
+        uint32_t done = log->stats.buffers_written + log->stats.write_errors;
+        uint64_t busy_us = backend.service(log.get(), now_us);
+        if (log->stats.buffers_written + log->stats.write_errors != done) {
+            now_us += busy_us;
+            report.busy_us += busy_us;
+            report.commit_us.push_back(now_us - filled_us.front());
+            filled_us.pop_front();
+            continue;
+        }
+        if (backend.idle(now_us, &busy_us)) {
+            now_us += busy_us;
+            report.busy_us += busy_us;
+            continue;
+        }
+        uint64_t ticks = next_us > now_us ? (next_us - now_us + config.poll_us - 1) / config.poll_us : 1;
+        now_us += ticks * config.poll_us;
+    }
+
+    report.elapsed_us = now_us;
+    report.samples_logged = sink->stats.written;
+    report.queue_dropped = sink->stats.dropped;
+    report.queue_high_water = sink->stats.high_water;
+    report.buffers_written = log->stats.buffers_written;
+    report.bytes_written = uint64_t(log->stats.buffers_written) * SD_LOG_BUFFER_SIZE;
+    std::sort(report.commit_us.begin(), report.commit_us.end());
+    return report;
+}
+
+}  // namespace host
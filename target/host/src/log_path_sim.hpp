@@ -0,0 +1,160 @@
+#ifndef LOG_PATH_SIM_HPP
+#define LOG_PATH_SIM_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "file_block_dev.hpp"
+#include "file_flash_dev.hpp"
+#include "segment_store.hpp"
+#include "flash_log.h"
+#include "log_segments.h"
+#include "sink.h"
+#include "sample_ring.h"
+#include "sd_log.h"
+
+namespace host {
+
+// Where the logging path's full buffers go, in virtual time. Each call
+// starts at 'now_us' and returns how long the storage side was busy.
+class LogBackend {
+public:
+    virtual ~LogBackend() = default;
+
+    // Set the writer that sd_log_service hands full buffers to
+    virtual void attach(sd_log_t *log) = 0;
+
+    // Write the next full buffer; 0 if there was none
+    virtual uint64_t service(sd_log_t *log, uint64_t now_us) = 0;
+
+    // Work the storage side does when it has nothing to write, such as
+    // erasing ahead; returns false when there is none
+    virtual bool idle(uint64_t now_us, uint64_t *busy_us) {
+        (void)now_us;
+        (void)busy_us;
+        return false;
+    }
+};
+
+// An SD card: host::FileBlockDev written by the raw sequential writer.
+// When the region is full the writer starts again at its beginning, as
+// if a new file had been made.
+class SdBackend : public LogBackend {
+public:
+    SdBackend(const std::string &path, LatencyModel latency, uint32_t region_blocks = 16384);
+    ~SdBackend() override;
+
+    void attach(sd_log_t *log) override;
+    uint64_t service(sd_log_t *log, uint64_t now_us) override;
+    FileBlockDev &card() { return card_; }
+
+private:
+    static int write(void *ctx, const uint8_t *data, size_t len);
+    static int sync(void *ctx);
+
+    FileBlockDev card_;
+    uint32_t region_blocks_;
+    raw_log_writer_t raw_;
+    log_writer_t data_;
+};
+
+// The board's flash: host::FileFlashDev under the flash ring log, with or
+// without erasing ahead when idle. The chip's clock follows the
+// simulation's, so an erase started while idle runs on while samples
+// arrive.
+class FlashBackend : public LogBackend {
+public:
+    FlashBackend(const std::string &path, FlashTiming timing, bool erase_ahead, uint32_t size = 2u * 1024 * 1024);
+    ~FlashBackend() override;
+
+    void attach(sd_log_t *log) override;
+    uint64_t service(sd_log_t *log, uint64_t now_us) override;
+    bool idle(uint64_t now_us, uint64_t *busy_us) override;
+    const flash_log_t &flash() const { return flash_; }
+
+private:
+    void catch_up(uint64_t now_us);
+
+    FileFlashDev chip_;
+    bool erase_ahead_;
+    flash_log_t flash_;
+};
+
+// A card holding the log as a pool of segments (see log_segments.h) on
+// a host::SegmentStore, with or without the pool's upkeep (retention,
+// spares) done while idle. Without it a segment is allocated when the
+// log rotates into it, and nothing is retired.
+class SegmentBackend : public LogBackend {
+public:
+    SegmentBackend(const std::string &path, LatencyModel latency, SegmentStoreConfig store,
+                   log_segments_config_t segments, bool upkeep = true);
+    ~SegmentBackend() override;
+
+    void attach(sd_log_t *log) override;
+    uint64_t service(sd_log_t *log, uint64_t now_us) override;
+    bool idle(uint64_t now_us, uint64_t *busy_us) override;
+
+    FileBlockDev &card() { return card_; }
+    const SegmentStore &store() const { return *store_; }
+    const log_segments_t &segments() const { return *segs_; }
+    const std::vector<uint64_t> &rotation_us() const { return rotation_us_; }  // Writes that rotated
+    const std::vector<uint64_t> &upkeep_us() const { return upkeep_us_; }      // Idle steps
+    uint32_t peak_slots() const { return peak_slots_; }
+
+private:
+    uint64_t elapsed();
+
+    FileBlockDev card_;
+    std::unique_ptr<SegmentStore> store_;
+    std::unique_ptr<log_checkpointer_t> ckpt_;
+    std::unique_ptr<log_segments_t> segs_;
+    bool upkeep_;
+    size_t seen_writes_ = 0;
+    uint64_t seen_read_us_ = 0;
+    std::vector<uint64_t> rotation_us_;
+    std::vector<uint64_t> upkeep_us_;
+    uint32_t peak_slots_ = 0;
+};
+
+// A synthetic sample stream pushed through the device's logging path:
+// sample ring, sd-log sink, block encoder and sd_log buffers, then the
+// backend. The sampling side and the storage side share one virtual
+// clock. While the storage side is busy writing, samples pile up in the
+// ring as they would on core 1; the ring depth is a parameter here so
+// that sizes other than SAMPLE_RING_SIZE can be tried.
+struct LogPathConfig {
+    double rate_hz = 20;
+    double seconds = 600;
+    uint32_t ring_size = SAMPLE_RING_SIZE;
+    uint32_t poll_us = 1000;            // Main loop sleep when there is nothing to do
+    uint32_t file_blocks = 0;           // Block log rotation by size and by time
+    uint64_t file_us = 0;               // (see block_log_config_t)
+};
+
+struct LogPathReport {
+    uint64_t samples = 0;               // Taken on the sampling side
+    uint64_t samples_logged = 0;        // Taken in by the log sink
+    uint64_t ring_dropped = 0;          // Lost to a full sample ring
+    uint64_t queue_dropped = 0;         // Lost to a full sink queue
+    uint32_t ring_high_water = 0;
+    uint32_t queue_high_water = 0;
+    uint32_t buffers_high_water = 0;    // sd_log buffers full at once
+    uint64_t buffers_written = 0;
+    uint64_t bytes_written = 0;
+    uint64_t busy_us = 0;               // Storage side busy writing or erasing
+    uint64_t elapsed_us = 0;
+
+    // From a buffer filling to its write (and any sync) finishing, sorted
+    std::vector<uint64_t> commit_us;
+
+    uint64_t commit_percentile(double p) const;
+    double throughput() const;          // Bytes written per second
+};
+
+LogPathReport run_log_path(LogBackend &backend, const LogPathConfig &config);
+
+}  // namespace host
+
+#endif
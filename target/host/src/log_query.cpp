@@ -0,0 +1,291 @@
+#include "log_query.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "block_log_reader.hpp"
+
+namespace host {
+
+namespace {
+
+// Enough for hourly buckets over two centuries. A bucket holds an aggregate
+// per channel, about 490 bytes with 12 channels, so the cap is about 1 GB
+constexpr uint64_t kMaxBuckets = uint64_t(1) << 21;
+
+constexpr double kPi = 3.14159265358979323846;
+
+// cos and sin of every raw value of each circular channel, Q30
+struct UnitCircle {
+    std::vector<int32_t> x[SAMPLE_CH_COUNT];
+    std::vector<int32_t> y[SAMPLE_CH_COUNT];
+
+    UnitCircle() {
+        for (int ch = 0; ch < SAMPLE_CH_COUNT; ++ch) {
+            int32_t modulus = sample_channels[ch].modulus;
+            for (int32_t v = 0; v < modulus; ++v) {
+                double a = 2 * kPi * v / modulus;
+                x[ch].push_back(static_cast<int32_t>(std::lround(std::cos(a) * (1 << 30))));
+                y[ch].push_back(static_cast<int32_t>(std::lround(std::sin(a) * (1 << 30))));
+            }
+        }
+    }
+};
+
+const UnitCircle &unit_circle() {
+    static const UnitCircle circle;
+    return circle;
+}
+
+void add_value(const UnitCircle &circle, int ch, int32_t value, ChannelAggregate &agg) {
+    agg.count++;
+    agg.sum += value;
+    agg.min = std::min(agg.min, value);
+    agg.max = std::max(agg.max, value);
+    int32_t modulus = sample_channels[ch].modulus;
+    if (modulus) {
+        int32_t v = value % modulus;
+        v += v < 0 ? modulus : 0;
+        agg.sum_x += circle.x[ch][v];
+        agg.sum_y += circle.y[ch][v];
+    }
+}
+
+// (raw * scale_mul) >> scale_shift counts units of the last printed
+// decimal place
+double scaled(sample_channel_t ch, double raw) {
+    const sample_channel_info_t &info = sample_channels[ch];
+    return std::ldexp(raw * info.scale_mul, -info.scale_shift) / std::pow(10.0, info.decimals);
+}
+
+}  // namespace
+
+void ChannelAggregate::merge(const ChannelAggregate &other) {
+    count += other.count;
+    sum += other.sum;
+    sum_x += other.sum_x;
+    sum_y += other.sum_y;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+}
+
+void QueryBucket::merge(const QueryBucket &other) {
+    for (int i = 0; i < SAMPLE_CH_COUNT; ++i) {
+        ch[i].merge(other.ch[i]);
+    }
+}
+
+double aggregate_min(sample_channel_t ch, const ChannelAggregate &agg) {
+    return agg.count ? scaled(ch, agg.min) : NAN;
+}
+
+double aggregate_max(sample_channel_t ch, const ChannelAggregate &agg) {
+    return agg.count ? scaled(ch, agg.max) : NAN;
+}
+
+double aggregate_mean(sample_channel_t ch, const ChannelAggregate &agg) {
+    int32_t modulus = sample_channels[ch].modulus;
+    if (!agg.count || (modulus && agg.sum_x == 0 && agg.sum_y == 0)) {
+        return NAN;
+    }
+    if (!modulus) {
+        return scaled(ch, double(agg.sum) / double(agg.count));
+    }
+    double raw = std::atan2(double(agg.sum_y), double(agg.sum_x)) / (2 * kPi) * modulus;
+    return scaled(ch, raw < 0 ? raw + modulus : raw);
+}
+
+// One task's buckets: only the run of buckets its blocks reach
+struct LogQuery::Partial {
+    size_t first = 0;
+    std::vector<QueryBucket> buckets;
+    QueryStats stats;
+
+    QueryBucket &at(size_t b) {
+        if (buckets.empty()) {
+            first = b;
+        } else if (b < first) {
+            buckets.insert(buckets.begin(), first - b, QueryBucket());
+            first = b;
+        }
+        if (b - first >= buckets.size()) {
+            buckets.resize(b - first + 1);
+        }
+        return buckets[b - first];
+    }
+};
+
+// Learn the log's time range from its first data block and the blocks
+// after its last index entry, without reading the rest
+bool LogQuery::add_log(const uint8_t *data, size_t size) {
+    BlockLogReader reader(data, size);
+    if (!reader.valid()) {
+        return false;
+    }
+    Log log = {data, reader.block_count(), reader.log_id(), 1, 0, 0};
+    log_block_header_t hdr;
+    for (size_t i = 1; i < log.blocks && log.end == 1; ++i) {
+        if (log_block_parse(data + i * LOG_BLOCK_SIZE, log.log_id, &hdr) == LOG_OK && hdr.type == LOG_BLOCK_DATA) {
+            log.first_time_us = hdr.first_time_us;
+            log.last_time_us = hdr.last_time_us;
+            log.end = i + 1;
+        }
+    }
+    size_t at = reader.seek(std::numeric_limits<uint64_t>::max());
+    size_t stop = at < log.blocks ? std::min(log.blocks, at + LOG_INDEX_INTERVAL + 2) : log.blocks;
+    for (size_t i = at < log.blocks ? at : 1; i < stop; ++i) {
+        if (log_block_parse(data + i * LOG_BLOCK_SIZE, log.log_id, &hdr) == LOG_OK && hdr.type == LOG_BLOCK_DATA) {
+            log.last_time_us = std::max(log.last_time_us, hdr.last_time_us);
+            log.end = std::max(log.end, i + 1);
+        }
+    }
+    logs_.push_back(log);
+    return true;
+}
+
+uint64_t LogQuery::first_time_us() const {
+    uint64_t t = std::numeric_limits<uint64_t>::max();
+    for (const Log &log : logs_) {
+        if (log.end > 1) {
+            t = std::min(t, log.first_time_us);
+        }
+    }
+    return t == std::numeric_limits<uint64_t>::max() ? 0 : t;
+}
+
+uint64_t LogQuery::last_time_us() const {
+    uint64_t t = 0;
+    for (const Log &log : logs_) {
+        if (log.end > 1) {
+            t = std::max(t, log.last_time_us);
+        }
+    }
+    return t;
+}
+
+// The blocks of one log that can hold [t0, t1), through its index. Data
+// past the last index entry is at most one interval on.
+LogQuery::Span LogQuery::span(size_t i, uint64_t t0, uint64_t t1) const {
+    const Log &log = logs_[i];
+    BlockLogReader reader(log.data, log.blocks * LOG_BLOCK_SIZE);
+    size_t first = t0 <= log.first_time_us ? 1 : reader.seek(t0);
+    size_t end = log.end;
+    if (t1 <= log.last_time_us) {
+        end = std::min(end, reader.seek(t1) + LOG_INDEX_INTERVAL + 2);
+    }
+    return {i, std::min(first, end), end};
+}
+
+// Headers are read without their CRC first: a block ruled out by its time
+// range or sensor mask is never read past its header
+void LogQuery::scan(const Span &span, const QuerySpec &spec, uint64_t base, Partial &out) const {
+    const Log &log = logs_[span.log];
+    const UnitCircle &circle = unit_circle();
+    log_block_header_t hdr;
+    log_cursor_t cursor;
+    sample_t s;
+
+    for (size_t k = span.first; k < span.end; ++k) {
+        const uint8_t *block = log.data + k * LOG_BLOCK_SIZE;
+        if (log_block_peek(block, &hdr) != LOG_OK) {
+            continue;
+        }
+        if (hdr.type != LOG_BLOCK_DATA || hdr.first_time_us >= spec.t1 || hdr.last_time_us < spec.t0 ||
+            !(hdr.sensor_mask & spec.channels)) {
+            out.stats.blocks_skipped++;
+            continue;
+        }
+        if (log_block_parse(block, log.log_id, &hdr) != LOG_OK) {
+            out.stats.bad_blocks++;
+            continue;
+        }
+        out.stats.blocks_decoded++;
+
+        // A block inside the range and one bucket needs no per-sample checks
+        auto bucket_of = [&](uint64_t t) { return spec.bucket_us ? size_t((t - base) / spec.bucket_us) : 0; };
+        bool whole = hdr.first_time_us >= spec.t0 && hdr.last_time_us < spec.t1 &&
+                     bucket_of(hdr.first_time_us) == bucket_of(hdr.last_time_us);
+        QueryBucket *bucket = whole ? &out.at(bucket_of(hdr.first_time_us)) : nullptr;
+
+        log_cursor_init(&cursor, block, &hdr);
+        int rc;
+        while ((rc = log_cursor_next(&cursor, &s)) == 1) {
+            if (!whole) {
+                if (s.time_us < spec.t0 || s.time_us >= spec.t1) {
+                    continue;
+                }
+                bucket = &out.at(bucket_of(s.time_us));
+            }
+            out.stats.samples++;
+            uint32_t present = s.valid & spec.channels;
+            for (int ch = 0; present; ++ch, present >>= 1) {
+                if (present & 1) {
+                    add_value(circle, ch, s.value[ch], bucket->ch[ch]);
+                }
+            }
+        }
+        out.stats.bad_blocks += rc < 0;
+    }
+}
+
+// Each task aggregates a run of blocks on its own; merging the partials
+// in task order is exact, so the thread count never changes the answer
+QueryResult LogQuery::run(ThreadPool &pool, const QuerySpec &spec) const {
+    QueryResult result;
+    result.bucket_us = spec.bucket_us;
+    uint64_t lo = std::max(spec.t0, first_time_us());
+    uint64_t hi = std::min(spec.t1, last_time_us() + 1);
+    if (lo >= hi || logs_.empty()) {
+        return result;
+    }
+    size_t buckets = 1;
+    result.t0 = spec.t0;
+    if (spec.bucket_us) {
+        result.t0 = spec.t0 + (lo - spec.t0) / spec.bucket_us * spec.bucket_us;
+        uint64_t n = (hi - 1 - result.t0) / spec.bucket_us + 1;
+        if (n > kMaxBuckets) {
+            throw std::runtime_error("query needs " + std::to_string(n) + " buckets; make them wider");
+        }
+        buckets = size_t(n);
+    }
+
+    std::vector<Span> tasks;
+    size_t per_task = std::max<size_t>(spec.chunk_blocks, 1);
+    for (size_t i = 0; i < logs_.size(); ++i) {
+        const Log &log = logs_[i];
+        if (log.end <= 1 || log.first_time_us >= spec.t1 || log.last_time_us < spec.t0) {
+            result.stats.logs_skipped++;
+            continue;
+        }
+        Span whole = span(i, spec.t0, spec.t1);
+        for (size_t first = whole.first; first < whole.end; first += per_task) {
+            tasks.push_back({i, first, std::min(whole.end, first + per_task)});
+        }
+    }
+
+    // Only samples within the logs' known range, so every one has a bucket
+    QuerySpec clipped = spec;
+    clipped.t0 = lo;
+    clipped.t1 = hi;
+    std::vector<Partial> partials(tasks.size());
+    pool.parallel_for(tasks.size(), [&](size_t i) { scan(tasks[i], clipped, result.t0, partials[i]); });
+
+    result.buckets.resize(buckets);
+    for (size_t b = 0; b < buckets; ++b) {
+        result.buckets[b].start_us = result.t0 + b * spec.bucket_us;
+    }
+    for (const Partial &p : partials) {
+        for (size_t b = 0; b < p.buckets.size(); ++b) {
+            result.buckets[p.first + b].merge(p.buckets[b]);
+        }
+        result.stats.blocks_skipped += p.stats.blocks_skipped;
+        result.stats.blocks_decoded += p.stats.blocks_decoded;
+        result.stats.bad_blocks += p.stats.bad_blocks;
+        result.stats.samples += p.stats.samples;
+    }
+    return result;
+}
+
+}  // namespace host
@@ -0,0 +1,116 @@
+#ifndef LOG_QUERY_HPP
+#define LOG_QUERY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "block_log.h"
+#include "sample.h"
+#include "thread_pool.hpp"
+
+namespace host {
+
+// Running aggregate of one channel, in raw units. Everything is an
+// integer sum, so partial aggregates merge exactly and the result does
+// not depend on how the work was split. Circular channels also sum their
+// values as unit vectors (Q30) for the circular mean; their min and max
+// are of the wrapped values.
+struct ChannelAggregate {
+    uint64_t count = 0;
+    int64_t sum = 0;
+    int64_t sum_x = 0;
+    int64_t sum_y = 0;
+    int32_t min = std::numeric_limits<int32_t>::max();
+    int32_t max = std::numeric_limits<int32_t>::min();
+
+    void merge(const ChannelAggregate &other);
+};
+
+struct QueryBucket {
+    uint64_t start_us = 0;
+    ChannelAggregate ch[SAMPLE_CH_COUNT];
+
+    void merge(const QueryBucket &other);
+};
+
+// Engineering values of an aggregate; NaN when there is nothing to show.
+// The mean of a circular channel is the direction of the summed unit
+// vectors, so headings either side of north average to north.
+double aggregate_min(sample_channel_t ch, const ChannelAggregate &agg);
+double aggregate_max(sample_channel_t ch, const ChannelAggregate &agg);
+double aggregate_mean(sample_channel_t ch, const ChannelAggregate &agg);
+
+struct QuerySpec {
+    uint64_t t0 = 0;                // Samples with t0 <= time < t1, in log time (µs)
+    uint64_t t1 = std::numeric_limits<uint64_t>::max();
+    uint64_t bucket_us = 0;         // Bucket width from t0; 0 for a single bucket
+    uint32_t channels = (1u << SAMPLE_CH_COUNT) - 1;
+    size_t chunk_blocks = 64;       // Blocks per task
+};
+
+struct QueryStats {
+    uint64_t logs_skipped = 0;      // Whole files outside the range
+    uint64_t blocks_skipped = 0;    // Near the range, but their headers ruled them out
+    uint64_t blocks_decoded = 0;
+    uint64_t bad_blocks = 0;
+    uint64_t samples = 0;           // Samples that fell in the range
+};
+
+struct QueryResult {
+    uint64_t t0 = 0;                // Start of the first bucket
+    uint64_t bucket_us = 0;
+    std::vector<QueryBucket> buckets;
+    QueryStats stats;
+};
+
+// Bucketed aggregates over a time range of one device's logs, given in
+// recording order and held in memory (normally MappedFiles). Each log's
+// time range and sparse index narrow the range to a run of blocks without
+// reading the rest; block headers then rule out blocks by time and by
+// sensor mask. The remaining blocks are decoded across a thread pool, each
+// task aggregating into its own buckets, and the partial buckets are
+// merged at the end.
+class LogQuery {
+public:
+    // False if the data is not a block log; the log is left out
+    bool add_log(const uint8_t *data, size_t size);
+
+    size_t log_count() const { return logs_.size(); }
+
+    // Times of the first and last samples in all the logs; 0 if none
+    uint64_t first_time_us() const;
+    uint64_t last_time_us() const;
+
+    // Throws std::runtime_error if the range needs too many buckets
+    QueryResult run(ThreadPool &pool, const QuerySpec &spec) const;
+
+private:
+    struct Log {
+        const uint8_t *data;
+        size_t blocks;
+        uint32_t log_id;
+        size_t end;                 // One past the last data block found
+        uint64_t first_time_us;
+        uint64_t last_time_us;
+    };
+
+    // Blocks [first, end) of one log
+    struct Span {
+        size_t log;
+        size_t first;
+        size_t end;
+    };
+
+    struct Partial;
+
+    Span span(size_t log, uint64_t t0, uint64_t t1) const;
+    void scan(const Span &span, const QuerySpec &spec, uint64_t base, Partial &out) const;
+
+    std::vector<Log> logs_;
+};
+
+}  // namespace host
+
+#endif
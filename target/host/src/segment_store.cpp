@@ -0,0 +1,201 @@
+#include "segment_store.hpp"
+
+#include <stdexcept>
+
+namespace host {
+
+namespace {
+
+constexpr uint32_t FAT_ENTRY_SIZE = 4;      // FAT32
+
+uint32_t div_up(uint32_t a, uint32_t b) {
+    return (a + b - 1) / b;
+}
+
+uint32_t clusters_per_segment(const SegmentStoreConfig &config) {
+    return div_up(config.segment_blocks * LOG_SECTORS_PER_BLOCK, config.cluster_sectors);
+}
+
+uint32_t fat_sectors(const SegmentStoreConfig &config) {
+    return div_up(config.slots * clusters_per_segment(config) * FAT_ENTRY_SIZE, BLOCK_SIZE);
+}
+
+// Directory sector, then both FAT copies, then the clusters
+uint32_t data_lba(const SegmentStoreConfig &config) {
+    uint32_t metadata = SegmentStore::CHECKPOINT_LBA + LOG_CHECKPOINT_SLOTS + 1 + 2 * fat_sectors(config);
+    return div_up(metadata, config.cluster_sectors) * config.cluster_sectors;
+}
+
+uint32_t slot_sectors(const SegmentStoreConfig &config) {
+    return clusters_per_segment(config) * config.cluster_sectors;
+}
+
+}  // namespace
+
+uint32_t SegmentStore::sectors(const SegmentStoreConfig &config) {
+    return data_lba(config) + config.slots * slot_sectors(config);
+}
+
+SegmentStore::SegmentStore(block_dev_t *dev, SegmentStoreConfig config)
+    : dev_(dev), config_(config), ops_{prepare, rename, remove, locate, this},
+      dir_lba_(CHECKPOINT_LBA + LOG_CHECKPOINT_SLOTS), fat_lba_(dir_lba_ + 1), fat_sectors_(fat_sectors(config)),
+      data_lba_(data_lba(config)), slot_used_(config.slots), sector_(BLOCK_SIZE) {
+    if (config.segment_blocks == 0 || config.slots == 0 || config.cluster_sectors == 0) {
+        throw std::invalid_argument("segment store needs segments, slots and clusters");
+    }
+    if (dev->block_count < sectors(config)) {
+        throw std::invalid_argument("device too small for the segment store");
+    }
+}
+
+bool SegmentStore::has(log_segment_kind_t kind, uint32_t number) const {
+    return names_.count({kind, number}) != 0;
+}
+
+uint32_t SegmentStore::count(log_segment_kind_t kind) const {
+    uint32_t n = 0;
+    for (const auto &entry : names_) {
+        n += entry.first.first == kind;
+    }
+    return n;
+}
+
+void SegmentStore::scan(log_segments_scan_t *scan) const {
+    log_segments_scan_init(scan);
+    for (const auto &entry : names_) {
+        log_segments_scan_add(scan, entry.first.first, entry.first.second);
+    }
+}
+
+uint32_t SegmentStore::lba(log_segment_kind_t kind, uint32_t number) const {
+    auto it = names_.find({kind, number});
+    if (it == names_.end()) {
+        throw std::out_of_range("no such segment");
+    }
+    return data_lba_ + it->second * slot_sectors(config_);
+}
+
+int SegmentStore::read_metadata(uint32_t lba, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        int status = block_dev_read(dev_, lba + i, sector_.data(), 1);
+        if (status != BLOCK_OK) {
+            return status;
+        }
+    }
+    return BLOCK_OK;
+}
+
+int SegmentStore::write_directory() {
+    metadata_writes_++;
+    return block_dev_write(dev_, dir_lba_, sector_.data(), 1);
+}
+
+// Rewrite the FAT sectors covering a slot's clusters, in both copies
+int SegmentStore::write_chain(uint32_t slot) {
+    uint32_t first = slot * clusters_per_segment(config_) * FAT_ENTRY_SIZE / BLOCK_SIZE;
+    uint32_t last = ((slot + 1) * clusters_per_segment(config_) * FAT_ENTRY_SIZE - 1) / BLOCK_SIZE;
+    for (uint32_t copy = 0; copy < 2; ++copy) {
+        for (uint32_t s = first; s <= last; ++s) {
+            metadata_writes_++;
+            int status = block_dev_write(dev_, fat_lba_ + copy * fat_sectors_ + s, sector_.data(), 1);
+            if (status != BLOCK_OK) {
+                return status;
+            }
+        }
+    }
+    return BLOCK_OK;
+}
+
+// f_open and f_expand: look through the FAT for the first free run long
+// enough, then claim it
+int SegmentStore::prepare(void *ctx, uint32_t spare) {
+    auto *self = static_cast<SegmentStore *>(ctx);
+    if (self->has(LOG_SEGMENT_SPARE, spare)) {
+        return BLOCK_OK;
+    }
+    uint32_t slot = 0;
+    while (slot < self->config_.slots && self->slot_used_[slot]) {
+        slot++;
+    }
+    if (slot == self->config_.slots) {
+        return BLOCK_ERROR;     // Volume full
+    }
+    uint32_t scanned = ((slot + 1) * clusters_per_segment(self->config_) * FAT_ENTRY_SIZE - 1) / BLOCK_SIZE + 1;
+    int status = self->read_metadata(self->dir_lba_, 1);
+    if (status == BLOCK_OK) {
+        status = self->read_metadata(self->fat_lba_, scanned);
+    }
+    if (status == BLOCK_OK) {
+        status = self->write_chain(slot);
+    }
+    if (status == BLOCK_OK) {
+        status = self->write_directory();
+    }
+    if (status != BLOCK_OK) {
+        return status;
+    }
+    self->slot_used_[slot] = true;
+    self->names_[{LOG_SEGMENT_SPARE, spare}] = slot;
+    return BLOCK_OK;
+}
+
+// f_rename: one directory entry changes
+int SegmentStore::rename(void *ctx, log_segment_kind_t from_kind, uint32_t from, log_segment_kind_t to_kind,
+                         uint32_t to) {
+    auto *self = static_cast<SegmentStore *>(ctx);
+    if (!self->has(from_kind, from)) {
+        return self->has(to_kind, to) ? BLOCK_OK : BLOCK_ERROR;
+    }
+    if (self->has(to_kind, to)) {
+        return BLOCK_ERROR;
+    }
+    int status = self->read_metadata(self->dir_lba_, 1);
+    if (status == BLOCK_OK) {
+        status = self->write_directory();
+    }
+    if (status != BLOCK_OK) {
+        return status;
+    }
+    uint32_t slot = self->names_[{from_kind, from}];
+    self->names_.erase({from_kind, from});
+    self->names_[{to_kind, to}] = slot;
+    return BLOCK_OK;
+}
+
+// f_unlink: free the chain and the directory entry
+int SegmentStore::remove(void *ctx, uint32_t spare) {
+    auto *self = static_cast<SegmentStore *>(ctx);
+    auto it = self->names_.find({LOG_SEGMENT_SPARE, spare});
+    if (it == self->names_.end()) {
+        return BLOCK_OK;
+    }
+    uint32_t slot = it->second;
+    int status = self->read_metadata(self->dir_lba_, 1);
+    if (status == BLOCK_OK) {
+        status = self->write_chain(slot);
+    }
+    if (status == BLOCK_OK) {
+        status = self->write_directory();
+    }
+    if (status != BLOCK_OK) {
+        return status;
+    }
+    self->slot_used_[slot] = false;
+    self->names_.erase(it);
+    return BLOCK_OK;
+}
+
+int SegmentStore::locate(void *ctx, uint32_t file, uint32_t *start_lba) {
+    auto *self = static_cast<SegmentStore *>(ctx);
+    int status = self->read_metadata(self->dir_lba_, 1);
+    if (status != BLOCK_OK) {
+        return status;
+    }
+    if (!self->has(LOG_SEGMENT_LIVE, file)) {
+        return BLOCK_ERROR;
+    }
+    *start_lba = self->lba(LOG_SEGMENT_LIVE, file);
+    return BLOCK_OK;
+}
+
+}  // namespace host
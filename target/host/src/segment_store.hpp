@@ -0,0 +1,81 @@
+#ifndef SEGMENT_STORE_HPP
+#define SEGMENT_STORE_HPP
+
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "log_segments.h"
+
+namespace host {
+
+// The shape of the emulated volume
+struct SegmentStoreConfig {
+    uint32_t segment_blocks = 256;      // Log blocks per segment
+    uint32_t slots = 32;                // Segments the volume has room for
+    uint32_t cluster_sectors = 64;      // 32 KiB clusters
+};
+
+// The file system side of log_segments on a host block device, standing
+// in for FatFs on the card. Segment slots sit one after another past a
+// directory sector and two copies of a FAT, and each operation does the
+// reads and writes FatFs would do for it, so the device's latency model
+// prices them:
+//
+//   rename   read and rewrite the directory sector
+//   prepare  read the FAT up to a free run, write the run's chain into
+//            both copies, write the directory sector
+//   remove   free the chain in both copies, write the directory sector
+//   locate   read the directory sector
+//
+// Names live in memory; the device only sees the traffic. Sectors 0 and 1
+// are left for the log's checkpoints.
+class SegmentStore {
+public:
+    static constexpr uint32_t CHECKPOINT_LBA = 0;
+
+    SegmentStore(block_dev_t *dev, SegmentStoreConfig config);
+
+    // Sectors a device needs for this volume
+    static uint32_t sectors(const SegmentStoreConfig &config);
+
+    const log_segment_ops_t &ops() const { return ops_; }
+    const SegmentStoreConfig &config() const { return config_; }
+
+    bool has(log_segment_kind_t kind, uint32_t number) const;
+    uint32_t count(log_segment_kind_t kind) const;
+    // Every segment, as a directory listing would show them
+    void scan(log_segments_scan_t *scan) const;
+    uint32_t slots_used() const { return uint32_t(names_.size()); }
+    uint32_t lba(log_segment_kind_t kind, uint32_t number) const;
+    uint64_t metadata_writes() const { return metadata_writes_; }
+
+private:
+    using Name = std::pair<log_segment_kind_t, uint32_t>;
+
+    static int prepare(void *ctx, uint32_t spare);
+    static int rename(void *ctx, log_segment_kind_t from_kind, uint32_t from, log_segment_kind_t to_kind, uint32_t to);
+    static int remove(void *ctx, uint32_t spare);
+    static int locate(void *ctx, uint32_t file, uint32_t *start_lba);
+
+    int write_chain(uint32_t slot);
+    int write_directory();
+    int read_metadata(uint32_t lba, uint32_t count);
+
+    block_dev_t *dev_;
+    SegmentStoreConfig config_;
+    log_segment_ops_t ops_;
+    uint32_t dir_lba_;
+    uint32_t fat_lba_;
+    uint32_t fat_sectors_;              // In each copy
+    uint32_t data_lba_;
+    std::map<Name, uint32_t> names_;    // Name to slot
+    std::vector<bool> slot_used_;
+    std::vector<uint8_t> sector_;
+    uint64_t metadata_writes_ = 0;
+};
+
+}  // namespace host
+
+#endif
@@ -0,0 +1,108 @@
+#include "serial_port.hpp"
+
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+namespace host {
+
+#ifdef _WIN32
+
+SerialPort::SerialPort(const std::string &path) : path_(path) {
+    throw std::runtime_error("serial ports are not supported on this platform: " + path);
+}
+
+SerialPort::~SerialPort() {}
+
+void SerialPort::write(const uint8_t *, size_t) {}
+
+size_t SerialPort::read(uint8_t *, size_t, int) {
+    return 0;
+}
+
+void SerialPort::discard() {}
+
+#else
+
+SerialPort::SerialPort(const std::string &path) : path_(path) {
+    fd_ = open(path.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (fd_ < 0) {
+        throw std::runtime_error("cannot open " + path);
+    }
+    struct termios tio;
+    if (tcgetattr(fd_, &tio) != 0) {
+        close(fd_);
+        throw std::runtime_error("not a serial port: " + path);
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(fd_, TCSANOW, &tio) != 0) {
+        close(fd_);
+        throw std::runtime_error("cannot set up " + path);
+    }
+    tcflush(fd_, TCIOFLUSH);
+}
+
+SerialPort::~SerialPort() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+void SerialPort::write(const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd_, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("write failed on " + path_);
+        }
+        data += n;
+        len -= size_t(n);
+    }
+}
+
+size_t SerialPort::read(uint8_t *buf, size_t len, int timeout_ms) {
+    struct pollfd p = {fd_, POLLIN, 0};
+    int ready = poll(&p, 1, timeout_ms);
+    if (ready < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        throw std::runtime_error("poll failed on " + path_);
+    }
+    if (ready == 0) {
+        return 0;
+    }
+    if (p.revents & (POLLERR | POLLNVAL)) {
+        throw std::runtime_error("port lost: " + path_);
+    }
+    ssize_t n = ::read(fd_, buf, len);
+    if (n < 0) {
+        if (errno == EINTR || errno == EAGAIN) {
+            return 0;
+        }
+        throw std::runtime_error("read failed on " + path_);
+    }
+    if (n == 0 && (p.revents & POLLHUP)) {
+        throw std::runtime_error("port closed: " + path_);
+    }
+    return size_t(n);
+}
+
+void SerialPort::discard() {
+    tcflush(fd_, TCIFLUSH);
+}
+
+#endif
+
+}  // namespace host
@@ -0,0 +1,42 @@
+#ifndef SERIAL_PORT_HPP
+#define SERIAL_PORT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace host {
+
+// A serial device (a CDC port such as /dev/ttyACM2, or a pty in the
+// tests) opened raw: no echo, no line editing, no translation of bytes.
+// The baud rate means nothing to a CDC port and is left alone.
+class SerialPort {
+public:
+    // Throws std::runtime_error if the port cannot be opened or set raw
+    explicit SerialPort(const std::string &path);
+    ~SerialPort();
+
+    SerialPort(const SerialPort &) = delete;
+    SerialPort &operator=(const SerialPort &) = delete;
+
+    // Write all of data; throws std::runtime_error if the port fails
+    void write(const uint8_t *data, size_t len);
+
+    // Read what is there, up to len bytes, waiting up to timeout_ms for
+    // the first of them. 0 on timeout; throws std::runtime_error if the
+    // port fails or goes away.
+    size_t read(uint8_t *buf, size_t len, int timeout_ms);
+
+    // Drop whatever has arrived and not been read
+    void discard();
+
+    const std::string &path() const { return path_; }
+
+private:
+    std::string path_;
+    int fd_ = -1;
+};
+
+}  // namespace host
+
+#endif
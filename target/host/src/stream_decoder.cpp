@@ -0,0 +1,91 @@
+#include "stream_decoder.hpp"
+
+#include <utility>
+
+#include "crc.h"
+#include "output_sinks.h"
+
+namespace host {
+
+StreamDecoder::StreamDecoder(SampleCallback on_sample) : on_sample_(std::move(on_sample)) {
+    reset();
+}
+
+// Forget any partial frame and wait for a keyframe
+void StreamDecoder::reset() {
+    pending_.clear();
+    delta_codec_init(&codec_, DELTA_KEYFRAME_INTERVAL);
+    last_seq_ = -1;
+}
+
+// Append bytes and decode every complete frame they finish
+void StreamDecoder::feed(const uint8_t *data, size_t len) {
+    pending_.insert(pending_.end(), data, data + len);
+
+    size_t pos = 0;
+    while (pending_.size() - pos >= 6) {
+        const uint8_t *p = &pending_[pos];
+        if (p[0] != OUTPUT_FRAME_SYNC0 || p[1] != OUTPUT_FRAME_SYNC1) {
+            pos++;
+            stats_.skipped_bytes++;
+            continue;
+        }
+
+        size_t payload_len = p[3];
+        size_t frame_len = payload_len + 6;
+        if (pending_.size() - pos < frame_len) {
+            break;
+        }
+
+        uint16_t crc = static_cast<uint16_t>(p[4 + payload_len] | (p[5 + payload_len] << 8));
+        if (crc16_ccitt(CRC16_INIT, &p[2], payload_len + 2) != crc) {
+            // Not a real frame (or a damaged one): resume the hunt one byte on
+            stats_.crc_errors++;
+            stats_.skipped_bytes++;
+            pos++;
+            continue;
+        }
+
+        stats_.frames++;
+        handle_frame(p[2], &p[4], payload_len);
+        pos += frame_len;
+    }
+    pending_.erase(pending_.begin(), pending_.begin() + static_cast<std::ptrdiff_t>(pos));
+}
+
+// Decode the payload of one CRC-checked frame
+void StreamDecoder::handle_frame(uint8_t type, const uint8_t *payload, size_t len) {
+    sample_t sample;
+
+    if (type == OUTPUT_FRAME_SAMPLE) {
+        if (sample_unpack(&sample, payload, len)) {
+            stats_.samples++;
+            on_sample_(sample);
+        }
+        return;
+    }
+    if (type != OUTPUT_FRAME_DELTA || len < 2) {
+        return;
+    }
+
+    int seq = payload[0];
+    if (last_seq_ >= 0 && seq != ((last_seq_ + 1) & 0xFF)) {
+        // Frames went missing; deltas are meaningless until the next keyframe
+        stats_.sequence_gaps += static_cast<uint64_t>((seq - last_seq_ - 1) & 0xFF);
+        delta_codec_force_keyframe(&codec_);
+    }
+    last_seq_ = seq;
+
+    size_t used = 0;
+    int status = delta_decode(&codec_, &payload[1], len - 1, &sample, &used);
+    if (status == DELTA_OK) {
+        stats_.samples++;
+        on_sample_(sample);
+    } else if (status == DELTA_ERR_NO_KEYFRAME) {
+        stats_.awaiting_keyframe++;
+    } else {
+        delta_codec_force_keyframe(&codec_);
+    }
+}
+
+}  // namespace host
@@ -0,0 +1,49 @@
+#ifndef STREAM_DECODER_HPP
+#define STREAM_DECODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "delta_codec.h"
+#include "sample.h"
+
+namespace host {
+
+// Decodes the framed binary stream written by the device's binary sink.
+// Bytes can be fed in arbitrary chunks; every recovered sample is passed to
+// the callback. Lost or corrupted frames make the decoder wait for the next
+// keyframe instead of producing wrong values.
+class StreamDecoder {
+public:
+    struct Stats {
+        uint64_t frames = 0;            // Frames with a valid CRC
+        uint64_t samples = 0;           // Samples delivered to the callback
+        uint64_t crc_errors = 0;
+        uint64_t sequence_gaps = 0;     // Frames missing between two good ones
+        uint64_t awaiting_keyframe = 0; // Delta records discarded while resynchronising
+        uint64_t skipped_bytes = 0;     // Bytes discarded while hunting for sync
+    };
+
+    using SampleCallback = std::function<void(const sample_t &)>;
+
+    explicit StreamDecoder(SampleCallback on_sample);
+
+    void feed(const uint8_t *data, size_t len);
+    void reset();
+    const Stats &stats() const { return stats_; }
+
+private:
+    void handle_frame(uint8_t type, const uint8_t *payload, size_t len);
+
+    SampleCallback on_sample_;
+    std::vector<uint8_t> pending_;
+    delta_codec_t codec_;
+    int last_seq_ = -1;
+    Stats stats_;
+};
+
+}  // namespace host
+
+#endif
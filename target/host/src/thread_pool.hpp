@@ -0,0 +1,51 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace host {
+
+// A fixed set of threads for data-parallel loops. parallel_for hands out
+// indices one at a time from a shared counter, so uneven tasks balance
+// themselves; the calling thread works too. One loop runs at a time, and
+// tasks must not throw.
+class ThreadPool {
+public:
+    // 'threads' includes the caller; 0 means one per hardware thread
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    // Run task(i) for every i in [0, count) and wait for all of them
+    void parallel_for(size_t count, const std::function<void(size_t)> &task);
+
+private:
+    void worker();
+    void work();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(size_t)> *task_ = nullptr;
+    size_t count_ = 0;
+    std::atomic<size_t> next_{0};
+    uint64_t generation_ = 0;
+    unsigned busy_ = 0;
+    bool stop_ = false;
+};
+
+}  // namespace host
+
+#endif
@@ -0,0 +1,93 @@
+// Download log files from a device over its download port (the third CDC
+// port, .../if04 on Linux), far faster than the control port's text.
+//
+//   log_download -p PORT [-w window] [-o dir] [-l] [FILE...]
+//
+// -l lists the files the device has. Each FILE (all of them if none is
+// given) goes to dir/log_NNNNNNNN.bin; a file already partly there is
+// carried on from where it stopped, so running again after an unplugged
+// cable or ^C fetches only what is missing.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "log_download.hpp"
+
+namespace {
+
+int usage() {
+    std::fprintf(stderr, "usage: log_download -p PORT [-w window] [-o dir] [-l] [FILE...]\n");
+    return 2;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    host::DownloadOptions options;
+    const char *port_path = nullptr;
+    std::string dir = ".";
+    bool list = false;
+    std::vector<uint32_t> files;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "-p") && i + 1 < argc) {
+            port_path = argv[++i];
+        } else if (!std::strcmp(argv[i], "-w") && i + 1 < argc) {
+            options.window = unsigned(std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "-o") && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (!std::strcmp(argv[i], "-l")) {
+            list = true;
+        } else if (argv[i][0] == '-') {
+            return usage();
+        } else {
+            files.push_back(uint32_t(std::strtoul(argv[i], nullptr, 10)));
+        }
+    }
+    if (!port_path) {
+        return usage();
+    }
+
+    try {
+        host::SerialPort port(port_path);
+        host::LogDownloader downloader(port, options);
+        std::pair<uint32_t, uint32_t> range = downloader.list();
+        if (list) {
+            for (uint32_t file = range.first; file < range.second; ++file) {
+                std::printf("%u %u blocks\n", file, downloader.blocks(file));
+            }
+            return 0;
+        }
+        if (files.empty()) {
+            for (uint32_t file = range.first; file < range.second; ++file) {
+                files.push_back(file);
+            }
+        }
+
+        int status = 0;
+        for (uint32_t file : files) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/log_%08u.bin", file);
+            std::string path = dir + name;
+            host::DownloadStats stats = downloader.fetch_to(file, path);
+            if (stats.write_failed) {
+                std::fprintf(stderr, "%s: write failed\n", path.c_str());
+                status = 1;
+                continue;
+            }
+            double kib = stats.blocks * LOG_BLOCK_SIZE / 1024.0;
+            std::fprintf(stderr,
+                         "%s: %llu blocks from block %llu, %.2f s, %.0f KiB/s, %llu CRC errors, %llu retries\n",
+                         path.c_str(), (unsigned long long)stats.blocks, (unsigned long long)stats.resumed_from,
+                         stats.seconds, stats.seconds > 0 ? kib / stats.seconds : 0.0,
+                         (unsigned long long)stats.crc_errors, (unsigned long long)stats.retries);
+        }
+        return status;
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
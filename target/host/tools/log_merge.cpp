@@ -0,0 +1,98 @@
+// Merge the logs of many devices into one time-ordered CSV or columnar
+// file, each row tagged with the device that recorded it.
+//
+//   log_merge [-f csv|columnar] [-b read blocks] [-j io threads] [-o out] LOG...
+//
+// Logs are streamed, not loaded: each keeps two buffers of -b blocks, so
+// memory depends on the number of logs, not their size, and -j reads run
+// ahead of the merge. Output goes to stdout unless -o is given; a summary
+// goes to stderr.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "log_merge.hpp"
+
+namespace {
+
+int usage() {
+    std::fprintf(stderr, "usage: log_merge [-f csv|columnar] [-b read blocks] [-j io threads] [-o out] LOG...\n");
+    return 2;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    host::MergeOptions options;
+    const char *out_path = nullptr;
+    std::vector<std::string> logs;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "-f") && i + 1 < argc) {
+            std::string f = argv[++i];
+            if (f == "csv") {
+                options.format = host::ExportFormat::Csv;
+            } else if (f == "columnar") {
+                options.format = host::ExportFormat::Columnar;
+            } else {
+                return usage();
+            }
+        } else if (!std::strcmp(argv[i], "-b") && i + 1 < argc) {
+            options.read_blocks = size_t(std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "-j") && i + 1 < argc) {
+            options.io_threads = unsigned(std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "-o") && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (argv[i][0] == '-') {
+            return usage();
+        } else {
+            logs.push_back(argv[i]);
+        }
+    }
+    if (logs.empty()) {
+        return usage();
+    }
+
+    host::LogMerger merger(options);
+    int status = 0;
+    for (const std::string &path : logs) {
+        try {
+            if (!merger.add(path)) {
+                std::fprintf(stderr, "%s: not a sample log\n", path.c_str());
+                status = 1;
+            }
+        } catch (const std::exception &e) {
+            std::fprintf(stderr, "%s\n", e.what());
+            status = 1;
+        }
+    }
+
+    FILE *out = out_path ? std::fopen(out_path, "wb") : stdout;
+    if (!out) {
+        std::fprintf(stderr, "cannot create %s\n", out_path);
+        return 1;
+    }
+    host::ExportSink sink = [out](const char *data, size_t len) { return std::fwrite(data, 1, len, out) == len; };
+
+    auto start = std::chrono::steady_clock::now();
+    host::MergeStats stats = merger.run(sink);
+    if (stats.write_failed || std::fflush(out) != 0 || (out_path && std::fclose(out) != 0)) {
+        std::fprintf(stderr, "%s: write failed\n", out_path ? out_path : "stdout");
+        status = 1;
+    }
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::fprintf(stderr,
+                 "%llu samples from %llu logs of %llu devices, %llu blocks (%llu bad), %llu out of order, "
+                 "%llu bytes out, %.2f s, %.1f MiB of read buffers, %.2f s waiting for reads\n",
+                 (unsigned long long)stats.samples, (unsigned long long)stats.inputs,
+                 (unsigned long long)stats.devices, (unsigned long long)stats.blocks,
+                 (unsigned long long)stats.bad_blocks, (unsigned long long)stats.out_of_order,
+                 (unsigned long long)stats.bytes_out, secs, stats.buffer_bytes / 1048576.0,
+                 stats.read_wait_us / 1e6);
+    return status;
+}
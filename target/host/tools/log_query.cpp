@@ -0,0 +1,155 @@
+// Bucketed aggregates over a time range of recorded logs.
+//
+//   log_query [-j threads] [-s start] [-e end | -l last] [-b bucket] [-c channels] LOG...
+//
+// Times are seconds of log time: -s and -e bound the range, -l takes the
+// last so many seconds of the logs instead, and -b sets the bucket width
+// (default: one bucket for the whole range). -c picks channels by name,
+// e.g. -c temperature,heading. Prints CSV with count, min, max and mean
+// per channel and bucket; heading is a circular mean.
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "log_query.hpp"
+#include "mapped_file.hpp"
+
+namespace {
+
+int usage() {
+    std::fprintf(stderr,
+                 "usage: log_query [-j threads] [-s start] [-e end | -l last] [-b bucket] [-c channels] LOG...\n");
+    return 2;
+}
+
+uint64_t seconds_us(const char *arg) {
+    return uint64_t(std::strtod(arg, nullptr) * 1e6);
+}
+
+// Comma-separated channel names to a mask; 0 if one is unknown
+uint32_t channel_mask(const std::string &list) {
+    uint32_t mask = 0;
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = list.find(',', pos);
+        std::string name = list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        int ch = 0;
+        while (ch < SAMPLE_CH_COUNT && name != sample_channels[ch].name) {
+            ch++;
+        }
+        if (ch == SAMPLE_CH_COUNT) {
+            return 0;
+        }
+        mask |= 1u << ch;
+        pos = comma == std::string::npos ? list.size() + 1 : comma + 1;
+    }
+    return mask;
+}
+
+void print_value(double value, int decimals) {
+    if (!std::isnan(value)) {
+        std::printf("%.*f", decimals, value);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    host::QuerySpec spec;
+    unsigned threads = 0;
+    uint64_t last_us = 0;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (arg[0] == '-' && arg[1] && !arg[2] && i + 1 < argc) {
+            const char *value = argv[++i];
+            switch (arg[1]) {
+            case 'j': threads = unsigned(std::atoi(value)); break;
+            case 's': spec.t0 = seconds_us(value); break;
+            case 'e': spec.t1 = seconds_us(value); break;
+            case 'l': last_us = seconds_us(value); break;
+            case 'b': spec.bucket_us = seconds_us(value); break;
+            case 'c':
+                spec.channels = channel_mask(value);
+                if (!spec.channels) {
+                    return usage();
+                }
+                break;
+            default: return usage();
+            }
+        } else if (arg[0] == '-') {
+            return usage();
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        return usage();
+    }
+
+    try {
+        std::vector<std::unique_ptr<host::MappedFile>> files;
+        host::LogQuery query;
+        for (const std::string &path : paths) {
+            files.push_back(std::make_unique<host::MappedFile>(path));
+            if (!query.add_log(files.back()->data(), files.back()->size())) {
+                std::fprintf(stderr, "%s: not a sample log\n", path.c_str());
+            }
+        }
+        if (last_us) {
+            spec.t1 = query.last_time_us() + 1;
+            spec.t0 = spec.t1 > last_us ? spec.t1 - last_us : 0;
+        }
+
+        host::ThreadPool pool(threads);
+        auto start = std::chrono::steady_clock::now();
+        host::QueryResult result = query.run(pool, spec);
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf("start_us");
+        for (int ch = 0; ch < SAMPLE_CH_COUNT; ++ch) {
+            if (spec.channels & (1u << ch)) {
+                const char *name = sample_channels[ch].name;
+                std::printf(",%s_count,%s_min,%s_max,%s_mean", name, name, name, name);
+            }
+        }
+        std::printf("\n");
+        for (const host::QueryBucket &bucket : result.buckets) {
+            std::printf("%llu", (unsigned long long)bucket.start_us);
+            for (int ch = 0; ch < SAMPLE_CH_COUNT; ++ch) {
+                if (!(spec.channels & (1u << ch))) {
+                    continue;
+                }
+                sample_channel_t c = sample_channel_t(ch);
+                const host::ChannelAggregate &agg = bucket.ch[ch];
+                int decimals = sample_channels[ch].decimals;
+                std::printf(",%llu,", (unsigned long long)agg.count);
+                print_value(host::aggregate_min(c, agg), decimals);
+                std::printf(",");
+                print_value(host::aggregate_max(c, agg), decimals);
+                std::printf(",");
+                print_value(host::aggregate_mean(c, agg), decimals + 2);
+            }
+            std::printf("\n");
+        }
+
+        const host::QueryStats &st = result.stats;
+        std::fprintf(stderr,
+                     "%llu samples in %zu buckets: %llu blocks decoded, %llu skipped by header, %llu bad, "
+                     "%llu of %zu logs skipped, %.3f s on %u threads\n",
+                     (unsigned long long)st.samples, result.buckets.size(), (unsigned long long)st.blocks_decoded,
+                     (unsigned long long)st.blocks_skipped, (unsigned long long)st.bad_blocks,
+                     (unsigned long long)st.logs_skipped, query.log_count(), secs, pool.size());
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,300 @@
+#include "acq_core.h"
+#include "ram_func.h"
+#include "cmps12.h"
+#include "tmp117_registers.h"
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/structs/timer.h"
+
+// TMP117 configuration register: a conversion has finished since the
+// result was last read
+#define ACQ_TMP117_DATA_READY 0x2000
+
+// Three commands per register read: the address and two read commands
+_Static_assert(VEML6075_READ_COUNT * 3 <= 16, "a VEML6075 read must fit the I2C TX FIFO");
+_Static_assert(ICP10125_RESULT_BYTES <= 16, "an ICP10125 read must fit the I2C TX FIFO");
+
+// Core 1's entry point takes no argument
+static acq_core_t *acq_core;
+
+// time_us_64() without calling into flash
+static uint64_t RAM_FUNC(acq_time_us)(void) {
+    uint32_t hi = timer_hw->timerawh;
+    while (1) {
+        uint32_t lo = timer_hw->timerawl;
+        uint32_t next_hi = timer_hw->timerawh;
+        if (next_hi == hi) {
+            return (uint64_t)hi << 32 | lo;
+        }
+        hi = next_hi;
+    }
+}
+
+static void RAM_FUNC(acq_i2c_begin)(i2c_hw_t *hw, uint8_t address) {
+    hw->enable = 0;
+    hw->tar = address;
+    hw->enable = 1;
+}
+
+// No acknowledge: the controller flushes the FIFO and sends a stop
+static void RAM_FUNC(acq_i2c_abort)(i2c_hw_t *hw, uint32_t start) {
+    while (!(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS) &&
+           timer_hw->timerawl - start < ACQ_I2C_TIMEOUT_US) {
+    }
+    (void)hw->clr_tx_abrt;
+    (void)hw->clr_stop_det;
+}
+
+// Collect the 'len' bytes a queued transfer reads
+static bool RAM_FUNC(acq_i2c_collect)(i2c_hw_t *hw, uint8_t *buf, uint32_t len) {
+    uint32_t start = timer_hw->timerawl;
+    for (uint32_t got = 0; got < len;) {
+        if (hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS) {
+            acq_i2c_abort(hw, start);
+            return false;
+        }
+        if (hw->rxflr) {
+            buf[got++] = (uint8_t)hw->data_cmd;
+        } else if (timer_hw->timerawl - start >= ACQ_I2C_TIMEOUT_US) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Read 'len' registers from 'reg' on, driving the controller directly
+// because the SDK's I2C functions are in flash. The whole transfer fits
+// the TX FIFO: the register address, then one read command per byte, the
+// first with a repeated start and the last with a stop.
+static bool RAM_FUNC(acq_i2c_read)(i2c_hw_t *hw, uint8_t address, uint8_t reg, uint8_t *buf, uint32_t len) {
+    acq_i2c_begin(hw, address);
+    hw->data_cmd = reg;
+    for (uint32_t i = 0; i < len; i++) {
+        hw->data_cmd = I2C_IC_DATA_CMD_CMD_BITS | (i == 0 ? I2C_IC_DATA_CMD_RESTART_BITS : 0) |
+                       (i == len - 1 ? I2C_IC_DATA_CMD_STOP_BITS : 0);
+    }
+    return acq_i2c_collect(hw, buf, len);
+}
+
+// The VEML6075 bus (veml6075_bus_t). Its registers do not auto-increment,
+// so each gets its own command code and repeated start, all queued at
+// once as a single transaction with one stop at the end. Words are low
+// byte first.
+static bool RAM_FUNC(acq_uv_read)(void *ctx, uint8_t address, const uint8_t *regs, uint16_t *values,
+                                  uint32_t count) {
+    i2c_hw_t *hw = ctx;
+    uint8_t buf[2 * VEML6075_READ_COUNT];
+
+    acq_i2c_begin(hw, address);
+    for (uint32_t i = 0; i < count; i++) {
+        hw->data_cmd = regs[i] | (i > 0 ? I2C_IC_DATA_CMD_RESTART_BITS : 0);
+        hw->data_cmd = I2C_IC_DATA_CMD_CMD_BITS | I2C_IC_DATA_CMD_RESTART_BITS;
+        hw->data_cmd = I2C_IC_DATA_CMD_CMD_BITS | (i == count - 1 ? I2C_IC_DATA_CMD_STOP_BITS : 0);
+    }
+    if (!acq_i2c_collect(hw, buf, 2 * count)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        values[i] = (uint16_t)(buf[2 * i] | buf[2 * i + 1] << 8);
+    }
+    return true;
+}
+
+// A write has nothing to collect, so wait for its stop. At most 16 bytes.
+static bool RAM_FUNC(acq_i2c_write)(i2c_hw_t *hw, uint8_t address, const uint8_t *data, uint32_t len) {
+    acq_i2c_begin(hw, address);
+    (void)hw->clr_stop_det;
+    for (uint32_t i = 0; i < len; i++) {
+        hw->data_cmd = data[i] | (i == len - 1 ? I2C_IC_DATA_CMD_STOP_BITS : 0);
+    }
+
+    uint32_t start = timer_hw->timerawl;
+    while (!(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS)) {
+        if (hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS) {
+            acq_i2c_abort(hw, start);
+            return false;
+        }
+        if (timer_hw->timerawl - start >= ACQ_I2C_TIMEOUT_US) {
+            return false;
+        }
+    }
+    // A NAK on the last byte shows up with the stop
+    bool ok = !(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS);
+    (void)hw->clr_tx_abrt;
+    (void)hw->clr_stop_det;
+    return ok;
+}
+
+static bool RAM_FUNC(acq_uv_write)(void *ctx, uint8_t address, uint8_t reg, uint16_t value) {
+    uint8_t data[3];
+    data[0] = reg;
+    data[1] = (uint8_t)value;
+    data[2] = (uint8_t)(value >> 8);
+    return acq_i2c_write(ctx, address, data, 3);
+}
+
+// The ICP10125 bus (icp10125_bus_t): commands and results are plain
+// writes and reads, with no register address
+static bool RAM_FUNC(acq_pressure_write)(void *ctx, uint8_t address, const uint8_t *data, uint32_t len) {
+    return acq_i2c_write(ctx, address, data, len);
+}
+
+static bool RAM_FUNC(acq_pressure_read)(void *ctx, uint8_t address, uint8_t *buf, uint32_t len) {
+    i2c_hw_t *hw = ctx;
+
+    acq_i2c_begin(hw, address);
+    for (uint32_t i = 0; i < len; i++) {
+        hw->data_cmd = I2C_IC_DATA_CMD_CMD_BITS | (i == len - 1 ? I2C_IC_DATA_CMD_STOP_BITS : 0);
+    }
+    return acq_i2c_collect(hw, buf, len);
+}
+
+// sample_set() is in flash
+static void RAM_FUNC(acq_set)(sample_t *sample, sample_channel_t ch, int32_t value) {
+    sample->value[ch] = value;
+    sample->valid |= 1u << ch;
+}
+
+// One acquisition cycle: the compass every time, the temperature when a
+// conversion has finished, as the main loop did before
+static void RAM_FUNC(acq_sample)(acq_core_t *acq, sample_t *sample) {
+    uint8_t data[5];
+
+    sample->time_us = acq_time_us();
+    sample->valid = 0;
+
+    // angle8, angle16 high and low, pitch, roll
+    if (acq_i2c_read(acq->i2c, acq->compass_address, ANGLE_8_REG, data, 5)) {
+        acq_set(sample, SAMPLE_CH_ANGLE8, data[0]);
+        acq_set(sample, SAMPLE_CH_HEADING, data[1] << 8 | data[2]);
+        acq_set(sample, SAMPLE_CH_PITCH, (int8_t)data[3]);
+        acq_set(sample, SAMPLE_CH_ROLL, (int8_t)data[4]);
+    } else {
+        acq->i2c_errors++;
+    }
+
+    // Registers are big-endian
+    if (!acq_i2c_read(acq->i2c, acq->temp_address, TMP117_CONFIGURATION, data, 2)) {
+        acq->i2c_errors++;
+    } else if ((data[0] << 8 | data[1]) & ACQ_TMP117_DATA_READY) {
+        if (acq_i2c_read(acq->i2c, acq->temp_address, TMP117_TEMP_RESULT, data, 2)) {
+            acq_set(sample, SAMPLE_CH_TEMP, (int16_t)(data[0] << 8 | data[1]));
+        } else {
+            acq->i2c_errors++;
+        }
+    }
+
+    // Read in the idle time before this sample
+    const veml6075_result_t *uv = acq->uv_present ? veml6075_take(&acq->uv) : NULL;
+    if (uv) {
+        acq_set(sample, SAMPLE_CH_UVA, uv->uva);
+        acq_set(sample, SAMPLE_CH_UVB, uv->uvb);
+        acq_set(sample, SAMPLE_CH_UV_INDEX, uv->uv_index);
+    }
+
+    // Raw codes, for core 0 to convert (acq_core_convert())
+    const icp10125_result_t *pressure = acq->pressure_present ? icp10125_take(&acq->pressure) : NULL;
+    if (pressure) {
+        acq_set(sample, SAMPLE_CH_PRESSURE, (int32_t)pressure->pressure);
+        acq_set(sample, SAMPLE_CH_PRESSURE_TEMP, pressure->temp);
+    }
+}
+
+// Sample on a fixed schedule for ever, spinning between samples. Lateness
+// is measured from the scheduled time to the start of the cycle.
+static void RAM_FUNC(acq_core_main)(void) {
+    acq_core_t *acq = acq_core;
+    sample_t sample;
+    uint32_t next_us = timer_hw->timerawl;
+
+    while (1) {
+        while (1) {
+            uint32_t now_us = timer_hw->timerawl;
+            if ((int32_t)(next_us - now_us) <= 0) {
+                break;
+            }
+            // Sensor work only where it cannot make the sample late; the
+            // pressure sensor goes first, leaving room for the UV sensor
+            uint32_t left_us = next_us - now_us;
+            if (acq->pressure_present && left_us >= ACQ_UV_BUS_US + ACQ_PRESSURE_BUS_US &&
+                icp10125_due(&acq->pressure, now_us)) {
+                if (icp10125_poll(&acq->pressure, now_us) == ICP10125_ERROR) {
+                    acq->i2c_errors++;
+                }
+            } else if (acq->uv_present && left_us >= ACQ_UV_BUS_US && veml6075_due(&acq->uv, now_us) &&
+                       veml6075_poll(&acq->uv, now_us) == VEML6075_ERROR) {
+                acq->i2c_errors++;
+            }
+        }
+        uint32_t start_us = timer_hw->timerawl;
+
+        if (acq->reset_jitter) {
+            jitter_stats_reset(&acq->jitter);
+            acq->reset_jitter = false;
+        }
+        jitter_stats_add(&acq->jitter, start_us - next_us);
+
+        acq_sample(acq, &sample);
+        sample_ring_push(&acq->ring, &sample);
+
+        // Keep a fixed rate; if a whole period behind, resynchronise
+        uint32_t period_us = acq->period_us;
+        next_us += period_us;
+        if ((int32_t)(timer_hw->timerawl - next_us) > (int32_t)period_us) {
+            jitter_stats_skip(&acq->jitter);
+            next_us = timer_hw->timerawl;
+        }
+        if (acq->pressure_present) {
+            icp10125_plan(&acq->pressure, next_us - ACQ_UV_BUS_US - ACQ_PRESSURE_BUS_US);
+        }
+        if (acq->uv_present) {
+            veml6075_plan(&acq->uv, next_us - ACQ_UV_BUS_US);
+        }
+    }
+}
+
+// Called on core 0 once the bus is up. The TMP117 address is passed in
+// because its driver picks it.
+void acq_core_init(acq_core_t *acq, i2c_inst_t *i2c, uint8_t temp_address, uint32_t period_us) {
+    acq->i2c = i2c_get_hw(i2c);
+    acq->compass_address = CMPS12_ADDRESS;
+    acq->temp_address = temp_address;
+    acq->period_us = period_us;
+    acq->reset_jitter = false;
+    acq->i2c_errors = 0;
+    acq->uv_present = false;
+    acq->pressure_present = false;
+    sample_ring_init(&acq->ring);
+    jitter_stats_reset(&acq->jitter);
+}
+
+// Called on core 0 between acq_core_init() and the launch; false if there
+// is no VEML6075, in which case samples go without UV
+bool acq_core_add_uv(acq_core_t *acq, uint8_t it, bool hd) {
+    veml6075_bus_t bus = {acq_uv_read, acq_uv_write, acq->i2c};
+    acq->uv_present = veml6075_init(&acq->uv, &bus, it, hd);
+    return acq->uv_present;
+}
+
+// Likewise for the ICP10125, whose calibration is read here
+bool acq_core_add_pressure(acq_core_t *acq, uint8_t mode) {
+    icp10125_bus_t bus = {acq_pressure_write, acq_pressure_read, acq->i2c};
+    acq->pressure_present = icp10125_init(&acq->pressure, &bus, mode);
+    return acq->pressure_present;
+}
+
+// Core 0's share of a sample, from flash: conversions that need library
+// calls, such as 64-bit division
+void acq_core_convert(const acq_core_t *acq, sample_t *sample) {
+    if (sample_has(sample, SAMPLE_CH_PRESSURE)) {
+        uint16_t temp = (uint16_t)sample->value[SAMPLE_CH_PRESSURE_TEMP];
+        uint32_t code = (uint32_t)sample->value[SAMPLE_CH_PRESSURE];
+        sample->value[SAMPLE_CH_PRESSURE] = icp10125_pressure(&acq->pressure.cal, temp, code);
+        sample->value[SAMPLE_CH_PRESSURE_TEMP] = icp10125_temperature(temp);
+    }
+}
+
+void acq_core_launch(acq_core_t *acq) {
+    acq_core = acq;
+    multicore_launch_core1(acq_core_main);
+}
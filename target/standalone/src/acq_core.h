@@ -0,0 +1,71 @@
+#ifndef ACQ_CORE_H
+#define ACQ_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "hardware/i2c.h"
+#include "sample_ring.h"
+#include "jitter_stats.h"
+#include "veml6075.h"
+#include "icp10125.h"
+
+// A bus transaction gives up after this long
+#define ACQ_I2C_TIMEOUT_US 5000
+
+// Room left before a sample for a VEML6075 read and the next trigger at
+// 100 kHz; UV work that would not finish in time waits until after it
+#define ACQ_UV_BUS_US 4000
+
+// Likewise for an ICP10125 result and the next measurement command. Its
+// result is planned to be read before the VEML6075's.
+#define ACQ_PRESSURE_BUS_US 2000
+
+// Sampling on core 1. Everything it runs, from its main loop down to the
+// I2C register accesses, and everything it touches, is in SRAM. It keeps
+// sampling while core 0 has the flash out of XIP mode to write the log,
+// so core 0 never has to pause it. Samples go to core 0 through 'ring'.
+//
+// The bus and the sensors are set up on core 0 first. After the launch,
+// core 0 must leave the I2C controller alone.
+//
+// The VEML6075, if there is one, measures when triggered. Each
+// measurement is started so that it finishes just before the next sample
+// and read in the idle time before it, so a sample carries UV light from
+// the period it closes. With a period shorter than the integration time,
+// measurements run back to back and a sample carries the newest one.
+// The ICP10125 is run the same way, so its conversion overlaps the other
+// sensors' reads instead of being waited out. Core 1 passes on its raw
+// codes; core 0 converts them with acq_core_convert() as it takes each
+// sample from the ring, as the conversion needs a 64-bit division.
+typedef struct {
+    i2c_hw_t *i2c;
+    uint8_t compass_address;
+    uint8_t temp_address;
+    volatile uint32_t period_us;    // Core 0 may change it; used from the next sample on
+    volatile bool reset_jitter;     // Set by core 0; core 1 clears 'jitter' and then this
+    volatile uint32_t i2c_errors;
+    bool uv_present;
+    veml6075_t uv;
+    bool pressure_present;
+    icp10125_t pressure;
+    sample_ring_t ring;
+    jitter_stats_t jitter;
+} acq_core_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void acq_core_init(acq_core_t *acq, i2c_inst_t *i2c, uint8_t temp_address, uint32_t period_us);
+bool acq_core_add_uv(acq_core_t *acq, uint8_t it, bool hd);
+bool acq_core_add_pressure(acq_core_t *acq, uint8_t mode);
+void acq_core_convert(const acq_core_t *acq, sample_t *sample);
+void acq_core_launch(acq_core_t *acq);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
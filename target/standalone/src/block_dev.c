@@ -0,0 +1,34 @@
+#include "block_dev.h"
+
+// Bring the device up and learn its size
+int block_dev_init(block_dev_t *dev) {
+    return dev->ops->init ? dev->ops->init(dev) : BLOCK_OK;
+}
+
+// Read whole blocks
+int block_dev_read(block_dev_t *dev, uint32_t lba, uint8_t *buf, uint32_t count) {
+    if (lba + count > dev->block_count || lba + count < lba) {
+        return BLOCK_RANGE;
+    }
+    return dev->ops->read(dev, lba, buf, count);
+}
+
+// Write whole blocks and wait for the device to finish
+int block_dev_write(block_dev_t *dev, uint32_t lba, const uint8_t *buf, uint32_t count) {
+    if (lba + count > dev->block_count || lba + count < lba) {
+        return BLOCK_RANGE;
+    }
+    int status = dev->ops->write_start(dev, lba, buf, count);
+    if (status != BLOCK_OK) {
+        return status;
+    }
+    do {
+        status = dev->ops->write_poll(dev);
+    } while (status == BLOCK_BUSY);
+    return status;
+}
+
+// Make completed writes durable
+int block_dev_sync(block_dev_t *dev) {
+    return dev->ops->sync ? dev->ops->sync(dev) : BLOCK_OK;
+}
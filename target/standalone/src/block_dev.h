@@ -0,0 +1,51 @@
+#ifndef BLOCK_DEV_H
+#define BLOCK_DEV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// All block devices use 512-byte blocks (SD cards in SPI mode, FatFs sectors)
+#define BLOCK_SIZE 512
+
+// Status codes
+#define BLOCK_OK 0
+#define BLOCK_BUSY 1                // Started write still in progress
+#define BLOCK_ERROR -1              // Device reported an error or timed out
+#define BLOCK_NO_MEDIA -2           // Not initialized or no card
+#define BLOCK_RANGE -3              // Address past the end of the device
+
+typedef struct block_dev block_dev_t;
+
+// Writes are split into start and poll so the caller decides whether to
+// wait; block_dev_write() is the blocking form. Only one write may be in
+// flight, and 'buf' must stay untouched until the poll returns BLOCK_OK.
+typedef struct {
+    int (*init)(block_dev_t *dev);
+    int (*read)(block_dev_t *dev, uint32_t lba, uint8_t *buf, uint32_t count);
+    int (*write_start)(block_dev_t *dev, uint32_t lba, const uint8_t *buf, uint32_t count);
+    int (*write_poll)(block_dev_t *dev);
+    int (*sync)(block_dev_t *dev);
+} block_dev_ops_t;
+
+struct block_dev {
+    const block_dev_ops_t *ops;
+    void *ctx;
+    uint32_t block_count;       // Valid after a successful init
+};
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int block_dev_init(block_dev_t *dev);
+int block_dev_read(block_dev_t *dev, uint32_t lba, uint8_t *buf, uint32_t count);
+int block_dev_write(block_dev_t *dev, uint32_t lba, const uint8_t *buf, uint32_t count);
+int block_dev_sync(block_dev_t *dev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
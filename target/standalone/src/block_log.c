@@ -0,0 +1,446 @@
+#include "block_log.h"
+#include "crc.h"
+
+#include <string.h>
+
+_Static_assert(LOG_HEADER_SIZE + 8 + LOG_CHANNEL_DESC_SIZE * LOG_CHANNELS_MAX <= LOG_BLOCK_SIZE,
+               "FILE block must hold every channel");
+_Static_assert(LOG_HEADER_SIZE + 8 + LOG_INDEX_ENTRY_SIZE * LOG_INDEX_INTERVAL <= LOG_BLOCK_SIZE,
+               "INDEX block must hold every entry");
+_Static_assert(SAMPLE_CH_COUNT <= LOG_CHANNELS_MAX, "sensor mask is 32 bits");
+
+// Byte offsets of the header fields
+#define HDR_MAGIC 0
+#define HDR_TYPE 4
+#define HDR_VERSION 5
+#define HDR_CHANNELS 6
+#define HDR_FLAGS 7
+#define HDR_SEQ 8
+#define HDR_RECORDS 12
+#define HDR_PAYLOAD_LEN 14
+#define HDR_SENSOR_MASK 16
+#define HDR_CRC 20
+#define HDR_FIRST_TIME 24
+#define HDR_LAST_TIME 32
+#define HDR_DEVICE_ID 40
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, (uint16_t)v);
+    put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void put64(uint8_t *p, uint64_t v) {
+    put32(p, (uint32_t)v);
+    put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+static uint64_t get64(const uint8_t *p) {
+    return get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+// The CRC runs over the payload first so the writer can keep it up to date
+// as records arrive, then over the header with its CRC field zeroed
+static uint32_t block_crc(uint32_t payload_crc, const uint8_t *header) {
+    uint8_t copy[LOG_HEADER_SIZE];
+    memcpy(copy, header, sizeof(copy));
+    put32(&copy[HDR_CRC], 0);
+    return crc32(payload_crc, copy, sizeof(copy));
+}
+
+// Write the header in front of the payload and mark the block ready
+static void block_log_seal(block_log_t *log) {
+    log_block_header_t *h = &log->hdr;
+    uint8_t *b = log->block;
+
+    memset(&b[LOG_HEADER_SIZE + h->payload_len], 0xFF, LOG_PAYLOAD_MAX - h->payload_len);
+    put32(&b[HDR_MAGIC], LOG_MAGIC);
+    b[HDR_TYPE] = h->type;
+    b[HDR_VERSION] = LOG_VERSION;
+    b[HDR_CHANNELS] = SAMPLE_CH_COUNT;
+    b[HDR_FLAGS] = h->flags;
+    put32(&b[HDR_SEQ], log->seq);
+    put16(&b[HDR_RECORDS], h->record_count);
+    put16(&b[HDR_PAYLOAD_LEN], h->payload_len);
+    put32(&b[HDR_SENSOR_MASK], h->sensor_mask);
+    put64(&b[HDR_FIRST_TIME], h->first_time_us);
+    put64(&b[HDR_LAST_TIME], h->last_time_us);
+    put64(&b[HDR_DEVICE_ID], log->config.device_id);
+    h->seq = log->seq;
+    h->crc = block_crc(log->crc, b);
+    put32(&b[HDR_CRC], h->crc);
+    log->pending = true;
+}
+
+// Start an empty block of the given type
+static void block_log_begin(block_log_t *log, uint8_t type) {
+    memset(&log->hdr, 0, sizeof(log->hdr));
+    log->hdr.type = type;
+    log->crc = type == LOG_BLOCK_FILE ? CRC32_INIT : log->log_id;
+}
+
+// Append payload bytes to the block being built
+static void block_log_put(block_log_t *log, const void *data, size_t len) {
+    memcpy(&log->block[LOG_HEADER_SIZE + log->hdr.payload_len], data, len);
+    log->crc = crc32(log->crc, data, len);
+    log->hdr.payload_len = (uint16_t)(log->hdr.payload_len + len);
+}
+
+// FILE block: who wrote the log and how to read each channel, so a reader
+// built before a new sensor was added can still show its values
+static void block_log_file_block(block_log_t *log) {
+    uint8_t desc[LOG_CHANNEL_DESC_SIZE];
+    uint8_t head[8] = {SAMPLE_CH_COUNT, 0, 0, 0};
+
+    block_log_begin(log, LOG_BLOCK_FILE);
+    put32(&head[4], log->log_id);
+    block_log_put(log, head, sizeof(head));
+    for (int ch = 0; ch < SAMPLE_CH_COUNT; ch++) {
+        const sample_channel_info_t *info = &sample_channels[ch];
+        memset(desc, 0, sizeof(desc));
+        strncpy((char *)&desc[0], info->name, LOG_CHANNEL_NAME_MAX);
+        strncpy((char *)&desc[16], info->unit, LOG_CHANNEL_UNIT_MAX);
+        put32(&desc[24], (uint32_t)info->modulus);
+        put32(&desc[28], (uint32_t)info->scale_mul);
+        desc[32] = info->scale_shift;
+        desc[33] = info->decimals;
+        block_log_put(log, desc, sizeof(desc));
+    }
+    log->hdr.record_count = SAMPLE_CH_COUNT;
+    log->hdr.sensor_mask = (uint32_t)((1ull << SAMPLE_CH_COUNT) - 1);
+    block_log_seal(log);
+}
+
+// INDEX block: where each of the last LOG_INDEX_INTERVAL data blocks is
+static void block_log_index_block(block_log_t *log) {
+    uint8_t entry[LOG_INDEX_ENTRY_SIZE];
+    uint8_t prev[8] = {0};
+
+    block_log_begin(log, LOG_BLOCK_INDEX);
+    put32(prev, log->prev_index);
+    block_log_put(log, prev, sizeof(prev));
+    for (uint16_t i = 0; i < log->index_count; i++) {
+        put64(&entry[0], log->index[i].first_time_us);
+        put32(&entry[8], log->index[i].block);
+        put32(&entry[12], log->index[i].sensor_mask);
+        block_log_put(log, entry, sizeof(entry));
+        log->hdr.sensor_mask |= log->index[i].sensor_mask;
+    }
+    log->hdr.record_count = log->index_count;
+    log->hdr.first_time_us = log->index[0].first_time_us;
+    log->hdr.last_time_us = log->index_last_us;
+    log->prev_index = log->seq;
+    log->index_count = 0;
+    block_log_seal(log);
+}
+
+// Queue the FILE block that starts a log at position 0
+static void block_log_new_file(block_log_t *log) {
+    log->seq = 0;
+    log->prev_index = LOG_NO_BLOCK;
+    log->index_count = 0;
+    log->file_has_data = false;
+    log->ending = false;
+    log->files++;
+    block_log_file_block(log);
+}
+
+// ID of the log that follows a full file
+static uint32_t block_log_next_id(uint32_t log_id) {
+    return log_id * 1664525u + 1013904223u;
+}
+
+// End the current log before it is full, the way a full one ends: its
+// last data block, an index of its data blocks, then the next log's FILE
+// block. block_log_pump carries it on from whichever comes first.
+static void block_log_end_file(block_log_t *log) {
+    log->ending = true;
+    if (log->hdr.record_count > 0) {
+        block_log_seal(log);
+    } else if (log->index_count > 0) {
+        block_log_index_block(log);
+    } else {
+        log->log_id = block_log_next_id(log->log_id);
+        block_log_new_file(log);
+    }
+}
+
+// Start a log: the FILE block is queued first. 'emit' receives each
+// finished block in order; blocks must land in the file in that order.
+// With a start_seq the existing log is continued instead, from a data
+// block flagged LOG_FLAG_RESUMED; its index restarts empty there.
+void block_log_init(block_log_t *log, const block_log_config_t *config, log_emit_fn emit, void *emit_ctx) {
+    memset(log, 0, sizeof(*log));
+    log->config = *config;
+    log->log_id = config->log_id;
+    log->emit = emit;
+    log->emit_ctx = emit_ctx;
+    delta_codec_init(&log->codec, UINT16_MAX);
+
+    uint32_t file_blocks = config->file_blocks;
+    if (config->start_seq == 0) {
+        block_log_new_file(log);
+    } else if (file_blocks && config->start_seq >= file_blocks - 1) {
+        log->log_id = block_log_next_id(log->log_id);
+        block_log_new_file(log);
+    } else {
+        log->seq = config->start_seq;
+        log->prev_index = config->prev_index;
+        block_log_begin(log, LOG_BLOCK_DATA);
+        log->hdr.flags = LOG_FLAG_RESUMED;
+    }
+}
+
+// Offer the finished block (and any index block it completes) to the
+// emitter. Returns LOG_BUSY while a block is still waiting.
+int block_log_pump(block_log_t *log) {
+    while (log->pending) {
+        if (!log->emit(log->emit_ctx, log->block)) {
+            return LOG_BUSY;
+        }
+        log->pending = false;
+        log->blocks_emitted++;
+
+        if (log->hdr.type == LOG_BLOCK_DATA) {
+            log_index_entry_t *e = &log->index[log->index_count++];
+            e->first_time_us = log->hdr.first_time_us;
+            e->block = log->seq;
+            e->sensor_mask = log->hdr.sensor_mask;
+            log->index_last_us = log->hdr.last_time_us;
+        }
+        log->seq++;
+
+        // A file ends with an index of its last data blocks, then the next
+        // one starts with its own FILE block and log ID. With one block
+        // left and nothing to index, a data block there could not be
+        // indexed, so that file ends a block short.
+        uint32_t file_blocks = log->config.file_blocks;
+        bool file_ending = (log->ending || (file_blocks && log->seq == file_blocks - 1)) && log->index_count > 0;
+        bool file_full = file_blocks && log->seq >= file_blocks - 1 && !file_ending;
+        if (file_full || (log->ending && log->index_count == 0)) {
+            log->log_id = block_log_next_id(log->log_id);
+            block_log_new_file(log);        // Pending again; emitted next time round
+        } else if (log->index_count == LOG_INDEX_INTERVAL || file_ending) {
+            block_log_index_block(log);
+        } else {
+            block_log_begin(log, LOG_BLOCK_DATA);
+        }
+    }
+    return LOG_OK;
+}
+
+// Add one sample. Returns LOG_BUSY without taking the sample if the last
+// finished block is still waiting for the emitter.
+int block_log_add(block_log_t *log, const sample_t *sample) {
+    uint8_t record[DELTA_RECORD_MAX];
+    log_block_header_t *h = &log->hdr;
+    sample_t s = *sample;
+    s.time_us += log->config.time_base_us;
+
+    if (block_log_pump(log) != LOG_OK) {
+        return LOG_BUSY;
+    }
+    if (log->config.file_us && log->file_has_data && s.time_us - log->file_first_us >= log->config.file_us) {
+        log->file_has_data = false;
+        block_log_end_file(log);
+        if (block_log_pump(log) != LOG_OK) {
+            return LOG_BUSY;
+        }
+    }
+
+    // Every data block starts with a keyframe so it decodes on its own
+    delta_codec_t codec = log->codec;
+    if (h->record_count == 0) {
+        delta_codec_force_keyframe(&codec);
+    }
+    size_t len = delta_encode(&codec, &s, record, sizeof(record));
+    if (h->payload_len + len > LOG_PAYLOAD_MAX || h->record_count == UINT16_MAX) {
+        block_log_seal(log);
+        if (block_log_pump(log) != LOG_OK) {
+            return LOG_BUSY;
+        }
+        codec = log->codec;
+        delta_codec_force_keyframe(&codec);
+        len = delta_encode(&codec, &s, record, sizeof(record));
+    }
+
+    if (h->record_count == 0) {
+        h->first_time_us = s.time_us;
+    }
+    if (!log->file_has_data) {
+        log->file_has_data = true;
+        log->file_first_us = s.time_us;
+    }
+    block_log_put(log, record, len);
+    log->codec = codec;
+    h->last_time_us = s.time_us;
+    h->sensor_mask |= s.valid;
+    h->record_count++;
+    log->bytes_logged += (uint32_t)len;
+    return LOG_OK;
+}
+
+// Finish a partly filled data block now (before power-down or a file
+// change) and try to hand it on
+int block_log_flush(block_log_t *log) {
+    if (!log->pending && log->hdr.type == LOG_BLOCK_DATA && log->hdr.record_count > 0) {
+        block_log_seal(log);
+    }
+    return block_log_pump(log);
+}
+
+// Read a block's header without checking it, for blocks this program has
+// just built itself. Returns LOG_ERR_MAGIC if it is not a log block.
+int log_block_peek(const uint8_t *block, log_block_header_t *hdr) {
+    memset(hdr, 0, sizeof(*hdr));
+    if (get32(&block[HDR_MAGIC]) != LOG_MAGIC) {
+        return LOG_ERR_MAGIC;
+    }
+    hdr->type = block[HDR_TYPE];
+    hdr->version = block[HDR_VERSION];
+    hdr->channel_count = block[HDR_CHANNELS];
+    hdr->flags = block[HDR_FLAGS];
+    hdr->seq = get32(&block[HDR_SEQ]);
+    hdr->record_count = get16(&block[HDR_RECORDS]);
+    hdr->payload_len = get16(&block[HDR_PAYLOAD_LEN]);
+    hdr->sensor_mask = get32(&block[HDR_SENSOR_MASK]);
+    hdr->crc = get32(&block[HDR_CRC]);
+    hdr->first_time_us = get64(&block[HDR_FIRST_TIME]);
+    hdr->last_time_us = get64(&block[HDR_LAST_TIME]);
+    hdr->device_id = get64(&block[HDR_DEVICE_ID]);
+    return LOG_OK;
+}
+
+// Check one block of the log with the given ID (from its FILE block; any
+// value will do for the FILE block itself) and read its header. Returns
+// LOG_OK or an error code; 'hdr' is filled in either way as far as the
+// block allows.
+int log_block_parse(const uint8_t *block, uint32_t log_id, log_block_header_t *hdr) {
+    if (log_block_peek(block, hdr) != LOG_OK) {
+        return LOG_ERR_MAGIC;
+    }
+    if (hdr->version != LOG_VERSION) {
+        return LOG_ERR_VERSION;
+    }
+    if (hdr->payload_len > LOG_PAYLOAD_MAX) {
+        return LOG_ERR_CORRUPT;
+    }
+    uint32_t seed = hdr->type == LOG_BLOCK_FILE ? CRC32_INIT : log_id;
+    uint32_t crc = crc32(seed, &block[LOG_HEADER_SIZE], hdr->payload_len);
+    if (block_crc(crc, block) != hdr->crc) {
+        return LOG_ERR_CRC;
+    }
+    return LOG_OK;
+}
+
+// Prepare to walk a parsed data block
+void log_cursor_init(log_cursor_t *cursor, const uint8_t *block, const log_block_header_t *hdr) {
+    cursor->payload = &block[LOG_HEADER_SIZE];
+    cursor->len = hdr->type == LOG_BLOCK_DATA ? hdr->payload_len : 0;
+    cursor->pos = 0;
+    delta_codec_init(&cursor->codec, UINT16_MAX);
+}
+
+// Decode the next sample. Returns 1 for a sample, 0 at the end of the
+// block, or a negative DELTA_ERR_* code.
+int log_cursor_next(log_cursor_t *cursor, sample_t *sample) {
+    size_t used = 0;
+    if (cursor->pos >= cursor->len) {
+        return 0;
+    }
+    int rc = delta_decode(&cursor->codec, &cursor->payload[cursor->pos], cursor->len - cursor->pos, sample, &used);
+    if (rc != DELTA_OK) {
+        cursor->pos = cursor->len;
+        return rc;
+    }
+    cursor->pos += used;
+    return 1;
+}
+
+// Read the entries of a parsed INDEX block; returns how many were stored
+size_t log_index_entries(const uint8_t *block, const log_block_header_t *hdr, log_index_entry_t *entries,
+                         size_t max, uint32_t *prev_index) {
+    const uint8_t *p = &block[LOG_HEADER_SIZE];
+    size_t count = hdr->record_count;
+
+    if (hdr->type != LOG_BLOCK_INDEX || hdr->payload_len < 8 + count * LOG_INDEX_ENTRY_SIZE) {
+        return 0;
+    }
+    if (prev_index) {
+        *prev_index = get32(p);
+    }
+    if (count > max) {
+        count = max;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t *e = &p[8 + i * LOG_INDEX_ENTRY_SIZE];
+        entries[i].first_time_us = get64(&e[0]);
+        entries[i].block = get32(&e[8]);
+        entries[i].sensor_mask = get32(&e[12]);
+    }
+    return count;
+}
+
+// Entry of the block that holds 'time_us' (the last one starting at or
+// before it), or 0 if the time comes before every entry
+size_t log_index_find(const log_index_entry_t *entries, size_t count, uint64_t time_us) {
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (entries[mid].first_time_us <= time_us) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo ? lo - 1 : 0;
+}
+
+// Read the channel table of a parsed FILE block; returns the channel count
+size_t log_file_channels(const uint8_t *block, const log_block_header_t *hdr, log_channel_desc_t *channels,
+                         size_t max) {
+    const uint8_t *p = &block[LOG_HEADER_SIZE];
+    if (hdr->type != LOG_BLOCK_FILE || hdr->payload_len < 8) {
+        return 0;
+    }
+    size_t count = p[0];
+    if (hdr->payload_len < 8 + count * LOG_CHANNEL_DESC_SIZE) {
+        return 0;
+    }
+    if (count > max) {
+        count = max;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t *d = &p[8 + i * LOG_CHANNEL_DESC_SIZE];
+        memcpy(channels[i].name, &d[0], LOG_CHANNEL_NAME_MAX);
+        channels[i].name[LOG_CHANNEL_NAME_MAX] = '\0';
+        memcpy(channels[i].unit, &d[16], LOG_CHANNEL_UNIT_MAX);
+        channels[i].unit[LOG_CHANNEL_UNIT_MAX] = '\0';
+        channels[i].modulus = (int32_t)get32(&d[24]);
+        channels[i].scale_mul = (int32_t)get32(&d[28]);
+        channels[i].scale_shift = d[32];
+        channels[i].decimals = d[33];
+    }
+    return count;
+}
+
+// Log ID from a parsed FILE block, needed to check the blocks after it
+uint32_t log_file_id(const uint8_t *block, const log_block_header_t *hdr) {
+    if (hdr->type != LOG_BLOCK_FILE || hdr->payload_len < 8) {
+        return 0;
+    }
+    return get32(&block[LOG_HEADER_SIZE + 4]);
+}
@@ -0,0 +1,170 @@
+#ifndef BLOCK_LOG_H
+#define BLOCK_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sample.h"
+#include "delta_codec.h"
+
+// On-disk sample log: a file of fixed 4 KiB blocks, appended in order and
+// never rewritten. See docs/log_format.md for the full description.
+//
+//   block 0        FILE   device ID and a description of every channel
+//   blocks 1..     DATA   delta-coded samples; each block decodes on its own
+//   every 65th     INDEX  first time and position of the preceding data blocks
+//
+// All fields are little-endian. Every block starts with the same 48-byte
+// header, and its CRC covers the payload and then the header. The CRC of
+// every block after the FILE block is seeded with the log ID from the FILE
+// block, so blocks left on the card by an earlier log never pass as ours.
+#define LOG_BLOCK_SIZE 4096
+#define LOG_HEADER_SIZE 48
+#define LOG_PAYLOAD_MAX (LOG_BLOCK_SIZE - LOG_HEADER_SIZE)
+
+#define LOG_MAGIC 0x474F4C53u       // "SLOG"
+#define LOG_VERSION 1
+
+// Block types
+#define LOG_BLOCK_FILE 0
+#define LOG_BLOCK_DATA 1
+#define LOG_BLOCK_INDEX 2
+
+// Data blocks between index blocks
+#define LOG_INDEX_INTERVAL 64
+
+// Header flags
+#define LOG_FLAG_RESUMED 0x01       // First block after the writer restarted
+
+// FILE block payload: a channel count, the log ID, then one descriptor per channel
+#define LOG_CHANNEL_NAME_MAX 16
+#define LOG_CHANNEL_UNIT_MAX 8
+#define LOG_CHANNEL_DESC_SIZE 36
+#define LOG_CHANNELS_MAX 32         // One bit each in the sensor mask
+
+// INDEX block payload: the previous index block's position, then entries
+#define LOG_INDEX_ENTRY_SIZE 16
+#define LOG_NO_BLOCK 0xFFFFFFFFu
+
+// Status codes
+#define LOG_OK 0
+#define LOG_BUSY 1                  // The finished block could not be handed on yet
+#define LOG_ERR_MAGIC -1            // Not a log block (or erased space)
+#define LOG_ERR_VERSION -2
+#define LOG_ERR_CRC -3
+#define LOG_ERR_CORRUPT -4          // CRC passed but the contents make no sense
+
+// Fixed block header
+typedef struct {
+    uint8_t type;
+    uint8_t version;
+    uint8_t channel_count;      // SAMPLE_CH_COUNT of the writer
+    uint8_t flags;
+    uint32_t seq;               // Position the writer put this block at
+    uint16_t record_count;      // Samples (DATA) or entries (INDEX)
+    uint16_t payload_len;
+    uint32_t sensor_mask;       // Union of the channels present
+    uint32_t crc;
+    uint64_t first_time_us;
+    uint64_t last_time_us;
+    uint64_t device_id;
+} log_block_header_t;
+
+// One index entry per data block
+typedef struct {
+    uint64_t first_time_us;
+    uint32_t block;             // Position in the file, in blocks
+    uint32_t sensor_mask;
+} log_index_entry_t;
+
+// Channel description from the FILE block
+typedef struct {
+    char name[LOG_CHANNEL_NAME_MAX + 1];
+    char unit[LOG_CHANNEL_UNIT_MAX + 1];
+    int32_t modulus;
+    int32_t scale_mul;
+    uint8_t scale_shift;
+    uint8_t decimals;
+} log_channel_desc_t;
+
+// Writer settings
+typedef struct {
+    uint64_t device_id;         // Identifies the unit in every block
+    uint32_t log_id;            // Seeds the block CRCs; pick a new random value per boot
+    uint32_t file_blocks;       // Start a new log (FILE block, position 0) every this
+                                // many blocks; 0 for one endless log
+    // To carry on with a log found after a restart (see log_recover), its
+    // next position and last index block; start_seq 0 starts a new log
+    uint32_t start_seq;
+    uint32_t prev_index;
+    uint64_t time_base_us;      // Added to every sample time, so times keep rising
+    uint64_t file_us;           // Also start a new log once the current one holds
+                                // samples this far apart; 0 for no time limit
+} block_log_config_t;
+
+// Hands a finished block on; returns false if there is no room for it
+// right now, in which case the same block is offered again later
+typedef bool (*log_emit_fn)(void *ctx, const uint8_t *block);
+
+// Writer state. Samples go straight into the block being built, so the
+// only copy is the one the emit callback makes.
+typedef struct {
+    uint8_t block[LOG_BLOCK_SIZE] __attribute__((aligned(4)));
+    log_block_header_t hdr;
+    delta_codec_t codec;
+    uint32_t crc;               // Running CRC of the payload so far
+    bool pending;               // 'block' is finished and waiting to be emitted
+    block_log_config_t config;
+    uint32_t log_id;            // Current log; changes at every new file
+    uint32_t seq;               // Position of the next block emitted
+    uint32_t prev_index;        // Position of the last index block
+    log_index_entry_t index[LOG_INDEX_INTERVAL];
+    uint16_t index_count;
+    uint64_t index_last_us;     // Last sample time of the indexed blocks
+    uint64_t file_first_us;     // First sample time of the current log
+    bool file_has_data;
+    bool ending;                // Closing the current log early, for file_us
+    log_emit_fn emit;
+    void *emit_ctx;
+
+    uint32_t blocks_emitted;
+    uint32_t bytes_logged;      // Encoded sample bytes
+    uint32_t files;             // Logs started
+} block_log_t;
+
+// Walks the samples of one data block
+typedef struct {
+    const uint8_t *payload;
+    size_t len;
+    size_t pos;
+    delta_codec_t codec;
+} log_cursor_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Writing
+void block_log_init(block_log_t *log, const block_log_config_t *config, log_emit_fn emit, void *emit_ctx);
+int block_log_add(block_log_t *log, const sample_t *sample);
+int block_log_flush(block_log_t *log);
+int block_log_pump(block_log_t *log);
+
+// Reading
+int log_block_parse(const uint8_t *block, uint32_t log_id, log_block_header_t *hdr);
+int log_block_peek(const uint8_t *block, log_block_header_t *hdr);
+void log_cursor_init(log_cursor_t *cursor, const uint8_t *block, const log_block_header_t *hdr);
+int log_cursor_next(log_cursor_t *cursor, sample_t *sample);
+size_t log_index_entries(const uint8_t *block, const log_block_header_t *hdr, log_index_entry_t *entries,
+                         size_t max, uint32_t *prev_index);
+size_t log_index_find(const log_index_entry_t *entries, size_t count, uint64_t time_us);
+size_t log_file_channels(const uint8_t *block, const log_block_header_t *hdr, log_channel_desc_t *channels,
+                         size_t max);
+uint32_t log_file_id(const uint8_t *block, const log_block_header_t *hdr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
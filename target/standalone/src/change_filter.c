@@ -0,0 +1,83 @@
+#include "change_filter.h"
+
+#include <string.h>
+
+// Initialize every channel with its default deadband and heartbeat
+void change_filter_init(change_filter_t *filter) {
+    static const int32_t deadbands[SAMPLE_CH_COUNT] = {
+        [SAMPLE_CH_TEMP]    = CHANGE_DEADBAND_TEMP,
+        [SAMPLE_CH_HEADING] = CHANGE_DEADBAND_HEADING,
+        [SAMPLE_CH_ANGLE8]  = CHANGE_DEADBAND_ANGLE8,
+        [SAMPLE_CH_PITCH]   = CHANGE_DEADBAND_PITCH,
+        [SAMPLE_CH_ROLL]    = CHANGE_DEADBAND_ROLL,
+        [SAMPLE_CH_UVA]      = CHANGE_DEADBAND_UVA,
+        [SAMPLE_CH_UVB]      = CHANGE_DEADBAND_UVB,
+        [SAMPLE_CH_UV_INDEX] = CHANGE_DEADBAND_UV_INDEX,
+        [SAMPLE_CH_PRESSURE]      = CHANGE_DEADBAND_PRESSURE,
+        [SAMPLE_CH_PRESSURE_TEMP] = CHANGE_DEADBAND_PRESSURE_TEMP,
+        [SAMPLE_CH_HUMIDITY]      = CHANGE_DEADBAND_HUMIDITY,
+        [SAMPLE_CH_HUMIDITY_TEMP] = CHANGE_DEADBAND_HUMIDITY_TEMP,
+    };
+
+    memset(filter, 0, sizeof(*filter));
+    for (int ch = 0; ch < SAMPLE_CH_COUNT; ch++) {
+        filter->ch[ch].deadband = deadbands[ch];
+        filter->ch[ch].heartbeat_ms = CHANGE_HEARTBEAT_MS;
+        filter->ch[ch].modulus = sample_channels[ch].modulus;
+    }
+}
+
+// Override the deadband and heartbeat of one channel
+void change_filter_configure(change_filter_t *filter, sample_channel_t ch,
+                             int32_t deadband, uint32_t heartbeat_ms) {
+    filter->ch[ch].deadband = deadband;
+    filter->ch[ch].heartbeat_ms = heartbeat_ms;
+}
+
+// Absolute difference between two values; circular channels take the short
+// way round, so 3599 and 0 are one tenth of a degree apart
+int32_t change_filter_distance(int32_t a, int32_t b, int32_t modulus) {
+    int32_t d = a - b;
+    if (d < 0) {
+        d = -d;
+    }
+    if (modulus > 0) {
+        d %= modulus;
+        if (d > modulus / 2) {
+            d = modulus - d;
+        }
+    }
+    return d;
+}
+
+// Decide which channels of a sample are worth reporting. Returns a mask of
+// sample_channel_t bits; reported channels become the new reference values.
+uint32_t change_filter_apply(change_filter_t *filter, const sample_t *sample) {
+    uint32_t emit = 0;
+
+    for (int ch = 0; ch < SAMPLE_CH_COUNT; ch++) {
+        if (!sample_has(sample, (sample_channel_t)ch)) {
+            continue;
+        }
+        change_channel_t *c = &filter->ch[ch];
+        int32_t value = sample->value[ch];
+        filter->values_seen++;
+
+        bool report = !c->reported;
+        if (!report) {
+            report = change_filter_distance(value, c->last_value, c->modulus) > c->deadband;
+        }
+        if (!report && c->heartbeat_ms) {
+            report = sample->time_us - c->last_time_us >= (uint64_t)c->heartbeat_ms * 1000u;
+        }
+
+        if (report) {
+            c->last_value = value;
+            c->last_time_us = sample->time_us;
+            c->reported = true;
+            filter->values_reported++;
+            emit |= 1u << ch;
+        }
+    }
+    return emit;
+}
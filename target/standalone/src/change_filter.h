@@ -0,0 +1,57 @@
+#ifndef CHANGE_FILTER_H
+#define CHANGE_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sample.h"
+
+// Default deadbands, in each channel's raw units
+#define CHANGE_DEADBAND_TEMP 6          // Q7: 6/128 ≈ 0.05 °C
+#define CHANGE_DEADBAND_HEADING 10      // Tenths: 1.0 degree
+#define CHANGE_DEADBAND_ANGLE8 1
+#define CHANGE_DEADBAND_PITCH 1
+#define CHANGE_DEADBAND_ROLL 1
+#define CHANGE_DEADBAND_UVA 10
+#define CHANGE_DEADBAND_UVB 10
+#define CHANGE_DEADBAND_UV_INDEX 50     // Thousandths: 0.05
+#define CHANGE_DEADBAND_PRESSURE 16     // 1/16 Pa: 1 Pa, about 8 cm of height
+#define CHANGE_DEADBAND_PRESSURE_TEMP 6 // Q7: 6/128 ≈ 0.05 °C
+#define CHANGE_DEADBAND_HUMIDITY 5      // Tenths: 0.5 %RH
+#define CHANGE_DEADBAND_HUMIDITY_TEMP 1 // Tenths: 0.1 °C
+
+// Default maximum interval between reports of an unchanged channel
+#define CHANGE_HEARTBEAT_MS 60000
+
+// Report-on-change state for one channel
+typedef struct {
+    int32_t deadband;           // A change must exceed this to be reported
+    uint32_t heartbeat_ms;      // Report at least this often (0 = only on change)
+    int32_t modulus;            // Wrap-around for circular channels, 0 for linear ones
+    int32_t last_value;         // Last reported value
+    uint64_t last_time_us;      // Time of the last report
+    bool reported;              // Whether anything has been reported yet
+} change_channel_t;
+
+// Report-on-change state for all channels
+typedef struct {
+    change_channel_t ch[SAMPLE_CH_COUNT];
+    uint32_t values_seen;
+    uint32_t values_reported;
+} change_filter_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void change_filter_init(change_filter_t *filter);
+void change_filter_configure(change_filter_t *filter, sample_channel_t ch,
+                             int32_t deadband, uint32_t heartbeat_ms);
+uint32_t change_filter_apply(change_filter_t *filter, const sample_t *sample);
+int32_t change_filter_distance(int32_t a, int32_t b, int32_t modulus);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
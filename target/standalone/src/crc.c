@@ -0,0 +1,35 @@
+#include "crc.h"
+
+// CRC-16/CCITT-FALSE (poly 0x1021); pass CRC16_INIT to start, or a previous
+// result to continue over several buffers
+uint16_t crc16_ccitt(uint16_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+
+    while (len--) {
+        crc ^= (uint16_t)(*p++ << 8);
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// CRC-32 (IEEE 802.3, reflected poly 0xEDB88320), the same value as zlib's
+// crc32(). Pass CRC32_INIT to start, or a previous result to continue.
+// Four bits at a time from a 16-entry table: small enough for flash, about
+// four times faster than bitwise for the 4 KiB log blocks.
+uint32_t crc32(uint32_t crc, const void *data, size_t len) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    const uint8_t *p = (const uint8_t *)data;
+
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
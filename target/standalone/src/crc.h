@@ -0,0 +1,25 @@
+#ifndef CRC_H
+#define CRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Initial value for crc16_ccitt
+#define CRC16_INIT 0xFFFF
+
+// Initial value for crc32
+#define CRC32_INIT 0
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint16_t crc16_ccitt(uint16_t crc, const void *data, size_t len);
+uint32_t crc32(uint32_t crc, const void *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
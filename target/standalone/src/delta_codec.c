@@ -0,0 +1,205 @@
+#include "delta_codec.h"
+
+#include <string.h>
+
+// Start a stream; the first record will be a keyframe
+void delta_codec_init(delta_codec_t *codec, uint16_t keyframe_interval) {
+    memset(codec, 0, sizeof(*codec));
+    codec->keyframe_interval = keyframe_interval ? keyframe_interval : DELTA_KEYFRAME_INTERVAL;
+}
+
+// Make the next encoded record a keyframe (e.g. at the start of a log block)
+void delta_codec_force_keyframe(delta_codec_t *codec) {
+    codec->primed = false;
+}
+
+// Map signed to unsigned so small magnitudes stay small: 0,-1,1,-2 -> 0,1,2,3
+uint32_t zigzag_encode(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+int32_t zigzag_decode(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// LEB128 varint, 7 bits per byte; returns the bytes written (at most 10)
+size_t varint_put(uint64_t value, uint8_t *buf) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        buf[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buf[n++] = (uint8_t)value;
+    return n;
+}
+
+// Returns the bytes consumed, or 0 if the buffer ends mid-varint
+size_t varint_get(const uint8_t *buf, size_t len, uint64_t *value) {
+    uint64_t v = 0;
+    for (size_t n = 0; n < len && n < 10; n++) {
+        v |= (uint64_t)(buf[n] & 0x7F) << (7 * n);
+        if (!(buf[n] & 0x80)) {
+            *value = v;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+// Difference between two channel values, wrapped for circular channels
+static int32_t channel_delta(int ch, int32_t value, int32_t last) {
+    int32_t d = value - last;
+    int32_t modulus = sample_channels[ch].modulus;
+    if (modulus > 0) {
+        d %= modulus;
+        if (d >= modulus / 2) {
+            d -= modulus;
+        } else if (d < -modulus / 2) {
+            d += modulus;
+        }
+    }
+    return d;
+}
+
+// Apply a delta, wrapping circular channels back into range
+static int32_t channel_apply(int ch, int32_t last, int32_t delta) {
+    int32_t value = last + delta;
+    int32_t modulus = sample_channels[ch].modulus;
+    if (modulus > 0) {
+        value %= modulus;
+        if (value < 0) {
+            value += modulus;
+        }
+    }
+    return value;
+}
+
+// Encode one sample; returns the record length, or 0 if 'len' is too small
+size_t delta_encode(delta_codec_t *codec, const sample_t *sample, uint8_t *buf, size_t len) {
+    if (len < DELTA_RECORD_MAX) {
+        return 0;
+    }
+
+    bool keyframe = !codec->primed || codec->since_keyframe >= codec->keyframe_interval ||
+                    sample->time_us < codec->last_time_us;
+
+    // A circular channel outside its range would not survive the wrapped
+    // delta; send absolute values instead so the stream stays lossless
+    for (int ch = 0; ch < SAMPLE_CH_COUNT && !keyframe; ch++) {
+        if ((sample->valid & (1u << ch)) &&
+            channel_apply(ch, codec->last[ch], channel_delta(ch, sample->value[ch], codec->last[ch])) !=
+                sample->value[ch]) {
+            keyframe = true;
+        }
+    }
+    uint8_t flags = 0;
+    size_t used = 1;
+
+    if (keyframe) {
+        flags = DELTA_FLAG_KEYFRAME | DELTA_FLAG_MASK;
+        memset(codec->last, 0, sizeof(codec->last));
+        used += varint_put(sample->time_us, &buf[used]);
+        codec->since_keyframe = 0;
+        codec->primed = true;
+    } else {
+        used += varint_put(sample->time_us - codec->last_time_us, &buf[used]);
+        if (sample->valid != codec->last_valid) {
+            flags |= DELTA_FLAG_MASK;
+        }
+    }
+    if (flags & DELTA_FLAG_MASK) {
+        used += varint_put(sample->valid, &buf[used]);
+    }
+
+    for (int ch = 0; ch < SAMPLE_CH_COUNT; ch++) {
+        if (!(sample->valid & (1u << ch))) {
+            continue;
+        }
+        int32_t d = keyframe ? sample->value[ch] : channel_delta(ch, sample->value[ch], codec->last[ch]);
+        used += varint_put(zigzag_encode(d), &buf[used]);
+        codec->last[ch] = sample->value[ch];
+    }
+
+    buf[0] = flags;
+    codec->last_time_us = sample->time_us;
+    codec->last_valid = sample->valid;
+    codec->since_keyframe++;
+    return used;
+}
+
+// Decode one record into 'sample'. On DELTA_OK '*used' is the record length.
+// After an error the stream should be resumed from the next keyframe.
+int delta_decode(delta_codec_t *codec, const uint8_t *buf, size_t len, sample_t *sample, size_t *used) {
+    if (len < 2) {
+        return DELTA_ERR_TRUNCATED;
+    }
+
+    uint8_t flags = buf[0];
+    bool keyframe = (flags & DELTA_FLAG_KEYFRAME) != 0;
+    if (flags & ~(DELTA_FLAG_KEYFRAME | DELTA_FLAG_MASK)) {
+        return DELTA_ERR_CORRUPT;
+    }
+    if (!keyframe && !codec->primed) {
+        return DELTA_ERR_NO_KEYFRAME;
+    }
+
+    size_t pos = 1;
+    uint64_t v;
+    size_t n = varint_get(&buf[pos], len - pos, &v);
+    if (n == 0) {
+        return DELTA_ERR_TRUNCATED;
+    }
+    pos += n;
+    uint64_t time_us = keyframe ? v : codec->last_time_us + v;
+
+    uint32_t valid = codec->last_valid;
+    if (flags & DELTA_FLAG_MASK) {
+        n = varint_get(&buf[pos], len - pos, &v);
+        if (n == 0) {
+            return DELTA_ERR_TRUNCATED;
+        }
+        if (v >> SAMPLE_CH_COUNT) {
+            return DELTA_ERR_CORRUPT;
+        }
+        pos += n;
+        valid = (uint32_t)v;
+    } else if (keyframe) {
+        return DELTA_ERR_CORRUPT;
+    }
+
+    int32_t values[SAMPLE_CH_COUNT];
+    if (keyframe) {
+        memset(values, 0, sizeof(values));
+    } else {
+        memcpy(values, codec->last, sizeof(values));
+    }
+    for (int ch = 0; ch < SAMPLE_CH_COUNT; ch++) {
+        if (!(valid & (1u << ch))) {
+            continue;
+        }
+        n = varint_get(&buf[pos], len - pos, &v);
+        if (n == 0) {
+            return DELTA_ERR_TRUNCATED;
+        }
+        pos += n;
+        int32_t d = zigzag_decode((uint32_t)v);
+        values[ch] = keyframe ? d : channel_apply(ch, values[ch], d);
+    }
+
+    // Only commit once the whole record has been parsed
+    memcpy(codec->last, values, sizeof(values));
+    codec->last_time_us = time_us;
+    codec->last_valid = valid;
+    codec->primed = true;
+    codec->since_keyframe = keyframe ? 1 : codec->since_keyframe + 1;
+
+    sample_clear(sample, time_us);
+    sample->valid = valid;
+    for (int ch = 0; ch < SAMPLE_CH_COUNT; ch++) {
+        if (valid & (1u << ch)) {
+            sample->value[ch] = values[ch];
+        }
+    }
+    *used = pos;
+    return DELTA_OK;
+}
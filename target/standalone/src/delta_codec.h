@@ -0,0 +1,57 @@
+#ifndef DELTA_CODEC_H
+#define DELTA_CODEC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sample.h"
+
+// Default number of records between keyframes
+#define DELTA_KEYFRAME_INTERVAL 64
+
+// Largest encoded record: flags, time and mask varints, one varint per channel
+#define DELTA_RECORD_MAX (1 + 10 + 5 + 5 * SAMPLE_CH_COUNT)
+
+// Record flags (first byte of every record)
+#define DELTA_FLAG_KEYFRAME 0x01    // Absolute values; decoding can start here
+#define DELTA_FLAG_MASK 0x02        // The valid-channel mask follows
+
+// Decoder status codes
+#define DELTA_OK 0
+#define DELTA_ERR_TRUNCATED -1      // Buffer ends inside a record
+#define DELTA_ERR_NO_KEYFRAME -2    // Delta record before any keyframe
+#define DELTA_ERR_CORRUPT -3        // Record cannot be valid
+
+// Streaming state, identical on the encoding and decoding side.
+// Keyframes carry absolute values; other records carry the change of each
+// channel since its previous value as a zigzag varint. Circular channels
+// take the short way round, so heading 3599 -> 1 costs one byte.
+typedef struct {
+    int32_t last[SAMPLE_CH_COUNT];
+    uint64_t last_time_us;
+    uint32_t last_valid;
+    uint16_t keyframe_interval;
+    uint16_t since_keyframe;
+    bool primed;                // A keyframe has been encoded/decoded
+} delta_codec_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void delta_codec_init(delta_codec_t *codec, uint16_t keyframe_interval);
+void delta_codec_force_keyframe(delta_codec_t *codec);
+size_t delta_encode(delta_codec_t *codec, const sample_t *sample, uint8_t *buf, size_t len);
+int delta_decode(delta_codec_t *codec, const uint8_t *buf, size_t len, sample_t *sample, size_t *used);
+
+size_t varint_put(uint64_t value, uint8_t *buf);
+size_t varint_get(const uint8_t *buf, size_t len, uint64_t *value);
+uint32_t zigzag_encode(int32_t value);
+int32_t zigzag_decode(uint32_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,143 @@
+#include "dht.h"
+
+#ifndef HOST_TESTING
+#include "hardware/dma.h"
+#include "dht.pio.h"
+#endif
+
+#include <string.h>
+
+// Load the capture program and claim a DMA channel for it. The first
+// reading starts at the first poll.
+void dht_init(dht_t *d, uint8_t type, pio_hw_t *pio, uint32_t pin) {
+    memset(d, 0, sizeof(*d));
+    d->type = type;
+    d->interval_us = type == DHT_TYPE_11 ? 1000000 : 2000000;
+    d->pio = pio;
+    d->pin = pin;
+    d->chan = dht_port_init(d);
+}
+
+// How long the line is held low to ask for a reading
+uint32_t dht_hold_us(uint8_t type) {
+    return type == DHT_TYPE_11 ? 20000 : 1100;
+}
+
+int dht_poll(dht_t *d, uint32_t now_us) {
+    if (d->capturing) {
+        if (dht_port_remaining(d) != 0) {
+            if (now_us - d->start_us < dht_hold_us(d->type) + DHT_TIMEOUT_US) {
+                return DHT_WAIT;
+            }
+            dht_port_stop(d);
+            d->capturing = false;
+            d->stats.timeouts++;
+            return DHT_ERROR;
+        }
+        dht_port_stop(d);
+        d->capturing = false;
+
+        int status = dht_decode(d->pulses, d->type, &d->reading);
+        if (status == DHT_DECODE_BAD_PULSE) {
+            d->stats.pulse_errors++;
+            return DHT_ERROR;
+        }
+        if (status == DHT_DECODE_BAD_CHECKSUM) {
+            d->stats.checksum_errors++;
+            return DHT_ERROR;
+        }
+        d->fresh = true;
+        d->stats.readings++;
+        return DHT_NEW;
+    }
+
+    if ((int32_t)(now_us - d->next_us) >= 0) {
+        dht_port_start(d, dht_hold_us(d->type));
+        d->capturing = true;
+        d->start_us = now_us;
+        d->next_us = now_us + d->interval_us;
+    }
+    return DHT_WAIT;
+}
+
+const dht_reading_t *dht_take(dht_t *d) {
+    if (!d->fresh) {
+        return NULL;
+    }
+    d->fresh = false;
+    return &d->reading;
+}
+
+// Widths are checked before they are trusted: a glitch that splits a pulse
+// or a missed edge that joins two shows up as a width no bit can have,
+// where a plain threshold would pass it on to the checksum
+int dht_decode(const uint32_t pulses[DHT_PULSES], uint8_t type, dht_reading_t *reading) {
+    if (pulses[0] < DHT_ANSWER_MIN_US || pulses[0] > DHT_ANSWER_MAX_US) {
+        return DHT_DECODE_BAD_PULSE;
+    }
+
+    uint8_t bytes[DHT_BITS / 8] = {0};
+    for (int i = 0; i < DHT_BITS; i++) {
+        uint32_t width = pulses[1 + i];
+        if (width < DHT_BIT_MIN_US || width > DHT_BIT_MAX_US) {
+            return DHT_DECODE_BAD_PULSE;
+        }
+        bytes[i / 8] = (uint8_t)(bytes[i / 8] << 1 | (width >= DHT_ONE_MIN_US));
+    }
+    if ((uint8_t)(bytes[0] + bytes[1] + bytes[2] + bytes[3]) != bytes[4]) {
+        return DHT_DECODE_BAD_CHECKSUM;
+    }
+
+    if (type == DHT_TYPE_11) {
+        // Whole units, then a tenths digit; the sign is the top bit of it
+        reading->humidity = bytes[0] * 10 + bytes[1];
+        reading->temperature = bytes[2] * 10 + (bytes[3] & 0x7F);
+    } else {
+        // Tenths, sign and magnitude
+        reading->humidity = bytes[0] << 8 | bytes[1];
+        reading->temperature = (bytes[2] & 0x7F) << 8 | bytes[3];
+    }
+    if ((type == DHT_TYPE_11 ? bytes[3] : bytes[2]) & 0x80) {
+        reading->temperature = -reading->temperature;
+    }
+    return DHT_DECODE_OK;
+}
+
+#ifndef HOST_TESTING
+// The state machine's RX FIFO into 'pulses', one word per pulse, paced by
+// its DREQ. The program is loaded once; each reading restarts it.
+int dht_port_init(dht_t *d) {
+    d->offset = pio_add_program(d->pio, &dht_program);
+    d->sm = (uint32_t)pio_claim_unused_sm(d->pio, true);
+    dht_program_init(d->pio, d->sm, d->offset, d->pin);
+    return dma_claim_unused_channel(true);
+}
+
+void dht_port_start(dht_t *d, uint32_t hold_us) {
+    pio_sm_set_enabled(d->pio, d->sm, false);
+    pio_sm_clear_fifos(d->pio, d->sm);
+    pio_sm_restart(d->pio, d->sm);
+    pio_sm_exec(d->pio, d->sm, pio_encode_jmp(d->offset));
+
+    dma_channel_config c = dma_channel_get_default_config((uint)d->chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, pio_get_dreq(d->pio, d->sm, false));
+    dma_channel_configure((uint)d->chan, &c, d->pulses, &d->pio->rxf[d->sm], DHT_PULSES, true);
+
+    pio_sm_put(d->pio, d->sm, hold_us);
+    pio_sm_set_enabled(d->pio, d->sm, true);
+}
+
+uint32_t dht_port_remaining(const dht_t *d) {
+    return dma_channel_hw_addr((uint)d->chan)->transfer_count;
+}
+
+// Stopped part way, the state machine may still hold the line low
+void dht_port_stop(dht_t *d) {
+    pio_sm_set_enabled(d->pio, d->sm, false);
+    dma_channel_abort((uint)d->chan);
+    pio_sm_set_pindirs_with_mask(d->pio, d->sm, 0, 1u << d->pin);
+}
+#endif
@@ -0,0 +1,104 @@
+#ifndef DHT_H
+#define DHT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef HOST_TESTING
+#include "hardware/pio.h"
+#else
+typedef struct pio_hw pio_hw_t;
+#endif
+
+// Sensor types. The DHT22 (AM2302) reports tenths; the DHT11 whole units.
+#define DHT_TYPE_11 0
+#define DHT_TYPE_22 1
+
+// Pulses captured per reading: the answer pulse, then one per data bit
+#define DHT_BITS 40
+#define DHT_PULSES (1 + DHT_BITS)
+
+// High pulse widths, in us. A 0 is about 27 us and a 1 about 70 us; the
+// answer pulse is about 80 us.
+#define DHT_ONE_MIN_US 48
+#define DHT_BIT_MIN_US 10
+#define DHT_BIT_MAX_US 100
+#define DHT_ANSWER_MIN_US 50
+#define DHT_ANSWER_MAX_US 120
+
+// A reading that has not finished this long after its start pulse has no
+// sensor behind it; the answer itself takes under 6 ms
+#define DHT_TIMEOUT_US 10000
+
+// What dht_decode() found
+#define DHT_DECODE_OK 0
+#define DHT_DECODE_BAD_PULSE -1     // No answer pulse, or a width that is no bit
+#define DHT_DECODE_BAD_CHECKSUM -2
+
+// What dht_poll() did
+#define DHT_WAIT 0                  // Nothing, or started a reading
+#define DHT_NEW 1                   // Stored a new reading
+#define DHT_ERROR -1                // A reading timed out or did not decode
+
+typedef struct {
+    int32_t humidity;           // Tenths of a percent RH
+    int32_t temperature;        // Tenths of a degree C
+} dht_reading_t;
+
+typedef struct {
+    uint32_t readings;
+    uint32_t timeouts;          // No sensor, or it stopped part way
+    uint32_t pulse_errors;
+    uint32_t checksum_errors;
+} dht_stats_t;
+
+// One sensor on a PIO state machine. A reading costs the CPU a start and
+// a check that DMA has finished; the pulse train is timed by the state
+// machine with interrupts left on.
+typedef struct {
+    uint8_t type;
+    uint32_t interval_us;       // The sensor's shortest time between readings
+    bool capturing;
+    uint32_t start_us;
+    uint32_t next_us;           // When the next reading may start
+    uint32_t pulses[DHT_PULSES];    // Filled by DMA
+    bool fresh;                 // 'reading' not yet taken
+    dht_reading_t reading;
+    dht_stats_t stats;
+    pio_hw_t *pio;
+    uint32_t sm;
+    uint32_t offset;            // Where the program was loaded
+    uint32_t pin;
+    int chan;                   // DMA channel
+} dht_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void dht_init(dht_t *d, uint8_t type, pio_hw_t *pio, uint32_t pin);
+uint32_t dht_hold_us(uint8_t type);
+
+// Start a reading when the sensor allows one, and decode it once DMA has
+// all its pulses. Never blocks.
+int dht_poll(dht_t *d, uint32_t now_us);
+
+// The reading stored since the last call, or NULL if there is none
+const dht_reading_t *dht_take(dht_t *d);
+
+// Bits from pulse widths, checked against the checksum byte (the low
+// byte of the sum of the other four), then scaled for the sensor type
+int dht_decode(const uint32_t pulses[DHT_PULSES], uint8_t type, dht_reading_t *reading);
+
+// Port layer: PIO and DMA on the target, provided by the tests on the host
+int dht_port_init(dht_t *d);
+void dht_port_start(dht_t *d, uint32_t hold_us);
+uint32_t dht_port_remaining(const dht_t *d);
+void dht_port_stop(dht_t *d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,300 @@
+#include "fatfs_log.h"
+#include "diskio.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// FatFs disk I/O layer: each physical drive number maps to a block device
+static block_dev_t *drives[FF_VOLUMES];
+static DSTATUS drive_status[FF_VOLUMES];
+
+// Register the block device behind a FatFs drive number
+void fatfs_diskio_attach(uint8_t pdrv, block_dev_t *dev) {
+    if (pdrv < FF_VOLUMES) {
+        drives[pdrv] = dev;
+        drive_status[pdrv] = STA_NOINIT;
+    }
+}
+
+DSTATUS disk_initialize(BYTE pdrv) {
+    if (pdrv >= FF_VOLUMES || !drives[pdrv]) {
+        return STA_NOINIT | STA_NODISK;
+    }
+    drive_status[pdrv] = block_dev_init(drives[pdrv]) == BLOCK_OK ? 0 : STA_NOINIT;
+    return drive_status[pdrv];
+}
+
+DSTATUS disk_status(BYTE pdrv) {
+    return pdrv < FF_VOLUMES && drives[pdrv] ? drive_status[pdrv] : (STA_NOINIT | STA_NODISK);
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+    if (disk_status(pdrv) & STA_NOINIT) {
+        return RES_NOTRDY;
+    }
+    int status = block_dev_read(drives[pdrv], (uint32_t)sector, buff, count);
+    return status == BLOCK_OK ? RES_OK : status == BLOCK_RANGE ? RES_PARERR : RES_ERROR;
+}
+
+// FatFs itself only writes when a segment is made, renamed or deleted
+// (directory entry and FAT chain); the samples go around it through the
+// raw writer
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count) {
+    if (disk_status(pdrv) & STA_NOINIT) {
+        return RES_NOTRDY;
+    }
+    int status = block_dev_write(drives[pdrv], (uint32_t)sector, buff, count);
+    return status == BLOCK_OK ? RES_OK : status == BLOCK_RANGE ? RES_PARERR : RES_ERROR;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
+    if (disk_status(pdrv) & STA_NOINIT) {
+        return RES_NOTRDY;
+    }
+    switch (cmd) {
+    case CTRL_SYNC:
+        return block_dev_sync(drives[pdrv]) == BLOCK_OK ? RES_OK : RES_ERROR;
+    case GET_SECTOR_COUNT:
+        *(LBA_t *)buff = drives[pdrv]->block_count;
+        return RES_OK;
+    case GET_SECTOR_SIZE:
+        *(WORD *)buff = BLOCK_SIZE;
+        return RES_OK;
+    case GET_BLOCK_SIZE:
+        *(DWORD *)buff = 1;     // Erase block size unknown
+        return RES_OK;
+    default:
+        return RES_PARERR;
+    }
+}
+
+// One log block, read while looking for the end of the log after a restart
+static uint8_t recover_buf[LOG_BLOCK_SIZE] __attribute__((aligned(4)));
+
+// First sector of an open file; contiguous files are then plain sector ranges
+static uint32_t fatfs_log_file_lba(fatfs_log_t *log, FIL *file) {
+    return (uint32_t)(log->fs.database + (LBA_t)(file->obj.sclust - 2) * log->fs.csize);
+}
+
+// Open (or make) the checkpoint file and find its sectors. A new one has
+// both slots wiped, so an old checkpoint left in its clusters is ignored.
+static FRESULT fatfs_log_checkpoint_file(fatfs_log_t *log) {
+    FIL file;
+    FRESULT res = f_open(&file, FATFS_LOG_CHECKPOINT_PATH, FA_READ | FA_WRITE | FA_OPEN_ALWAYS);
+    if (res != FR_OK) {
+        return res;
+    }
+    bool created = f_size(&file) == 0;
+    if (created) {
+        res = f_expand(&file, LOG_CHECKPOINT_SLOTS * BLOCK_SIZE, 1);
+        if (res == FR_OK) {
+            res = f_sync(&file);
+        }
+    }
+    if (res != FR_OK) {
+        f_close(&file);
+        return res;
+    }
+    log_checkpointer_init(&log->ckpt, log->dev, fatfs_log_file_lba(log, &file));
+    f_close(&file);
+
+    if (created) {
+        memset(log->ckpt.sector, 0xFF, BLOCK_SIZE);
+        for (uint32_t slot = 0; slot < LOG_CHECKPOINT_SLOTS; slot++) {
+            if (block_dev_write(log->dev, log->ckpt.lba + slot, log->ckpt.sector, 1) != BLOCK_OK) {
+                return FR_DISK_ERR;
+            }
+        }
+    }
+    return FR_OK;
+}
+
+// Name of a segment
+static void fatfs_log_name(char *path, size_t len, log_segment_kind_t kind, uint32_t number) {
+    snprintf(path, len, kind == LOG_SEGMENT_LIVE ? "LOG%04u.BIN" : "SPR%04u.BIN", (unsigned)number);
+}
+
+static int fatfs_log_status(FRESULT res) {
+    return res == FR_OK ? BLOCK_OK : res == FR_NOT_READY ? BLOCK_NO_MEDIA : BLOCK_ERROR;
+}
+
+// Make SPRnnnn.BIN at full size in one contiguous allocation; the size and
+// FAT chain are written now, once, and never again while it is in use. A
+// spare made before a restart is kept.
+static int fatfs_log_prepare(void *ctx, uint32_t spare) {
+    (void)ctx;
+    char path[16];
+    FIL file;
+    fatfs_log_name(path, sizeof(path), LOG_SEGMENT_SPARE, spare);
+    FRESULT res = f_open(&file, path, FA_WRITE | FA_OPEN_ALWAYS);
+    if (res != FR_OK) {
+        return fatfs_log_status(res);
+    }
+    if (f_size(&file) == FATFS_LOG_FILE_BYTES) {
+        return fatfs_log_status(f_close(&file));
+    }
+    if (f_size(&file) != 0) {
+        res = f_truncate(&file);
+    }
+    if (res == FR_OK) {
+        res = f_expand(&file, FATFS_LOG_FILE_BYTES, 1);
+    }
+    if (res == FR_OK) {
+        res = f_sync(&file);
+    }
+    f_close(&file);
+    if (res != FR_OK) {
+        f_unlink(path);
+    }
+    return fatfs_log_status(res);
+}
+
+// One directory entry changes; the clusters stay where they are
+static int fatfs_log_rename(void *ctx, log_segment_kind_t from_kind, uint32_t from, log_segment_kind_t to_kind,
+                            uint32_t to) {
+    (void)ctx;
+    char old_path[16], new_path[16];
+    fatfs_log_name(old_path, sizeof(old_path), from_kind, from);
+    fatfs_log_name(new_path, sizeof(new_path), to_kind, to);
+    FRESULT res = f_rename(old_path, new_path);
+    if (res == FR_NO_FILE && f_stat(new_path, NULL) == FR_OK) {
+        res = FR_OK;
+    }
+    return fatfs_log_status(res);
+}
+
+static int fatfs_log_remove(void *ctx, uint32_t spare) {
+    (void)ctx;
+    char path[16];
+    fatfs_log_name(path, sizeof(path), LOG_SEGMENT_SPARE, spare);
+    FRESULT res = f_unlink(path);
+    return fatfs_log_status(res == FR_NO_FILE ? FR_OK : res);
+}
+
+// Contiguous files are plain sector ranges, so the first sector is all
+// the raw writer needs
+static int fatfs_log_locate(void *ctx, uint32_t number, uint32_t *start_lba) {
+    fatfs_log_t *log = (fatfs_log_t *)ctx;
+    char path[16];
+    FIL file;
+    fatfs_log_name(path, sizeof(path), LOG_SEGMENT_LIVE, number);
+    FRESULT res = f_open(&file, path, FA_READ | FA_OPEN_EXISTING);
+    if (res != FR_OK) {
+        return fatfs_log_status(res);
+    }
+    bool full = f_size(&file) == FATFS_LOG_FILE_BYTES;
+    *start_lba = fatfs_log_file_lba(log, &file);
+    f_close(&file);
+    return full ? BLOCK_OK : BLOCK_ERROR;
+}
+
+// Number of a segment from its name, or -1 for any other file
+static int32_t fatfs_log_number(const char *name, log_segment_kind_t *kind) {
+    if (strlen(name) != 11 || strcmp(&name[7], ".BIN") != 0) {
+        return -1;
+    }
+    if (strncmp(name, "LOG", 3) == 0) {
+        *kind = LOG_SEGMENT_LIVE;
+    } else if (strncmp(name, "SPR", 3) == 0) {
+        *kind = LOG_SEGMENT_SPARE;
+    } else {
+        return -1;
+    }
+    int32_t number = 0;
+    for (int i = 3; i < 7; i++) {
+        if (name[i] < '0' || name[i] > '9') {
+            return -1;
+        }
+        number = number * 10 + (name[i] - '0');
+    }
+    return number;
+}
+
+// The segments in the root directory, for a start with no checkpoint
+static FRESULT fatfs_log_scan(log_segments_scan_t *scan) {
+    DIR dir;
+    FILINFO info;
+    log_segments_scan_init(scan);
+    FRESULT res = f_opendir(&dir, "");
+    if (res != FR_OK) {
+        return res;
+    }
+    while ((res = f_readdir(&dir, &info)) == FR_OK && info.fname[0]) {
+        log_segment_kind_t kind;
+        int32_t number = fatfs_log_number(info.fname, &kind);
+        if (number >= 0 && !(info.fattrib & AM_DIR)) {
+            log_segments_scan_add(scan, kind, (uint32_t)number);
+        }
+    }
+    f_closedir(&dir);
+    return res;
+}
+
+// Carry on in the segment named in the checkpoint, after its last good
+// block. Anything that does not match means a new log instead.
+static FRESULT fatfs_log_resume(fatfs_log_t *log, const log_checkpoint_t *cp) {
+    if (log_recover(log->dev, cp, recover_buf, &log->recovered, &log->recover_blocks_read) != BLOCK_OK ||
+        log_segments_resume(&log->segs, cp, &log->recovered) != BLOCK_OK) {
+        return FR_NO_FILE;
+    }
+    log->resumed = true;
+    return FR_OK;
+}
+
+// Mount the volume and pick up where the last checkpoint says logging
+// stopped. After a power cut this reads two checkpoint sectors and a few
+// log blocks, however long the log is. With no checkpoint to go on, the
+// directory is read for the segments already there, and a new log starts
+// after the highest LOGnnnn.BIN with those segments and the spares as its
+// pool; starting at the lowest free number would put new segments below
+// the live ones and strand the spares. 'config' sets the pool; its file_blocks is
+// the segment size here.
+FRESULT fatfs_log_open(fatfs_log_t *log, block_dev_t *dev, const log_segments_config_t *config) {
+    memset(log, 0, sizeof(*log));
+    log->dev = dev;
+    FRESULT res = f_mount(&log->fs, "", 1);
+    if (res == FR_OK) {
+        res = fatfs_log_checkpoint_file(log);
+    }
+    if (res != FR_OK) {
+        return res;
+    }
+
+    log_segment_ops_t ops = {fatfs_log_prepare, fatfs_log_rename, fatfs_log_remove, fatfs_log_locate, log};
+    log_segments_config_t seg_config = *config;
+    seg_config.file_blocks = FATFS_LOG_FILE_BYTES / LOG_BLOCK_SIZE;
+    log_segments_init(&log->segs, &seg_config, &ops, dev, &log->ckpt);
+
+    log_checkpoint_t cp;
+    if (log_checkpointer_load(&log->ckpt, &cp) == 1 && fatfs_log_resume(log, &cp) == FR_OK) {
+        return FR_OK;
+    }
+    log_segments_scan_t scan;
+    res = fatfs_log_scan(&scan);
+    if (res != FR_OK) {
+        return res;
+    }
+    if (scan.live && scan.live_last + 1 >= FATFS_LOG_MAX_FILES) {
+        return FR_DENIED;
+    }
+    return log_segments_rebuild(&log->segs, &scan) == BLOCK_OK ? FR_OK : FR_DISK_ERR;
+}
+
+// Route sd_log buffers into the segments. The block log starts a new
+// FILE block where a segment fills or its time is up (see
+// block_log_config_t), and that block starts the next segment, so each
+// one reads on its own.
+void fatfs_log_writer(fatfs_log_t *log, log_writer_t *writer) {
+    log_segments_writer(&log->segs, writer);
+}
+
+// Retention and spares, for when there is nothing to write; see
+// log_segments_service
+int fatfs_log_service(fatfs_log_t *log) {
+    return log_segments_service(&log->segs);
+}
+
+// Sync and checkpoint, so the next start finds the end without searching
+FRESULT fatfs_log_close(fatfs_log_t *log) {
+    return log_segments_close(&log->segs) == BLOCK_OK ? FR_OK : FR_DISK_ERR;
+}
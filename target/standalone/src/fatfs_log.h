@@ -0,0 +1,53 @@
+#ifndef FATFS_LOG_H
+#define FATFS_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ff.h"
+#include "block_dev.h"
+#include "sd_log.h"
+#include "log_checkpoint.h"
+#include "log_segments.h"
+
+// Log segments are LOG0000.BIN, LOG0001.BIN, ... on the card's root
+// directory, and spares SPR0000.BIN, ... (see log_segments.h)
+#define FATFS_LOG_MAX_FILES 10000
+
+// Each segment is allocated at full size, in one contiguous run of
+// clusters, when it is made. Samples are then written to its sectors
+// directly, so the FAT and directory entry are only touched when a
+// segment is made or renamed; a plain append would rewrite them at every
+// sync, and those out-of-place small writes are what make an SD card
+// stall.
+#define FATFS_LOG_FILE_BYTES (32u * 1024u * 1024u)
+
+// Checkpoints of where logging has got to (two sectors, preallocated once)
+#define FATFS_LOG_CHECKPOINT_PATH "LOGCKPT.BIN"
+
+// The log on a mounted volume
+typedef struct {
+    FATFS fs;
+    block_dev_t *dev;
+    log_checkpointer_t ckpt;
+    log_segments_t segs;
+    bool resumed;               // Carrying on in the segment from the last checkpoint
+    log_checkpoint_t recovered; // Where, when resumed
+    uint32_t recover_blocks_read;
+} fatfs_log_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void fatfs_diskio_attach(uint8_t pdrv, block_dev_t *dev);
+FRESULT fatfs_log_open(fatfs_log_t *log, block_dev_t *dev, const log_segments_config_t *config);
+void fatfs_log_writer(fatfs_log_t *log, log_writer_t *writer);
+int fatfs_log_service(fatfs_log_t *log);
+FRESULT fatfs_log_close(fatfs_log_t *log);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
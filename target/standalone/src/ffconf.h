@@ -0,0 +1,57 @@
+// FatFs configuration for the SD card log. FatFs itself comes from the
+// pimoroni-pico package and is compiled against this file (see CMakeLists.txt).
+// Options not listed here are off.
+
+// The FatFs revision this file was written for: R0.14b, as shipped in the
+// pimoroni-pico tag CMakeLists.txt pins. ff.h refuses to build against a
+// different one; check the options below before changing it.
+#define FFCONF_DEF 86631
+
+// Function set
+#define FF_FS_READONLY 0
+#define FF_FS_MINIMIZE 0
+#define FF_USE_FIND 0
+#define FF_USE_MKFS 0
+#define FF_USE_FASTSEEK 0
+#define FF_USE_EXPAND 1         // f_expand: contiguous preallocation for raw writes
+#define FF_USE_CHMOD 0
+#define FF_USE_LABEL 0
+#define FF_USE_FORWARD 0
+#define FF_USE_STRFUNC 0
+#define FF_PRINT_LLI 0
+#define FF_PRINT_FLOAT 0
+#define FF_STRF_ENCODE 0
+
+// Names: 8.3 only, so no Unicode tables are needed
+#define FF_CODE_PAGE 437
+#define FF_USE_LFN 0
+#define FF_MAX_LFN 255
+#define FF_LFN_UNICODE 0
+#define FF_LFN_BUF 255
+#define FF_SFN_BUF 12
+#define FF_FS_RPATH 0
+
+// Volumes: one card, FAT12/16/32 (exFAT would need long file names; format
+// cards over 32 GB as FAT32)
+#define FF_VOLUMES 1
+#define FF_STR_VOLUME_ID 0
+#define FF_VOLUME_STRS "SD"
+#define FF_MULTI_PARTITION 0
+#define FF_MIN_SS 512
+#define FF_MAX_SS 512
+#define FF_LBA64 0
+#define FF_MIN_GPT 0x10000000
+#define FF_USE_TRIM 0
+
+// System: a full sector buffer per file so unaligned writes do not disturb
+// the volume's buffer; no RTC; only the storage core touches the volume
+#define FF_FS_TINY 0
+#define FF_FS_EXFAT 0
+#define FF_FS_NORTC 1
+#define FF_NORTC_MON 1
+#define FF_NORTC_MDAY 1
+#define FF_NORTC_YEAR 2025
+#define FF_FS_NOFSINFO 0
+#define FF_FS_LOCK 0
+#define FF_FS_REENTRANT 0
+#define FF_FS_TIMEOUT 1000
@@ -0,0 +1,51 @@
+#include "flash_dev.h"
+
+// Read any range of bytes
+int flash_dev_read(flash_dev_t *dev, uint32_t offset, uint8_t *buf, size_t len) {
+    if (offset > dev->size || len > dev->size - offset) {
+        return BLOCK_RANGE;
+    }
+    return dev->ops->read(dev, offset, buf, len);
+}
+
+// Start erasing the sector at 'offset'
+int flash_dev_erase_start(flash_dev_t *dev, uint32_t offset) {
+    if (offset % FLASH_DEV_SECTOR_SIZE || offset >= dev->size) {
+        return BLOCK_RANGE;
+    }
+    return dev->ops->erase_start(dev, offset);
+}
+
+// Start programming whole pages
+int flash_dev_program_start(flash_dev_t *dev, uint32_t offset, const uint8_t *buf, size_t len) {
+    if (offset % FLASH_DEV_PAGE_SIZE || len % FLASH_DEV_PAGE_SIZE || offset > dev->size ||
+        len > dev->size - offset) {
+        return BLOCK_RANGE;
+    }
+    return dev->ops->program_start(dev, offset, buf, len);
+}
+
+// BLOCK_BUSY while an erase or program is still running
+int flash_dev_poll(flash_dev_t *dev) {
+    return dev->ops->poll(dev);
+}
+
+static int flash_dev_wait(flash_dev_t *dev, int status) {
+    if (status != BLOCK_OK) {
+        return status;
+    }
+    do {
+        status = dev->ops->poll(dev);
+    } while (status == BLOCK_BUSY);
+    return status;
+}
+
+// Erase a sector and wait for it
+int flash_dev_erase(flash_dev_t *dev, uint32_t offset) {
+    return flash_dev_wait(dev, flash_dev_erase_start(dev, offset));
+}
+
+// Program whole pages and wait for them
+int flash_dev_program(flash_dev_t *dev, uint32_t offset, const uint8_t *buf, size_t len) {
+    return flash_dev_wait(dev, flash_dev_program_start(dev, offset, buf, len));
+}
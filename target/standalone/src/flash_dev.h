@@ -0,0 +1,52 @@
+#ifndef FLASH_DEV_H
+#define FLASH_DEV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "block_dev.h"
+
+// NOR flash as the log sees it: erased a sector at a time (every bit back
+// to 1), programmed a page at a time (bits only go from 1 to 0), and read
+// anywhere. Offsets are from the start of the device's region, and status
+// codes are block_dev's BLOCK_* ones.
+#define FLASH_DEV_SECTOR_SIZE 4096
+#define FLASH_DEV_PAGE_SIZE 256
+
+typedef struct flash_dev flash_dev_t;
+
+// Erases and programs are split into start and poll like block_dev
+// writes, so a caller with other work can leave an erase running. Only one
+// operation may be in flight, and a program's 'buf' must stay untouched
+// until the poll returns BLOCK_OK. A driver that can only block finishes
+// in start, and its poll always returns BLOCK_OK.
+typedef struct {
+    int (*read)(flash_dev_t *dev, uint32_t offset, uint8_t *buf, size_t len);
+    int (*erase_start)(flash_dev_t *dev, uint32_t offset);
+    int (*program_start)(flash_dev_t *dev, uint32_t offset, const uint8_t *buf, size_t len);
+    int (*poll)(flash_dev_t *dev);
+} flash_dev_ops_t;
+
+struct flash_dev {
+    const flash_dev_ops_t *ops;
+    void *ctx;
+    uint32_t size;              // Bytes, a whole number of sectors
+};
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int flash_dev_read(flash_dev_t *dev, uint32_t offset, uint8_t *buf, size_t len);
+int flash_dev_erase_start(flash_dev_t *dev, uint32_t offset);
+int flash_dev_program_start(flash_dev_t *dev, uint32_t offset, const uint8_t *buf, size_t len);
+int flash_dev_poll(flash_dev_t *dev);
+int flash_dev_erase(flash_dev_t *dev, uint32_t offset);
+int flash_dev_program(flash_dev_t *dev, uint32_t offset, const uint8_t *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,288 @@
+#include "flash_log.h"
+
+#include <string.h>
+
+_Static_assert(LOG_BLOCK_SIZE == FLASH_DEV_SECTOR_SIZE, "one log block per flash sector");
+
+// Where a block goes: seq 0 is the FILE block, the rest go round the ring
+uint32_t flash_log_sector(const flash_log_t *log, uint32_t seq) {
+    if (seq == 0) {
+        return log->file_offset;
+    }
+    return ((seq - 1) % log->ring_sectors) * FLASH_DEV_SECTOR_SIZE;
+}
+
+// Split the device into the ring and the FILE sector. The ring has to be
+// longer than the erase-ahead, or erasing ahead would reach the newest block.
+int flash_log_init(flash_log_t *log, flash_dev_t *dev) {
+    memset(log, 0, sizeof(*log));
+    log->dev = dev;
+    log->next_seq = 1;
+    log->recovered.prev_index = LOG_NO_BLOCK;
+    uint32_t sectors = dev->size / FLASH_DEV_SECTOR_SIZE;
+    if (sectors < FLASH_LOG_ERASE_AHEAD + 2) {
+        return BLOCK_RANGE;
+    }
+    log->ring_sectors = sectors - 1;
+    log->file_offset = log->ring_sectors * FLASH_DEV_SECTOR_SIZE;
+    return BLOCK_OK;
+}
+
+// Read the header of the block in the sector for 'seq' without checking
+// its CRC. Returns 1 if the block claims to be that seq, 0 if not, or a
+// read error.
+static int flash_log_header(flash_log_t *log, uint32_t seq, log_block_header_t *hdr) {
+    uint8_t head[LOG_HEADER_SIZE];
+    int status = flash_dev_read(log->dev, flash_log_sector(log, seq), head, sizeof(head));
+    if (status != BLOCK_OK) {
+        return status;
+    }
+    return log_block_peek(head, hdr) == LOG_OK && hdr->seq == seq && hdr->type != LOG_BLOCK_FILE;
+}
+
+// Read and check the whole block for 'seq'. Returns 1 if it is this log's
+// block for that seq, 0 if not, or a read error.
+static int flash_log_check(flash_log_t *log, uint32_t seq, uint8_t *scratch, log_block_header_t *hdr) {
+    int status = flash_dev_read(log->dev, flash_log_sector(log, seq), scratch, LOG_BLOCK_SIZE);
+    if (status != BLOCK_OK) {
+        return status;
+    }
+    return log_block_parse(scratch, log->recovered.log_id, hdr) == LOG_OK && hdr->seq == seq;
+}
+
+// True if the whole sector reads as erased
+static int flash_log_erased(flash_log_t *log, uint32_t offset, uint8_t *scratch) {
+    int status = flash_dev_read(log->dev, offset, scratch, FLASH_DEV_SECTOR_SIZE);
+    if (status != BLOCK_OK) {
+        return status;
+    }
+    for (size_t i = 0; i < FLASH_DEV_SECTOR_SIZE; i++) {
+        if (scratch[i] != 0xFF) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Find the log already in flash and where it ends; the result is in
+// log->recovered, with next_block 0 if there is no log to continue.
+// 'scratch' holds one log block. Returns BLOCK_OK or a read error.
+//
+// The newest block is the highest seq sitting in its own sector that also
+// passes its CRC. A block torn by a power cut fails the CRC, and so does a
+// block left over from an earlier log; each one costs another pass over
+// the headers, which only read 48 bytes a sector.
+int flash_log_mount(flash_log_t *log, uint8_t *scratch) {
+    flash_log_recovered_t *r = &log->recovered;
+    log_block_header_t hdr;
+    int status = flash_dev_read(log->dev, log->file_offset, scratch, LOG_BLOCK_SIZE);
+    if (status != BLOCK_OK) {
+        return status;
+    }
+    if (log_block_parse(scratch, 0, &hdr) == LOG_OK && hdr.type == LOG_BLOCK_FILE && hdr.seq == 0) {
+        r->log_id = log_file_id(scratch, &hdr);
+        r->next_block = 1;
+    }
+
+    uint32_t newest = 0;
+    for (uint32_t below = UINT32_MAX; r->next_block && below > 1;) {
+        uint32_t best = 0;
+        for (uint32_t i = 0; i < log->ring_sectors; i++) {
+            uint8_t head[LOG_HEADER_SIZE];
+            status = flash_dev_read(log->dev, i * FLASH_DEV_SECTOR_SIZE, head, sizeof(head));
+            if (status != BLOCK_OK) {
+                return status;
+            }
+            if (log_block_peek(head, &hdr) == LOG_OK && hdr.type != LOG_BLOCK_FILE && hdr.seq > best &&
+                hdr.seq < below && flash_log_sector(log, hdr.seq) == i * FLASH_DEV_SECTOR_SIZE) {
+                best = hdr.seq;
+            }
+        }
+        if (best == 0) {
+            break;
+        }
+        status = flash_log_check(log, best, scratch, &hdr);
+        if (status < 0) {
+            return status;
+        }
+        if (status) {
+            newest = best;
+            break;
+        }
+        below = best;
+    }
+
+    if (newest) {
+        r->next_block = newest + 1;
+        r->last_time_us = hdr.last_time_us;
+        r->prev_index = hdr.type == LOG_BLOCK_INDEX ? newest : LOG_NO_BLOCK;
+
+        // Walk back through the unbroken run of this log's blocks to the
+        // newest index block, so the next one can link to it
+        for (uint32_t seq = newest - 1; r->prev_index == LOG_NO_BLOCK && seq > 0 && newest - seq < log->ring_sectors;
+             seq--) {
+            status = flash_log_header(log, seq, &hdr);
+            if (status < 0) {
+                return status;
+            }
+            if (!status) {
+                break;
+            }
+            if (hdr.type == LOG_BLOCK_INDEX) {
+                status = flash_log_check(log, seq, scratch, &hdr);
+                if (status < 0) {
+                    return status;
+                }
+                if (status) {
+                    r->prev_index = seq;
+                }
+            }
+        }
+    }
+
+    // Sectors a previous run already erased ahead need not be erased again
+    log->next_seq = r->next_block ? r->next_block : 1;
+    log->erased = 0;
+    while (log->erased < FLASH_LOG_ERASE_AHEAD) {
+        status = flash_log_erased(log, flash_log_sector(log, log->next_seq + log->erased), scratch);
+        if (status < 0) {
+            return status;
+        }
+        if (!status) {
+            break;
+        }
+        log->erased++;
+    }
+    return BLOCK_OK;
+}
+
+// Wait for the erase ahead, if one is running
+static void flash_log_finish_erase(flash_log_t *log) {
+    if (!log->erasing) {
+        return;
+    }
+    int status;
+    do {
+        status = flash_dev_poll(log->dev);
+    } while (status == BLOCK_BUSY);
+    log->erasing = false;
+    if (status == BLOCK_OK) {
+        log->erased++;
+    } else {
+        log->stats.erase_errors++;
+    }
+}
+
+// Erase a sector now, because no erase ahead got to it in time
+static int flash_log_erase_now(flash_log_t *log, uint32_t offset) {
+    log->stats.erases++;
+    log->stats.erase_stalls++;
+    int status = flash_dev_erase(log->dev, offset);
+    if (status != BLOCK_OK) {
+        log->stats.erase_errors++;
+    }
+    return status;
+}
+
+// Put one block in its sector. A FILE block starts a new log: the ring
+// starts again at sector 0. A failed write still uses up its sector, as
+// on the SD card.
+static int flash_log_write_block(flash_log_t *log, const uint8_t *block) {
+    log_block_header_t hdr;
+    int status;
+
+    if (log_block_peek(block, &hdr) != LOG_OK) {
+        return BLOCK_ERROR;
+    }
+    flash_log_finish_erase(log);
+
+    if (hdr.type == LOG_BLOCK_FILE) {
+        if (log->next_seq != 1) {
+            log->next_seq = 1;
+            log->erased = 0;
+        }
+        status = flash_log_erase_now(log, log->file_offset);
+        if (status == BLOCK_OK) {
+            status = flash_dev_program(log->dev, log->file_offset, block, LOG_BLOCK_SIZE);
+        }
+        return status;
+    }
+
+    // Blocks arrive in seq order; anything else means the erase-ahead was
+    // for the wrong sectors
+    if (hdr.seq != log->next_seq) {
+        log->next_seq = hdr.seq;
+        log->erased = 0;
+    }
+    uint32_t offset = flash_log_sector(log, hdr.seq);
+    if (log->erased) {
+        log->erased--;
+        status = BLOCK_OK;
+    } else {
+        status = flash_log_erase_now(log, offset);
+    }
+    if (status == BLOCK_OK) {
+        status = flash_dev_program(log->dev, offset, block, LOG_BLOCK_SIZE);
+    }
+    log->next_seq++;
+    if (offset == 0 && hdr.seq > 1) {
+        log->stats.laps++;
+    }
+    return status;
+}
+
+// log_writer_t write: takes whole log blocks only
+static int flash_log_write(void *ctx, const uint8_t *data, size_t len) {
+    flash_log_t *log = (flash_log_t *)ctx;
+    int result = BLOCK_OK;
+
+    if (len % LOG_BLOCK_SIZE) {
+        log->stats.write_errors++;
+        return BLOCK_ERROR;
+    }
+    for (size_t off = 0; off < len; off += LOG_BLOCK_SIZE) {
+        int status = flash_log_write_block(log, &data[off]);
+        if (status == BLOCK_OK) {
+            log->stats.blocks_written++;
+        } else {
+            log->stats.write_errors++;
+            result = status;
+        }
+    }
+    return result;
+}
+
+// Programs are durable as soon as they finish, so there is no sync
+void flash_log_writer(flash_log_t *log, log_writer_t *writer) {
+    writer->write = flash_log_write;
+    writer->sync = NULL;
+    writer->ctx = log;
+}
+
+// Idle work for the storage side: keep FLASH_LOG_ERASE_AHEAD sectors
+// erased ahead of the writer, one erase at a time. Returns 1 while an
+// erase is running, 0 when there is nothing to do.
+int flash_log_service(flash_log_t *log) {
+    if (log->erasing) {
+        int status = flash_dev_poll(log->dev);
+        if (status == BLOCK_BUSY) {
+            return 1;
+        }
+        log->erasing = false;
+        if (status != BLOCK_OK) {
+            log->stats.erase_errors++;
+            return 0;
+        }
+        log->erased++;
+    }
+    if (log->erased >= FLASH_LOG_ERASE_AHEAD) {
+        return 0;
+    }
+    if (flash_dev_erase_start(log->dev, flash_log_sector(log, log->next_seq + log->erased)) != BLOCK_OK) {
+        log->stats.erase_errors++;
+        return 0;
+    }
+    log->stats.erases++;
+    log->erasing = true;
+    return 1;
+}
@@ -0,0 +1,71 @@
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "flash_dev.h"
+#include "block_log.h"
+#include "sd_log.h"
+
+// A circular sample log in NOR flash, for when there is no SD card. Every
+// sector holds one log block. The last sector of the region holds the
+// FILE block, and the others form a ring: block seq s (s >= 1) goes in
+// sector (s - 1) % ring_sectors. It is one endless log (file_blocks 0),
+// and once the ring is full each new block replaces the oldest.
+//
+// Each ring sector is erased once per lap, so wear is even across the
+// ring. After a restart the log carries on from its newest block, not
+// from sector 0, which keeps it even. The FILE sector is only erased when
+// a new log starts.
+//
+// A sector erase takes tens of milliseconds, far longer than programming
+// a block. flash_log_service erases sectors ahead of the writer while the
+// storage side has nothing else to do. A block that arrives then finds
+// its sector already erased and only has to be programmed.
+#define FLASH_LOG_ERASE_AHEAD 4
+
+// Where the log found in flash ends, from flash_log_mount
+typedef struct {
+    uint32_t log_id;            // From the FILE block
+    uint32_t next_block;        // Seq to carry on from; 0 if there is no log
+    uint32_t prev_index;        // Newest index block, or LOG_NO_BLOCK
+    uint64_t last_time_us;      // Time of the last sample in the newest block
+} flash_log_recovered_t;
+
+typedef struct {
+    uint32_t blocks_written;
+    uint32_t write_errors;
+    uint32_t erases;
+    uint32_t erase_errors;
+    uint32_t erase_stalls;      // Blocks that had to wait for their sector to be erased
+    uint32_t laps;              // Times the writer went round the ring
+} flash_log_stats_t;
+
+typedef struct {
+    flash_dev_t *dev;
+    uint32_t ring_sectors;
+    uint32_t file_offset;       // The FILE block's sector
+    uint32_t next_seq;          // Seq of the next block to arrive
+    uint32_t erased;            // Sectors from next_seq's on known to be erased
+    bool erasing;               // Erasing the sector after those
+    flash_log_recovered_t recovered;
+    flash_log_stats_t stats;
+} flash_log_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int flash_log_init(flash_log_t *log, flash_dev_t *dev);
+int flash_log_mount(flash_log_t *log, uint8_t *scratch);
+void flash_log_writer(flash_log_t *log, log_writer_t *writer);
+int flash_log_service(flash_log_t *log);
+uint32_t flash_log_sector(const flash_log_t *log, uint32_t seq);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,192 @@
+#include "icp10125.h"
+#include "ram_func.h"
+
+#include <string.h>
+
+// The calibration points of the vendor's model: pressures in Pa, and the
+// LUT values at 25 °C (the OTP moves the middle one and all three with
+// temperature)
+#define ICP10125_P0 45000
+#define ICP10125_P1 80000
+#define ICP10125_P2 105000
+#define ICP10125_LUT_LOWER 3670016      // 3.5 * 2^20
+#define ICP10125_LUT_UPPER 12058624     // 11.5 * 2^20
+#define ICP10125_OFFSET_FACTOR 2048
+
+// The closed form in icp10125_pressure() has these in it
+_Static_assert(ICP10125_P0 == 3 * 15000 && ICP10125_P2 == 7 * 15000 && ICP10125_P1 - ICP10125_P0 == 7 * 5000 &&
+               ICP10125_P2 - ICP10125_P1 == 5 * 5000, "calibration pressures changed");
+
+uint8_t RAM_FUNC(icp10125_crc8)(const uint8_t *data, uint32_t len) {
+    uint8_t crc = 0xFF;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (uint8_t)(crc & 0x80 ? crc << 1 ^ 0x31 : crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Send a command, then read the word it returns
+static bool icp10125_read_word(const icp10125_bus_t *bus, uint16_t cmd, uint16_t *word) {
+    uint8_t buf[3] = {(uint8_t)(cmd >> 8), (uint8_t)cmd};
+    if (!bus->write(bus->ctx, ICP10125_ADDRESS, buf, 2) || !bus->read(bus->ctx, ICP10125_ADDRESS, buf, 3) ||
+        icp10125_crc8(buf, 2) != buf[2]) {
+        return false;
+    }
+    *word = (uint16_t)(buf[0] << 8 | buf[1]);
+    return true;
+}
+
+// Called on core 0 before sampling starts, so it may live in flash. The
+// OTP is read here, once; nothing is read from it again.
+bool icp10125_init(icp10125_t *p, const icp10125_bus_t *bus, uint8_t mode) {
+    static const uint8_t otp_setup[] = {ICP10125_CMD_OTP_SETUP >> 8, ICP10125_CMD_OTP_SETUP & 0xFF, 0x00, 0x66, 0x9C};
+    static const uint16_t measure_cmds[] = {0x609C, 0x6825, 0x70DF, 0x7866};
+
+    memset(p, 0, sizeof(*p));
+    p->bus = *bus;
+    p->mode = mode;
+    p->measure_cmd[0] = (uint8_t)(measure_cmds[mode] >> 8);
+    p->measure_cmd[1] = (uint8_t)measure_cmds[mode];
+    p->conversion_us = icp10125_conversion_us(mode);
+
+    uint16_t word;
+    if (!icp10125_read_word(bus, ICP10125_CMD_READ_ID, &word) || (word & ICP10125_ID_MASK) != ICP10125_ID) {
+        return false;
+    }
+    if (!bus->write(bus->ctx, ICP10125_ADDRESS, otp_setup, sizeof(otp_setup))) {
+        return false;
+    }
+    int16_t otp[ICP10125_OTP_WORDS];
+    for (int i = 0; i < ICP10125_OTP_WORDS; i++) {
+        if (!icp10125_read_word(bus, ICP10125_CMD_OTP_READ, &word)) {
+            return false;
+        }
+        otp[i] = (int16_t)word;
+    }
+    icp10125_calibrate(&p->cal, otp);
+    return true;
+}
+
+// The longest each mode takes, so a read is never too early
+uint32_t icp10125_conversion_us(uint8_t mode) {
+    static const uint32_t conversion_us[] = {1800, 6300, 23800, 94500};
+    return conversion_us[mode];
+}
+
+void RAM_FUNC(icp10125_plan)(icp10125_t *p, uint32_t ready_by_us) {
+    if (p->planned) {
+        return;
+    }
+    p->planned = true;
+    p->start_us = ready_by_us - p->conversion_us;
+}
+
+bool RAM_FUNC(icp10125_due)(const icp10125_t *p, uint32_t now_us) {
+    return (p->running && (int32_t)(now_us - p->ready_us) >= 0) ||
+           (p->planned && (int32_t)(now_us - p->start_us) >= 0);
+}
+
+// Read a finished measurement, then start the planned one. The sensor
+// converts while the other sensors are read. A bad CRC measures again at
+// once; a sensor that stops answering is tried a conversion time later.
+int RAM_FUNC(icp10125_poll)(icp10125_t *p, uint32_t now_us) {
+    int status = ICP10125_WAIT;
+
+    if (p->running && (int32_t)(now_us - p->ready_us) >= 0) {
+        uint8_t buf[ICP10125_RESULT_BYTES];
+        p->running = false;
+        if (!p->bus.read(p->bus.ctx, ICP10125_ADDRESS, buf, ICP10125_RESULT_BYTES)) {
+            p->stats.bus_errors++;
+            p->planned = true;
+            p->start_us = now_us + p->conversion_us;
+            return ICP10125_ERROR;
+        }
+        if (icp10125_crc8(&buf[0], 2) != buf[2] || icp10125_crc8(&buf[3], 2) != buf[5] ||
+            icp10125_crc8(&buf[6], 2) != buf[8]) {
+            p->stats.crc_errors++;
+            p->planned = true;
+            p->start_us = now_us;
+            return ICP10125_ERROR;
+        }
+        p->result.temp = (uint16_t)(buf[0] << 8 | buf[1]);
+        p->result.pressure = (uint32_t)buf[3] << 16 | (uint32_t)buf[4] << 8 | buf[6];
+        p->fresh = true;
+        p->stats.measurements++;
+        status = ICP10125_NEW;
+    }
+
+    if (!p->running && p->planned && (int32_t)(now_us - p->start_us) >= 0) {
+        if (!p->bus.write(p->bus.ctx, ICP10125_ADDRESS, p->measure_cmd, 2)) {
+            p->stats.bus_errors++;
+            p->start_us = now_us + p->conversion_us;
+            return ICP10125_ERROR;
+        }
+        p->planned = false;
+        p->running = true;
+        p->ready_us = now_us + p->conversion_us;
+    }
+    return status;
+}
+
+const icp10125_result_t *RAM_FUNC(icp10125_take)(icp10125_t *p) {
+    if (!p->fresh) {
+        return NULL;
+    }
+    p->fresh = false;
+    return &p->result;
+}
+
+void icp10125_calibrate(icp10125_cal_t *cal, const int16_t otp[ICP10125_OTP_WORDS]) {
+    cal->base[0] = ICP10125_LUT_LOWER;
+    cal->base[1] = ICP10125_OFFSET_FACTOR * otp[3];
+    cal->base[2] = ICP10125_LUT_UPPER;
+    for (int i = 0; i < 3; i++) {
+        cal->quad[i] = otp[i];
+    }
+}
+
+// The vendor solves for the curve's three coefficients in floating point
+// on every sample. The curve is a Moebius map, which keeps cross ratios,
+// so the pressure follows from the code's cross ratio against the three
+// LUT values. With the calibration pressures put in that is
+//   P = 15000 (15 D + 49 N) / (5 D + 7 N)
+//   N = (code - lut0)(lut1 - lut2),  D = (code - lut2)(lut1 - lut0)
+// where every term fits 64 bits.
+int32_t icp10125_pressure(const icp10125_cal_t *cal, uint16_t temp, uint32_t pressure) {
+    int32_t t = (int32_t)temp - 32768;
+    int64_t t2 = (int64_t)t * t;
+    int64_t lut[3];
+    for (int i = 0; i < 3; i++) {
+        lut[i] = cal->base[i] + ((cal->quad[i] * t2 + (1 << 23)) >> 24);
+    }
+
+    int64_t code = pressure;
+    int64_t n = (code - lut[0]) * (lut[1] - lut[2]);
+    int64_t d = (code - lut[2]) * (lut[1] - lut[0]);
+    int64_t num = 15 * d + 49 * n;
+    int64_t den = 5 * d + 7 * n;
+    if (den < 0) {
+        num = -num;
+        den = -den;
+    }
+    // Room for the scale factor; the ratio is a few units, so den keeps
+    // over 40 bits
+    while (num >= (1ll << 44) || num <= -(1ll << 44)) {
+        num /= 2;
+        den /= 2;
+    }
+    if (den == 0) {
+        return 0;
+    }
+    // 15000 Pa in 1/16 Pa, rounded
+    int64_t scaled = num * (15000 * 16);
+    return (int32_t)((scaled + (scaled < 0 ? -den : den) / 2) / den);
+}
+
+// -45 °C + 175 °C * code / 2^16, in 1/128 °C
+int32_t icp10125_temperature(uint16_t temp) {
+    return (int32_t)((22400u * temp + (1u << 15)) >> 16) - 45 * 128;
+}
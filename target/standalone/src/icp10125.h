@@ -0,0 +1,111 @@
+#ifndef ICP10125_H
+#define ICP10125_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// I2C address and commands. Commands are 16 bits, sent high byte first;
+// every 16-bit word the sensor returns is followed by a CRC-8.
+#define ICP10125_ADDRESS 0x63
+#define ICP10125_CMD_READ_ID 0xEFC8
+#define ICP10125_CMD_OTP_SETUP 0xC595       // Followed by 0x00 0x66 0x9C
+#define ICP10125_CMD_OTP_READ 0xC7F7        // Next calibration word
+#define ICP10125_ID_MASK 0x003F
+#define ICP10125_ID 0x0008
+#define ICP10125_OTP_WORDS 4
+
+// Measurement modes, temperature first. The slower modes average more.
+#define ICP10125_MODE_LP 0          // Low power, 1.8 ms
+#define ICP10125_MODE_N 1           // Normal, 6.3 ms
+#define ICP10125_MODE_LN 2          // Low noise, 23.8 ms
+#define ICP10125_MODE_ULN 3         // Ultra low noise, 94.5 ms
+
+// Result: temperature word, then the pressure in two words of which the
+// last byte is unused, each with its CRC
+#define ICP10125_RESULT_BYTES 9
+
+// What icp10125_poll() did
+#define ICP10125_WAIT 0             // Nothing, or started a measurement
+#define ICP10125_NEW 1              // Stored a new result
+#define ICP10125_ERROR -1           // The bus failed or a CRC was wrong; the measurement starts again
+
+// The conversion from the sensor's codes, with everything that depends
+// only on the OTP worked out at init. The vendor's model maps a code to
+// pressure with a curve through three calibration points, whose
+// positions (the LUT values) move with temperature as
+//   lut[i] = base[i] + quad[i] * t^2 / 2^24,  t = temperature code - 32768
+typedef struct {
+    int32_t base[3];
+    int32_t quad[3];
+} icp10125_cal_t;
+
+// How the driver reaches the sensor: a write, then a separate read, each
+// its own transaction. Both return false if the sensor did not answer,
+// which it also does to a read before a measurement is done. They are
+// called from the sampling core, so on the target they must be in SRAM.
+typedef struct {
+    bool (*write)(void *ctx, uint8_t address, const uint8_t *data, uint32_t len);
+    bool (*read)(void *ctx, uint8_t address, uint8_t *data, uint32_t len);
+    void *ctx;
+} icp10125_bus_t;
+
+// The raw codes of one measurement
+typedef struct {
+    uint16_t temp;
+    uint32_t pressure;          // 24 bits
+} icp10125_result_t;
+
+typedef struct {
+    uint32_t measurements;
+    uint32_t crc_errors;
+    uint32_t bus_errors;
+} icp10125_stats_t;
+
+typedef struct {
+    icp10125_bus_t bus;
+    icp10125_cal_t cal;
+    uint8_t mode;
+    uint8_t measure_cmd[2];     // Kept here: const tables may be in flash
+    uint32_t conversion_us;
+    bool running;               // Started and not yet read
+    uint32_t ready_us;
+    bool planned;               // A measurement is wanted, starting at start_us
+    uint32_t start_us;
+    bool fresh;                 // 'result' not yet taken
+    icp10125_result_t result;
+    icp10125_stats_t stats;
+} icp10125_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Check the ID and read the calibration; false if the sensor is missing,
+// something else answers, or the OTP does not read back cleanly
+bool icp10125_init(icp10125_t *p, const icp10125_bus_t *bus, uint8_t mode);
+uint32_t icp10125_conversion_us(uint8_t mode);
+
+// The same scheduling as the VEML6075 (veml6075.h): have a result ready
+// by 'ready_by_us', poll when due, take it with the sample
+void icp10125_plan(icp10125_t *p, uint32_t ready_by_us);
+bool icp10125_due(const icp10125_t *p, uint32_t now_us);
+int icp10125_poll(icp10125_t *p, uint32_t now_us);
+const icp10125_result_t *icp10125_take(icp10125_t *p);
+
+// CRC-8 over one returned word (polynomial 0x31, initial value 0xFF)
+uint8_t icp10125_crc8(const uint8_t *data, uint32_t len);
+
+// Calibration constants from the four OTP words
+void icp10125_calibrate(icp10125_cal_t *cal, const int16_t otp[ICP10125_OTP_WORDS]);
+
+// Pressure in 1/16 Pa and temperature in 1/128 °C from the codes, in
+// integer arithmetic. Uses a 64-bit division, so it is not for core 1.
+int32_t icp10125_pressure(const icp10125_cal_t *cal, uint16_t temp, uint32_t pressure);
+int32_t icp10125_temperature(uint16_t temp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,45 @@
+#include "jitter_stats.h"
+#include "ram_func.h"
+
+#include <stdio.h>
+
+// Cleared field by field through a volatile pointer, which cannot become
+// a call to memset in flash
+void RAM_FUNC(jitter_stats_reset)(jitter_stats_t *stats) {
+    volatile uint32_t *bucket = stats->bucket;
+    stats->samples = 0;
+    for (int i = 0; i < JITTER_BUCKETS; i++) {
+        bucket[i] = 0;
+    }
+    stats->max_late_us = 0;
+    stats->total_late_us = 0;
+    stats->skipped = 0;
+}
+
+// Comparisons rather than a table of limits, which would be in flash
+void RAM_FUNC(jitter_stats_add)(jitter_stats_t *stats, uint32_t late_us) {
+    int i = late_us < 10 ? 0 : late_us < 100 ? 1 : late_us < 1000 ? 2 : late_us < 10000 ? 3 : 4;
+    stats->bucket[i]++;
+    stats->samples++;
+    stats->total_late_us += late_us;
+    if (late_us > stats->max_late_us) {
+        stats->max_late_us = late_us;
+    }
+}
+
+void RAM_FUNC(jitter_stats_skip)(jitter_stats_t *stats) {
+    stats->skipped++;
+}
+
+// One line: count, mean and worst lateness, then the bucket counts
+int jitter_stats_format(const jitter_stats_t *stats, char *buf, size_t len) {
+    unsigned long mean = stats->samples ? (unsigned long)(stats->total_late_us / stats->samples) : 0;
+    int n = snprintf(buf, len,
+                     "%lu samples, late by %lu us mean, %lu us max; <10us %lu, <100us %lu, <1ms %lu, <10ms %lu, "
+                     ">=10ms %lu; %lu periods skipped\n",
+                     (unsigned long)stats->samples, mean, (unsigned long)stats->max_late_us,
+                     (unsigned long)stats->bucket[0], (unsigned long)stats->bucket[1],
+                     (unsigned long)stats->bucket[2], (unsigned long)stats->bucket[3],
+                     (unsigned long)stats->bucket[4], (unsigned long)stats->skipped);
+    return (n < 0) ? 0 : ((size_t)n >= len ? (int)len - 1 : n);
+}
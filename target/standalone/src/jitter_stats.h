@@ -0,0 +1,37 @@
+#ifndef JITTER_STATS_H
+#define JITTER_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Lateness buckets, one per decade: under 10 us, 100 us, 1 ms, 10 ms, and
+// 10 ms or more
+#define JITTER_BUCKETS 5
+
+// How late each sample started against its schedule. The acquisition
+// core adds to it from SRAM. Another core may read it at any time and see
+// fields from two different samples, which is fine for a report.
+typedef struct {
+    uint32_t samples;
+    uint32_t bucket[JITTER_BUCKETS];
+    uint32_t max_late_us;
+    uint64_t total_late_us;
+    uint32_t skipped;           // Periods given up after falling a whole period behind
+} jitter_stats_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void jitter_stats_reset(jitter_stats_t *stats);
+void jitter_stats_add(jitter_stats_t *stats, uint32_t late_us);
+void jitter_stats_skip(jitter_stats_t *stats);
+int jitter_stats_format(const jitter_stats_t *stats, char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
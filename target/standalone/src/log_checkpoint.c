@@ -0,0 +1,269 @@
+#include "log_checkpoint.h"
+#include "crc.h"
+#include "sd_log.h"
+
+#include <string.h>
+
+_Static_assert(LOG_RECOVER_WINDOW >= LOG_CHECKPOINT_BLOCKS + SD_LOG_SYNC_BUFFERS, "window must reach the next save");
+_Static_assert(LOG_RECOVER_WINDOW <= LOG_INDEX_INTERVAL, "at most one index block in the window");
+
+// Byte offsets in a checkpoint sector
+#define CP_MAGIC 0
+#define CP_VERSION 4
+#define CP_GENERATION 8
+#define CP_FILE_NUMBER 12
+#define CP_START_LBA 16
+#define CP_FILE_BLOCKS 20
+#define CP_LOG_ID 24
+#define CP_NEXT_BLOCK 28
+#define CP_PREV_INDEX 32
+#define CP_INDEX_PENDING 36
+#define CP_LAST_TIME 40
+#define CP_OLDEST_FILE 48
+#define CP_SPARE_FIRST 52
+#define CP_SPARE_END 56
+#define CP_CRC 60
+#define CP_CRC_V1 48            // Version 1 ends after last_time
+
+_Static_assert(CP_CRC + 4 == LOG_CHECKPOINT_SIZE, "checkpoint layout and size disagree");
+
+static void put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+void log_checkpointer_init(log_checkpointer_t *ckpt, block_dev_t *dev, uint32_t lba) {
+    memset(ckpt, 0, sizeof(*ckpt));
+    ckpt->dev = dev;
+    ckpt->lba = lba;
+    ckpt->current.prev_index = LOG_NO_BLOCK;
+}
+
+// Read both slots and return the newest valid checkpoint: 1 if there is
+// one, 0 if neither slot holds one, or a BLOCK_* error
+int log_checkpointer_load(log_checkpointer_t *ckpt, log_checkpoint_t *cp) {
+    int found = 0;
+    for (uint32_t slot = 0; slot < LOG_CHECKPOINT_SLOTS; slot++) {
+        uint8_t *s = ckpt->sector;
+        int status = block_dev_read(ckpt->dev, ckpt->lba + slot, s, 1);
+        if (status != BLOCK_OK) {
+            return status;
+        }
+        uint8_t version = s[CP_VERSION];
+        size_t crc_at = version == 1 ? CP_CRC_V1 : CP_CRC;
+        if (get32(&s[CP_MAGIC]) != LOG_CHECKPOINT_MAGIC || version < 1 || version > LOG_CHECKPOINT_VERSION ||
+            crc32(CRC32_INIT, s, crc_at) != get32(&s[crc_at])) {
+            continue;
+        }
+        uint32_t generation = get32(&s[CP_GENERATION]);
+        if (found && (int32_t)(generation - cp->generation) <= 0) {
+            continue;
+        }
+        cp->generation = generation;
+        cp->file_number = get32(&s[CP_FILE_NUMBER]);
+        cp->start_lba = get32(&s[CP_START_LBA]);
+        cp->file_blocks = get32(&s[CP_FILE_BLOCKS]);
+        cp->log_id = get32(&s[CP_LOG_ID]);
+        cp->next_block = get32(&s[CP_NEXT_BLOCK]);
+        cp->prev_index = get32(&s[CP_PREV_INDEX]);
+        cp->index_pending = get32(&s[CP_INDEX_PENDING]);
+        cp->last_time_us = get32(&s[CP_LAST_TIME]) | (uint64_t)get32(&s[CP_LAST_TIME + 4]) << 32;
+        if (version == 1) {
+            // From before segments: older files are left alone
+            cp->oldest_file = cp->file_number;
+            cp->spare_first = cp->spare_end = 0;
+        } else {
+            cp->oldest_file = get32(&s[CP_OLDEST_FILE]);
+            cp->spare_first = get32(&s[CP_SPARE_FIRST]);
+            cp->spare_end = get32(&s[CP_SPARE_END]);
+        }
+        found = 1;
+    }
+    if (found) {
+        ckpt->current.generation = cp->generation;
+    }
+    return found;
+}
+
+// A new, empty log file; save straight after so a restart finds it
+void log_checkpointer_new_file(log_checkpointer_t *ckpt, uint32_t file_number, uint32_t start_lba,
+                               uint32_t file_blocks) {
+    log_checkpoint_t *c = &ckpt->current;
+    c->file_number = file_number;
+    c->start_lba = start_lba;
+    c->file_blocks = file_blocks;
+    c->log_id = 0;
+    c->next_block = 0;
+    c->prev_index = LOG_NO_BLOCK;
+    c->index_pending = 0;
+    c->last_time_us = 0;
+    ckpt->saved_block = 0;
+}
+
+// Carry on from a recovered checkpoint. The resumed writer starts its
+// index afresh, and so does the count of blocks waiting for one.
+void log_checkpointer_resume(log_checkpointer_t *ckpt, const log_checkpoint_t *recovered) {
+    uint32_t generation = ckpt->current.generation;
+    ckpt->current = *recovered;
+    ckpt->current.generation = generation;
+    ckpt->current.index_pending = 0;
+    ckpt->saved_block = recovered->next_block;
+}
+
+// Note whole log blocks as they are handed to the card, whether or not
+// the write worked: either way they take up their positions
+void log_checkpointer_wrote(log_checkpointer_t *ckpt, const uint8_t *data, size_t len) {
+    log_checkpoint_t *c = &ckpt->current;
+    for (size_t off = 0; off + LOG_BLOCK_SIZE <= len; off += LOG_BLOCK_SIZE) {
+        log_block_header_t hdr;
+        if (log_block_peek(&data[off], &hdr) != LOG_OK) {
+            continue;
+        }
+        switch (hdr.type) {
+        case LOG_BLOCK_FILE:
+            c->log_id = log_file_id(&data[off], &hdr);
+            c->prev_index = LOG_NO_BLOCK;
+            c->index_pending = 0;
+            break;
+        case LOG_BLOCK_INDEX:
+            c->prev_index = hdr.seq;
+            c->index_pending = 0;
+            break;
+        default:
+            c->index_pending++;
+            break;
+        }
+        c->next_block = hdr.seq + 1;
+        if (hdr.last_time_us > c->last_time_us) {
+            c->last_time_us = hdr.last_time_us;
+        }
+    }
+}
+
+// Save the checkpoint if enough has been written since the last one (or
+// 'force'). Only call once the blocks it counts have been synced. Returns
+// 1 if saved, 0 if not due, or a BLOCK_* error.
+int log_checkpointer_save(log_checkpointer_t *ckpt, bool force) {
+    log_checkpoint_t *c = &ckpt->current;
+    if (!force && c->next_block - ckpt->saved_block < LOG_CHECKPOINT_BLOCKS) {
+        return 0;
+    }
+
+    uint8_t *s = ckpt->sector;
+    memset(s, 0xFF, BLOCK_SIZE);
+    c->generation++;
+    put32(&s[CP_MAGIC], LOG_CHECKPOINT_MAGIC);
+    s[CP_VERSION] = LOG_CHECKPOINT_VERSION;
+    s[CP_VERSION + 1] = s[CP_VERSION + 2] = s[CP_VERSION + 3] = 0;
+    put32(&s[CP_GENERATION], c->generation);
+    put32(&s[CP_FILE_NUMBER], c->file_number);
+    put32(&s[CP_START_LBA], c->start_lba);
+    put32(&s[CP_FILE_BLOCKS], c->file_blocks);
+    put32(&s[CP_LOG_ID], c->log_id);
+    put32(&s[CP_NEXT_BLOCK], c->next_block);
+    put32(&s[CP_PREV_INDEX], c->prev_index);
+    put32(&s[CP_INDEX_PENDING], c->index_pending);
+    put32(&s[CP_LAST_TIME], (uint32_t)c->last_time_us);
+    put32(&s[CP_LAST_TIME + 4], (uint32_t)(c->last_time_us >> 32));
+    put32(&s[CP_OLDEST_FILE], c->oldest_file);
+    put32(&s[CP_SPARE_FIRST], c->spare_first);
+    put32(&s[CP_SPARE_END], c->spare_end);
+    put32(&s[CP_CRC], crc32(CRC32_INIT, s, CP_CRC));
+
+    // Alternate slots: the older checkpoint survives a torn write
+    int status = block_dev_write(ckpt->dev, ckpt->lba + c->generation % LOG_CHECKPOINT_SLOTS, s, 1);
+    if (status == BLOCK_OK) {
+        status = block_dev_sync(ckpt->dev);
+    }
+    if (status != BLOCK_OK) {
+        ckpt->save_errors++;
+        return status;
+    }
+    ckpt->saved_block = c->next_block;
+    ckpt->saves++;
+    return 1;
+}
+
+// Read one block of the file and check it is this log's block for that
+// position. Read errors are returned through 'status'.
+static bool recover_block(block_dev_t *dev, const log_checkpoint_t *cp, uint32_t pos, uint32_t log_id,
+                          uint8_t *scratch, log_block_header_t *hdr, uint32_t *blocks_read, int *status) {
+    (*blocks_read)++;
+    *status = block_dev_read(dev, cp->start_lba + pos * LOG_SECTORS_PER_BLOCK, scratch, LOG_SECTORS_PER_BLOCK);
+    if (*status != BLOCK_OK || log_block_parse(scratch, log_id, hdr) != LOG_OK || hdr->seq != pos) {
+        return false;
+    }
+    return (pos == 0) == (hdr->type == LOG_BLOCK_FILE);
+}
+
+// Find where the log in the checkpoint's file really ends. Blocks go to
+// the card in order, so past the checkpoint the valid ones form a run:
+// a binary search over the window finds its end in a handful of reads.
+// Stale blocks from an earlier log fail on the log ID, and a torn block
+// on its CRC. 'scratch' holds one log block. Returns BLOCK_OK or a read
+// error; 'out' is the checkpoint moved up to the true end.
+int log_recover(block_dev_t *dev, const log_checkpoint_t *cp, uint8_t *scratch, log_checkpoint_t *out,
+                uint32_t *blocks_read) {
+    log_block_header_t hdr;
+    int status = BLOCK_OK;
+
+    *out = *cp;
+    *blocks_read = 0;
+    if (out->next_block == 0) {
+        // The file was new: its FILE block may not have landed
+        if (!recover_block(dev, cp, 0, 0, scratch, &hdr, blocks_read, &status)) {
+            return status;
+        }
+        out->log_id = log_file_id(scratch, &hdr);
+        out->next_block = 1;
+        out->prev_index = LOG_NO_BLOCK;
+        out->index_pending = 0;
+    }
+
+    uint32_t first = out->next_block;
+    uint32_t lo = first;
+    uint32_t hi = first + LOG_RECOVER_WINDOW < out->file_blocks ? first + LOG_RECOVER_WINDOW : out->file_blocks;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (recover_block(dev, cp, mid, out->log_id, scratch, &hdr, blocks_read, &status)) {
+            lo = mid + 1;
+        } else if (status != BLOCK_OK) {
+            return status;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == first) {
+        return BLOCK_OK;
+    }
+
+    // The last good block gives the time; the index block, if one was
+    // written in the run, is where the writer's cadence puts it
+    uint32_t last = lo - 1;
+    if (!recover_block(dev, cp, last, out->log_id, scratch, &hdr, blocks_read, &status)) {
+        return status != BLOCK_OK ? status : BLOCK_ERROR;
+    }
+    out->last_time_us = hdr.last_time_us;
+    uint32_t index_at = first + (LOG_INDEX_INTERVAL - out->index_pending);
+    if (hdr.type == LOG_BLOCK_INDEX) {
+        out->prev_index = last;
+        out->index_pending = 0;
+    } else if (index_at < last &&
+               recover_block(dev, cp, index_at, out->log_id, scratch, &hdr, blocks_read, &status) &&
+               hdr.type == LOG_BLOCK_INDEX) {
+        out->prev_index = index_at;
+        out->index_pending = last - index_at;
+    } else if (status != BLOCK_OK) {
+        return status;
+    } else {
+        out->index_pending += lo - first;
+    }
+    out->next_block = lo;
+    return BLOCK_OK;
+}
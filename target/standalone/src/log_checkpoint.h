@@ -0,0 +1,80 @@
+#ifndef LOG_CHECKPOINT_H
+#define LOG_CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "block_dev.h"
+#include "block_log.h"
+
+// Where the log stands on the card, so that after a power cut the writer
+// can find its place by reading one checkpoint and a few blocks past it
+// instead of scanning the whole log.
+//
+// Checkpoints live in two sectors written in turn; a write torn by the
+// power cut leaves the other one intact. A checkpoint is only saved after
+// the log blocks it counts have been synced. See docs/log_format.md.
+#define LOG_CHECKPOINT_MAGIC 0x504B4353u    // "SCKP"
+#define LOG_CHECKPOINT_VERSION 2
+#define LOG_CHECKPOINT_SLOTS 2
+#define LOG_CHECKPOINT_SIZE 64
+
+// Save a checkpoint once this many blocks have been written since the last
+// one. Each save is a small write away from the log, so not every sync.
+#define LOG_CHECKPOINT_BLOCKS 32
+
+// Blocks past a checkpoint that recovery looks at: the checkpoint spacing,
+// plus the blocks written before the next sync point
+#define LOG_RECOVER_WINDOW 48
+
+#define LOG_SECTORS_PER_BLOCK (LOG_BLOCK_SIZE / BLOCK_SIZE)
+
+// One checkpoint
+typedef struct {
+    uint32_t generation;        // Higher is newer
+    uint32_t file_number;       // LOGnnnn.BIN holding the log
+    uint32_t start_lba;         // First sector of that file
+    uint32_t file_blocks;       // Its size in log blocks
+    uint32_t log_id;            // From its FILE block, once written
+    uint32_t next_block;        // Blocks of the file known to be on the card
+    uint32_t prev_index;        // Position of the last index block among them
+    uint32_t index_pending;     // Data blocks written since that index block
+    uint64_t last_time_us;      // Time of the last sample among them
+    // The segments around it (see log_segments.h)
+    uint32_t oldest_file;       // Oldest log file still kept
+    uint32_t spare_first;       // Spare segments spare_first..spare_end - 1
+    uint32_t spare_end;
+} log_checkpoint_t;
+
+// Keeps the checkpoint up to date as blocks are written and saves it
+typedef struct {
+    block_dev_t *dev;
+    uint32_t lba;               // First of LOG_CHECKPOINT_SLOTS sectors
+    log_checkpoint_t current;   // What has been written so far
+    uint32_t saved_block;       // current.next_block when last saved
+    uint8_t sector[BLOCK_SIZE] __attribute__((aligned(4)));
+    uint32_t saves;
+    uint32_t save_errors;
+} log_checkpointer_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void log_checkpointer_init(log_checkpointer_t *ckpt, block_dev_t *dev, uint32_t lba);
+int log_checkpointer_load(log_checkpointer_t *ckpt, log_checkpoint_t *cp);
+void log_checkpointer_new_file(log_checkpointer_t *ckpt, uint32_t file_number, uint32_t start_lba,
+                               uint32_t file_blocks);
+void log_checkpointer_resume(log_checkpointer_t *ckpt, const log_checkpoint_t *recovered);
+void log_checkpointer_wrote(log_checkpointer_t *ckpt, const uint8_t *data, size_t len);
+int log_checkpointer_save(log_checkpointer_t *ckpt, bool force);
+
+int log_recover(block_dev_t *dev, const log_checkpoint_t *cp, uint8_t *scratch, log_checkpoint_t *out,
+                uint32_t *blocks_read);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,400 @@
+#include "log_msc.h"
+
+#ifndef HOST_TESTING
+#include "tusb.h"
+#endif
+
+#include <string.h>
+
+#define DIR_ENTRY_SIZE 32
+#define FAT_ENTRIES_PER_SECTOR (LOG_MSC_SECTOR_SIZE / 4)
+#define FAT_EOC 0x0FFFFFFFu
+#define FAT_MEDIA 0x0FFFFFF8u
+#define ROOT_CLUSTER 2
+#define FIRST_FILE_CLUSTER (ROOT_CLUSTER + LOG_MSC_ROOT_CLUSTERS)
+#define FSINFO_SECTOR 1
+#define BACKUP_BOOT_SECTOR 6
+
+// 1980-01-01, the earliest date FAT has: the log's times are its own, not
+// calendar dates
+#define FAT_DATE_EPOCH ((1 << 5) | 1)
+
+_Static_assert(LOG_BLOCK_SIZE % LOG_MSC_SECTOR_SIZE == 0, "a cluster is a whole log block");
+_Static_assert(LOG_MSC_ROOT_CLUSTERS * LOG_BLOCK_SIZE >= (1 + LOG_MSC_MAX_FILES) * DIR_ENTRY_SIZE,
+               "root directory holds the label and every file");
+_Static_assert(BACKUP_BOOT_SECTOR + 2 <= LOG_MSC_RESERVED_SECTORS, "boot sector copies fit the reserved area");
+
+static const char volume_label[11] = {'P', 'I', 'C', 'O', ' ', 'L', 'O', 'G', ' ', ' ', ' '};
+
+#if !defined(HOST_TESTING) && CFG_TUD_MSC
+static log_msc_t *msc_port;
+#endif
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+void log_msc_init(log_msc_t *m, const log_xfer_source_t *source, uint32_t volume_id) {
+    memset(m, 0, sizeof(*m));
+    m->source = *source;
+    m->volume_id = volume_id;
+#if !defined(HOST_TESTING) && CFG_TUD_MSC
+    msc_port = m;
+#endif
+}
+
+int log_msc_load(log_msc_t *m) {
+    uint32_t first, end;
+    m->loaded = false;
+    m->block_valid = false;
+    m->file_count = 0;
+    int status = m->source.range(m->source.ctx, &first, &end);
+    if (status != BLOCK_OK) {
+        return status;
+    }
+    if (end - first > LOG_MSC_MAX_FILES) {
+        first = end - LOG_MSC_MAX_FILES;
+    }
+
+    uint32_t cluster = FIRST_FILE_CLUSTER;
+    for (uint32_t file = first; file < end; file++) {
+        uint32_t blocks;
+        if (m->source.size(m->source.ctx, file, &blocks) != BLOCK_OK) {
+            continue;           // Retired since the range was taken
+        }
+        log_msc_file_t *f = &m->files[m->file_count++];
+        f->file = file;
+        f->blocks = blocks;
+        f->cluster = cluster;
+        cluster += blocks;
+    }
+
+    m->clusters = cluster - ROOT_CLUSTER;
+    if (m->clusters < LOG_MSC_MIN_CLUSTERS) {
+        m->clusters = LOG_MSC_MIN_CLUSTERS;
+    }
+    // Whole clusters of FAT keep the data region, and so every log block,
+    // on a 4 KiB boundary of the disk
+    uint32_t fat_bytes = (m->clusters + ROOT_CLUSTER) * 4;
+    uint32_t fat_clusters = (fat_bytes + LOG_BLOCK_SIZE - 1) / LOG_BLOCK_SIZE;
+    m->fat_sectors = fat_clusters * LOG_MSC_SECTORS_PER_CLUSTER;
+    m->data_start = LOG_MSC_RESERVED_SECTORS + 2 * m->fat_sectors;
+    m->sectors = m->data_start + m->clusters * LOG_MSC_SECTORS_PER_CLUSTER;
+    m->loaded = true;
+    m->changed = true;
+    m->stats.loads++;
+    return BLOCK_OK;
+}
+
+void log_msc_eject(log_msc_t *m) {
+    m->loaded = false;
+    m->block_valid = false;
+}
+
+int log_msc_unit_ready(log_msc_t *m) {
+    if (!m->loaded) {
+        return LOG_MSC_NO_MEDIUM;
+    }
+    if (m->changed) {
+        m->changed = false;
+        return LOG_MSC_CHANGED;
+    }
+    return LOG_MSC_READY;
+}
+
+// The file holding a cluster, and the block within it; NULL for the root
+// directory and free space
+static const log_msc_file_t *log_msc_find(const log_msc_t *m, uint32_t cluster, uint32_t *block) {
+    // Last file starting at or before the cluster. Empty files share their
+    // cluster with the next file, which comes after them.
+    uint32_t lo = 0, hi = m->file_count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (m->files[mid].cluster <= cluster) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return NULL;
+    }
+    const log_msc_file_t *f = &m->files[lo - 1];
+    if (cluster - f->cluster >= f->blocks) {
+        return NULL;
+    }
+    *block = cluster - f->cluster;
+    return f;
+}
+
+static uint32_t log_msc_fat_entry(const log_msc_t *m, uint32_t cluster) {
+    uint32_t block;
+    if (cluster == 0) {
+        return FAT_MEDIA;
+    }
+    if (cluster == 1) {
+        return FAT_EOC;
+    }
+    if (cluster < FIRST_FILE_CLUSTER) {
+        return cluster + 1 == FIRST_FILE_CLUSTER ? FAT_EOC : cluster + 1;
+    }
+    const log_msc_file_t *f = log_msc_find(m, cluster, &block);
+    if (f == NULL) {
+        return 0;               // Free
+    }
+    return block + 1 == f->blocks ? FAT_EOC : cluster + 1;
+}
+
+static void log_msc_boot_sector(const log_msc_t *m, uint8_t *s) {
+    static const uint8_t jump[3] = {0xEB, 0x58, 0x90};
+    memcpy(&s[0], jump, sizeof(jump));
+    memcpy(&s[3], "PICOLOG ", 8);
+    put16(&s[11], LOG_MSC_SECTOR_SIZE);
+    s[13] = LOG_MSC_SECTORS_PER_CLUSTER;
+    put16(&s[14], LOG_MSC_RESERVED_SECTORS);
+    s[16] = 2;                  // FATs
+    s[21] = 0xF8;               // Fixed disk
+    put16(&s[24], 63);          // Sectors per track and heads, for tools that want them
+    put16(&s[26], 255);
+    put32(&s[32], m->sectors);
+    put32(&s[36], m->fat_sectors);
+    put32(&s[44], ROOT_CLUSTER);
+    put16(&s[48], FSINFO_SECTOR);
+    put16(&s[50], BACKUP_BOOT_SECTOR);
+    s[64] = 0x80;
+    s[66] = 0x29;               // Extended boot signature: the next three fields are valid
+    put32(&s[67], m->volume_id);
+    memcpy(&s[71], volume_label, sizeof(volume_label));
+    memcpy(&s[82], "FAT32   ", 8);
+    s[510] = 0x55;
+    s[511] = 0xAA;
+}
+
+static void log_msc_fsinfo(uint8_t *s) {
+    put32(&s[0], 0x41615252);
+    put32(&s[484], 0x61417272);
+    put32(&s[488], 0xFFFFFFFF); // Free clusters unknown: there is nothing to allocate
+    put32(&s[492], 0xFFFFFFFF);
+    put32(&s[508], 0xAA550000);
+}
+
+// LOGnnnn.BIN, as fatfs_log names the card's files, padded to 8.3
+static void log_msc_dir_entry(const log_msc_file_t *f, uint8_t *e) {
+    char digits[10];
+    int n = 0;
+    uint32_t number = f->file;
+    do {
+        digits[n++] = (char)('0' + number % 10);
+        number /= 10;
+    } while (number > 0 || n < 4);
+    if (n > 5) {
+        n = 5;                  // Only 5 digits fit beside "LOG"
+    }
+    memset(e, ' ', 11);
+    memcpy(e, "LOG", 3);
+    for (int i = 0; i < n; i++) {
+        e[3 + i] = (uint8_t)digits[n - 1 - i];
+    }
+    memcpy(&e[8], "BIN", 3);
+    e[11] = 0x21;               // Read-only, archive
+    put16(&e[16], FAT_DATE_EPOCH);      // Created
+    put16(&e[18], FAT_DATE_EPOCH);      // Accessed
+    put16(&e[24], FAT_DATE_EPOCH);      // Written
+    uint32_t cluster = f->blocks ? f->cluster : 0;
+    put16(&e[20], (uint16_t)(cluster >> 16));
+    put16(&e[26], (uint16_t)cluster);
+    put32(&e[28], f->blocks * LOG_BLOCK_SIZE);
+}
+
+// Make up a sector that holds no log data: reserved area, FAT, root
+// directory or free space
+static void log_msc_meta_sector(const log_msc_t *m, uint32_t sector, uint8_t *s) {
+    memset(s, 0, LOG_MSC_SECTOR_SIZE);
+    if (sector < LOG_MSC_RESERVED_SECTORS) {
+        if (sector == 0 || sector == BACKUP_BOOT_SECTOR) {
+            log_msc_boot_sector(m, s);
+        } else if (sector == FSINFO_SECTOR || sector == BACKUP_BOOT_SECTOR + 1) {
+            log_msc_fsinfo(s);
+        }
+        return;
+    }
+    if (sector < m->data_start) {
+        // Both FATs alike
+        uint32_t first = (sector - LOG_MSC_RESERVED_SECTORS) % m->fat_sectors * FAT_ENTRIES_PER_SECTOR;
+        for (uint32_t i = 0; i < FAT_ENTRIES_PER_SECTOR && first + i < m->clusters + ROOT_CLUSTER; i++) {
+            put32(&s[4 * i], log_msc_fat_entry(m, first + i));
+        }
+        return;
+    }
+    uint32_t root_sector = sector - m->data_start;
+    if (root_sector < LOG_MSC_ROOT_CLUSTERS * LOG_MSC_SECTORS_PER_CLUSTER) {
+        uint32_t first = root_sector * (LOG_MSC_SECTOR_SIZE / DIR_ENTRY_SIZE);
+        for (uint32_t i = 0; i < LOG_MSC_SECTOR_SIZE / DIR_ENTRY_SIZE; i++) {
+            uint32_t entry = first + i;
+            uint8_t *e = &s[i * DIR_ENTRY_SIZE];
+            if (entry == 0) {
+                memcpy(e, volume_label, sizeof(volume_label));
+                e[11] = 0x08;   // Volume label
+            } else if (entry <= m->file_count) {
+                log_msc_dir_entry(&m->files[entry - 1], e);
+            }
+        }
+    }
+}
+
+int32_t log_msc_read(log_msc_t *m, uint32_t lba, uint32_t offset, void *buf, uint32_t len) {
+    uint8_t *out = (uint8_t *)buf;
+    uint64_t pos = (uint64_t)lba * LOG_MSC_SECTOR_SIZE + offset;
+    uint32_t done = 0;
+    if (!m->loaded || pos + len > (uint64_t)m->sectors * LOG_MSC_SECTOR_SIZE) {
+        m->stats.read_errors++;
+        return -1;
+    }
+    m->stats.reads++;
+
+    while (done < len) {
+        uint32_t sector = (uint32_t)(pos / LOG_MSC_SECTOR_SIZE);
+        uint32_t at = (uint32_t)(pos % LOG_MSC_SECTOR_SIZE);
+        uint32_t n;
+        const log_msc_file_t *f = NULL;
+        uint32_t block = 0;
+        if (sector >= m->data_start) {
+            uint32_t cluster = ROOT_CLUSTER + (sector - m->data_start) / LOG_MSC_SECTORS_PER_CLUSTER;
+            f = log_msc_find(m, cluster, &block);
+        }
+
+        if (f != NULL) {
+            uint32_t in_block = (sector - m->data_start) % LOG_MSC_SECTORS_PER_CLUSTER * LOG_MSC_SECTOR_SIZE + at;
+            n = LOG_BLOCK_SIZE - in_block;
+            if (n > len - done) {
+                n = len - done;
+            }
+            int status;
+            if (n == LOG_BLOCK_SIZE) {
+                // A whole block goes straight into the host's buffer
+                status = m->source.read(m->source.ctx, f->file, block, &out[done]);
+                m->stats.source_reads += status == BLOCK_OK;
+            } else if (m->block_valid && m->block_file == f->file && m->block_num == block) {
+                status = BLOCK_OK;
+            } else {
+                m->block_valid = false;
+                status = m->source.read(m->source.ctx, f->file, block, m->block);
+                if (status == BLOCK_OK) {
+                    m->stats.source_reads++;
+                    m->block_valid = true;
+                    m->block_file = f->file;
+                    m->block_num = block;
+                }
+            }
+            if (status == BLOCK_BUSY) {
+                m->stats.busy++;
+                break;          // The host is asked again for the rest
+            }
+            if (status != BLOCK_OK) {
+                m->stats.read_errors++;
+                return -1;
+            }
+            if (n != LOG_BLOCK_SIZE) {
+                memcpy(&out[done], &m->block[in_block], n);
+            }
+        } else {
+            n = LOG_MSC_SECTOR_SIZE - at;
+            if (n > len - done) {
+                n = len - done;
+            }
+            if (at == 0 && n == LOG_MSC_SECTOR_SIZE) {
+                log_msc_meta_sector(m, sector, &out[done]);
+            } else {
+                log_msc_meta_sector(m, sector, m->sector);
+                memcpy(&out[done], &m->sector[at], n);
+            }
+        }
+        done += n;
+        pos += n;
+    }
+    m->stats.bytes_read += done;
+    return (int32_t)done;
+}
+
+#if !defined(HOST_TESTING) && CFG_TUD_MSC
+// TinyUSB MSC callbacks: one LUN, read-only
+void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4]) {
+    (void)lun;
+    memcpy(vendor_id, "PicoSens", 8);
+    memcpy(product_id, "Sensor Log Disk ", 16);
+    memcpy(product_rev, "1.0 ", 4);
+}
+
+bool tud_msc_test_unit_ready_cb(uint8_t lun) {
+    switch (msc_port ? log_msc_unit_ready(msc_port) : LOG_MSC_NO_MEDIUM) {
+    case LOG_MSC_READY:
+        return true;
+    case LOG_MSC_CHANGED:
+        // Medium may have changed: the host drops what it had cached
+        tud_msc_set_sense(lun, SCSI_SENSE_UNIT_ATTENTION, 0x28, 0x00);
+        return false;
+    default:
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+        return false;
+    }
+}
+
+void tud_msc_capacity_cb(uint8_t lun, uint32_t *block_count, uint16_t *block_size) {
+    (void)lun;
+    *block_count = msc_port && msc_port->loaded ? msc_port->sectors : 0;
+    *block_size = LOG_MSC_SECTOR_SIZE;
+}
+
+bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, bool load_eject) {
+    (void)lun;
+    (void)power_condition;
+    if (msc_port && load_eject) {
+        if (start) {
+            return log_msc_load(msc_port) == BLOCK_OK;
+        }
+        log_msc_eject(msc_port);
+    }
+    return true;
+}
+
+bool tud_msc_is_writable_cb(uint8_t lun) {
+    (void)lun;
+    return false;
+}
+
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void *buffer, uint32_t bufsize) {
+    int32_t n = msc_port ? log_msc_read(msc_port, lba, offset, buffer, bufsize) : -1;
+    if (n < 0) {
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x11, 0x00);    // Unrecovered read error
+    }
+    return n;
+}
+
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t *buffer, uint32_t bufsize) {
+    (void)lba;
+    (void)offset;
+    (void)buffer;
+    (void)bufsize;
+    if (msc_port) {
+        msc_port->stats.write_attempts++;
+    }
+    tud_msc_set_sense(lun, SCSI_SENSE_DATA_PROTECT, 0x27, 0x00);       // Write protected
+    return -1;
+}
+
+int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void *buffer, uint16_t bufsize) {
+    (void)scsi_cmd;
+    (void)buffer;
+    (void)bufsize;
+    tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);     // Invalid command
+    return -1;
+}
+#endif
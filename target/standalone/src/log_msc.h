@@ -0,0 +1,99 @@
+#ifndef LOG_MSC_H
+#define LOG_MSC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "block_dev.h"
+#include "block_log.h"
+#include "log_xfer.h"
+
+// The log as a read-only USB disk (USB_MSC_LOG in tusb_config.h). The
+// disk is a FAT32 volume that exists only as arithmetic: the boot sector,
+// FATs and root directory are made up as the host reads them, and every
+// cluster of file data is one log block, read from wherever the log keeps
+// it (the same source as the download port, log_xfer.h). Nothing is
+// copied or converted, and nothing on the card or in flash is touched.
+//
+// Layout, in 512-byte sectors:
+//   0                 boot sector (copy at 6), FS info (copy at 7)
+//   32                two FATs of fat_sectors each
+//   data_start        cluster 2 on: the root directory, then each file's
+//                     blocks in turn, one 4 KiB cluster per block
+//
+// The volume always claims at least LOG_MSC_MIN_CLUSTERS clusters, so
+// hosts take it for FAT32 whatever the size of the log; clusters past the
+// files read as zeros. Each file is LOGnnnn.BIN, as on the card, marked
+// read-only. The directory is a snapshot of the log taken when the disk
+// is loaded: a file being written shows the blocks it had then, and
+// loading again (which the host sees as a new medium) shows the rest.
+#define LOG_MSC_SECTOR_SIZE 512
+#define LOG_MSC_SECTORS_PER_CLUSTER (LOG_BLOCK_SIZE / LOG_MSC_SECTOR_SIZE)
+#define LOG_MSC_RESERVED_SECTORS 32
+#define LOG_MSC_MAX_FILES 256       // Newest files shown if the log has more
+#define LOG_MSC_ROOT_CLUSTERS 3     // Room for the label and LOG_MSC_MAX_FILES entries
+#define LOG_MSC_MIN_CLUSTERS 65536  // Hosts take fewer than 65525 for FAT16
+
+// What a host asking whether the disk is ready is told
+#define LOG_MSC_READY 0
+#define LOG_MSC_NO_MEDIUM 1         // Ejected, or never loaded
+#define LOG_MSC_CHANGED 2           // Loaded since the host last asked
+
+typedef struct {
+    uint32_t file;              // Number in the source
+    uint32_t blocks;
+    uint32_t cluster;           // First cluster; files follow one another
+} log_msc_file_t;
+
+typedef struct {
+    uint32_t loads;
+    uint32_t reads;             // Read callbacks
+    uint32_t bytes_read;
+    uint32_t source_reads;      // Log blocks read to answer them
+    uint32_t busy;              // Reads put off while the log had work to do
+    uint32_t read_errors;
+    uint32_t write_attempts;
+} log_msc_stats_t;
+
+typedef struct {
+    log_xfer_source_t source;
+    uint32_t volume_id;
+    bool loaded;
+    bool changed;
+    log_msc_file_t files[LOG_MSC_MAX_FILES];
+    uint32_t file_count;
+    uint32_t clusters;          // Data clusters, from cluster 2
+    uint32_t fat_sectors;       // Per FAT
+    uint32_t data_start;        // Sector of cluster 2
+    uint32_t sectors;           // Size of the volume
+    uint8_t sector[LOG_MSC_SECTOR_SIZE];    // Made-up sector being copied out
+    uint8_t block[LOG_BLOCK_SIZE];          // Log block last read for a partial cluster read
+    uint32_t block_file;
+    uint32_t block_num;
+    bool block_valid;
+    log_msc_stats_t stats;
+} log_msc_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The TinyUSB callbacks serve the disk initialised last
+void log_msc_init(log_msc_t *m, const log_xfer_source_t *source, uint32_t volume_id);
+
+// Take a new snapshot of the log's files; BLOCK_OK or the source's error
+int log_msc_load(log_msc_t *m);
+void log_msc_eject(log_msc_t *m);
+int log_msc_unit_ready(log_msc_t *m);
+
+// The SCSI READ(10) data: len bytes from 'offset' bytes into sector
+// 'lba'. Returns the bytes copied, fewer (maybe 0) if the source was
+// busy, or -1 on an error or a read past the end.
+int32_t log_msc_read(log_msc_t *m, uint32_t lba, uint32_t offset, void *buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,313 @@
+#include "log_segments.h"
+
+#include <string.h>
+
+_Static_assert(LOG_BLOCK_SIZE % BLOCK_SIZE == 0, "log blocks are whole sectors");
+
+// Live and spare segments together
+uint32_t log_segments_count(const log_segments_t *seg) {
+    return (seg->next - seg->oldest) + (seg->spare_end - seg->spare_first);
+}
+
+// Keep the checkpoint's copy of the pool current, so that whichever save
+// comes next records it
+static void log_segments_note(log_segments_t *seg) {
+    log_checkpoint_t *c = &seg->ckpt->current;
+    c->oldest_file = seg->oldest;
+    c->spare_first = seg->spare_first;
+    c->spare_end = seg->spare_end;
+}
+
+// Save the checkpoint now, once what it counts is on the card
+static int log_segments_save(log_segments_t *seg) {
+    log_segments_note(seg);
+    int status = block_dev_sync(seg->dev);
+    if (status == BLOCK_OK) {
+        int saved = log_checkpointer_save(seg->ckpt, true);
+        status = saved < 0 ? saved : BLOCK_OK;
+    }
+    return status;
+}
+
+void log_segments_init(log_segments_t *seg, const log_segments_config_t *config, const log_segment_ops_t *ops,
+                       block_dev_t *dev, log_checkpointer_t *ckpt) {
+    memset(seg, 0, sizeof(*seg));
+    seg->config = *config;
+    if (seg->config.max_segments < 2) {
+        seg->config.max_segments = 2;
+    }
+    seg->ops = *ops;
+    seg->dev = dev;
+    seg->ckpt = ckpt;
+}
+
+// Give live number 'file' a segment: a spare if one is ready, else the
+// oldest live segment once the pool is at its limit, else a new one made
+// here. Each way falls through to the next if it fails.
+static int log_segments_take(log_segments_t *seg, uint32_t file) {
+    const log_segment_ops_t *ops = &seg->ops;
+    int status = BLOCK_ERROR;
+    if (seg->spare_first < seg->spare_end) {
+        status = ops->rename(ops->ctx, LOG_SEGMENT_SPARE, seg->spare_first, LOG_SEGMENT_LIVE, file);
+        seg->spare_first++;
+    }
+    if (status != BLOCK_OK && log_segments_count(seg) >= seg->config.max_segments && seg->oldest < file) {
+        status = ops->rename(ops->ctx, LOG_SEGMENT_LIVE, seg->oldest, LOG_SEGMENT_LIVE, file);
+        seg->oldest++;
+        seg->next_start_known = false;
+        if (status == BLOCK_OK) {
+            seg->stats.recycled++;
+        }
+    }
+    if (status != BLOCK_OK) {
+        status = ops->prepare(ops->ctx, seg->spare_end);
+        if (status == BLOCK_OK) {
+            status = ops->rename(ops->ctx, LOG_SEGMENT_SPARE, seg->spare_end, LOG_SEGMENT_LIVE, file);
+        }
+        seg->spare_end++;
+        seg->spare_first = seg->spare_end;
+        if (status == BLOCK_OK) {
+            seg->stats.inline_creates++;
+        }
+    }
+    if (status == BLOCK_OK) {
+        status = ops->locate(ops->ctx, file, &seg->start_lba);
+    }
+    if (status != BLOCK_OK) {
+        seg->open = false;
+        seg->stats.errors++;
+        return status;
+    }
+
+    seg->next = file + 1;
+    raw_log_writer_init(&seg->raw, seg->dev, seg->start_lba, seg->config.file_blocks * LOG_SECTORS_PER_BLOCK,
+                        &seg->raw_writer);
+    seg->open = true;
+    seg->stats.rotations++;
+
+    // A restart from here on finds the new segment
+    log_checkpointer_new_file(seg->ckpt, file, seg->start_lba, seg->config.file_blocks);
+    return log_segments_save(seg);
+}
+
+// Start a new log at live number 'file', with a pool of its own
+int log_segments_start(log_segments_t *seg, uint32_t file) {
+    seg->oldest = file;
+    seg->next = file;
+    seg->spare_first = 0;
+    seg->spare_end = 0;
+    seg->next_start_known = false;
+    return log_segments_take(seg, file);
+}
+
+void log_segments_scan_init(log_segments_scan_t *scan) {
+    memset(scan, 0, sizeof(*scan));
+}
+
+// Note one segment from the listing, in any order
+void log_segments_scan_add(log_segments_scan_t *scan, log_segment_kind_t kind, uint32_t number) {
+    bool *found = kind == LOG_SEGMENT_LIVE ? &scan->live : &scan->spare;
+    uint32_t *first = kind == LOG_SEGMENT_LIVE ? &scan->live_first : &scan->spare_first;
+    uint32_t *last = kind == LOG_SEGMENT_LIVE ? &scan->live_last : &scan->spare_last;
+    if (!*found || number < *first) {
+        *first = number;
+    }
+    if (!*found || number > *last) {
+        *last = number;
+    }
+    *found = true;
+}
+
+// Start a new log after the segments a listing found, with them as the
+// pool: the lowest live number stays the oldest, and the spares are used
+// before any new one is made. The segment that was being written cannot
+// be carried on without a checkpoint, so the new log takes the number
+// after the highest. A number missing in between fails its rename when
+// its turn comes, and is skipped like any other that does.
+int log_segments_rebuild(log_segments_t *seg, const log_segments_scan_t *scan) {
+    seg->next = scan->live ? scan->live_last + 1 : 0;
+    seg->oldest = scan->live ? scan->live_first : seg->next;
+    seg->spare_first = scan->spare ? scan->spare_first : 0;
+    seg->spare_end = scan->spare ? scan->spare_last + 1 : 0;
+    seg->next_start_known = false;
+    return log_segments_take(seg, seg->next);
+}
+
+// Carry on in the segment a checkpoint names, after the blocks log_recover
+// found there, with the pool the checkpoint recorded. Returns BLOCK_ERROR
+// if the segment is not where the checkpoint says, or not this size.
+int log_segments_resume(log_segments_t *seg, const log_checkpoint_t *cp, const log_checkpoint_t *recovered) {
+    const log_segment_ops_t *ops = &seg->ops;
+    uint32_t lba;
+    if (cp->file_blocks != seg->config.file_blocks || ops->locate(ops->ctx, cp->file_number, &lba) != BLOCK_OK ||
+        lba != cp->start_lba) {
+        return BLOCK_ERROR;
+    }
+    seg->next = cp->file_number + 1;
+    seg->start_lba = lba;
+    seg->oldest = cp->oldest_file;
+    seg->spare_first = cp->spare_first;
+    seg->spare_end = cp->spare_end;
+    if (seg->oldest > cp->file_number || seg->spare_first > seg->spare_end) {
+        seg->oldest = cp->file_number;
+        seg->spare_first = seg->spare_end;
+    }
+    seg->next_start_known = false;
+
+    uint32_t offset = recovered->next_block * LOG_SECTORS_PER_BLOCK;
+    raw_log_writer_init(&seg->raw, seg->dev, lba + offset, seg->config.file_blocks * LOG_SECTORS_PER_BLOCK - offset,
+                        &seg->raw_writer);
+    log_checkpointer_resume(seg->ckpt, recovered);
+    log_segments_note(seg);
+    seg->open = true;
+    return BLOCK_OK;
+}
+
+// Write to the current segment. A FILE block anywhere but at its start
+// means the block log began a new log, because the last one reached its
+// size or its time span (see block_log_config_t); that log gets a segment
+// of its own. A segment that fills up moves on to a new one as well.
+static int log_segments_write(void *ctx, const uint8_t *data, size_t len) {
+    log_segments_t *seg = (log_segments_t *)ctx;
+    if (!seg->open) {
+        return BLOCK_ERROR;
+    }
+    log_block_header_t hdr;
+    int status = BLOCK_RANGE;
+    if (seg->raw.next_lba == seg->start_lba || len < LOG_HEADER_SIZE || log_block_peek(data, &hdr) != LOG_OK ||
+        hdr.type != LOG_BLOCK_FILE) {
+        status = seg->raw_writer.write(seg->raw_writer.ctx, data, len);
+    }
+    if (status == BLOCK_RANGE) {
+        status = log_segments_take(seg, seg->next);
+        if (status == BLOCK_OK) {
+            status = seg->raw_writer.write(seg->raw_writer.ctx, data, len);
+        }
+    }
+    log_checkpointer_wrote(seg->ckpt, data, len);
+    return status;
+}
+
+// The segment's metadata is already final; flush the card's cache, then
+// record how far the log now reaches when a checkpoint is due
+static int log_segments_sync(void *ctx) {
+    log_segments_t *seg = (log_segments_t *)ctx;
+    int status = block_dev_sync(seg->dev);
+    if (status == BLOCK_OK) {
+        int saved = log_checkpointer_save(seg->ckpt, false);
+        status = saved < 0 ? saved : BLOCK_OK;
+    }
+    return status;
+}
+
+// Route sd_log buffers into the segments
+void log_segments_writer(log_segments_t *seg, log_writer_t *writer) {
+    writer->write = log_segments_write;
+    writer->sync = log_segments_sync;
+    writer->ctx = seg;
+}
+
+// Retire the oldest live segment once the segment after it starts
+// retain_us before the newest sample: everything in the oldest is older
+// than that. Finding where the next one starts reads one sector, the
+// header of its first data block, and is a step of its own. The segment
+// being written is never retired.
+static int log_segments_retire(log_segments_t *seg) {
+    uint32_t current = seg->next - 1;
+    if (seg->config.retain_us == 0 || seg->oldest >= current) {
+        return 0;
+    }
+    const log_segment_ops_t *ops = &seg->ops;
+    if (!seg->next_start_known) {
+        uint32_t lba = seg->start_lba;
+        if (seg->oldest + 1 == current && seg->ckpt->current.next_block < 2) {
+            return 0;           // No data block in it yet
+        }
+        int status = BLOCK_OK;
+        if (seg->oldest + 1 != current) {
+            status = ops->locate(ops->ctx, seg->oldest + 1, &lba);
+        }
+        if (status == BLOCK_OK) {
+            status = block_dev_read(seg->dev, lba + LOG_SECTORS_PER_BLOCK, seg->sector, 1);
+        }
+        // A segment that does not start with a data block gives no time;
+        // the oldest then stays until its space is needed
+        log_block_header_t hdr;
+        bool ok = status == BLOCK_OK && log_block_peek(seg->sector, &hdr) == LOG_OK && hdr.type == LOG_BLOCK_DATA;
+        seg->next_start_us = ok ? hdr.first_time_us : UINT64_MAX;
+        seg->next_start_known = true;
+        return status != BLOCK_OK ? status : 1;
+    }
+
+    uint64_t newest = seg->ckpt->current.last_time_us;
+    if (newest < seg->next_start_us || newest - seg->next_start_us < seg->config.retain_us) {
+        return 0;
+    }
+    // A segment that cannot be renamed is left out of the pool, not deleted
+    int status = ops->rename(ops->ctx, LOG_SEGMENT_LIVE, seg->oldest, LOG_SEGMENT_SPARE, seg->spare_end);
+    if (status == BLOCK_OK) {
+        seg->spare_end++;
+        seg->stats.retired++;
+    }
+    seg->oldest++;
+    seg->next_start_known = false;
+    int saved = log_segments_save(seg);
+    return status != BLOCK_OK ? status : saved != BLOCK_OK ? saved : 1;
+}
+
+// Allocate a spare that is missing, within the pool's limit, or delete
+// spares beyond one more than wanted. That one is left alone: when a
+// rotation has just used a spare and the next one has been made, the
+// retirement due about then brings one back.
+static int log_segments_balance(log_segments_t *seg) {
+    const log_segment_ops_t *ops = &seg->ops;
+    uint32_t spares = seg->spare_end - seg->spare_first;
+    int status;
+    if (spares > seg->config.spares + 1) {
+        status = ops->remove(ops->ctx, seg->spare_end - 1);
+        seg->spare_end--;
+        if (status == BLOCK_OK) {
+            seg->stats.removed++;
+        }
+    } else if (spares < seg->config.spares && log_segments_count(seg) < seg->config.max_segments) {
+        status = ops->prepare(ops->ctx, seg->spare_end);
+        if (status != BLOCK_OK) {
+            seg->config.spares = spares;    // No room for more: stop asking
+            return status;
+        }
+        seg->spare_end++;
+        seg->stats.prepared++;
+    } else {
+        return 0;
+    }
+    int saved = log_segments_save(seg);
+    return status != BLOCK_OK ? status : saved != BLOCK_OK ? saved : 1;
+}
+
+// One step of work on the pool, for when the storage side has nothing to
+// write: retention first, since a retired segment becomes a spare, then
+// the spares. Each step may block for a while, so call this once per
+// pass of the loop. Returns 1 if it did something, 0 if there was nothing
+// to do, or an error code.
+int log_segments_service(log_segments_t *seg) {
+    if (!seg->open) {
+        return 0;
+    }
+    int status = log_segments_retire(seg);
+    if (status == 0) {
+        status = log_segments_balance(seg);
+    }
+    if (status < 0) {
+        seg->stats.errors++;
+    }
+    return status;
+}
+
+// Sync and checkpoint, so the next start finds the end without searching
+int log_segments_close(log_segments_t *seg) {
+    if (!seg->open) {
+        return BLOCK_OK;
+    }
+    seg->open = false;
+    return log_segments_save(seg);
+}
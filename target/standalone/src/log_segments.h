@@ -0,0 +1,124 @@
+#ifndef LOG_SEGMENTS_H
+#define LOG_SEGMENTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "block_dev.h"
+#include "sd_log.h"
+#include "log_checkpoint.h"
+
+// The log on a card as a bounded pool of segments: files of one fixed
+// size, each allocated in one contiguous run when it is made and written
+// through the raw writer from then on.
+//
+//   live    LOGnnnn.BIN, numbers oldest..current; the log itself
+//   spare   SPRnnnn.BIN, numbers spare_first..spare_end - 1; allocated at
+//           full size but not part of the log
+//
+// Rotating to a new segment renames a spare to the next live number, and
+// retention renames the oldest live segment to a spare. A rename rewrites
+// one directory entry whatever the segment size, and no sample is ever
+// rewritten: a reused segment starts a new log, whose ID keeps the old
+// blocks in it out. Allocating a segment writes its FAT chain, which
+// takes long enough to hold up the samples behind it, so spares are
+// allocated ahead by log_segments_service while the storage side is idle,
+// and spares beyond what is wanted are deleted there too.
+//
+// Once the pool reaches max_segments and no spare is ready, rotation
+// takes the oldest live segment instead, so the log never needs more of
+// the card than that.
+#define LOG_SEGMENTS_SPARES 1
+
+// Which kind of segment a number refers to
+typedef enum {
+    LOG_SEGMENT_LIVE,
+    LOG_SEGMENT_SPARE
+} log_segment_kind_t;
+
+// The file system underneath; each returns BLOCK_OK or an error code
+typedef struct {
+    // Allocate a spare at full size. The slow one.
+    int (*prepare)(void *ctx, uint32_t spare);
+    // Rename a segment; if 'from' is gone and 'to' is there, it already
+    // happened before a restart
+    int (*rename)(void *ctx, log_segment_kind_t from_kind, uint32_t from, log_segment_kind_t to_kind, uint32_t to);
+    // Delete a spare and free its space
+    int (*remove)(void *ctx, uint32_t spare);
+    // First sector of a live segment, checking it has the full size
+    int (*locate)(void *ctx, uint32_t file, uint32_t *start_lba);
+    void *ctx;
+} log_segment_ops_t;
+
+typedef struct {
+    uint32_t file_blocks;       // Segment size in log blocks
+    uint32_t max_segments;      // Live and spare segments together, at least 2
+    uint32_t spares;            // Spares to keep allocated ahead
+    uint64_t retain_us;         // Retire segments whose samples are all this much
+                                // older than the newest; 0 keeps them until the
+                                // space is needed
+} log_segments_config_t;
+
+typedef struct {
+    uint32_t rotations;         // New segments started
+    uint32_t recycled;          // Of those, the oldest live segment taken over
+    uint32_t inline_creates;    // Of those, allocated there and then: no spare was ready
+    uint32_t prepared;          // Spares allocated ahead
+    uint32_t retired;           // Live segments past retention, made spares
+    uint32_t removed;           // Spares deleted
+    uint32_t errors;
+} log_segments_stats_t;
+
+// What a directory listing shows of a pool, for a start with no usable
+// checkpoint (log_segments_rebuild)
+typedef struct {
+    bool live;                  // Any live segment found
+    uint32_t live_first;
+    uint32_t live_last;
+    bool spare;                 // Any spare found
+    uint32_t spare_first;
+    uint32_t spare_last;
+} log_segments_scan_t;
+
+typedef struct {
+    log_segments_config_t config;
+    log_segment_ops_t ops;
+    block_dev_t *dev;
+    log_checkpointer_t *ckpt;   // Kept up to date with the pool, and saved
+    raw_log_writer_t raw;       // Writes the current segment's sectors
+    log_writer_t raw_writer;
+    bool open;
+    uint32_t next;              // Number of the next live segment; the one being
+                                // written is next - 1
+    uint32_t start_lba;         // First sector of the one being written
+    uint32_t oldest;
+    uint32_t spare_first;
+    uint32_t spare_end;
+    uint64_t next_start_us;     // First sample time of segment oldest + 1
+    bool next_start_known;
+    uint8_t sector[BLOCK_SIZE] __attribute__((aligned(4)));
+    log_segments_stats_t stats;
+} log_segments_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void log_segments_init(log_segments_t *seg, const log_segments_config_t *config, const log_segment_ops_t *ops,
+                       block_dev_t *dev, log_checkpointer_t *ckpt);
+int log_segments_start(log_segments_t *seg, uint32_t file);
+void log_segments_scan_init(log_segments_scan_t *scan);
+void log_segments_scan_add(log_segments_scan_t *scan, log_segment_kind_t kind, uint32_t number);
+int log_segments_rebuild(log_segments_t *seg, const log_segments_scan_t *scan);
+int log_segments_resume(log_segments_t *seg, const log_checkpoint_t *cp, const log_checkpoint_t *recovered);
+void log_segments_writer(log_segments_t *seg, log_writer_t *writer);
+int log_segments_service(log_segments_t *seg);
+int log_segments_close(log_segments_t *seg);
+uint32_t log_segments_count(const log_segments_t *seg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
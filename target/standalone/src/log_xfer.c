@@ -0,0 +1,272 @@
+#include "log_xfer.h"
+#include "crc.h"
+#include "usb_tx.h"
+
+#ifndef HOST_TESTING
+#include "tusb.h"
+#endif
+
+#include <string.h>
+
+// Request fields
+#define RQ_MAGIC 0
+#define RQ_OP 4
+#define RQ_WINDOW 5
+#define RQ_TAG 6
+#define RQ_FILE 8
+#define RQ_FIRST 12
+#define RQ_COUNT 16
+#define RQ_CRC 20
+
+// Frame header fields
+#define FR_MAGIC 0
+#define FR_TYPE 4
+#define FR_STATUS 5
+#define FR_TAG 6
+#define FR_FILE 8
+#define FR_ARG0 12
+#define FR_ARG1 16
+
+_Static_assert(RQ_CRC + 4 == LOG_XFER_REQUEST_SIZE, "request layout and size disagree");
+_Static_assert(FR_ARG1 + 4 == LOG_XFER_HEADER_SIZE, "frame layout and size disagree");
+_Static_assert(LOG_XFER_FRAME_MAX <= UINT16_MAX, "frame length fits frame_len");
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+void log_xfer_init(log_xfer_t *x, const log_xfer_source_t *source) {
+    memset(x, 0, sizeof(*x));
+    x->source = *source;
+}
+
+// Fill in a frame's header and CRC around a payload already in place
+static void log_xfer_frame(log_xfer_t *x, uint8_t type, int status, uint32_t arg0, uint32_t arg1,
+                           uint16_t payload) {
+    uint8_t *f = x->frame;
+    put32(&f[FR_MAGIC], LOG_XFER_FRAME_MAGIC);
+    f[FR_TYPE] = type;
+    f[FR_STATUS] = (uint8_t)(int8_t)status;
+    put16(&f[FR_TAG], x->tag);
+    put32(&f[FR_FILE], x->file);
+    put32(&f[FR_ARG0], arg0);
+    put32(&f[FR_ARG1], arg1);
+    uint16_t len = (uint16_t)(LOG_XFER_HEADER_SIZE + payload);
+    put32(&f[len], crc32(CRC32_INIT, f, len));
+    x->frame_len = (uint16_t)(len + 4);
+    x->frame_sent = 0;
+}
+
+// Start answering a READ. An earlier transfer is dropped; its frames
+// already sent carry the old tag.
+static void log_xfer_start(log_xfer_t *x, const uint8_t *rq, uint32_t now_us) {
+    uint32_t first = get32(&rq[RQ_FIRST]);
+    uint32_t count = get32(&rq[RQ_COUNT]);
+    uint32_t blocks;
+    x->stats.transfers++;
+    x->stats.restarts += x->active;
+    x->active = false;
+
+    int status = x->source.size(x->source.ctx, x->file, &blocks);
+    if (status != BLOCK_OK) {
+        log_xfer_frame(x, LOG_XFER_ERROR, status, first, 0, 0);
+        return;
+    }
+    if (first >= blocks) {
+        log_xfer_frame(x, LOG_XFER_END, BLOCK_RANGE, first, 0, 0);
+        return;
+    }
+    x->window = rq[RQ_WINDOW] == 0 ? 1 : rq[RQ_WINDOW] > LOG_XFER_WINDOW_MAX ? LOG_XFER_WINDOW_MAX : rq[RQ_WINDOW];
+    x->next = first;
+    x->acked = first;
+    x->end = count < blocks - first ? first + count : blocks;
+    x->ack_us = now_us;
+    x->active = true;
+}
+
+static void log_xfer_request(log_xfer_t *x, const uint8_t *rq, uint32_t now_us) {
+    uint8_t op = rq[RQ_OP];
+    uint16_t tag = get16(&rq[RQ_TAG]);
+    uint32_t file = get32(&rq[RQ_FILE]);
+    x->stats.requests++;
+
+    if (op == LOG_XFER_ACK) {
+        uint32_t next = get32(&rq[RQ_FIRST]);
+        if (x->active && tag == x->tag && file == x->file && next > x->acked && next <= x->next) {
+            x->acked = next;
+            x->ack_us = now_us;
+        }
+        return;
+    }
+    if (op == LOG_XFER_STOP) {
+        x->active = false;
+        return;
+    }
+    // An op we do not know leaves the transfer under way alone
+    if (op != LOG_XFER_LIST && op != LOG_XFER_INFO && op != LOG_XFER_READ) {
+        x->stats.bad_requests++;
+        return;
+    }
+
+    // Any other request ends the transfer under way
+    uint32_t first = 0, end = 0, blocks = 0;
+    int status;
+    x->tag = tag;
+    x->file = file;
+    switch (op) {
+    case LOG_XFER_LIST:
+        x->active = false;
+        x->file = 0;
+        status = x->source.range(x->source.ctx, &first, &end);
+        log_xfer_frame(x, LOG_XFER_LIST, status, first, end, 0);
+        break;
+    case LOG_XFER_INFO:
+        x->active = false;
+        status = x->source.size(x->source.ctx, file, &blocks);
+        log_xfer_frame(x, LOG_XFER_INFO, status, blocks, 0, 0);
+        break;
+    case LOG_XFER_READ:
+        log_xfer_start(x, rq, now_us);
+        break;
+    }
+}
+
+// Take in request bytes until one is complete and handled. Bytes that do
+// not start a valid request are skipped one at a time, so the next good
+// request is found whatever came before it.
+static bool log_xfer_take_request(log_xfer_t *x, uint32_t now_us) {
+    while (true) {
+        if (x->req_len < LOG_XFER_REQUEST_SIZE) {
+            x->req_len += (uint8_t)log_xfer_port_read(&x->req[x->req_len], LOG_XFER_REQUEST_SIZE - x->req_len);
+            if (x->req_len < LOG_XFER_REQUEST_SIZE) {
+                return false;
+            }
+        }
+        if (get32(&x->req[RQ_MAGIC]) == LOG_XFER_REQUEST_MAGIC &&
+            get32(&x->req[RQ_CRC]) == crc32(CRC32_INIT, x->req, RQ_CRC)) {
+            x->req_len = 0;
+            log_xfer_request(x, x->req, now_us);
+            return true;
+        }
+        x->stats.bad_requests++;
+        memmove(x->req, &x->req[1], LOG_XFER_REQUEST_SIZE - 1);
+        x->req_len--;
+    }
+}
+
+// The next frame of the transfer under way, if the window allows one
+static bool log_xfer_next_frame(log_xfer_t *x, uint32_t now_us) {
+    if (x->next == x->end) {
+        x->active = false;
+        log_xfer_frame(x, LOG_XFER_END, BLOCK_OK, x->next, 0, 0);
+        return true;
+    }
+    if (x->next - x->acked >= x->window) {
+        if (now_us - x->ack_us > LOG_XFER_TIMEOUT_US) {
+            x->active = false;
+            x->stats.timeouts++;
+        }
+        return false;
+    }
+    int status = x->source.read(x->source.ctx, x->file, x->next, &x->frame[LOG_XFER_HEADER_SIZE]);
+    if (status == BLOCK_RANGE) {
+        x->active = false;
+        log_xfer_frame(x, LOG_XFER_END, BLOCK_RANGE, x->next, 0, 0);
+    } else if (status != BLOCK_OK) {
+        x->active = false;
+        x->stats.read_errors++;
+        log_xfer_frame(x, LOG_XFER_ERROR, status, x->next, 0, 0);
+    } else {
+        log_xfer_frame(x, LOG_XFER_DATA, BLOCK_OK, x->next, 0, LOG_BLOCK_SIZE);
+        x->next++;
+        x->stats.blocks_sent++;
+    }
+    return true;
+}
+
+// Hand as much of the current frame to the port as it takes
+static bool log_xfer_push(log_xfer_t *x) {
+    uint32_t room = log_xfer_port_write_available();
+    uint32_t left = (uint32_t)(x->frame_len - x->frame_sent);
+    if (room == 0) {
+        return false;
+    }
+    uint32_t n = log_xfer_port_write(&x->frame[x->frame_sent], room < left ? room : left);
+    x->frame_sent = (uint16_t)(x->frame_sent + n);
+    x->stats.bytes_sent += n;
+    if (x->frame_sent == x->frame_len) {
+        log_xfer_port_flush();
+    }
+    return n > 0;
+}
+
+// Send what the port takes of the current frame; once it is out, handle
+// requests and make the next frame. Reading a block may take a while on
+// a card, so this makes at most one frame per call. Returns true if it
+// did anything.
+bool log_xfer_poll(log_xfer_t *x, uint32_t now_us) {
+    if (!log_xfer_port_connected()) {
+        x->active = false;
+        x->req_len = 0;
+        x->frame_len = 0;
+        x->frame_sent = 0;
+        return false;
+    }
+    bool busy = false;
+    if (x->frame_sent < x->frame_len) {
+        busy = log_xfer_push(x);
+        if (x->frame_sent < x->frame_len) {
+            return busy;
+        }
+    }
+    // A request that needs a reply fills the frame, so stop there
+    while (x->frame_sent == x->frame_len && log_xfer_take_request(x, now_us)) {
+        busy = true;
+    }
+    if (x->frame_sent == x->frame_len && x->active && log_xfer_next_frame(x, now_us)) {
+        busy = true;
+    }
+    if (x->frame_sent < x->frame_len) {
+        busy |= log_xfer_push(x);
+    }
+    return busy;
+}
+
+#ifndef HOST_TESTING
+// TinyUSB port
+bool log_xfer_port_connected(void) {
+    return tud_cdc_n_connected(USB_ITF_DOWNLOAD);
+}
+
+uint32_t log_xfer_port_read(uint8_t *buf, uint32_t len) {
+    return tud_cdc_n_available(USB_ITF_DOWNLOAD) ? tud_cdc_n_read(USB_ITF_DOWNLOAD, buf, len) : 0;
+}
+
+uint32_t log_xfer_port_write_available(void) {
+    return tud_cdc_n_write_available(USB_ITF_DOWNLOAD);
+}
+
+uint32_t log_xfer_port_write(const uint8_t *data, uint32_t len) {
+    return tud_cdc_n_write(USB_ITF_DOWNLOAD, data, len);
+}
+
+void log_xfer_port_flush(void) {
+    tud_cdc_n_write_flush(USB_ITF_DOWNLOAD);
+}
+#endif
@@ -0,0 +1,121 @@
+#ifndef LOG_XFER_H
+#define LOG_XFER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "block_dev.h"
+#include "block_log.h"
+
+// Bulk download of log blocks on a CDC interface of its own
+// (USB_ITF_DOWNLOAD), far faster than anything printed on the control
+// port. The host sends fixed-size requests and the device answers in
+// frames; both end in a CRC-32 (crc.h) and every field is little-endian.
+//
+// Request, 24 bytes:
+//   0  u32 magic "XREQ"      12  u32 first block (READ) or next block (ACK)
+//   4  u8  op                16  u32 count (READ)
+//   5  u8  window (READ)     20  u32 CRC of bytes 0-19
+//   6  u16 tag
+//   8  u32 file
+//
+// Frame, 24 bytes plus a log block for DATA:
+//   0  u32 magic "XBLK"      12  u32 arg0
+//   4  u8  type              16  u32 arg1
+//   5  i8  status            20  payload, then u32 CRC of all before it
+//   6  u16 tag of the READ it answers
+//   8  u32 file
+//
+// LIST gives the files there are as [arg0, arg1). INFO gives a file's
+// length in blocks as arg0. READ streams blocks [first, first + count)
+// as DATA frames (block number in arg0) and then an END frame (arg0 one
+// past the last block sent; status BLOCK_RANGE if the file ended first).
+// An ERROR frame carries the BLOCK_* status of a failed read. Each
+// request but ACK ends a transfer under way.
+//
+// The device runs at most 'window' blocks ahead of the host's last ACK,
+// so its output stays bounded and a host that has gone quiet stops the
+// transfer after LOG_XFER_TIMEOUT_US. The device keeps nothing about a
+// transfer beyond that: a host that lost a frame, or that was stopped
+// and started again, sends a new READ from the first block it is
+// missing, with a new tag so frames still in flight from the old one
+// are told apart.
+#define LOG_XFER_REQUEST_MAGIC 0x51455258u     // "XREQ"
+#define LOG_XFER_FRAME_MAGIC 0x4B4C4258u       // "XBLK"
+#define LOG_XFER_REQUEST_SIZE 24
+#define LOG_XFER_HEADER_SIZE 20
+#define LOG_XFER_FRAME_MAX (LOG_XFER_HEADER_SIZE + LOG_BLOCK_SIZE + 4)
+#define LOG_XFER_WINDOW_MAX 64
+#define LOG_XFER_TIMEOUT_US 3000000
+
+// Requests
+#define LOG_XFER_LIST 1
+#define LOG_XFER_INFO 2
+#define LOG_XFER_READ 3
+#define LOG_XFER_ACK 4
+#define LOG_XFER_STOP 5
+
+// Frames; LIST and INFO answer the requests of the same number
+#define LOG_XFER_DATA 3
+#define LOG_XFER_END 4
+#define LOG_XFER_ERROR 5
+
+// Where the blocks come from: the card's log files, or the flash ring as
+// one file. Each returns BLOCK_OK or a BLOCK_* error; read returns
+// BLOCK_RANGE past the end of the file.
+typedef struct {
+    int (*range)(void *ctx, uint32_t *first, uint32_t *end);
+    int (*size)(void *ctx, uint32_t file, uint32_t *blocks);
+    int (*read)(void *ctx, uint32_t file, uint32_t block, uint8_t *buf);
+    void *ctx;
+} log_xfer_source_t;
+
+typedef struct {
+    uint32_t requests;
+    uint32_t bad_requests;      // Failed their CRC, or bytes skipped to find one
+    uint32_t transfers;         // READ requests
+    uint32_t restarts;          // READs that replaced a transfer under way
+    uint32_t blocks_sent;
+    uint32_t bytes_sent;
+    uint32_t timeouts;
+    uint32_t read_errors;
+} log_xfer_stats_t;
+
+typedef struct {
+    log_xfer_source_t source;
+    uint8_t req[LOG_XFER_REQUEST_SIZE];
+    uint8_t req_len;
+    uint8_t frame[LOG_XFER_FRAME_MAX];
+    uint16_t frame_len;
+    uint16_t frame_sent;
+    bool active;                // A READ is being answered
+    uint8_t window;
+    uint16_t tag;
+    uint32_t file;
+    uint32_t next;              // Next block to send
+    uint32_t end;
+    uint32_t acked;             // Blocks before this one have reached the host
+    uint32_t ack_us;            // Time of the READ or the last ACK
+    log_xfer_stats_t stats;
+} log_xfer_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void log_xfer_init(log_xfer_t *x, const log_xfer_source_t *source);
+bool log_xfer_poll(log_xfer_t *x, uint32_t now_us);
+
+// Port layer: TinyUSB CDC on the target, provided by the tests on the host
+bool log_xfer_port_connected(void);
+uint32_t log_xfer_port_read(uint8_t *buf, uint32_t len);
+uint32_t log_xfer_port_write_available(void);
+uint32_t log_xfer_port_write(const uint8_t *data, uint32_t len);
+void log_xfer_port_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
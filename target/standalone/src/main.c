@@ -6,7 +6,31 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include "cmps12.h"
+#include "usb_tx.h"
+#include "sample.h"
+#include "change_filter.h"
+#include "window_stats.h"
+#include "sink.h"
+#include "output_sinks.h"
+#include "usb_control.h"
+#include "tusb.h"
+#include "sd_spi.h"
+#include "sd_log.h"
+#include "fatfs_log.h"
+#include "flash_log.h"
+#include "log_xfer.h"
+#include "log_msc.h"
+#include "xip_flash.h"
+#include "hardware/spi.h"
+#include "pico/unique_id.h"
+#include "pico/rand.h"
+#include "acq_core.h"
+#include "rollup.h"
+#include "dht.h"
+#include <stdlib.h>
+#include <string.h>
 
 // I2C Configuration
 #define I2C_PORT i2c0
@@ -21,13 +45,908 @@
 #define I2C_SDA PICO_DEFAULT_I2C_SDA_PIN  // Set to a different SDA pin as needed
 #define I2C_SCL PICO_DEFAULT_I2C_SCL_PIN  // Set to a different SCL pin as needed
 #define TMP117_OFFSET_VALUE -25.0f     // Temperature offset in degrees C (for testing)
-#define TMP117_CONVERSION_DELAY_MS 1000  // Adjust based on conversion cycle time
+#define USB_TX_POLL_US 1000            // How often waiting loops service the outputs
+
+// Optional: Sample fast and print min/max/mean/stddev once per window instead
+// of every sample (takes precedence over REPORT_ON_CHANGE)
+// #define AGGREGATE_WINDOW_MS 1000
+
+// Acquisition period. The TMP117 converts once per second and is read whenever
+// a conversion has finished; the CMPS12 is read every period.
+#ifdef AGGREGATE_WINDOW_MS
+#define ACQUISITION_PERIOD_MS 50       // 20 Hz compass, summarised per window
+#else
+#define ACQUISITION_PERIOD_MS 1500     // One printed sample per period
+#endif
+
+// VEML6075 integration time (VEML6075_IT_50MS to _800MS) and dynamic range.
+// Longer times resolve dimmer light but saturate sooner in sunshine; high
+// dynamic halves the sensitivity. UV is left out if the sensor is missing.
+#define UV_INTEGRATION VEML6075_IT_100MS
+#define UV_HIGH_DYNAMIC false
+
+// ICP10125 measurement mode (ICP10125_MODE_LP to _ULN). The quieter modes
+// average for longer; low noise (23.8 ms) fits well within any period here.
+// Pressure is left out if the sensor is missing.
+#define PRESSURE_MODE ICP10125_MODE_LN
+
+// Optional: DollaTek humidity sensor (DHT22 / AM2302, or DHT11 with
+// DHT_TYPE_11) on one GPIO with a pull-up. A PIO state machine times its
+// pulses, so it is read without turning interrupts off. Left off, the pin
+// is not touched; on with no sensor, it is pulled low every reading.
+// #define HUMIDITY_PIN 15
+#define HUMIDITY_TYPE DHT_TYPE_22
+
+// Optional: Only print channels that moved past their deadband, plus a heartbeat
+// for unchanged ones (deadbands and heartbeat are set in change_filter.h)
+// #define REPORT_ON_CHANGE
+
+// Optional: Compare per-line USB writes with the batched path at startup for this many ms
+// #define USB_TX_BENCHMARK_MS 5000
+
+// Optional: Extra sinks fed from the same records as the USB text output.
+// OUTPUT_USB_BINARY replaces the text on the data port rather than adding
+// to it: frames and lines in one stream could not be told apart.
+// #define OUTPUT_USB_BINARY              // Framed binary samples on the USB CDC port
+// #define OUTPUT_UART                    // Text lines on a UART
+// #define OUTPUT_UART_DMA                // Binary frames on a UART at multi-megabaud, drained by DMA
+#define OUTPUT_UART_ID uart0
+#define OUTPUT_UART_TX_PIN 0
+#define OUTPUT_UART_BAUD 115200
+#define OUTPUT_UART_DMA_BAUD 3000000
+
+#if defined(OUTPUT_UART) && defined(OUTPUT_UART_DMA)
+#error "OUTPUT_UART and OUTPUT_UART_DMA share OUTPUT_UART_ID; enable only one"
+#endif
+
+// Optional: Log binary frames to LOGnnnn.BIN on an SD card. Sampling runs
+// on core 1 from SRAM, so it never waits for the card.
+// #define LOG_TO_SD
+#define SD_SPI_ID spi0
+#define SD_SCK_PIN 18
+#define SD_MOSI_PIN 19
+#define SD_MISO_PIN 16
+#define SD_CS_PIN 17
+
+// Start a new log file at least this often, and retire whole files once
+// everything in them is older than SD_LOG_RETAIN_DAYS (0 keeps them). The
+// log never takes more than SD_LOG_MAX_FILES files of 32 MiB; past that
+// the oldest is reused.
+#define SD_LOG_FILE_HOURS 24
+#define SD_LOG_RETAIN_DAYS 90
+#define SD_LOG_MAX_FILES 64
+
+// Optional: Log the same blocks to the top of the board's flash instead,
+// when LOG_TO_SD is off or no card is found. The flash is a ring: once it
+// is full, each new block replaces the oldest.
+// #define LOG_TO_FLASH
+#define FLASH_LOG_BYTES (PICO_FLASH_SIZE_BYTES / 2)
+
+// Optional: Measure sampling jitter at startup for this many ms with the
+// flash idle, then as long again while core 0 erases and programs the
+// flash log region. The log starts afresh afterwards.
+// #define FLASH_JITTER_BENCHMARK_MS 5000
+#define FLASH_JITTER_PERIOD_US 5000
+
+#if defined(FLASH_JITTER_BENCHMARK_MS) && !defined(LOG_TO_FLASH)
+#error "FLASH_JITTER_BENCHMARK_MS writes the LOG_TO_FLASH region; define LOG_TO_FLASH too"
+#endif
+
+#if defined(LOG_TO_SD) || defined(LOG_TO_FLASH)
+#define LOG_TO_STORAGE
+#endif
+
+// Optional: Compare blocking uart_putc with the DMA UART ring at startup for this many ms
+// #define UART_DMA_BENCHMARK_MS 2000
+
+// Optional: Print per-sink throughput and drop counters this often
+// #define SINK_STATS_INTERVAL_MS 10000
+
+// Optional: Keep recent history in RAM (every sample for the last few
+// minutes, 24 h of minutes, 30 days of hours) for the "history" command.
+// Uses sizeof(rollup_t), about 94 KB.
+// #define ROLLUP_HISTORY
+
+// Sampling on core 1, handing samples to this core
+static acq_core_t acq;
+
+#ifdef HUMIDITY_PIN
+// Read from this core; each reading goes with the next sample
+static dht_t humidity;
+#endif
+
+// Batched output to the data CDC interface
+static usb_tx_t usb_out;
+
+// Commands, replies and printf diagnostics on the control CDC interface
+static usb_control_t control;
+
+#ifdef ROLLUP_HISTORY
+// Recent history, and the reply being sent from it
+static rollup_t rollup;
+static rollup_dump_t history_dump;
+static bool history_sending;
+#endif
+
+// Every record is produced once and fanned out to these sinks
+static sink_hub_t sinks;
+#ifdef OUTPUT_USB_BINARY
+static sink_t usb_binary_sink;
+static usb_sink_ctx_t usb_binary_ctx;
+#else
+static sink_t usb_text_sink;
+static usb_sink_ctx_t usb_text_ctx;
+#endif
+#ifdef OUTPUT_UART
+static sink_t uart_sink;
+static uart_sink_ctx_t uart_sink_ctx;
+#endif
+#if defined(OUTPUT_UART_DMA) || defined(UART_DMA_BENCHMARK_MS)
+UART_DMA_BUFFER(uart_dma_buf, UART_DMA_BUFFER_BITS_DEFAULT);
+static uart_dma_t uart_dma;
+#endif
+#ifdef OUTPUT_UART_DMA
+static sink_t uart_dma_sink;
+static uart_dma_sink_ctx_t uart_dma_sink_ctx;
+#endif
+#ifdef LOG_TO_STORAGE
+// Where the log goes, decided once core 0 has looked for a card
+typedef enum {
+    STORAGE_NONE = 0,
+    STORAGE_SD,
+    STORAGE_FLASH
+} storage_t;
+
+static const char *const storage_names[] = {"storage", "sd", "flash"};
+static storage_t storage;
+static sd_log_t sd_log;
+static uint64_t storage_mount_start_us;
+static sink_t sd_log_sink;
+static sd_log_sink_ctx_t sd_log_sink_ctx;
+#endif
+#ifdef LOG_TO_SD
+static fatfs_log_t sd_file;
+#endif
+#ifdef LOG_TO_FLASH
+static xip_flash_t flash_chip;
+static flash_log_t flash_log;
+#endif
+
+// Log blocks for the host on the download CDC interface
+static log_xfer_t download;
+
+#ifdef USB_MSC_LOG
+// The log as a read-only USB disk
+static log_msc_t log_disk;
+#endif
+
+// Run the USB stack, answer commands and move queued output along
+static void service_usb(void) {
+    tud_task();
+    usb_control_poll(&control, time_us_32());
+    usb_tx_poll(&usb_out, time_us_32());
+#ifdef OUTPUT_UART_DMA
+    uart_dma_poll(&uart_dma);
+#endif
+}
+
+// Append formatted text to a buffer, never overrunning it
+static int append(char *buf, size_t len, int used, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(&buf[used], len - (size_t)used, fmt, args);
+    va_end(args);
+    return (n < 0 || (size_t)(used + n) >= len) ? used : used + n;
+}
+
+// Format a record for the text sinks: the original line layout for full
+// samples, just the reported channels in report-on-change mode, and one
+// summary line per aggregation window
+static int format_record(const record_t *record, char *buf, size_t len) {
+    if (record->kind == RECORD_WINDOW) {
+        return window_stats_format_text(&record->window, buf, len);
+    }
+
+    const sample_t *sample = &record->sample;
+#ifdef REPORT_ON_CHANGE
+    return sample_format_text(sample, sample->valid, buf, len);
+#else
+    int used = 0;
+    buf[0] = '\0';
+
+    if (sample_has(sample, SAMPLE_CH_HEADING)) {
+        int angle16 = sample->value[SAMPLE_CH_HEADING];
+
+        // Calculate angle in degrees with decimal
+        int angle_whole = angle16 / 10;
+        int angle_decimal = angle16 % 10;
+
+        used = append(buf, len, used, "roll: %d    pitch: %d    angle 8: %d    angle 16: %d.%d    ",
+                      (int)sample->value[SAMPLE_CH_ROLL], (int)sample->value[SAMPLE_CH_PITCH],
+                      (int)sample->value[SAMPLE_CH_ANGLE8], angle_whole, angle_decimal);
+
+        // Optional: Apply calibration offset
+        #ifdef CALIBRATION_OFFSET
+        int calibrated = (angle16 - (CALIBRATION_OFFSET * 10) + 3600) % 3600;
+        int cal_whole = calibrated / 10;
+        int cal_decimal = calibrated % 10;
+        used = append(buf, len, used, "calibrated: %d.%d    direction: %s\n",
+                      cal_whole, cal_decimal, cmps12_get_cardinal_direction(cal_whole));
+        #else
+        used = append(buf, len, used, "direction: %s\n", cmps12_get_cardinal_direction(angle_whole));
+        #endif
+    }
+
+    if (sample_has(sample, SAMPLE_CH_TEMP)) {
+        /* 1) Typecast temp_result register to integer, converting from two's complement
+           2) Multiply by 100 to scale the temperature (i.e. 2 decimal places)
+           3) Shift right by 7 to account for the TMP117's 1/128 resolution (Q7 format) */
+        int temp = sample->value[SAMPLE_CH_TEMP] * 100 >> 7;
+
+        // Display the temperature in degrees Celsius, formatted to show two decimal places
+        used = append(buf, len, used, "Temperature: %d.%02d °C\n",
+                      temp / 100, (temp < 0 ? -temp : temp) % 100);
+
+        // Floating point functions are also available for converting to Celsius or Fahrenheit
+        //printf("\nTemperature: %.2f °C\t%.2f °F", read_temp_celsius(), read_temp_fahrenheit());
+    }
+
+    if (sample_has(sample, SAMPLE_CH_UV_INDEX)) {
+        int uv_index = sample->value[SAMPLE_CH_UV_INDEX];
+        used = append(buf, len, used, "UVA: %d    UVB: %d    UV index: %d.%03d\n",
+                      (int)sample->value[SAMPLE_CH_UVA], (int)sample->value[SAMPLE_CH_UVB],
+                      uv_index / 1000, uv_index % 1000);
+    }
+
+    if (sample_has(sample, SAMPLE_CH_PRESSURE)) {
+        // 1/16 Pa to whole pascals, shown as hectopascals; Q7 to hundredths of a degree
+        int pressure = (int)(((int64_t)sample->value[SAMPLE_CH_PRESSURE] + 8) >> 4);
+        int temp = sample->value[SAMPLE_CH_PRESSURE_TEMP] * 100 >> 7;
+        used = append(buf, len, used, "Pressure: %d.%02d hPa    (%d.%02d °C)\n",
+                      pressure / 100, pressure % 100, temp / 100, (temp < 0 ? -temp : temp) % 100);
+    }
+
+    if (sample_has(sample, SAMPLE_CH_HUMIDITY)) {
+        int rh = sample->value[SAMPLE_CH_HUMIDITY];
+        int temp = sample->value[SAMPLE_CH_HUMIDITY_TEMP];
+        int mag = temp < 0 ? -temp : temp;
+        used = append(buf, len, used, "Humidity: %d.%d %%RH    (%s%d.%d °C)\n", rh / 10, rh % 10,
+                      temp < 0 ? "-" : "", mag / 10, mag % 10);
+    }
+    return used;
+#endif
+}
+
+// Attach the configured sinks to the hub
+static void setup_sinks(void) {
+    sink_hub_init(&sinks);
+
+    // One sink per USB stream: the data port carries text or frames
+#ifdef OUTPUT_USB_BINARY
+    sink_usb_binary_init(&usb_binary_sink, &usb_binary_ctx, &usb_out);
+    sink_hub_add(&sinks, &usb_binary_sink);
+#else
+    sink_usb_text_init(&usb_text_sink, &usb_text_ctx, &usb_out, format_record);
+    sink_hub_add(&sinks, &usb_text_sink);
+#endif
+
+#ifdef OUTPUT_UART
+    uart_init(OUTPUT_UART_ID, OUTPUT_UART_BAUD);
+    gpio_set_function(OUTPUT_UART_TX_PIN, GPIO_FUNC_UART);
+    sink_uart_init(&uart_sink, &uart_sink_ctx, OUTPUT_UART_ID, format_record);
+    sink_hub_add(&sinks, &uart_sink);
+#endif
+
+#ifdef LOG_TO_STORAGE
+    // The flash unique ID identifies this unit in its log files
+    pico_unique_board_id_t board;
+    uint64_t device_id = 0;
+    pico_get_unique_board_id(&board);
+    for (int i = 0; i < PICO_UNIQUE_BOARD_ID_SIZE_BYTES; i++) {
+        device_id = device_id << 8 | board.id[i];
+    }
+    // A fresh log ID per boot keeps stale blocks in reused files out of
+    // this log
+    block_log_config_t log_config = {device_id, get_rand_32(), 0, 0, LOG_NO_BLOCK, 0, 0};
+
+    // Storage is mounted by now. If the last log can be continued, carry
+    // on after its last good block, with times following on from its last
+    // sample.
+#ifdef LOG_TO_SD
+    // Files are cut where the storage side starts a new one, or daily
+    if (storage == STORAGE_SD) {
+        log_config.file_blocks = FATFS_LOG_FILE_BYTES / LOG_BLOCK_SIZE;
+        log_config.file_us = SD_LOG_FILE_HOURS * 3600ull * 1000000;
+        if (sd_file.resumed && sd_file.recovered.next_block > 0) {
+            log_config.log_id = sd_file.recovered.log_id;
+            log_config.start_seq = sd_file.recovered.next_block;
+            log_config.prev_index = sd_file.recovered.prev_index;
+            log_config.time_base_us = sd_file.recovered.last_time_us + 1;
+        }
+    }
+#endif
+#ifdef LOG_TO_FLASH
+    // The flash ring is one endless log, carried on across restarts
+    if (storage == STORAGE_FLASH && flash_log.recovered.next_block > 0) {
+        log_config.log_id = flash_log.recovered.log_id;
+        log_config.start_seq = flash_log.recovered.next_block;
+        log_config.prev_index = flash_log.recovered.prev_index;
+        log_config.time_base_us = flash_log.recovered.last_time_us + 1;
+    }
+#endif
+    sink_sd_log_init(&sd_log_sink, &sd_log_sink_ctx, &sd_log, &log_config);
+    sink_hub_add(&sinks, &sd_log_sink);
+#endif
+
+#ifdef OUTPUT_UART_DMA
+    uart_init(OUTPUT_UART_ID, OUTPUT_UART_DMA_BAUD);
+    gpio_set_function(OUTPUT_UART_TX_PIN, GPIO_FUNC_UART);
+    uart_dma_init(&uart_dma, OUTPUT_UART_ID, uart_dma_buf, UART_DMA_BUFFER_BITS_DEFAULT);
+    sink_uart_dma_binary_init(&uart_dma_sink, &uart_dma_sink_ctx, &uart_dma);
+    sink_hub_add(&sinks, &uart_dma_sink);
+#endif
+}
+
+// Print every sink's counters on the control interface, outside the sinks themselves
+static void report_sink_stats(uint64_t elapsed_us) {
+    char line[160];
+    for (uint8_t i = 0; i < sinks.count; i++) {
+        int len = sink_format_stats(sinks.sinks[i], elapsed_us, line, sizeof(line));
+        if (len < 0) {
+            len = 0;
+        }
+        if ((size_t)len >= sizeof(line)) {
+            len = sizeof(line) - 1;
+        }
+        usb_tx_write(&control.tx, line, (size_t)len, time_us_32());
+    }
+}
+
+#ifdef LOG_TO_STORAGE
+// Bring up the card and file, or the flash ring if there is no card.
+// Core 1 is already sampling and keeps its samples until the loop starts.
+static void storage_mount(void) {
+    log_writer_t writer;
+    int status = BLOCK_NO_MEDIA;
+
+    storage_mount_start_us = time_us_64();
+#ifdef LOG_TO_SD
+    static sd_spi_t card;
+    gpio_set_function(SD_SCK_PIN, GPIO_FUNC_SPI);
+    gpio_set_function(SD_MOSI_PIN, GPIO_FUNC_SPI);
+    gpio_set_function(SD_MISO_PIN, GPIO_FUNC_SPI);
+    gpio_pull_up(SD_MISO_PIN);
+    sd_spi_setup(&card, SD_SPI_ID, SD_CS_PIN);
+    fatfs_diskio_attach(0, &card.dev);
+
+    log_segments_config_t segments = {0, SD_LOG_MAX_FILES, LOG_SEGMENTS_SPARES,
+                                      SD_LOG_RETAIN_DAYS * 86400ull * 1000000};
+    FRESULT res = fatfs_log_open(&sd_file, &card.dev, &segments);
+    if (res == FR_OK) {
+        fatfs_log_writer(&sd_file, &writer);
+        storage = STORAGE_SD;
+    } else {
+        status = -(int)res;
+    }
+#endif
+#ifdef LOG_TO_FLASH
+    static uint8_t scratch[LOG_BLOCK_SIZE];
+    if (storage == STORAGE_NONE) {
+        status = xip_flash_setup(&flash_chip, PICO_FLASH_SIZE_BYTES - FLASH_LOG_BYTES, FLASH_LOG_BYTES);
+        if (status == BLOCK_OK) {
+            status = flash_log_init(&flash_log, &flash_chip.dev);
+        }
+        if (status == BLOCK_OK) {
+            status = flash_log_mount(&flash_log, scratch);
+        }
+        if (status == BLOCK_OK) {
+            flash_log_writer(&flash_log, &writer);
+            storage = STORAGE_FLASH;
+        }
+    }
+#endif
+
+    if (storage == STORAGE_NONE) {
+        sd_log.status = status;         // Reported by the "storage" command
+        return;
+    }
+    sd_log_attach(&sd_log, &writer);
+}
+
+// Write a full log buffer, or else erase a flash sector ahead or look
+// after the card's log files. Any of these may block this core for tens
+// of milliseconds, so the loop calls it once per pass. Returns true if
+// there was anything to do.
+static bool storage_service(void) {
+    if (storage == STORAGE_NONE) {
+        return false;
+    }
+    if (sd_log_service(&sd_log)) {
+        return true;
+    }
+#ifdef LOG_TO_SD
+    if (storage == STORAGE_SD && fatfs_log_service(&sd_file) > 0) {
+        return true;
+    }
+#endif
+#ifdef LOG_TO_FLASH
+    if (storage == STORAGE_FLASH && flash_log_service(&flash_log)) {
+        return true;
+    }
+#endif
+    return false;
+}
+#endif
+
+// What the download interface and the USB disk offer: the card's log
+// files as numbered, or the flash ring as file 0, laid out like a dump of
+// the region (ring sectors, then the FILE sector) for log_export
+static int download_range(void *ctx, uint32_t *first, uint32_t *end) {
+    (void)ctx;
+    *first = 0;
+    *end = 0;
+#ifdef LOG_TO_SD
+    if (storage == STORAGE_SD) {
+        *first = sd_file.segs.oldest;
+        *end = sd_file.segs.next;
+    }
+#endif
+#ifdef LOG_TO_FLASH
+    if (storage == STORAGE_FLASH) {
+        *end = 1;
+    }
+#endif
+    return BLOCK_OK;
+}
+
+static int download_size(void *ctx, uint32_t file, uint32_t *blocks) {
+    uint32_t first, end;
+    download_range(ctx, &first, &end);
+    if (file < first || file >= end) {
+        return BLOCK_RANGE;
+    }
+#ifdef LOG_TO_SD
+    if (storage == STORAGE_SD) {
+        // The file being written ends at the last block sent to the card
+        *blocks = file + 1 == end ? sd_file.ckpt.current.next_block : sd_file.segs.config.file_blocks;
+    }
+#endif
+#ifdef LOG_TO_FLASH
+    if (storage == STORAGE_FLASH) {
+        *blocks = flash_log.ring_sectors + 1;
+    }
+#endif
+    (void)blocks;
+    return BLOCK_OK;
+}
+
+// Card files are read by sector from where their segment starts, which is
+// looked up once per file. A file retired since then is out of range
+// before its old place is read.
+static int download_read(void *ctx, uint32_t file, uint32_t block, uint8_t *buf) {
+    uint32_t blocks;
+    int status = download_size(ctx, file, &blocks);
+    if (status != BLOCK_OK) {
+        return status;
+    }
+    if (block >= blocks) {
+        return BLOCK_RANGE;
+    }
+#ifdef LOG_TO_SD
+    static uint32_t located_file = UINT32_MAX;
+    static uint32_t located_lba;
+    if (storage == STORAGE_SD) {
+        if (file != located_file) {
+            const log_segment_ops_t *ops = &sd_file.segs.ops;
+            status = ops->locate(ops->ctx, file, &located_lba);
+            if (status != BLOCK_OK) {
+                return status;
+            }
+            located_file = file;
+        }
+        return block_dev_read(sd_file.dev, located_lba + block * LOG_SECTORS_PER_BLOCK, buf, LOG_SECTORS_PER_BLOCK);
+    }
+#endif
+#ifdef LOG_TO_FLASH
+    if (storage == STORAGE_FLASH) {
+        return flash_dev_read(flash_log.dev, block * FLASH_DEV_SECTOR_SIZE, buf, LOG_BLOCK_SIZE);
+    }
+#endif
+    (void)buf;
+    return BLOCK_RANGE;
+}
+
+#ifdef USB_MSC_LOG
+// The disk is read from inside tud_task, wherever that is called, so it
+// stands aside while the log has a full buffer to write
+static int disk_read(void *ctx, uint32_t file, uint32_t block, uint8_t *buf) {
+#ifdef LOG_TO_STORAGE
+    if (storage != STORAGE_NONE && sd_log.full[sd_log.drain]) {
+        return BLOCK_BUSY;
+    }
+#endif
+    return download_read(ctx, file, block, buf);
+}
+#endif
+
+// Control commands
+static void command_help(usb_control_t *ctl, const char *args) {
+    (void)args;
+    usb_control_help(ctl);
+}
+
+static void command_stats(usb_control_t *ctl, const char *args) {
+    (void)ctl;
+    (void)args;
+    report_sink_stats(time_us_64());
+}
+
+static void command_usb(usb_control_t *ctl, const char *args) {
+    (void)args;
+    usb_control_printf(ctl, "data: state %d, %lu bytes sent, %lu records dropped\n",
+                       (int)usb_tx_state(&usb_out), (unsigned long)usb_out.stats.bytes_sent,
+                       (unsigned long)usb_out.stats.records_dropped);
+    usb_control_printf(ctl, "control: %lu commands, %lu unknown, %lu stdio bytes dropped\n",
+                       (unsigned long)ctl->commands_run, (unsigned long)ctl->commands_unknown,
+                       (unsigned long)ctl->stdio_dropped);
+    usb_control_printf(ctl, "download: %lu transfers, %lu blocks sent, %lu restarted, %lu timed out, %lu errors\n",
+                       (unsigned long)download.stats.transfers, (unsigned long)download.stats.blocks_sent,
+                       (unsigned long)download.stats.restarts, (unsigned long)download.stats.timeouts,
+                       (unsigned long)(download.stats.read_errors + download.stats.bad_requests));
+#ifdef USB_MSC_LOG
+    usb_control_printf(ctl, "disk: %s, %lu files, %lu KiB read, %lu reads put off, %lu errors\n",
+                       log_disk.loaded ? "loaded" : "ejected", (unsigned long)log_disk.file_count,
+                       (unsigned long)(log_disk.stats.bytes_read / 1024), (unsigned long)log_disk.stats.busy,
+                       (unsigned long)log_disk.stats.read_errors);
+#endif
+}
+
+static void command_acq(usb_control_t *ctl, const char *args) {
+    (void)args;
+    char line[200];
+    jitter_stats_format(&acq.jitter, line, sizeof(line));
+    usb_control_printf(ctl, "acq: %s", line);
+    usb_control_printf(ctl, "acq: every %lu us, %lu waiting, %lu dropped, %lu I2C errors\n",
+                       (unsigned long)acq.period_us, (unsigned long)sample_ring_count(&acq.ring),
+                       (unsigned long)acq.ring.dropped, (unsigned long)acq.i2c_errors);
+    if (acq.uv_present) {
+        const veml6075_stats_t *uv = &acq.uv.stats;
+        usb_control_printf(ctl, "uv: %lu measurements of %lu us, %lu read early, %lu saturated, %lu bus errors\n",
+                           (unsigned long)uv->measurements, (unsigned long)veml6075_integration_us(acq.uv.it),
+                           (unsigned long)uv->early, (unsigned long)uv->saturated,
+                           (unsigned long)uv->bus_errors);
+    }
+    if (acq.pressure_present) {
+        const icp10125_stats_t *pressure = &acq.pressure.stats;
+        usb_control_printf(ctl, "pressure: %lu measurements of %lu us, %lu CRC errors, %lu bus errors\n",
+                           (unsigned long)pressure->measurements, (unsigned long)acq.pressure.conversion_us,
+                           (unsigned long)pressure->crc_errors, (unsigned long)pressure->bus_errors);
+    }
+#ifdef HUMIDITY_PIN
+    const dht_stats_t *rh = &humidity.stats;
+    usb_control_printf(ctl, "humidity: %lu readings, %lu timeouts, %lu bad pulses, %lu checksum errors\n",
+                       (unsigned long)rh->readings, (unsigned long)rh->timeouts,
+                       (unsigned long)rh->pulse_errors, (unsigned long)rh->checksum_errors);
+#endif
+}
+
+#ifdef LOG_TO_STORAGE
+static void command_storage(usb_control_t *ctl, const char *args) {
+    (void)args;
+    const sd_log_stats_t *st = &sd_log.stats;
+    const char *name = storage_names[storage];
+    usb_control_printf(ctl, "%s: %s, status %d, %lu buffers written, %lu errors\n", name,
+                       sd_log.attached ? "logging" : "not ready", sd_log.status,
+                       (unsigned long)st->buffers_written, (unsigned long)st->write_errors);
+    usb_control_printf(ctl, "%s: %lu log blocks, %lu sample bytes (drops are in 'stats' under sd-log)\n", name,
+                       (unsigned long)sd_log_sink_ctx.blocks.blocks_emitted,
+                       (unsigned long)sd_log_sink_ctx.blocks.bytes_logged);
+    usb_control_printf(ctl, "%s: write %lu us last, %lu us max\n", name,
+                       (unsigned long)st->last_write_us, (unsigned long)st->max_write_us);
+#ifdef LOG_TO_SD
+    if (storage == STORAGE_SD) {
+        const log_segments_t *segs = &sd_file.segs;
+        usb_control_printf(ctl, "sd: file LOG%04lu.BIN at sector %lu, %lu started\n",
+                           (unsigned long)(segs->next - 1), (unsigned long)segs->start_lba,
+                           (unsigned long)segs->stats.rotations);
+        usb_control_printf(ctl, "sd: %lu files kept from LOG%04lu.BIN, %lu spare, %lu retired, %lu reused\n",
+                           (unsigned long)(segs->next - segs->oldest), (unsigned long)segs->oldest,
+                           (unsigned long)(segs->spare_end - segs->spare_first), (unsigned long)segs->stats.retired,
+                           (unsigned long)segs->stats.recycled);
+        usb_control_printf(ctl, "sd: %lu files made ahead, %lu while logging waited, %lu errors\n",
+                           (unsigned long)segs->stats.prepared, (unsigned long)segs->stats.inline_creates,
+                           (unsigned long)segs->stats.errors);
+        if (sd_file.resumed) {
+            usb_control_printf(ctl, "sd: resumed at block %lu after reading %lu blocks\n",
+                               (unsigned long)sd_file.recovered.next_block,
+                               (unsigned long)sd_file.recover_blocks_read);
+        }
+    }
+#endif
+#ifdef LOG_TO_FLASH
+    if (storage == STORAGE_FLASH) {
+        const flash_log_stats_t *fs = &flash_log.stats;
+        usb_control_printf(ctl, "flash: %lu KiB ring, next block %lu, %lu laps\n",
+                           (unsigned long)(flash_log.ring_sectors * FLASH_DEV_SECTOR_SIZE / 1024),
+                           (unsigned long)flash_log.next_seq, (unsigned long)fs->laps);
+        usb_control_printf(ctl, "flash: %lu erases, %lu made a write wait, %lu errors\n",
+                           (unsigned long)fs->erases, (unsigned long)fs->erase_stalls,
+                           (unsigned long)(fs->erase_errors + fs->write_errors));
+        usb_control_printf(ctl, "flash: out of XIP mode for %lu ms over %lu operations\n",
+                           (unsigned long)(flash_chip.busy_us / 1000), (unsigned long)flash_chip.ops);
+        if (flash_log.recovered.next_block) {
+            usb_control_printf(ctl, "flash: resumed at block %lu\n",
+                               (unsigned long)flash_log.recovered.next_block);
+        }
+    }
+#endif
+    if (sd_log_sink_ctx.first_sample_us) {
+        usb_control_printf(ctl, "%s: mount to first logged sample %lu us\n", name,
+                           (unsigned long)(sd_log_sink_ctx.first_sample_us - storage_mount_start_us));
+    }
+}
+#endif
+
+#ifdef ROLLUP_HISTORY
+static void command_history(usb_control_t *ctl, const char *args) {
+    char tier[8] = "";
+    size_t len = strcspn(args, " \t");
+    if (len < sizeof(tier)) {
+        memcpy(tier, args, len);
+        tier[len] = '\0';
+    }
+    int t = rollup_parse_tier(tier);
+    if (t < 0) {
+        usb_control_printf(ctl, "history: raw, minute or hour, then an optional count\n");
+        return;
+    }
+    // The lines go out from the main loop as the control buffer drains
+    rollup_dump_start(&rollup, &history_dump, (rollup_tier_t)t, (uint32_t)strtoul(&args[len], NULL, 10));
+    history_sending = true;
+}
+
+// Send what fits of a history reply; true while there is more
+static bool history_service(void) {
+    char line[ROLLUP_LINE_MAX];
+    while (history_sending && usb_tx_free(&control.tx) >= ROLLUP_LINE_MAX) {
+        int n = rollup_dump_line(&rollup, &history_dump, line, sizeof(line));
+        if (n == 0) {
+            history_sending = false;
+        } else {
+            usb_tx_write(&control.tx, line, (size_t)n, time_us_32());
+        }
+    }
+    return history_sending;
+}
+#endif
+
+#ifdef USB_MSC_LOG
+// Load the disk again to show what the log has written since, or eject it
+static void command_disk(usb_control_t *ctl, const char *args) {
+    size_t len = strcspn(args, " \t");
+    if (len == 4 && strncmp(args, "load", len) == 0) {
+        int status = log_msc_load(&log_disk);
+        if (status != BLOCK_OK) {
+            usb_control_printf(ctl, "disk: cannot read the log (%d)\n", status);
+            return;
+        }
+    } else if (len == 5 && strncmp(args, "eject", len) == 0) {
+        log_msc_eject(&log_disk);
+    } else if (len != 0) {
+        usb_control_printf(ctl, "disk: load or eject\n");
+        return;
+    }
+    usb_control_printf(ctl, "disk: %s, %lu files, %lu sectors\n", log_disk.loaded ? "loaded" : "ejected",
+                       (unsigned long)log_disk.file_count, (unsigned long)log_disk.sectors);
+}
+#endif
+
+static const usb_control_command_t commands[] = {
+    {"help", "list commands", command_help},
+    {"stats", "per-sink counters since boot", command_stats},
+    {"usb", "USB interface counters", command_usb},
+    {"acq", "sampling jitter, drops and sensors", command_acq},
+#ifdef LOG_TO_STORAGE
+    {"storage", "SD card or flash log counters", command_storage},
+#endif
+#ifdef ROLLUP_HISTORY
+    {"history", "raw|minute|hour [count]: recent history from RAM", command_history},
+#endif
+#ifdef USB_MSC_LOG
+    {"disk", "[load|eject]: the log as a USB disk", command_disk},
+#endif
+};
+
+#ifdef USB_TX_BENCHMARK_MS
+// Push identical sample lines straight into the control interface's CDC
+// FIFO, one write and flush per line as the SDK's USB stdio does per
+// printf, and then through usb_tx (data interface), for a fixed time each.
+// Report the sustained samples/sec and bytes/sec of both paths. printf is
+// not used for the first: it goes through usb_tx itself now
+// (usb_control_stdio_init).
+static void run_output_benchmark(void) {
+    static const char line[] =
+        "roll: -3    pitch: 12    angle 8: 128    angle 16: 180.4    direction: S\n"
+        "Temperature: 23.42 °C\n";
+    const uint32_t line_len = sizeof(line) - 1;
+
+    // Nothing of the control port's own queued behind the lines
+    usb_tx_flush(&control.tx);
+    while (usb_tx_state(&control.tx) == USB_TX_DRAINING) {
+        service_usb();
+    }
+    uint32_t start = time_us_32();
+    uint32_t samples = 0;
+    while (time_us_32() - start < USB_TX_BENCHMARK_MS * 1000u) {
+        while (tud_cdc_n_write_available(USB_ITF_CONTROL) < line_len) {
+            service_usb();
+        }
+        tud_cdc_n_write(USB_ITF_CONTROL, line, line_len);
+        tud_cdc_n_write_flush(USB_ITF_CONTROL);
+        samples++;
+    }
+    uint32_t line_samples = samples;
+
+    usb_tx_init(&usb_out, NULL);
+    start = time_us_32();
+    while (time_us_32() - start < USB_TX_BENCHMARK_MS * 1000u) {
+        while (!usb_tx_write(&usb_out, line, line_len, time_us_32())) {
+            service_usb();
+        }
+        service_usb();
+    }
+    usb_tx_flush(&usb_out);
+    uint32_t usb_samples = usb_out.stats.records_queued;
+
+    printf("\nper line: %lu samples/s, %lu bytes/s\n",
+           (unsigned long)(line_samples * 1000u / USB_TX_BENCHMARK_MS),
+           (unsigned long)((uint64_t)line_samples * line_len * 1000u / USB_TX_BENCHMARK_MS));
+    printf("usb_tx:   %lu samples/s, %lu bytes/s (%lu size / %lu age flushes)\n\n",
+           (unsigned long)(usb_samples * 1000u / USB_TX_BENCHMARK_MS),
+           (unsigned long)((uint64_t)usb_samples * line_len * 1000u / USB_TX_BENCHMARK_MS),
+           (unsigned long)usb_out.stats.flushes_size,
+           (unsigned long)usb_out.stats.flushes_age);
+}
+#endif
+
+#ifdef UART_DMA_BENCHMARK_MS
+// Send identical sample lines with blocking uart_putc and then through the DMA
+// ring for a fixed time each. Report bytes/sec, and the CPU share the DMA path
+// used: the time spent in its writes and polls, read from the timer around
+// each call. Calls start when the UART frees room, at any phase of the timer
+// tick, so ones shorter than a tick still add up right on average.
+static void run_uart_benchmark(void) {
+    static const char line[] =
+        "roll: -3    pitch: 12    angle 8: 128    angle 16: 180.4    direction: S\n"
+        "Temperature: 23.42 °C\n";
+    const uint32_t line_len = sizeof(line) - 1;
+
+    uint baud = uart_init(OUTPUT_UART_ID, OUTPUT_UART_DMA_BAUD);
+    gpio_set_function(OUTPUT_UART_TX_PIN, GPIO_FUNC_UART);
+
+    uint32_t putc_bytes = 0;
+    uint32_t start = time_us_32();
+    while (time_us_32() - start < UART_DMA_BENCHMARK_MS * 1000u) {
+        for (uint32_t i = 0; i < line_len; i++) {
+            uart_putc_raw(OUTPUT_UART_ID, line[i]);
+        }
+        putc_bytes += line_len;
+    }
+
+    uart_dma_init(&uart_dma, OUTPUT_UART_ID, uart_dma_buf, UART_DMA_BUFFER_BITS_DEFAULT);
+    uint32_t busy_us = 0;
+    start = time_us_32();
+    while (time_us_32() - start < UART_DMA_BENCHMARK_MS * 1000u) {
+        bool room = uart_dma_free(&uart_dma) >= line_len;
+        if (!room && uart_dma.inflight && uart_dma_port_remaining(&uart_dma)) {
+            continue;       // Nothing to do until the transfer ends: free time
+        }
+        uint32_t t0 = time_us_32();
+        if (room) {
+            uart_dma_write(&uart_dma, line, line_len);
+        } else {
+            uart_dma_poll(&uart_dma);
+        }
+        busy_us += time_us_32() - t0;
+    }
+    while (!uart_dma_idle(&uart_dma)) {
+        uart_dma_poll(&uart_dma);
+    }
+
+    uint32_t load_pct = (uint32_t)((uint64_t)busy_us * 100u / (UART_DMA_BENCHMARK_MS * 1000u));
+    printf("\nUART at %u baud (wire limit %u bytes/s)\n", baud, baud / 10);
+    printf("uart_putc: %lu bytes/s, CPU 100%%\n",
+           (unsigned long)((uint64_t)putc_bytes * 1000u / UART_DMA_BENCHMARK_MS));
+    printf("uart_dma:  %lu bytes/s, CPU ~%lu%% (%lu transfers, %lu bytes each)\n\n",
+           (unsigned long)((uint64_t)uart_dma.stats.bytes_sent * 1000u / UART_DMA_BENCHMARK_MS),
+           (unsigned long)load_pct, (unsigned long)uart_dma.stats.transfers,
+           (unsigned long)(uart_dma.stats.transfers ? uart_dma.stats.bytes_sent / uart_dma.stats.transfers : 0));
+}
+#endif
+
+#ifdef FLASH_JITTER_BENCHMARK_MS
+// Throw away samples, keeping USB up
+static void discard_samples_for(uint32_t ms) {
+    sample_t sample;
+    uint32_t start = time_us_32();
+    while (time_us_32() - start < ms * 1000u) {
+        while (sample_ring_pop(&acq.ring, &sample)) {
+        }
+        service_usb();
+    }
+}
+
+// Start the acquisition core's jitter statistics again from its next sample
+static void restart_jitter_stats(void) {
+    acq.reset_jitter = true;
+    while (acq.reset_jitter) {
+        tight_loop_contents();
+    }
+}
+
+// Sample every FLASH_JITTER_PERIOD_US and report how late samples start,
+// first with the flash idle and then while this core erases and programs
+// the flash log region sector after sector. The acquisition core is never
+// paused, so its lateness should not change.
+static void run_flash_jitter_benchmark(void) {
+    static uint8_t page[FLASH_DEV_PAGE_SIZE];
+    char line[200];
+    uint32_t period_us = acq.period_us;
+    acq.period_us = FLASH_JITTER_PERIOD_US;
+
+    restart_jitter_stats();
+    discard_samples_for(FLASH_JITTER_BENCHMARK_MS);
+    jitter_stats_format(&acq.jitter, line, sizeof(line));
+    printf("\nflash idle: %s", line);
+
+    if (xip_flash_setup(&flash_chip, PICO_FLASH_SIZE_BYTES - FLASH_LOG_BYTES, FLASH_LOG_BYTES) != BLOCK_OK) {
+        printf("flash log region overlaps the firmware image\n\n");
+        acq.period_us = period_us;
+        return;
+    }
+    flash_dev_t *dev = &flash_chip.dev;
+    uint32_t offset = 0;
+    sample_t sample;
+    restart_jitter_stats();
+    uint32_t start = time_us_32();
+    while (time_us_32() - start < FLASH_JITTER_BENCHMARK_MS * 1000u) {
+        flash_dev_erase(dev, offset);
+        for (uint32_t p = 0; p < FLASH_DEV_SECTOR_SIZE; p += FLASH_DEV_PAGE_SIZE) {
+            flash_dev_program(dev, offset + p, page, sizeof(page));
+            while (sample_ring_pop(&acq.ring, &sample)) {
+            }
+        }
+        service_usb();
+        // Stay clear of the FILE block in the last sector
+        offset = (offset + FLASH_DEV_SECTOR_SIZE) % (FLASH_LOG_BYTES - FLASH_DEV_SECTOR_SIZE);
+    }
+    jitter_stats_format(&acq.jitter, line, sizeof(line));
+    printf("flash busy: %s", line);
+    printf("flash busy: %lu erases and programs, out of XIP mode %lu ms of %lu\n\n",
+           (unsigned long)flash_chip.ops, (unsigned long)(flash_chip.busy_us / 1000),
+           (unsigned long)FLASH_JITTER_BENCHMARK_MS);
+
+    // The ring now holds zeroed sectors; make the log start afresh
+    flash_dev_erase(dev, FLASH_LOG_BYTES - FLASH_DEV_SECTOR_SIZE);
+    acq.period_us = period_us;
+}
+#endif
 
 int main(void) {
     // Initialize chosen interface
     stdio_init_all();
-    // A little delay to ensure serial line stability
-    sleep_ms(SERIAL_INIT_DELAY_MS);
+
+    // Composite USB device: data and control CDC interfaces, printf on control
+    tusb_init();
+    usb_control_init(&control, commands, sizeof(commands) / sizeof(commands[0]));
+    usb_control_stdio_init(&control);
+
+    // A little delay to ensure serial line stability (and let the host enumerate)
+    uint32_t settle_until_us = time_us_32() + SERIAL_INIT_DELAY_MS * 1000u;
+    while ((int32_t)(settle_until_us - time_us_32()) > 0) {
+        service_usb();
+        sleep_us(USB_TX_POLL_US);
+    }
 
     // Uncomment below to set I2C address other than 0x48 (e.g., 0x49)
     //tmp117_set_address(0x49);
@@ -58,55 +977,146 @@ int main(void) {
     if (!cmps12_init(&compass, I2C_PORT)) {
         printf("Failed to initialize CMPS12!\n");
         while (1) {
-            tight_loop_contents();
+            service_usb();      // Keep the port up so the message is seen
         }
     }
     printf("CMPS12 initialized successfully!\n\n");
 
+#ifdef USB_TX_BENCHMARK_MS
+    run_output_benchmark();
+#endif
+#ifdef UART_DMA_BENCHMARK_MS
+    run_uart_benchmark();
+#endif
+
+    // From here on core 1 owns the I2C bus and samples on its own
+    acq_core_init(&acq, I2C_PORT, tmp117_get_address(), ACQUISITION_PERIOD_MS * 1000u);
+    if (acq_core_add_uv(&acq, UV_INTEGRATION, UV_HIGH_DYNAMIC)) {
+        printf("VEML6075 initialized, %lu ms integration\n\n",
+               (unsigned long)(veml6075_integration_us(UV_INTEGRATION) / 1000));
+    } else {
+        printf("No VEML6075 found; sampling without UV\n\n");
+    }
+    if (acq_core_add_pressure(&acq, PRESSURE_MODE)) {
+        printf("ICP10125 initialized, %lu us conversions\n\n",
+               (unsigned long)icp10125_conversion_us(PRESSURE_MODE));
+    } else {
+        printf("No ICP10125 found; sampling without pressure\n\n");
+    }
+    acq_core_launch(&acq);
+#ifdef HUMIDITY_PIN
+    dht_init(&humidity, HUMIDITY_TYPE, pio0, HUMIDITY_PIN);
+#endif
+#ifdef FLASH_JITTER_BENCHMARK_MS
+    run_flash_jitter_benchmark();
+#endif
+
+    // Sample lines are batched and submitted to TinyUSB in large writes
+    usb_tx_init(&usb_out, NULL);
+#ifdef LOG_TO_STORAGE
+    sd_log_init(&sd_log);
+    storage_mount();
+#endif
+    setup_sinks();
+#ifdef ROLLUP_HISTORY
+    rollup_init(&rollup);
+#endif
+    log_xfer_source_t download_source = {download_range, download_size, download_read, NULL};
+    log_xfer_init(&download, &download_source);
+#ifdef USB_MSC_LOG
+    // The disk's volume serial number is the board's, so hosts know it again
+    pico_unique_board_id_t board_id;
+    uint32_t volume_id = 0;
+    pico_get_unique_board_id(&board_id);
+    for (int i = 0; i < PICO_UNIQUE_BOARD_ID_SIZE_BYTES; i++) {
+        volume_id = volume_id << 8 | board_id.id[i];
+    }
+    log_xfer_source_t disk_source = {download_range, download_size, disk_read, NULL};
+    log_msc_init(&log_disk, &disk_source, volume_id);
+    log_msc_load(&log_disk);
+#endif
+
+    // Each sample from core 1 becomes a record for the sinks
+    sample_t sample;
+    record_t record;
+#if defined(AGGREGATE_WINDOW_MS)
+    window_stats_t window;
+    window_stats_init(&window, time_us_64());
+#elif defined(REPORT_ON_CHANGE)
+    change_filter_t filter;
+    change_filter_init(&filter);
+#endif
+#ifdef SINK_STATS_INTERVAL_MS
+    uint64_t stats_start_us = time_us_64();
+    uint64_t stats_next_us = stats_start_us + SINK_STATS_INTERVAL_MS * 1000ull;
+#endif
+
     while (1) {
-        // Read compass data
-        if (cmps12_read(&compass)) {
-            // Calculate angle in degrees with decimal
-            int angle_whole = compass.angle16 / 10;
-            int angle_decimal = compass.angle16 % 10;
-            
-            // Print all data
-            printf("roll: %d    ", compass.roll);
-            printf("pitch: %d    ", compass.pitch);
-            printf("angle 8: %d    ", compass.angle8);
-            printf("angle 16: %d.%d    ", angle_whole, angle_decimal);
-            
-            // Optional: Apply calibration offset
-            #ifdef CALIBRATION_OFFSET
-            int calibrated = (compass.angle16 - (CALIBRATION_OFFSET * 10) + 3600) % 3600;
-            int cal_whole = calibrated / 10;
-            int cal_decimal = calibrated % 10;
-            printf("calibrated: %d.%d    ", cal_whole, cal_decimal);
-            printf("direction: %s\n", cmps12_get_cardinal_direction(cal_whole));
-            #else
-            printf("direction: %s\n", cmps12_get_cardinal_direction(angle_whole));
-            #endif
-        } else {
-            printf("Failed to read from CMPS12\n");
-        }
-        
+        while (sample_ring_pop(&acq.ring, &sample)) {
+            acq_core_convert(&acq, &sample);
+#ifdef HUMIDITY_PIN
+            const dht_reading_t *reading = dht_take(&humidity);
+            if (reading) {
+                sample_set(&sample, SAMPLE_CH_HUMIDITY, reading->humidity);
+                sample_set(&sample, SAMPLE_CH_HUMIDITY_TEMP, reading->temperature);
+            }
+#endif
+            if (!sample_has(&sample, SAMPLE_CH_HEADING)) {
+                printf("Failed to read from CMPS12\n");
+            }
+#ifdef ROLLUP_HISTORY
+            rollup_add(&rollup, &sample);
+#endif
 
-        do {
-            sleep_ms(TMP117_CONVERSION_DELAY_MS);
-        } while (!data_ready()); // Check if the data ready flag is high
+#if defined(AGGREGATE_WINDOW_MS)
+            // Fold every sample into the window; publish one summary per window
+            window_stats_add(&window, &sample);
+            if (window_stats_due(&window, sample.time_us, AGGREGATE_WINDOW_MS)) {
+                record.kind = RECORD_WINDOW;
+                window_stats_take(&window, &record.window, sample.time_us);
+                sink_hub_publish(&sinks, &record, time_us_64());
+            }
+#else
+            record.kind = RECORD_SAMPLE;
+            record.sample = sample;
+#ifdef REPORT_ON_CHANGE
+            // Only the channels that moved (or are due a heartbeat) are published
+            record.sample.valid = change_filter_apply(&filter, &sample);
+            if (record.sample.valid)
+#endif
+            sink_hub_publish(&sinks, &record, time_us_64());
+#endif
+        }
 
-        /* 1) Typecast temp_result register to integer, converting from two's complement
-           2) Multiply by 100 to scale the temperature (i.e. 2 decimal places)
-           3) Shift right by 7 to account for the TMP117's 1/128 resolution (Q7 format) */
-        int temp = read_temp_raw() * 100 >> 7;
-        
-        // Display the temperature in degrees Celsius, formatted to show two decimal places
-        printf("Temperature: %d.%02d °C\n", temp / 100, (temp < 0 ? -temp : temp) % 100);
+#ifdef SINK_STATS_INTERVAL_MS
+        if (time_us_64() >= stats_next_us) {
+            report_sink_stats(time_us_64() - stats_start_us);
+            stats_next_us += SINK_STATS_INTERVAL_MS * 1000ull;
+        }
+#endif
 
-        // Floating point functions are also available for converting to Celsius or Fahrenheit
-        //printf("\nTemperature: %.2f °C\t%.2f °F", read_temp_celsius(), read_temp_fahrenheit());
+#ifdef HUMIDITY_PIN
+        dht_poll(&humidity, time_us_32());
+#endif
 
-        sleep_ms(500);
+        // Keep the outputs moving, then give the log its turn
+        sink_hub_service(&sinks, time_us_64());
+        service_usb();
+#ifdef ROLLUP_HISTORY
+        if (history_service()) {
+            continue;
+        }
+#endif
+#ifdef LOG_TO_STORAGE
+        if (storage_service()) {
+            continue;
+        }
+#endif
+        // A download only has the card when the log does not need it
+        if (log_xfer_poll(&download, time_us_32())) {
+            continue;
+        }
+        sleep_us(USB_TX_POLL_US);
     }
 
     return 0;
@@ -0,0 +1,237 @@
+#include "output_sinks.h"
+#include "crc.h"
+
+#include <string.h>
+
+// Wrap a payload in a sync/type/length/CRC frame; returns the frame length
+size_t output_frame(uint8_t type, const uint8_t *payload, size_t payload_len, uint8_t *buf, size_t len) {
+    if (payload_len > 0xFF || len < payload_len + 6) {
+        return 0;
+    }
+
+    buf[0] = OUTPUT_FRAME_SYNC0;
+    buf[1] = OUTPUT_FRAME_SYNC1;
+    buf[2] = type;
+    buf[3] = (uint8_t)payload_len;
+    memmove(&buf[4], payload, payload_len);
+
+    uint16_t crc = crc16_ccitt(CRC16_INIT, &buf[2], payload_len + 2);
+    buf[4 + payload_len] = (uint8_t)crc;
+    buf[5 + payload_len] = (uint8_t)(crc >> 8);
+    return payload_len + 6;
+}
+
+// Frame a packed sample
+size_t output_frame_sample(const sample_t *sample, uint8_t *buf, size_t len) {
+    uint8_t payload[SAMPLE_PACKED_MAX];
+    size_t payload_len = sample_pack(sample, payload, sizeof(payload));
+    return output_frame(OUTPUT_FRAME_SAMPLE, payload, payload_len, buf, len);
+}
+
+// Queue bytes on the USB stream, or report busy so the record stays queued
+static int usb_sink_put(usb_tx_t *usb, const void *data, size_t len, uint64_t now_us) {
+    if (usb_tx_free(usb) < len) {
+        usb_tx_poll(usb, (uint32_t)now_us);
+        return SINK_BUSY;
+    }
+    return usb_tx_write(usb, data, len, (uint32_t)now_us) ? (int)len : SINK_BUSY;
+}
+
+// Human-readable lines on the USB CDC port
+static int usb_text_write(sink_t *sink, const record_t *record, uint64_t now_us) {
+    usb_sink_ctx_t *ctx = (usb_sink_ctx_t *)sink->ctx;
+    char text[OUTPUT_TEXT_MAX];
+
+    int len = ctx->format(record, text, sizeof(text));
+    if (len <= 0) {
+        return 0;
+    }
+    return usb_sink_put(ctx->usb, text, (size_t)len, now_us);
+}
+
+// Frame a sample as a delta record. 'codec' is a scratch copy of the
+// stream state; the caller keeps it only if the frame was accepted, so a
+// busy port does not advance the stream.
+static size_t delta_frame(delta_codec_t *codec, uint8_t seq, const sample_t *sample, uint8_t *frame) {
+    uint8_t payload[1 + DELTA_RECORD_MAX];
+    payload[0] = seq;
+    size_t payload_len = 1 + delta_encode(codec, sample, &payload[1], sizeof(payload) - 1);
+    return output_frame(OUTPUT_FRAME_DELTA, payload, payload_len, frame, OUTPUT_FRAME_MAX);
+}
+
+// Delta-coded binary samples on the USB CDC port, one record per frame
+static int usb_binary_write(sink_t *sink, const record_t *record, uint64_t now_us) {
+    usb_sink_ctx_t *ctx = (usb_sink_ctx_t *)sink->ctx;
+    uint8_t frame[OUTPUT_FRAME_MAX];
+
+    if (record->kind != RECORD_SAMPLE) {
+        return 0;
+    }
+
+    delta_codec_t codec = ctx->codec;
+    size_t len = delta_frame(&codec, ctx->seq, &record->sample, frame);
+
+    int written = usb_sink_put(ctx->usb, frame, len, now_us);
+    if (written != SINK_BUSY) {
+        ctx->codec = codec;
+        ctx->seq++;
+    }
+    return written;
+}
+
+// Human-readable lines into the DMA UART ring
+static int uart_dma_text_write(sink_t *sink, const record_t *record, uint64_t now_us) {
+    uart_dma_sink_ctx_t *ctx = (uart_dma_sink_ctx_t *)sink->ctx;
+    char text[OUTPUT_TEXT_MAX];
+    (void)now_us;
+
+    int len = ctx->format(record, text, sizeof(text));
+    if (len <= 0) {
+        return 0;
+    }
+    if (uart_dma_free(ctx->dma) < (size_t)len) {
+        uart_dma_poll(ctx->dma);
+        return SINK_BUSY;
+    }
+    uart_dma_write(ctx->dma, text, (size_t)len);
+    return len;
+}
+
+// Delta-coded binary frames into the DMA UART ring
+static int uart_dma_binary_write(sink_t *sink, const record_t *record, uint64_t now_us) {
+    uart_dma_sink_ctx_t *ctx = (uart_dma_sink_ctx_t *)sink->ctx;
+    uint8_t frame[OUTPUT_FRAME_MAX];
+    (void)now_us;
+
+    if (record->kind != RECORD_SAMPLE) {
+        return 0;
+    }
+
+    delta_codec_t codec = ctx->codec;
+    size_t len = delta_frame(&codec, ctx->seq, &record->sample, frame);
+    if (uart_dma_free(ctx->dma) < len) {
+        uart_dma_poll(ctx->dma);
+        return SINK_BUSY;
+    }
+    uart_dma_write(ctx->dma, frame, len);
+    ctx->codec = codec;
+    ctx->seq++;
+    return (int)len;
+}
+
+// Human-readable lines on a UART, fed to the FIFO without blocking
+static int uart_write(sink_t *sink, const record_t *record, uint64_t now_us) {
+    uart_sink_ctx_t *ctx = (uart_sink_ctx_t *)sink->ctx;
+    (void)now_us;
+
+    if (ctx->pending_len == 0) {
+        int len = ctx->format(record, ctx->pending, sizeof(ctx->pending));
+        if (len <= 0) {
+            return 0;
+        }
+        ctx->pending_len = (uint16_t)len;
+        ctx->pending_pos = 0;
+    }
+
+    ctx->pending_pos += (uint16_t)uart_sink_port_write(ctx->uart,
+                                                       (const uint8_t *)&ctx->pending[ctx->pending_pos],
+                                                       ctx->pending_len - ctx->pending_pos);
+    if (ctx->pending_pos < ctx->pending_len) {
+        return SINK_BUSY;
+    }
+
+    int written = ctx->pending_len;
+    ctx->pending_len = 0;
+    return written;
+}
+
+// Text sink on the batched USB stream; drops rather than stalling acquisition
+void sink_usb_text_init(sink_t *sink, usb_sink_ctx_t *ctx, usb_tx_t *usb, record_format_fn format) {
+    ctx->usb = usb;
+    ctx->format = format;
+    sink_init(sink, "usb-text", usb_text_write, ctx, SINK_POLICY_DROP);
+}
+
+// Binary sink on the batched USB stream; thins out samples when backlogged.
+// It must be the stream's only sink: a text sink on the same stream would
+// put lines between its frames.
+void sink_usb_binary_init(sink_t *sink, usb_sink_ctx_t *ctx, usb_tx_t *usb) {
+    ctx->usb = usb;
+    ctx->format = NULL;
+    ctx->seq = 0;
+    delta_codec_init(&ctx->codec, DELTA_KEYFRAME_INTERVAL);
+    sink_init(sink, "usb-binary", usb_binary_write, ctx, SINK_POLICY_DOWNSAMPLE);
+}
+
+// Text sink on a UART; the UART must already be initialized
+void sink_uart_init(sink_t *sink, uart_sink_ctx_t *ctx, uart_inst_t *uart, record_format_fn format) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->uart = uart;
+    ctx->format = format;
+    sink_init(sink, "uart", uart_write, ctx, SINK_POLICY_DOWNSAMPLE);
+}
+
+_Static_assert(SD_LOG_BUFFER_SIZE % LOG_BLOCK_SIZE == 0, "log blocks must not straddle SD log buffers");
+
+// Hand a finished log block to the SD log, if a buffer is free
+static bool sd_log_emit(void *ctx, const uint8_t *block) {
+    sd_log_t *log = (sd_log_t *)ctx;
+    if (sd_log_free(log) < LOG_BLOCK_SIZE) {
+        return false;
+    }
+    return sd_log_append(log, block, LOG_BLOCK_SIZE);
+}
+
+// Samples into log blocks bound for the SD card. Never waits for the card:
+// while a finished block has nowhere to go the record is busy.
+static int sd_log_write(sink_t *sink, const record_t *record, uint64_t now_us) {
+    sd_log_sink_ctx_t *ctx = (sd_log_sink_ctx_t *)sink->ctx;
+
+    if (record->kind != RECORD_SAMPLE) {
+        return 0;
+    }
+
+    uint32_t before = ctx->blocks.bytes_logged;
+    if (block_log_add(&ctx->blocks, &record->sample) != LOG_OK) {
+        return SINK_BUSY;
+    }
+    if (!ctx->first_sample_us) {
+        ctx->first_sample_us = now_us;
+    }
+    return (int)(ctx->blocks.bytes_logged - before);
+}
+
+// Text sink on a DMA UART ring; thins out samples when backlogged
+void sink_uart_dma_text_init(sink_t *sink, uart_dma_sink_ctx_t *ctx, uart_dma_t *dma, record_format_fn format) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->dma = dma;
+    ctx->format = format;
+    sink_init(sink, "uart-dma-text", uart_dma_text_write, ctx, SINK_POLICY_DOWNSAMPLE);
+}
+
+// Binary sink on a DMA UART ring; thins out samples when backlogged
+void sink_uart_dma_binary_init(sink_t *sink, uart_dma_sink_ctx_t *ctx, uart_dma_t *dma) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->dma = dma;
+    delta_codec_init(&ctx->codec, DELTA_KEYFRAME_INTERVAL);
+    sink_init(sink, "uart-dma-binary", uart_dma_binary_write, ctx, SINK_POLICY_DOWNSAMPLE);
+}
+
+// SD card log sink; drops rather than stalling acquisition when the card is slow
+void sink_sd_log_init(sink_t *sink, sd_log_sink_ctx_t *ctx, sd_log_t *log, const block_log_config_t *config) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->log = log;
+    block_log_init(&ctx->blocks, config, sd_log_emit, log);
+    sink_init(sink, "sd-log", sd_log_write, ctx, SINK_POLICY_DROP);
+}
+
+#ifndef HOST_TESTING
+// Write only what fits in the TX FIFO right now
+size_t uart_sink_port_write(uart_inst_t *uart, const uint8_t *data, size_t len) {
+    size_t n = 0;
+    while (n < len && uart_is_writable(uart)) {
+        uart_get_hw(uart)->dr = data[n++];
+    }
+    return n;
+}
+#endif
@@ -0,0 +1,84 @@
+#ifndef OUTPUT_SINKS_H
+#define OUTPUT_SINKS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sink.h"
+#include "usb_tx.h"
+#include "delta_codec.h"
+#include "uart_dma.h"
+#include "sd_log.h"
+#include "block_log.h"
+
+// Longest text a sink formats for one record
+#define OUTPUT_TEXT_MAX 512
+
+// Binary frame: sync (2), type (1), payload length (1), payload, CRC-16 (2)
+#define OUTPUT_FRAME_SYNC0 0xA5
+#define OUTPUT_FRAME_SYNC1 0x5A
+#define OUTPUT_FRAME_SAMPLE 0x01    // Payload: packed sample
+#define OUTPUT_FRAME_DELTA 0x02     // Payload: sequence number, delta-coded record
+#define OUTPUT_FRAME_PAYLOAD_MAX (SAMPLE_PACKED_MAX > 1 + DELTA_RECORD_MAX ? \
+                                  SAMPLE_PACKED_MAX : 1 + DELTA_RECORD_MAX)
+#define OUTPUT_FRAME_MAX (4 + OUTPUT_FRAME_PAYLOAD_MAX + 2)
+
+// Turns a record into text; returns the length, 0 to skip the record
+typedef int (*record_format_fn)(const record_t *record, char *buf, size_t len);
+
+// Context for sinks writing to a batched USB CDC stream
+typedef struct {
+    usb_tx_t *usb;
+    record_format_fn format;    // Text sinks only
+    delta_codec_t codec;        // Binary sinks only
+    uint8_t seq;                // Binary frame sequence, lets the host spot gaps
+} usb_sink_ctx_t;
+
+// Context for the UART text sink; a record is formatted once and then fed
+// to the TX FIFO as space allows
+typedef struct {
+    uart_inst_t *uart;
+    record_format_fn format;
+    char pending[OUTPUT_TEXT_MAX];
+    uint16_t pending_len;
+    uint16_t pending_pos;
+} uart_sink_ctx_t;
+
+// Context for sinks writing to a DMA-drained UART ring
+typedef struct {
+    uart_dma_t *dma;
+    record_format_fn format;    // Text sinks only
+    delta_codec_t codec;        // Binary sinks only
+    uint8_t seq;
+} uart_dma_sink_ctx_t;
+
+// Context for the SD card log sink: samples are packed into log blocks
+// (block_log.h), and each finished block fills one SD log buffer
+typedef struct {
+    sd_log_t *log;
+    block_log_t blocks;
+    uint64_t first_sample_us;   // When the first sample was taken in, 0 until then
+} sd_log_sink_ctx_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sink_usb_text_init(sink_t *sink, usb_sink_ctx_t *ctx, usb_tx_t *usb, record_format_fn format);
+void sink_usb_binary_init(sink_t *sink, usb_sink_ctx_t *ctx, usb_tx_t *usb);
+void sink_uart_init(sink_t *sink, uart_sink_ctx_t *ctx, uart_inst_t *uart, record_format_fn format);
+void sink_uart_dma_text_init(sink_t *sink, uart_dma_sink_ctx_t *ctx, uart_dma_t *dma, record_format_fn format);
+void sink_uart_dma_binary_init(sink_t *sink, uart_dma_sink_ctx_t *ctx, uart_dma_t *dma);
+void sink_sd_log_init(sink_t *sink, sd_log_sink_ctx_t *ctx, sd_log_t *log, const block_log_config_t *config);
+size_t output_frame(uint8_t type, const uint8_t *payload, size_t payload_len, uint8_t *buf, size_t len);
+size_t output_frame_sample(const sample_t *sample, uint8_t *buf, size_t len);
+
+// Port layer: non-blocking UART writes, mocked on the host
+size_t uart_sink_port_write(uart_inst_t *uart, const uint8_t *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef RAM_FUNC_H
+#define RAM_FUNC_H
+
+// Put a function in SRAM on the target, for code that has to keep running
+// while the flash is being written. RAM_FUNC(name) goes where the name
+// would in the definition. On the host it does nothing.
+//
+// Such a function must not reach flash any other way either. That rules
+// out calls to functions without RAM_FUNC, const tables, switch
+// statements (their jump tables can land in flash), and struct copies,
+// copy loops, divisions and 64-bit shifts by a variable, which the
+// compiler may turn into library calls.
+#ifdef HOST_TESTING
+#define RAM_FUNC(name) name
+#else
+#include "pico/platform.h"
+#define RAM_FUNC(name) __not_in_flash_func(name)
+#endif
+
+#endif
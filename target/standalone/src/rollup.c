@@ -0,0 +1,252 @@
+#include "rollup.h"
+
+#include <stdio.h>
+#include <string.h>
+
+_Static_assert(sizeof(rollup_point_t) == 12, "rollup_point_t is a packed 12-byte record");
+_Static_assert(sizeof(rollup_bucket_t) == 8 * ROLLUP_CHANNELS, "rollup_bucket_t has no padding");
+
+// The sample channel behind each rollup channel
+static const sample_channel_t rollup_channels[ROLLUP_CHANNELS] = {
+    SAMPLE_CH_TEMP, SAMPLE_CH_HEADING, SAMPLE_CH_PITCH, SAMPLE_CH_ROLL,
+};
+
+static const char *const tier_names[ROLLUP_TIER_COUNT] = {"raw", "minute", "hour"};
+static const char *const channel_names[ROLLUP_CHANNELS] = {"temp", "heading", "pitch", "roll"};
+
+enum { DUMP_HEADER, DUMP_COLUMNS, DUMP_ENTRIES, DUMP_END, DUMP_DONE };
+
+static int16_t clamp16(int32_t v) {
+    return (int16_t)(v < INT16_MIN ? INT16_MIN : v > INT16_MAX ? INT16_MAX : v);
+}
+
+static int8_t clamp8(int32_t v) {
+    return (int8_t)(v < INT8_MIN ? INT8_MIN : v > INT8_MAX ? INT8_MAX : v);
+}
+
+// Q8 mean to the nearest raw unit, kept in range for circular channels
+static int16_t round_mean(int32_t mean_q, int32_t modulus) {
+    int32_t mean = (mean_q + (1 << (WSTAT_FRAC_BITS - 1))) >> WSTAT_FRAC_BITS;
+    if (modulus && mean >= modulus) {
+        mean -= modulus;
+    }
+    return clamp16(mean);
+}
+
+// Pack the statistics of one interval
+static void compact(const window_stats_t *ws, rollup_bucket_t *bucket) {
+    for (int i = 0; i < ROLLUP_CHANNELS; i++) {
+        sample_channel_t ch = rollup_channels[i];
+        wstat_result_t result;
+        wstat_result(&ws->ch[ch], &result);
+        rollup_stat_t *stat = &bucket->ch[i];
+        stat->count = (uint16_t)(result.count > UINT16_MAX ? UINT16_MAX : result.count);
+        stat->mean = round_mean(result.mean_q, sample_channels[ch].modulus);
+        stat->min = clamp16(result.min);
+        stat->max = clamp16(result.max);
+    }
+}
+
+static void level_init(rollup_level_t *level, rollup_bucket_t *buckets, uint32_t slots, uint32_t length_s) {
+    memset(level, 0, sizeof(*level));
+    level->buckets = buckets;
+    level->slots = slots;
+    level->length_s = length_s;
+}
+
+// Close the open interval and clear the slots of any empty ones before
+// interval n, which becomes the open one
+static void level_advance(rollup_level_t *level, uint32_t n, uint64_t time_us) {
+    compact(&level->open, &level->buckets[level->interval % level->slots]);
+    uint32_t closed = n - level->interval;
+    for (uint32_t i = 1; i < closed && i <= level->slots; i++) {
+        memset(&level->buckets[(level->interval + i) % level->slots], 0, sizeof(rollup_bucket_t));
+    }
+    level->held = closed >= level->slots - level->held ? level->slots : level->held + closed;
+    level->interval = n;
+    window_stats_init(&level->open, time_us);
+}
+
+void rollup_init(rollup_t *r) {
+    memset(r, 0, sizeof(*r));
+    level_init(&r->level[0], r->minute, ROLLUP_MINUTE_BUCKETS, 60);
+    level_init(&r->level[1], r->hour, ROLLUP_HOUR_BUCKETS, 3600);
+}
+
+// Store the sample at full rate and fold it into every aggregate tier
+void rollup_add(rollup_t *r, const sample_t *sample) {
+    rollup_point_t *p = &r->raw[r->raw_count % ROLLUP_RAW_POINTS];
+    p->time_ms = (uint32_t)(sample->time_us / 1000u);
+    p->temp = clamp16(sample->value[SAMPLE_CH_TEMP]);
+    p->heading = (uint16_t)clamp16(sample->value[SAMPLE_CH_HEADING]);
+    p->pitch = clamp8(sample->value[SAMPLE_CH_PITCH]);
+    p->roll = clamp8(sample->value[SAMPLE_CH_ROLL]);
+    p->valid = 0;
+    for (int i = 0; i < ROLLUP_CHANNELS; i++) {
+        if (sample_has(sample, rollup_channels[i])) {
+            p->valid |= (uint8_t)(1u << i);
+        }
+    }
+    p->reserved = 0;
+    r->raw_count++;
+    r->last_time_us = sample->time_us;
+
+    for (int t = 0; t < ROLLUP_TIER_COUNT - 1; t++) {
+        rollup_level_t *level = &r->level[t];
+        uint32_t n = (uint32_t)(sample->time_us / (level->length_s * 1000000ull));
+        if (!level->started) {
+            level->started = true;
+            level->interval = n;
+            window_stats_init(&level->open, sample->time_us);
+        } else if (n > level->interval) {
+            level_advance(level, n, sample->time_us);
+        }
+        window_stats_add(&level->open, sample);
+    }
+}
+
+// Entries a tier holds: points, or closed intervals plus the open one
+uint32_t rollup_held(const rollup_t *r, rollup_tier_t tier) {
+    if (tier == ROLLUP_RAW) {
+        return r->raw_count < ROLLUP_RAW_POINTS ? r->raw_count : ROLLUP_RAW_POINTS;
+    }
+    const rollup_level_t *level = &r->level[tier - 1];
+    return level->started ? level->held + 1 : 0;
+}
+
+// Point number 'index' (counted since boot), if it is still held
+bool rollup_point(const rollup_t *r, uint32_t index, rollup_point_t *point) {
+    if (index >= r->raw_count || r->raw_count - index > ROLLUP_RAW_POINTS) {
+        return false;
+    }
+    *point = r->raw[index % ROLLUP_RAW_POINTS];
+    return true;
+}
+
+// Interval 'interval' of an aggregate tier, if it is still held; the open
+// interval is summarised as it stands
+bool rollup_bucket(const rollup_t *r, rollup_tier_t tier, uint32_t interval, rollup_bucket_t *bucket) {
+    if (tier == ROLLUP_RAW) {
+        return false;
+    }
+    const rollup_level_t *level = &r->level[tier - 1];
+    if (!level->started || interval > level->interval || level->interval - interval > level->held) {
+        return false;
+    }
+    if (interval == level->interval) {
+        compact(&level->open, bucket);
+    } else {
+        *bucket = level->buckets[interval % level->slots];
+    }
+    return true;
+}
+
+int rollup_parse_tier(const char *name) {
+    for (int t = 0; t < ROLLUP_TIER_COUNT; t++) {
+        if (strcmp(name, tier_names[t]) == 0) {
+            return t;
+        }
+    }
+    return -1;
+}
+
+// The last 'count' entries of a tier (0 for all it holds)
+void rollup_dump_start(const rollup_t *r, rollup_dump_t *dump, rollup_tier_t tier, uint32_t count) {
+    uint32_t held = rollup_held(r, tier);
+    if (count == 0 || count > held) {
+        count = held;
+    }
+    dump->tier = tier;
+    dump->end = tier == ROLLUP_RAW ? r->raw_count : r->level[tier - 1].interval + (held ? 1 : 0);
+    dump->next = dump->end - count;
+    dump->stage = DUMP_HEADER;
+}
+
+// Oldest entry of the tier still held
+static uint32_t oldest(const rollup_t *r, rollup_tier_t tier) {
+    if (tier == ROLLUP_RAW) {
+        return r->raw_count - rollup_held(r, tier);
+    }
+    const rollup_level_t *level = &r->level[tier - 1];
+    return level->interval - level->held;
+}
+
+static int format_bucket(const rollup_bucket_t *bucket, uint32_t start_s, char *buf, size_t len) {
+    int used = snprintf(buf, len, "%lu", (unsigned long)start_s);
+    for (int i = 0; i < ROLLUP_CHANNELS && used > 0 && (size_t)used < len; i++) {
+        const rollup_stat_t *s = &bucket->ch[i];
+        used += snprintf(&buf[used], len - (size_t)used, ",%u,%d,%d,%d", (unsigned)s->count, s->mean, s->min,
+                         s->max);
+    }
+    if (used > 0 && (size_t)used + 1 < len) {
+        buf[used++] = '\n';
+        buf[used] = '\0';
+    }
+    return (used < 0) ? 0 : ((size_t)used >= len ? (int)len - 1 : used);
+}
+
+// Write the next line of the dump; 0 once it is finished. Intervals with
+// no data at all are left out.
+int rollup_dump_line(const rollup_t *r, rollup_dump_t *dump, char *buf, size_t len) {
+    int n = 0;
+    switch (dump->stage) {
+    case DUMP_HEADER:
+        dump->stage = DUMP_COLUMNS;
+        n = snprintf(buf, len, "history %s: up to %lu entries, newest sample at %lu ms\n", tier_names[dump->tier],
+                     (unsigned long)(dump->end - dump->next), (unsigned long)(r->last_time_us / 1000u));
+        break;
+    case DUMP_COLUMNS:
+        dump->stage = DUMP_ENTRIES;
+        if (dump->tier == ROLLUP_RAW) {
+            n = snprintf(buf, len, "time_ms,valid,temp,heading,pitch,roll\n");
+        } else {
+            n = snprintf(buf, len, "start_s");
+            for (int i = 0; i < ROLLUP_CHANNELS && n > 0 && (size_t)n < len; i++) {
+                const char *c = channel_names[i];
+                n += snprintf(&buf[n], len - (size_t)n, ",%s_n,%s_mean,%s_min,%s_max", c, c, c, c);
+            }
+            if (n > 0 && (size_t)n + 1 < len) {
+                buf[n++] = '\n';
+                buf[n] = '\0';
+            }
+        }
+        break;
+    case DUMP_ENTRIES:
+        if (dump->next < oldest(r, dump->tier)) {
+            dump->next = oldest(r, dump->tier);        // Overwritten meanwhile
+        }
+        while (dump->next < dump->end && n == 0) {
+            uint32_t i = dump->next++;
+            if (dump->tier == ROLLUP_RAW) {
+                rollup_point_t p;
+                if (rollup_point(r, i, &p)) {
+                    n = snprintf(buf, len, "%lu,%u,%d,%u,%d,%d\n", (unsigned long)p.time_ms, (unsigned)p.valid,
+                                 p.temp, (unsigned)p.heading, p.pitch, p.roll);
+                }
+            } else {
+                rollup_bucket_t b;
+                uint32_t total = 0;
+                if (rollup_bucket(r, dump->tier, i, &b)) {
+                    for (int c = 0; c < ROLLUP_CHANNELS; c++) {
+                        total += b.ch[c].count;
+                    }
+                }
+                if (total) {
+                    n = format_bucket(&b, i * r->level[dump->tier - 1].length_s, buf, len);
+                }
+            }
+        }
+        if (n == 0) {
+            dump->stage = DUMP_END;
+            return rollup_dump_line(r, dump, buf, len);
+        }
+        return n;
+    case DUMP_END:
+        dump->stage = DUMP_DONE;
+        n = snprintf(buf, len, "history end\n");
+        break;
+    default:
+        return 0;
+    }
+    return (n < 0) ? 0 : ((size_t)n >= len ? (int)len - 1 : n);
+}
@@ -0,0 +1,109 @@
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sample.h"
+#include "window_stats.h"
+
+// Recent history kept in RAM at three resolutions, round-robin style:
+// every sample at full rate, 1-minute aggregates and 1-hour aggregates.
+// Each tier is a fixed ring, so the memory used is fixed at compile time
+// (about 94 KB with these sizes) and the oldest entries are overwritten.
+#define ROLLUP_RAW_POINTS 2048          // 51 min at a 1.5 s period, 102 s at 20 Hz
+#define ROLLUP_MINUTE_BUCKETS 1440      // 24 hours
+#define ROLLUP_HOUR_BUCKETS 720         // 30 days
+
+// Channels kept, in this order, in every point and bucket:
+// temperature, heading, pitch and roll. The other channels (compass angle,
+// UV, pressure, humidity) are not kept: each would add 8 bytes to every
+// bucket, and their history is in the log.
+#define ROLLUP_CHANNELS 4
+
+typedef enum {
+    ROLLUP_RAW = 0,
+    ROLLUP_MINUTE,
+    ROLLUP_HOUR,
+    ROLLUP_TIER_COUNT
+} rollup_tier_t;
+
+// One sample, packed: 12 bytes instead of sample_t's 64
+typedef struct {
+    uint32_t time_ms;           // Low 32 bits of ms since boot
+    int16_t temp;               // TMP117 raw, 1/128 °C
+    uint16_t heading;           // Tenths of a degree
+    int8_t pitch;               // Degrees
+    int8_t roll;
+    uint8_t valid;              // Bit n set if channel n of the list above was read
+    uint8_t reserved;
+} rollup_point_t;
+
+// One channel over one interval, in the channel's raw units. The mean is
+// rounded to the nearest raw unit; for heading it is a circular mean.
+// A count of 0 means no data.
+typedef struct {
+    int16_t mean;
+    int16_t min;
+    int16_t max;
+    uint16_t count;             // Saturates at 65535
+} rollup_stat_t;
+
+typedef struct {
+    rollup_stat_t ch[ROLLUP_CHANNELS];
+} rollup_bucket_t;
+
+// An aggregate tier: the interval being filled and a ring of closed ones.
+// Interval n covers [n * length, (n + 1) * length) of time since boot and
+// sits in slot n % slots.
+typedef struct {
+    rollup_bucket_t *buckets;
+    uint32_t slots;
+    uint32_t length_s;
+    window_stats_t open;        // The interval being filled
+    uint32_t interval;          // Its number
+    uint32_t held;              // Closed intervals in the ring, up to slots
+    bool started;
+} rollup_level_t;
+
+typedef struct {
+    rollup_point_t raw[ROLLUP_RAW_POINTS];
+    uint32_t raw_count;         // Points added since boot; the newest is raw_count - 1
+    uint64_t last_time_us;      // Time of the newest sample
+    rollup_bucket_t minute[ROLLUP_MINUTE_BUCKETS];
+    rollup_bucket_t hour[ROLLUP_HOUR_BUCKETS];
+    rollup_level_t level[ROLLUP_TIER_COUNT - 1];
+} rollup_t;
+
+// Reads a tier out one text line at a time, so a reply of any size can
+// be paced to the space in the transmit buffer. Entries overwritten while
+// the dump is under way are skipped.
+typedef struct {
+    rollup_tier_t tier;
+    uint32_t next;              // Raw point or interval number to send next
+    uint32_t end;               // One past the last one
+    uint8_t stage;              // Header, entries, end line, done
+} rollup_dump_t;
+
+// Longest line rollup_dump_line writes
+#define ROLLUP_LINE_MAX 192
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void rollup_init(rollup_t *r);
+void rollup_add(rollup_t *r, const sample_t *sample);
+uint32_t rollup_held(const rollup_t *r, rollup_tier_t tier);
+bool rollup_point(const rollup_t *r, uint32_t index, rollup_point_t *point);
+bool rollup_bucket(const rollup_t *r, rollup_tier_t tier, uint32_t interval, rollup_bucket_t *bucket);
+int rollup_parse_tier(const char *name);
+void rollup_dump_start(const rollup_t *r, rollup_dump_t *dump, rollup_tier_t tier, uint32_t count);
+int rollup_dump_line(const rollup_t *r, rollup_dump_t *dump, char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
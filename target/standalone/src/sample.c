@@ -0,0 +1,158 @@
+#include "sample.h"
+
+#include <stdio.h>
+#include <string.h>
+
+const sample_channel_info_t sample_channels[SAMPLE_CH_COUNT] = {
+    // Q7 to hundredths of a degree, the same conversion as the main loop
+    [SAMPLE_CH_TEMP]    = {"temperature", " °C", 0, 100, 7, 2},
+    [SAMPLE_CH_HEADING] = {"heading", "", SAMPLE_HEADING_MODULUS, 1, 0, 1},
+    [SAMPLE_CH_ANGLE8]  = {"angle8", "", 256, 1, 0, 0},
+    [SAMPLE_CH_PITCH]   = {"pitch", "", 0, 1, 0, 0},
+    [SAMPLE_CH_ROLL]    = {"roll", "", 0, 1, 0, 0},
+    // Counts depend on the integration time; the index does not
+    [SAMPLE_CH_UVA]      = {"uva", "", 0, 1, 0, 0},
+    [SAMPLE_CH_UVB]      = {"uvb", "", 0, 1, 0, 0},
+    [SAMPLE_CH_UV_INDEX] = {"uv_index", "", 0, 1, 0, 3},
+    [SAMPLE_CH_PRESSURE]      = {"pressure", " Pa", 0, 100, 4, 2},
+    [SAMPLE_CH_PRESSURE_TEMP] = {"pressure_temp", " °C", 0, 100, 7, 2},
+    [SAMPLE_CH_HUMIDITY]      = {"humidity", " %RH", 0, 1, 0, 1},
+    [SAMPLE_CH_HUMIDITY_TEMP] = {"humidity_temp", " °C", 0, 1, 0, 1},
+};
+
+// Start a new, empty sample
+void sample_clear(sample_t *sample, uint64_t time_us) {
+    memset(sample, 0, sizeof(*sample));
+    sample->time_us = time_us;
+}
+
+// Store a channel value and mark it present
+void sample_set(sample_t *sample, sample_channel_t ch, int32_t value) {
+    sample->value[ch] = value;
+    sample->valid |= 1u << ch;
+}
+
+// Check whether a channel is present
+bool sample_has(const sample_t *sample, sample_channel_t ch) {
+    return (sample->valid & (1u << ch)) != 0;
+}
+
+// Format a raw value with 'frac_bits' extra fractional bits (0 for plain
+// readings, more for averages) in the channel's engineering units
+int sample_format_value(sample_channel_t ch, int64_t raw, unsigned frac_bits, char *buf, size_t len) {
+    const sample_channel_info_t *info = &sample_channels[ch];
+    int64_t value = (raw * info->scale_mul) >> (info->scale_shift + frac_bits);
+    const char *sign = value < 0 ? "-" : "";
+    uint64_t mag = (uint64_t)(value < 0 ? -value : value);
+
+    if (info->decimals == 0) {
+        return snprintf(buf, len, "%s%lu", sign, (unsigned long)mag);
+    }
+
+    uint32_t div = 1;
+    for (int i = 0; i < info->decimals; i++) {
+        div *= 10;
+    }
+    return snprintf(buf, len, "%s%lu.%0*lu", sign, (unsigned long)(mag / div),
+                    (int)info->decimals, (unsigned long)(mag % div));
+}
+
+// Format one channel in engineering units, e.g. "heading: 180.4"
+int sample_format_channel(sample_channel_t ch, int32_t value, char *buf, size_t len) {
+    char text[24];
+    sample_format_value(ch, value, 0, text, sizeof(text));
+    return snprintf(buf, len, "%s: %s%s", sample_channels[ch].name, text, sample_channels[ch].unit);
+}
+
+// Format the channels in 'mask' that are present as one text line.
+// Returns the line length, or 0 if nothing was selected.
+int sample_format_text(const sample_t *sample, uint32_t mask, char *buf, size_t len) {
+    size_t used = 0;
+
+    if (len == 0) {
+        return 0;
+    }
+    buf[0] = '\0';
+
+    for (int ch = 0; ch < SAMPLE_CH_COUNT; ch++) {
+        if (!(mask & sample->valid & (1u << ch))) {
+            continue;
+        }
+        if (used > 0 && used + 4 < len) {
+            memcpy(&buf[used], "    ", 4);
+            used += 4;
+        }
+        int n = sample_format_channel((sample_channel_t)ch, sample->value[ch], &buf[used], len - used);
+        if (n < 0 || used + (size_t)n >= len) {
+            return (int)strlen(buf);
+        }
+        used += (size_t)n;
+    }
+
+    if (used == 0) {
+        return 0;
+    }
+    if (used + 1 < len) {
+        buf[used++] = '\n';
+        buf[used] = '\0';
+    }
+    return (int)used;
+}
+
+// Pack a sample little-endian: time_us (8), valid mask (4), then one int32 per
+// present channel in channel order. Returns the packed length, 0 if it won't fit.
+size_t sample_pack(const sample_t *sample, uint8_t *buf, size_t len) {
+    size_t used = 0;
+
+    if (len < SAMPLE_PACKED_MAX) {
+        return 0;
+    }
+    for (int i = 0; i < 8; i++) {
+        buf[used++] = (uint8_t)(sample->time_us >> (8 * i));
+    }
+    for (int i = 0; i < 4; i++) {
+        buf[used++] = (uint8_t)(sample->valid >> (8 * i));
+    }
+    for (int ch = 0; ch < SAMPLE_CH_COUNT; ch++) {
+        if (sample_has(sample, (sample_channel_t)ch)) {
+            uint32_t v = (uint32_t)sample->value[ch];
+            for (int i = 0; i < 4; i++) {
+                buf[used++] = (uint8_t)(v >> (8 * i));
+            }
+        }
+    }
+    return used;
+}
+
+// Reverse of sample_pack; returns false if the buffer is short or malformed
+bool sample_unpack(sample_t *sample, const uint8_t *buf, size_t len) {
+    size_t used = 12;
+
+    if (len < used) {
+        return false;
+    }
+    memset(sample, 0, sizeof(*sample));
+    for (int i = 0; i < 8; i++) {
+        sample->time_us |= (uint64_t)buf[i] << (8 * i);
+    }
+    for (int i = 0; i < 4; i++) {
+        sample->valid |= (uint32_t)buf[8 + i] << (8 * i);
+    }
+    if (sample->valid >> SAMPLE_CH_COUNT) {
+        return false;
+    }
+    for (int ch = 0; ch < SAMPLE_CH_COUNT; ch++) {
+        if (!sample_has(sample, (sample_channel_t)ch)) {
+            continue;
+        }
+        if (used + 4 > len) {
+            return false;
+        }
+        uint32_t v = 0;
+        for (int i = 0; i < 4; i++) {
+            v |= (uint32_t)buf[used++] << (8 * i);
+        }
+        sample->value[ch] = (int32_t)v;
+    }
+    return used == len;
+}
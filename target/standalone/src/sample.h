@@ -0,0 +1,69 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Measurement channels carried in a sample record
+typedef enum {
+    SAMPLE_CH_TEMP = 0,     // TMP117 temperature result, Q7 (1/128 °C)
+    SAMPLE_CH_HEADING,      // CMPS12 angle16, tenths of a degree (0-3599)
+    SAMPLE_CH_ANGLE8,       // CMPS12 angle8, 0-255 for a full circle
+    SAMPLE_CH_PITCH,        // CMPS12 pitch, degrees
+    SAMPLE_CH_ROLL,         // CMPS12 roll, degrees
+    SAMPLE_CH_UVA,          // VEML6075 compensated UVA, counts
+    SAMPLE_CH_UVB,          // VEML6075 compensated UVB, counts
+    SAMPLE_CH_UV_INDEX,     // UV index from the VEML6075, thousandths
+    SAMPLE_CH_PRESSURE,     // ICP10125 pressure, 1/16 Pa
+    SAMPLE_CH_PRESSURE_TEMP,    // ICP10125 temperature, Q7 (1/128 °C)
+    SAMPLE_CH_HUMIDITY,     // DHT relative humidity, tenths of a percent
+    SAMPLE_CH_HUMIDITY_TEMP,    // DHT temperature, tenths of a degree
+    SAMPLE_CH_COUNT
+} sample_channel_t;
+
+// Heading wraps around at 360.0 degrees
+#define SAMPLE_HEADING_MODULUS 3600
+
+// One acquisition cycle; only channels flagged in 'valid' hold data
+typedef struct {
+    uint64_t time_us;
+    uint32_t valid;
+    int32_t value[SAMPLE_CH_COUNT];
+} sample_t;
+
+// Largest packed sample: time, valid mask and every channel
+#define SAMPLE_PACKED_MAX (8 + 4 + 4 * SAMPLE_CH_COUNT)
+
+// Static description of a channel. Engineering units are
+// (raw * scale_mul) >> scale_shift, printed with 'decimals' places.
+typedef struct {
+    const char *name;
+    const char *unit;
+    int32_t modulus;        // Wrap-around for circular channels, 0 for linear ones
+    int32_t scale_mul;
+    uint8_t scale_shift;
+    uint8_t decimals;
+} sample_channel_info_t;
+
+extern const sample_channel_info_t sample_channels[SAMPLE_CH_COUNT];
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sample_clear(sample_t *sample, uint64_t time_us);
+void sample_set(sample_t *sample, sample_channel_t ch, int32_t value);
+bool sample_has(const sample_t *sample, sample_channel_t ch);
+int sample_format_value(sample_channel_t ch, int64_t raw, unsigned frac_bits, char *buf, size_t len);
+int sample_format_channel(sample_channel_t ch, int32_t value, char *buf, size_t len);
+int sample_format_text(const sample_t *sample, uint32_t mask, char *buf, size_t len);
+size_t sample_pack(const sample_t *sample, uint8_t *buf, size_t len);
+bool sample_unpack(sample_t *sample, const uint8_t *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,52 @@
+#include "sample_ring.h"
+#include "ram_func.h"
+
+#include <string.h>
+
+_Static_assert((SAMPLE_RING_SIZE & (SAMPLE_RING_SIZE - 1)) == 0, "SAMPLE_RING_SIZE must be a power of two");
+
+// A slot is written before the index that hands it over, and read before
+// the index that hands it back
+#define sample_ring_barrier() __sync_synchronize()
+
+void sample_ring_init(sample_ring_t *ring) {
+    memset(ring, 0, sizeof(*ring));
+}
+
+// Producer side. The sample is copied by hand through a volatile pointer,
+// as a struct copy or copy loop may become a call to memcpy in flash.
+bool RAM_FUNC(sample_ring_push)(sample_ring_t *ring, const sample_t *sample) {
+    uint32_t head = ring->head;
+    if (head - ring->tail >= SAMPLE_RING_SIZE) {
+        ring->dropped++;
+        return false;
+    }
+
+    sample_t *slot = &ring->slot[head & (SAMPLE_RING_SIZE - 1)];
+    volatile int32_t *value = slot->value;
+    slot->time_us = sample->time_us;
+    slot->valid = sample->valid;
+    for (int ch = 0; ch < SAMPLE_CH_COUNT; ch++) {
+        value[ch] = sample->value[ch];
+    }
+    sample_ring_barrier();
+    ring->head = head + 1;
+    return true;
+}
+
+// Consumer side: the oldest sample, if there is one
+bool sample_ring_pop(sample_ring_t *ring, sample_t *sample) {
+    uint32_t tail = ring->tail;
+    if (tail == ring->head) {
+        return false;
+    }
+    sample_ring_barrier();
+    *sample = ring->slot[tail & (SAMPLE_RING_SIZE - 1)];
+    sample_ring_barrier();
+    ring->tail = tail + 1;
+    return true;
+}
+
+uint32_t sample_ring_count(const sample_ring_t *ring) {
+    return ring->head - ring->tail;
+}
@@ -0,0 +1,39 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sample.h"
+
+// Samples the ring can hold; a power of two. At the 20 Hz aggregation
+// rate that is over 6 s of samples, enough to ride out the consumer
+// blocking on a card while it starts a new log file.
+#define SAMPLE_RING_SIZE 128
+
+// Samples passed from the acquisition core to the core that publishes
+// them, one producer and one consumer. The producer never waits: a push
+// into a full ring is dropped and counted. Push runs from SRAM, so the
+// producer keeps going while the other core writes flash.
+typedef struct {
+    sample_t slot[SAMPLE_RING_SIZE];
+    volatile uint32_t head;     // Samples pushed; written by the producer only
+    volatile uint32_t tail;     // Samples popped; written by the consumer only
+    volatile uint32_t dropped;  // Pushes that found the ring full
+} sample_ring_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sample_ring_init(sample_ring_t *ring);
+bool sample_ring_push(sample_ring_t *ring, const sample_t *sample);
+bool sample_ring_pop(sample_ring_t *ring, sample_t *sample);
+uint32_t sample_ring_count(const sample_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,177 @@
+#include "sd_log.h"
+
+#ifndef HOST_TESTING
+#include "pico/stdlib.h"
+#endif
+
+#include <string.h>
+
+_Static_assert(SD_LOG_BUFFER_SIZE % BLOCK_SIZE == 0, "log buffers must be whole blocks");
+_Static_assert(SD_LOG_BUFFER_SIZE <= UINT16_MAX, "buffer lengths are 16-bit");
+
+// Order buffer contents before the flag that hands them over (and the
+// flag before reuse). A full barrier on both cores and on the host.
+#define sd_log_barrier() __sync_synchronize()
+
+// Start with every buffer owned by the producer and no writer attached
+void sd_log_init(sd_log_t *log) {
+    memset(log, 0, sizeof(*log));
+}
+
+// Set where buffers go; call from the storage side before servicing
+void sd_log_attach(sd_log_t *log, const log_writer_t *writer) {
+    log->writer = *writer;
+    sd_log_barrier();
+    log->attached = true;
+}
+
+// Give a buffer to the storage side and move on to the next one
+static void sd_log_hand_over(sd_log_t *log, uint8_t i) {
+    sd_log_barrier();
+    log->full[i] = 1;
+    log->fill = (uint8_t)((i + 1) % SD_LOG_BUFFER_COUNT);
+}
+
+// Bytes that can be appended right now without dropping
+size_t sd_log_free(const sd_log_t *log) {
+    size_t free_bytes = 0;
+    uint8_t i = log->fill;
+    for (int n = 0; n < SD_LOG_BUFFER_COUNT && !log->full[i]; n++) {
+        free_bytes += SD_LOG_BUFFER_SIZE - log->len[i];
+        i = (uint8_t)((i + 1) % SD_LOG_BUFFER_COUNT);
+    }
+    return free_bytes;
+}
+
+// Append one record; it may straddle two buffers. Never waits: if the
+// storage side is behind, the record is dropped and counted.
+bool sd_log_append(sd_log_t *log, const void *data, size_t len) {
+    const uint8_t *src = (const uint8_t *)data;
+    uint8_t cur = log->fill;
+
+    if (len == 0) {
+        return true;
+    }
+    size_t room = log->full[cur] ? 0 : SD_LOG_BUFFER_SIZE - log->len[cur];
+    uint8_t next = (uint8_t)((cur + 1) % SD_LOG_BUFFER_COUNT);
+    if (len > SD_LOG_BUFFER_SIZE || (len > room && (room == 0 || log->full[next]))) {
+        log->stats.records_dropped++;
+        log->stats.bytes_dropped += (uint32_t)len;
+        return false;
+    }
+    sd_log_barrier();
+
+    size_t first = len < room ? len : room;
+    memcpy(&log->buf[cur][log->len[cur]], src, first);
+    log->len[cur] = (uint16_t)(log->len[cur] + first);
+    if (log->len[cur] == SD_LOG_BUFFER_SIZE) {
+        sd_log_hand_over(log, cur);
+    }
+    if (first < len) {
+        memcpy(log->buf[next], &src[first], len - first);
+        log->len[next] = (uint16_t)(len - first);
+    }
+
+    log->stats.bytes_logged += (uint32_t)len;
+    log->stats.records_logged++;
+    return true;
+}
+
+// Hand over a partly filled buffer (e.g. before power-down). Later data
+// starts a new buffer, so use sparingly: each flush costs a partial block.
+bool sd_log_flush(sd_log_t *log) {
+    uint8_t cur = log->fill;
+    if (log->full[cur] || log->len[cur] == 0) {
+        return false;
+    }
+    sd_log_hand_over(log, cur);
+    return true;
+}
+
+// Storage side: write the oldest full buffer, if any. Returns 1 if a buffer
+// was written, 0 if there was nothing to do.
+int sd_log_service(sd_log_t *log) {
+    uint8_t i = log->drain;
+    if (!log->attached || !log->full[i]) {
+        return 0;
+    }
+    sd_log_barrier();
+
+    uint32_t start = sd_log_port_time_us();
+    int status = log->writer.write(log->writer.ctx, log->buf[i], log->len[i]);
+    if (status == BLOCK_OK && ++log->since_sync >= SD_LOG_SYNC_BUFFERS) {
+        log->since_sync = 0;
+        log->stats.syncs++;
+        if (log->writer.sync) {
+            status = log->writer.sync(log->writer.ctx);
+        }
+    }
+    uint32_t elapsed = sd_log_port_time_us() - start;
+
+    log->stats.last_write_us = elapsed;
+    if (elapsed > log->stats.max_write_us) {
+        log->stats.max_write_us = elapsed;
+    }
+    if (status == BLOCK_OK) {
+        log->stats.buffers_written++;
+    } else {
+        // The data is lost either way; free the buffer so logging carries on
+        log->stats.write_errors++;
+    }
+    log->status = status;
+
+    log->len[i] = 0;
+    sd_log_barrier();
+    log->full[i] = 0;
+    log->drain = (uint8_t)((i + 1) % SD_LOG_BUFFER_COUNT);
+    return 1;
+}
+
+// A failed write still uses up its blocks, so block positions in the file
+// keep matching the order the buffers were written in
+static int raw_log_write(void *ctx, const uint8_t *data, size_t len) {
+    raw_log_writer_t *raw = (raw_log_writer_t *)ctx;
+    uint32_t blocks = (uint32_t)(len / BLOCK_SIZE);
+    size_t rest = len % BLOCK_SIZE;
+    int status = BLOCK_OK;
+
+    if (raw->next_lba + blocks + (rest ? 1 : 0) > raw->end_lba) {
+        return BLOCK_RANGE;
+    }
+    if (blocks) {
+        status = block_dev_write(raw->dev, raw->next_lba, data, blocks);
+        raw->next_lba += blocks;
+    }
+    if (rest && status == BLOCK_OK) {
+        memcpy(raw->tail, &data[blocks * BLOCK_SIZE], rest);
+        memset(&raw->tail[rest], 0xFF, BLOCK_SIZE - rest);
+        status = block_dev_write(raw->dev, raw->next_lba, raw->tail, 1);
+    }
+    if (rest) {
+        raw->next_lba++;
+    }
+    return status;
+}
+
+static int raw_log_sync(void *ctx) {
+    raw_log_writer_t *raw = (raw_log_writer_t *)ctx;
+    return block_dev_sync(raw->dev);
+}
+
+// Log to blocks [start_lba, start_lba + block_count) of a block device
+void raw_log_writer_init(raw_log_writer_t *raw, block_dev_t *dev, uint32_t start_lba, uint32_t block_count,
+                         log_writer_t *writer) {
+    memset(raw, 0, sizeof(*raw));
+    raw->dev = dev;
+    raw->next_lba = start_lba;
+    raw->end_lba = start_lba + block_count;
+    writer->write = raw_log_write;
+    writer->sync = raw_log_sync;
+    writer->ctx = raw;
+}
+
+#ifndef HOST_TESTING
+uint32_t sd_log_port_time_us(void) {
+    return time_us_32();
+}
+#endif
@@ -0,0 +1,88 @@
+#ifndef SD_LOG_H
+#define SD_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "block_dev.h"
+
+// Each buffer is written in one go as whole 512-byte blocks, so file
+// offsets stay block-aligned and FatFs passes the data straight to the
+// driver (and its DMA) without copying it through the sector cache
+#define SD_LOG_BUFFER_SIZE 4096
+#define SD_LOG_BUFFER_COUNT 2
+
+// Ask the writer to make everything so far durable every this many buffers
+#define SD_LOG_SYNC_BUFFERS 8
+
+// Where full buffers go. Called only from the storage side and allowed to
+// block; returns BLOCK_OK or an error code.
+typedef struct {
+    int (*write)(void *ctx, const uint8_t *data, size_t len);
+    int (*sync)(void *ctx);
+    void *ctx;
+} log_writer_t;
+
+// Counters. The producer updates the first group, the storage side the second.
+typedef struct {
+    uint32_t bytes_logged;
+    uint32_t records_logged;
+    uint32_t bytes_dropped;
+    uint32_t records_dropped;   // No free buffer: storage is behind
+    uint32_t buffers_written;
+    uint32_t write_errors;
+    uint32_t syncs;
+    uint32_t last_write_us;
+    uint32_t max_write_us;
+} sd_log_stats_t;
+
+// Buffers handed between the acquisition side (sd_log_append, never waits)
+// and the storage side (sd_log_service, may block on the card). On the
+// target both run on core 0, but they may also run on different cores:
+// 'full' is the only shared flag and each buffer has exactly one owner at
+// a time.
+typedef struct {
+    uint8_t buf[SD_LOG_BUFFER_COUNT][SD_LOG_BUFFER_SIZE] __attribute__((aligned(4)));
+    volatile uint16_t len[SD_LOG_BUFFER_COUNT];
+    volatile uint8_t full[SD_LOG_BUFFER_COUNT];
+    uint8_t fill;               // Producer's buffer
+    uint8_t drain;              // Storage side's next buffer
+    uint8_t since_sync;
+    log_writer_t writer;
+    volatile bool attached;     // A writer is set; until then full buffers wait
+    volatile int status;        // Last writer result
+    sd_log_stats_t stats;
+} sd_log_t;
+
+// Writes sequential blocks straight to a block device, padding a final
+// partial block with 0xFF
+typedef struct {
+    block_dev_t *dev;
+    uint32_t next_lba;
+    uint32_t end_lba;
+    uint8_t tail[BLOCK_SIZE];
+} raw_log_writer_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sd_log_init(sd_log_t *log);
+void sd_log_attach(sd_log_t *log, const log_writer_t *writer);
+bool sd_log_append(sd_log_t *log, const void *data, size_t len);
+bool sd_log_flush(sd_log_t *log);
+size_t sd_log_free(const sd_log_t *log);
+int sd_log_service(sd_log_t *log);
+
+void raw_log_writer_init(raw_log_writer_t *raw, block_dev_t *dev, uint32_t start_lba, uint32_t block_count,
+                         log_writer_t *writer);
+
+// Port layer: microsecond timer for the write latency counters
+uint32_t sd_log_port_time_us(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,386 @@
+#include "sd_spi.h"
+
+#ifndef HOST_TESTING
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#endif
+
+#include <string.h>
+
+// Commands used in SPI mode
+#define CMD0 0                      // GO_IDLE_STATE
+#define CMD8 8                      // SEND_IF_COND
+#define CMD9 9                      // SEND_CSD
+#define CMD12 12                    // STOP_TRANSMISSION
+#define CMD16 16                    // SET_BLOCKLEN
+#define CMD17 17                    // READ_SINGLE_BLOCK
+#define CMD24 24                    // WRITE_BLOCK
+#define CMD25 25                    // WRITE_MULTIPLE_BLOCK
+#define CMD55 55                    // APP_CMD
+#define CMD58 58                    // READ_OCR
+#define ACMD41 41                   // SD_SEND_OP_COND
+
+#define R1_IDLE 0x01
+#define TOKEN_START 0xFE            // Read data and single-block write
+#define TOKEN_START_MULTI 0xFC
+#define TOKEN_STOP_MULTI 0xFD
+#define DATA_ACCEPTED 0x05
+
+// CRC7 over a command frame; only checked by the card before CRCs are off,
+// but cheap enough to always send
+uint8_t sd_crc7(const uint8_t *data, size_t len) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t byte = data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc <<= 1;
+            if ((byte ^ crc) & 0x80) {
+                crc ^= 0x09;
+            }
+            byte <<= 1;
+        }
+    }
+    return crc & 0x7F;
+}
+
+static uint8_t sd_byte(sd_spi_t *sd) {
+    uint8_t rx;
+    sd_spi_port_xfer(sd, NULL, &rx, 1);
+    return rx;
+}
+
+// Clock until the card releases the busy (low) data line
+static bool sd_wait_ready(sd_spi_t *sd) {
+    for (uint32_t i = 0; i < SD_SPI_READY_BYTES; i++) {
+        if (sd_byte(sd) == 0xFF) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Send a command and return its R1 response (0xFF on timeout).
+// The card stays selected so the caller can read the rest of the response.
+static uint8_t sd_command(sd_spi_t *sd, uint8_t cmd, uint32_t arg) {
+    uint8_t frame[6] = {
+        (uint8_t)(0x40 | cmd), (uint8_t)(arg >> 24), (uint8_t)(arg >> 16), (uint8_t)(arg >> 8), (uint8_t)arg, 0
+    };
+    frame[5] = (uint8_t)(sd_crc7(frame, 5) << 1 | 1);
+
+    sd_spi_port_select(sd, true);
+    if (cmd != CMD0 && !sd_wait_ready(sd)) {
+        return 0xFF;
+    }
+    sd_spi_port_xfer(sd, frame, NULL, sizeof(frame));
+
+    uint8_t r1 = 0xFF;
+    for (int i = 0; i < 10 && (r1 & 0x80); i++) {
+        r1 = sd_byte(sd);
+    }
+    return r1;
+}
+
+static void sd_deselect(sd_spi_t *sd) {
+    sd_spi_port_select(sd, false);
+    sd_byte(sd);                    // Let the card release MISO
+}
+
+static uint8_t sd_app_command(sd_spi_t *sd, uint8_t cmd, uint32_t arg) {
+    sd_command(sd, CMD55, 0);
+    sd_deselect(sd);
+    return sd_command(sd, cmd, arg);
+}
+
+// Capacity in blocks from the CSD register (versions 1 and 2)
+static uint32_t sd_csd_blocks(const uint8_t *csd) {
+    if ((csd[0] >> 6) == 1) {
+        uint32_t c_size = ((uint32_t)(csd[7] & 0x3F) << 16) | ((uint32_t)csd[8] << 8) | csd[9];
+        return (c_size + 1) * 1024u;
+    }
+    uint32_t c_size = ((uint32_t)(csd[6] & 0x03) << 10) | ((uint32_t)csd[7] << 2) | (csd[8] >> 6);
+    uint32_t mult = ((csd[9] & 0x03) << 1) | (csd[10] >> 7);
+    uint32_t read_bl_len = csd[5] & 0x0F;
+    return (c_size + 1) << (mult + 2 + read_bl_len - 9);
+}
+
+// Read one data packet (token, payload, CRC) after a read command
+static bool sd_read_data(sd_spi_t *sd, uint8_t *buf, size_t len) {
+    uint8_t token = 0xFF;
+    for (uint32_t i = 0; i < SD_SPI_TOKEN_BYTES && token == 0xFF; i++) {
+        token = sd_byte(sd);
+    }
+    if (token != TOKEN_START) {
+        return false;
+    }
+    sd_spi_port_xfer(sd, NULL, buf, len);
+    uint8_t crc[2];
+    sd_spi_port_xfer(sd, NULL, crc, sizeof(crc));
+    return true;
+}
+
+// Identification sequence: reset, voltage check, wait for power-up, then
+// learn the addressing mode and capacity and switch to the fast clock
+static int sd_init(block_dev_t *dev) {
+    sd_spi_t *sd = (sd_spi_t *)dev->ctx;
+    uint8_t buf[16];
+
+    sd->phase = SD_WRITE_IDLE;
+    dev->block_count = 0;
+    sd_spi_port_set_baud(sd, SD_SPI_INIT_HZ);
+
+    // At least 74 clocks with CS high
+    sd_spi_port_select(sd, false);
+    memset(buf, 0xFF, 10);
+    sd_spi_port_xfer(sd, buf, NULL, 10);
+
+    uint8_t r1 = 0xFF;
+    for (int i = 0; i < 10 && r1 != R1_IDLE; i++) {
+        r1 = sd_command(sd, CMD0, 0);
+        sd_deselect(sd);
+    }
+    if (r1 != R1_IDLE) {
+        return BLOCK_NO_MEDIA;
+    }
+
+    bool v2 = false;
+    if (sd_command(sd, CMD8, 0x1AA) == R1_IDLE) {
+        sd_spi_port_xfer(sd, NULL, buf, 4);
+        if ((buf[2] & 0x0F) != 0x01 || buf[3] != 0xAA) {
+            sd_deselect(sd);
+            return BLOCK_NO_MEDIA;
+        }
+        v2 = true;
+    }
+    sd_deselect(sd);
+
+    r1 = 0xFF;
+    for (int i = 0; i < SD_SPI_INIT_TRIES && r1 != 0; i++) {
+        r1 = sd_app_command(sd, ACMD41, v2 ? 0x40000000u : 0);
+        sd_deselect(sd);
+        if (r1 != 0) {
+            sd_spi_port_sleep_ms(1);
+        }
+    }
+    if (r1 != 0) {
+        return BLOCK_NO_MEDIA;
+    }
+
+    sd->high_capacity = false;
+    if (v2 && sd_command(sd, CMD58, 0) == 0) {
+        sd_spi_port_xfer(sd, NULL, buf, 4);
+        sd->high_capacity = (buf[0] & 0x40) != 0;
+    }
+    sd_deselect(sd);
+    if (!sd->high_capacity) {
+        sd_command(sd, CMD16, BLOCK_SIZE);
+        sd_deselect(sd);
+    }
+
+    bool csd_ok = sd_command(sd, CMD9, 0) == 0 && sd_read_data(sd, buf, 16);
+    sd_deselect(sd);
+    if (!csd_ok) {
+        return BLOCK_ERROR;
+    }
+    dev->block_count = sd_csd_blocks(buf);
+
+    sd_spi_port_set_baud(sd, SD_SPI_FAST_HZ);
+    return BLOCK_OK;
+}
+
+static uint32_t sd_address(const sd_spi_t *sd, uint32_t lba) {
+    return sd->high_capacity ? lba : lba * BLOCK_SIZE;
+}
+
+// Blocking single-block reads; only FatFs metadata and recovery read
+static int sd_read(block_dev_t *dev, uint32_t lba, uint8_t *buf, uint32_t count) {
+    sd_spi_t *sd = (sd_spi_t *)dev->ctx;
+    if (sd->phase != SD_WRITE_IDLE) {
+        return BLOCK_BUSY;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        bool ok = sd_command(sd, CMD17, sd_address(sd, lba + i)) == 0 &&
+                  sd_read_data(sd, &buf[i * BLOCK_SIZE], BLOCK_SIZE);
+        sd_deselect(sd);
+        if (!ok) {
+            return BLOCK_ERROR;
+        }
+    }
+    return BLOCK_OK;
+}
+
+// Send the data token and hand the next block to the DMA
+static void sd_write_next_block(sd_spi_t *sd) {
+    uint8_t token = sd->write_multi ? TOKEN_START_MULTI : TOKEN_START;
+    sd_spi_port_xfer(sd, &token, NULL, 1);
+    sd_spi_port_dma_start(sd, sd->write_buf, BLOCK_SIZE);
+    sd->phase = SD_WRITE_DMA;
+    sd->busy_polls = 0;
+}
+
+static int sd_write_fail(sd_spi_t *sd) {
+    sd->phase = SD_WRITE_IDLE;
+    sd->write_errors++;
+    sd_deselect(sd);
+    return BLOCK_ERROR;
+}
+
+// Issue the write command and start the first block. Returns as soon as
+// the DMA is running; sd_write_poll() does the rest.
+static int sd_write_start(block_dev_t *dev, uint32_t lba, const uint8_t *buf, uint32_t count) {
+    sd_spi_t *sd = (sd_spi_t *)dev->ctx;
+    if (sd->phase != SD_WRITE_IDLE) {
+        return BLOCK_BUSY;
+    }
+    if (count == 0) {
+        return BLOCK_OK;
+    }
+
+    sd->write_multi = count > 1;
+    if (sd_command(sd, sd->write_multi ? CMD25 : CMD24, sd_address(sd, lba)) != 0) {
+        return sd_write_fail(sd);
+    }
+    sd_byte(sd);                    // One byte gap before the data token
+    sd->write_buf = buf;
+    sd->write_left = count;
+    sd_write_next_block(sd);
+    return BLOCK_OK;
+}
+
+// Advance the write by at most one phase without waiting. Each call costs a
+// few byte times on the bus; the block data itself only ever moves by DMA.
+static int sd_write_poll(block_dev_t *dev) {
+    sd_spi_t *sd = (sd_spi_t *)dev->ctx;
+    uint8_t crc[2] = {0xFF, 0xFF};
+    uint8_t response = 0xFF;
+
+    switch (sd->phase) {
+    case SD_WRITE_IDLE:
+        return BLOCK_OK;
+
+    case SD_WRITE_DMA:
+        if (sd_spi_port_dma_busy(sd)) {
+            return BLOCK_BUSY;
+        }
+        sd_spi_port_xfer(sd, crc, NULL, sizeof(crc));
+        for (int i = 0; i < 8 && response == 0xFF; i++) {
+            response = sd_byte(sd);
+        }
+        if ((response & 0x1F) != DATA_ACCEPTED) {
+            return sd_write_fail(sd);
+        }
+        sd->write_buf += BLOCK_SIZE;
+        sd->write_left--;
+        sd->blocks_written++;
+        sd->phase = SD_WRITE_PROGRAMMING;
+        sd->busy_polls = 0;
+        return BLOCK_BUSY;
+
+    case SD_WRITE_PROGRAMMING:
+        if (sd_byte(sd) != 0xFF) {
+            return ++sd->busy_polls > SD_SPI_READY_BYTES ? sd_write_fail(sd) : BLOCK_BUSY;
+        }
+        if (sd->write_left > 0) {
+            sd_write_next_block(sd);
+            return BLOCK_BUSY;
+        }
+        if (sd->write_multi) {
+            uint8_t stop[2] = {TOKEN_STOP_MULTI, 0xFF};
+            sd_spi_port_xfer(sd, stop, NULL, sizeof(stop));
+            sd->phase = SD_WRITE_STOPPING;
+            sd->busy_polls = 0;
+            return BLOCK_BUSY;
+        }
+        break;
+
+    case SD_WRITE_STOPPING:
+        if (sd_byte(sd) != 0xFF) {
+            return ++sd->busy_polls > SD_SPI_READY_BYTES ? sd_write_fail(sd) : BLOCK_BUSY;
+        }
+        break;
+    }
+
+    sd->phase = SD_WRITE_IDLE;
+    sd_deselect(sd);
+    return BLOCK_OK;
+}
+
+// Writes are complete once polled to BLOCK_OK; the card has no write cache
+static int sd_sync(block_dev_t *dev) {
+    sd_spi_t *sd = (sd_spi_t *)dev->ctx;
+    return sd->phase == SD_WRITE_IDLE ? BLOCK_OK : BLOCK_BUSY;
+}
+
+static const block_dev_ops_t sd_spi_ops = {
+    sd_init, sd_read, sd_write_start, sd_write_poll, sd_sync
+};
+
+// Bind the driver to an SPI instance and chip-select pin; the card is
+// brought up by block_dev_init(&sd->dev)
+void sd_spi_setup(sd_spi_t *sd, spi_inst_t *spi, uint8_t cs_pin) {
+    memset(sd, 0, sizeof(*sd));
+    sd->spi = spi;
+    sd->cs_pin = cs_pin;
+    sd->dev.ops = &sd_spi_ops;
+    sd->dev.ctx = sd;
+    sd_spi_port_init(sd);
+}
+
+#ifndef HOST_TESTING
+// RP2 SPI port. SCK/MOSI/MISO must already be set to GPIO_FUNC_SPI.
+void sd_spi_port_init(sd_spi_t *sd) {
+    spi_init(sd->spi, SD_SPI_INIT_HZ);
+    spi_set_format(sd->spi, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
+    gpio_init(sd->cs_pin);
+    gpio_put(sd->cs_pin, 1);
+    gpio_set_dir(sd->cs_pin, GPIO_OUT);
+
+    // TX-only channel for block data; received bytes are discarded afterwards
+    sd->dma_chan = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config((uint)sd->dma_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, spi_get_dreq(sd->spi, true));
+    dma_channel_configure((uint)sd->dma_chan, &c, &spi_get_hw(sd->spi)->dr, NULL, 0, false);
+}
+
+void sd_spi_port_set_baud(sd_spi_t *sd, uint32_t hz) {
+    spi_set_baudrate(sd->spi, hz);
+}
+
+void sd_spi_port_select(sd_spi_t *sd, bool selected) {
+    gpio_put(sd->cs_pin, !selected);
+}
+
+void sd_spi_port_xfer(sd_spi_t *sd, const uint8_t *tx, uint8_t *rx, size_t len) {
+    if (tx && rx) {
+        spi_write_read_blocking(sd->spi, tx, rx, len);
+    } else if (tx) {
+        spi_write_blocking(sd->spi, tx, len);
+    } else {
+        spi_read_blocking(sd->spi, 0xFF, rx, len);
+    }
+}
+
+void sd_spi_port_dma_start(sd_spi_t *sd, const uint8_t *data, size_t len) {
+    dma_channel_transfer_from_buffer_now((uint)sd->dma_chan, data, len);
+}
+
+// Done once the DMA has emptied and the shifter has finished; then drop
+// the bytes clocked in meanwhile and clear the receive overrun
+bool sd_spi_port_dma_busy(sd_spi_t *sd) {
+    if (dma_channel_is_busy((uint)sd->dma_chan) || spi_is_busy(sd->spi)) {
+        return true;
+    }
+    while (spi_is_readable(sd->spi)) {
+        (void)spi_get_hw(sd->spi)->dr;
+    }
+    spi_get_hw(sd->spi)->icr = SPI_SSPICR_RORIC_BITS;
+    return false;
+}
+
+void sd_spi_port_sleep_ms(uint32_t ms) {
+    sleep_ms(ms);
+}
+#endif
@@ -0,0 +1,72 @@
+#ifndef SD_SPI_H
+#define SD_SPI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "block_dev.h"
+
+#ifndef HOST_TESTING
+#include "hardware/spi.h"
+#else
+typedef struct spi_inst spi_inst_t;
+#endif
+
+// Clock rates: identification must run at 100-400 kHz; SPI mode tops out at 25 MHz
+#define SD_SPI_INIT_HZ 400000
+#define SD_SPI_FAST_HZ 25000000
+
+// Limits, counted in polls/bytes so the driver needs no clock
+#define SD_SPI_INIT_TRIES 1000      // ACMD41 attempts, 1 ms apart
+#define SD_SPI_READY_BYTES 50000    // Bytes to wait for the card to release busy (~16 ms at 25 MHz)
+#define SD_SPI_TOKEN_BYTES 10000    // Bytes to wait for a read data token
+
+// Phases of a multi-block write, advanced by sd_spi_write_poll()
+typedef enum {
+    SD_WRITE_IDLE = 0,
+    SD_WRITE_DMA,               // Block data moving out by DMA
+    SD_WRITE_PROGRAMMING,       // Card busy programming the block
+    SD_WRITE_STOPPING           // Stop token sent; card busy finishing
+} sd_write_phase_t;
+
+// SD card on an SPI bus, usable as a block device
+typedef struct {
+    block_dev_t dev;
+    spi_inst_t *spi;
+    uint8_t cs_pin;
+    int dma_chan;
+    bool high_capacity;         // SDHC/SDXC: block addresses; SDSC: byte addresses
+
+    // Write in progress
+    sd_write_phase_t phase;
+    const uint8_t *write_buf;
+    uint32_t write_left;        // Blocks not yet sent
+    bool write_multi;
+    uint32_t busy_polls;        // Polls spent waiting on the current block
+
+    uint32_t blocks_written;
+    uint32_t write_errors;
+} sd_spi_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sd_spi_setup(sd_spi_t *sd, spi_inst_t *spi, uint8_t cs_pin);
+uint8_t sd_crc7(const uint8_t *data, size_t len);
+
+// Port layer: SPI and DMA on the target, a card emulator in the tests
+void sd_spi_port_init(sd_spi_t *sd);
+void sd_spi_port_set_baud(sd_spi_t *sd, uint32_t hz);
+void sd_spi_port_select(sd_spi_t *sd, bool selected);
+void sd_spi_port_xfer(sd_spi_t *sd, const uint8_t *tx, uint8_t *rx, size_t len);
+void sd_spi_port_dma_start(sd_spi_t *sd, const uint8_t *data, size_t len);
+bool sd_spi_port_dma_busy(sd_spi_t *sd);
+void sd_spi_port_sleep_ms(uint32_t ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,131 @@
+#include "sink.h"
+
+#ifndef HOST_TESTING
+#include "pico/stdlib.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+// Set up a sink with an empty queue
+void sink_init(sink_t *sink, const char *name, sink_write_fn write, void *ctx, sink_policy_t policy) {
+    memset(sink, 0, sizeof(*sink));
+    sink->name = name;
+    sink->write = write;
+    sink->ctx = ctx;
+    sink->policy = policy;
+    sink->downsample = 4;
+    sink->budget = SINK_SERVICE_BUDGET;
+}
+
+// Set up a hub with no sinks
+void sink_hub_init(sink_hub_t *hub) {
+    memset(hub, 0, sizeof(*hub));
+    hub->block_timeout_us = SINK_BLOCK_TIMEOUT_US;
+}
+
+// Attach a sink; returns false when the hub is full
+bool sink_hub_add(sink_hub_t *hub, sink_t *sink) {
+    if (hub->count >= SINK_MAX) {
+        return false;
+    }
+    hub->sinks[hub->count++] = sink;
+    return true;
+}
+
+// Try to deliver the oldest queued record; returns false if the device was busy
+static bool sink_deliver_one(sink_t *sink, uint64_t now_us) {
+    int n = sink->write(sink, &sink->queue[sink->head], now_us);
+    if (n == SINK_BUSY) {
+        sink->stats.busy++;
+        return false;
+    }
+    sink->head = (uint8_t)((sink->head + 1) % SINK_QUEUE_LEN);
+    sink->count--;
+    sink->stats.written++;
+    sink->stats.bytes += (uint32_t)n;
+    return true;
+}
+
+// Wait for room in a BLOCK sink, delivering its records meanwhile
+static void sink_wait_for_room(const sink_hub_t *hub, sink_t *sink) {
+    uint64_t start = sink_port_time_us();
+    uint64_t now = start;
+
+    while (sink->count == SINK_QUEUE_LEN && now - start < hub->block_timeout_us) {
+        sink_deliver_one(sink, now);
+        now = sink_port_time_us();
+    }
+    sink->stats.blocked_us += (uint32_t)(now - start);
+}
+
+// Apply the sink's policy and queue a copy of the record
+static void sink_offer(const sink_hub_t *hub, sink_t *sink, const record_t *record) {
+    sink->stats.published++;
+
+    if (sink->count == SINK_QUEUE_LEN && sink->policy == SINK_POLICY_BLOCK) {
+        sink_wait_for_room(hub, sink);
+    }
+    if (sink->policy == SINK_POLICY_DOWNSAMPLE && sink->count >= SINK_QUEUE_LEN / 2) {
+        if (sink->phase++ % sink->downsample != 0) {
+            sink->stats.skipped++;
+            return;
+        }
+    } else {
+        sink->phase = 0;
+    }
+    if (sink->count == SINK_QUEUE_LEN) {
+        sink->stats.dropped++;
+        return;
+    }
+
+    uint8_t tail = (uint8_t)((sink->head + sink->count) % SINK_QUEUE_LEN);
+    sink->queue[tail] = *record;
+    sink->count++;
+    if (sink->count > sink->stats.high_water) {
+        sink->stats.high_water = sink->count;
+    }
+}
+
+// Fan a record out to every sink. Only BLOCK sinks can make this wait.
+void sink_hub_publish(sink_hub_t *hub, const record_t *record, uint64_t now_us) {
+    for (uint8_t i = 0; i < hub->count; i++) {
+        sink_offer(hub, hub->sinks[i], record);
+    }
+    sink_hub_service(hub, now_us);
+}
+
+// Give every sink a bounded chance to drain its queue. A busy sink simply
+// keeps its backlog; it never delays the sinks after it.
+void sink_hub_service(sink_hub_t *hub, uint64_t now_us) {
+    for (uint8_t i = 0; i < hub->count; i++) {
+        sink_t *sink = hub->sinks[i];
+        for (uint8_t n = 0; n < sink->budget && sink->count > 0; n++) {
+            if (!sink_deliver_one(sink, now_us)) {
+                break;
+            }
+        }
+    }
+}
+
+// Format a sink's counters as one line, with rates over 'elapsed_us'
+int sink_format_stats(const sink_t *sink, uint64_t elapsed_us, char *buf, size_t len) {
+    const sink_stats_t *s = &sink->stats;
+    uint64_t ms = elapsed_us / 1000u;
+    if (ms == 0) {
+        ms = 1;
+    }
+    return snprintf(buf, len, "%s: %lu rec/s %lu B/s written %lu dropped %lu skipped %lu busy %lu "
+                    "blocked %lu us high water %u/%u\n", sink->name,
+                    (unsigned long)((uint64_t)s->written * 1000u / ms),
+                    (unsigned long)((uint64_t)s->bytes * 1000u / ms),
+                    (unsigned long)s->written, (unsigned long)s->dropped,
+                    (unsigned long)s->skipped, (unsigned long)s->busy,
+                    (unsigned long)s->blocked_us, (unsigned)s->high_water, (unsigned)SINK_QUEUE_LEN);
+}
+
+#ifndef HOST_TESTING
+uint64_t sink_port_time_us(void) {
+    return time_us_64();
+}
+#endif
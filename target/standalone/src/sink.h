@@ -0,0 +1,102 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sample.h"
+#include "window_stats.h"
+
+// Maximum number of sinks attached to a hub
+#define SINK_MAX 6
+// Records buffered per sink
+#define SINK_QUEUE_LEN 16
+// Records a sink may deliver per service call, so one sink cannot hog the loop
+#define SINK_SERVICE_BUDGET 4
+// Longest a BLOCK sink may hold up the producer
+#define SINK_BLOCK_TIMEOUT_US 20000
+
+// Returned by a sink's write function when the device cannot take the record yet
+#define SINK_BUSY (-1)
+
+// What happens when a sink's queue is full
+typedef enum {
+    SINK_POLICY_DROP = 0,       // Drop the new record
+    SINK_POLICY_BLOCK,          // Producer waits (up to the block timeout) for room
+    SINK_POLICY_DOWNSAMPLE      // Keep 1 in N records once half full, drop when full
+} sink_policy_t;
+
+// Kinds of record produced by the acquisition loop
+typedef enum {
+    RECORD_SAMPLE = 0,          // One acquisition cycle
+    RECORD_WINDOW               // Statistics over an aggregation window
+} record_kind_t;
+
+// Record fanned out to every sink
+typedef struct {
+    record_kind_t kind;
+    union {
+        sample_t sample;
+        window_record_t window;
+    };
+} record_t;
+
+// Per-sink throughput and drop counters
+typedef struct {
+    uint32_t published;         // Records offered to the sink
+    uint32_t written;           // Records delivered
+    uint32_t bytes;             // Bytes delivered
+    uint32_t dropped;           // Records lost to a full queue
+    uint32_t skipped;           // Records thinned out by downsampling
+    uint32_t busy;              // Deliveries deferred because the device was busy
+    uint32_t blocked_us;        // Time the producer spent waiting on this sink
+    uint16_t high_water;        // Deepest the queue has been
+} sink_stats_t;
+
+typedef struct sink sink_t;
+
+// Deliver one record. Returns the bytes written, or SINK_BUSY to retry later.
+typedef int (*sink_write_fn)(sink_t *sink, const record_t *record, uint64_t now_us);
+
+// One output with its own bounded queue and policy
+struct sink {
+    const char *name;
+    sink_write_fn write;
+    void *ctx;
+    sink_policy_t policy;
+    uint8_t downsample;         // Keep 1 in this many records when backlogged
+    uint8_t budget;             // Records delivered per service call
+    uint8_t head;
+    uint8_t count;
+    uint32_t phase;             // Downsampling counter
+    sink_stats_t stats;
+    record_t queue[SINK_QUEUE_LEN];
+};
+
+// Fan-out point between the acquisition loop and the sinks
+typedef struct {
+    sink_t *sinks[SINK_MAX];
+    uint8_t count;
+    uint32_t block_timeout_us;
+} sink_hub_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sink_init(sink_t *sink, const char *name, sink_write_fn write, void *ctx, sink_policy_t policy);
+void sink_hub_init(sink_hub_t *hub);
+bool sink_hub_add(sink_hub_t *hub, sink_t *sink);
+void sink_hub_publish(sink_hub_t *hub, const record_t *record, uint64_t now_us);
+void sink_hub_service(sink_hub_t *hub, uint64_t now_us);
+int sink_format_stats(const sink_t *sink, uint64_t elapsed_us, char *buf, size_t len);
+
+// Port layer: monotonic time for BLOCK waits, mocked on the host
+uint64_t sink_port_time_us(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -15,6 +15,7 @@ extern "C" {
 #endif
 
 
+uint8_t tmp117_get_address(void);
 void check_i2c(unsigned int frequency);
 void check_status(unsigned int frequency);
 void soft_reset(void);
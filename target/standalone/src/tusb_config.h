@@ -0,0 +1,37 @@
+#ifndef TUSB_CONFIG_H
+#define TUSB_CONFIG_H
+
+// TinyUSB configuration for the composite device described in
+// usb_descriptors.c. CFG_TUSB_MCU and CFG_TUSB_OS come from the Pico SDK.
+
+#ifndef CFG_TUSB_RHPORT0_MODE
+#define CFG_TUSB_RHPORT0_MODE OPT_MODE_DEVICE
+#endif
+
+#define CFG_TUD_ENABLED 1
+#define CFG_TUD_ENDPOINT0_SIZE 64
+
+// Define USB_MSC_LOG to add a read-only USB disk holding the log files
+// (log_msc.h) to the three serial ports. main.c sees it through tusb.h.
+// #define USB_MSC_LOG
+
+// Three CDC-ACM functions: data stream, control/logging and log download.
+// TinyUSB gives each one its own FIFOs of the sizes below.
+#define CFG_TUD_CDC 3
+#ifdef USB_MSC_LOG
+#define CFG_TUD_MSC 1
+#else
+#define CFG_TUD_MSC 0
+#endif
+#define CFG_TUD_HID 0
+#define CFG_TUD_MIDI 0
+#define CFG_TUD_VENDOR 0
+
+#define CFG_TUD_CDC_RX_BUFSIZE 256
+#define CFG_TUD_CDC_TX_BUFSIZE 1024
+#define CFG_TUD_CDC_EP_BUFSIZE 64
+
+// One log block per MSC read callback, read straight into this buffer
+#define CFG_TUD_MSC_EP_BUFSIZE 4096
+
+#endif
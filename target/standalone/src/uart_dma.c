@@ -0,0 +1,105 @@
+#include "uart_dma.h"
+
+#ifndef HOST_TESTING
+#include "hardware/dma.h"
+#endif
+
+#include <string.h>
+
+// Set up an empty ring and claim a DMA channel for it. 'buf' holds
+// 1 << size_bits bytes and is aligned to its size; the UART must already
+// be initialized.
+void uart_dma_init(uart_dma_t *u, uart_inst_t *uart, uint8_t *buf, uint8_t size_bits) {
+    memset(u, 0, sizeof(*u));
+    u->uart = uart;
+    u->buf = buf;
+    u->mask = (1u << size_bits) - 1;
+    u->chan = uart_dma_port_init(u, size_bits);
+}
+
+// Bytes that can be queued right now
+size_t uart_dma_free(const uart_dma_t *u) {
+    return u->mask + 1 - (u->head - u->tail);
+}
+
+// Nothing queued and nothing on its way to the UART
+bool uart_dma_idle(const uart_dma_t *u) {
+    return u->head == u->tail;
+}
+
+// Account for what the running transfer has sent and, once it is done,
+// start one transfer for everything queued since. Never blocks.
+void uart_dma_poll(uart_dma_t *u) {
+    if (u->inflight) {
+        uint32_t remaining = uart_dma_port_remaining(u);
+        uint32_t done = u->inflight - remaining;
+        u->tail += done;
+        u->inflight = remaining;
+        u->stats.bytes_sent += done;
+        if (remaining) {
+            return;
+        }
+    }
+
+    uint32_t queued = u->head - u->tail;
+    if (queued) {
+        // The read address wraps at the end of the ring by itself
+        uart_dma_port_start(u, &u->buf[u->tail & u->mask], queued);
+        u->inflight = queued;
+        u->stats.transfers++;
+    }
+}
+
+// Queue one record; records are never split. Returns false (and counts a
+// drop) when the ring has no room for it.
+bool uart_dma_write(uart_dma_t *u, const void *data, size_t len) {
+    if (len == 0) {
+        return true;
+    }
+    if (uart_dma_free(u) < len) {
+        uart_dma_poll(u);
+        if (uart_dma_free(u) < len) {
+            u->stats.records_dropped++;
+            u->stats.bytes_dropped += (uint32_t)len;
+            return false;
+        }
+    }
+
+    uint32_t pos = u->head & u->mask;
+    size_t first = u->mask + 1 - pos;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(&u->buf[pos], data, first);
+    memcpy(u->buf, (const uint8_t *)data + first, len - first);
+    u->head += (uint32_t)len;
+    u->stats.bytes_queued += (uint32_t)len;
+    u->stats.records_queued++;
+
+    uart_dma_poll(u);
+    return true;
+}
+
+#ifndef HOST_TESTING
+// One channel: byte reads from the ring (wrapping), writes to the UART data
+// register, paced by the UART's TX DREQ
+int uart_dma_port_init(uart_dma_t *u, uint8_t size_bits) {
+    int chan = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config((uint)chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_ring(&c, false, size_bits);
+    channel_config_set_dreq(&c, uart_get_dreq_num(u->uart, true));
+    dma_channel_configure((uint)chan, &c, &uart_get_hw(u->uart)->dr, u->buf, 0, false);
+    return chan;
+}
+
+void uart_dma_port_start(uart_dma_t *u, const uint8_t *from, uint32_t count) {
+    dma_channel_transfer_from_buffer_now((uint)u->chan, from, count);
+}
+
+uint32_t uart_dma_port_remaining(const uart_dma_t *u) {
+    return dma_channel_hw_addr((uint)u->chan)->transfer_count;
+}
+#endif
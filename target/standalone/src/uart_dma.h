@@ -0,0 +1,65 @@
+#ifndef UART_DMA_H
+#define UART_DMA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef HOST_TESTING
+#include "hardware/uart.h"
+#else
+typedef struct uart_inst uart_inst_t;
+#endif
+
+// Ring size as a power of two. The DMA read address wraps in hardware, so
+// the buffer must be aligned to its size (see UART_DMA_BUFFER).
+#define UART_DMA_BUFFER_BITS_DEFAULT 12     // 4 KB: ~13 ms at 3 Mbaud
+
+// Declare a ring buffer with the alignment the DMA ring mode needs
+#define UART_DMA_BUFFER(name, bits) static uint8_t name[1u << (bits)] __attribute__((aligned(1u << (bits))))
+
+// Throughput and drop counters
+typedef struct {
+    uint32_t bytes_queued;
+    uint32_t bytes_sent;        // Bytes the DMA has moved into the UART FIFO
+    uint32_t bytes_dropped;
+    uint32_t records_queued;
+    uint32_t records_dropped;
+    uint32_t transfers;         // DMA transfers started; bytes_sent / transfers is the batch size
+} uart_dma_stats_t;
+
+// Ring buffer drained by one DMA channel paced by the UART TX DREQ. The
+// CPU only copies records in and starts a transfer for everything queued
+// once the previous one has finished.
+typedef struct {
+    uart_inst_t *uart;
+    uint8_t *buf;
+    uint32_t mask;              // Ring size - 1
+    uint32_t head;              // Bytes ever queued (free-running)
+    uint32_t tail;              // Bytes ever sent (free-running)
+    uint32_t inflight;          // Bytes of the current transfer not yet sent
+    int chan;                   // DMA channel
+    uart_dma_stats_t stats;
+} uart_dma_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void uart_dma_init(uart_dma_t *u, uart_inst_t *uart, uint8_t *buf, uint8_t size_bits);
+bool uart_dma_write(uart_dma_t *u, const void *data, size_t len);
+void uart_dma_poll(uart_dma_t *u);
+size_t uart_dma_free(const uart_dma_t *u);
+bool uart_dma_idle(const uart_dma_t *u);
+
+// Port layer: RP2 DMA on the target, provided by the tests on the host
+int uart_dma_port_init(uart_dma_t *u, uint8_t size_bits);
+void uart_dma_port_start(uart_dma_t *u, const uint8_t *from, uint32_t count);
+uint32_t uart_dma_port_remaining(const uart_dma_t *u);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,143 @@
+#include "usb_control.h"
+
+#ifndef HOST_TESTING
+#include "pico/stdio.h"
+#include "pico/stdio/driver.h"
+#include "pico/time.h"
+#include "tusb.h"
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Start with an empty line buffer and a transmit path on the control interface
+void usb_control_init(usb_control_t *ctl, const usb_control_command_t *commands, size_t count) {
+    memset(ctl, 0, sizeof(*ctl));
+    usb_tx_config_t config = {USB_CONTROL_FLUSH_BYTES, USB_CONTROL_FLUSH_AGE_US, USB_ITF_CONTROL};
+    usb_tx_init(&ctl->tx, &config);
+    ctl->commands = commands;
+    ctl->command_count = count;
+}
+
+// Queue a formatted reply
+bool usb_control_printf(usb_control_t *ctl, const char *fmt, ...) {
+    char text[USB_TX_MAX_RECORD];
+    va_list args;
+
+    va_start(args, fmt);
+    int len = vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+
+    if (len < 0) {
+        return false;
+    }
+    if ((size_t)len >= sizeof(text)) {
+        len = sizeof(text) - 1;
+    }
+    return usb_tx_write(&ctl->tx, text, (size_t)len, ctl->now_us);
+}
+
+// List the available commands
+void usb_control_help(usb_control_t *ctl) {
+    for (size_t i = 0; i < ctl->command_count; i++) {
+        usb_control_printf(ctl, "%-10s %s\n", ctl->commands[i].name, ctl->commands[i].help);
+    }
+}
+
+// Look up and run the command on one complete line
+static void usb_control_dispatch(usb_control_t *ctl, char *line) {
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    if (*line == '\0') {
+        return;
+    }
+
+    char *args = line;
+    while (*args && *args != ' ' && *args != '\t') {
+        args++;
+    }
+    if (*args) {
+        *args++ = '\0';
+        while (*args == ' ' || *args == '\t') {
+            args++;
+        }
+    }
+
+    for (size_t i = 0; i < ctl->command_count; i++) {
+        if (strcmp(line, ctl->commands[i].name) == 0) {
+            ctl->commands_run++;
+            ctl->commands[i].handler(ctl, args);
+            return;
+        }
+    }
+    ctl->commands_unknown++;
+    usb_control_printf(ctl, "error: unknown command '%s' (try 'help')\n", line);
+}
+
+// Assemble received bytes into lines and run each complete one
+void usb_control_feed(usb_control_t *ctl, const char *data, size_t len, uint32_t now_us) {
+    ctl->now_us = now_us;
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+        if (c == '\r' || c == '\n') {
+            if (ctl->overflow) {
+                usb_control_printf(ctl, "error: line too long\n");
+            } else {
+                ctl->line[ctl->line_len] = '\0';
+                usb_control_dispatch(ctl, ctl->line);
+            }
+            ctl->line_len = 0;
+            ctl->overflow = false;
+        } else if (ctl->line_len + 1 < sizeof(ctl->line)) {
+            ctl->line[ctl->line_len++] = c;
+        } else {
+            ctl->overflow = true;
+        }
+    }
+}
+
+// Read pending input, run any complete commands and move replies along
+void usb_control_poll(usb_control_t *ctl, uint32_t now_us) {
+    uint8_t buf[64];
+    uint32_t n;
+    while ((n = usb_control_port_read(buf, sizeof(buf))) > 0) {
+        usb_control_feed(ctl, (const char *)buf, n, now_us);
+    }
+    usb_tx_poll(&ctl->tx, now_us);
+}
+
+#ifndef HOST_TESTING
+// TinyUSB port
+uint32_t usb_control_port_read(uint8_t *buf, uint32_t len) {
+    return tud_cdc_n_available(USB_ITF_CONTROL) ? tud_cdc_n_read(USB_ITF_CONTROL, buf, len) : 0;
+}
+
+// stdio driver: printf output joins the replies on the control interface.
+// It never waits for the host; output that does not fit is counted and lost.
+static usb_control_t *stdio_ctl;
+
+static void usb_control_stdio_out_chars(const char *buf, int len) {
+    if (!usb_tx_write(&stdio_ctl->tx, buf, (size_t)len, time_us_32())) {
+        stdio_ctl->stdio_dropped += (uint32_t)len;
+    }
+}
+
+static void usb_control_stdio_out_flush(void) {
+    usb_tx_flush(&stdio_ctl->tx);
+}
+
+static stdio_driver_t usb_control_stdio = {
+    .out_chars = usb_control_stdio_out_chars,
+    .out_flush = usb_control_stdio_out_flush,
+#if PICO_STDIO_ENABLE_CRLF_SUPPORT
+    .crlf_enabled = PICO_STDIO_DEFAULT_CRLF,
+#endif
+};
+
+void usb_control_stdio_init(usb_control_t *ctl) {
+    stdio_ctl = ctl;
+    stdio_set_driver_enabled(&usb_control_stdio, true);
+}
+#endif
@@ -0,0 +1,65 @@
+#ifndef USB_CONTROL_H
+#define USB_CONTROL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "usb_tx.h"
+
+// Longest command line; longer lines are discarded with an error reply
+#define USB_CONTROL_LINE_MAX 80
+
+// Replies and log lines are small, so submit them quickly rather than in
+// large batches like the data stream
+#define USB_CONTROL_FLUSH_BYTES 256
+#define USB_CONTROL_FLUSH_AGE_US 2000
+
+typedef struct usb_control usb_control_t;
+
+// Command handler; 'args' is the rest of the line after the command name
+typedef void (*usb_control_handler_fn)(usb_control_t *ctl, const char *args);
+
+typedef struct {
+    const char *name;
+    const char *help;
+    usb_control_handler_fn handler;
+} usb_control_command_t;
+
+// Control interface: line-based commands in, replies and stdio out.
+// It has its own transmit buffers, so a backlog on the data interface
+// never delays a reply.
+struct usb_control {
+    usb_tx_t tx;
+    const usb_control_command_t *commands;
+    size_t command_count;
+    char line[USB_CONTROL_LINE_MAX];
+    size_t line_len;
+    bool overflow;              // Current line is too long and is being skipped
+    uint32_t now_us;            // Time of the input being processed
+    uint32_t commands_run;
+    uint32_t commands_unknown;
+    uint32_t stdio_dropped;     // Bytes of printf output lost to a full buffer
+};
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void usb_control_init(usb_control_t *ctl, const usb_control_command_t *commands, size_t count);
+void usb_control_feed(usb_control_t *ctl, const char *data, size_t len, uint32_t now_us);
+void usb_control_poll(usb_control_t *ctl, uint32_t now_us);
+bool usb_control_printf(usb_control_t *ctl, const char *fmt, ...);
+void usb_control_help(usb_control_t *ctl);
+
+// Route printf output to the control interface (target only)
+void usb_control_stdio_init(usb_control_t *ctl);
+
+// Port layer: TinyUSB CDC on the target, provided by the tests on the host
+uint32_t usb_control_port_read(uint8_t *buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
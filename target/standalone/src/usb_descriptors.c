@@ -0,0 +1,148 @@
+#include "tusb.h"
+#include "pico/unique_id.h"
+#include "usb_tx.h"
+
+#include <string.h>
+
+// Composite device: three CDC-ACM functions grouped by interface
+// association descriptors. Hosts show them as three serial ports (on Linux
+// the by-id names end in -if00 for data, -if02 for control and -if04 for
+// log download). With USB_MSC_LOG a mass storage interface follows, the
+// log as a read-only disk.
+
+// The Pico SDK's own IDs (Raspberry Pi's vendor ID and its SDK CDC
+// product ID) unless the build sets others: this project has no product ID
+// allocated to it. Devices given to others should carry one of their own.
+#ifndef USBD_VID
+#define USBD_VID 0x2E8A
+#endif
+#ifndef USBD_PID
+#define USBD_PID 0x0009
+#endif
+
+enum {
+    ITF_NUM_CDC_DATA = 0,
+    ITF_NUM_CDC_DATA_DATA,
+    ITF_NUM_CDC_CONTROL,
+    ITF_NUM_CDC_CONTROL_DATA,
+    ITF_NUM_CDC_DOWNLOAD,
+    ITF_NUM_CDC_DOWNLOAD_DATA,
+#if CFG_TUD_MSC
+    ITF_NUM_MSC,
+#endif
+    ITF_NUM_TOTAL
+};
+
+// Endpoints: notification IN, bulk OUT and bulk IN per CDC function
+#define EPNUM_CDC_DATA_NOTIF 0x81
+#define EPNUM_CDC_DATA_OUT 0x02
+#define EPNUM_CDC_DATA_IN 0x82
+#define EPNUM_CDC_CONTROL_NOTIF 0x83
+#define EPNUM_CDC_CONTROL_OUT 0x04
+#define EPNUM_CDC_CONTROL_IN 0x84
+#define EPNUM_CDC_DOWNLOAD_NOTIF 0x85
+#define EPNUM_CDC_DOWNLOAD_OUT 0x06
+#define EPNUM_CDC_DOWNLOAD_IN 0x86
+#define EPNUM_MSC_OUT 0x07
+#define EPNUM_MSC_IN 0x87
+
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + CFG_TUD_CDC * TUD_CDC_DESC_LEN + CFG_TUD_MSC * TUD_MSC_DESC_LEN)
+
+enum {
+    STRID_LANGID = 0,
+    STRID_MANUFACTURER,
+    STRID_PRODUCT,
+    STRID_SERIAL,
+    STRID_CDC_DATA,
+    STRID_CDC_CONTROL,
+    STRID_CDC_DOWNLOAD,
+    STRID_MSC
+};
+
+// TinyUSB numbers CDC instances in descriptor order, which must match
+// USB_ITF_DATA, USB_ITF_CONTROL and USB_ITF_DOWNLOAD
+_Static_assert(USB_ITF_DATA == 0 && USB_ITF_CONTROL == 1 && USB_ITF_DOWNLOAD == 2, "CDC instance order");
+
+static const tusb_desc_device_t desc_device = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = 0x0200,
+    // Required for interface association descriptors
+    .bDeviceClass = TUSB_CLASS_MISC,
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor = USBD_VID,
+    .idProduct = USBD_PID,
+    .bcdDevice = 0x0100,
+    .iManufacturer = STRID_MANUFACTURER,
+    .iProduct = STRID_PRODUCT,
+    .iSerialNumber = STRID_SERIAL,
+    .bNumConfigurations = 1,
+};
+
+static const uint8_t desc_configuration[] = {
+    TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 100),
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_DATA, STRID_CDC_DATA, EPNUM_CDC_DATA_NOTIF, 8,
+                       EPNUM_CDC_DATA_OUT, EPNUM_CDC_DATA_IN, CFG_TUD_CDC_EP_BUFSIZE),
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_CONTROL, STRID_CDC_CONTROL, EPNUM_CDC_CONTROL_NOTIF, 8,
+                       EPNUM_CDC_CONTROL_OUT, EPNUM_CDC_CONTROL_IN, CFG_TUD_CDC_EP_BUFSIZE),
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_DOWNLOAD, STRID_CDC_DOWNLOAD, EPNUM_CDC_DOWNLOAD_NOTIF, 8,
+                       EPNUM_CDC_DOWNLOAD_OUT, EPNUM_CDC_DOWNLOAD_IN, CFG_TUD_CDC_EP_BUFSIZE),
+#if CFG_TUD_MSC
+    TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, STRID_MSC, EPNUM_MSC_OUT, EPNUM_MSC_IN, 64),
+#endif
+};
+
+static const char *const desc_strings[] = {
+    [STRID_MANUFACTURER] = "Raspberry Pi",
+    [STRID_PRODUCT] = "Pico Sensors",
+    [STRID_SERIAL] = NULL,      // Filled in from the flash unique ID
+    [STRID_CDC_DATA] = "Sensors Data",
+    [STRID_CDC_CONTROL] = "Sensors Control",
+    [STRID_CDC_DOWNLOAD] = "Sensors Download",
+    [STRID_MSC] = "Sensors Log Disk",
+};
+
+const uint8_t *tud_descriptor_device_cb(void) {
+    return (const uint8_t *)&desc_device;
+}
+
+const uint8_t *tud_descriptor_configuration_cb(uint8_t index) {
+    (void)index;
+    return desc_configuration;
+}
+
+// String descriptors are UTF-16; all of ours are plain ASCII
+const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
+    static uint16_t desc_str[1 + 32];
+    (void)langid;
+    char serial[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+    const char *str;
+    size_t len;
+
+    if (index == STRID_LANGID) {
+        desc_str[1] = 0x0409;   // English
+        len = 1;
+    } else {
+        if (index >= sizeof(desc_strings) / sizeof(desc_strings[0])) {
+            return NULL;
+        }
+        if (index == STRID_SERIAL) {
+            pico_get_unique_board_id_string(serial, sizeof(serial));
+            str = serial;
+        } else {
+            str = desc_strings[index];
+        }
+        len = strlen(str);
+        if (len > 32) {
+            len = 32;
+        }
+        for (size_t i = 0; i < len; i++) {
+            desc_str[1 + i] = (uint8_t)str[i];
+        }
+    }
+
+    desc_str[0] = (uint16_t)((TUSB_DESC_STRING << 8) | (2 * len + 2));
+    return desc_str;
+}
@@ -0,0 +1,189 @@
+#include "usb_tx.h"
+
+#ifndef HOST_TESTING
+#include "tusb.h"
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Initialize an empty double buffer with the given (or default) flush policy.
+// The default writes to the data interface.
+void usb_tx_init(usb_tx_t *tx, const usb_tx_config_t *config) {
+    memset(tx, 0, sizeof(*tx));
+    if (config) {
+        tx->config = *config;
+    } else {
+        tx->config.flush_bytes = USB_TX_FLUSH_BYTES_DEFAULT;
+        tx->config.flush_age_us = USB_TX_FLUSH_AGE_US_DEFAULT;
+    }
+    if (tx->config.flush_bytes == 0 || tx->config.flush_bytes > USB_TX_BUFFER_SIZE) {
+        tx->config.flush_bytes = USB_TX_BUFFER_SIZE;
+    }
+}
+
+// Hand the fill buffer to the USB side and start filling the other one
+static bool usb_tx_swap(usb_tx_t *tx) {
+    if (tx->draining || tx->len[tx->fill] == 0) {
+        return false;
+    }
+    tx->fill ^= 1;
+    tx->len[tx->fill] = 0;
+    tx->sent = 0;
+    tx->draining = true;
+    return true;
+}
+
+// Push as much of the draining buffer as TinyUSB will take right now
+static void usb_tx_drain(usb_tx_t *tx) {
+    if (!tx->draining) {
+        return;
+    }
+
+    uint8_t out = tx->fill ^ 1;
+    uint16_t remaining = tx->len[out] - tx->sent;
+    uint32_t room = usb_tx_port_write_available(tx->config.itf);
+    if (room < remaining && room > 0) {
+        remaining = (uint16_t)room;
+    }
+    if (room > 0) {
+        uint32_t written = usb_tx_port_write(tx->config.itf, &tx->buf[out][tx->sent], remaining);
+        tx->sent += (uint16_t)written;
+        tx->stats.bytes_sent += written;
+    }
+
+    if (tx->sent == tx->len[out]) {
+        usb_tx_port_flush(tx->config.itf);
+        tx->len[out] = 0;
+        tx->sent = 0;
+        tx->draining = false;
+    }
+}
+
+// Queue one record; records are never split across submissions.
+// Returns false (and counts a drop) when both buffers are occupied.
+bool usb_tx_write(usb_tx_t *tx, const void *data, size_t len, uint32_t now_us) {
+    if (len == 0) {
+        return true;
+    }
+    if (len > USB_TX_BUFFER_SIZE) {
+        tx->stats.records_dropped++;
+        tx->stats.bytes_dropped += (uint32_t)len;
+        return false;
+    }
+
+    if (tx->len[tx->fill] + len > USB_TX_BUFFER_SIZE) {
+        // Fill buffer is full: try to finish the previous submission first
+        usb_tx_drain(tx);
+        if (!usb_tx_swap(tx)) {
+            tx->stats.records_dropped++;
+            tx->stats.bytes_dropped += (uint32_t)len;
+            return false;
+        }
+        tx->stats.flushes_size++;
+        usb_tx_drain(tx);
+    }
+
+    if (tx->len[tx->fill] == 0) {
+        tx->fill_start_us = now_us;
+    }
+    memcpy(&tx->buf[tx->fill][tx->len[tx->fill]], data, len);
+    tx->len[tx->fill] += (uint16_t)len;
+    tx->stats.bytes_queued += (uint32_t)len;
+    tx->stats.records_queued++;
+    return true;
+}
+
+// Format and queue one record
+bool usb_tx_printf(usb_tx_t *tx, uint32_t now_us, const char *fmt, ...) {
+    char record[USB_TX_MAX_RECORD];
+    va_list args;
+
+    va_start(args, fmt);
+    int len = vsnprintf(record, sizeof(record), fmt, args);
+    va_end(args);
+
+    if (len < 0) {
+        return false;
+    }
+    if ((size_t)len >= sizeof(record)) {
+        len = sizeof(record) - 1;
+    }
+    return usb_tx_write(tx, record, (size_t)len, now_us);
+}
+
+// Apply the size-or-age flush policy and keep the USB side busy.
+// Call this often from the main loop; it never blocks.
+void usb_tx_poll(usb_tx_t *tx, uint32_t now_us) {
+    usb_tx_drain(tx);
+
+    uint16_t queued = tx->len[tx->fill];
+    if (tx->draining || queued == 0) {
+        return;
+    }
+
+    if (queued >= tx->config.flush_bytes) {
+        usb_tx_swap(tx);
+        tx->stats.flushes_size++;
+    } else if ((uint32_t)(now_us - tx->fill_start_us) >= tx->config.flush_age_us) {
+        usb_tx_swap(tx);
+        tx->stats.flushes_age++;
+    } else {
+        return;
+    }
+    usb_tx_drain(tx);
+}
+
+// Submit everything queued regardless of policy (e.g. before a long sleep)
+void usb_tx_flush(usb_tx_t *tx) {
+    usb_tx_drain(tx);
+    if (usb_tx_swap(tx)) {
+        usb_tx_drain(tx);
+    }
+}
+
+// Report the backpressure state to the producer. Past the flush threshold
+// the fill buffer still takes records; only once it cannot take one of
+// the largest size while the other is with USB is the next one dropped.
+usb_tx_state_t usb_tx_state(const usb_tx_t *tx) {
+    if (!usb_tx_port_connected(tx->config.itf)) {
+        return USB_TX_DISCONNECTED;
+    }
+    if (tx->draining && USB_TX_BUFFER_SIZE - tx->len[tx->fill] < USB_TX_MAX_RECORD) {
+        return USB_TX_BACKPRESSURE;
+    }
+    if (tx->draining) {
+        return USB_TX_DRAINING;
+    }
+    return tx->len[tx->fill] ? USB_TX_FILLING : USB_TX_IDLE;
+}
+
+// Bytes the producer can queue before records start being dropped
+size_t usb_tx_free(const usb_tx_t *tx) {
+    size_t free_bytes = USB_TX_BUFFER_SIZE - tx->len[tx->fill];
+    if (!tx->draining) {
+        // The other half becomes available on the next swap
+        free_bytes += USB_TX_BUFFER_SIZE;
+    }
+    return free_bytes;
+}
+
+#ifndef HOST_TESTING
+// TinyUSB port. The main loop runs tud_task() between samples.
+bool usb_tx_port_connected(uint8_t itf) {
+    return tud_cdc_n_connected(itf);
+}
+
+uint32_t usb_tx_port_write_available(uint8_t itf) {
+    return tud_cdc_n_write_available(itf);
+}
+
+uint32_t usb_tx_port_write(uint8_t itf, const uint8_t *data, uint32_t len) {
+    return tud_cdc_n_write(itf, data, len);
+}
+
+void usb_tx_port_flush(uint8_t itf) {
+    tud_cdc_n_write_flush(itf);
+}
+#endif
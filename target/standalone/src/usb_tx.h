@@ -0,0 +1,89 @@
+#ifndef USB_TX_H
+#define USB_TX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Size of each half of the double buffer. A full half is handed to TinyUSB
+// in one go, so keep it a multiple of the 64-byte CDC bulk packet.
+#ifndef USB_TX_BUFFER_SIZE
+#define USB_TX_BUFFER_SIZE 2048
+#endif
+
+// Default flush policy: submit once this many bytes are queued...
+#define USB_TX_FLUSH_BYTES_DEFAULT 1024
+// ...or once the oldest queued byte is this old, whichever comes first
+#define USB_TX_FLUSH_AGE_US_DEFAULT 50000
+
+// Largest single formatted record accepted by usb_tx_printf
+#define USB_TX_MAX_RECORD 256
+
+// CDC interfaces of the composite device (see usb_descriptors.c)
+#define USB_ITF_DATA 0              // Sample stream
+#define USB_ITF_CONTROL 1           // Commands, responses and diagnostics
+#define USB_ITF_DOWNLOAD 2          // Bulk log download (log_xfer.h)
+
+// Backpressure state as seen by the producer
+typedef enum {
+    USB_TX_IDLE = 0,        // Nothing queued
+    USB_TX_FILLING,         // Fill buffer has data that is not yet due
+    USB_TX_DRAINING,        // A full buffer is being handed to TinyUSB
+    USB_TX_BACKPRESSURE,    // Both buffers are full; the next record may be dropped
+    USB_TX_DISCONNECTED     // No host has the port open
+} usb_tx_state_t;
+
+// Throughput and drop counters
+typedef struct {
+    uint32_t bytes_queued;
+    uint32_t bytes_sent;
+    uint32_t bytes_dropped;
+    uint32_t records_queued;
+    uint32_t records_dropped;
+    uint32_t flushes_size;      // Submissions triggered by the size threshold
+    uint32_t flushes_age;       // Submissions triggered by the age threshold
+} usb_tx_stats_t;
+
+// Flush policy and the CDC interface to write to
+typedef struct {
+    uint16_t flush_bytes;
+    uint32_t flush_age_us;
+    uint8_t itf;
+} usb_tx_config_t;
+
+// Double-buffered transmit state
+typedef struct {
+    uint8_t buf[2][USB_TX_BUFFER_SIZE];
+    uint16_t len[2];
+    uint16_t sent;              // Bytes of the draining buffer already accepted by TinyUSB
+    uint8_t fill;               // Buffer the producer appends to
+    bool draining;              // The other buffer is owned by the USB side
+    uint32_t fill_start_us;     // Time the first byte landed in the fill buffer
+    usb_tx_config_t config;
+    usb_tx_stats_t stats;
+} usb_tx_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void usb_tx_init(usb_tx_t *tx, const usb_tx_config_t *config);
+bool usb_tx_write(usb_tx_t *tx, const void *data, size_t len, uint32_t now_us);
+bool usb_tx_printf(usb_tx_t *tx, uint32_t now_us, const char *fmt, ...);
+void usb_tx_poll(usb_tx_t *tx, uint32_t now_us);
+void usb_tx_flush(usb_tx_t *tx);
+usb_tx_state_t usb_tx_state(const usb_tx_t *tx);
+size_t usb_tx_free(const usb_tx_t *tx);
+
+// Port layer: TinyUSB CDC on the target, provided by the tests on the host
+bool usb_tx_port_connected(uint8_t itf);
+uint32_t usb_tx_port_write_available(uint8_t itf);
+uint32_t usb_tx_port_write(uint8_t itf, const uint8_t *data, uint32_t len);
+void usb_tx_port_flush(uint8_t itf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,134 @@
+#include "veml6075.h"
+#include "ram_func.h"
+
+#include <string.h>
+
+// Called on core 0 before sampling starts, so it may live in flash
+bool veml6075_init(veml6075_t *v, const veml6075_bus_t *bus, uint8_t it, bool hd) {
+    memset(v, 0, sizeof(*v));
+    v->bus = *bus;
+    v->it = it;
+    v->hd = hd;
+    v->conf = (uint16_t)(it << VEML6075_CONF_IT_SHIFT | (hd ? VEML6075_CONF_HD : 0) | VEML6075_CONF_UV_AF);
+
+    v->it_us = veml6075_integration_us(it);
+    v->measure_us = v->it_us + (v->it_us >> VEML6075_MARGIN_SHIFT);
+
+    v->regs[0] = VEML6075_UV_CONF;
+    v->regs[1 + VEML6075_CH_UVA] = VEML6075_UVA_DATA;
+    v->regs[1 + VEML6075_CH_UVB] = VEML6075_UVB_DATA;
+    v->regs[1 + VEML6075_CH_UVCOMP1] = VEML6075_UVCOMP1_DATA;
+    v->regs[1 + VEML6075_CH_UVCOMP2] = VEML6075_UVCOMP2_DATA;
+
+    uint8_t reg = VEML6075_ID;
+    uint16_t id;
+    if (!bus->read(bus->ctx, VEML6075_ADDRESS, &reg, &id, 1) || (id & 0xFF) != VEML6075_DEVICE_ID) {
+        return false;
+    }
+    // Powered up and idle until the first trigger
+    return bus->write(bus->ctx, VEML6075_ADDRESS, VEML6075_UV_CONF, v->conf);
+}
+
+uint32_t veml6075_integration_us(uint8_t it) {
+    return 50000u << it;
+}
+
+void RAM_FUNC(veml6075_plan)(veml6075_t *v, uint32_t ready_by_us) {
+    if (v->planned) {
+        return;
+    }
+    v->planned = true;
+    v->start_us = ready_by_us - v->measure_us;
+}
+
+bool RAM_FUNC(veml6075_due)(const veml6075_t *v, uint32_t now_us) {
+    return (v->running && (int32_t)(now_us - v->ready_us) >= 0) ||
+           (v->planned && (int32_t)(now_us - v->start_us) >= 0);
+}
+
+// Read a finished measurement, then start the planned one, which may be
+// at once. A sensor that stops answering is tried again a measurement
+// time later rather than on every call.
+int RAM_FUNC(veml6075_poll)(veml6075_t *v, uint32_t now_us) {
+    int status = VEML6075_WAIT;
+
+    if (v->running && (int32_t)(now_us - v->ready_us) >= 0) {
+        uint16_t values[VEML6075_READ_COUNT];
+        if (!v->bus.read(v->bus.ctx, VEML6075_ADDRESS, v->regs, values, VEML6075_READ_COUNT)) {
+            v->stats.bus_errors++;
+            v->running = false;
+            v->planned = true;
+            v->start_us = now_us + v->measure_us;
+            return VEML6075_ERROR;
+        }
+        if (values[0] & VEML6075_CONF_UV_TRIG) {
+            // The sensor's clock runs slow: look again a little later, and
+            // allow for it from the next measurement on
+            uint32_t step_us = v->it_us >> VEML6075_MARGIN_SHIFT;
+            v->stats.early++;
+            v->ready_us = now_us + step_us;
+            if (v->measure_us < 2 * v->it_us) {
+                v->measure_us += step_us;
+            }
+            return VEML6075_WAIT;
+        }
+
+        // Element by element: a copy loop may become a call to memcpy in flash
+        uint16_t *raw = v->result.raw;
+        raw[VEML6075_CH_UVA] = values[1 + VEML6075_CH_UVA];
+        raw[VEML6075_CH_UVB] = values[1 + VEML6075_CH_UVB];
+        raw[VEML6075_CH_UVCOMP1] = values[1 + VEML6075_CH_UVCOMP1];
+        raw[VEML6075_CH_UVCOMP2] = values[1 + VEML6075_CH_UVCOMP2];
+        if (raw[0] == 0xFFFF || raw[1] == 0xFFFF || raw[2] == 0xFFFF || raw[3] == 0xFFFF) {
+            v->stats.saturated++;
+        }
+        veml6075_compensate(raw, v->it, v->hd, &v->result);
+        v->running = false;
+        v->fresh = true;
+        v->stats.measurements++;
+        status = VEML6075_NEW;
+    }
+
+    if (!v->running && v->planned && (int32_t)(now_us - v->start_us) >= 0) {
+        // The whole configuration goes with the trigger, so a sensor that
+        // was reset gets it back
+        if (!v->bus.write(v->bus.ctx, VEML6075_ADDRESS, VEML6075_UV_CONF, v->conf | VEML6075_CONF_UV_TRIG)) {
+            v->stats.bus_errors++;
+            v->start_us = now_us + v->measure_us;
+            return VEML6075_ERROR;
+        }
+        v->planned = false;
+        v->running = true;
+        v->ready_us = now_us + v->measure_us;
+    }
+    return status;
+}
+
+const veml6075_result_t *RAM_FUNC(veml6075_take)(veml6075_t *v) {
+    if (!v->fresh) {
+        return NULL;
+    }
+    v->fresh = false;
+    return &v->result;
+}
+
+// Integer only: the Q12 coefficients keep every product within 32 bits,
+// and the UV index responsivity scales by powers of two (halving with
+// each doubling of the integration time, doubling in high dynamic), so
+// it becomes a shift
+void RAM_FUNC(veml6075_compensate)(const uint16_t raw[VEML6075_CHANNELS], uint8_t it, bool hd,
+                                   veml6075_result_t *result) {
+    int32_t comp1 = raw[VEML6075_CH_UVCOMP1];
+    int32_t comp2 = raw[VEML6075_CH_UVCOMP2];
+    int32_t uva = ((int32_t)raw[VEML6075_CH_UVA] << 12) - VEML6075_UVA_A * comp1 - VEML6075_UVA_B * comp2;
+    int32_t uvb = ((int32_t)raw[VEML6075_CH_UVB] << 12) - VEML6075_UVB_C * comp1 - VEML6075_UVB_D * comp2;
+    result->uva = uva > 0 ? (uva + (1 << 11)) >> 12 : 0;
+    result->uvb = uvb > 0 ? (uvb + (1 << 11)) >> 12 : 0;
+
+    // The index is the mean of the two; each term is halved first so the
+    // sum fits 32 bits
+    uint32_t shift = 14u + it - (hd ? 1u : 0u);
+    uint32_t sum = ((uint32_t)result->uva * VEML6075_UVA_RESP >> 1) +
+                   ((uint32_t)result->uvb * VEML6075_UVB_RESP >> 1);
+    result->uv_index = (int32_t)((sum + (1u << (shift - 2))) >> (shift - 1));
+}
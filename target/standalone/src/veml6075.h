@@ -0,0 +1,142 @@
+#ifndef VEML6075_H
+#define VEML6075_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// I2C address and command codes. Registers are 16 bits, low byte first.
+#define VEML6075_ADDRESS 0x10
+#define VEML6075_UV_CONF 0x00
+#define VEML6075_UVA_DATA 0x07
+#define VEML6075_UVB_DATA 0x09
+#define VEML6075_UVCOMP1_DATA 0x0A
+#define VEML6075_UVCOMP2_DATA 0x0B
+#define VEML6075_ID 0x0C
+#define VEML6075_DEVICE_ID 0x26     // Low byte of the ID register
+
+// UV_CONF bits
+#define VEML6075_CONF_SD 0x0001         // Shut down
+#define VEML6075_CONF_UV_AF 0x0002      // Active force: one measurement per trigger
+#define VEML6075_CONF_UV_TRIG 0x0004    // Start a measurement; reads 1 until it is done
+#define VEML6075_CONF_HD 0x0008         // High dynamic: half the sensitivity
+#define VEML6075_CONF_IT_SHIFT 4
+
+// Integration times; each is twice the one before (50 ms << it)
+#define VEML6075_IT_50MS 0
+#define VEML6075_IT_100MS 1
+#define VEML6075_IT_200MS 2
+#define VEML6075_IT_400MS 3
+#define VEML6075_IT_800MS 4
+
+// The sensor's clock is only good to about 10%. Results are read this
+// fraction of the integration time late (as a shift), then checked; each
+// read that finds the measurement still running adds as much again to
+// the margin, up to a whole integration time.
+#define VEML6075_MARGIN_SHIFT 3
+
+// Compensation coefficients for a sensor in open air, from Vishay's
+// application note "Designing the VEML6075 into an application", Q12
+#define VEML6075_UVA_A 9093         // 2.22
+#define VEML6075_UVA_B 5448         // 1.33
+#define VEML6075_UVB_C 12083        // 2.95
+#define VEML6075_UVB_D 7127         // 1.74
+
+// UV index per compensated count at 100 ms and normal dynamic, in
+// thousandths, Q14
+#define VEML6075_UVA_RESP 23937     // 1.461
+#define VEML6075_UVB_RESP 42451     // 2.591
+
+// What veml6075_poll() did
+#define VEML6075_WAIT 0             // Nothing, or started a measurement
+#define VEML6075_NEW 1              // Stored a new result
+#define VEML6075_ERROR -1           // The bus failed; the measurement starts again
+
+// Channels in the order they are read
+typedef enum {
+    VEML6075_CH_UVA = 0,
+    VEML6075_CH_UVB,
+    VEML6075_CH_UVCOMP1,
+    VEML6075_CH_UVCOMP2,
+    VEML6075_CHANNELS
+} veml6075_channel_t;
+
+// Registers read together: UV_CONF, to see that the measurement is done,
+// then the channels
+#define VEML6075_READ_COUNT (1 + VEML6075_CHANNELS)
+
+// How the driver reaches the sensor. read() reads the 16-bit registers
+// 'regs' in one transaction, with a repeated start before each and a
+// stop only at the end, so all four channels come from the same
+// measurement. Both return false if the sensor did not answer. They are
+// called from the sampling core, so on the target they must be in SRAM.
+typedef struct {
+    bool (*read)(void *ctx, uint8_t address, const uint8_t *regs, uint16_t *values, uint32_t count);
+    bool (*write)(void *ctx, uint8_t address, uint8_t reg, uint16_t value);
+    void *ctx;
+} veml6075_bus_t;
+
+// A result. The compensated counts have the visible and infrared leakage
+// taken out and are never negative.
+typedef struct {
+    uint16_t raw[VEML6075_CHANNELS];
+    int32_t uva;
+    int32_t uvb;
+    int32_t uv_index;           // Thousandths
+} veml6075_result_t;
+
+typedef struct {
+    uint32_t measurements;
+    uint32_t early;             // Reads that found the measurement still running
+    uint32_t saturated;         // Results with a channel at full scale
+    uint32_t bus_errors;
+} veml6075_stats_t;
+
+typedef struct {
+    veml6075_bus_t bus;
+    uint16_t conf;              // UV_CONF without the trigger
+    uint8_t it;
+    bool hd;
+    uint32_t it_us;
+    uint32_t measure_us;        // Integration time plus margin
+    uint8_t regs[VEML6075_READ_COUNT];  // Kept here: const tables may be in flash
+    bool running;               // Triggered and not yet read
+    uint32_t ready_us;          // When a running measurement should be done
+    bool planned;               // A measurement is wanted, starting at start_us
+    uint32_t start_us;
+    bool fresh;                 // 'result' not yet taken
+    veml6075_result_t result;
+    veml6075_stats_t stats;
+} veml6075_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Check the ID and set up one measurement per trigger; false if the
+// sensor is missing or something else answers
+bool veml6075_init(veml6075_t *v, const veml6075_bus_t *bus, uint8_t it, bool hd);
+uint32_t veml6075_integration_us(uint8_t it);
+
+// Have a result ready by 'ready_by_us': the measurement starts as late as
+// it can and still finish by then, or at once if that is already past
+// (after the running one, if there is one). Does nothing if a measurement
+// is already planned.
+void veml6075_plan(veml6075_t *v, uint32_t ready_by_us);
+
+// Whether veml6075_poll() has a trigger or a read to do at 'now_us'
+bool veml6075_due(const veml6075_t *v, uint32_t now_us);
+int veml6075_poll(veml6075_t *v, uint32_t now_us);
+
+// The result stored since the last call, or NULL if there is none. It
+// stays valid until the next veml6075_poll().
+const veml6075_result_t *veml6075_take(veml6075_t *v);
+
+// Compensated UVA and UVB, and the UV index, from the four channels
+void veml6075_compensate(const uint16_t raw[VEML6075_CHANNELS], uint8_t it, bool hd, veml6075_result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
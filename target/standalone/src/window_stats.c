@@ -0,0 +1,174 @@
+#include "window_stats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Integer square root of a 64-bit value
+static uint32_t isqrt64(uint64_t x) {
+    uint64_t root = 0;
+    uint64_t bit = 1ull << 62;
+
+    while (bit > x) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+// Wrap a value into [0, modulus)
+static int32_t wrap(int64_t value, int32_t modulus) {
+    int64_t r = value % modulus;
+    return (int32_t)(r < 0 ? r + modulus : r);
+}
+
+// Start an empty window for one channel
+void wstat_reset(wstat_channel_t *c, int32_t modulus) {
+    memset(c, 0, sizeof(*c));
+    c->modulus = modulus;
+}
+
+// Welford update in Q8 fixed point
+void wstat_add(wstat_channel_t *c, int32_t value) {
+    int64_t x = value;
+
+    if (c->modulus > 0 && c->count > 0) {
+        // Pick the representation of the value closest to the running mean
+        int64_t mean = c->mean_q >> WSTAT_FRAC_BITS;
+        int64_t d = (x - mean) % c->modulus;
+        if (d > c->modulus / 2) {
+            d -= c->modulus;
+        } else if (d < -c->modulus / 2) {
+            d += c->modulus;
+        }
+        x = mean + d;
+    }
+
+    int64_t x_q = x * (1 << WSTAT_FRAC_BITS);
+    c->count++;
+    if (c->count == 1) {
+        c->min = c->max = (int32_t)x;
+        c->mean_q = x_q;
+        c->m2_q = 0;
+        return;
+    }
+
+    if (x < c->min) {
+        c->min = (int32_t)x;
+    }
+    if (x > c->max) {
+        c->max = (int32_t)x;
+    }
+
+    int64_t delta = x_q - c->mean_q;
+    c->mean_q += delta / (int64_t)c->count;
+    int64_t delta2 = x_q - c->mean_q;
+    c->m2_q += (delta * delta2) >> WSTAT_FRAC_BITS;
+}
+
+// Summarize one channel; circular results are wrapped back into range
+void wstat_result(const wstat_channel_t *c, wstat_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    result->count = c->count;
+    if (c->count == 0) {
+        return;
+    }
+
+    result->min = c->min;
+    result->max = c->max;
+    result->mean_q = (int32_t)c->mean_q;
+    if (c->count > 1 && c->m2_q > 0) {
+        uint64_t variance_q = (uint64_t)c->m2_q / (c->count - 1);
+        result->stddev_q = (int32_t)isqrt64(variance_q << WSTAT_FRAC_BITS);
+    }
+
+    if (c->modulus > 0) {
+        int64_t modulus_q = (int64_t)c->modulus << WSTAT_FRAC_BITS;
+        int64_t mean_q = c->mean_q % modulus_q;
+        result->mean_q = (int32_t)(mean_q < 0 ? mean_q + modulus_q : mean_q);
+        result->min = wrap(c->min, c->modulus);
+        result->max = wrap(c->max, c->modulus);
+    }
+}
+
+// Start a new window for every channel
+void window_stats_init(window_stats_t *ws, uint64_t now_us) {
+    for (int ch = 0; ch < SAMPLE_CH_COUNT; ch++) {
+        wstat_reset(&ws->ch[ch], sample_channels[ch].modulus);
+    }
+    ws->start_us = now_us;
+    ws->samples = 0;
+}
+
+// Fold one acquisition sample into the window
+void window_stats_add(window_stats_t *ws, const sample_t *sample) {
+    for (int ch = 0; ch < SAMPLE_CH_COUNT; ch++) {
+        if (sample_has(sample, (sample_channel_t)ch)) {
+            wstat_add(&ws->ch[ch], sample->value[ch]);
+        }
+    }
+    ws->samples++;
+}
+
+// Check whether the current window has run its full length
+bool window_stats_due(const window_stats_t *ws, uint64_t now_us, uint32_t window_ms) {
+    return now_us - ws->start_us >= (uint64_t)window_ms * 1000u;
+}
+
+// Close the current window into a record and start the next one
+void window_stats_take(window_stats_t *ws, window_record_t *record, uint64_t now_us) {
+    memset(record, 0, sizeof(*record));
+    record->start_us = ws->start_us;
+    record->end_us = now_us;
+    for (int ch = 0; ch < SAMPLE_CH_COUNT; ch++) {
+        wstat_result(&ws->ch[ch], &record->ch[ch]);
+        if (record->ch[ch].count) {
+            record->valid |= 1u << ch;
+        }
+    }
+    window_stats_init(ws, now_us);
+}
+
+// Format an aggregated record as one text line, e.g.
+// "heading: 180.4 [179.9..181.0] sd 0.3 n=20    pitch: ..."
+int window_stats_format_text(const window_record_t *record, char *buf, size_t len) {
+    size_t used = 0;
+
+    if (len == 0) {
+        return 0;
+    }
+    buf[0] = '\0';
+
+    for (int ch = 0; ch < SAMPLE_CH_COUNT && used < len; ch++) {
+        if (!(record->valid & (1u << ch))) {
+            continue;
+        }
+        const wstat_result_t *r = &record->ch[ch];
+        char mean[24], min[24], max[24], sd[24];
+        sample_format_value((sample_channel_t)ch, r->mean_q, WSTAT_FRAC_BITS, mean, sizeof(mean));
+        sample_format_value((sample_channel_t)ch, r->min, 0, min, sizeof(min));
+        sample_format_value((sample_channel_t)ch, r->max, 0, max, sizeof(max));
+        sample_format_value((sample_channel_t)ch, r->stddev_q, WSTAT_FRAC_BITS, sd, sizeof(sd));
+
+        int n = snprintf(&buf[used], len - used, "%s%s: %s [%s..%s] sd %s n=%lu",
+                         used ? "    " : "", sample_channels[ch].name, mean, min, max, sd,
+                         (unsigned long)r->count);
+        if (n < 0 || used + (size_t)n >= len) {
+            return (int)strlen(buf);
+        }
+        used += (size_t)n;
+    }
+
+    if (used > 0 && used + 1 < len) {
+        buf[used++] = '\n';
+        buf[used] = '\0';
+    }
+    return (int)used;
+}
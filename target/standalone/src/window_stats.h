@@ -0,0 +1,67 @@
+#ifndef WINDOW_STATS_H
+#define WINDOW_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sample.h"
+
+// Fractional bits carried by means and standard deviations (Q8)
+#define WSTAT_FRAC_BITS 8
+
+// Incremental statistics for one channel over the current window.
+// Circular channels are unwrapped around the running mean, so a heading
+// that dithers across north averages to north rather than to south.
+typedef struct {
+    uint32_t count;
+    int32_t min;            // Unwrapped for circular channels
+    int32_t max;
+    int64_t mean_q;         // Welford running mean, Q8
+    int64_t m2_q;           // Welford sum of squared deviations, Q8
+    int32_t modulus;        // Wrap-around for circular channels, 0 for linear ones
+} wstat_channel_t;
+
+// Summary of one channel over a finished window
+typedef struct {
+    uint32_t count;
+    int32_t min;            // Wrapped back into range for circular channels
+    int32_t max;
+    int32_t mean_q;         // Q8, in the channel's raw units
+    int32_t stddev_q;       // Q8, sample standard deviation
+} wstat_result_t;
+
+// Aggregated record emitted once per window
+typedef struct {
+    uint64_t start_us;
+    uint64_t end_us;
+    uint32_t valid;         // Bit per sample_channel_t with at least one value
+    wstat_result_t ch[SAMPLE_CH_COUNT];
+} window_record_t;
+
+// Window statistics for all channels
+typedef struct {
+    wstat_channel_t ch[SAMPLE_CH_COUNT];
+    uint64_t start_us;
+    uint32_t samples;
+} window_stats_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void window_stats_init(window_stats_t *ws, uint64_t now_us);
+void window_stats_add(window_stats_t *ws, const sample_t *sample);
+bool window_stats_due(const window_stats_t *ws, uint64_t now_us, uint32_t window_ms);
+void window_stats_take(window_stats_t *ws, window_record_t *record, uint64_t now_us);
+int window_stats_format_text(const window_record_t *record, char *buf, size_t len);
+
+void wstat_reset(wstat_channel_t *c, int32_t modulus);
+void wstat_add(wstat_channel_t *c, int32_t value);
+void wstat_result(const wstat_channel_t *c, wstat_result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+#include "xip_flash.h"
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+#include <string.h>
+
+_Static_assert(FLASH_DEV_SECTOR_SIZE == FLASH_SECTOR_SIZE, "flash_dev sectors are the chip's erase sectors");
+_Static_assert(FLASH_DEV_PAGE_SIZE == FLASH_PAGE_SIZE, "flash_dev pages are the chip's program pages");
+
+// End of the firmware image, from the linker script
+extern char __flash_binary_end;
+
+static int xip_flash_read(flash_dev_t *dev, uint32_t offset, uint8_t *buf, size_t len) {
+    xip_flash_t *flash = (xip_flash_t *)dev->ctx;
+    memcpy(buf, (const void *)(uintptr_t)(XIP_NOCACHE_NOALLOC_BASE + flash->base + offset), len);
+    return BLOCK_OK;
+}
+
+// Erase the sector at 'offset', or program 'buf' there if there is one.
+// flash_range_erase and flash_range_program run from SRAM and take the
+// flash out of XIP mode until they are done. Nothing on this core may run
+// from flash meanwhile, interrupt handlers included.
+static int xip_flash_run(xip_flash_t *flash, uint32_t offset, const uint8_t *buf, size_t len) {
+    uint64_t start_us = time_us_64();
+    uint32_t irq = save_and_disable_interrupts();
+    if (buf) {
+        flash_range_program(flash->base + offset, buf, len);
+    } else {
+        flash_range_erase(flash->base + offset, FLASH_SECTOR_SIZE);
+    }
+    restore_interrupts(irq);
+    flash->ops++;
+    flash->busy_us += time_us_64() - start_us;
+    return BLOCK_OK;
+}
+
+static int xip_flash_erase_start(flash_dev_t *dev, uint32_t offset) {
+    return xip_flash_run((xip_flash_t *)dev->ctx, offset, NULL, 0);
+}
+
+static int xip_flash_program_start(flash_dev_t *dev, uint32_t offset, const uint8_t *buf, size_t len) {
+    return xip_flash_run((xip_flash_t *)dev->ctx, offset, buf, len);
+}
+
+// Everything finished in start
+static int xip_flash_poll(flash_dev_t *dev) {
+    (void)dev;
+    return BLOCK_OK;
+}
+
+static const flash_dev_ops_t xip_flash_ops = {
+    xip_flash_read, xip_flash_erase_start, xip_flash_program_start, xip_flash_poll,
+};
+
+// Use 'size' bytes of flash from offset 'base'. Fails with BLOCK_RANGE if
+// the region is not whole sectors, runs past the chip or overlaps the
+// firmware image, e.g. after an update made the image bigger.
+int xip_flash_setup(xip_flash_t *flash, uint32_t base, uint32_t size) {
+    uint32_t image_end = (uint32_t)((uintptr_t)&__flash_binary_end - XIP_BASE);
+
+    memset(flash, 0, sizeof(*flash));
+    flash->dev.ops = &xip_flash_ops;
+    flash->dev.ctx = flash;
+    if (base % FLASH_SECTOR_SIZE || size % FLASH_SECTOR_SIZE || base < image_end ||
+        base + size > PICO_FLASH_SIZE_BYTES) {
+        return BLOCK_RANGE;
+    }
+    flash->base = base;
+    flash->dev.size = size;
+    return BLOCK_OK;
+}
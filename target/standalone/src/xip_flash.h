@@ -0,0 +1,35 @@
+#ifndef XIP_FLASH_H
+#define XIP_FLASH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "flash_dev.h"
+
+// A region of the board's QSPI flash, past the firmware image, as a
+// flash_dev. Reads come straight from the uncached XIP window, so log
+// reads do not push code out of the cache.
+//
+// Erases and programs run with this core's interrupts off, and both
+// finish in start. The other core is not paused, so it must not run
+// from flash or read it meanwhile. In this firmware it is the
+// acquisition core, which runs from SRAM (acq_core.h).
+typedef struct {
+    flash_dev_t dev;
+    uint32_t base;              // Offset of the region in flash
+    uint32_t ops;               // Erases and programs so far
+    uint64_t busy_us;           // Time they kept the flash out of XIP mode
+} xip_flash_t;
+
+// Function declarations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int xip_flash_setup(xip_flash_t *flash, uint32_t base, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "batch_decode.hpp"
+
+using host::EngColumns;
+using host::Kernel;
+
+// Test fixture for the host batch decoder
+class BatchDecodeTest : public ::testing::Test {
+protected:
+    std::vector<sample_t> samples;
+
+    // Every TMP117 reading, plus random compass data and missing channels
+    void SetUp() override {
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<int> heading(0, 3599);
+        std::uniform_int_distribution<int> tilt(-128, 127);
+
+        for (int32_t raw = INT16_MIN; raw <= INT16_MAX; ++raw) {
+            sample_t s;
+            sample_clear(&s, 0x123456789ull + (uint64_t)(raw - INT16_MIN) * 50000);
+            sample_set(&s, SAMPLE_CH_TEMP, raw);
+            sample_set(&s, SAMPLE_CH_HEADING, heading(rng));
+            sample_set(&s, SAMPLE_CH_ANGLE8, raw & 0xFF);
+            sample_set(&s, SAMPLE_CH_PITCH, tilt(rng));
+            sample_set(&s, SAMPLE_CH_ROLL, tilt(rng));
+            if (raw % 5 == 0) {
+                s.valid &= ~(1u << (raw & 3 ? SAMPLE_CH_PITCH : SAMPLE_CH_TEMP));
+            }
+            samples.push_back(s);
+        }
+    }
+
+    static bool same_bits(const std::vector<float> &a, const std::vector<float> &b) {
+        return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+    }
+};
+
+// Test that the scalar path matches the firmware's expression and units
+TEST_F(BatchDecodeTest, ScalarMatchesFirmwareConversion) {
+    EngColumns out;
+    out.resize(samples.size());
+    host::decode_batch(samples.data(), samples.size(), out, 0, Kernel::Scalar);
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        const sample_t &s = samples[i];
+        ASSERT_EQ(out.time_us[i], s.time_us);
+        if (sample_has(&s, SAMPLE_CH_TEMP)) {
+            int temp = s.value[SAMPLE_CH_TEMP] * 100 >> 7;
+            ASSERT_EQ(out.temp_centi[i], temp) << "raw " << s.value[SAMPLE_CH_TEMP];
+            ASSERT_EQ(out.temp_c[i], s.value[SAMPLE_CH_TEMP] / 128.0f);
+        } else {
+            ASSERT_EQ(out.temp_centi[i], 0);
+            ASSERT_TRUE(std::isnan(out.temp_c[i]));
+        }
+        ASSERT_FLOAT_EQ(out.heading_deg[i], s.value[SAMPLE_CH_HEADING] / 10.0f);
+        ASSERT_EQ(std::isnan(out.pitch_deg[i]), !sample_has(&s, SAMPLE_CH_PITCH));
+    }
+}
+
+// Test that every SIMD kernel is bit-exact with the scalar one, tails included
+TEST_F(BatchDecodeTest, SimdKernelsAreBitExact) {
+    EngColumns ref;
+    ref.resize(samples.size());
+    host::decode_batch(samples.data(), samples.size(), ref, 0, Kernel::Scalar);
+
+    for (Kernel k : {Kernel::Sse41, Kernel::Avx2}) {
+        if (!host::kernel_supported(k)) {
+            std::printf("  skipping %s: not supported on this CPU\n", host::kernel_name(k));
+            continue;
+        }
+        // Odd start and length exercise the unaligned loads and scalar tail
+        for (size_t start : {0u, 3u}) {
+            for (size_t count : {0u, 1u, 7u, 8u, 9u, 17u, 1000u}) {
+                EngColumns out;
+                out.resize(count);
+                host::decode_batch(&samples[start], count, out, 0, k);
+                for (size_t i = 0; i < count; ++i) {
+                    ASSERT_EQ(out.time_us[i], ref.time_us[start + i]) << host::kernel_name(k);
+                    ASSERT_EQ(out.valid[i], ref.valid[start + i]) << host::kernel_name(k);
+                }
+            }
+        }
+
+        EngColumns out;
+        out.resize(samples.size());
+        host::decode_batch(samples.data(), samples.size(), out, 0, k);
+        EXPECT_EQ(out.time_us, ref.time_us) << host::kernel_name(k);
+        EXPECT_EQ(out.valid, ref.valid) << host::kernel_name(k);
+        EXPECT_EQ(out.temp_centi, ref.temp_centi) << host::kernel_name(k);
+        EXPECT_TRUE(same_bits(out.temp_c, ref.temp_c)) << host::kernel_name(k);
+        EXPECT_TRUE(same_bits(out.heading_deg, ref.heading_deg)) << host::kernel_name(k);
+        EXPECT_TRUE(same_bits(out.pitch_deg, ref.pitch_deg)) << host::kernel_name(k);
+        EXPECT_TRUE(same_bits(out.roll_deg, ref.roll_deg)) << host::kernel_name(k);
+    }
+}
+
+// Test that a batch lands at the requested offset without touching the rest
+TEST_F(BatchDecodeTest, WritesAtOffset) {
+    EngColumns out;
+    out.resize(20);
+    host::decode_batch(samples.data(), 10, out, 10);
+    EXPECT_EQ(out.time_us[0], 0u);
+    EXPECT_EQ(out.time_us[10], samples[0].time_us);
+    EXPECT_EQ(out.time_us[19], samples[9].time_us);
+}
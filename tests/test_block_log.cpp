@@ -0,0 +1,337 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+#include "block_log.h"
+#include "crc.h"
+
+// Emitter that appends blocks to an in-memory file, or refuses them
+namespace {
+    struct MemFile {
+        std::vector<uint8_t> bytes;
+        bool full = false;
+
+        static bool emit(void *ctx, const uint8_t *block) {
+            auto *self = static_cast<MemFile *>(ctx);
+            if (self->full) {
+                return false;
+            }
+            self->bytes.insert(self->bytes.end(), block, block + LOG_BLOCK_SIZE);
+            return true;
+        }
+
+        size_t blocks() const { return bytes.size() / LOG_BLOCK_SIZE; }
+        uint8_t *block(size_t i) { return &bytes[i * LOG_BLOCK_SIZE]; }
+    };
+
+    const uint32_t LOG_ID = 0x5EED1234;
+
+    sample_t make_sample(uint32_t i) {
+        sample_t s;
+        sample_clear(&s, 1000000ull + i * 10000ull);
+        sample_set(&s, SAMPLE_CH_TEMP, 2900 + (int32_t)(i % 50));
+        if (i % 4 == 0) {
+            sample_set(&s, SAMPLE_CH_HEADING, (int32_t)(i * 7 % SAMPLE_HEADING_MODULUS));
+            sample_set(&s, SAMPLE_CH_PITCH, (int32_t)(i % 11) - 5);
+        }
+        return s;
+    }
+}
+
+// Test fixture for the block log writer and block parser
+class BlockLogTest : public ::testing::Test {
+protected:
+    MemFile file;
+    block_log_t log;
+
+    void SetUp() override {
+        block_log_config_t config = {0x0123456789ABCDEFull, LOG_ID, 0, 0, LOG_NO_BLOCK, 0, 0};
+        block_log_init(&log, &config, MemFile::emit, &file);
+    }
+
+    void add(uint32_t count, uint32_t first = 0) {
+        for (uint32_t i = first; i < first + count; ++i) {
+            sample_t s = make_sample(i);
+            ASSERT_EQ(block_log_add(&log, &s), LOG_OK);
+        }
+    }
+};
+
+// Test the CRC-32 check value shared with zlib
+TEST_F(BlockLogTest, Crc32MatchesCheckValue) {
+    EXPECT_EQ(crc32(CRC32_INIT, "123456789", 9), 0xCBF43926u);
+    uint32_t crc = crc32(CRC32_INIT, "1234", 4);
+    EXPECT_EQ(crc32(crc, "56789", 5), 0xCBF43926u);
+}
+
+// Test that the log starts with a FILE block describing every channel
+TEST_F(BlockLogTest, FileBlockDescribesChannels) {
+    add(1);
+    ASSERT_GE(file.blocks(), 1u);
+
+    log_block_header_t hdr;
+    ASSERT_EQ(log_block_parse(file.block(0), LOG_ID, &hdr), LOG_OK);
+    EXPECT_EQ(hdr.type, LOG_BLOCK_FILE);
+    EXPECT_EQ(hdr.seq, 0u);
+    EXPECT_EQ(hdr.channel_count, SAMPLE_CH_COUNT);
+    EXPECT_EQ(hdr.device_id, 0x0123456789ABCDEFull);
+
+    EXPECT_EQ(log_file_id(file.block(0), &hdr), LOG_ID);
+
+    log_channel_desc_t channels[LOG_CHANNELS_MAX];
+    ASSERT_EQ(log_file_channels(file.block(0), &hdr, channels, LOG_CHANNELS_MAX), (size_t)SAMPLE_CH_COUNT);
+    EXPECT_STREQ(channels[SAMPLE_CH_TEMP].name, "temperature");
+    EXPECT_EQ(channels[SAMPLE_CH_TEMP].scale_shift, 7);
+    EXPECT_STREQ(channels[SAMPLE_CH_HEADING].name, "heading");
+    EXPECT_EQ(channels[SAMPLE_CH_HEADING].modulus, SAMPLE_HEADING_MODULUS);
+}
+
+// Test that samples survive the trip through full blocks, block by block
+TEST_F(BlockLogTest, DataBlocksRoundTrip) {
+    const uint32_t count = 3000;
+    add(count);
+    ASSERT_EQ(block_log_flush(&log), LOG_OK);
+    ASSERT_GT(file.blocks(), 3u);
+
+    uint32_t next = 0;
+    for (size_t b = 1; b < file.blocks(); ++b) {
+        log_block_header_t hdr;
+        ASSERT_EQ(log_block_parse(file.block(b), LOG_ID, &hdr), LOG_OK) << "block " << b;
+        ASSERT_EQ(hdr.type, LOG_BLOCK_DATA);
+        EXPECT_EQ(hdr.seq, b);
+        EXPECT_LE(hdr.payload_len, LOG_PAYLOAD_MAX);
+
+        // Header summarises the block
+        sample_t first = make_sample(next);
+        sample_t last = make_sample(next + hdr.record_count - 1);
+        EXPECT_EQ(hdr.first_time_us, first.time_us);
+        EXPECT_EQ(hdr.last_time_us, last.time_us);
+        EXPECT_EQ(hdr.sensor_mask, (1u << SAMPLE_CH_TEMP) | (1u << SAMPLE_CH_HEADING) | (1u << SAMPLE_CH_PITCH));
+
+        // Each block decodes without the ones before it
+        log_cursor_t cursor;
+        sample_t s;
+        log_cursor_init(&cursor, file.block(b), &hdr);
+        uint16_t n = 0;
+        while (log_cursor_next(&cursor, &s) == 1) {
+            sample_t want = make_sample(next++);
+            ASSERT_EQ(s.time_us, want.time_us);
+            ASSERT_EQ(s.valid, want.valid);
+            ASSERT_EQ(memcmp(s.value, want.value, sizeof(s.value)), 0);
+            n++;
+        }
+        EXPECT_EQ(n, hdr.record_count);
+    }
+    EXPECT_EQ(next, count);
+}
+
+// Test that corruption anywhere in a block is caught
+TEST_F(BlockLogTest, DetectsCorruption) {
+    add(200);
+    block_log_flush(&log);
+    ASSERT_EQ(file.blocks(), 2u);
+
+    log_block_header_t hdr;
+    std::vector<uint8_t> saved(file.block(1), file.block(1) + LOG_BLOCK_SIZE);
+    file.block(1)[LOG_HEADER_SIZE + 10] ^= 0x01;
+    EXPECT_EQ(log_block_parse(file.block(1), LOG_ID, &hdr), LOG_ERR_CRC);
+
+    memcpy(file.block(1), saved.data(), LOG_BLOCK_SIZE);
+    file.block(1)[30] ^= 0x80;     // Last-time field
+    EXPECT_EQ(log_block_parse(file.block(1), LOG_ID, &hdr), LOG_ERR_CRC);
+
+    // An intact block from a different log does not verify as part of this one
+    memcpy(file.block(1), saved.data(), LOG_BLOCK_SIZE);
+    EXPECT_EQ(log_block_parse(file.block(1), LOG_ID, &hdr), LOG_OK);
+    EXPECT_EQ(log_block_parse(file.block(1), LOG_ID + 1, &hdr), LOG_ERR_CRC);
+
+    std::vector<uint8_t> erased(LOG_BLOCK_SIZE, 0xFF);
+    EXPECT_EQ(log_block_parse(erased.data(), LOG_ID, &hdr), LOG_ERR_MAGIC);
+}
+
+// Test that a refused block is kept and offered again, and no sample is lost
+TEST_F(BlockLogTest, HoldsBlockWhileEmitterIsFull) {
+    file.full = true;
+    sample_t s = make_sample(0);
+    EXPECT_EQ(block_log_add(&log, &s), LOG_BUSY);     // FILE block cannot go out
+
+    file.full = false;
+    uint32_t i = 0;
+    while (file.blocks() < 2) {
+        s = make_sample(i);
+        ASSERT_EQ(block_log_add(&log, &s), LOG_OK);
+        i++;
+    }
+
+    // The next full block is refused: samples are turned away, not dropped silently
+    file.full = true;
+    uint32_t busy = 0;
+    for (uint32_t n = 0; n < 2000; ++n) {
+        s = make_sample(i);
+        if (block_log_add(&log, &s) == LOG_BUSY) {
+            busy++;
+        } else {
+            i++;
+        }
+    }
+    EXPECT_GT(busy, 0u);
+    EXPECT_EQ(file.blocks(), 2u);
+
+    file.full = false;
+    EXPECT_EQ(block_log_pump(&log), LOG_OK);
+    block_log_flush(&log);
+
+    // Everything accepted is in the file, in order
+    uint32_t next = 0;
+    for (size_t b = 1; b < file.blocks(); ++b) {
+        log_block_header_t hdr;
+        ASSERT_EQ(log_block_parse(file.block(b), LOG_ID, &hdr), LOG_OK);
+        log_cursor_t cursor;
+        log_cursor_init(&cursor, file.block(b), &hdr);
+        while (log_cursor_next(&cursor, &s) == 1) {
+            ASSERT_EQ(s.time_us, make_sample(next++).time_us);
+        }
+    }
+    EXPECT_EQ(next, i);
+}
+
+// Test that an index block follows every LOG_INDEX_INTERVAL data blocks
+TEST_F(BlockLogTest, WritesChainedIndexBlocks) {
+    uint32_t i = 0;
+    while (file.blocks() < 2 * (LOG_INDEX_INTERVAL + 1) + 1) {
+        sample_t s = make_sample(i++);
+        ASSERT_EQ(block_log_add(&log, &s), LOG_OK);
+    }
+
+    const size_t first_index = LOG_INDEX_INTERVAL + 1;
+    const size_t second_index = 2 * (LOG_INDEX_INTERVAL + 1);
+    log_block_header_t hdr;
+    log_index_entry_t entries[LOG_INDEX_INTERVAL];
+    uint32_t prev = 0;
+
+    ASSERT_EQ(log_block_parse(file.block(first_index), LOG_ID, &hdr), LOG_OK);
+    ASSERT_EQ(hdr.type, LOG_BLOCK_INDEX);
+    ASSERT_EQ(log_index_entries(file.block(first_index), &hdr, entries, LOG_INDEX_INTERVAL, &prev),
+              (size_t)LOG_INDEX_INTERVAL);
+    EXPECT_EQ(prev, LOG_NO_BLOCK);
+    EXPECT_EQ(entries[0].block, 1u);
+    EXPECT_EQ(entries[LOG_INDEX_INTERVAL - 1].block, (uint32_t)LOG_INDEX_INTERVAL);
+    EXPECT_EQ(hdr.first_time_us, entries[0].first_time_us);
+
+    log_block_header_t data;
+    ASSERT_EQ(log_block_parse(file.block(LOG_INDEX_INTERVAL), LOG_ID, &data), LOG_OK);
+    EXPECT_EQ(hdr.last_time_us, data.last_time_us);
+
+    ASSERT_EQ(log_block_parse(file.block(second_index), LOG_ID, &hdr), LOG_OK);
+    ASSERT_EQ(hdr.type, LOG_BLOCK_INDEX);
+    log_index_entries(file.block(second_index), &hdr, entries, LOG_INDEX_INTERVAL, &prev);
+    EXPECT_EQ(prev, first_index);
+    EXPECT_EQ(entries[0].block, first_index + 1);
+}
+
+// Test the index lookup at and between entry boundaries
+TEST_F(BlockLogTest, IndexFindPicksContainingBlock) {
+    log_index_entry_t entries[3] = {{100, 1, 0}, {200, 2, 0}, {300, 3, 0}};
+    EXPECT_EQ(log_index_find(entries, 3, 50), 0u);
+    EXPECT_EQ(log_index_find(entries, 3, 100), 0u);
+    EXPECT_EQ(log_index_find(entries, 3, 199), 0u);
+    EXPECT_EQ(log_index_find(entries, 3, 200), 1u);
+    EXPECT_EQ(log_index_find(entries, 3, 1000), 2u);
+}
+
+// Test that a fixed file size starts a new log, with its own FILE block and
+// ID, exactly at the file boundary, and that each file ends with its index
+TEST_F(BlockLogTest, StartsNewFileAtFileBoundary) {
+    const uint32_t file_blocks = 10;
+    block_log_config_t config = {1, LOG_ID, file_blocks, 0, LOG_NO_BLOCK, 0, 0};
+    block_log_init(&log, &config, MemFile::emit, &file);
+
+    uint32_t i = 0;
+    while (file.blocks() < 2 * file_blocks + 1) {
+        sample_t s = make_sample(i++);
+        ASSERT_EQ(block_log_add(&log, &s), LOG_OK);
+    }
+    EXPECT_EQ(log.files, 3u);
+
+    log_block_header_t hdr;
+    ASSERT_EQ(log_block_parse(file.block(file_blocks - 1), LOG_ID, &hdr), LOG_OK);
+    EXPECT_EQ(hdr.type, LOG_BLOCK_INDEX);
+    EXPECT_EQ(hdr.record_count, file_blocks - 2);
+
+    ASSERT_EQ(log_block_parse(file.block(file_blocks), 0, &hdr), LOG_OK);
+    EXPECT_EQ(hdr.type, LOG_BLOCK_FILE);
+    EXPECT_EQ(hdr.seq, 0u);
+    uint32_t next_id = log_file_id(file.block(file_blocks), &hdr);
+    EXPECT_NE(next_id, LOG_ID);
+
+    ASSERT_EQ(log_block_parse(file.block(file_blocks + 1), next_id, &hdr), LOG_OK);
+    EXPECT_EQ(hdr.type, LOG_BLOCK_DATA);
+    EXPECT_EQ(hdr.seq, 1u);
+    EXPECT_EQ(log_block_parse(file.block(file_blocks + 1), LOG_ID, &hdr), LOG_ERR_CRC);
+}
+
+// Test that every data block of a full file is indexed when an index
+// block lands one block before the end: the file then ends a block short
+TEST_F(BlockLogTest, IndexesEveryDataBlockOfFullFile) {
+    const uint32_t file_blocks = LOG_INDEX_INTERVAL + 3;
+    block_log_config_t config = {1, LOG_ID, file_blocks, 0, LOG_NO_BLOCK, 0, 0};
+    block_log_init(&log, &config, MemFile::emit, &file);
+
+    uint32_t i = 0;
+    while (file.blocks() < 2 * file_blocks) {
+        sample_t s = make_sample(i++);
+        ASSERT_EQ(block_log_add(&log, &s), LOG_OK);
+    }
+
+    log_block_header_t hdr;
+    ASSERT_EQ(log_block_parse(file.block(file_blocks - 1), 0, &hdr), LOG_OK);
+    EXPECT_EQ(hdr.type, LOG_BLOCK_FILE);
+
+    std::vector<uint32_t> data, indexed;
+    uint32_t log_id = LOG_ID;
+    for (size_t b = 0; b < file_blocks - 1; ++b) {
+        ASSERT_EQ(log_block_parse(file.block(b), log_id, &hdr), LOG_OK) << b;
+        if (hdr.type == LOG_BLOCK_DATA) {
+            data.push_back(hdr.seq);
+        } else if (hdr.type == LOG_BLOCK_INDEX) {
+            log_index_entry_t entries[LOG_INDEX_INTERVAL];
+            uint32_t prev;
+            size_t n = log_index_entries(file.block(b), &hdr, entries, LOG_INDEX_INTERVAL, &prev);
+            for (size_t e = 0; e < n; ++e) {
+                indexed.push_back(entries[e].block);
+            }
+        }
+    }
+    EXPECT_EQ(data.size(), (size_t)LOG_INDEX_INTERVAL);
+    EXPECT_EQ(indexed, data);
+}
+
+// Test that file_us ends a log early: last data block, its index, then
+// the next log's FILE block, with the next sample first in the new log
+TEST_F(BlockLogTest, StartsNewFileAfterFileTime) {
+    block_log_config_t config = {1, LOG_ID, 0, 0, LOG_NO_BLOCK, 0, 1000000};
+    block_log_init(&log, &config, MemFile::emit, &file);
+    add(250);       // 2.5 s at 100 Hz
+
+    EXPECT_EQ(log.files, 3u);
+    ASSERT_EQ(file.blocks(), 7u);      // Two logs of three blocks, then the FILE block of the third
+    const uint8_t types[] = {LOG_BLOCK_FILE, LOG_BLOCK_DATA, LOG_BLOCK_INDEX};
+    uint32_t log_id = LOG_ID;
+    for (size_t b = 0; b < file.blocks(); ++b) {
+        log_block_header_t hdr;
+        ASSERT_EQ(log_block_parse(file.block(b), log_id, &hdr), LOG_OK) << b;
+        EXPECT_EQ(hdr.type, types[b % 3]) << b;
+        EXPECT_EQ(hdr.seq, b % 3) << b;
+        if (hdr.type == LOG_BLOCK_FILE) {
+            log_id = log_file_id(file.block(b), &hdr);
+        } else if (hdr.type == LOG_BLOCK_DATA) {
+            EXPECT_EQ(hdr.record_count, 100u);
+            EXPECT_EQ(hdr.first_time_us, make_sample(uint32_t(b / 3 * 100)).time_us);
+        }
+    }
+
+    // The third log has its first 50 samples in the block being built
+    ASSERT_EQ(block_log_flush(&log), LOG_OK);
+    log_block_header_t hdr;
+    ASSERT_EQ(log_block_parse(file.block(7), log_id, &hdr), LOG_OK);
+    EXPECT_EQ(hdr.record_count, 50u);
+}
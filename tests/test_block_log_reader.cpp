@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "block_log_reader.hpp"
+
+// Builds a log in memory with one sample every 10 ms
+namespace {
+    bool append_block(void *ctx, const uint8_t *block) {
+        auto *bytes = static_cast<std::vector<uint8_t> *>(ctx);
+        bytes->insert(bytes->end(), block, block + LOG_BLOCK_SIZE);
+        return true;
+    }
+
+    uint64_t sample_time(uint32_t i) {
+        return 5000000ull + i * 10000ull;
+    }
+
+    std::vector<uint8_t> build_log(uint32_t samples) {
+        std::vector<uint8_t> bytes;
+        static block_log_t log;
+        block_log_config_t config = {42, 0xC0FFEE, 0, 0, LOG_NO_BLOCK, 0, 0};
+        block_log_init(&log, &config, append_block, &bytes);
+        for (uint32_t i = 0; i < samples; ++i) {
+            sample_t s;
+            sample_clear(&s, sample_time(i));
+            sample_set(&s, SAMPLE_CH_TEMP, (int32_t)(i % 1000));
+            block_log_add(&log, &s);
+        }
+        block_log_flush(&log);
+        return bytes;
+    }
+}
+
+// Test fixture for the host-side block log reader
+class BlockLogReaderTest : public ::testing::Test {
+protected:
+    std::vector<uint64_t> read(host::BlockLogReader &reader, uint64_t t0, uint64_t t1) {
+        std::vector<uint64_t> times;
+        reader.read_range(t0, t1, [&](const sample_t &s) { times.push_back(s.time_us); });
+        return times;
+    }
+};
+
+// Test that the FILE block is recognised
+TEST_F(BlockLogReaderTest, ReadsFileBlock) {
+    std::vector<uint8_t> bytes = build_log(10);
+    host::BlockLogReader reader(bytes.data(), bytes.size());
+    ASSERT_TRUE(reader.valid());
+    EXPECT_EQ(reader.device_id(), 42u);
+    EXPECT_EQ(reader.log_id(), 0xC0FFEEu);
+    EXPECT_EQ(reader.channels().size(), (size_t)SAMPLE_CH_COUNT);
+
+    std::vector<uint8_t> junk(LOG_BLOCK_SIZE, 0);
+    host::BlockLogReader bad(junk.data(), junk.size());
+    EXPECT_FALSE(bad.valid());
+}
+
+// Test a time-range read deep in a large log: exact results, and the
+// index keeps the number of headers touched far below the block count
+TEST_F(BlockLogReaderTest, SeeksThroughIndex) {
+    const uint32_t count = 200000;
+    std::vector<uint8_t> bytes = build_log(count);
+    host::BlockLogReader reader(bytes.data(), bytes.size());
+    ASSERT_TRUE(reader.valid());
+    ASSERT_GT(reader.block_count(), 3u * LOG_INDEX_INTERVAL);
+
+    uint32_t from = 123457;
+    uint32_t to = 123600;
+    std::vector<uint64_t> times = read(reader, sample_time(from), sample_time(to));
+    ASSERT_EQ(times.size(), (size_t)(to - from));
+    EXPECT_EQ(times.front(), sample_time(from));
+    EXPECT_EQ(times.back(), sample_time(to - 1));
+
+    EXPECT_GT(reader.stats().index_blocks, 0u);
+    EXPECT_LT(reader.stats().blocks_parsed, reader.block_count() / 4);
+    EXPECT_EQ(reader.stats().bad_blocks, 0u);
+}
+
+// Test ranges at the edges of the log
+TEST_F(BlockLogReaderTest, HandlesEdgeRanges) {
+    const uint32_t count = 50000;
+    std::vector<uint8_t> bytes = build_log(count);
+    host::BlockLogReader reader(bytes.data(), bytes.size());
+
+    EXPECT_EQ(read(reader, 0, sample_time(5)).size(), 5u);
+    EXPECT_EQ(read(reader, sample_time(count - 3), UINT64_MAX).size(), 3u);
+    EXPECT_TRUE(read(reader, sample_time(count) + 1, UINT64_MAX).empty());
+    EXPECT_EQ(read(reader, 0, UINT64_MAX).size(), (size_t)count);
+}
+
+// Test that damaged blocks, including an index block, are skipped
+TEST_F(BlockLogReaderTest, SurvivesDamagedBlocks) {
+    const uint32_t count = 50000;
+    std::vector<uint8_t> bytes = build_log(count);
+
+    // Wreck every index block and one data block
+    for (size_t b = LOG_INDEX_INTERVAL + 1; b * LOG_BLOCK_SIZE < bytes.size(); b += LOG_INDEX_INTERVAL + 1) {
+        bytes[b * LOG_BLOCK_SIZE + LOG_HEADER_SIZE] ^= 0xFF;
+    }
+    bytes[10 * LOG_BLOCK_SIZE + LOG_HEADER_SIZE + 3] ^= 0xFF;
+
+    host::BlockLogReader reader(bytes.data(), bytes.size());
+    std::vector<uint64_t> times = read(reader, 0, UINT64_MAX);
+    EXPECT_LT(times.size(), (size_t)count);
+    EXPECT_GT(reader.stats().bad_blocks, 0u);
+    for (size_t i = 1; i < times.size(); ++i) {
+        ASSERT_LT(times[i - 1], times[i]);
+    }
+
+    // A range that avoids the damaged data block is still complete
+    EXPECT_EQ(read(reader, sample_time(40000), sample_time(40100)).size(), 100u);
+}
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include "change_filter.h"
+
+// Test fixture for report-on-change filtering
+class ChangeFilterTest : public ::testing::Test {
+protected:
+    change_filter_t filter;
+    sample_t sample;
+
+    void SetUp() override {
+        change_filter_init(&filter);
+    }
+
+    void TearDown() override {
+        // Cleanup if needed
+    }
+
+    uint32_t apply(uint64_t time_ms, sample_channel_t ch, int32_t value) {
+        sample_clear(&sample, time_ms * 1000);
+        sample_set(&sample, ch, value);
+        return change_filter_apply(&filter, &sample);
+    }
+};
+
+// Test that the first value of every channel is always reported
+TEST_F(ChangeFilterTest, FirstValueIsReported) {
+    sample_clear(&sample, 0);
+    sample_set(&sample, SAMPLE_CH_TEMP, 3000);
+    sample_set(&sample, SAMPLE_CH_HEADING, 1800);
+    EXPECT_EQ(change_filter_apply(&filter, &sample),
+              (1u << SAMPLE_CH_TEMP) | (1u << SAMPLE_CH_HEADING));
+}
+
+// Test that changes inside the deadband are suppressed
+TEST_F(ChangeFilterTest, SuppressesChangesInsideDeadband) {
+    change_filter_configure(&filter, SAMPLE_CH_TEMP, 6, 0);
+    ASSERT_NE(apply(0, SAMPLE_CH_TEMP, 3000), 0u);
+
+    EXPECT_EQ(apply(1000, SAMPLE_CH_TEMP, 3006), 0u);
+    EXPECT_EQ(apply(2000, SAMPLE_CH_TEMP, 2994), 0u);
+    EXPECT_EQ(apply(3000, SAMPLE_CH_TEMP, 3007), 1u << SAMPLE_CH_TEMP);
+}
+
+// Test that the reference moves with each report, so slow drift is still seen
+TEST_F(ChangeFilterTest, ReportsSlowDrift) {
+    change_filter_configure(&filter, SAMPLE_CH_TEMP, 6, 0);
+    int reports = 0;
+    for (int i = 0; i < 100; ++i) {
+        if (apply(i * 1000, SAMPLE_CH_TEMP, 3000 + i)) {
+            reports++;
+        }
+    }
+    // First value plus one report every 7 steps
+    EXPECT_EQ(reports, 1 + 99 / 7);
+}
+
+// Test that an unchanged channel is re-reported after the heartbeat interval
+TEST_F(ChangeFilterTest, HeartbeatReportsUnchangedChannel) {
+    change_filter_configure(&filter, SAMPLE_CH_PITCH, 1, 5000);
+    ASSERT_NE(apply(0, SAMPLE_CH_PITCH, 2), 0u);
+
+    EXPECT_EQ(apply(4999, SAMPLE_CH_PITCH, 2), 0u);
+    EXPECT_EQ(apply(5000, SAMPLE_CH_PITCH, 2), 1u << SAMPLE_CH_PITCH);
+    EXPECT_EQ(apply(9999, SAMPLE_CH_PITCH, 2), 0u);
+    EXPECT_EQ(apply(10000, SAMPLE_CH_PITCH, 2), 1u << SAMPLE_CH_PITCH);
+}
+
+// Test circular distance at the 3600-tenths wraparound
+TEST_F(ChangeFilterTest, HeadingDistanceWrapsAround) {
+    EXPECT_EQ(change_filter_distance(3599, 0, SAMPLE_HEADING_MODULUS), 1);
+    EXPECT_EQ(change_filter_distance(0, 3599, SAMPLE_HEADING_MODULUS), 1);
+    EXPECT_EQ(change_filter_distance(100, 3500, SAMPLE_HEADING_MODULUS), 200);
+    EXPECT_EQ(change_filter_distance(0, 1800, SAMPLE_HEADING_MODULUS), 1800);
+    EXPECT_EQ(change_filter_distance(3599, 0, 0), 3599);
+}
+
+// Test that a heading jittering across north is not reported as a big jump
+TEST_F(ChangeFilterTest, HeadingJitterAcrossNorthIsSuppressed) {
+    change_filter_configure(&filter, SAMPLE_CH_HEADING, 10, 0);
+    ASSERT_NE(apply(0, SAMPLE_CH_HEADING, 3598), 0u);
+
+    EXPECT_EQ(apply(100, SAMPLE_CH_HEADING, 2), 0u);
+    EXPECT_EQ(apply(200, SAMPLE_CH_HEADING, 3590), 0u);
+    EXPECT_EQ(apply(300, SAMPLE_CH_HEADING, 9), 1u << SAMPLE_CH_HEADING);
+}
+
+// Test the bandwidth reduction on a steady, noisy trace
+TEST_F(ChangeFilterTest, SteadyTraceCutsOutputByOrderOfMagnitude) {
+    srand(1);
+    for (int i = 0; i < 3600; ++i) {
+        sample_clear(&sample, (uint64_t)i * 1000000);
+        sample_set(&sample, SAMPLE_CH_TEMP, 2998 + rand() % 5 - 2);
+        sample_set(&sample, SAMPLE_CH_HEADING, (3600 + rand() % 9 - 4) % 3600);
+        sample_set(&sample, SAMPLE_CH_ANGLE8, 0);
+        sample_set(&sample, SAMPLE_CH_PITCH, 1);
+        sample_set(&sample, SAMPLE_CH_ROLL, -1);
+        change_filter_apply(&filter, &sample);
+    }
+    EXPECT_EQ(filter.values_seen, 3600u * 5);
+    EXPECT_LT(filter.values_reported * 10, filter.values_seen);
+}
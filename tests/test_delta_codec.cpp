@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include "delta_codec.h"
+
+// Test fixture for the delta + zigzag varint codec
+class DeltaCodecTest : public ::testing::Test {
+protected:
+    delta_codec_t enc;
+    delta_codec_t dec;
+
+    void SetUp() override {
+        delta_codec_init(&enc, 8);
+        delta_codec_init(&dec, 8);
+    }
+
+    // Encode then decode one sample, returning the encoded size
+    size_t round_trip(const sample_t &in, sample_t &out) {
+        uint8_t buf[DELTA_RECORD_MAX];
+        size_t len = delta_encode(&enc, &in, buf, sizeof(buf));
+        size_t used = 0;
+        EXPECT_EQ(delta_decode(&dec, buf, len, &out, &used), DELTA_OK);
+        EXPECT_EQ(used, len);
+        return len;
+    }
+
+    static sample_t make(uint64_t time_us, int32_t temp, int32_t heading) {
+        sample_t s;
+        sample_clear(&s, time_us);
+        sample_set(&s, SAMPLE_CH_TEMP, temp);
+        sample_set(&s, SAMPLE_CH_HEADING, heading);
+        return s;
+    }
+};
+
+// Test that zigzag keeps small magnitudes small and is reversible
+TEST_F(DeltaCodecTest, ZigzagMapping) {
+    EXPECT_EQ(zigzag_encode(0), 0u);
+    EXPECT_EQ(zigzag_encode(-1), 1u);
+    EXPECT_EQ(zigzag_encode(1), 2u);
+    EXPECT_EQ(zigzag_encode(-2), 3u);
+    EXPECT_EQ(zigzag_encode(INT32_MIN), 0xFFFFFFFFu);
+    for (int32_t v : {0, 1, -1, 63, -64, 1000000, INT32_MAX, INT32_MIN}) {
+        EXPECT_EQ(zigzag_decode(zigzag_encode(v)), v);
+    }
+}
+
+// Test varint lengths and truncated input
+TEST_F(DeltaCodecTest, VarintRoundTrip) {
+    uint8_t buf[10];
+    uint64_t v = 0;
+
+    EXPECT_EQ(varint_put(127, buf), 1u);
+    EXPECT_EQ(varint_put(128, buf), 2u);
+    EXPECT_EQ(varint_put(UINT64_MAX, buf), 10u);
+    EXPECT_EQ(varint_get(buf, 10, &v), 10u);
+    EXPECT_EQ(v, UINT64_MAX);
+
+    size_t n = varint_put(300, buf);
+    EXPECT_EQ(varint_get(buf, n - 1, &v), 0u);
+    EXPECT_EQ(varint_get(buf, n, &v), n);
+    EXPECT_EQ(v, 300u);
+}
+
+// Test that a slowly changing stream is lossless and small
+TEST_F(DeltaCodecTest, RandomWalkRoundTrip) {
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> step(-3, 3);
+    sample_t in = make(0, 2900, 0);
+    sample_t out;
+
+    for (int i = 0; i < 1000; ++i) {
+        in.time_us += 50000;
+        in.value[SAMPLE_CH_TEMP] += step(rng);
+        in.value[SAMPLE_CH_HEADING] = (in.value[SAMPLE_CH_HEADING] + step(rng) + 3600) % 3600;
+        if (i % 97 == 0) {
+            in.valid ^= 1u << SAMPLE_CH_PITCH;
+            in.value[SAMPLE_CH_PITCH] = -i;
+        }
+        round_trip(in, out);
+        ASSERT_EQ(out.time_us, in.time_us);
+        ASSERT_EQ(out.valid, in.valid);
+        for (int ch = 0; ch < SAMPLE_CH_COUNT; ++ch) {
+            if (in.valid & (1u << ch)) {
+                ASSERT_EQ(out.value[ch], in.value[ch]) << "record " << i << " channel " << ch;
+            }
+        }
+    }
+}
+
+// Test that keyframes come at the configured interval
+TEST_F(DeltaCodecTest, KeyframeInterval) {
+    uint8_t buf[DELTA_RECORD_MAX];
+    int keyframes = 0;
+    for (int i = 0; i < 32; ++i) {
+        sample_t s = make(i * 1000, 2900, 100);
+        delta_encode(&enc, &s, buf, sizeof(buf));
+        if (buf[0] & DELTA_FLAG_KEYFRAME) {
+            EXPECT_EQ(i % 8, 0);
+            keyframes++;
+        }
+    }
+    EXPECT_EQ(keyframes, 4);
+}
+
+// Test that crossing north is a one-byte delta rather than a 3599 jump
+TEST_F(DeltaCodecTest, HeadingWrapIsSmall) {
+    sample_t out;
+    sample_t a;
+    sample_clear(&a, 1000);
+    sample_set(&a, SAMPLE_CH_HEADING, 3598);
+    round_trip(a, out);
+
+    sample_t b = a;
+    b.time_us = 1001;
+    b.value[SAMPLE_CH_HEADING] = 2;
+    // flags, time delta, heading delta
+    EXPECT_EQ(round_trip(b, out), 3u);
+    EXPECT_EQ(out.value[SAMPLE_CH_HEADING], 2);
+}
+
+// Test that a heading outside its range is sent as a keyframe, not mangled
+TEST_F(DeltaCodecTest, OutOfRangeCircularValueStaysLossless) {
+    sample_t out;
+    round_trip(make(0, 2900, 100), out);
+
+    uint8_t buf[DELTA_RECORD_MAX];
+    sample_t odd = make(1000, 2900, 4000);
+    size_t len = delta_encode(&enc, &odd, buf, sizeof(buf));
+    EXPECT_TRUE(buf[0] & DELTA_FLAG_KEYFRAME);
+
+    size_t used = 0;
+    ASSERT_EQ(delta_decode(&dec, buf, len, &out, &used), DELTA_OK);
+    EXPECT_EQ(out.value[SAMPLE_CH_HEADING], 4000);
+}
+
+// Test that decoding cannot start in the middle of a delta run
+TEST_F(DeltaCodecTest, DeltaBeforeKeyframeIsRejected) {
+    uint8_t buf[DELTA_RECORD_MAX];
+    sample_t s = make(0, 2900, 100);
+    delta_encode(&enc, &s, buf, sizeof(buf));
+    s.time_us = 1000;
+    size_t len = delta_encode(&enc, &s, buf, sizeof(buf));
+
+    sample_t out;
+    size_t used = 0;
+    EXPECT_EQ(delta_decode(&dec, buf, len, &out, &used), DELTA_ERR_NO_KEYFRAME);
+}
+
+// Test that truncated records are reported and leave the state untouched
+TEST_F(DeltaCodecTest, TruncatedRecord) {
+    uint8_t buf[DELTA_RECORD_MAX];
+    sample_t s = make(123456789, -2000, 1800);
+    size_t len = delta_encode(&enc, &s, buf, sizeof(buf));
+
+    sample_t out;
+    size_t used = 0;
+    for (size_t cut = 0; cut < len; ++cut) {
+        EXPECT_EQ(delta_decode(&dec, buf, cut, &out, &used), DELTA_ERR_TRUNCATED);
+    }
+    EXPECT_FALSE(dec.primed);
+    EXPECT_EQ(delta_decode(&dec, buf, len, &out, &used), DELTA_OK);
+    EXPECT_EQ(out.value[SAMPLE_CH_TEMP], -2000);
+}
@@ -0,0 +1,228 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "dht.h"
+
+// Mock capture: the state machine and DMA, replaced by a pulse train that
+// arrives on the test's clock. After the start pulse the sensor waits,
+// answers low for 80 us, then each high pulse is followed by 50 us low;
+// DMA has a width once its pulse has ended.
+namespace {
+    uint32_t mock_now_us;
+    bool mock_present;
+    std::vector<uint32_t> mock_trace;
+    bool mock_running;
+    uint32_t mock_start_us;
+    uint32_t mock_hold_us;
+    uint32_t mock_starts;
+    uint32_t mock_stops;
+
+    // A DHT22 at 65.2 %RH and 35.1 °C, in the form the capture produces:
+    // the answer pulse, then 40 bits
+    const uint32_t kDht22Trace[DHT_PULSES] = {
+        80, 25, 24, 28, 27, 25, 24, 71, 24, 70, 26, 24, 26, 73, 70, 28, 27, 24, 28, 24, 28,
+        26, 26, 27, 70, 25, 69, 28, 73, 73, 69, 71, 73, 71, 71, 70, 27, 71, 73, 70, 26,
+    };
+
+    // Widths for five bytes, with a few us of spread
+    std::vector<uint32_t> trace(const uint8_t bytes[5]) {
+        std::vector<uint32_t> widths = {81};
+        for (int i = 0; i < DHT_BITS; ++i) {
+            bool one = (bytes[i / 8] >> (7 - i % 8)) & 1;
+            widths.push_back((one ? 68 : 23) + uint32_t(i * 7 % 5));
+        }
+        return widths;
+    }
+
+    std::vector<uint32_t> trace(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3) {
+        const uint8_t bytes[5] = {b0, b1, b2, b3, uint8_t(b0 + b1 + b2 + b3)};
+        return trace(bytes);
+    }
+}
+
+extern "C" {
+    int dht_port_init(dht_t *d) {
+        (void)d;
+        return 5;
+    }
+
+    void dht_port_start(dht_t *d, uint32_t hold_us) {
+        (void)d;
+        mock_running = true;
+        mock_start_us = mock_now_us;
+        mock_hold_us = hold_us;
+        mock_starts++;
+    }
+
+    // Copy in the pulses that have ended by now, as DMA would
+    uint32_t dht_port_remaining(const dht_t *d) {
+        if (!mock_running || !mock_present) {
+            return DHT_PULSES;
+        }
+        uint32_t t = mock_start_us + mock_hold_us + 30 + 80;
+        uint32_t done = 0;
+        for (uint32_t width : mock_trace) {
+            t += width;
+            if (done == DHT_PULSES || int32_t(mock_now_us - t) < 0) {
+                break;
+            }
+            const_cast<dht_t *>(d)->pulses[done++] = width;
+            t += 50;
+        }
+        return DHT_PULSES - done;
+    }
+
+    void dht_port_stop(dht_t *d) {
+        (void)d;
+        mock_running = false;
+        mock_stops++;
+    }
+}
+
+// Test fixture for the DHT capture and decoder
+class DhtTest : public ::testing::Test {
+protected:
+    dht_t d;
+    dht_reading_t r;
+
+    void SetUp() override {
+        mock_now_us = 1000000;
+        mock_present = true;
+        mock_trace.assign(kDht22Trace, kDht22Trace + DHT_PULSES);
+        mock_running = false;
+        mock_starts = mock_stops = 0;
+        dht_init(&d, DHT_TYPE_22, nullptr, 15);
+    }
+
+    // Poll every 100 us for 'us'; returns what the polls reported
+    std::vector<int> run(uint32_t us) {
+        std::vector<int> seen;
+        for (uint32_t end = mock_now_us + us; int32_t(end - mock_now_us) > 0; mock_now_us += 100) {
+            int status = dht_poll(&d, mock_now_us);
+            if (status != DHT_WAIT) {
+                seen.push_back(status);
+            }
+        }
+        return seen;
+    }
+};
+
+// Test that a DHT22 trace decodes to tenths of a percent and a degree
+TEST_F(DhtTest, DecodesDht22Trace) {
+    ASSERT_EQ(dht_decode(kDht22Trace, DHT_TYPE_22, &r), DHT_DECODE_OK);
+    EXPECT_EQ(r.humidity, 652);
+    EXPECT_EQ(r.temperature, 351);
+}
+
+// Test the DHT22's sign-and-magnitude temperature and the DHT11's whole
+// units with a tenths byte
+TEST_F(DhtTest, DecodesNegativeAndDht11) {
+    std::vector<uint32_t> cold = trace(0x03, 0xD4, 0x80, 0x65);
+    ASSERT_EQ(dht_decode(cold.data(), DHT_TYPE_22, &r), DHT_DECODE_OK);
+    EXPECT_EQ(r.humidity, 980);
+    EXPECT_EQ(r.temperature, -101);
+
+    std::vector<uint32_t> dht11 = trace(45, 0, 23, 4);
+    ASSERT_EQ(dht_decode(dht11.data(), DHT_TYPE_11, &r), DHT_DECODE_OK);
+    EXPECT_EQ(r.humidity, 450);
+    EXPECT_EQ(r.temperature, 234);
+}
+
+// Test that widths anywhere in the spread of real parts decode the same,
+// whichever side of nominal they fall
+TEST_F(DhtTest, ToleratesPulseSpread) {
+    for (uint32_t zero = 15; zero <= 40; ++zero) {
+        for (uint32_t one = 55; one <= 90; one += 5) {
+            uint32_t pulses[DHT_PULSES];
+            pulses[0] = 80;
+            for (int i = 1; i < DHT_PULSES; ++i) {
+                pulses[i] = kDht22Trace[i] >= 48 ? one : zero;
+            }
+            ASSERT_EQ(dht_decode(pulses, DHT_TYPE_22, &r), DHT_DECODE_OK) << zero << " " << one;
+            EXPECT_EQ(r.humidity, 652);
+            EXPECT_EQ(r.temperature, 351);
+        }
+    }
+}
+
+// Test that a bit read wrong fails the checksum and leaves the last
+// reading alone
+TEST_F(DhtTest, RejectsChecksumMismatch) {
+    ASSERT_EQ(dht_decode(kDht22Trace, DHT_TYPE_22, &r), DHT_DECODE_OK);
+    uint32_t pulses[DHT_PULSES];
+    std::copy(kDht22Trace, kDht22Trace + DHT_PULSES, pulses);
+    pulses[12] = 70;
+    EXPECT_EQ(dht_decode(pulses, DHT_TYPE_22, &r), DHT_DECODE_BAD_CHECKSUM);
+    EXPECT_EQ(r.humidity, 652);
+}
+
+// Test that a glitch splitting a pulse, two pulses run together, or a
+// capture that missed the answer pulse is caught before the checksum
+TEST_F(DhtTest, RejectsGlitchedPulses) {
+    uint32_t pulses[DHT_PULSES];
+    std::copy(kDht22Trace, kDht22Trace + DHT_PULSES, pulses);
+    pulses[20] = 6;
+    EXPECT_EQ(dht_decode(pulses, DHT_TYPE_22, &r), DHT_DECODE_BAD_PULSE);
+
+    std::copy(kDht22Trace, kDht22Trace + DHT_PULSES, pulses);
+    pulses[7] = 71 + 50 + 24;
+    EXPECT_EQ(dht_decode(pulses, DHT_TYPE_22, &r), DHT_DECODE_BAD_PULSE);
+
+    // The capture started a pulse late: everything moves up one
+    std::copy(kDht22Trace + 1, kDht22Trace + DHT_PULSES, pulses);
+    pulses[DHT_PULSES - 1] = 26;
+    EXPECT_EQ(dht_decode(pulses, DHT_TYPE_22, &r), DHT_DECODE_BAD_PULSE);
+}
+
+// Test that a reading is started, left to the capture while polls return
+// at once, decoded when DMA has every pulse, and not repeated sooner than
+// the sensor allows
+TEST_F(DhtTest, PollsCaptureToCompletion) {
+    EXPECT_EQ(dht_poll(&d, mock_now_us), DHT_WAIT);
+    EXPECT_EQ(mock_starts, 1u);
+    EXPECT_EQ(mock_hold_us, dht_hold_us(DHT_TYPE_22));
+    EXPECT_EQ(dht_take(&d), nullptr);
+
+    // Start pulse, answer and 40 bits: about 6 ms
+    std::vector<int> seen = run(10000);
+    ASSERT_EQ(seen, std::vector<int>{DHT_NEW});
+    EXPECT_EQ(mock_stops, 1u);
+    const dht_reading_t *reading = dht_take(&d);
+    ASSERT_NE(reading, nullptr);
+    EXPECT_EQ(reading->humidity, 652);
+    EXPECT_EQ(reading->temperature, 351);
+    EXPECT_EQ(dht_take(&d), nullptr);
+
+    run(1900000);
+    EXPECT_EQ(mock_starts, 1u);
+    mock_trace = trace(0x02, 0x8D, 0x01, 0x60);
+    seen = run(200000);
+    EXPECT_EQ(mock_starts, 2u);
+    ASSERT_EQ(seen, std::vector<int>{DHT_NEW});
+    EXPECT_EQ(dht_take(&d)->humidity, 653);
+    EXPECT_EQ(d.stats.readings, 2u);
+}
+
+// Test that a missing sensor times out, releases the line, and is tried
+// again only once per interval
+TEST_F(DhtTest, TimesOutWithoutSensor) {
+    mock_present = false;
+    std::vector<int> seen = run(10000000);      // 10 s
+    EXPECT_EQ(mock_starts, 5u);
+    EXPECT_EQ(mock_stops, 5u);
+    EXPECT_EQ(seen.size(), 5u);
+    EXPECT_EQ(d.stats.timeouts, 5u);
+    EXPECT_EQ(d.stats.readings, 0u);
+    EXPECT_EQ(dht_take(&d), nullptr);
+
+    // A bad reading counts, and the one after it is good
+    mock_present = true;
+    mock_trace[12] = 70;
+    seen = run(2000000);
+    EXPECT_EQ(d.stats.checksum_errors, 1u);
+    mock_trace[12] = 26;
+    seen = run(2000000);
+    ASSERT_EQ(seen, std::vector<int>{DHT_NEW});
+    EXPECT_EQ(d.stats.readings, 1u);
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "file_block_dev.hpp"
+
+// Test fixture for the file-backed block device and its latency model
+class FileBlockDevTest : public ::testing::Test {
+protected:
+    std::string path = ::testing::TempDir() + "file_block_dev.img";
+    std::vector<uint8_t> data = std::vector<uint8_t>(8 * BLOCK_SIZE, 0x5A);
+
+    void TearDown() override {
+        std::remove(path.c_str());
+    }
+};
+
+// Test that each write is charged its modelled latency: per block, every
+// Nth write a spike, and a jump away from the previous write an extra cost
+TEST_F(FileBlockDevTest, RecordsModelledLatency) {
+    host::LatencyModel model;
+    model.base_us = 100;
+    model.per_block_us = 10;
+    model.spike_every = 4;
+    model.spike_us = 5000;
+    model.nonsequential_us = 2000;
+    host::FileBlockDev card(path, 1024, model);
+    card.set_virtual_time(true);
+    ASSERT_EQ(block_dev_init(card.dev()), BLOCK_OK);
+
+    ASSERT_EQ(block_dev_write(card.dev(), 0, data.data(), 8), BLOCK_OK);
+    ASSERT_EQ(block_dev_write(card.dev(), 8, data.data(), 8), BLOCK_OK);
+    ASSERT_EQ(block_dev_write(card.dev(), 500, data.data(), 1), BLOCK_OK);
+    ASSERT_EQ(block_dev_write(card.dev(), 16, data.data(), 8), BLOCK_OK);
+
+    std::vector<uint32_t> expected = {180, 180, 2110, 180 + 2000 + 5000};
+    EXPECT_EQ(card.latencies(), expected);
+    EXPECT_EQ(card.writes(), 4u);
+}
+
+// Test that virtual time does not wait but still stores the data
+TEST_F(FileBlockDevTest, VirtualTimeWritesLand) {
+    host::LatencyModel model;
+    model.base_us = 1000000;
+    host::FileBlockDev card(path, 64, model);
+    card.set_virtual_time(true);
+    ASSERT_EQ(block_dev_init(card.dev()), BLOCK_OK);
+
+    ASSERT_EQ(block_dev_write(card.dev(), 3, data.data(), 2), BLOCK_OK);
+    uint8_t block[BLOCK_SIZE];
+    ASSERT_EQ(block_dev_read(card.dev(), 4, block, 1), BLOCK_OK);
+    EXPECT_EQ(block[0], 0x5A);
+    ASSERT_EQ(block_dev_read(card.dev(), 5, block, 1), BLOCK_OK);
+    EXPECT_EQ(block[0], 0xFF);
+    EXPECT_EQ(card.latencies().front(), 1000000u);
+}
+
+// Test that reads are charged to the read model and a power cut leaves a
+// torn write behind
+TEST_F(FileBlockDevTest, PowerCutTearsWrite) {
+    host::LatencyModel model;
+    model.read_base_us = 200;
+    model.read_per_block_us = 50;
+    host::FileBlockDev card(path, 64, model);
+    ASSERT_EQ(block_dev_init(card.dev()), BLOCK_OK);
+
+    card.cut_power_after(1, 3);
+    ASSERT_EQ(block_dev_write(card.dev(), 0, data.data(), 8), BLOCK_OK);
+    EXPECT_EQ(block_dev_write(card.dev(), 8, data.data(), 8), BLOCK_ERROR);
+    EXPECT_FALSE(card.powered());
+    EXPECT_EQ(block_dev_write(card.dev(), 16, data.data(), 8), BLOCK_ERROR);
+    card.restore_power();
+
+    std::vector<uint8_t> back(24 * BLOCK_SIZE);
+    ASSERT_EQ(block_dev_read(card.dev(), 0, back.data(), 24), BLOCK_OK);
+    EXPECT_EQ(back[7 * BLOCK_SIZE], 0x5A);
+    EXPECT_EQ(back[10 * BLOCK_SIZE], 0x5A);     // Torn: three blocks landed
+    EXPECT_EQ(back[11 * BLOCK_SIZE], 0xFF);
+    EXPECT_EQ(back[16 * BLOCK_SIZE], 0xFF);
+    EXPECT_EQ(card.reads(), 1u);
+    EXPECT_EQ(card.read_time_us(), 200u + 24 * 50);
+}
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "file_flash_dev.hpp"
+
+// Test fixture for the file-backed NOR flash emulator
+class FileFlashDevTest : public ::testing::Test {
+protected:
+    std::string path = ::testing::TempDir() + "file_flash_dev.img";
+    std::vector<uint8_t> page = std::vector<uint8_t>(FLASH_DEV_PAGE_SIZE, 0xF0);
+
+    void TearDown() override {
+        std::remove(path.c_str());
+    }
+};
+
+// Test that programming only clears bits and erasing sets them again
+TEST_F(FileFlashDevTest, ProgramClearsBitsEraseSetsThem) {
+    host::FileFlashDev chip(path, 4 * FLASH_DEV_SECTOR_SIZE);
+    chip.set_virtual_time(true);
+    std::vector<uint8_t> low(FLASH_DEV_PAGE_SIZE, 0x0F);
+    uint8_t back[4];
+
+    ASSERT_EQ(flash_dev_program(chip.dev(), 256, page.data(), page.size()), BLOCK_OK);
+    ASSERT_EQ(flash_dev_read(chip.dev(), 256, back, 1), BLOCK_OK);
+    EXPECT_EQ(back[0], 0xF0);
+    EXPECT_EQ(chip.overprograms(), 0u);
+
+    // 0x0F over 0xF0 can only clear, leaving 0x00, and is counted
+    ASSERT_EQ(flash_dev_program(chip.dev(), 256, low.data(), low.size()), BLOCK_OK);
+    ASSERT_EQ(flash_dev_read(chip.dev(), 256, back, 1), BLOCK_OK);
+    EXPECT_EQ(back[0], 0x00);
+    EXPECT_EQ(chip.overprograms(), size_t(FLASH_DEV_PAGE_SIZE));
+
+    ASSERT_EQ(flash_dev_erase(chip.dev(), 0), BLOCK_OK);
+    ASSERT_EQ(flash_dev_read(chip.dev(), 256, back, 4), BLOCK_OK);
+    EXPECT_EQ(back[0], 0xFF);
+    EXPECT_EQ(back[3], 0xFF);
+    EXPECT_EQ(chip.erase_counts()[0], 1u);
+    EXPECT_EQ(chip.erase_counts()[1], 0u);
+}
+
+// Test that operations must be whole sectors or pages inside the device
+TEST_F(FileFlashDevTest, RejectsMisalignedAndOutOfRange) {
+    host::FileFlashDev chip(path, 2 * FLASH_DEV_SECTOR_SIZE);
+    uint8_t back[16];
+
+    EXPECT_EQ(flash_dev_erase(chip.dev(), 100), BLOCK_RANGE);
+    EXPECT_EQ(flash_dev_erase(chip.dev(), 2 * FLASH_DEV_SECTOR_SIZE), BLOCK_RANGE);
+    EXPECT_EQ(flash_dev_program(chip.dev(), 128, page.data(), page.size()), BLOCK_RANGE);
+    EXPECT_EQ(flash_dev_program(chip.dev(), 0, page.data(), 100), BLOCK_RANGE);
+    EXPECT_EQ(flash_dev_read(chip.dev(), 2 * FLASH_DEV_SECTOR_SIZE - 8, back, sizeof(back)), BLOCK_RANGE);
+    EXPECT_EQ(chip.erases() + chip.programs(), 0u);
+}
+
+// Test that in virtual time an erase stays busy until its time has been
+// spent, either waiting or elsewhere
+TEST_F(FileFlashDevTest, VirtualTimeChargesWaits) {
+    host::FlashTiming timing;
+    timing.erase_us = 45000;
+    timing.page_program_us = 400;
+    timing.poll_us = 100;
+    host::FileFlashDev chip(path, 4 * FLASH_DEV_SECTOR_SIZE, timing);
+    chip.set_virtual_time(true);
+
+    ASSERT_EQ(flash_dev_erase_start(chip.dev(), 0), BLOCK_OK);
+    EXPECT_EQ(flash_dev_poll(chip.dev()), BLOCK_BUSY);
+    chip.advance(45000);
+    EXPECT_EQ(flash_dev_poll(chip.dev()), BLOCK_OK);
+    EXPECT_EQ(chip.now_us(), 45100u);
+
+    std::vector<uint8_t> block(FLASH_DEV_SECTOR_SIZE, 0x11);
+    ASSERT_EQ(flash_dev_program(chip.dev(), 0, block.data(), block.size()), BLOCK_OK);
+    EXPECT_EQ(chip.now_us(), 45100u + 16 * 400);
+}
+
+// Test that a power cut leaves a torn program and stops everything after it
+TEST_F(FileFlashDevTest, PowerCutTearsProgram) {
+    host::FileFlashDev chip(path, 2 * FLASH_DEV_SECTOR_SIZE);
+    chip.set_virtual_time(true);
+    std::vector<uint8_t> block(FLASH_DEV_SECTOR_SIZE, 0x22);
+
+    chip.cut_power_after(0, 3);
+    EXPECT_EQ(flash_dev_program(chip.dev(), 0, block.data(), block.size()), BLOCK_ERROR);
+    EXPECT_FALSE(chip.powered());
+    EXPECT_EQ(flash_dev_erase(chip.dev(), FLASH_DEV_SECTOR_SIZE), BLOCK_ERROR);
+    chip.restore_power();
+
+    uint8_t back[1];
+    ASSERT_EQ(flash_dev_read(chip.dev(), 3 * FLASH_DEV_PAGE_SIZE - 1, back, 1), BLOCK_OK);
+    EXPECT_EQ(back[0], 0x22);
+    ASSERT_EQ(flash_dev_read(chip.dev(), 3 * FLASH_DEV_PAGE_SIZE, back, 1), BLOCK_OK);
+    EXPECT_EQ(back[0], 0xFF);
+}
@@ -0,0 +1,244 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "flash_log.h"
+#include "file_flash_dev.hpp"
+
+// block_log writing straight into the flash ring, with the erase-ahead
+// run between blocks when the storage side is idle, as core 1 does
+namespace {
+    const uint32_t CHIP_SECTORS = 24;
+    const uint32_t RING = CHIP_SECTORS - 1;
+
+    sample_t make_sample(uint32_t i) {
+        sample_t s;
+        sample_clear(&s, 1000000ull + i * 10000ull);
+        sample_set(&s, SAMPLE_CH_TEMP, 2900 + (int32_t)(i * 37 % 400));
+        sample_set(&s, SAMPLE_CH_HEADING, (int32_t)(i * 7919 % SAMPLE_HEADING_MODULUS));
+        sample_set(&s, SAMPLE_CH_PITCH, (int32_t)(i * 13 % 90) - 45);
+        return s;
+    }
+
+    host::FlashTiming fast_polls() {
+        host::FlashTiming timing;
+        timing.poll_us = 500;
+        return timing;
+    }
+
+    struct FlashLogger {
+        host::FileFlashDev &chip;
+        flash_log_t flash;
+        log_writer_t writer;
+        block_log_t blocks;
+        bool idle_erase;
+        uint8_t scratch[LOG_BLOCK_SIZE];
+
+        // Newest block that is whole on the chip, in an unbroken run
+        uint32_t durable = 0;
+        bool failed = false;
+        uint64_t max_write_us = 0;
+        uint64_t max_data_write_us = 0;
+
+        static bool emit(void *ctx, const uint8_t *block) {
+            auto *self = static_cast<FlashLogger *>(ctx);
+            log_block_header_t hdr;
+            log_block_peek(block, &hdr);
+
+            uint64_t start = self->chip.now_us();
+            int status = self->writer.write(self->writer.ctx, block, LOG_BLOCK_SIZE);
+            uint64_t took = self->chip.now_us() - start;
+            self->max_write_us = std::max(self->max_write_us, took);
+            if (hdr.type != LOG_BLOCK_FILE) {
+                self->max_data_write_us = std::max(self->max_data_write_us, took);
+            }
+
+            if (status == BLOCK_OK && !self->failed) {
+                self->durable = hdr.seq;
+            } else if (!self->failed) {
+                // A torn program still leaves a whole block if its payload
+                // was short. Reads work without power here.
+                self->failed = true;
+                uint8_t back[LOG_BLOCK_SIZE];
+                log_block_header_t landed;
+                flash_dev_read(self->chip.dev(), flash_log_sector(&self->flash, hdr.seq), back, sizeof(back));
+                uint32_t log_id = hdr.type == LOG_BLOCK_FILE ? 0 : self->blocks.log_id;
+                if (log_block_parse(back, log_id, &landed) == LOG_OK && landed.seq == hdr.seq &&
+                    landed.crc == hdr.crc) {
+                    self->durable = hdr.seq;
+                }
+            }
+            if (self->idle_erase && self->chip.powered()) {
+                self->chip.advance(100000);
+                while (flash_log_service(&self->flash)) {
+                }
+            }
+            return true;
+        }
+
+        // Mount and carry on from whatever the chip holds, as main does
+        FlashLogger(host::FileFlashDev &c, bool idle, uint32_t new_log_id = 0x5151) : chip(c), idle_erase(idle) {
+            EXPECT_EQ(flash_log_init(&flash, chip.dev()), BLOCK_OK);
+            EXPECT_EQ(flash_log_mount(&flash, scratch), BLOCK_OK);
+            flash_log_writer(&flash, &writer);
+            const flash_log_recovered_t &rec = flash.recovered;
+            block_log_config_t config = {7, new_log_id, 0, 0, LOG_NO_BLOCK, 0, 0};
+            if (rec.next_block > 0) {
+                config.log_id = rec.log_id;
+                config.start_seq = rec.next_block;
+                config.prev_index = rec.prev_index;
+                config.time_base_us = rec.last_time_us + 1;
+                durable = rec.next_block - 1;
+            }
+            block_log_init(&blocks, &config, emit, this);
+        }
+
+        // Write samples until 'seq' blocks have gone out or the power goes
+        uint32_t run_to(uint32_t seq, uint32_t first_sample = 0) {
+            uint32_t i = first_sample;
+            while (blocks.seq < seq && chip.powered()) {
+                sample_t s = make_sample(i++);
+                block_log_add(&blocks, &s);
+            }
+            return i;
+        }
+    };
+
+    // Every block the ring still holds, oldest first: they must be this
+    // log's, in order, and stop at the newest
+    void expect_ring_holds(host::FileFlashDev &chip, const flash_log_t &flash, uint32_t newest, uint32_t log_id) {
+        uint32_t oldest = newest > RING - FLASH_LOG_ERASE_AHEAD ? newest - (RING - FLASH_LOG_ERASE_AHEAD) + 1 : 1;
+        uint8_t block[LOG_BLOCK_SIZE];
+        log_block_header_t hdr;
+        for (uint32_t seq = oldest; seq <= newest; ++seq) {
+            ASSERT_EQ(flash_dev_read(chip.dev(), flash_log_sector(&flash, seq), block, sizeof(block)), BLOCK_OK);
+            ASSERT_EQ(log_block_parse(block, log_id, &hdr), LOG_OK) << "seq " << seq;
+            EXPECT_EQ(hdr.seq, seq);
+        }
+    }
+}
+
+// Test fixture for the flash ring log
+class FlashLogTest : public ::testing::Test {
+protected:
+    std::string path = ::testing::TempDir() + "flash_log.img";
+
+    void TearDown() override {
+        std::remove(path.c_str());
+    }
+};
+
+// Test that the log goes round the ring several times with every ring
+// sector erased equally often, and a remount finds where it got to
+TEST_F(FlashLogTest, WrapsRingWithEvenWear) {
+    host::FileFlashDev chip(path, CHIP_SECTORS * FLASH_DEV_SECTOR_SIZE, fast_polls());
+    chip.set_virtual_time(true);
+    FlashLogger logger(chip, true);
+    EXPECT_EQ(logger.flash.recovered.next_block, 0u);
+    logger.run_to(3 * RING + 10);      // The last index block, 65, is still held
+
+    EXPECT_EQ(logger.flash.stats.laps, 3u);
+    EXPECT_EQ(logger.flash.stats.write_errors, 0u);
+    EXPECT_EQ(chip.overprograms(), 0u);
+    const std::vector<uint32_t> &wear = chip.erase_counts();
+    auto ring = std::minmax_element(wear.begin(), wear.begin() + RING);
+    EXPECT_LE(*ring.second - *ring.first, 1u);
+    EXPECT_GE(*ring.first, 3u);
+    EXPECT_EQ(wear[RING], 1u);      // The FILE sector, once
+
+    flash_log_t again;
+    uint8_t scratch[LOG_BLOCK_SIZE];
+    ASSERT_EQ(flash_log_init(&again, chip.dev()), BLOCK_OK);
+    ASSERT_EQ(flash_log_mount(&again, scratch), BLOCK_OK);
+    EXPECT_EQ(again.recovered.log_id, logger.blocks.log_id);
+    EXPECT_EQ(again.recovered.next_block, logger.blocks.seq);
+    uint32_t newest = logger.blocks.seq - 1;
+    EXPECT_EQ(again.recovered.prev_index, logger.blocks.prev_index);
+    EXPECT_EQ(again.erased, (uint32_t)FLASH_LOG_ERASE_AHEAD);
+    expect_ring_holds(chip, again, newest, logger.blocks.log_id);
+}
+
+// Test that with idle time between blocks every sector is erased ahead,
+// so a block costs only its program time; without it each block waits
+// for an erase first
+TEST_F(FlashLogTest, ErasesAheadWhileIdle) {
+    host::FlashTiming timing = fast_polls();
+    const uint64_t program_us = uint64_t(timing.page_program_us) * (LOG_BLOCK_SIZE / FLASH_DEV_PAGE_SIZE);
+    {
+        host::FileFlashDev chip(path, CHIP_SECTORS * FLASH_DEV_SECTOR_SIZE, timing);
+        chip.set_virtual_time(true);
+        FlashLogger logger(chip, true);
+        logger.run_to(3 * RING);
+        EXPECT_EQ(logger.flash.stats.erase_stalls, 1u);     // The FILE block
+        EXPECT_EQ(logger.max_data_write_us, program_us);
+    }
+    {
+        host::FileFlashDev chip(path, CHIP_SECTORS * FLASH_DEV_SECTOR_SIZE, timing);
+        chip.set_virtual_time(true);
+        FlashLogger logger(chip, false);
+        logger.run_to(3 * RING);
+        EXPECT_GT(logger.flash.stats.erase_stalls, 2 * RING);
+        EXPECT_EQ(logger.max_data_write_us, timing.erase_us + program_us);
+    }
+}
+
+// Test that after a power cut at any erase or program, torn or not, the
+// remount finds exactly the last whole block and logging carries on after
+// it with rising times
+TEST_F(FlashLogTest, ResumesAfterPowerCutAtEveryOperation) {
+    for (uint32_t cut = 0; cut < 3 * RING; ++cut) {
+        SCOPED_TRACE("cut after " + std::to_string(cut) + " operations");
+        host::FileFlashDev chip(path, CHIP_SECTORS * FLASH_DEV_SECTOR_SIZE, fast_polls());
+        chip.set_virtual_time(true);
+        uint32_t next_sample;
+        uint32_t durable;
+        uint64_t last_time;
+        {
+            FlashLogger logger(chip, cut % 2 == 0);
+            next_sample = logger.run_to(RING + RING / 2);
+            chip.cut_power_after(cut, cut % 19);
+            next_sample = logger.run_to(UINT32_MAX, next_sample);
+            durable = logger.durable;
+        }
+        chip.restore_power();
+
+        FlashLogger resumed(chip, true);
+        ASSERT_EQ(resumed.flash.recovered.next_block, durable + 1);
+        expect_ring_holds(chip, resumed.flash, durable, resumed.blocks.log_id);
+        last_time = resumed.flash.recovered.last_time_us;
+
+        resumed.run_to(durable + 5, next_sample);
+        uint8_t block[LOG_BLOCK_SIZE];
+        log_block_header_t hdr;
+        ASSERT_EQ(flash_dev_read(chip.dev(), flash_log_sector(&resumed.flash, durable + 1), block, sizeof(block)),
+                  BLOCK_OK);
+        ASSERT_EQ(log_block_parse(block, resumed.blocks.log_id, &hdr), LOG_OK);
+        EXPECT_EQ(hdr.flags & LOG_FLAG_RESUMED, LOG_FLAG_RESUMED);
+        EXPECT_GT(hdr.first_time_us, last_time);
+        EXPECT_EQ(chip.overprograms(), 0u);
+    }
+}
+
+// Test that blocks of an earlier log, with higher seqs than the new log
+// has reached, are not taken for its newest block
+TEST_F(FlashLogTest, IgnoresBlocksOfEarlierLog) {
+    host::FileFlashDev chip(path, CHIP_SECTORS * FLASH_DEV_SECTOR_SIZE, fast_polls());
+    chip.set_virtual_time(true);
+    {
+        FlashLogger first(chip, true, 0x1111);
+        first.run_to(2 * RING + 3);
+    }
+
+    // Lose the FILE block, so the next start begins a new log
+    ASSERT_EQ(flash_dev_erase(chip.dev(), RING * FLASH_DEV_SECTOR_SIZE), BLOCK_OK);
+    {
+        FlashLogger second(chip, true, 0x2222);
+        EXPECT_EQ(second.flash.recovered.next_block, 0u);
+        second.run_to(6);
+    }
+
+    FlashLogger third(chip, true);
+    EXPECT_EQ(third.flash.recovered.log_id, 0x2222u);
+    EXPECT_EQ(third.flash.recovered.next_block, 6u);
+}
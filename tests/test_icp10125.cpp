@@ -0,0 +1,391 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "icp10125.h"
+
+// An ICP10125 as the driver sees it over I2C: 16-bit commands, words
+// returned with a CRC, the OTP behind its setup command, measurements
+// that NAK reads until they are done, and a count of every transaction
+namespace {
+    // As acq_core.h: room kept before each sample for bus work
+    constexpr uint32_t kUvBusUs = 4000;
+    constexpr uint32_t kPressureBusUs = 2000;
+    constexpr uint32_t kSpinStepUs = 100;
+
+    const uint16_t kMeasureCmds[] = {0x609C, 0x6825, 0x70DF, 0x7866};
+
+    uint8_t crc8(const uint8_t *data, int len) {
+        uint8_t crc = 0xFF;
+        for (int i = 0; i < len; ++i) {
+            crc ^= data[i];
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = uint8_t(crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1);
+            }
+        }
+        return crc;
+    }
+
+    // The vendor's conversion, in double precision (its code uses float)
+    template <typename Real>
+    struct Model {
+        Real a, b, c;
+
+        Model(const int16_t otp[ICP10125_OTP_WORDS], uint16_t temp) {
+            const Real p_pa[3] = {45000, 80000, 105000};
+            Real t = Real(int32_t(temp) - 32768);
+            Real quadr = Real(1) / 16777216;
+            Real lut[3] = {Real(3.5 * (1 << 20)) + otp[0] * t * t * quadr,
+                           Real(2048) * otp[3] + otp[1] * t * t * quadr,
+                           Real(11.5 * (1 << 20)) + otp[2] * t * t * quadr};
+            c = (lut[0] * lut[1] * (p_pa[0] - p_pa[1]) + lut[1] * lut[2] * (p_pa[1] - p_pa[2]) +
+                 lut[2] * lut[0] * (p_pa[2] - p_pa[0])) /
+                (lut[2] * (p_pa[0] - p_pa[1]) + lut[0] * (p_pa[1] - p_pa[2]) + lut[1] * (p_pa[2] - p_pa[0]));
+            a = (p_pa[0] * lut[0] - p_pa[1] * lut[1] - (p_pa[1] - p_pa[0]) * c) / (lut[0] - lut[1]);
+            b = (p_pa[0] - a) * (lut[0] + c);
+        }
+
+        Real pressure(uint32_t code) const { return a + b / (c + Real(code)); }
+        uint32_t code(Real pa) const { return uint32_t(std::lround(b / (pa - a) - c)); }
+    };
+
+    uint16_t temp_code(double celsius) {
+        return uint16_t(std::lround((celsius + 45) / 175 * 65536));
+    }
+
+    struct Measurement {
+        uint32_t start_us, end_us;
+        double pa;
+    };
+
+    struct SimIcp10125 {
+        uint32_t now_us = 0;
+        bool present = true;
+        uint16_t id = 0x5A48;                   // Low six bits 0x08
+        int16_t otp[ICP10125_OTP_WORDS] = {1848, 1577, 1395, 3710};
+        double speed = 0.9;                     // Conversions take this times the datasheet maximum
+        // Conditions; the pressure rises with each measurement so every
+        // result is different
+        double celsius = 21.5, pa = 101325, pa_step = 3.25;
+        bool corrupt_next = false;              // Flip a bit in the next result
+
+        int otp_index = -1;                     // -1 until the OTP is set up
+        std::vector<uint8_t> reply;             // Words waiting to be read
+        bool measuring = false;
+        uint32_t done_us = 0;
+        std::vector<Measurement> measurements;
+
+        int reads = 0, writes = 0, otp_reads = 0, early = 0, failed = 0;
+
+        void word(uint16_t w) {
+            uint8_t b[2] = {uint8_t(w >> 8), uint8_t(w)};
+            reply.insert(reply.end(), {b[0], b[1], crc8(b, 2)});
+        }
+
+        bool write(const uint8_t *data, uint32_t len) {
+            if (!present || measuring || len < 2) {
+                failed++;
+                return false;
+            }
+            writes++;
+            uint16_t cmd = uint16_t(data[0] << 8 | data[1]);
+            reply.clear();
+            if (cmd == ICP10125_CMD_READ_ID) {
+                word(id);
+            } else if (cmd == ICP10125_CMD_OTP_SETUP && len == 5 && data[2] == 0x00 && data[3] == 0x66 &&
+                       data[4] == 0x9C) {
+                otp_index = 0;
+            } else if (cmd == ICP10125_CMD_OTP_READ && otp_index >= 0 && otp_index < ICP10125_OTP_WORDS) {
+                word(uint16_t(otp[otp_index++]));
+                otp_reads++;
+            } else {
+                for (uint8_t mode = 0; mode < 4; ++mode) {
+                    if (cmd == kMeasureCmds[mode]) {
+                        measuring = true;
+                        done_us = now_us + uint32_t(std::lround(icp10125_conversion_us(mode) * speed));
+                        double p = pa + pa_step * double(measurements.size());
+                        measurements.push_back({now_us, done_us, p});
+                    }
+                }
+            }
+            return true;
+        }
+
+        bool read(uint8_t *data, uint32_t len) {
+            if (!present) {
+                failed++;
+                return false;
+            }
+            if (measuring) {
+                if (int32_t(now_us - done_us) < 0) {
+                    early++;
+                    return false;
+                }
+                measuring = false;
+                uint16_t t = temp_code(celsius);
+                uint32_t p = Model<double>(otp, t).code(measurements.back().pa);
+                reply.clear();
+                word(t);
+                word(uint16_t(p >> 8));
+                word(uint16_t(p << 8));
+                if (corrupt_next) {
+                    reply[4] ^= 0x10;
+                    corrupt_next = false;
+                }
+            }
+            if (reply.size() < len) {
+                failed++;
+                return false;
+            }
+            reads++;
+            std::copy(reply.begin(), reply.begin() + len, data);
+            reply.erase(reply.begin(), reply.begin() + len);
+            return true;
+        }
+    };
+
+    bool sim_write(void *ctx, uint8_t address, const uint8_t *data, uint32_t len) {
+        auto *sim = static_cast<SimIcp10125 *>(ctx);
+        return address == ICP10125_ADDRESS && sim->write(data, len);
+    }
+
+    bool sim_read(void *ctx, uint8_t address, uint8_t *data, uint32_t len) {
+        auto *sim = static_cast<SimIcp10125 *>(ctx);
+        return address == ICP10125_ADDRESS && sim->read(data, len);
+    }
+
+    struct Sampled {
+        uint32_t time_us;
+        bool has_pressure;
+        double pa;
+    };
+
+    // The sampling loop of acq_core.c: pressure work in the idle time
+    // before a sample when it leaves room for the UV sensor's as well, the
+    // newest result taken with the sample and converted as core 0 does,
+    // and the next measurement planned for the next sample
+    std::vector<Sampled> run_acquisition(SimIcp10125 &sim, icp10125_t *p, uint32_t period_us, int samples) {
+        std::vector<Sampled> out;
+        uint32_t next_us = sim.now_us;
+        for (int n = 0; n < samples; ++n) {
+            while (int32_t(next_us - sim.now_us) > 0) {
+                if (int32_t(next_us - sim.now_us) >= int32_t(kUvBusUs + kPressureBusUs) &&
+                    icp10125_due(p, sim.now_us)) {
+                    icp10125_poll(p, sim.now_us);
+                }
+                sim.now_us += std::min(kSpinStepUs, next_us - sim.now_us);
+            }
+            Sampled s = {sim.now_us, false, 0};
+            if (const icp10125_result_t *r = icp10125_take(p)) {
+                s.has_pressure = true;
+                s.pa = icp10125_pressure(&p->cal, r->temp, r->pressure) / 16.0;
+            }
+            out.push_back(s);
+            next_us += period_us;
+            icp10125_plan(p, next_us - kUvBusUs - kPressureBusUs);
+        }
+        return out;
+    }
+
+    // The newest measurement finished by 'time_us'
+    const Measurement *finished_by(const SimIcp10125 &sim, uint32_t time_us) {
+        const Measurement *last = nullptr;
+        for (const Measurement &m : sim.measurements) {
+            if (int32_t(time_us - m.end_us) >= 0) {
+                last = &m;
+            }
+        }
+        return last;
+    }
+}  // namespace
+
+// Test fixture for the ICP10125 driver on a simulated sensor
+class Icp10125Test : public ::testing::Test {
+protected:
+    SimIcp10125 sim;
+    icp10125_t icp;
+    icp10125_bus_t bus = {sim_write, sim_read, &sim};
+};
+
+// Test that init checks the ID and reads the four OTP words once, into
+// the calibration, and rejects a wrong ID, a bad CRC or a missing sensor
+TEST_F(Icp10125Test, InitReadsOtpOnce) {
+    const uint8_t example[] = {0xBE, 0xEF};
+    EXPECT_EQ(icp10125_crc8(example, 2), 0x92);
+
+    ASSERT_TRUE(icp10125_init(&icp, &bus, ICP10125_MODE_LN));
+    EXPECT_EQ(sim.otp_reads, ICP10125_OTP_WORDS);
+    EXPECT_EQ(sim.writes, 2 + ICP10125_OTP_WORDS);
+    EXPECT_EQ(sim.reads, 1 + ICP10125_OTP_WORDS);
+    EXPECT_TRUE(sim.measurements.empty());
+    icp10125_cal_t cal;
+    icp10125_calibrate(&cal, sim.otp);
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(icp.cal.base[i], cal.base[i]);
+        EXPECT_EQ(icp.cal.quad[i], cal.quad[i]);
+    }
+    EXPECT_EQ(icp.cal.base[1], 2048 * 3710);
+
+    // Measuring never goes back to the OTP
+    run_acquisition(sim, &icp, 100000, 20);
+    EXPECT_EQ(sim.otp_reads, ICP10125_OTP_WORDS);
+    EXPECT_GT(icp.stats.measurements, 0u);
+
+    sim.id = 0x5A49;
+    EXPECT_FALSE(icp10125_init(&icp, &bus, ICP10125_MODE_LN));
+    sim.id = 0x5A48;
+    sim.present = false;
+    EXPECT_FALSE(icp10125_init(&icp, &bus, ICP10125_MODE_LN));
+}
+
+// Test that init gives up on an OTP word whose CRC is wrong
+TEST_F(Icp10125Test, InitRejectsCorruptOtp) {
+    icp10125_bus_t corrupting = {
+        sim_write,
+        [](void *ctx, uint8_t address, uint8_t *data, uint32_t len) {
+            auto *sim = static_cast<SimIcp10125 *>(ctx);
+            bool ok = sim_read(ctx, address, data, len);
+            if (ok && sim->otp_reads == 3) {
+                data[1] ^= 0x01;
+            }
+            return ok;
+        },
+        &sim};
+    EXPECT_FALSE(icp10125_init(&icp, &corrupting, ICP10125_MODE_LN));
+}
+
+// Test the integer conversion against the vendor's formula over the
+// sensor's range of temperature and pressure, for a spread of OTP
+// calibrations, and the temperature against its datasheet formula. The
+// vendor's single-precision version is measured for comparison.
+TEST_F(Icp10125Test, CompensationMatchesVendorFormula) {
+    std::mt19937 rng(10125);
+    std::uniform_int_distribution<int> quad(-3000, 3000), offset(3000, 4500);
+    std::uniform_real_distribution<double> celsius(-40, 85), pa(30000, 110000);
+    double worst = 0, worst_float = 0;
+    for (int n = 0; n < 100000; ++n) {
+        int16_t otp[ICP10125_OTP_WORDS] = {};
+        if (n == 0) {
+            std::copy(sim.otp, sim.otp + ICP10125_OTP_WORDS, otp);
+        } else {
+            for (int i = 0; i < 3; ++i) {
+                otp[i] = int16_t(quad(rng));
+            }
+            otp[3] = int16_t(offset(rng));
+        }
+        icp10125_cal_t cal;
+        icp10125_calibrate(&cal, otp);
+
+        uint16_t t = temp_code(n < 2 ? -40 + 125 * n : celsius(rng));
+        Model<double> model(otp, t);
+        uint32_t code = model.code(pa(rng));
+        double expect = model.pressure(code);
+        double got = icp10125_pressure(&cal, t, code) / 16.0;
+        ASSERT_NEAR(got, expect, 0.1) << n;
+        worst = std::max(worst, std::fabs(got - expect));
+        worst_float = std::max(worst_float, double(std::fabs(Model<float>(otp, t).pressure(code) - expect)));
+
+        double temp = -45 + 175.0 * t / 65536;
+        ASSERT_NEAR(icp10125_temperature(t) / 128.0, temp, 0.5 / 128 + 1e-9) << n;
+    }
+    RecordProperty("worst_error_mpa", int(std::lround(worst * 1000)));
+    RecordProperty("vendor_float_worst_error_mpa", int(std::lround(worst_float * 1000)));
+}
+
+// Test that each conversion is started so that it ends just before a
+// sample, costs one command and one read, is never read before it is
+// done, and that the sample carries that result
+TEST_F(Icp10125Test, PipelinedJustBeforeEachSample) {
+    ASSERT_TRUE(icp10125_init(&icp, &bus, ICP10125_MODE_LN));
+    sim.reads = sim.writes = 0;
+    std::vector<Sampled> samples = run_acquisition(sim, &icp, 1000000, 21);
+
+    EXPECT_FALSE(samples[0].has_pressure);
+    for (size_t n = 1; n < samples.size(); ++n) {
+        ASSERT_TRUE(samples[n].has_pressure) << n;
+        const Measurement *m = finished_by(sim, samples[n].time_us);
+        ASSERT_NE(m, nullptr);
+        EXPECT_NEAR(samples[n].pa, m->pa, 0.1) << n;
+        EXPECT_GE(m->start_us, samples[n - 1].time_us);
+        // Idle only for the speed margin and the bus allowance
+        EXPECT_LE(samples[n].time_us - m->end_us, icp.conversion_us / 10 + 1 + kUvBusUs + kPressureBusUs) << n;
+    }
+    EXPECT_EQ(sim.measurements.size(), 20u);
+    EXPECT_EQ(sim.writes, 20);
+    EXPECT_EQ(sim.reads, 20);
+    EXPECT_EQ(sim.early, 0);
+    EXPECT_EQ(icp.stats.measurements, 20u);
+    RecordProperty("bus_transactions_per_measurement", 2);
+}
+
+// Test that a sample period shorter than a conversion gets conversions
+// back to back, and every sample the newest finished one
+TEST_F(Icp10125Test, BackToBackWhenPeriodIsShort) {
+    ASSERT_TRUE(icp10125_init(&icp, &bus, ICP10125_MODE_ULN));
+    const uint32_t period_us = 50000;
+    std::vector<Sampled> samples = run_acquisition(sim, &icp, period_us, 200);     // 10 s
+
+    for (size_t i = 1; i < sim.measurements.size(); ++i) {
+        uint32_t gap = sim.measurements[i].start_us - sim.measurements[i - 1].end_us;
+        ASSERT_LE(gap, icp.conversion_us / 10 + period_us) << i;
+    }
+    EXPECT_GE(sim.measurements.size(), 10000000u / (icp.conversion_us + period_us));
+
+    double last = 0;
+    int with_pressure = 0;
+    for (const Sampled &s : samples) {
+        if (!s.has_pressure) {
+            continue;
+        }
+        with_pressure++;
+        EXPECT_GT(s.pa, last);
+        last = s.pa;
+    }
+    EXPECT_EQ(with_pressure, int(icp.stats.measurements));
+    EXPECT_EQ(sim.early, 0);
+}
+
+// Test that a result with a bad CRC is thrown away and measured again at
+// once, costing at most one sample its pressure
+TEST_F(Icp10125Test, CrcErrorIsMeasuredAgain) {
+    ASSERT_TRUE(icp10125_init(&icp, &bus, ICP10125_MODE_N));
+    run_acquisition(sim, &icp, 200000, 5);
+    sim.corrupt_next = true;
+    std::vector<Sampled> samples = run_acquisition(sim, &icp, 200000, 10);
+
+    EXPECT_EQ(icp.stats.crc_errors, 1u);
+    // The first sample of a run comes at once, before any measurement
+    int missing = 0;
+    for (size_t n = 1; n < samples.size(); ++n) {
+        const Sampled &s = samples[n];
+        if (!s.has_pressure) {
+            missing++;
+            continue;
+        }
+        const Measurement *m = finished_by(sim, s.time_us);
+        ASSERT_NE(m, nullptr);
+        EXPECT_NEAR(s.pa, m->pa, 0.1);
+    }
+    EXPECT_LE(missing, 1);
+}
+
+// Test that a sensor that stops answering is retried once a conversion
+// time rather than on every pass of the loop, and picked up again
+TEST_F(Icp10125Test, RetriesMissingSensorSparingly) {
+    ASSERT_TRUE(icp10125_init(&icp, &bus, ICP10125_MODE_N));
+    run_acquisition(sim, &icp, 20000, 50);
+    uint32_t before = icp.stats.measurements;
+    EXPECT_GT(before, 0u);
+
+    sim.present = false;
+    std::vector<Sampled> gone = run_acquisition(sim, &icp, 20000, 100);           // 2 s
+    EXPECT_GT(icp.stats.bus_errors, 0u);
+    EXPECT_LE(sim.failed, int(2000000 / icp.conversion_us) + 2);
+    EXPECT_TRUE(std::none_of(gone.begin() + 1, gone.end(), [](const Sampled &s) { return s.has_pressure; }));
+
+    sim.present = true;
+    run_acquisition(sim, &icp, 20000, 50);
+    EXPECT_GT(icp.stats.measurements, before);
+}
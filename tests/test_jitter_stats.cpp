@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+#include "jitter_stats.h"
+
+// Test fixture for sampling jitter statistics
+class JitterStatsTest : public ::testing::Test {
+protected:
+    jitter_stats_t stats;
+
+    void SetUp() override {
+        jitter_stats_reset(&stats);
+    }
+};
+
+// Test that lateness lands in the right decade, edges included
+TEST_F(JitterStatsTest, BucketsByDecade) {
+    for (uint32_t late : {0u, 9u, 10u, 99u, 100u, 999u, 1000u, 9999u, 10000u, 45000u}) {
+        jitter_stats_add(&stats, late);
+    }
+    EXPECT_EQ(stats.samples, 10u);
+    for (int i = 0; i < JITTER_BUCKETS; ++i) {
+        EXPECT_EQ(stats.bucket[i], 2u) << "bucket " << i;
+    }
+    EXPECT_EQ(stats.max_late_us, 45000u);
+    EXPECT_EQ(stats.total_late_us, 0u + 9 + 10 + 99 + 100 + 999 + 1000 + 9999 + 10000 + 45000);
+}
+
+// Test that a reset clears everything, including skipped periods
+TEST_F(JitterStatsTest, ResetClears) {
+    jitter_stats_add(&stats, 5000);
+    jitter_stats_skip(&stats);
+    jitter_stats_reset(&stats);
+    EXPECT_EQ(stats.samples, 0u);
+    EXPECT_EQ(stats.bucket[3], 0u);
+    EXPECT_EQ(stats.max_late_us, 0u);
+    EXPECT_EQ(stats.total_late_us, 0u);
+    EXPECT_EQ(stats.skipped, 0u);
+}
+
+// Test the report line, and that it fits whatever buffer it is given
+TEST_F(JitterStatsTest, FormatsOneLine) {
+    char buf[200];
+    jitter_stats_format(&stats, buf, sizeof(buf));
+    EXPECT_EQ(std::string(buf), "0 samples, late by 0 us mean, 0 us max; <10us 0, <100us 0, <1ms 0, <10ms 0, "
+                                ">=10ms 0; 0 periods skipped\n");
+
+    jitter_stats_add(&stats, 2);
+    jitter_stats_add(&stats, 4);
+    jitter_stats_add(&stats, 300);
+    jitter_stats_skip(&stats);
+    int n = jitter_stats_format(&stats, buf, sizeof(buf));
+    EXPECT_EQ(std::string(buf), "3 samples, late by 102 us mean, 300 us max; <10us 2, <100us 0, <1ms 1, <10ms 0, "
+                                ">=10ms 0; 1 periods skipped\n");
+    EXPECT_EQ(n, (int)strlen(buf));
+
+    char small[16];
+    n = jitter_stats_format(&stats, small, sizeof(small));
+    EXPECT_EQ(n, (int)strlen(small));
+    EXPECT_EQ(std::string(small), "3 samples, late");
+}
@@ -0,0 +1,357 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "log_checkpoint.h"
+#include "crc.h"
+#include "sd_log.h"
+#include "block_log_reader.hpp"
+#include "file_block_dev.hpp"
+
+// The firmware's storage path without FatFs: a log file that is one
+// preallocated sector range, checkpoints in two sectors in front of it,
+// and block_log feeding sd_log on top
+namespace {
+    const uint32_t CKPT_LBA = 0;
+    const uint32_t FILE_LBA = 8;
+    const uint32_t FILE_BLOCKS = 128;
+    const uint32_t CARD_SECTORS = FILE_LBA + FILE_BLOCKS * LOG_SECTORS_PER_BLOCK;
+
+    sample_t make_sample(uint32_t i) {
+        sample_t s;
+        sample_clear(&s, 1000000ull + i * 10000ull);
+        sample_set(&s, SAMPLE_CH_TEMP, 2900 + (int32_t)(i * 37 % 400));
+        sample_set(&s, SAMPLE_CH_HEADING, (int32_t)(i * 7919 % SAMPLE_HEADING_MODULUS));
+        sample_set(&s, SAMPLE_CH_PITCH, (int32_t)(i * 13 % 90) - 45);
+        sample_set(&s, SAMPLE_CH_ROLL, (int32_t)(i * 29 % 90) - 45);
+        return s;
+    }
+
+    struct Logger {
+        block_dev_t *dev;
+        sd_log_t sd;
+        raw_log_writer_t raw;
+        log_writer_t raw_writer;
+        log_checkpointer_t ckpt;
+        block_log_t blocks;
+
+        // Log blocks that reached the card in full, in a row from the start,
+        // and the samples in them
+        uint32_t durable_blocks = 0;
+        uint64_t durable_samples = 0;
+        bool failed = false;
+        log_block_header_t first_failed = {};
+
+        // A torn write still leaves a whole block if its payload was short
+        void count_torn(uint32_t torn) {
+            uint32_t landed = torn * BLOCK_SIZE;
+            if (failed && first_failed.seq == durable_blocks &&
+                landed >= (uint32_t)LOG_HEADER_SIZE + first_failed.payload_len) {
+                durable_blocks++;
+                durable_samples += first_failed.type == LOG_BLOCK_DATA ? first_failed.record_count : 0;
+            }
+        }
+
+        static int write(void *ctx, const uint8_t *data, size_t len) {
+            auto *self = static_cast<Logger *>(ctx);
+            int status = self->raw_writer.write(self->raw_writer.ctx, data, len);
+            log_checkpointer_wrote(&self->ckpt, data, len);
+
+            log_block_header_t hdr;
+            log_block_peek(data, &hdr);
+            if (status != BLOCK_OK) {
+                if (!self->failed) {
+                    self->first_failed = hdr;
+                }
+                self->failed = true;
+            } else if (!self->failed) {
+                self->durable_blocks = hdr.seq + 1;
+                self->durable_samples += hdr.type == LOG_BLOCK_DATA ? hdr.record_count : 0;
+            }
+            return status;
+        }
+
+        static int sync(void *ctx) {
+            auto *self = static_cast<Logger *>(ctx);
+            int status = block_dev_sync(self->dev);
+            if (status == BLOCK_OK) {
+                int saved = log_checkpointer_save(&self->ckpt, false);
+                status = saved < 0 ? saved : BLOCK_OK;
+            }
+            return status;
+        }
+
+        // A new log at the start of the file
+        explicit Logger(block_dev_t *d, uint32_t log_id = 0x1234567) : dev(d) {
+            log_checkpoint_t loaded;
+            log_checkpointer_init(&ckpt, dev, CKPT_LBA);
+            log_checkpointer_load(&ckpt, &loaded);      // Carries the generation on
+            log_checkpointer_new_file(&ckpt, 0, FILE_LBA, FILE_BLOCKS);
+            log_checkpointer_save(&ckpt, true);
+            block_log_config_t config = {7, log_id, 0, 0, LOG_NO_BLOCK, 0, 0};
+            start(0, config);
+        }
+
+        // Carry on from a recovered checkpoint, as fatfs_log and main do
+        Logger(block_dev_t *d, const log_checkpoint_t &rec) : dev(d) {
+            log_checkpointer_init(&ckpt, dev, CKPT_LBA);
+            log_checkpoint_t loaded;
+            log_checkpointer_load(&ckpt, &loaded);
+            log_checkpointer_resume(&ckpt, &rec);
+            block_log_config_t config = {7, 0x7654321, 0, 0, LOG_NO_BLOCK, 0, 0};
+            if (rec.next_block > 0) {
+                config.log_id = rec.log_id;
+                config.start_seq = rec.next_block;
+                config.prev_index = rec.prev_index;
+                config.time_base_us = rec.last_time_us + 1;
+            }
+            start(rec.next_block, config);
+        }
+
+        void start(uint32_t first_block, const block_log_config_t &config) {
+            uint32_t offset = first_block * LOG_SECTORS_PER_BLOCK;
+            raw_log_writer_init(&raw, dev, FILE_LBA + offset, FILE_BLOCKS * LOG_SECTORS_PER_BLOCK - offset,
+                                &raw_writer);
+            sd_log_init(&sd);
+            log_writer_t w = {write, sync, this};
+            sd_log_attach(&sd, &w);
+            block_log_init(&blocks, &config, emit, &sd);
+        }
+
+        static bool emit(void *ctx, const uint8_t *block) {
+            auto *sd = static_cast<sd_log_t *>(ctx);
+            return sd_log_free(sd) >= LOG_BLOCK_SIZE && sd_log_append(sd, block, LOG_BLOCK_SIZE);
+        }
+
+        void add(uint32_t first, uint32_t count) {
+            for (uint32_t i = first; i < first + count; ++i) {
+                sample_t s = make_sample(i);
+                while (block_log_add(&blocks, &s) == LOG_BUSY) {
+                    sd_log_service(&sd);
+                }
+            }
+        }
+
+        void finish() {
+            while (block_log_flush(&blocks) == LOG_BUSY) {
+                sd_log_service(&sd);
+            }
+            while (sd_log_service(&sd)) {
+            }
+            sync(this);
+        }
+    };
+
+    std::vector<uint8_t> read_file(block_dev_t *dev) {
+        std::vector<uint8_t> bytes(size_t(FILE_BLOCKS) * LOG_BLOCK_SIZE);
+        EXPECT_EQ(block_dev_read(dev, FILE_LBA, bytes.data(), FILE_BLOCKS * LOG_SECTORS_PER_BLOCK), BLOCK_OK);
+        return bytes;
+    }
+}
+
+// Test fixture for checkpoints and recovery after a power cut
+class LogCheckpointTest : public ::testing::Test {
+protected:
+    std::string path = ::testing::TempDir() + "log_checkpoint.img";
+    const uint32_t FIRST_RUN = 40000;       // About 85 log blocks
+    const uint32_t SECOND_RUN = 3000;
+
+    void TearDown() override {
+        std::remove(path.c_str());
+    }
+
+    // Recover from whatever the card holds and check the end found
+    log_checkpoint_t recover(block_dev_t *dev, uint32_t expected_blocks, uint32_t *reads = nullptr) {
+        log_checkpointer_t ckpt;
+        log_checkpointer_init(&ckpt, dev, CKPT_LBA);
+        log_checkpoint_t cp;
+        log_checkpoint_t rec = {};
+        if (log_checkpointer_load(&ckpt, &cp) != 1) {
+            EXPECT_EQ(expected_blocks, 0u);
+            rec.start_lba = FILE_LBA;
+            rec.file_blocks = FILE_BLOCKS;
+            rec.prev_index = LOG_NO_BLOCK;
+            return rec;
+        }
+        EXPECT_LE(cp.next_block, expected_blocks);
+        std::vector<uint8_t> scratch(LOG_BLOCK_SIZE);
+        uint32_t blocks_read = 0;
+        EXPECT_EQ(log_recover(dev, &cp, scratch.data(), &rec, &blocks_read), BLOCK_OK);
+        EXPECT_EQ(rec.next_block, expected_blocks);
+        if (reads) {
+            *reads = blocks_read;
+        }
+        return rec;
+    }
+};
+
+// Test that the newer of the two checkpoint slots wins, and that a damaged
+// newest slot falls back to the older one
+TEST_F(LogCheckpointTest, LoadsNewestIntactSlot) {
+    host::FileBlockDev card(path, CARD_SECTORS);
+    ASSERT_EQ(block_dev_init(card.dev()), BLOCK_OK);
+
+    log_checkpointer_t ckpt;
+    log_checkpoint_t cp;
+    log_checkpointer_init(&ckpt, card.dev(), CKPT_LBA);
+    EXPECT_EQ(log_checkpointer_load(&ckpt, &cp), 0);
+
+    log_checkpointer_new_file(&ckpt, 3, FILE_LBA, FILE_BLOCKS);
+    ASSERT_EQ(log_checkpointer_save(&ckpt, true), 1);
+    ckpt.current.next_block = 10;
+    EXPECT_EQ(log_checkpointer_save(&ckpt, false), 0);     // Not due yet
+    ckpt.current.next_block = 40;
+    ASSERT_EQ(log_checkpointer_save(&ckpt, false), 1);
+
+    ASSERT_EQ(log_checkpointer_load(&ckpt, &cp), 1);
+    EXPECT_EQ(cp.file_number, 3u);
+    EXPECT_EQ(cp.next_block, 40u);
+
+    // Tear the newest slot
+    uint8_t sector[BLOCK_SIZE];
+    uint32_t newest = CKPT_LBA + ckpt.current.generation % LOG_CHECKPOINT_SLOTS;
+    ASSERT_EQ(block_dev_read(card.dev(), newest, sector, 1), BLOCK_OK);
+    sector[30] ^= 0x01;
+    ASSERT_EQ(block_dev_write(card.dev(), newest, sector, 1), BLOCK_OK);
+    ASSERT_EQ(log_checkpointer_load(&ckpt, &cp), 1);
+    EXPECT_EQ(cp.next_block, 0u);
+}
+
+// Test that the segment range round-trips, and that a version 1
+// checkpoint still loads, with no older files or spares to manage
+TEST_F(LogCheckpointTest, LoadsSegmentsAndVersion1) {
+    host::FileBlockDev card(path, CARD_SECTORS);
+    ASSERT_EQ(block_dev_init(card.dev()), BLOCK_OK);
+
+    log_checkpointer_t ckpt;
+    log_checkpoint_t cp;
+    log_checkpointer_init(&ckpt, card.dev(), CKPT_LBA);
+    log_checkpointer_new_file(&ckpt, 12, FILE_LBA, FILE_BLOCKS);
+    ckpt.current.oldest_file = 5;
+    ckpt.current.spare_first = 30;
+    ckpt.current.spare_end = 32;
+    ASSERT_EQ(log_checkpointer_save(&ckpt, true), 1);
+    ASSERT_EQ(log_checkpointer_load(&ckpt, &cp), 1);
+    EXPECT_EQ(cp.oldest_file, 5u);
+    EXPECT_EQ(cp.spare_first, 30u);
+    EXPECT_EQ(cp.spare_end, 32u);
+
+    // Rewrite the slot as the first firmware did: CRC at 48, then 0xFF
+    uint8_t sector[BLOCK_SIZE];
+    uint32_t slot = CKPT_LBA + ckpt.current.generation % LOG_CHECKPOINT_SLOTS;
+    ASSERT_EQ(block_dev_read(card.dev(), slot, sector, 1), BLOCK_OK);
+    sector[4] = 1;
+    uint32_t crc = crc32(CRC32_INIT, sector, 48);
+    std::memcpy(&sector[48], &crc, 4);
+    std::memset(&sector[52], 0xFF, BLOCK_SIZE - 52);
+    ASSERT_EQ(block_dev_write(card.dev(), slot, sector, 1), BLOCK_OK);
+    ASSERT_EQ(log_checkpointer_load(&ckpt, &cp), 1);
+    EXPECT_EQ(cp.file_number, 12u);
+    EXPECT_EQ(cp.oldest_file, 12u);
+    EXPECT_EQ(cp.spare_first, cp.spare_end);
+}
+
+// Test a power cut at every write of a run, torn or clean: recovery finds
+// exactly the blocks that reached the card, logging carries on after them,
+// and the file then reads back in time order with nothing lost that was
+// written in full
+TEST_F(LogCheckpointTest, RecoversFromPowerCutAtEveryWrite) {
+    uint64_t total_writes;
+    {
+        host::FileBlockDev card(path, CARD_SECTORS);
+        block_dev_init(card.dev());
+        auto logger = std::make_unique<Logger>(card.dev());
+        logger->add(0, FIRST_RUN);
+        logger->finish();
+        total_writes = card.writes();
+        ASSERT_GT(logger->ckpt.saves, 2u);
+    }
+
+    for (uint64_t cut = 0; cut <= total_writes; ++cut) {
+        uint32_t torn = cut % 3 == 1 ? 3 : 0;
+        SCOPED_TRACE("power cut before write " + std::to_string(cut) + ", torn " + std::to_string(torn));
+
+        host::FileBlockDev card(path, CARD_SECTORS);
+        block_dev_init(card.dev());
+        card.cut_power_after(cut, torn);
+        auto before = std::make_unique<Logger>(card.dev());
+        before->add(0, FIRST_RUN);
+        before->finish();
+        card.restore_power();
+        before->count_torn(torn);
+
+        uint32_t reads = 0;
+        log_checkpoint_t rec = recover(card.dev(), before->durable_blocks, &reads);
+        EXPECT_LE(reads, 9u);
+
+        auto after = std::make_unique<Logger>(card.dev(), rec);
+        after->add(0, SECOND_RUN);
+        after->finish();
+
+        std::vector<uint8_t> bytes = read_file(card.dev());
+        host::BlockLogReader reader(bytes.data(), bytes.size());
+        ASSERT_TRUE(reader.valid());
+        uint64_t count = 0;
+        uint64_t last = 0;
+        bool ordered = true;
+        reader.read_range(0, UINT64_MAX, [&](const sample_t &s) {
+            ordered = ordered && (count == 0 || s.time_us > last);
+            last = s.time_us;
+            count++;
+        });
+        EXPECT_TRUE(ordered);
+        EXPECT_EQ(count, (rec.next_block > 0 ? before->durable_samples : 0) + SECOND_RUN);
+        if (HasFailure()) {
+            break;
+        }
+    }
+}
+
+// Test that blocks left in the file by an earlier log are not taken for
+// the end of the current one
+TEST_F(LogCheckpointTest, IgnoresStaleBlocksOfEarlierLog) {
+    host::FileBlockDev card(path, CARD_SECTORS);
+    block_dev_init(card.dev());
+    {
+        auto old_log = std::make_unique<Logger>(card.dev(), 0xDEAD);
+        old_log->add(0, 55000);
+        old_log->finish();
+    }
+
+    // A new log in the same file, cut after a few blocks
+    card.cut_power_after(20);
+    auto logger = std::make_unique<Logger>(card.dev());
+    logger->add(0, FIRST_RUN);
+    logger->finish();
+    card.restore_power();
+    ASSERT_GT(logger->durable_blocks, 5u);
+
+    log_checkpoint_t rec = recover(card.dev(), logger->durable_blocks);
+    EXPECT_EQ(rec.log_id, 0x1234567u);
+}
+
+// Test that recovery finds the index block written after the checkpoint,
+// so the resumed log's index chain stays linked
+TEST_F(LogCheckpointTest, RecoveryFollowsIndexCadence) {
+    host::FileBlockDev card(path, CARD_SECTORS);
+    block_dev_init(card.dev());
+    auto logger = std::make_unique<Logger>(card.dev());
+    logger->add(0, FIRST_RUN);
+    logger->finish();
+    ASSERT_GT(logger->durable_blocks, LOG_INDEX_INTERVAL + 2u);
+
+    // Rewind to the checkpoint before the index block and recover from there
+    log_checkpoint_t cp = logger->ckpt.current;
+    cp.next_block = 40;
+    cp.index_pending = 39;
+    cp.prev_index = LOG_NO_BLOCK;
+    std::vector<uint8_t> scratch(LOG_BLOCK_SIZE);
+    log_checkpoint_t rec;
+    uint32_t reads = 0;
+    ASSERT_EQ(log_recover(card.dev(), &cp, scratch.data(), &rec, &reads), BLOCK_OK);
+    EXPECT_EQ(rec.next_block, std::min(logger->durable_blocks, 40u + LOG_RECOVER_WINDOW));
+    EXPECT_EQ(rec.prev_index, (uint32_t)LOG_INDEX_INTERVAL + 1);
+    EXPECT_EQ(rec.index_pending, rec.next_block - 1 - (LOG_INDEX_INTERVAL + 1));
+}
@@ -0,0 +1,281 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "log_export.hpp"
+#include "mapped_file.hpp"
+
+// Logs built in memory with one sample every 10 ms
+namespace {
+    struct Blocks {
+        std::vector<uint8_t> bytes;
+        std::vector<sample_t> samples;     // As they go in, before delta coding
+    };
+
+    bool append_block(void *ctx, const uint8_t *block) {
+        auto *bytes = static_cast<std::vector<uint8_t> *>(ctx);
+        bytes->insert(bytes->end(), block, block + LOG_BLOCK_SIZE);
+        return true;
+    }
+
+    sample_t make_sample(uint32_t i) {
+        sample_t s;
+        sample_clear(&s, 1000000ull + i * 10000ull);
+        sample_set(&s, SAMPLE_CH_TEMP, (int32_t)(i * 37 % 800) - 400);
+        sample_set(&s, SAMPLE_CH_HEADING, (int32_t)(i * 7919 % SAMPLE_HEADING_MODULUS));
+        if (i % 3) {
+            sample_set(&s, SAMPLE_CH_PITCH, (int32_t)(i * 13 % 90) - 45);
+        }
+        sample_set(&s, SAMPLE_CH_ROLL, (int32_t)(i % 7) - 3);
+        if (i % 4 == 0) {
+            sample_set(&s, SAMPLE_CH_UV_INDEX, 2616);
+            sample_set(&s, SAMPLE_CH_PRESSURE, 101325 * 16 + (int32_t)i);
+            sample_set(&s, SAMPLE_CH_HUMIDITY, 652);
+            sample_set(&s, SAMPLE_CH_HUMIDITY_TEMP, -101);
+        }
+        return s;
+    }
+
+    Blocks build_log(uint32_t samples) {
+        Blocks log;
+        static block_log_t writer;
+        block_log_config_t config = {42, 0xC0FFEE, 0, 0, LOG_NO_BLOCK, 0, 0};
+        block_log_init(&writer, &config, append_block, &log.bytes);
+        for (uint32_t i = 0; i < samples; ++i) {
+            sample_t s = make_sample(i);
+            block_log_add(&writer, &s);
+            log.samples.push_back(s);
+        }
+        block_log_flush(&writer);
+        return log;
+    }
+
+    // Lay a log out as flash_log does: block seq s in sector (s - 1) % ring,
+    // the FILE block in the last sector, later laps over earlier ones
+    std::vector<uint8_t> as_ring(const std::vector<uint8_t> &log, uint32_t ring) {
+        std::vector<uint8_t> chip((ring + 1) * LOG_BLOCK_SIZE, 0xFF);
+        std::memcpy(&chip[ring * LOG_BLOCK_SIZE], log.data(), LOG_BLOCK_SIZE);
+        for (size_t seq = 1; seq < log.size() / LOG_BLOCK_SIZE; ++seq) {
+            std::memcpy(&chip[(seq - 1) % ring * LOG_BLOCK_SIZE], &log[seq * LOG_BLOCK_SIZE], LOG_BLOCK_SIZE);
+        }
+        return chip;
+    }
+
+    std::string csv_time(const sample_t &s) {
+        return std::to_string(s.time_us);
+    }
+
+    template <typename T>
+    T take(const std::string &bytes, size_t &pos) {
+        T value;
+        std::memcpy(&value, bytes.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+}
+
+// Test fixture for the parallel log exporter
+class LogExportTest : public ::testing::Test {
+protected:
+    std::string path = ::testing::TempDir() + "log_export.bin";
+
+    void TearDown() override {
+        std::remove(path.c_str());
+    }
+
+    static std::string run(const std::vector<uint8_t> &bytes, unsigned threads, host::ExportOptions options,
+                           host::ExportStats *stats = nullptr) {
+        host::ThreadPool pool(threads);
+        host::LogExporter exporter(bytes.data(), bytes.size());
+        EXPECT_TRUE(exporter.valid());
+        std::string out;
+        host::ExportStats s = exporter.run(pool, options, [&](const char *data, size_t len) {
+            out.append(data, len);
+            return true;
+        });
+        EXPECT_EQ(s.bytes_out, out.size());
+        if (stats) {
+            *stats = s;
+        }
+        return out;
+    }
+};
+
+// Test that a mapped file shows the file's bytes and that a missing one
+// throws
+TEST_F(LogExportTest, MapsFile) {
+    std::vector<uint8_t> bytes(3 * LOG_BLOCK_SIZE + 17);
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        bytes[i] = (uint8_t)(i * 31);
+    }
+    std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+
+    host::MappedFile file(path);
+    ASSERT_EQ(file.size(), bytes.size());
+    EXPECT_EQ(std::memcmp(file.data(), bytes.data(), bytes.size()), 0);
+    EXPECT_THROW(host::MappedFile(path + ".missing"), std::runtime_error);
+}
+
+// Test that every index runs exactly once, loop after loop
+TEST_F(LogExportTest, PoolRunsEveryIndexOnce) {
+    host::ThreadPool pool(4);
+    EXPECT_EQ(pool.size(), 4u);
+    for (size_t count : {0u, 1u, 3u, 1000u}) {
+        std::vector<std::atomic<int>> hits(count);
+        pool.parallel_for(count, [&](size_t i) { hits[i]++; });
+        for (size_t i = 0; i < count; ++i) {
+            ASSERT_EQ(hits[i].load(), 1) << "index " << i << " of " << count;
+        }
+    }
+}
+
+// Test the CSV lines, in log order, and that the thread count and chunk
+// size do not change a byte of them
+TEST_F(LogExportTest, CsvMatchesSamplesWhateverTheThreads) {
+    Blocks log = build_log(20000);
+    host::ExportOptions options;
+    host::ExportStats stats;
+    std::string csv = run(log.bytes, 1, options, &stats);
+
+    EXPECT_EQ(stats.samples, log.samples.size());
+    EXPECT_GT(stats.blocks, 0u);
+    EXPECT_LE(stats.blocks, log.bytes.size() / LOG_BLOCK_SIZE - 1);     // Index blocks are not counted
+    EXPECT_EQ(stats.bad_blocks, 0u);
+    EXPECT_EQ(csv.substr(0, csv.find('\n')),
+              "time_us,temp_c,heading_deg,pitch_deg,roll_deg,angle8,uva,uvb,uv_index,pressure_pa,press_temp_c,"
+              "humidity_pct,humid_temp_c");
+    std::string none(host::kOtherColumnCount, ',');
+
+    // Sample 10: raw -30 is -0.234 °C, which the device prints as -0.24
+    const sample_t &s = log.samples[10];
+    std::string line = csv_time(s) + ",-0.24," + std::to_string(s.value[SAMPLE_CH_HEADING] / 10) + "." +
+                       std::to_string(s.value[SAMPLE_CH_HEADING] % 10) + "," +
+                       std::to_string(s.value[SAMPLE_CH_PITCH]) + "," + std::to_string(s.value[SAMPLE_CH_ROLL]);
+    EXPECT_NE(csv.find("\n" + line + none + "\n"), std::string::npos) << line;
+    EXPECT_NE(csv.find("\n" + csv_time(log.samples[3]) + ",-2.26,"), std::string::npos);
+    EXPECT_NE(csv.find(",," + std::to_string(log.samples[3].value[SAMPLE_CH_ROLL]) + none + "\n"), std::string::npos);
+
+    // The other channels as the device formats them: sample 8 has UV index,
+    // pressure (1/16 Pa, shown to 0.01) and humidity
+    std::string eight = csv.substr(csv.find("\n" + csv_time(log.samples[8]) + ",") + 1);
+    eight = eight.substr(0, eight.find('\n') + 1);
+    EXPECT_NE(eight.find(std::to_string(log.samples[8].value[SAMPLE_CH_ROLL]) + ",,,,2.616,101325.50,,65.2,-10.1\n"),
+              std::string::npos)
+        << eight;
+
+    for (unsigned threads : {2u, 3u, 8u}) {
+        for (size_t chunk : {1u, 5u, 64u}) {
+            options.chunk_blocks = chunk;
+            ASSERT_EQ(run(log.bytes, threads, options), csv) << threads << " threads, " << chunk << " blocks";
+        }
+    }
+}
+
+// Test that the columnar output reads back to what decode_batch makes of
+// the samples
+TEST_F(LogExportTest, ColumnarReadsBack) {
+    Blocks log = build_log(5000);
+    host::ExportOptions options;
+    options.format = host::ExportFormat::Columnar;
+    options.chunk_blocks = 2;
+    std::string out = run(log.bytes, 3, options);
+
+    size_t pos = 0;
+    ASSERT_EQ(take<uint32_t>(out, pos), host::kColumnarMagic);
+    EXPECT_EQ(take<uint16_t>(out, pos), host::kColumnarVersion);
+    uint16_t columns = take<uint16_t>(out, pos);
+    ASSERT_EQ(columns, 7u + host::kOtherColumnCount);
+    EXPECT_EQ(take<uint64_t>(out, pos), 42u);
+    EXPECT_EQ(take<uint32_t>(out, pos), 0xC0FFEEu);
+    pos += 4;
+    EXPECT_STREQ(out.c_str() + pos, "time_us");
+    pos += columns * 16;
+
+    host::EngColumns ref;
+    ref.resize(log.samples.size());
+    host::decode_batch(log.samples.data(), log.samples.size(), ref);
+
+    size_t row = 0;
+    while (pos < out.size()) {
+        ASSERT_EQ(take<uint32_t>(out, pos), host::kColumnarRowsMagic);
+        uint32_t rows = take<uint32_t>(out, pos);
+        ASSERT_LE(row + rows, log.samples.size());
+        const char *group = out.data() + pos;
+        EXPECT_EQ(std::memcmp(group, &ref.time_us[row], rows * 8), 0);
+        group += rows * 8;
+        EXPECT_EQ(std::memcmp(group, &ref.valid[row], rows * 4), 0);
+        group += rows * 4;
+        EXPECT_EQ(std::memcmp(group, &ref.temp_centi[row], rows * 4), 0);
+        group += rows * 4;
+        EXPECT_EQ(std::memcmp(group, &ref.temp_c[row], rows * 4), 0);
+        group += rows * 4;
+        EXPECT_EQ(std::memcmp(group, &ref.heading_deg[row], rows * 4), 0);
+        group += 2 * rows * 4;      // Pitch is NaN in places; compare roll
+        EXPECT_EQ(std::memcmp(group, &ref.roll_deg[row], rows * 4), 0);
+        group += rows * 4;
+        for (size_t k = 0; k < host::kOtherColumnCount; ++k, group += rows * 4) {
+            // NaN in places, so compare bits
+            EXPECT_EQ(std::memcmp(group, &(ref.*host::kOtherColumns[k].column)[row], rows * 4), 0)
+                << host::kOtherColumns[k].name;
+        }
+        pos += rows * (32 + 4 * host::kOtherColumnCount);
+        row += rows;
+    }
+    EXPECT_EQ(row, log.samples.size());
+}
+
+// Test that a damaged block is counted and skipped, and the rest exported
+TEST_F(LogExportTest, SkipsBadBlocks) {
+    Blocks log = build_log(20000);
+    log.bytes[5 * LOG_BLOCK_SIZE + 100] ^= 0x40;
+    host::ExportOptions options;
+    host::ExportStats stats;
+    std::string csv = run(log.bytes, 2, options, &stats);
+
+    EXPECT_EQ(stats.bad_blocks, 1u);
+    EXPECT_LT(stats.samples, log.samples.size());
+    EXPECT_GT(stats.samples, log.samples.size() * 9 / 10);
+    EXPECT_NE(csv.find("\n" + csv_time(log.samples.back()) + ","), std::string::npos);
+}
+
+// Test a flash ring dump that has gone round several times: only the
+// blocks the ring still holds come out, oldest first, and erased sectors
+// are not counted as damage
+TEST_F(LogExportTest, ExportsFlashRingInSeqOrder) {
+    const uint32_t ring = 23;
+    Blocks log = build_log(60000);
+    size_t data_blocks = log.bytes.size() / LOG_BLOCK_SIZE - 1;
+    ASSERT_GT(data_blocks, 2u * ring);
+    std::vector<uint8_t> chip = as_ring(log.bytes, ring);
+    std::memset(&chip[(data_blocks % ring) * LOG_BLOCK_SIZE], 0xFF, LOG_BLOCK_SIZE);   // Erased ahead
+
+    host::LogExporter exporter(chip.data(), chip.size());
+    ASSERT_TRUE(exporter.valid());
+    EXPECT_TRUE(exporter.ring());
+    EXPECT_EQ(exporter.log_id(), 0xC0FFEEu);
+
+    host::ExportOptions options;
+    host::ExportStats stats;
+    std::string csv = run(chip, 4, options, &stats);
+    EXPECT_EQ(stats.bad_blocks, 0u);
+    // The ring keeps the last ring - 1 blocks; INDEX blocks among them are not data
+    size_t kept = ring - 1;
+    for (size_t seq = data_blocks - ring + 2; seq <= data_blocks; ++seq) {
+        kept -= seq % (LOG_INDEX_INTERVAL + 1) == 0;
+    }
+    EXPECT_EQ(stats.blocks, kept);
+
+    // Times rise all the way through and end with the last sample
+    std::vector<uint64_t> times;
+    for (size_t line = csv.find('\n') + 1; line < csv.size(); line = csv.find('\n', line) + 1) {
+        times.push_back(std::stoull(csv.substr(line, csv.find(',', line) - line)));
+    }
+    ASSERT_EQ(times.size(), stats.samples);
+    for (size_t i = 1; i < times.size(); ++i) {
+        ASSERT_LT(times[i - 1], times[i]);
+    }
+    EXPECT_EQ(times.back(), log.samples.back().time_us);
+}
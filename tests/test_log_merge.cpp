@@ -0,0 +1,225 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "log_merge.hpp"
+
+// Device logs written to files, each with its own start time and rate
+namespace {
+    struct DeviceLog {
+        uint64_t device_id;
+        uint64_t start_us;
+        uint64_t period_us;
+        uint32_t samples;
+    };
+
+    bool append_block(void *ctx, const uint8_t *block) {
+        auto *bytes = static_cast<std::vector<uint8_t> *>(ctx);
+        bytes->insert(bytes->end(), block, block + LOG_BLOCK_SIZE);
+        return true;
+    }
+
+    std::vector<uint8_t> build_log(const DeviceLog &d) {
+        std::vector<uint8_t> bytes;
+        static block_log_t writer;
+        block_log_config_t config = {d.device_id, uint32_t(0x1000 + d.device_id), 0, 0, LOG_NO_BLOCK, 0, 0};
+        block_log_init(&writer, &config, append_block, &bytes);
+        for (uint32_t i = 0; i < d.samples; ++i) {
+            sample_t s;
+            sample_clear(&s, d.start_us + i * d.period_us);
+            sample_set(&s, SAMPLE_CH_TEMP, int32_t(i * 37 % 800) - 400);
+            sample_set(&s, SAMPLE_CH_HEADING, int32_t((i + d.device_id) * 7919 % SAMPLE_HEADING_MODULUS));
+            block_log_add(&writer, &s);
+        }
+        block_log_flush(&writer);
+        return bytes;
+    }
+
+    void write_file(const std::string &path, const std::vector<uint8_t> &bytes) {
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    }
+
+    template <typename T>
+    T take(const std::string &bytes, size_t &pos) {
+        T value;
+        std::memcpy(&value, bytes.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+}
+
+// Test fixture for the multi-device merge
+class LogMergeTest : public ::testing::Test {
+protected:
+    std::vector<std::string> paths;
+
+    void TearDown() override {
+        for (const std::string &path : paths) {
+            std::remove(path.c_str());
+        }
+    }
+
+    std::string add_file(const std::vector<uint8_t> &bytes) {
+        paths.push_back(::testing::TempDir() + "log_merge_" + std::to_string(paths.size()) + ".bin");
+        write_file(paths.back(), bytes);
+        return paths.back();
+    }
+
+    void add_devices(const std::vector<DeviceLog> &devices) {
+        for (const DeviceLog &d : devices) {
+            add_file(build_log(d));
+        }
+    }
+
+    std::string merge(const host::MergeOptions &options, host::MergeStats *stats = nullptr) {
+        host::LogMerger merger(options);
+        for (const std::string &path : paths) {
+            EXPECT_TRUE(merger.add(path)) << path;
+        }
+        std::string out;
+        host::MergeStats s = merger.run([&](const char *data, size_t len) {
+            out.append(data, len);
+            return true;
+        });
+        EXPECT_EQ(s.bytes_out, out.size());
+        if (stats) {
+            *stats = s;
+        }
+        return out;
+    }
+};
+
+// Test that rows from devices with interleaved times come out in time
+// order, each tagged with its device, and none lost
+TEST_F(LogMergeTest, MergesDevicesInTimeOrder) {
+    add_devices({{0xA1, 1000000, 10000, 20000}, {0xB2, 1003000, 7000, 25000}, {0xC3, 900000, 25000, 8000},
+                 {0xA1, 300000000, 10000, 3000}});
+    host::MergeStats stats;
+    std::string csv = merge(host::MergeOptions(), &stats);
+
+    EXPECT_EQ(stats.inputs, 4u);
+    EXPECT_EQ(stats.devices, 3u);
+    EXPECT_EQ(stats.samples, 56000u);
+    EXPECT_EQ(stats.bad_blocks, 0u);
+    EXPECT_EQ(stats.out_of_order, 0u);
+
+    std::istringstream lines(csv);
+    std::string line;
+    std::getline(lines, line);
+    EXPECT_EQ(line + "\n", "device_id," + host::csv_header());
+    std::map<std::string, uint64_t> rows;
+    uint64_t last = 0;
+    size_t count = 0;
+    while (std::getline(lines, line)) {
+        ASSERT_EQ(line.find(','), 16u) << line;
+        uint64_t t = std::strtoull(line.c_str() + 17, nullptr, 10);
+        ASSERT_GE(t, last) << "row " << count;
+        last = t;
+        rows[line.substr(0, 16)]++;
+        count++;
+    }
+    EXPECT_EQ(count, 56000u);
+    EXPECT_EQ(rows["00000000000000a1"], 23000u);
+    EXPECT_EQ(rows["00000000000000b2"], 25000u);
+    EXPECT_EQ(rows["00000000000000c3"], 8000u);
+
+    // The first row is device C3's, which started earliest
+    EXPECT_EQ(csv.substr(csv.find('\n') + 1, 24), "00000000000000c3,900000,");
+}
+
+// Test that one-block reads, a single I/O thread and tiny batches give
+// the same bytes, and that the read buffers follow read_blocks
+TEST_F(LogMergeTest, BufferSizesDoNotChangeOutput) {
+    add_devices({{1, 0, 1000, 9000}, {2, 500, 1500, 7000}, {3, 250, 3000, 4000}});
+    host::MergeStats stats;
+    std::string reference = merge(host::MergeOptions(), &stats);
+    EXPECT_EQ(stats.buffer_bytes, 3u * 2 * 8 * LOG_BLOCK_SIZE);
+
+    host::MergeOptions options;
+    options.read_blocks = 1;
+    options.io_threads = 1;
+    options.batch_rows = 7;
+    std::string small = merge(options, &stats);
+    EXPECT_EQ(small, reference);
+    EXPECT_EQ(stats.buffer_bytes, 3u * 2 * LOG_BLOCK_SIZE);
+    EXPECT_GT(stats.reads, stats.blocks);
+}
+
+// Test that columnar output carries a device_id column next to the
+// usual ones, in merged order
+TEST_F(LogMergeTest, ColumnarHasDeviceColumn) {
+    add_devices({{0x11, 0, 2000, 3000}, {0x22, 1000, 2000, 3000}});
+    host::MergeOptions options;
+    options.format = host::ExportFormat::Columnar;
+    options.batch_rows = 1000;
+    std::string out = merge(options);
+
+    size_t pos = 0;
+    ASSERT_EQ(take<uint32_t>(out, pos), host::kColumnarMagic);
+    EXPECT_EQ(take<uint16_t>(out, pos), host::kColumnarVersion);
+    uint16_t columns = take<uint16_t>(out, pos);
+    ASSERT_EQ(columns, 8u + host::kOtherColumnCount);
+    EXPECT_EQ(take<uint64_t>(out, pos), 0u);
+    EXPECT_EQ(take<uint32_t>(out, pos), 0u);
+    pos += 4;
+    EXPECT_STREQ(out.c_str() + pos, "time_us");
+    EXPECT_STREQ(out.c_str() + pos + (columns - 1) * 16, "device_id");
+    pos += columns * 16;
+
+    size_t row = 0;
+    while (pos < out.size()) {
+        ASSERT_EQ(take<uint32_t>(out, pos), host::kColumnarRowsMagic);
+        uint32_t rows = take<uint32_t>(out, pos);
+        EXPECT_EQ(rows, 1000u);
+        size_t device_at = pos + rows * (8 + 4 * (6 + host::kOtherColumnCount));
+        for (uint32_t i = 0; i < rows; ++i, ++row) {
+            size_t t_at = pos + i * 8;
+            size_t d_at = device_at + i * 8;
+            ASSERT_EQ(take<uint64_t>(out, t_at), row * 1000);
+            ASSERT_EQ(take<uint64_t>(out, d_at), row % 2 ? 0x22u : 0x11u);
+        }
+        pos = device_at + rows * 8;
+    }
+    EXPECT_EQ(row, 6000u);
+}
+
+// Test that files that are not logs are refused, a missing one throws,
+// and a damaged block is skipped and counted
+TEST_F(LogMergeTest, RefusesNonLogsAndSkipsDamage) {
+    std::vector<uint8_t> log = build_log({5, 0, 1000, 5000});
+    log[3 * LOG_BLOCK_SIZE + 100] ^= 0x40;
+    add_file(log);
+
+    host::LogMerger merger;
+    EXPECT_FALSE(merger.add(add_file(std::vector<uint8_t>(2 * LOG_BLOCK_SIZE, 0xFF))));
+    EXPECT_FALSE(merger.add(add_file(std::vector<uint8_t>(100, 0))));
+    EXPECT_THROW(merger.add(paths[0] + ".missing"), std::runtime_error);
+    ASSERT_TRUE(merger.add(paths[0]));
+    EXPECT_EQ(merger.input_count(), 1u);
+
+    host::MergeStats stats = merger.run([](const char *, size_t) { return true; });
+    EXPECT_EQ(stats.bad_blocks, 1u);
+    EXPECT_GT(stats.samples, 0u);
+    EXPECT_LT(stats.samples, 5000u);
+}
+
+// Test that a sink that refuses output stops the merge
+TEST_F(LogMergeTest, StopsWhenSinkFails) {
+    add_devices({{1, 0, 1000, 20000}, {2, 0, 1000, 20000}});
+    host::MergeOptions options;
+    options.batch_rows = 100;
+    host::LogMerger merger(options);
+    for (const std::string &path : paths) {
+        ASSERT_TRUE(merger.add(path));
+    }
+    size_t writes = 0;
+    host::MergeStats stats = merger.run([&](const char *, size_t) { return ++writes < 3; });
+    EXPECT_TRUE(stats.write_failed);
+    EXPECT_EQ(writes, 3u);
+    EXPECT_LT(stats.samples, 40000u);
+}
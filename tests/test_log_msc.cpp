@@ -0,0 +1,357 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "file_block_dev.hpp"
+#include "log_checkpoint.h"
+#include "log_msc.h"
+
+// Log files laid out on an emulated card as fatfs_log leaves them, each
+// a run of sectors from its own LBA, and read the way main.c reads them
+// for the download port and the USB disk
+namespace {
+    struct CardLog {
+        host::FileBlockDev *card = nullptr;
+        std::map<uint32_t, std::pair<uint32_t, uint32_t>> files;    // Number to LBA and blocks
+        int busy_after = -1;            // Reads to serve before one BLOCK_BUSY; -1 for none
+        uint32_t fail_file = UINT32_MAX;
+    };
+
+    int card_range(void *ctx, uint32_t *first, uint32_t *end) {
+        auto *log = static_cast<CardLog *>(ctx);
+        *first = log->files.empty() ? 0 : log->files.begin()->first;
+        *end = log->files.empty() ? 0 : log->files.rbegin()->first + 1;
+        return BLOCK_OK;
+    }
+
+    int card_size(void *ctx, uint32_t file, uint32_t *blocks) {
+        auto *log = static_cast<CardLog *>(ctx);
+        auto it = log->files.find(file);
+        if (it == log->files.end()) {
+            return BLOCK_RANGE;
+        }
+        *blocks = it->second.second;
+        return BLOCK_OK;
+    }
+
+    int card_read(void *ctx, uint32_t file, uint32_t block, uint8_t *buf) {
+        auto *log = static_cast<CardLog *>(ctx);
+        auto it = log->files.find(file);
+        if (it == log->files.end() || block >= it->second.second) {
+            return BLOCK_RANGE;
+        }
+        if (log->busy_after == 0) {
+            log->busy_after = -1;
+            return BLOCK_BUSY;
+        }
+        if (log->busy_after > 0) {
+            log->busy_after--;
+        }
+        if (file == log->fail_file) {
+            return BLOCK_ERROR;
+        }
+        return block_dev_read(log->card->dev(), it->second.first + block * LOG_SECTORS_PER_BLOCK, buf,
+                              LOG_SECTORS_PER_BLOCK);
+    }
+
+    uint8_t pattern(uint32_t file, uint32_t block, uint32_t i) {
+        return uint8_t(file * 29 + block * 3 + i + (i >> 8));
+    }
+
+    uint16_t get16(const uint8_t *p) {
+        return uint16_t(p[0] | p[1] << 8);
+    }
+
+    uint32_t get32(const uint8_t *p) {
+        return p[0] | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+    }
+
+    // What a host's FAT driver needs of a volume, read through log_msc_read
+    struct FatView {
+        uint32_t sectors_per_cluster, reserved, fats, fat_sectors, root_cluster, total_sectors;
+        uint32_t data_start, clusters;
+        std::vector<uint32_t> fat;
+
+        std::vector<uint8_t> read(log_msc_t *m, uint32_t lba, uint32_t count) {
+            std::vector<uint8_t> out(size_t(count) * LOG_MSC_SECTOR_SIZE);
+            EXPECT_EQ(log_msc_read(m, lba, 0, out.data(), uint32_t(out.size())), int32_t(out.size()));
+            return out;
+        }
+
+        void mount(log_msc_t *m) {
+            std::vector<uint8_t> boot = read(m, 0, 1);
+            ASSERT_EQ(get16(&boot[11]), LOG_MSC_SECTOR_SIZE);
+            ASSERT_EQ(boot[510], 0x55);
+            ASSERT_EQ(boot[511], 0xAA);
+            ASSERT_EQ(std::memcmp(&boot[82], "FAT32   ", 8), 0);
+            sectors_per_cluster = boot[13];
+            reserved = get16(&boot[14]);
+            fats = boot[16];
+            ASSERT_EQ(get16(&boot[17]), 0u);        // No fixed root directory: FAT32
+            ASSERT_EQ(get16(&boot[22]), 0u);
+            total_sectors = get32(&boot[32]);
+            fat_sectors = get32(&boot[36]);
+            root_cluster = get32(&boot[44]);
+            data_start = reserved + fats * fat_sectors;
+            clusters = (total_sectors - data_start) / sectors_per_cluster;
+            EXPECT_TRUE(read(m, 6, 1) == boot);
+            std::vector<uint8_t> info = read(m, get16(&boot[48]), 1);
+            EXPECT_EQ(get32(&info[0]), 0x41615252u);
+            EXPECT_EQ(get32(&info[484]), 0x61417272u);
+
+            std::vector<uint8_t> bytes = read(m, reserved, fat_sectors);
+            for (uint32_t i = 1; i < fats; ++i) {
+                EXPECT_TRUE(read(m, reserved + i * fat_sectors, fat_sectors) == bytes) << "FAT " << i;
+            }
+            fat.resize(bytes.size() / 4);
+            for (size_t i = 0; i < fat.size(); ++i) {
+                fat[i] = get32(&bytes[4 * i]) & 0x0FFFFFFF;
+            }
+        }
+
+        std::vector<uint8_t> read_chain(log_msc_t *m, uint32_t cluster, uint32_t size = UINT32_MAX) {
+            std::vector<uint8_t> out;
+            while (cluster >= 2 && cluster < 0x0FFFFFF8 && out.size() < size) {
+                std::vector<uint8_t> c =
+                    read(m, data_start + (cluster - 2) * sectors_per_cluster, sectors_per_cluster);
+                out.insert(out.end(), c.begin(), c.end());
+                cluster = fat[cluster];
+            }
+            if (size != UINT32_MAX) {
+                out.resize(size);
+            }
+            return out;
+        }
+
+        // Name to contents, and the attributes seen
+        std::map<std::string, std::vector<uint8_t>> files(log_msc_t *m, std::map<std::string, uint8_t> *attrs) {
+            std::map<std::string, std::vector<uint8_t>> out;
+            std::vector<uint8_t> dir = read_chain(m, root_cluster);
+            for (size_t at = 0; at < dir.size() && dir[at] != 0; at += 32) {
+                const uint8_t *e = &dir[at];
+                if (e[11] & 0x08) {
+                    continue;       // Volume label
+                }
+                std::string name(reinterpret_cast<const char *>(e), 8);
+                name = name.substr(0, name.find(' ')) + "." + std::string(reinterpret_cast<const char *>(e + 8), 3);
+                uint32_t cluster = uint32_t(get16(&e[20])) << 16 | get16(&e[26]);
+                out[name] = read_chain(m, cluster, get32(&e[28]));
+                if (attrs) {
+                    (*attrs)[name] = e[11];
+                }
+            }
+            return out;
+        }
+    };
+}
+
+// Test fixture for the USB disk view of a log on an emulated card
+class LogMscTest : public ::testing::Test {
+protected:
+    std::string path = ::testing::TempDir() + "log_msc_card.img";
+    host::FileBlockDev card{path, 70000};
+    CardLog log;
+    log_msc_t disk;
+    uint32_t next_lba = 1000;
+
+    void SetUp() override {
+        ASSERT_EQ(block_dev_init(card.dev()), BLOCK_OK);
+        log.card = &card;
+        log_xfer_source_t source = {card_range, card_size, card_read, &log};
+        log_msc_init(&disk, &source, 0x1234ABCD);
+    }
+
+    void TearDown() override {
+        std::remove(path.c_str());
+    }
+
+    // A file of patterned blocks on the card; more blocks may follow later
+    void add_file(uint32_t number, uint32_t blocks, uint32_t room = 0) {
+        log.files[number] = {next_lba, 0};
+        grow_file(number, blocks);
+        next_lba += (blocks + room) * LOG_SECTORS_PER_BLOCK;
+    }
+
+    void grow_file(uint32_t number, uint32_t blocks) {
+        auto &f = log.files[number];
+        std::vector<uint8_t> block(LOG_BLOCK_SIZE);
+        for (uint32_t b = f.second; b < f.second + blocks; ++b) {
+            for (uint32_t i = 0; i < LOG_BLOCK_SIZE; ++i) {
+                block[i] = pattern(number, b, i);
+            }
+            ASSERT_EQ(block_dev_write(card.dev(), f.first + b * LOG_SECTORS_PER_BLOCK, block.data(),
+                                      LOG_SECTORS_PER_BLOCK),
+                      BLOCK_OK);
+        }
+        f.second += blocks;
+    }
+
+    std::vector<uint8_t> expected(uint32_t number) {
+        std::vector<uint8_t> bytes;
+        for (uint32_t b = 0; b < log.files[number].second; ++b) {
+            for (uint32_t i = 0; i < LOG_BLOCK_SIZE; ++i) {
+                bytes.push_back(pattern(number, b, i));
+            }
+        }
+        return bytes;
+    }
+};
+
+// Test that the log's files appear on a well-formed FAT32 volume, named
+// as on the card, read-only, and hold the card's blocks unchanged
+TEST_F(LogMscTest, PresentsLogFilesOnFat32Volume) {
+    add_file(7, 40);
+    add_file(8, 0);
+    add_file(12, 130);
+    ASSERT_EQ(log_msc_load(&disk), BLOCK_OK);
+
+    FatView fat;
+    fat.mount(&disk);
+    EXPECT_EQ(fat.sectors_per_cluster * LOG_MSC_SECTOR_SIZE, LOG_BLOCK_SIZE);
+    EXPECT_EQ(fat.fats, 2u);
+    EXPECT_GE(fat.clusters, 65525u);
+    EXPECT_GE(fat.fat.size(), fat.clusters + 2);
+    EXPECT_EQ(fat.total_sectors, disk.sectors);
+    // Every log block sits on a 4 KiB boundary of the disk
+    EXPECT_EQ(fat.data_start % LOG_MSC_SECTORS_PER_CLUSTER, 0u);
+
+    std::map<std::string, uint8_t> attrs;
+    std::map<std::string, std::vector<uint8_t>> files = fat.files(&disk, &attrs);
+    ASSERT_EQ(files.size(), 3u);
+    EXPECT_TRUE(files["LOG0007.BIN"] == expected(7));
+    EXPECT_TRUE(files["LOG0008.BIN"].empty());
+    EXPECT_TRUE(files["LOG0012.BIN"] == expected(12));
+    EXPECT_EQ(attrs["LOG0012.BIN"] & 0x01, 0x01);
+
+    // Clusters past the files are free and read as zeros
+    EXPECT_EQ(fat.fat[fat.clusters], 0u);
+    std::vector<uint8_t> free = fat.read(&disk, fat.data_start + (fat.clusters - 1) * 8, 8);
+    EXPECT_EQ(std::count(free.begin(), free.end(), 0), LOG_BLOCK_SIZE);
+}
+
+// Test that reads of any size and alignment give the same bytes, and that
+// reading a block sector by sector reads it from the card only once
+TEST_F(LogMscTest, ReadsAnyAlignment) {
+    add_file(1, 64);
+    add_file(2, 33);
+    ASSERT_EQ(log_msc_load(&disk), BLOCK_OK);
+    uint32_t first = disk.data_start;
+    uint32_t count = (LOG_MSC_ROOT_CLUSTERS + 97) * LOG_MSC_SECTORS_PER_CLUSTER;
+
+    std::vector<uint8_t> whole(size_t(count) * LOG_MSC_SECTOR_SIZE);
+    ASSERT_EQ(log_msc_read(&disk, first, 0, whole.data(), uint32_t(whole.size())), int32_t(whole.size()));
+    uint32_t reads = disk.stats.source_reads;
+    EXPECT_EQ(reads, 97u);
+
+    std::vector<uint8_t> pieces(whole.size());
+    for (uint32_t s = 0; s < count; ++s) {
+        ASSERT_EQ(log_msc_read(&disk, first + s, 0, &pieces[size_t(s) * LOG_MSC_SECTOR_SIZE], LOG_MSC_SECTOR_SIZE),
+                  LOG_MSC_SECTOR_SIZE);
+    }
+    EXPECT_TRUE(pieces == whole);
+    EXPECT_EQ(disk.stats.source_reads - reads, 97u);
+
+    // Odd offsets and lengths across sector and block boundaries
+    for (uint32_t at : {1u, 511u, 4095u, 4097u, 30000u}) {
+        std::vector<uint8_t> part(9000);
+        ASSERT_EQ(log_msc_read(&disk, first + at / 512, at % 512, part.data(), 9000), 9000);
+        EXPECT_TRUE(std::equal(part.begin(), part.end(), whole.begin() + at)) << at;
+    }
+
+    // Past the end of the volume
+    uint8_t sector[LOG_MSC_SECTOR_SIZE];
+    EXPECT_EQ(log_msc_read(&disk, disk.sectors, 0, sector, sizeof(sector)), -1);
+    EXPECT_EQ(log_msc_read(&disk, disk.sectors - 1, 1, sector, sizeof(sector)), -1);
+}
+
+// Test that the disk shows the snapshot it was loaded with, and that
+// loading again picks up new blocks and files and tells the host the
+// medium changed; ejected, it has no medium
+TEST_F(LogMscTest, ReloadShowsGrowthAndSignalsChange) {
+    EXPECT_EQ(log_msc_unit_ready(&disk), LOG_MSC_NO_MEDIUM);
+    add_file(3, 10, 100);
+    ASSERT_EQ(log_msc_load(&disk), BLOCK_OK);
+    EXPECT_EQ(log_msc_unit_ready(&disk), LOG_MSC_CHANGED);
+    EXPECT_EQ(log_msc_unit_ready(&disk), LOG_MSC_READY);
+
+    grow_file(3, 25);
+    add_file(4, 5);
+    FatView fat;
+    fat.mount(&disk);
+    std::map<std::string, std::vector<uint8_t>> files = fat.files(&disk, nullptr);
+    ASSERT_EQ(files.size(), 1u);
+    EXPECT_EQ(files["LOG0003.BIN"].size(), 10u * LOG_BLOCK_SIZE);
+
+    ASSERT_EQ(log_msc_load(&disk), BLOCK_OK);
+    EXPECT_EQ(log_msc_unit_ready(&disk), LOG_MSC_CHANGED);
+    fat.mount(&disk);
+    files = fat.files(&disk, nullptr);
+    ASSERT_EQ(files.size(), 2u);
+    EXPECT_TRUE(files["LOG0003.BIN"] == expected(3));
+    EXPECT_TRUE(files["LOG0004.BIN"] == expected(4));
+
+    log_msc_eject(&disk);
+    EXPECT_EQ(log_msc_unit_ready(&disk), LOG_MSC_NO_MEDIUM);
+    uint8_t sector[LOG_MSC_SECTOR_SIZE];
+    EXPECT_EQ(log_msc_read(&disk, 0, 0, sector, sizeof(sector)), -1);
+}
+
+// Test that a busy source cuts a read short, to be asked again for the
+// rest, and a failed read is an error
+TEST_F(LogMscTest, BusySourceDefersRead) {
+    add_file(5, 8);
+    add_file(6, 8);
+    ASSERT_EQ(log_msc_load(&disk), BLOCK_OK);
+    uint32_t file_lba = disk.data_start + LOG_MSC_ROOT_CLUSTERS * LOG_MSC_SECTORS_PER_CLUSTER;
+
+    std::vector<uint8_t> buf(2 * LOG_BLOCK_SIZE);
+    std::vector<uint8_t> want = expected(5);
+    log.busy_after = 0;
+    EXPECT_EQ(log_msc_read(&disk, file_lba, 0, buf.data(), uint32_t(buf.size())), 0);
+    EXPECT_EQ(disk.stats.busy, 1u);
+    EXPECT_EQ(log_msc_read(&disk, file_lba, 0, buf.data(), uint32_t(buf.size())), int32_t(buf.size()));
+    EXPECT_TRUE(std::equal(buf.begin(), buf.end(), want.begin()));
+
+    // Busy at the second block: the first is returned, then the rest
+    log.busy_after = 1;
+    std::fill(buf.begin(), buf.end(), 0);
+    ASSERT_EQ(log_msc_read(&disk, file_lba + 16, 0, buf.data(), uint32_t(buf.size())), LOG_BLOCK_SIZE);
+    ASSERT_EQ(log_msc_read(&disk, file_lba + 24, 0, &buf[LOG_BLOCK_SIZE], LOG_BLOCK_SIZE), LOG_BLOCK_SIZE);
+    EXPECT_TRUE(std::equal(buf.begin(), buf.end(), want.begin() + 2 * LOG_BLOCK_SIZE));
+
+    log.fail_file = 6;
+    EXPECT_EQ(log_msc_read(&disk, file_lba + 8 * 8, 0, buf.data(), LOG_BLOCK_SIZE), -1);
+    EXPECT_EQ(disk.stats.read_errors, 1u);
+}
+
+// Test read throughput through the translation layer: a 32 MiB log on
+// the emulated card read as the host would, in transfers the size of the
+// MSC endpoint buffer, reported as test properties. This is the layer's
+// own cost; over USB full speed the bus, at about 1 MB/s, is the limit.
+TEST_F(LogMscTest, ReportsReadThroughput) {
+    for (uint32_t f = 0; f < 8; ++f) {
+        add_file(f, 1024);
+    }
+    ASSERT_EQ(log_msc_load(&disk), BLOCK_OK);
+
+    for (uint32_t transfer : {512u, 4096u, 65536u}) {
+        std::vector<uint8_t> buf(transfer);
+        uint32_t reads = disk.stats.source_reads;
+        uint32_t first = disk.data_start + LOG_MSC_ROOT_CLUSTERS * LOG_MSC_SECTORS_PER_CLUSTER;
+        uint64_t bytes = 8ull * 1024 * LOG_BLOCK_SIZE;
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t at = 0; at < bytes; at += transfer) {
+            ASSERT_EQ(log_msc_read(&disk, first + uint32_t(at / LOG_MSC_SECTOR_SIZE), 0, buf.data(), transfer),
+                      int32_t(transfer));
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        EXPECT_EQ(disk.stats.source_reads - reads, 8u * 1024);
+        double mb_s = bytes / secs / 1e6;
+        std::printf("  %5u-byte reads: %8.0f MB/s\n", transfer, mb_s);
+        RecordProperty("read_" + std::to_string(transfer) + "_mb_per_s", int(mb_s));
+    }
+}
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <string>
+#include "log_path_sim.hpp"
+
+// The logging path harness: samples through the ring, sink and sd_log
+// buffers into emulated storage, in virtual time
+class LogPathSimTest : public ::testing::Test {
+protected:
+    std::string path;
+    host::LogPathConfig config;
+
+    void SetUp() override {
+        path = ::testing::TempDir() + "log_path_sim.img";
+        config.rate_hz = 200;
+        config.seconds = 300;
+    }
+};
+
+// Test that storage that never waits takes every sample, and that the
+// report adds up
+TEST_F(LogPathSimTest, InstantStorageKeepsEverything) {
+    host::SdBackend sd(path, host::LatencyModel{});
+    host::LogPathReport r = host::run_log_path(sd, config);
+
+    EXPECT_EQ(r.samples, 60000u);
+    EXPECT_EQ(r.samples_logged, r.samples);
+    EXPECT_EQ(r.ring_dropped + r.queue_dropped, 0u);
+    EXPECT_GT(r.buffers_written, 10u);
+    EXPECT_EQ(r.bytes_written, r.buffers_written * SD_LOG_BUFFER_SIZE);
+    EXPECT_EQ(r.commit_us.size(), r.buffers_written);
+    EXPECT_EQ(r.commit_percentile(1.0), 0u);
+    EXPECT_EQ(r.busy_us, 0u);
+    EXPECT_LE(r.buffers_high_water, 2u);      // An index block comes with a data block
+    EXPECT_LE(r.ring_high_water, 1u);
+    EXPECT_NEAR(r.throughput(), r.bytes_written / 300.0, 1.0);
+}
+
+// Test that a stall longer than the ring covers drops samples, and that a
+// deeper ring rides it out
+TEST_F(LogPathSimTest, RingDepthCoversStalls) {
+    host::LatencyModel model;
+    model.base_us = 500;
+    model.spike_every = 4;
+    model.spike_us = 400000;    // 80 samples at 200 Hz
+
+    config.ring_size = 32;
+    host::LogPathReport shallow;
+    {
+        host::SdBackend sd(path, model);
+        shallow = host::run_log_path(sd, config);
+    }
+    EXPECT_GT(shallow.ring_dropped, 0u);
+    EXPECT_EQ(shallow.ring_high_water, 32u);
+    EXPECT_GE(shallow.commit_percentile(1.0), 400000u);
+
+    config.ring_size = 128;
+    host::SdBackend sd(path, model);
+    host::LogPathReport deep = host::run_log_path(sd, config);
+    EXPECT_EQ(deep.ring_dropped + deep.queue_dropped, 0u);
+    EXPECT_GE(deep.ring_high_water, 80u);
+    EXPECT_LE(deep.ring_high_water, 128u);
+    EXPECT_EQ(deep.samples_logged, deep.samples);
+}
+
+// Test that erasing flash ahead takes the erase out of the commit latency
+TEST_F(LogPathSimTest, FlashEraseAheadShortensCommits) {
+    host::LogPathReport on_write;
+    {
+        host::FlashBackend flash(path, host::FlashTiming{}, false);
+        on_write = host::run_log_path(flash, config);
+    }
+    host::FlashBackend flash(path, host::FlashTiming{}, true);
+    host::LogPathReport ahead = host::run_log_path(flash, config);
+
+    ASSERT_GT(ahead.buffers_written, 10u);
+    EXPECT_GE(on_write.commit_percentile(0.5), 45000u);
+    EXPECT_LT(ahead.commit_percentile(0.5), 10000u);
+    EXPECT_EQ(ahead.ring_dropped + ahead.queue_dropped, 0u);
+    EXPECT_LE(flash.flash().stats.erase_stalls, 1u);  // The first block, before any idle time
+}
+
+// Test that injected jitter is random but repeats for the same seed
+TEST_F(LogPathSimTest, JitterRepeatsForSeed) {
+    host::LatencyModel model;
+    model.jitter_us = 20000;
+    host::LogPathReport a, b, c;
+    {
+        host::SdBackend sd(path, model);
+        a = host::run_log_path(sd, config);
+    }
+    {
+        host::SdBackend sd(path, model);
+        b = host::run_log_path(sd, config);
+    }
+    model.seed = 2;
+    {
+        host::SdBackend sd(path, model);
+        c = host::run_log_path(sd, config);
+    }
+    EXPECT_EQ(a.commit_us, b.commit_us);
+    EXPECT_NE(a.commit_us, c.commit_us);
+    EXPECT_GT(a.commit_percentile(0.99), a.commit_percentile(0.5));
+}
@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "log_query.hpp"
+
+// A recording split over several log files, one sample every 10 s
+namespace {
+    const uint64_t STEP_US = 10000000;
+    const uint64_t HOUR_US = 3600000000ull;
+
+    struct Recording {
+        std::vector<std::vector<uint8_t>> files;
+        std::vector<sample_t> samples;
+    };
+
+    bool append_block(void *ctx, const uint8_t *block) {
+        auto *rec = static_cast<Recording *>(ctx);
+        log_block_header_t hdr;
+        log_block_peek(block, &hdr);
+        if (hdr.type == LOG_BLOCK_FILE) {
+            rec->files.emplace_back();
+        }
+        rec->files.back().insert(rec->files.back().end(), block, block + LOG_BLOCK_SIZE);
+        return true;
+    }
+
+    // Starts at time 0, as at boot. Heading swings either side of north;
+    // pitch only for the first day.
+    sample_t make_sample(uint32_t i) {
+        sample_t s;
+        sample_clear(&s, i * STEP_US);
+        sample_set(&s, SAMPLE_CH_TEMP, 2000 + (int32_t)(i * 7919 % 1500));
+        sample_set(&s, SAMPLE_CH_HEADING, (int32_t)((3500 + i * 13 % 200) % SAMPLE_HEADING_MODULUS));
+        if (i < 8640) {
+            sample_set(&s, SAMPLE_CH_PITCH, (int32_t)(i % 61) - 30);
+        }
+        return s;
+    }
+
+    Recording record(uint32_t samples, uint32_t file_blocks) {
+        Recording rec;
+        static block_log_t log;
+        block_log_config_t config = {9, 0xFEED, file_blocks, 0, LOG_NO_BLOCK, 0, 0};
+        block_log_init(&log, &config, append_block, &rec);
+        for (uint32_t i = 0; i < samples; ++i) {
+            sample_t s = make_sample(i);
+            block_log_add(&log, &s);
+            rec.samples.push_back(s);
+        }
+        block_log_flush(&log);
+        return rec;
+    }
+
+    // The same aggregates worked out sample by sample
+    std::vector<host::QueryBucket> reference(const std::vector<sample_t> &samples, uint64_t t0, uint64_t t1,
+                                             uint64_t bucket_us, uint64_t base) {
+        std::vector<host::QueryBucket> out;
+        for (const sample_t &s : samples) {
+            if (s.time_us < t0 || s.time_us >= t1) {
+                continue;
+            }
+            size_t b = (s.time_us - base) / bucket_us;
+            if (b >= out.size()) {
+                out.resize(b + 1);
+            }
+            for (int ch = 0; ch < SAMPLE_CH_COUNT; ++ch) {
+                if (sample_has(&s, (sample_channel_t)ch)) {
+                    host::ChannelAggregate &agg = out[b].ch[ch];
+                    agg.count++;
+                    agg.sum += s.value[ch];
+                    agg.min = std::min(agg.min, s.value[ch]);
+                    agg.max = std::max(agg.max, s.value[ch]);
+                }
+            }
+        }
+        return out;
+    }
+
+    void expect_same(const std::vector<host::QueryBucket> &got, const std::vector<host::QueryBucket> &want) {
+        ASSERT_GE(got.size(), want.size());
+        for (size_t b = 0; b < got.size(); ++b) {
+            for (int ch = 0; ch < SAMPLE_CH_COUNT; ++ch) {
+                const host::ChannelAggregate &g = got[b].ch[ch];
+                host::ChannelAggregate w = b < want.size() ? want[b].ch[ch] : host::ChannelAggregate();
+                ASSERT_EQ(g.count, w.count) << "bucket " << b << " channel " << ch;
+                ASSERT_EQ(g.sum, w.sum) << "bucket " << b << " channel " << ch;
+                if (w.count) {
+                    ASSERT_EQ(g.min, w.min);
+                    ASSERT_EQ(g.max, w.max);
+                }
+            }
+        }
+    }
+}
+
+// Test fixture for the time-range query engine
+class LogQueryTest : public ::testing::Test {
+protected:
+    Recording rec = record(30 * 8640, 128);       // 30 days over several files
+    host::LogQuery query;
+
+    void SetUp() override {
+        ASSERT_GT(rec.files.size(), 2u);
+        for (const auto &file : rec.files) {
+            ASSERT_TRUE(query.add_log(file.data(), file.size()));
+        }
+    }
+};
+
+// Test hourly aggregates over the whole recording against a sample by
+// sample reference, at several thread counts and task sizes
+TEST_F(LogQueryTest, HourlyBucketsMatchReference) {
+    EXPECT_EQ(query.first_time_us(), rec.samples.front().time_us);
+    EXPECT_EQ(query.last_time_us(), rec.samples.back().time_us);
+
+    host::QuerySpec spec;
+    spec.bucket_us = HOUR_US;
+    std::vector<host::QueryBucket> want = reference(rec.samples, 0, UINT64_MAX, HOUR_US, 0);
+    for (unsigned threads : {1u, 4u}) {
+        for (size_t chunk : {1u, 64u}) {
+            spec.chunk_blocks = chunk;
+            host::ThreadPool pool(threads);
+            host::QueryResult result = query.run(pool, spec);
+            ASSERT_EQ(result.t0, 0u);
+            ASSERT_EQ(result.buckets.size(), want.size());
+            EXPECT_EQ(result.stats.samples, rec.samples.size());
+            EXPECT_EQ(result.stats.bad_blocks, 0u);
+            EXPECT_EQ(result.buckets[5].start_us, 5 * HOUR_US);
+            expect_same(result.buckets, want);
+        }
+    }
+}
+
+// Test that a short range late in the recording decodes only the blocks
+// that hold it, and skips whole files before it
+TEST_F(LogQueryTest, RangeSkipsOtherBlocks) {
+    uint64_t t0 = 20 * 24 * HOUR_US + 1234567;
+    uint64_t t1 = t0 + 6 * HOUR_US;
+    host::QuerySpec spec;
+    spec.t0 = t0;
+    spec.t1 = t1;
+    spec.bucket_us = HOUR_US;
+    host::ThreadPool pool(3);
+    host::QueryResult result = query.run(pool, spec);
+
+    EXPECT_EQ(result.t0, t0);
+    ASSERT_EQ(result.buckets.size(), 6u);
+    expect_same(result.buckets, reference(rec.samples, t0, t1, HOUR_US, t0));
+    EXPECT_GT(result.stats.logs_skipped, 0u);
+
+    size_t blocks = 0;
+    for (const auto &file : rec.files) {
+        blocks += file.size() / LOG_BLOCK_SIZE;
+    }
+    EXPECT_LE(result.stats.blocks_decoded, 6 * blocks / (30 * 24) + 4);
+}
+
+// Test that blocks whose sensor mask lacks every wanted channel are not
+// decoded, and that a range with no data gives no buckets
+TEST_F(LogQueryTest, SkipsBlocksWithoutWantedChannels) {
+    host::QuerySpec spec;
+    spec.channels = 1u << SAMPLE_CH_PITCH;
+    host::ThreadPool pool(2);
+    host::QueryResult result = query.run(pool, spec);
+    ASSERT_EQ(result.buckets.size(), 1u);
+    EXPECT_EQ(result.buckets[0].ch[SAMPLE_CH_PITCH].count, 8640u);
+    EXPECT_EQ(result.buckets[0].ch[SAMPLE_CH_TEMP].count, 0u);
+    EXPECT_GT(result.stats.blocks_skipped, result.stats.blocks_decoded * 10);
+
+    spec.t0 = query.last_time_us() + 1;
+    EXPECT_TRUE(query.run(pool, spec).buckets.empty());
+}
+
+// Test engineering values: temperature scaled from Q7, and a heading that
+// swings either side of north averaging to north rather than south
+TEST_F(LogQueryTest, CircularMeanOfHeading) {
+    host::QuerySpec spec;
+    spec.bucket_us = 24 * HOUR_US;
+    host::ThreadPool pool(2);
+    host::QueryResult result = query.run(pool, spec);
+    ASSERT_FALSE(result.buckets.empty());
+
+    const host::QueryBucket &day = result.buckets[1];
+    double mean = host::aggregate_mean(SAMPLE_CH_HEADING, day.ch[SAMPLE_CH_HEADING]);
+    double off_north = std::min(mean, 360.0 - mean);
+    EXPECT_LT(off_north, 1.0) << mean;
+    EXPECT_NEAR(host::aggregate_mean(SAMPLE_CH_TEMP, day.ch[SAMPLE_CH_TEMP]),
+                day.ch[SAMPLE_CH_TEMP].sum / 128.0 / day.ch[SAMPLE_CH_TEMP].count, 1e-9);
+    EXPECT_DOUBLE_EQ(host::aggregate_max(SAMPLE_CH_TEMP, day.ch[SAMPLE_CH_TEMP]),
+                     day.ch[SAMPLE_CH_TEMP].max / 128.0);
+    EXPECT_TRUE(std::isnan(host::aggregate_mean(SAMPLE_CH_ROLL, day.ch[SAMPLE_CH_ROLL])));
+}
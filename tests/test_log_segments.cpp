@@ -0,0 +1,289 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include "log_segments.h"
+#include "log_path_sim.hpp"
+#include "segment_store.hpp"
+#include "file_block_dev.hpp"
+
+// The log as a pool of segments on host::SegmentStore, fed by block_log
+// straight into the segment writer. 'idle' runs the pool's upkeep after
+// every block, as the main loop would between writes.
+namespace {
+    const uint32_t SEGMENT_BLOCKS = 16;
+
+    struct Pool {
+        host::SegmentStoreConfig store_config;
+        std::unique_ptr<host::FileBlockDev> card;
+        std::unique_ptr<host::SegmentStore> store;
+        log_checkpointer_t ckpt;
+        log_segments_t seg;
+        log_writer_t writer;
+        block_log_t blocks;
+        bool idle = true;
+        uint64_t next_us = 0;
+
+        Pool(const std::string &path, log_segments_config_t config) {
+            store_config.segment_blocks = SEGMENT_BLOCKS;
+            store_config.slots = 12;
+            store_config.cluster_sectors = 8;
+            card = std::make_unique<host::FileBlockDev>(path, host::SegmentStore::sectors(store_config));
+            block_dev_init(card->dev());
+            store = std::make_unique<host::SegmentStore>(card->dev(), store_config);
+            config.file_blocks = SEGMENT_BLOCKS;
+            log_checkpointer_init(&ckpt, card->dev(), host::SegmentStore::CHECKPOINT_LBA);
+            log_segments_init(&seg, &config, &store->ops(), card->dev(), &ckpt);
+            log_segments_writer(&seg, &writer);
+        }
+
+        ~Pool() {
+            std::remove(card->path().c_str());
+        }
+
+        // Start the block log: new files by size, and by time if 'file_us'
+        void start_log(uint64_t file_us) {
+            block_log_config_t config = {7, 0xC0FFEE, SEGMENT_BLOCKS, 0, LOG_NO_BLOCK, 0, file_us};
+            block_log_init(&blocks, &config, emit, this);
+        }
+
+        static bool emit(void *ctx, const uint8_t *block) {
+            auto *self = static_cast<Pool *>(ctx);
+            EXPECT_EQ(self->writer.write(self->writer.ctx, block, LOG_BLOCK_SIZE), BLOCK_OK);
+            EXPECT_EQ(self->writer.sync(self->writer.ctx), BLOCK_OK);
+            while (self->idle && log_segments_service(&self->seg) > 0) {
+            }
+            return true;
+        }
+
+        void add(uint32_t count, uint64_t step_us) {
+            for (uint32_t i = 0; i < count; ++i, next_us += step_us) {
+                sample_t s;
+                sample_clear(&s, next_us);
+                sample_set(&s, SAMPLE_CH_TEMP, 2500 + int32_t(i * 31 % 500));
+                sample_set(&s, SAMPLE_CH_HEADING, int32_t(i * 7919 % SAMPLE_HEADING_MODULUS));
+                ASSERT_EQ(block_log_add(&blocks, &s), LOG_OK);
+            }
+        }
+    };
+}
+
+class LogSegmentsTest : public ::testing::Test {
+protected:
+    std::string path;
+    log_segments_config_t config = {};
+
+    void SetUp() override {
+        path = ::testing::TempDir() + "log_segments.img";
+        config.max_segments = 8;
+        config.spares = 1;
+    }
+};
+
+// Test that a full segment moves on to a spare made ahead, so only the
+// first segment is allocated while the log waits
+TEST_F(LogSegmentsTest, RotatesIntoSparesMadeAhead) {
+    Pool pool(path, config);
+    ASSERT_EQ(log_segments_start(&pool.seg, 0), BLOCK_OK);
+    pool.start_log(0);
+    pool.add(60000, 1000);
+
+    const log_segments_stats_t &st = pool.seg.stats;
+    EXPECT_GE(st.rotations, 5u);
+    EXPECT_EQ(st.inline_creates, 1u);
+    EXPECT_EQ(st.prepared, st.rotations);
+    EXPECT_EQ(st.recycled + st.retired + st.errors, 0u);
+    EXPECT_EQ(pool.store->count(LOG_SEGMENT_LIVE), st.rotations);
+    EXPECT_EQ(pool.store->count(LOG_SEGMENT_SPARE), 1u);
+    EXPECT_EQ(pool.seg.next, st.rotations);
+    EXPECT_EQ(pool.ckpt.current.file_number, st.rotations - 1);
+
+    // Every segment starts a log of its own
+    uint8_t block[LOG_BLOCK_SIZE];
+    log_block_header_t hdr;
+    for (uint32_t file = 0; file < pool.seg.next; ++file) {
+        uint32_t lba = pool.store->lba(LOG_SEGMENT_LIVE, file);
+        ASSERT_EQ(block_dev_read(pool.card->dev(), lba, block, LOG_SECTORS_PER_BLOCK), BLOCK_OK);
+        ASSERT_EQ(log_block_parse(block, 0, &hdr), LOG_OK);
+        EXPECT_EQ(hdr.type, LOG_BLOCK_FILE);
+        EXPECT_EQ(hdr.seq, 0u);
+    }
+}
+
+// Test that at the pool's limit with no spare, rotation takes over the
+// oldest segment, and the pool never grows past the limit
+TEST_F(LogSegmentsTest, RecyclesOldestAtLimit) {
+    config.max_segments = 4;
+    config.spares = 0;
+    Pool pool(path, config);
+    ASSERT_EQ(log_segments_start(&pool.seg, 0), BLOCK_OK);
+    pool.start_log(0);
+    pool.add(150000, 1000);
+
+    const log_segments_stats_t &st = pool.seg.stats;
+    EXPECT_GE(st.rotations, 8u);
+    EXPECT_EQ(st.inline_creates, 4u);
+    EXPECT_EQ(st.recycled, st.rotations - 4);
+    EXPECT_EQ(pool.store->slots_used(), 4u);
+    EXPECT_EQ(log_segments_count(&pool.seg), 4u);
+    EXPECT_EQ(pool.seg.oldest, pool.seg.next - 4);
+    EXPECT_FALSE(pool.store->has(LOG_SEGMENT_LIVE, pool.seg.oldest - 1));
+}
+
+// Test that logs are cut by time, that segments past retention become
+// spares, and that those are reused rather than allocated again
+TEST_F(LogSegmentsTest, RetiresByTimeAndReusesSpares) {
+    config.retain_us = 3000000;
+    Pool pool(path, config);
+    ASSERT_EQ(log_segments_start(&pool.seg, 0), BLOCK_OK);
+    pool.start_log(1000000);
+    pool.add(12000, 1000);         // 12 s: a log a second, far from full
+
+    const log_segments_stats_t &st = pool.seg.stats;
+    EXPECT_GE(st.rotations, 12u);
+    EXPECT_GE(st.retired, st.rotations - 5);
+    EXPECT_LE(st.prepared, 5u);         // Until retention starts; retired segments after that
+    EXPECT_EQ(st.inline_creates, 1u);
+    EXPECT_EQ(st.errors, 0u);
+    EXPECT_EQ(st.prepared + st.inline_creates - st.removed, pool.store->slots_used());
+    EXPECT_LE(pool.store->slots_used(), 6u);
+
+    // The oldest log kept is not entirely older than retain_us
+    uint8_t sector[BLOCK_SIZE];
+    log_block_header_t hdr;
+    uint32_t lba = pool.store->lba(LOG_SEGMENT_LIVE, pool.seg.oldest + 1);
+    ASSERT_EQ(block_dev_read(pool.card->dev(), lba + LOG_SECTORS_PER_BLOCK, sector, 1), BLOCK_OK);
+    ASSERT_EQ(log_block_peek(sector, &hdr), LOG_OK);
+    EXPECT_LT(pool.ckpt.current.last_time_us - hdr.first_time_us, config.retain_us + 1000000);
+}
+
+// Test that a restart carries on in the same segment with the same pool,
+// from what the checkpoint recorded
+TEST_F(LogSegmentsTest, ResumesPoolFromCheckpoint) {
+    config.retain_us = 3000000;
+    Pool pool(path, config);
+    ASSERT_EQ(log_segments_start(&pool.seg, 0), BLOCK_OK);
+    pool.start_log(1000000);
+    pool.add(8500, 1000);
+    ASSERT_EQ(log_segments_close(&pool.seg), BLOCK_OK);
+
+    log_checkpointer_t ckpt;
+    log_checkpoint_t cp, recovered;
+    uint8_t scratch[LOG_BLOCK_SIZE];
+    uint32_t reads = 0;
+    log_checkpointer_init(&ckpt, pool.card->dev(), host::SegmentStore::CHECKPOINT_LBA);
+    ASSERT_EQ(log_checkpointer_load(&ckpt, &cp), 1);
+    EXPECT_EQ(cp.file_number, pool.seg.next - 1);
+    EXPECT_EQ(cp.oldest_file, pool.seg.oldest);
+    EXPECT_EQ(cp.spare_first, pool.seg.spare_first);
+    EXPECT_EQ(cp.spare_end, pool.seg.spare_end);
+    ASSERT_EQ(log_recover(pool.card->dev(), &cp, scratch, &recovered, &reads), BLOCK_OK);
+
+    log_segments_t seg;
+    config.file_blocks = SEGMENT_BLOCKS;
+    log_segments_init(&seg, &config, &pool.store->ops(), pool.card->dev(), &ckpt);
+    ASSERT_EQ(log_segments_resume(&seg, &cp, &recovered), BLOCK_OK);
+    EXPECT_EQ(seg.next, pool.seg.next);
+    EXPECT_EQ(seg.oldest, pool.seg.oldest);
+    EXPECT_EQ(seg.raw.next_lba, pool.seg.raw.next_lba);
+
+    // A checkpoint naming a segment that is not there is refused
+    cp.file_number += 10;
+    EXPECT_EQ(log_segments_resume(&seg, &cp, &recovered), BLOCK_ERROR);
+}
+
+// Test that with the checkpoint lost after retention has run, the pool
+// is rebuilt from the segments there: the new log goes after the newest,
+// the oldest stays the oldest, and the spares are reused, so the pool
+// stays the size it was
+TEST_F(LogSegmentsTest, RebuildsPoolWithoutCheckpoint) {
+    config.retain_us = 3000000;
+    Pool pool(path, config);
+    ASSERT_EQ(log_segments_start(&pool.seg, 0), BLOCK_OK);
+    pool.start_log(1000000);
+    pool.add(12000, 1000);
+    ASSERT_EQ(log_segments_close(&pool.seg), BLOCK_OK);
+    ASSERT_GT(pool.seg.oldest, 0u);
+    ASSERT_GT(pool.store->count(LOG_SEGMENT_SPARE), 0u);
+    uint32_t next = pool.seg.next;
+    uint32_t oldest = pool.seg.oldest;
+    uint32_t slots = pool.store->slots_used();
+
+    // Both checkpoint slots torn
+    uint8_t junk[BLOCK_SIZE];
+    std::memset(junk, 0x5A, sizeof(junk));
+    for (uint32_t slot = 0; slot < LOG_CHECKPOINT_SLOTS; ++slot) {
+        ASSERT_EQ(block_dev_write(pool.card->dev(), host::SegmentStore::CHECKPOINT_LBA + slot, junk, 1), BLOCK_OK);
+    }
+    log_checkpoint_t cp;
+    log_checkpointer_init(&pool.ckpt, pool.card->dev(), host::SegmentStore::CHECKPOINT_LBA);
+    ASSERT_NE(log_checkpointer_load(&pool.ckpt, &cp), 1);
+
+    log_segments_scan_t scan;
+    pool.store->scan(&scan);
+    log_segments_init(&pool.seg, &config, &pool.store->ops(), pool.card->dev(), &pool.ckpt);
+    pool.seg.config.file_blocks = SEGMENT_BLOCKS;
+    ASSERT_EQ(log_segments_rebuild(&pool.seg, &scan), BLOCK_OK);
+    EXPECT_EQ(pool.seg.next, next + 1);
+    EXPECT_EQ(pool.seg.oldest, oldest);
+    EXPECT_EQ(pool.seg.stats.inline_creates, 0u);
+
+    pool.start_log(1000000);
+    pool.add(12000, 1000);
+    const log_segments_stats_t &st = pool.seg.stats;
+    EXPECT_GE(st.rotations, 12u);
+    EXPECT_EQ(st.errors, 0u);
+    EXPECT_EQ(st.inline_creates, 0u);
+    EXPECT_GT(st.retired, 0u);
+    EXPECT_LE(pool.store->slots_used(), slots + 1);
+    EXPECT_FALSE(pool.store->has(LOG_SEGMENT_LIVE, oldest));
+    EXPECT_LE(pool.store->count(LOG_SEGMENT_SPARE), config.spares + 1);
+}
+
+// Months of samples at 1 Hz, a log a day, a fortnight kept: the pool
+// stays bounded and rotation and retention never hold up a write for
+// longer than a plain one
+TEST(LogSegmentsSimTest, MonthsOfDataStayBounded) {
+    host::LatencyModel card;
+    card.base_us = 300;
+    card.per_block_us = 25;
+    card.nonsequential_us = 2000;
+
+    host::SegmentStoreConfig store;
+    store.segment_blocks = 256;
+    store.slots = 24;
+    log_segments_config_t segments = {};
+    segments.max_segments = 20;
+    segments.spares = 1;
+    segments.retain_us = 14ull * 86400 * 1000000;
+
+    host::LogPathConfig config;
+    config.rate_hz = 1;
+    config.seconds = 60.0 * 86400;
+    config.poll_us = 100000;
+    config.file_blocks = store.segment_blocks;
+    config.file_us = 86400ull * 1000000;
+
+    std::string path = ::testing::TempDir() + "log_segments_sim.img";
+    host::SegmentBackend backend(path, card, store, segments);
+    host::LogPathReport r = host::run_log_path(backend, config);
+
+    const log_segments_stats_t &st = backend.segments().stats;
+    EXPECT_EQ(r.samples_logged, r.samples);
+    EXPECT_EQ(r.ring_dropped + r.queue_dropped, 0u);
+    EXPECT_GE(st.rotations, 60u);
+    EXPECT_GE(st.retired, 44u);
+    EXPECT_EQ(st.inline_creates, 1u);
+    EXPECT_EQ(st.recycled + st.errors, 0u);
+    EXPECT_LE(backend.peak_slots(), 17u);
+    EXPECT_EQ(backend.store().count(LOG_SEGMENT_LIVE), backend.segments().next - backend.segments().oldest);
+
+    // A rotation costs a few small writes more than the block it carries:
+    // the directory sector and a checkpoint
+    uint64_t worst = 0;
+    for (uint64_t us : backend.rotation_us()) {
+        worst = std::max(worst, us);
+    }
+    EXPECT_LT(worst, 4 * (300 + 25 * LOG_SECTORS_PER_BLOCK + 2000u));
+}
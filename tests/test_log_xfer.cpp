@@ -0,0 +1,392 @@
+#include <gtest/gtest.h>
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "crc.h"
+#include "log_download.hpp"
+#include "log_xfer.h"
+
+// The device end of a pty pair stands in for the download port: the
+// device loop runs on a thread of its own against the master side, and
+// the downloader opens the slave side as it would /dev/ttyACM2.
+namespace {
+    const uint32_t kFirstFile = 3;
+
+    struct MockDevice {
+        int fd = -1;
+        std::atomic<bool> connected{true};
+        std::atomic<uint32_t> corrupt_every{0};     // Flip one byte in this many sent; 0 for none
+        std::atomic<uint32_t> cut_after{0};         // Disconnect after this many block reads; 0 for never
+        uint32_t latency_us = 0;                    // Delay before the device sees what the host sent
+        uint64_t written = 0;
+        uint32_t reads = 0;
+        std::deque<std::pair<uint32_t, uint8_t>> arriving;  // Bytes sent and when the device sees them
+        std::vector<std::vector<uint8_t>> files;    // Blocks of files kFirstFile on, back to back
+    };
+
+    MockDevice mock;
+
+    uint8_t block_byte(uint32_t file, uint32_t block, uint32_t i) {
+        return uint8_t((file * 131 + block * 31 + i * 7) ^ (i >> 5));
+    }
+
+    std::vector<uint8_t> make_file(uint32_t file, uint32_t blocks) {
+        std::vector<uint8_t> bytes(size_t(blocks) * LOG_BLOCK_SIZE);
+        for (uint32_t b = 0; b < blocks; ++b) {
+            for (uint32_t i = 0; i < LOG_BLOCK_SIZE; ++i) {
+                bytes[size_t(b) * LOG_BLOCK_SIZE + i] = block_byte(file, b, i);
+            }
+        }
+        return bytes;
+    }
+
+    int source_range(void *, uint32_t *first, uint32_t *end) {
+        *first = kFirstFile;
+        *end = kFirstFile + uint32_t(mock.files.size());
+        return BLOCK_OK;
+    }
+
+    int source_size(void *, uint32_t file, uint32_t *blocks) {
+        if (file < kFirstFile || file - kFirstFile >= mock.files.size()) {
+            return BLOCK_RANGE;
+        }
+        *blocks = uint32_t(mock.files[file - kFirstFile].size() / LOG_BLOCK_SIZE);
+        return BLOCK_OK;
+    }
+
+    int source_read(void *, uint32_t file, uint32_t block, uint8_t *buf) {
+        uint32_t blocks;
+        int status = source_size(nullptr, file, &blocks);
+        if (status != BLOCK_OK || block >= blocks) {
+            return BLOCK_RANGE;
+        }
+        std::memcpy(buf, &mock.files[file - kFirstFile][size_t(block) * LOG_BLOCK_SIZE], LOG_BLOCK_SIZE);
+        if (++mock.reads == mock.cut_after) {
+            mock.connected = false;
+        }
+        return BLOCK_OK;
+    }
+
+    // A request as the downloader sends it, with a good CRC
+    std::vector<uint8_t> request(uint8_t op, uint16_t tag, uint32_t file, uint32_t first, uint32_t count) {
+        std::vector<uint8_t> rq(LOG_XFER_REQUEST_SIZE, 0);
+        uint32_t words[] = {LOG_XFER_REQUEST_MAGIC, 0, file, first, count};
+        std::memcpy(&rq[0], &words[0], 4);
+        rq[4] = op;
+        rq[5] = 1;                                  // Window
+        std::memcpy(&rq[6], &tag, 2);
+        std::memcpy(&rq[8], &words[2], 12);
+        uint32_t crc = crc32(CRC32_INIT, rq.data(), 20);
+        std::memcpy(&rq[20], &crc, 4);
+        return rq;
+    }
+
+    uint32_t now_us() {
+        return uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+}
+
+extern "C" {
+    bool log_xfer_port_connected(void) { return mock.connected; }
+
+    uint32_t log_xfer_port_read(uint8_t *buf, uint32_t len) {
+        if (mock.latency_us == 0) {
+            ssize_t n = read(mock.fd, buf, len);
+            return n > 0 ? uint32_t(n) : 0;
+        }
+        uint8_t in[256];
+        ssize_t n;
+        uint32_t now = now_us();
+        while ((n = read(mock.fd, in, sizeof(in))) > 0) {
+            for (ssize_t i = 0; i < n; ++i) {
+                mock.arriving.emplace_back(now + mock.latency_us, in[i]);
+            }
+        }
+        uint32_t got = 0;
+        while (got < len && !mock.arriving.empty() && int32_t(now - mock.arriving.front().first) >= 0) {
+            buf[got++] = mock.arriving.front().second;
+            mock.arriving.pop_front();
+        }
+        return got;
+    }
+
+    uint32_t log_xfer_port_write_available(void) {
+        struct pollfd p = {mock.fd, POLLOUT, 0};
+        return poll(&p, 1, 0) == 1 && (p.revents & POLLOUT) ? 4096 : 0;
+    }
+
+    uint32_t log_xfer_port_write(const uint8_t *data, uint32_t len) {
+        std::vector<uint8_t> out(data, data + len);
+        uint32_t every = mock.corrupt_every;
+        if (every) {
+            for (uint32_t i = 0; i < len; ++i) {
+                if ((mock.written + i) % every == every - 1) {
+                    out[i] ^= 0x10;
+                }
+            }
+        }
+        ssize_t n = write(mock.fd, out.data(), len);
+        if (n <= 0) {
+            return 0;
+        }
+        mock.written += uint64_t(n);
+        return uint32_t(n);
+    }
+
+    void log_xfer_port_flush(void) {}
+}
+
+// Test fixture for bulk download between the device loop and the host
+class LogXferTest : public ::testing::Test {
+protected:
+    log_xfer_t xfer;
+    std::unique_ptr<host::SerialPort> port;
+    std::thread device;
+    std::atomic<bool> stop{false};
+    std::string path;
+
+    void SetUp() override {
+        mock.fd = posix_openpt(O_RDWR | O_NOCTTY);
+        ASSERT_GE(mock.fd, 0);
+        ASSERT_EQ(grantpt(mock.fd), 0);
+        ASSERT_EQ(unlockpt(mock.fd), 0);
+        fcntl(mock.fd, F_SETFL, fcntl(mock.fd, F_GETFL) | O_NONBLOCK);
+        port.reset(new host::SerialPort(ptsname(mock.fd)));
+
+        mock.connected = true;
+        mock.corrupt_every = 0;
+        mock.cut_after = 0;
+        mock.written = 0;
+        mock.reads = 0;
+        mock.latency_us = 0;
+        mock.arriving.clear();
+        mock.files = {make_file(3, 2048), make_file(4, 300), make_file(5, 7)};
+        path = ::testing::TempDir() + "log_xfer_download.bin";
+        std::remove(path.c_str());
+
+        log_xfer_source_t source = {source_range, source_size, source_read, nullptr};
+        log_xfer_init(&xfer, &source);
+        device = std::thread([this] { run_device(); });
+    }
+
+    void TearDown() override {
+        stop = true;
+        if (device.joinable()) {
+            device.join();
+        }
+        port.reset();
+        if (mock.fd >= 0) {
+            close(mock.fd);
+        }
+        std::remove(path.c_str());
+    }
+
+    // The main loop's part: poll, and sleep on the port when idle. While
+    // unplugged, whatever the host sends is lost.
+    void run_device() {
+        uint8_t drop[256];
+        while (!stop) {
+            if (!mock.connected) {
+                while (read(mock.fd, drop, sizeof(drop)) > 0) {
+                }
+            }
+            if (!log_xfer_poll(&xfer, now_us())) {
+                short events = POLLIN;
+                if (xfer.frame_sent < xfer.frame_len) {
+                    events |= POLLOUT;
+                }
+                struct pollfd p = {mock.fd, events, 0};
+                poll(&p, 1, 1);
+            }
+        }
+    }
+
+    host::DownloadStats fetch(host::LogDownloader &downloader, uint32_t file, uint32_t first, uint32_t count,
+                              std::vector<uint8_t> &bytes) {
+        uint32_t expect = first;
+        return downloader.fetch(file, first, count, [&](uint32_t block, const uint8_t *data) {
+            EXPECT_EQ(block, expect++);
+            bytes.insert(bytes.end(), data, data + LOG_BLOCK_SIZE);
+            return true;
+        });
+    }
+
+    std::vector<uint8_t> read_file() {
+        std::ifstream in(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+};
+
+// Test that the files and their lengths are listed, and an unknown file
+// is refused
+TEST_F(LogXferTest, ListsFilesAndSizes) {
+    host::LogDownloader downloader(*port);
+    std::pair<uint32_t, uint32_t> range = downloader.list();
+    EXPECT_EQ(range.first, 3u);
+    EXPECT_EQ(range.second, 6u);
+    EXPECT_EQ(downloader.blocks(4), 300u);
+    EXPECT_EQ(downloader.blocks(5), 7u);
+    EXPECT_THROW(downloader.blocks(9), std::runtime_error);
+}
+
+// Test that a whole file, a range within one and a range running off the
+// end all arrive intact and in order
+TEST_F(LogXferTest, DownloadsBlocksIntact) {
+    host::LogDownloader downloader(*port);
+    std::vector<uint8_t> bytes;
+    host::DownloadStats stats = fetch(downloader, 4, 0, UINT32_MAX, bytes);
+    EXPECT_EQ(stats.blocks, 300u);
+    EXPECT_EQ(stats.crc_errors, 0u);
+    EXPECT_EQ(stats.retries, 0u);
+    EXPECT_GE(stats.bytes, 300u * (LOG_XFER_HEADER_SIZE + LOG_BLOCK_SIZE + 4));
+    EXPECT_TRUE(bytes == mock.files[1]);
+
+    bytes.clear();
+    stats = fetch(downloader, 4, 10, 20, bytes);
+    EXPECT_EQ(stats.blocks, 20u);
+    EXPECT_TRUE(std::equal(bytes.begin(), bytes.end(), mock.files[1].begin() + 10 * LOG_BLOCK_SIZE));
+
+    bytes.clear();
+    stats = fetch(downloader, 5, 5, 100, bytes);
+    EXPECT_EQ(stats.blocks, 2u);
+    stats = fetch(downloader, 5, 7, 100, bytes);
+    EXPECT_EQ(stats.blocks, 0u);
+}
+
+// Test that frames damaged on the way are caught by their CRC and asked
+// for again, whatever the window
+TEST_F(LogXferTest, RecoversFromCorruptFrames) {
+    mock.corrupt_every = 150000;
+    for (unsigned window : {1u, 8u, 64u}) {
+        host::DownloadOptions options;
+        options.window = window;
+        options.timeout_ms = 200;
+        host::LogDownloader downloader(*port, options);
+        std::vector<uint8_t> bytes;
+        host::DownloadStats stats = fetch(downloader, 4, 0, UINT32_MAX, bytes);
+        EXPECT_EQ(stats.blocks, 300u) << "window " << window;
+        EXPECT_GT(stats.crc_errors, 0u) << "window " << window;
+        EXPECT_GT(stats.retries, 0u) << "window " << window;
+        EXPECT_TRUE(bytes == mock.files[1]) << "window " << window;
+    }
+}
+
+// Test that a download cut off by a disconnect fails, and a second run
+// into the same file fetches only the rest, after cutting off a part
+// block left at its end
+TEST_F(LogXferTest, ResumesInterruptedDownload) {
+    host::DownloadOptions options;
+    options.timeout_ms = 100;
+    options.retries = 2;
+    mock.cut_after = 120;
+    {
+        host::LogDownloader downloader(*port, options);
+        EXPECT_THROW(downloader.fetch_to(4, path), std::runtime_error);
+    }
+    std::vector<uint8_t> part = read_file();
+    ASSERT_EQ(part.size() % LOG_BLOCK_SIZE, 0u);
+    ASSERT_GT(part.size(), 0u);
+    ASSERT_LT(part.size(), mock.files[1].size());
+    EXPECT_TRUE(std::equal(part.begin(), part.end(), mock.files[1].begin()));
+    std::ofstream(path, std::ios::binary | std::ios::app) << std::string(100, 'x');
+
+    mock.connected = true;
+    host::LogDownloader downloader(*port, options);
+    host::DownloadStats stats = downloader.fetch_to(4, path);
+    EXPECT_EQ(stats.resumed_from, part.size() / LOG_BLOCK_SIZE);
+    EXPECT_EQ(stats.blocks, 300u - stats.resumed_from);
+    EXPECT_TRUE(read_file() == mock.files[1]);
+
+    // Nothing left to fetch
+    stats = downloader.fetch_to(4, path);
+    EXPECT_EQ(stats.blocks, 0u);
+    EXPECT_TRUE(read_file() == mock.files[1]);
+}
+
+// Test that a request with an op the device does not know, good CRC and
+// all, is counted and ignored: the transfer under way keeps its tag and
+// file and goes on at the next ACK
+TEST_F(LogXferTest, IgnoresUnknownOpMidTransfer) {
+    std::vector<uint8_t> frame(LOG_XFER_FRAME_MAX);
+    auto read_frame = [&] {
+        size_t got = 0;
+        while (got < frame.size()) {
+            size_t n = port->read(&frame[got], frame.size() - got, 1000);
+            if (n == 0) {
+                break;
+            }
+            got += n;
+        }
+        return got;
+    };
+    auto send = [&](const std::vector<uint8_t> &rq) { port->write(rq.data(), rq.size()); };
+    auto word = [&](size_t at) {
+        uint32_t v;
+        std::memcpy(&v, &frame[at], 4);
+        return v;
+    };
+
+    send(request(LOG_XFER_READ, 7, 4, 0, 3));
+    ASSERT_EQ(read_frame(), size_t(LOG_XFER_FRAME_MAX));
+    EXPECT_EQ(frame[4], LOG_XFER_DATA);
+    EXPECT_EQ(word(12), 0u);
+
+    send(request(42, 9, 5, 0, 0));
+    send(request(LOG_XFER_ACK, 7, 4, 1, 0));
+    ASSERT_EQ(read_frame(), size_t(LOG_XFER_FRAME_MAX));
+    EXPECT_EQ(frame[4], LOG_XFER_DATA);
+    EXPECT_EQ(frame[6] | frame[7] << 8, 7);
+    EXPECT_EQ(word(8), 4u);
+    EXPECT_EQ(word(12), 1u);
+    EXPECT_EQ(std::memcmp(&frame[LOG_XFER_HEADER_SIZE], &mock.files[1][LOG_BLOCK_SIZE], LOG_BLOCK_SIZE), 0);
+    EXPECT_EQ(xfer.stats.bad_requests, 1u);
+    send(request(LOG_XFER_STOP, 7, 4, 0, 0));
+}
+
+// Test the throughput the window buys: 2 MiB through the pty at several
+// window sizes, reported as test properties. A pty has no latency to
+// speak of, so with none the window changes little; with the millisecond
+// a USB full-speed frame adds before the device sees a request, a window
+// of one block waits out that millisecond for every block.
+TEST_F(LogXferTest, MeasuresThroughput) {
+    for (uint32_t latency_us : {0u, 1000u}) {
+        mock.latency_us = latency_us;
+        for (unsigned window : {1u, 4u, 16u, 64u}) {
+            host::DownloadOptions options;
+            options.window = window;
+            host::LogDownloader downloader(*port, options);
+            uint64_t good = 0;
+            host::DownloadStats stats = downloader.fetch(3, 0, 512, [&](uint32_t block, const uint8_t *data) {
+                good += std::memcmp(data, &mock.files[0][size_t(block) * LOG_BLOCK_SIZE], LOG_BLOCK_SIZE) == 0;
+                return true;
+            });
+            EXPECT_EQ(stats.blocks, 512u);
+            EXPECT_EQ(good, 512u);
+            double kib_per_s = stats.blocks * LOG_BLOCK_SIZE / 1024.0 / stats.seconds;
+            std::printf("  latency %4u us, window %2u: %8.0f KiB/s\n", latency_us, window, kib_per_s);
+            std::string name = "latency_" + std::to_string(latency_us) + "_window_" + std::to_string(window);
+            RecordProperty(name + "_kib_per_s", int(kib_per_s));
+        }
+    }
+}
+
+#endif
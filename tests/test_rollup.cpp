@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "rollup.h"
+
+// Samples with fixed values, one every 'step_ms'
+namespace {
+    sample_t make_sample(uint64_t time_us, int32_t temp, int32_t heading) {
+        sample_t s;
+        sample_clear(&s, time_us);
+        sample_set(&s, SAMPLE_CH_TEMP, temp);
+        sample_set(&s, SAMPLE_CH_HEADING, heading);
+        sample_set(&s, SAMPLE_CH_PITCH, -3);
+        sample_set(&s, SAMPLE_CH_ROLL, 200);    // Out of range for the packed point
+        return s;
+    }
+
+    std::vector<std::string> dump_all(const rollup_t &r, rollup_tier_t tier, uint32_t count) {
+        rollup_dump_t dump;
+        rollup_dump_start(&r, &dump, tier, count);
+        std::vector<std::string> lines;
+        char buf[ROLLUP_LINE_MAX];
+        int n;
+        while ((n = rollup_dump_line(&r, &dump, buf, sizeof(buf))) > 0) {
+            EXPECT_EQ(buf[n - 1], '\n');
+            EXPECT_LT(n, ROLLUP_LINE_MAX);
+            lines.emplace_back(buf, n);
+        }
+        return lines;
+    }
+}
+
+// Test fixture for the in-RAM rollup store
+class RollupTest : public ::testing::Test {
+protected:
+    static rollup_t r;
+
+    void SetUp() override {
+        rollup_init(&r);
+    }
+};
+
+rollup_t RollupTest::r;
+
+// Test that the raw ring packs samples and keeps only the newest points
+TEST_F(RollupTest, RawRingKeepsNewestPoints) {
+    EXPECT_EQ(rollup_held(&r, ROLLUP_RAW), 0u);
+    for (uint32_t i = 0; i < ROLLUP_RAW_POINTS + 10; ++i) {
+        sample_t s = make_sample(i * 50000ull, (int32_t)i, 100);
+        if (i == 5) {
+            s.valid &= ~(1u << SAMPLE_CH_HEADING);
+        }
+        rollup_add(&r, &s);
+    }
+    EXPECT_EQ(rollup_held(&r, ROLLUP_RAW), (uint32_t)ROLLUP_RAW_POINTS);
+
+    rollup_point_t p;
+    EXPECT_FALSE(rollup_point(&r, 9, &p));
+    ASSERT_TRUE(rollup_point(&r, 10, &p));
+    EXPECT_EQ(p.time_ms, 500u);
+    EXPECT_EQ(p.temp, 10);
+    EXPECT_EQ(p.heading, 100u);
+    EXPECT_EQ(p.pitch, -3);
+    EXPECT_EQ(p.roll, 127);
+    EXPECT_EQ(p.valid, 0x0F);
+    EXPECT_FALSE(rollup_point(&r, ROLLUP_RAW_POINTS + 10, &p));
+
+    std::vector<std::string> lines = dump_all(r, ROLLUP_RAW, 3);
+    ASSERT_EQ(lines.size(), 6u);
+    EXPECT_EQ(lines[0].rfind("history raw: up to 3 entries", 0), 0u) << lines[0];
+    EXPECT_EQ(lines[1], "time_ms,valid,temp,heading,pitch,roll\n");
+    EXPECT_EQ(lines[4], std::to_string((ROLLUP_RAW_POINTS + 9) * 50) + ",15," +
+                            std::to_string(ROLLUP_RAW_POINTS + 9) + ",100,-3,127\n");
+    EXPECT_EQ(lines[5], "history end\n");
+}
+
+// Test minute and hour aggregates of a known signal, including the open
+// interval
+TEST_F(RollupTest, AggregatesMinutesAndHours) {
+    // One sample a second for two and a half hours; temperature is the
+    // second within the minute
+    for (uint32_t t = 0; t < 9000; ++t) {
+        sample_t s = make_sample(t * 1000000ull, (int32_t)(t % 60), 900);
+        rollup_add(&r, &s);
+    }
+    EXPECT_EQ(rollup_held(&r, ROLLUP_MINUTE), 150u);
+    EXPECT_EQ(rollup_held(&r, ROLLUP_HOUR), 3u);
+
+    rollup_bucket_t b;
+    ASSERT_TRUE(rollup_bucket(&r, ROLLUP_MINUTE, 42, &b));
+    EXPECT_EQ(b.ch[0].count, 60u);
+    EXPECT_EQ(b.ch[0].min, 0);
+    EXPECT_EQ(b.ch[0].max, 59);
+    EXPECT_EQ(b.ch[0].mean, 30);        // 29.5 rounds up
+    EXPECT_EQ(b.ch[1].mean, 900);
+    EXPECT_EQ(b.ch[3].max, 200);        // Aggregates keep int16 range
+
+    ASSERT_TRUE(rollup_bucket(&r, ROLLUP_HOUR, 1, &b));
+    EXPECT_EQ(b.ch[0].count, 3600u);
+    ASSERT_TRUE(rollup_bucket(&r, ROLLUP_HOUR, 2, &b));     // Open: half an hour so far
+    EXPECT_EQ(b.ch[0].count, 1800u);
+    EXPECT_FALSE(rollup_bucket(&r, ROLLUP_HOUR, 3, &b));
+
+    std::vector<std::string> lines = dump_all(r, ROLLUP_HOUR, 0);
+    ASSERT_EQ(lines.size(), 6u);
+    EXPECT_EQ(lines[1].rfind("start_s,temp_n,temp_mean,temp_min,temp_max,heading_n", 0), 0u);
+    EXPECT_EQ(lines[3].rfind("3600,3600,", 0), 0u) << lines[3];
+    EXPECT_NE(lines[3].find(",0,59,3600,900,900,900,"), std::string::npos) << lines[3];
+    EXPECT_EQ(lines[4].rfind("7200,1800,", 0), 0u) << lines[4];
+}
+
+// Test that the rings wrap after a day of minutes, that a gap leaves
+// empty intervals out of the dump, and that memory is fixed
+TEST_F(RollupTest, WrapsAndSkipsGaps) {
+    uint64_t t = 0;
+    for (; t < 30 * 3600ull; t += 10) {
+        if (t >= 29 * 3600ull && t < 29 * 3600ull + 600) {
+            continue;       // Ten minutes with no samples
+        }
+        sample_t s = make_sample(t * 1000000ull, 1, 1);
+        rollup_add(&r, &s);
+    }
+    EXPECT_EQ(rollup_held(&r, ROLLUP_MINUTE), (uint32_t)ROLLUP_MINUTE_BUCKETS + 1);
+    rollup_bucket_t b;
+    EXPECT_FALSE(rollup_bucket(&r, ROLLUP_MINUTE, 6 * 60 - 2, &b));
+    ASSERT_TRUE(rollup_bucket(&r, ROLLUP_MINUTE, 6 * 60 - 1, &b));
+    EXPECT_EQ(b.ch[0].count, 6u);
+    ASSERT_TRUE(rollup_bucket(&r, ROLLUP_MINUTE, 29 * 60 + 5, &b));
+    EXPECT_EQ(b.ch[0].count, 0u);
+
+    std::vector<std::string> lines = dump_all(r, ROLLUP_MINUTE, 0);
+    EXPECT_EQ(lines.size(), 3u + ROLLUP_MINUTE_BUCKETS + 1 - 10);
+    EXPECT_EQ(sizeof(rollup_t) / 1024, 92u);
+}
+
+// Test that heading either side of north averages to north
+TEST_F(RollupTest, HeadingMeanIsCircular) {
+    for (uint32_t t = 0; t < 60; ++t) {
+        sample_t s = make_sample(t * 1000000ull, 0, t % 2 ? 3590 : 20);
+        rollup_add(&r, &s);
+    }
+    rollup_bucket_t b;
+    ASSERT_TRUE(rollup_bucket(&r, ROLLUP_MINUTE, 0, &b));
+    EXPECT_EQ(b.ch[1].mean, 5);
+    EXPECT_EQ(rollup_parse_tier("hour"), ROLLUP_HOUR);
+    EXPECT_EQ(rollup_parse_tier("week"), -1);
+}
+
+// Test that entries overwritten during a dump are skipped, not repeated
+TEST_F(RollupTest, DumpSkipsOverwrittenEntries) {
+    for (uint32_t i = 0; i < ROLLUP_RAW_POINTS; ++i) {
+        sample_t s = make_sample(i * 1000ull, (int32_t)i, 0);
+        rollup_add(&r, &s);
+    }
+    rollup_dump_t dump;
+    rollup_dump_start(&r, &dump, ROLLUP_RAW, 0);
+    char buf[ROLLUP_LINE_MAX];
+    rollup_dump_line(&r, &dump, buf, sizeof(buf));
+    rollup_dump_line(&r, &dump, buf, sizeof(buf));
+    ASSERT_GT(rollup_dump_line(&r, &dump, buf, sizeof(buf)), 0);
+    EXPECT_EQ(std::string(buf).rfind("0,", 0), 0u);
+
+    for (uint32_t i = 0; i < 100; ++i) {
+        sample_t s = make_sample((ROLLUP_RAW_POINTS + i) * 1000ull, 0, 0);
+        rollup_add(&r, &s);
+    }
+    ASSERT_GT(rollup_dump_line(&r, &dump, buf, sizeof(buf)), 0);
+    EXPECT_EQ(std::string(buf).rfind("100,", 0), 0u) << buf;
+    int lines = 1;
+    while (rollup_dump_line(&r, &dump, buf, sizeof(buf)) > 0) {
+        lines++;
+    }
+    EXPECT_EQ(lines, ROLLUP_RAW_POINTS - 100 + 1);      // To the end the dump started with, then "end"
+}
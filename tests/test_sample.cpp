@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include <string>
+#include "sample.h"
+
+// Test fixture for sample records
+class SampleTest : public ::testing::Test {
+protected:
+    sample_t sample;
+    char line[128];
+
+    void SetUp() override {
+        sample_clear(&sample, 1000);
+    }
+
+    void TearDown() override {
+        // Cleanup if needed
+    }
+};
+
+// Test that a cleared sample holds no channels
+TEST_F(SampleTest, ClearedSampleIsEmpty) {
+    EXPECT_EQ(sample.time_us, 1000u);
+    EXPECT_EQ(sample.valid, 0u);
+    EXPECT_FALSE(sample_has(&sample, SAMPLE_CH_TEMP));
+    EXPECT_EQ(sample_format_text(&sample, ~0u, line, sizeof(line)), 0);
+}
+
+// Test that setting a channel marks it present
+TEST_F(SampleTest, SetMarksChannelPresent) {
+    sample_set(&sample, SAMPLE_CH_PITCH, -12);
+    EXPECT_TRUE(sample_has(&sample, SAMPLE_CH_PITCH));
+    EXPECT_FALSE(sample_has(&sample, SAMPLE_CH_ROLL));
+    EXPECT_EQ(sample.value[SAMPLE_CH_PITCH], -12);
+}
+
+// Test Q7 temperature formatting matches the main loop conversion
+TEST_F(SampleTest, FormatTemperature) {
+    sample_format_channel(SAMPLE_CH_TEMP, 2998, line, sizeof(line)); // 23.42 °C
+    EXPECT_STREQ(line, "temperature: 23.42 °C");
+
+    sample_format_channel(SAMPLE_CH_TEMP, -640, line, sizeof(line)); // -5.00 °C
+    EXPECT_STREQ(line, "temperature: -5.00 °C");
+}
+
+// Test heading formatting in tenths of a degree
+TEST_F(SampleTest, FormatHeading) {
+    sample_format_channel(SAMPLE_CH_HEADING, 1804, line, sizeof(line));
+    EXPECT_STREQ(line, "heading: 180.4");
+}
+
+// Test that only selected, present channels are formatted
+TEST_F(SampleTest, FormatTextHonoursMask) {
+    sample_set(&sample, SAMPLE_CH_HEADING, 900);
+    sample_set(&sample, SAMPLE_CH_PITCH, 3);
+    sample_set(&sample, SAMPLE_CH_ROLL, -4);
+
+    int len = sample_format_text(&sample, (1u << SAMPLE_CH_HEADING) | (1u << SAMPLE_CH_ROLL) |
+                                 (1u << SAMPLE_CH_TEMP), line, sizeof(line));
+    EXPECT_STREQ(line, "heading: 90.0    roll: -4\n");
+    EXPECT_EQ(len, (int)std::string(line).size());
+}
+
+// Test that a short buffer is never overrun
+TEST_F(SampleTest, FormatTextTruncatesSafely) {
+    char small[8];
+    sample_set(&sample, SAMPLE_CH_HEADING, 900);
+    sample_set(&sample, SAMPLE_CH_PITCH, 3);
+    int len = sample_format_text(&sample, ~0u, small, sizeof(small));
+    EXPECT_LT(len, (int)sizeof(small));
+    EXPECT_EQ(small[len], '\0');
+}
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include "sample_ring.h"
+
+namespace {
+    sample_t make_sample(uint32_t i) {
+        sample_t s;
+        sample_clear(&s, 1000ull * i);
+        sample_set(&s, SAMPLE_CH_HEADING, (int32_t)(i % SAMPLE_HEADING_MODULUS));
+        sample_set(&s, SAMPLE_CH_ROLL, -(int32_t)(i % 90));
+        return s;
+    }
+}
+
+// Test fixture for the cross-core sample ring
+class SampleRingTest : public ::testing::Test {
+protected:
+    sample_ring_t ring;
+
+    void SetUp() override {
+        sample_ring_init(&ring);
+    }
+};
+
+// Test that samples come out whole and in order
+TEST_F(SampleRingTest, PopsInOrder) {
+    sample_t out;
+    EXPECT_FALSE(sample_ring_pop(&ring, &out));
+
+    for (uint32_t i = 0; i < 10; ++i) {
+        sample_t s = make_sample(i);
+        ASSERT_TRUE(sample_ring_push(&ring, &s));
+    }
+    EXPECT_EQ(sample_ring_count(&ring), 10u);
+    for (uint32_t i = 0; i < 10; ++i) {
+        ASSERT_TRUE(sample_ring_pop(&ring, &out));
+        EXPECT_EQ(out.time_us, 1000ull * i);
+        EXPECT_EQ(out.valid, (1u << SAMPLE_CH_HEADING) | (1u << SAMPLE_CH_ROLL));
+        EXPECT_EQ(out.value[SAMPLE_CH_HEADING], (int32_t)i);
+        EXPECT_EQ(out.value[SAMPLE_CH_ROLL], -(int32_t)i);
+    }
+    EXPECT_FALSE(sample_ring_pop(&ring, &out));
+}
+
+// Test that a full ring drops new samples and keeps the old ones
+TEST_F(SampleRingTest, DropsWhenFull) {
+    for (uint32_t i = 0; i < SAMPLE_RING_SIZE + 5; ++i) {
+        sample_t s = make_sample(i);
+        EXPECT_EQ(sample_ring_push(&ring, &s), i < SAMPLE_RING_SIZE);
+    }
+    EXPECT_EQ(ring.dropped, 5u);
+    EXPECT_EQ(sample_ring_count(&ring), (uint32_t)SAMPLE_RING_SIZE);
+
+    sample_t out;
+    ASSERT_TRUE(sample_ring_pop(&ring, &out));
+    EXPECT_EQ(out.time_us, 0u);
+    sample_t s = make_sample(999);
+    EXPECT_TRUE(sample_ring_push(&ring, &s));
+}
+
+// Test a producer and a consumer on separate threads: nothing is lost,
+// duplicated or reordered beyond what was counted as dropped
+TEST_F(SampleRingTest, ProducerAndConsumerThreads) {
+    const uint32_t total = 200000;
+    std::atomic<bool> done(false);
+    uint32_t received = 0;
+    uint32_t out_of_order = 0;
+
+    std::thread consumer([&] {
+        sample_t out;
+        uint64_t last = 0;
+        while (true) {
+            bool finished = done.load();
+            if (!sample_ring_pop(&ring, &out)) {
+                if (finished) {
+                    break;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            uint32_t i = (uint32_t)(out.time_us / 1000);
+            if ((received && out.time_us <= last) || out.value[SAMPLE_CH_HEADING] != (int32_t)(i % SAMPLE_HEADING_MODULUS)) {
+                out_of_order++;
+            }
+            last = out.time_us;
+            received++;
+        }
+    });
+
+    for (uint32_t i = 0; i < total; ++i) {
+        sample_t s = make_sample(i);
+        sample_ring_push(&ring, &s);
+    }
+    done = true;
+    consumer.join();
+
+    EXPECT_EQ(out_of_order, 0u);
+    EXPECT_EQ(received + ring.dropped, total);
+}
@@ -0,0 +1,277 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sd_log.h"
+#include "file_block_dev.hpp"
+
+// Microsecond clock for the write latency counters
+extern "C" {
+    uint32_t sd_log_port_time_us(void) {
+        using namespace std::chrono;
+        return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+// Writer that keeps everything in memory and can be told to fail
+namespace {
+    struct CaptureWriter {
+        std::string data;
+        int syncs = 0;
+        int result = BLOCK_OK;
+
+        static int write(void *ctx, const uint8_t *buf, size_t len) {
+            auto *self = static_cast<CaptureWriter *>(ctx);
+            if (self->result == BLOCK_OK) {
+                self->data.append(reinterpret_cast<const char *>(buf), len);
+            }
+            return self->result;
+        }
+
+        static int sync(void *ctx) {
+            static_cast<CaptureWriter *>(ctx)->syncs++;
+            return BLOCK_OK;
+        }
+
+        log_writer_t writer() {
+            return log_writer_t{write, sync, this};
+        }
+    };
+
+    // 24-byte records with a sequence number, so they straddle buffers
+    struct Record {
+        uint32_t seq;
+        uint8_t body[20];
+    };
+
+    Record make_record(uint32_t seq) {
+        Record r;
+        r.seq = seq;
+        for (size_t i = 0; i < sizeof(r.body); i++) {
+            r.body[i] = (uint8_t)(seq * 31 + i);
+        }
+        return r;
+    }
+}
+
+// Test fixture for the double-buffered log
+class SdLogTest : public ::testing::Test {
+protected:
+    sd_log_t log;
+    CaptureWriter capture;
+
+    void SetUp() override {
+        sd_log_init(&log);
+    }
+
+    void attach() {
+        log_writer_t w = capture.writer();
+        sd_log_attach(&log, &w);
+    }
+};
+
+// Test that full buffers wait for the storage side and later records are dropped
+TEST_F(SdLogTest, DropsWhenStorageIsBehind) {
+    uint8_t record[64] = {0};
+    int accepted = 0;
+    for (int i = 0; i < 200; ++i) {
+        accepted += sd_log_append(&log, record, sizeof(record)) ? 1 : 0;
+    }
+
+    EXPECT_EQ(accepted, SD_LOG_BUFFER_COUNT * SD_LOG_BUFFER_SIZE / (int)sizeof(record));
+    EXPECT_EQ(sd_log_free(&log), 0u);
+    EXPECT_EQ(log.stats.records_dropped, (uint32_t)(200 - accepted));
+
+    // Nothing is written until a writer is attached
+    EXPECT_EQ(sd_log_service(&log), 0);
+    attach();
+    EXPECT_EQ(sd_log_service(&log), 1);
+    EXPECT_EQ(sd_log_free(&log), (size_t)SD_LOG_BUFFER_SIZE);
+    EXPECT_TRUE(sd_log_append(&log, record, sizeof(record)));
+}
+
+// Test that records split across buffers come out whole and in order
+TEST_F(SdLogTest, RecordsStraddleBuffers) {
+    attach();
+    std::string expected;
+    for (uint32_t seq = 0; seq < 1000; ++seq) {
+        Record r = make_record(seq);
+        ASSERT_TRUE(sd_log_append(&log, &r, sizeof(r)));
+        expected.append(reinterpret_cast<const char *>(&r), sizeof(r));
+        sd_log_service(&log);
+    }
+    ASSERT_TRUE(sd_log_flush(&log));
+    while (sd_log_service(&log)) {
+    }
+
+    EXPECT_EQ(capture.data, expected);
+    EXPECT_EQ(log.stats.records_logged, 1000u);
+    EXPECT_EQ(log.stats.records_dropped, 0u);
+    EXPECT_EQ(log.stats.buffers_written, (uint32_t)(expected.size() / SD_LOG_BUFFER_SIZE + 1));
+}
+
+// Test that flushing hands over a partial buffer once and only once
+TEST_F(SdLogTest, FlushHandsOverPartialBuffer) {
+    attach();
+    EXPECT_FALSE(sd_log_flush(&log));
+    ASSERT_TRUE(sd_log_append(&log, "abc", 3));
+    EXPECT_TRUE(sd_log_flush(&log));
+    EXPECT_EQ(sd_log_service(&log), 1);
+    EXPECT_EQ(capture.data, "abc");
+    EXPECT_FALSE(sd_log_flush(&log));
+}
+
+// Test that the writer is synced periodically
+TEST_F(SdLogTest, SyncsEveryFewBuffers) {
+    attach();
+    std::vector<uint8_t> block(SD_LOG_BUFFER_SIZE, 0x55);
+    for (int i = 0; i < 2 * SD_LOG_SYNC_BUFFERS; ++i) {
+        ASSERT_TRUE(sd_log_append(&log, block.data(), block.size()));
+        ASSERT_EQ(sd_log_service(&log), 1);
+    }
+    EXPECT_EQ(capture.syncs, 2);
+    EXPECT_EQ(log.stats.syncs, 2u);
+}
+
+// Test that a failed write is counted and its buffer reused
+TEST_F(SdLogTest, WriteErrorFreesBuffer) {
+    attach();
+    capture.result = BLOCK_ERROR;
+    std::vector<uint8_t> block(SD_LOG_BUFFER_SIZE, 0);
+    ASSERT_TRUE(sd_log_append(&log, block.data(), block.size()));
+    EXPECT_EQ(sd_log_service(&log), 1);
+
+    EXPECT_EQ(log.stats.write_errors, 1u);
+    EXPECT_EQ(log.status, BLOCK_ERROR);
+    EXPECT_EQ(sd_log_free(&log), (size_t)SD_LOG_BUFFER_COUNT * SD_LOG_BUFFER_SIZE);
+}
+
+// Test the raw block writer pads the final partial block
+TEST_F(SdLogTest, RawWriterPadsFinalBlock) {
+    std::string path = ::testing::TempDir() + "sd_log_raw.img";
+    host::FileBlockDev card(path, 64);
+    ASSERT_EQ(block_dev_init(card.dev()), BLOCK_OK);
+
+    raw_log_writer_t raw;
+    log_writer_t w;
+    raw_log_writer_init(&raw, card.dev(), 8, 4, &w);
+    sd_log_attach(&log, &w);
+
+    ASSERT_TRUE(sd_log_append(&log, "hello", 5));
+    sd_log_flush(&log);
+    ASSERT_EQ(sd_log_service(&log), 1);
+    EXPECT_EQ(raw.next_lba, 9u);
+
+    uint8_t block[BLOCK_SIZE];
+    ASSERT_EQ(block_dev_read(card.dev(), 8, block, 1), BLOCK_OK);
+    EXPECT_EQ(memcmp(block, "hello", 5), 0);
+    EXPECT_EQ(block[5], 0xFF);
+    EXPECT_EQ(block[BLOCK_SIZE - 1], 0xFF);
+
+    // The region is four blocks; a full buffer no longer fits
+    std::vector<uint8_t> big(SD_LOG_BUFFER_SIZE, 0);
+    ASSERT_TRUE(sd_log_append(&log, big.data(), big.size()));
+    ASSERT_EQ(sd_log_service(&log), 1);
+    EXPECT_EQ(log.status, BLOCK_RANGE);
+    std::remove(path.c_str());
+}
+
+// Test that a failed raw write still uses up its blocks, so later buffers
+// land where their position in the stream says
+TEST_F(SdLogTest, RawWriterSkipsFailedBlocks) {
+    std::string path = ::testing::TempDir() + "sd_log_skip.img";
+    host::FileBlockDev card(path, 64);
+    ASSERT_EQ(block_dev_init(card.dev()), BLOCK_OK);
+
+    raw_log_writer_t raw;
+    log_writer_t w;
+    raw_log_writer_init(&raw, card.dev(), 0, 64, &w);
+    sd_log_attach(&log, &w);
+
+    std::vector<uint8_t> buf(SD_LOG_BUFFER_SIZE, 0xA5);
+    card.fail_writes(true);
+    ASSERT_TRUE(sd_log_append(&log, buf.data(), buf.size()));
+    ASSERT_EQ(sd_log_service(&log), 1);
+    EXPECT_EQ(log.status, BLOCK_ERROR);
+
+    card.fail_writes(false);
+    ASSERT_TRUE(sd_log_append(&log, buf.data(), buf.size()));
+    ASSERT_EQ(sd_log_service(&log), 1);
+    EXPECT_EQ(log.status, BLOCK_OK);
+    EXPECT_EQ(raw.next_lba, 2u * SD_LOG_BUFFER_SIZE / BLOCK_SIZE);
+
+    uint8_t block[BLOCK_SIZE];
+    ASSERT_EQ(block_dev_read(card.dev(), 0, block, 1), BLOCK_OK);
+    EXPECT_EQ(block[0], 0xFF);
+    ASSERT_EQ(block_dev_read(card.dev(), SD_LOG_BUFFER_SIZE / BLOCK_SIZE, block, 1), BLOCK_OK);
+    EXPECT_EQ(block[0], 0xA5);
+    std::remove(path.c_str());
+}
+
+// Test a producer and a storage thread against a card with slow writes and
+// latency spikes: appends never wait, and whatever was accepted reaches
+// the card intact and in order
+TEST_F(SdLogTest, ConcurrentProducerWithSlowCard) {
+    std::string path = ::testing::TempDir() + "sd_log_card.img";
+    host::LatencyModel latency;
+    latency.base_us = 200;
+    latency.per_block_us = 20;
+    latency.spike_every = 7;
+    latency.spike_us = 20000;
+    host::FileBlockDev card(path, 4096, latency);
+    ASSERT_EQ(block_dev_init(card.dev()), BLOCK_OK);
+
+    raw_log_writer_t raw;
+    log_writer_t w;
+    raw_log_writer_init(&raw, card.dev(), 0, 4096, &w);
+
+    std::atomic<bool> done(false);
+    std::thread storage([&] {
+        sd_log_attach(&log, &w);
+        while (!done.load()) {
+            if (!sd_log_service(&log)) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+        while (sd_log_service(&log)) {
+        }
+    });
+
+    const uint32_t total = 40000;
+    for (uint32_t seq = 0; seq < total; ++seq) {
+        Record r = make_record(seq);
+        sd_log_append(&log, &r, sizeof(r));
+        if (seq % 64 == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+    while (!sd_log_flush(&log) && log.len[log.fill] != 0) {
+        std::this_thread::yield();
+    }
+    done = true;
+    storage.join();
+
+    EXPECT_EQ(log.stats.records_logged + log.stats.records_dropped, total);
+    EXPECT_EQ(log.stats.write_errors, 0u);
+    EXPECT_GT(card.busy_polls(), 0u);
+
+    // Accepted records are contiguous on the card; drops only leave gaps in
+    // the sequence numbers
+    uint32_t count = log.stats.records_logged;
+    std::vector<uint8_t> image((count * sizeof(Record) + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE);
+    ASSERT_EQ(block_dev_read(card.dev(), 0, image.data(), (uint32_t)(image.size() / BLOCK_SIZE)), BLOCK_OK);
+    int64_t last = -1;
+    for (uint32_t i = 0; i < count; ++i) {
+        Record r;
+        memcpy(&r, &image[i * sizeof(Record)], sizeof(r));
+        ASSERT_GT((int64_t)r.seq, last) << "record " << i;
+        Record want = make_record(r.seq);
+        ASSERT_EQ(memcmp(r.body, want.body, sizeof(r.body)), 0) << "record " << i;
+        last = r.seq;
+    }
+    std::remove(path.c_str());
+}
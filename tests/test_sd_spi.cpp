@@ -0,0 +1,375 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "sd_spi.h"
+
+// Byte-level SD card emulator in SPI mode. Every byte clocked out by the
+// driver (or its DMA) goes through exchange(), which returns what the card
+// drives on MISO at the same time.
+namespace {
+    const uint32_t CARD_BLOCKS = 2048;
+
+    struct SdCardEmu {
+        bool high_capacity = true;
+        int acmd41_busy = 3;            // ACMD41 calls answered "still idle"
+        int busy_bytes = 4;             // Busy bytes after each written block
+        bool reject_next = false;       // Answer the next data block with a write error
+        bool present = true;
+
+        std::vector<uint8_t> storage = std::vector<uint8_t>(CARD_BLOCKS * BLOCK_SIZE, 0xFF);
+        std::vector<uint8_t> commands;
+        bool selected = false;
+
+        // Card state
+        bool idle = true;
+        bool app = false;
+        std::vector<uint8_t> frame;
+        std::deque<uint8_t> out;
+        int busy = 0;
+        enum { COMMAND, WRITE_TOKEN, WRITE_DATA } state = COMMAND;
+        bool multi = false;
+        uint32_t write_block = 0;
+        std::vector<uint8_t> data;
+
+        uint8_t miso() {
+            if (!out.empty()) {
+                uint8_t b = out.front();
+                out.pop_front();
+                return b;
+            }
+            if (busy > 0) {
+                busy--;
+                return 0x00;
+            }
+            return 0xFF;
+        }
+
+        uint8_t exchange(uint8_t mosi) {
+            if (!present || !selected) {
+                return 0xFF;
+            }
+            uint8_t reply = miso();
+            if (reply != 0xFF || busy > 0) {
+                return reply;
+            }
+            switch (state) {
+            case COMMAND:
+                if (frame.empty() && (mosi & 0xC0) != 0x40) {
+                    break;
+                }
+                frame.push_back(mosi);
+                if (frame.size() == 6) {
+                    command();
+                    frame.clear();
+                }
+                break;
+            case WRITE_TOKEN:
+                if (mosi == 0xFE || mosi == 0xFC) {
+                    data.clear();
+                    state = WRITE_DATA;
+                } else if (mosi == 0xFD && multi) {
+                    out.push_back(0xFF);
+                    busy = busy_bytes;
+                    state = COMMAND;
+                }
+                break;
+            case WRITE_DATA:
+                data.push_back(mosi);
+                if (data.size() == BLOCK_SIZE + 2) {
+                    if (reject_next) {
+                        reject_next = false;
+                        out.push_back(0x0D);
+                        state = COMMAND;
+                        break;
+                    }
+                    std::copy(data.begin(), data.begin() + BLOCK_SIZE, &storage[write_block * BLOCK_SIZE]);
+                    write_block++;
+                    out.push_back(0x05);
+                    busy = busy_bytes;
+                    state = multi ? WRITE_TOKEN : COMMAND;
+                }
+                break;
+            }
+            return reply;
+        }
+
+        uint32_t block_of(uint32_t arg) const {
+            return high_capacity ? arg : arg / BLOCK_SIZE;
+        }
+
+        void r1(uint8_t value) {
+            out.push_back(0xFF);        // One byte of NCR
+            out.push_back(value);
+        }
+
+        void command() {
+            uint8_t cmd = frame[0] & 0x3F;
+            uint32_t arg = (uint32_t)frame[1] << 24 | (uint32_t)frame[2] << 16 | (uint32_t)frame[3] << 8 | frame[4];
+            bool was_app = app;
+            app = false;
+            commands.push_back(cmd);
+
+            if (was_app && cmd == 41) {
+                if (acmd41_busy > 0) {
+                    acmd41_busy--;
+                } else {
+                    idle = false;
+                }
+                r1(idle ? 0x01 : 0x00);
+                return;
+            }
+            uint8_t status = idle ? 0x01 : 0x00;
+            switch (cmd) {
+            case 0:
+                idle = true;
+                r1(0x01);
+                break;
+            case 8:
+                r1(0x01);
+                for (uint8_t b : {0x00, 0x00, 0x01, (int)(arg & 0xFF)}) {
+                    out.push_back(b);
+                }
+                break;
+            case 55:
+                app = true;
+                r1(status);
+                break;
+            case 58:
+                r1(status);
+                for (uint8_t b : {high_capacity ? 0xC0 : 0x80, 0xFF, 0x80, 0x00}) {
+                    out.push_back(b);
+                }
+                break;
+            case 16:
+                r1(status);
+                break;
+            case 9: {
+                uint8_t csd[16] = {0};
+                if (high_capacity) {
+                    csd[0] = 0x40;              // CSD v2: (C_SIZE + 1) * 512 KiB
+                    csd[9] = CARD_BLOCKS / 1024 - 1;
+                } else {
+                    csd[5] = 0x09;              // READ_BL_LEN 512, C_SIZE_MULT 0
+                    uint32_t c_size = CARD_BLOCKS / 4 - 1;
+                    csd[6] = (uint8_t)(c_size >> 10);
+                    csd[7] = (uint8_t)(c_size >> 2);
+                    csd[8] = (uint8_t)(c_size << 6);
+                }
+                r1(status);
+                out.push_back(0xFF);
+                out.push_back(0xFE);
+                out.insert(out.end(), csd, csd + 16);
+                out.push_back(0xFF);
+                out.push_back(0xFF);
+                break;
+            }
+            case 17: {
+                uint32_t block = block_of(arg);
+                r1(status);
+                out.push_back(0xFF);
+                out.push_back(0xFE);
+                out.insert(out.end(), &storage[block * BLOCK_SIZE], &storage[(block + 1) * BLOCK_SIZE]);
+                out.push_back(0xFF);
+                out.push_back(0xFF);
+                break;
+            }
+            case 24:
+            case 25:
+                r1(status);
+                write_block = block_of(arg);
+                multi = cmd == 25;
+                state = WRITE_TOKEN;
+                break;
+            default:
+                r1(0x04);               // Illegal command
+                break;
+            }
+        }
+    };
+
+    SdCardEmu card;
+    int dma_busy_polls = 2;             // Polls each DMA transfer reports busy
+    int dma_busy_left = 0;
+    std::vector<uint32_t> baud_rates;
+}
+
+extern "C" {
+    void sd_spi_port_init(sd_spi_t *sd) { (void)sd; }
+
+    void sd_spi_port_set_baud(sd_spi_t *sd, uint32_t hz) {
+        (void)sd;
+        baud_rates.push_back(hz);
+    }
+
+    void sd_spi_port_select(sd_spi_t *sd, bool selected) {
+        (void)sd;
+        card.selected = selected;
+        if (!selected) {
+            card.out.clear();
+            card.frame.clear();
+        }
+    }
+
+    void sd_spi_port_xfer(sd_spi_t *sd, const uint8_t *tx, uint8_t *rx, size_t len) {
+        (void)sd;
+        for (size_t i = 0; i < len; i++) {
+            uint8_t b = card.exchange(tx ? tx[i] : 0xFF);
+            if (rx) {
+                rx[i] = b;
+            }
+        }
+    }
+
+    void sd_spi_port_dma_start(sd_spi_t *sd, const uint8_t *data, size_t len) {
+        (void)sd;
+        for (size_t i = 0; i < len; i++) {
+            card.exchange(data[i]);
+        }
+        dma_busy_left = dma_busy_polls;
+    }
+
+    bool sd_spi_port_dma_busy(sd_spi_t *sd) {
+        (void)sd;
+        if (dma_busy_left > 0) {
+            dma_busy_left--;
+            return true;
+        }
+        return false;
+    }
+
+    void sd_spi_port_sleep_ms(uint32_t ms) { (void)ms; }
+}
+
+// Test fixture for the SD card SPI driver
+class SdSpiTest : public ::testing::Test {
+protected:
+    sd_spi_t sd;
+
+    void SetUp() override {
+        card = SdCardEmu();
+        dma_busy_polls = 2;
+        dma_busy_left = 0;
+        baud_rates.clear();
+        sd_spi_setup(&sd, nullptr, 17);
+    }
+
+    std::vector<uint8_t> pattern(uint32_t blocks, uint8_t seed) {
+        std::vector<uint8_t> data(blocks * BLOCK_SIZE);
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = (uint8_t)(i * 7 + seed);
+        }
+        return data;
+    }
+};
+
+// Test the command CRC against frames with well-known checksums
+TEST_F(SdSpiTest, Crc7MatchesKnownFrames) {
+    const uint8_t cmd0[] = {0x40, 0x00, 0x00, 0x00, 0x00};
+    const uint8_t cmd8[] = {0x48, 0x00, 0x00, 0x01, 0xAA};
+    EXPECT_EQ(sd_crc7(cmd0, sizeof(cmd0)) << 1 | 1, 0x95);
+    EXPECT_EQ(sd_crc7(cmd8, sizeof(cmd8)) << 1 | 1, 0x87);
+}
+
+// Test identification of a high-capacity card
+TEST_F(SdSpiTest, InitDetectsHighCapacityCard) {
+    ASSERT_EQ(block_dev_init(&sd.dev), BLOCK_OK);
+    EXPECT_TRUE(sd.high_capacity);
+    EXPECT_EQ(sd.dev.block_count, CARD_BLOCKS);
+
+    // Slow clock for identification, fast clock afterwards
+    ASSERT_GE(baud_rates.size(), 2u);
+    EXPECT_EQ(baud_rates.front(), (uint32_t)SD_SPI_INIT_HZ);
+    EXPECT_EQ(baud_rates.back(), (uint32_t)SD_SPI_FAST_HZ);
+
+    // Block length is fixed on SDHC, so CMD16 is skipped
+    EXPECT_EQ(std::count(card.commands.begin(), card.commands.end(), 16), 0);
+}
+
+// Test that a standard-capacity card gets byte addresses and CMD16
+TEST_F(SdSpiTest, InitHandlesStandardCapacityCard) {
+    card.high_capacity = false;
+    ASSERT_EQ(block_dev_init(&sd.dev), BLOCK_OK);
+    EXPECT_FALSE(sd.high_capacity);
+    EXPECT_EQ(sd.dev.block_count, CARD_BLOCKS);
+    EXPECT_EQ(std::count(card.commands.begin(), card.commands.end(), 16), 1);
+
+    std::vector<uint8_t> data = pattern(1, 3);
+    ASSERT_EQ(block_dev_write(&sd.dev, 10, data.data(), 1), BLOCK_OK);
+    EXPECT_TRUE(std::equal(data.begin(), data.end(), &card.storage[10 * BLOCK_SIZE]));
+}
+
+// Test that a missing card is reported rather than hanging
+TEST_F(SdSpiTest, InitReportsNoMedia) {
+    card.present = false;
+    EXPECT_EQ(block_dev_init(&sd.dev), BLOCK_NO_MEDIA);
+    EXPECT_EQ(sd.dev.block_count, 0u);
+}
+
+// Test that a single-block write returns at once and completes over polls
+TEST_F(SdSpiTest, SingleBlockWriteCompletesByPolling) {
+    ASSERT_EQ(block_dev_init(&sd.dev), BLOCK_OK);
+    std::vector<uint8_t> data = pattern(1, 1);
+
+    ASSERT_EQ(sd.dev.ops->write_start(&sd.dev, 5, data.data(), 1), BLOCK_OK);
+    int polls = 1;
+    while (sd.dev.ops->write_poll(&sd.dev) == BLOCK_BUSY) {
+        polls++;
+    }
+
+    // DMA busy polls, the data response, then the card's busy time
+    EXPECT_GT(polls, dma_busy_polls + card.busy_bytes);
+    EXPECT_EQ(sd.phase, SD_WRITE_IDLE);
+    EXPECT_TRUE(std::equal(data.begin(), data.end(), &card.storage[5 * BLOCK_SIZE]));
+}
+
+// Test a multi-block write and read it back
+TEST_F(SdSpiTest, MultiBlockWriteReadsBack) {
+    ASSERT_EQ(block_dev_init(&sd.dev), BLOCK_OK);
+    std::vector<uint8_t> data = pattern(8, 9);
+
+    ASSERT_EQ(block_dev_write(&sd.dev, 100, data.data(), 8), BLOCK_OK);
+    EXPECT_EQ(sd.blocks_written, 8u);
+    EXPECT_EQ(std::count(card.commands.begin(), card.commands.end(), 25), 1);
+
+    std::vector<uint8_t> back(data.size());
+    ASSERT_EQ(block_dev_read(&sd.dev, 100, back.data(), 8), BLOCK_OK);
+    EXPECT_EQ(back, data);
+}
+
+// Test that only one write may be in flight
+TEST_F(SdSpiTest, RejectsSecondWriteWhileBusy) {
+    ASSERT_EQ(block_dev_init(&sd.dev), BLOCK_OK);
+    std::vector<uint8_t> data = pattern(2, 0);
+
+    ASSERT_EQ(sd.dev.ops->write_start(&sd.dev, 0, data.data(), 2), BLOCK_OK);
+    EXPECT_EQ(sd.dev.ops->write_start(&sd.dev, 4, data.data(), 1), BLOCK_BUSY);
+    EXPECT_EQ(sd.dev.ops->read(&sd.dev, 0, data.data(), 1), BLOCK_BUSY);
+    EXPECT_EQ(block_dev_sync(&sd.dev), BLOCK_BUSY);
+
+    while (sd.dev.ops->write_poll(&sd.dev) == BLOCK_BUSY) {
+    }
+    EXPECT_EQ(block_dev_sync(&sd.dev), BLOCK_OK);
+}
+
+// Test that a block the card refuses fails the write and is counted
+TEST_F(SdSpiTest, ReportsRejectedBlock) {
+    ASSERT_EQ(block_dev_init(&sd.dev), BLOCK_OK);
+    std::vector<uint8_t> data = pattern(1, 5);
+
+    card.reject_next = true;
+    EXPECT_EQ(block_dev_write(&sd.dev, 7, data.data(), 1), BLOCK_ERROR);
+    EXPECT_EQ(sd.write_errors, 1u);
+    EXPECT_EQ(sd.phase, SD_WRITE_IDLE);
+
+    // The driver recovers for the next write
+    EXPECT_EQ(block_dev_write(&sd.dev, 7, data.data(), 1), BLOCK_OK);
+    EXPECT_TRUE(std::equal(data.begin(), data.end(), &card.storage[7 * BLOCK_SIZE]));
+}
+
+// Test that writes past the end of the card are refused up front
+TEST_F(SdSpiTest, RejectsOutOfRangeWrite) {
+    ASSERT_EQ(block_dev_init(&sd.dev), BLOCK_OK);
+    std::vector<uint8_t> data = pattern(2, 0);
+    EXPECT_EQ(block_dev_write(&sd.dev, CARD_BLOCKS - 1, data.data(), 2), BLOCK_RANGE);
+}
@@ -0,0 +1,252 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "sink.h"
+#include "output_sinks.h"
+#include "crc.h"
+
+// Mock clock and UART for the sink layer
+namespace {
+    uint64_t mock_now_us = 0;
+    std::string mock_uart;
+    size_t mock_uart_room = 0;
+
+    // Test sink: optionally busy, each delivery costs some mock time
+    struct FakeSink {
+        std::vector<int32_t> received;
+        bool busy = false;
+        uint64_t cost_us = 0;
+        int busy_left = 0;   // Number of deliveries to refuse before accepting
+    };
+
+    int fake_write(sink_t *sink, const record_t *record, uint64_t now_us) {
+        (void)now_us;
+        FakeSink *fake = static_cast<FakeSink *>(sink->ctx);
+        mock_now_us += fake->cost_us;
+        if (fake->busy) {
+            return SINK_BUSY;
+        }
+        if (fake->busy_left > 0) {
+            fake->busy_left--;
+            return SINK_BUSY;
+        }
+        fake->received.push_back(record->sample.value[SAMPLE_CH_HEADING]);
+        return 10;
+    }
+
+    int format_heading(const record_t *record, char *buf, size_t len) {
+        return snprintf(buf, len, "h=%d\n", (int)record->sample.value[SAMPLE_CH_HEADING]);
+    }
+}
+
+extern "C" {
+    uint64_t sink_port_time_us(void) { return mock_now_us; }
+
+    size_t uart_sink_port_write(uart_inst_t *uart, const uint8_t *data, size_t len) {
+        (void)uart;
+        size_t n = len < mock_uart_room ? len : mock_uart_room;
+        mock_uart.append(reinterpret_cast<const char *>(data), n);
+        mock_uart_room -= n;
+        return n;
+    }
+}
+
+// Test fixture for the sink hub
+class SinkTest : public ::testing::Test {
+protected:
+    sink_hub_t hub;
+    sink_t fast, slow;
+    FakeSink fast_dev, slow_dev;
+    record_t record;
+
+    void SetUp() override {
+        mock_now_us = 0;
+        mock_uart.clear();
+        mock_uart_room = 0;
+        sink_hub_init(&hub);
+        sink_init(&fast, "fast", fake_write, &fast_dev, SINK_POLICY_DROP);
+        sink_init(&slow, "slow", fake_write, &slow_dev, SINK_POLICY_DROP);
+        ASSERT_TRUE(sink_hub_add(&hub, &fast));
+        ASSERT_TRUE(sink_hub_add(&hub, &slow));
+        record.kind = RECORD_SAMPLE;
+        sample_clear(&record.sample, 0);
+    }
+
+    void TearDown() override {
+        // Cleanup if needed
+    }
+
+    void publish(int32_t heading) {
+        sample_set(&record.sample, SAMPLE_CH_HEADING, heading);
+        sink_hub_publish(&hub, &record, mock_now_us);
+    }
+};
+
+// Test that every record reaches every sink
+TEST_F(SinkTest, FansOutToAllSinks) {
+    for (int i = 0; i < 10; ++i) {
+        publish(i);
+    }
+    EXPECT_EQ(fast_dev.received.size(), 10u);
+    EXPECT_EQ(slow_dev.received.size(), 10u);
+    EXPECT_EQ(fast.stats.written, 10u);
+    EXPECT_EQ(fast.stats.bytes, 100u);
+}
+
+// Test that a stalled sink drops its own records without affecting the others
+TEST_F(SinkTest, StalledSinkDoesNotSlowOthers) {
+    slow_dev.busy = true;     // e.g. an SD card mid-erase
+    for (int i = 0; i < 100; ++i) {
+        publish(i);
+    }
+
+    ASSERT_EQ(fast_dev.received.size(), 100u);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(fast_dev.received[i], i);
+    }
+    EXPECT_EQ(fast.stats.dropped, 0u);
+
+    EXPECT_TRUE(slow_dev.received.empty());
+    EXPECT_EQ(slow.stats.published, 100u);
+    EXPECT_EQ(slow.stats.dropped, 100u - SINK_QUEUE_LEN);
+    EXPECT_EQ(slow.stats.high_water, SINK_QUEUE_LEN);
+
+    // Once the card recovers, the oldest queued records come out in order
+    slow_dev.busy = false;
+    for (int i = 0; i < SINK_QUEUE_LEN; ++i) {
+        sink_hub_service(&hub, mock_now_us);
+    }
+    ASSERT_EQ(slow_dev.received.size(), (size_t)SINK_QUEUE_LEN);
+    EXPECT_EQ(slow_dev.received.front(), 0);
+    EXPECT_EQ(slow_dev.received.back(), SINK_QUEUE_LEN - 1);
+}
+
+// Test that a BLOCK sink holds the producer until it has room
+TEST_F(SinkTest, BlockPolicyWaitsForRoom) {
+    slow.policy = SINK_POLICY_BLOCK;
+    slow_dev.busy = true;
+    for (int i = 0; i < SINK_QUEUE_LEN; ++i) {
+        publish(i);
+    }
+    slow_dev.busy = false;
+    slow_dev.busy_left = 3;
+    slow_dev.cost_us = 100;
+
+    publish(99);
+    EXPECT_EQ(slow.stats.dropped, 0u);
+    EXPECT_GT(slow.stats.blocked_us, 0u);
+
+    // Nothing was lost: the blocked record comes out last
+    while (slow.count > 0) {
+        sink_hub_service(&hub, mock_now_us);
+    }
+    ASSERT_EQ(slow_dev.received.size(), (size_t)SINK_QUEUE_LEN + 1);
+    EXPECT_EQ(slow_dev.received.back(), 99);
+}
+
+// Test that a BLOCK sink gives up after its timeout rather than hanging
+TEST_F(SinkTest, BlockPolicyTimesOut) {
+    slow.policy = SINK_POLICY_BLOCK;
+    slow_dev.busy = true;
+    slow_dev.cost_us = 1000;
+    for (int i = 0; i <= SINK_QUEUE_LEN; ++i) {
+        publish(i);
+    }
+    EXPECT_EQ(slow.stats.dropped, 1u);
+    EXPECT_GE(slow.stats.blocked_us, SINK_BLOCK_TIMEOUT_US);
+    EXPECT_LT(slow.stats.blocked_us, SINK_BLOCK_TIMEOUT_US + 2000);
+}
+
+// Test that a DOWNSAMPLE sink thins records once backlogged
+TEST_F(SinkTest, DownsamplePolicyThinsBacklog) {
+    slow.policy = SINK_POLICY_DOWNSAMPLE;
+    slow.downsample = 4;
+    slow_dev.busy = true;
+    for (int i = 0; i < SINK_QUEUE_LEN / 2; ++i) {
+        publish(i);
+    }
+    EXPECT_EQ(slow.stats.skipped, 0u);
+
+    for (int i = 0; i < 16; ++i) {
+        publish(100 + i);
+    }
+    EXPECT_EQ(slow.stats.skipped, 12u);
+    EXPECT_EQ(slow.count, SINK_QUEUE_LEN / 2 + 4);
+    EXPECT_EQ(slow.stats.dropped, 0u);
+}
+
+// Test that a single slow sink is only given a bounded budget per service call
+TEST_F(SinkTest, ServiceBudgetIsBounded) {
+    fast_dev.busy = true;
+    for (int i = 0; i < SINK_QUEUE_LEN; ++i) {
+        publish(i);
+    }
+    fast_dev.busy = false;
+    size_t before = fast_dev.received.size();
+    sink_hub_service(&hub, 0);
+    EXPECT_EQ(fast_dev.received.size() - before, (size_t)SINK_SERVICE_BUDGET);
+}
+
+// Test the per-sink statistics line
+TEST_F(SinkTest, FormatsStats) {
+    for (int i = 0; i < 10; ++i) {
+        publish(i);
+    }
+    char line[200];
+    sink_format_stats(&fast, 2000000, line, sizeof(line));
+    EXPECT_NE(std::string(line).find("fast: 5 rec/s 50 B/s written 10 dropped 0"), std::string::npos)
+        << line;
+}
+
+// Test that the UART sink feeds a record to the FIFO across several calls
+TEST_F(SinkTest, UartSinkDrainsPartialWrites) {
+    sink_t uart;
+    uart_sink_ctx_t ctx;
+    sink_hub_t uart_hub;
+    sink_hub_init(&uart_hub);
+    sink_uart_init(&uart, &ctx, nullptr, format_heading);
+    sink_hub_add(&uart_hub, &uart);
+
+    sample_set(&record.sample, SAMPLE_CH_HEADING, 1234);
+    mock_uart_room = 3;
+    sink_hub_publish(&uart_hub, &record, 0);
+    EXPECT_EQ(mock_uart, "h=1");
+    EXPECT_EQ(uart.count, 1);
+
+    mock_uart_room = 100;
+    sink_hub_service(&uart_hub, 0);
+    EXPECT_EQ(mock_uart, "h=1234\n");
+    EXPECT_EQ(uart.count, 0);
+    EXPECT_EQ(uart.stats.bytes, 7u);
+}
+
+// Test the binary frame layout and CRC
+TEST_F(SinkTest, BinaryFrameRoundTrips) {
+    sample_clear(&record.sample, 0x0102030405060708ull);
+    sample_set(&record.sample, SAMPLE_CH_TEMP, -640);
+    sample_set(&record.sample, SAMPLE_CH_ROLL, 7);
+
+    uint8_t frame[OUTPUT_FRAME_MAX];
+    size_t len = output_frame_sample(&record.sample, frame, sizeof(frame));
+    ASSERT_EQ(len, 4u + 12u + 8u + 2u);
+    EXPECT_EQ(frame[0], OUTPUT_FRAME_SYNC0);
+    EXPECT_EQ(frame[1], OUTPUT_FRAME_SYNC1);
+    EXPECT_EQ(frame[2], OUTPUT_FRAME_SAMPLE);
+    EXPECT_EQ(frame[3], 20);
+
+    uint16_t crc = crc16_ccitt(CRC16_INIT, &frame[2], len - 4);
+    EXPECT_EQ(frame[len - 2], crc & 0xFF);
+    EXPECT_EQ(frame[len - 1], crc >> 8);
+
+    sample_t decoded;
+    ASSERT_TRUE(sample_unpack(&decoded, &frame[4], frame[3]));
+    EXPECT_EQ(decoded.time_us, record.sample.time_us);
+    EXPECT_EQ(decoded.valid, record.sample.valid);
+    EXPECT_EQ(decoded.value[SAMPLE_CH_TEMP], -640);
+    EXPECT_EQ(decoded.value[SAMPLE_CH_ROLL], 7);
+}
+
+// Test the CRC against the standard check value
+TEST_F(SinkTest, Crc16CheckValue) {
+    EXPECT_EQ(crc16_ccitt(CRC16_INIT, "123456789", 9), 0x29B1);
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "delta_codec.h"
+#include "output_sinks.h"
+#include "stream_decoder.hpp"
+
+// Test fixture for the host-side decoder of the framed binary stream
+class StreamDecoderTest : public ::testing::Test {
+protected:
+    delta_codec_t codec;
+    uint8_t seq = 0;
+    std::vector<sample_t> received;
+    host::StreamDecoder decoder{[this](const sample_t &s) { received.push_back(s); }};
+
+    void SetUp() override {
+        delta_codec_init(&codec, 16);
+    }
+
+    // Frame one sample the way the device's binary sink does
+    std::vector<uint8_t> frame(uint64_t time_us, int32_t temp) {
+        sample_t s;
+        sample_clear(&s, time_us);
+        sample_set(&s, SAMPLE_CH_TEMP, temp);
+
+        uint8_t payload[1 + DELTA_RECORD_MAX];
+        payload[0] = seq++;
+        size_t len = 1 + delta_encode(&codec, &s, &payload[1], sizeof(payload) - 1);
+
+        std::vector<uint8_t> out(OUTPUT_FRAME_MAX);
+        out.resize(output_frame(OUTPUT_FRAME_DELTA, payload, len, out.data(), out.size()));
+        return out;
+    }
+};
+
+// Test that a clean stream fed in odd-sized chunks decodes completely
+TEST_F(StreamDecoderTest, DecodesChunkedStream) {
+    std::vector<uint8_t> stream;
+    for (int i = 0; i < 100; ++i) {
+        std::vector<uint8_t> f = frame(i * 1000, 2900 + i);
+        stream.insert(stream.end(), f.begin(), f.end());
+    }
+    for (size_t pos = 0; pos < stream.size(); pos += 7) {
+        decoder.feed(&stream[pos], std::min<size_t>(7, stream.size() - pos));
+    }
+
+    ASSERT_EQ(received.size(), 100u);
+    EXPECT_EQ(received[99].time_us, 99000u);
+    EXPECT_EQ(received[99].value[SAMPLE_CH_TEMP], 2999);
+    EXPECT_EQ(decoder.stats().crc_errors, 0u);
+}
+
+// Test that a dropped frame discards deltas until the next keyframe
+TEST_F(StreamDecoderTest, ResynchronisesAfterLostFrame) {
+    for (int i = 0; i < 40; ++i) {
+        std::vector<uint8_t> f = frame(i * 1000, 2900 + i);
+        if (i == 5) {
+            continue;
+        }
+        decoder.feed(f.data(), f.size());
+    }
+
+    // Records 6..15 depend on the lost one; 16 is the next keyframe
+    EXPECT_EQ(decoder.stats().sequence_gaps, 1u);
+    EXPECT_EQ(decoder.stats().awaiting_keyframe, 10u);
+    ASSERT_EQ(received.size(), 5u + 24u);
+    EXPECT_EQ(received[5].time_us, 16000u);
+    for (const sample_t &s : received) {
+        EXPECT_EQ(s.value[SAMPLE_CH_TEMP], 2900 + (int32_t)(s.time_us / 1000));
+    }
+}
+
+// Test that corrupted bytes are rejected by the CRC and skipped over
+TEST_F(StreamDecoderTest, RejectsCorruptFrame) {
+    std::vector<uint8_t> good = frame(0, 2900);
+    std::vector<uint8_t> bad = frame(1000, 2901);
+    bad[5] ^= 0x40;
+    std::vector<uint8_t> garbage = {0x00, 0xA5, 0xA5, 0x5A};
+
+    decoder.feed(good.data(), good.size());
+    decoder.feed(garbage.data(), garbage.size());
+    decoder.feed(bad.data(), bad.size());
+    for (int i = 2; i < 20; ++i) {
+        std::vector<uint8_t> f = frame(i * 1000, 2900 + i);
+        decoder.feed(f.data(), f.size());
+    }
+
+    EXPECT_GE(decoder.stats().crc_errors, 1u);
+    EXPECT_EQ(received.front().value[SAMPLE_CH_TEMP], 2900);
+    EXPECT_EQ(received.back().value[SAMPLE_CH_TEMP], 2919);
+    for (const sample_t &s : received) {
+        EXPECT_NE(s.time_us, 1000u);
+    }
+}
+
+// Test that plain packed-sample frames are understood too
+TEST_F(StreamDecoderTest, DecodesPackedSampleFrames) {
+    sample_t s;
+    sample_clear(&s, 42);
+    sample_set(&s, SAMPLE_CH_HEADING, 1234);
+    uint8_t buf[OUTPUT_FRAME_MAX];
+    size_t len = output_frame_sample(&s, buf, sizeof(buf));
+
+    decoder.feed(buf, len);
+    ASSERT_EQ(received.size(), 1u);
+    EXPECT_EQ(received[0].value[SAMPLE_CH_HEADING], 1234);
+}
@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "uart_dma.h"
+#include "output_sinks.h"
+
+// Mock DMA channel: a transfer reads from the ring with hardware-style
+// wrapping and "sends" as many bytes as the test lets it
+namespace {
+    const uint8_t RING_BITS = 6;    // 64-byte ring keeps wrap-around easy to hit
+    alignas(64) uint8_t ring[1u << RING_BITS];
+
+    const uint8_t *mock_from;
+    uint32_t mock_remaining;
+    uint32_t mock_starts;
+    std::string mock_wire;
+
+    // Let the running transfer move up to 'n' bytes
+    void mock_dma_run(uint32_t n) {
+        uintptr_t base = reinterpret_cast<uintptr_t>(ring);
+        uintptr_t mask = (1u << RING_BITS) - 1;
+        while (n-- > 0 && mock_remaining > 0) {
+            mock_wire += static_cast<char>(*mock_from);
+            mock_from = reinterpret_cast<const uint8_t *>(base | ((reinterpret_cast<uintptr_t>(mock_from) + 1) & mask));
+            mock_remaining--;
+        }
+    }
+}
+
+extern "C" {
+    int uart_dma_port_init(uart_dma_t *u, uint8_t size_bits) {
+        (void)u;
+        (void)size_bits;
+        return 3;
+    }
+
+    void uart_dma_port_start(uart_dma_t *u, const uint8_t *from, uint32_t count) {
+        (void)u;
+        mock_from = from;
+        mock_remaining = count;
+        mock_starts++;
+    }
+
+    uint32_t uart_dma_port_remaining(const uart_dma_t *u) {
+        (void)u;
+        return mock_remaining;
+    }
+}
+
+// Test fixture for the DMA-drained UART ring
+class UartDmaTest : public ::testing::Test {
+protected:
+    uart_dma_t u;
+
+    void SetUp() override {
+        mock_from = nullptr;
+        mock_remaining = 0;
+        mock_starts = 0;
+        mock_wire.clear();
+        uart_dma_init(&u, nullptr, ring, RING_BITS);
+    }
+};
+
+// Test that queued bytes go out in one transfer, not byte by byte
+TEST_F(UartDmaTest, StartsOneTransferForQueuedBytes) {
+    ASSERT_TRUE(uart_dma_write(&u, "hello ", 6));
+    EXPECT_EQ(mock_starts, 1u);
+
+    // Written while the first transfer runs: batched into the next one
+    ASSERT_TRUE(uart_dma_write(&u, "wide ", 5));
+    ASSERT_TRUE(uart_dma_write(&u, "world", 5));
+    EXPECT_EQ(mock_starts, 1u);
+
+    mock_dma_run(100);
+    uart_dma_poll(&u);
+    EXPECT_EQ(mock_starts, 2u);
+    mock_dma_run(100);
+    uart_dma_poll(&u);
+
+    EXPECT_EQ(mock_wire, "hello wide world");
+    EXPECT_TRUE(uart_dma_idle(&u));
+    EXPECT_EQ(u.stats.bytes_sent, 16u);
+    EXPECT_EQ(u.stats.transfers, 2u);
+}
+
+// Test that a long stream arrives intact across many ring wraps
+TEST_F(UartDmaTest, PreservesOrderAcrossWraps) {
+    std::string expected;
+    for (int i = 0; i < 300; ++i) {
+        std::string record = "r" + std::to_string(i) + ";";
+        while (!uart_dma_write(&u, record.data(), record.size())) {
+            mock_dma_run(7);
+            uart_dma_poll(&u);
+        }
+        expected += record;
+        mock_dma_run(3);
+    }
+    while (!uart_dma_idle(&u)) {
+        mock_dma_run(5);
+        uart_dma_poll(&u);
+    }
+    EXPECT_EQ(mock_wire, expected);
+    EXPECT_LT(u.stats.transfers, 300u);
+}
+
+// Test that partial progress of a transfer frees space straight away
+TEST_F(UartDmaTest, PartialProgressFreesSpace) {
+    std::vector<uint8_t> block(40, 'a');
+    ASSERT_TRUE(uart_dma_write(&u, block.data(), block.size()));
+    EXPECT_EQ(uart_dma_free(&u), 24u);
+    EXPECT_FALSE(uart_dma_write(&u, block.data(), 30));
+
+    mock_dma_run(10);
+    EXPECT_TRUE(uart_dma_write(&u, block.data(), 30));
+    EXPECT_EQ(u.stats.records_dropped, 1u);
+}
+
+// Test that records bigger than the free space are dropped whole
+TEST_F(UartDmaTest, DropsWholeRecords) {
+    std::vector<uint8_t> big(65, 'x');
+    EXPECT_FALSE(uart_dma_write(&u, big.data(), big.size()));
+    EXPECT_EQ(u.stats.bytes_dropped, 65u);
+    EXPECT_TRUE(uart_dma_idle(&u));
+}
+
+// Test that the binary sink frames samples into the ring and waits when it is full
+TEST_F(UartDmaTest, BinarySinkWritesFramesAndReportsBusy) {
+    sink_t sink;
+    uart_dma_sink_ctx_t ctx;
+    sink_uart_dma_binary_init(&sink, &ctx, &u);
+
+    record_t record;
+    record.kind = RECORD_SAMPLE;
+    sample_clear(&record.sample, 1000);
+    sample_set(&record.sample, SAMPLE_CH_TEMP, 2900);
+
+    int first = sink.write(&sink, &record, 0);
+    ASSERT_GT(first, 0);
+    EXPECT_EQ((uint8_t)mock_from[0], OUTPUT_FRAME_SYNC0);
+    EXPECT_EQ(ctx.seq, 1);
+
+    // Fill the ring while the DMA is stalled
+    int busy = 0;
+    for (int i = 0; i < 20 && busy == 0; ++i) {
+        record.sample.time_us += 1000;
+        busy = sink.write(&sink, &record, 0) == SINK_BUSY;
+    }
+    EXPECT_TRUE(busy);
+    uint8_t seq = ctx.seq;
+    EXPECT_EQ(sink.write(&sink, &record, 0), SINK_BUSY);
+    EXPECT_EQ(ctx.seq, seq);
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "usb_control.h"
+
+// Mock control-interface receive FIFO; transmit goes through the usb_tx
+// mocks in test_usb_tx.cpp, so replies are read back from the usb_tx buffer
+namespace {
+    std::string mock_rx;
+    std::vector<std::string> calls;
+
+    void record_call(usb_control_t *ctl, const char *args) {
+        calls.push_back(args);
+        usb_control_printf(ctl, "ok\n");
+    }
+
+    const usb_control_command_t test_commands[] = {
+        {"ping", "reply ok", record_call},
+        {"set", "record the arguments", record_call},
+    };
+}
+
+extern "C" {
+    uint32_t usb_control_port_read(uint8_t *buf, uint32_t len) {
+        uint32_t n = len < mock_rx.size() ? len : (uint32_t)mock_rx.size();
+        memcpy(buf, mock_rx.data(), n);
+        mock_rx.erase(0, n);
+        return n;
+    }
+}
+
+// Test fixture for the control interface command parser
+class UsbControlTest : public ::testing::Test {
+protected:
+    usb_control_t ctl;
+
+    void SetUp() override {
+        mock_rx.clear();
+        calls.clear();
+        usb_control_init(&ctl, test_commands, sizeof(test_commands) / sizeof(test_commands[0]));
+    }
+
+    // Replies queued on the control interface so far
+    std::string replies() const {
+        return std::string(reinterpret_cast<const char *>(ctl.tx.buf[ctl.tx.fill]), ctl.tx.len[ctl.tx.fill]);
+    }
+};
+
+// Test that replies are queued on the control interface, not the data one
+TEST_F(UsbControlTest, UsesControlInterface) {
+    EXPECT_EQ(ctl.tx.config.itf, USB_ITF_CONTROL);
+    EXPECT_EQ(ctl.tx.config.flush_age_us, (uint32_t)USB_CONTROL_FLUSH_AGE_US);
+}
+
+// Test that a command split across reads runs once the line is complete
+TEST_F(UsbControlTest, RunsCommandOnCompleteLine) {
+    usb_control_feed(&ctl, "pi", 2, 0);
+    EXPECT_TRUE(calls.empty());
+    usb_control_feed(&ctl, "ng\r\n", 4, 0);
+
+    ASSERT_EQ(calls.size(), 1u);
+    EXPECT_EQ(calls[0], "");
+    EXPECT_EQ(replies(), "ok\n");
+    EXPECT_EQ(ctl.commands_run, 1u);
+}
+
+// Test that arguments are passed without the command name or padding
+TEST_F(UsbControlTest, PassesArguments) {
+    mock_rx = "  set   deadband 6\n";
+    usb_control_poll(&ctl, 0);
+    ASSERT_EQ(calls.size(), 1u);
+    EXPECT_EQ(calls[0], "deadband 6");
+}
+
+// Test that unknown commands and blank lines are handled
+TEST_F(UsbControlTest, RejectsUnknownCommand) {
+    usb_control_feed(&ctl, "\n\nreboot\n", 9, 0);
+    EXPECT_TRUE(calls.empty());
+    EXPECT_EQ(ctl.commands_unknown, 1u);
+    EXPECT_EQ(replies(), "error: unknown command 'reboot' (try 'help')\n");
+}
+
+// Test that an over-long line is discarded rather than run truncated
+TEST_F(UsbControlTest, DiscardsOverlongLine) {
+    std::string line = "set " + std::string(USB_CONTROL_LINE_MAX, 'x') + "\nping\n";
+    usb_control_feed(&ctl, line.data(), line.size(), 0);
+
+    ASSERT_EQ(calls.size(), 1u);
+    EXPECT_EQ(calls[0], "");
+    EXPECT_EQ(replies(), "error: line too long\nok\n");
+}
+
+// Test the generated help text
+TEST_F(UsbControlTest, ListsCommands) {
+    usb_control_help(&ctl);
+    EXPECT_EQ(replies(), "ping       reply ok\nset        record the arguments\n");
+}
@@ -0,0 +1,215 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "usb_tx.h"
+
+// Mock TinyUSB CDC endpoint: a FIFO of fixed capacity that the test drains
+namespace {
+    bool mock_connected = true;
+    uint32_t mock_fifo_capacity = 256;
+    std::string mock_fifo;       // Bytes accepted by tud_cdc_write but not yet "sent"
+    std::string mock_host;       // Bytes the host has received
+    std::vector<size_t> mock_write_sizes;
+    std::vector<uint8_t> mock_itfs;
+    int mock_flushes = 0;
+
+    void mock_host_read_all() {
+        mock_host += mock_fifo;
+        mock_fifo.clear();
+    }
+}
+
+extern "C" {
+    bool usb_tx_port_connected(uint8_t itf) { (void)itf; return mock_connected; }
+
+    uint32_t usb_tx_port_write_available(uint8_t itf) {
+        (void)itf;
+        return mock_fifo_capacity - (uint32_t)mock_fifo.size();
+    }
+
+    uint32_t usb_tx_port_write(uint8_t itf, const uint8_t *data, uint32_t len) {
+        uint32_t room = usb_tx_port_write_available(itf);
+        uint32_t n = len < room ? len : room;
+        mock_fifo.append(reinterpret_cast<const char *>(data), n);
+        mock_write_sizes.push_back(n);
+        mock_itfs.push_back(itf);
+        return n;
+    }
+
+    void usb_tx_port_flush(uint8_t itf) { (void)itf; mock_flushes++; }
+}
+
+// Test fixture for the batched USB transmit path
+class UsbTxTest : public ::testing::Test {
+protected:
+    usb_tx_t tx;
+
+    void SetUp() override {
+        mock_connected = true;
+        mock_fifo_capacity = 4096;
+        mock_fifo.clear();
+        mock_host.clear();
+        mock_write_sizes.clear();
+        mock_itfs.clear();
+        mock_flushes = 0;
+
+        usb_tx_config_t config = {100, 10000, USB_ITF_DATA};
+        usb_tx_init(&tx, &config);
+    }
+
+    void TearDown() override {
+        // Cleanup if needed
+    }
+};
+
+// Test that small records are held back until the size threshold
+TEST_F(UsbTxTest, BatchesUntilSizeThreshold) {
+    for (int i = 0; i < 9; ++i) {
+        ASSERT_TRUE(usb_tx_write(&tx, "0123456789", 10, 0));
+        usb_tx_poll(&tx, 0);
+    }
+    EXPECT_TRUE(mock_write_sizes.empty());
+    EXPECT_EQ(usb_tx_state(&tx), USB_TX_FILLING);
+
+    ASSERT_TRUE(usb_tx_write(&tx, "0123456789", 10, 0));
+    usb_tx_poll(&tx, 0);
+
+    // One large write instead of ten small ones
+    ASSERT_EQ(mock_write_sizes.size(), 1u);
+    EXPECT_EQ(mock_write_sizes[0], 100u);
+    EXPECT_EQ(mock_flushes, 1);
+    EXPECT_EQ(tx.stats.flushes_size, 1u);
+    EXPECT_EQ(usb_tx_state(&tx), USB_TX_IDLE);
+}
+
+// Test that a trickle of data is flushed once it gets old
+TEST_F(UsbTxTest, FlushesOnAge) {
+    ASSERT_TRUE(usb_tx_write(&tx, "abc", 3, 1000));
+    usb_tx_poll(&tx, 5000);
+    EXPECT_TRUE(mock_fifo.empty());
+
+    usb_tx_poll(&tx, 11000);
+    EXPECT_EQ(mock_fifo, "abc");
+    EXPECT_EQ(tx.stats.flushes_age, 1u);
+}
+
+// Test that age is measured from the first queued byte, across timer wrap
+TEST_F(UsbTxTest, AgeSurvivesTimerWrap) {
+    ASSERT_TRUE(usb_tx_write(&tx, "abc", 3, 0xFFFFF000u));
+    usb_tx_poll(&tx, 0x00000100u);
+    EXPECT_TRUE(mock_fifo.empty());
+
+    usb_tx_poll(&tx, 0x00002000u);
+    EXPECT_EQ(mock_fifo, "abc");
+}
+
+// Test that output arrives complete and in order through a slow endpoint
+TEST_F(UsbTxTest, PreservesOrderThroughSlowEndpoint) {
+    mock_fifo_capacity = 64;
+    std::string expected;
+    uint32_t now = 0;
+
+    for (int i = 0; i < 200; ++i) {
+        std::string record = "sample " + std::to_string(i) + "\n";
+        while (!usb_tx_write(&tx, record.data(), record.size(), now)) {
+            usb_tx_poll(&tx, now);
+            mock_host_read_all();
+        }
+        expected += record;
+        usb_tx_poll(&tx, now);
+        now += 100;
+        if (i % 3 == 0) {
+            mock_host_read_all();
+        }
+    }
+    for (int i = 0; i < 100 && mock_host.size() < expected.size(); ++i) {
+        now += 20000;
+        usb_tx_poll(&tx, now);
+        mock_host_read_all();
+    }
+
+    EXPECT_EQ(mock_host, expected);
+    EXPECT_EQ(tx.stats.bytes_sent, expected.size());
+}
+
+// Test that a stalled host produces visible backpressure and counted drops
+TEST_F(UsbTxTest, ReportsBackpressureAndDrops) {
+    mock_fifo_capacity = 0;
+    char record[64] = {0};
+    int accepted = 0;
+
+    for (int i = 0; i < 200; ++i) {
+        if (usb_tx_write(&tx, record, sizeof(record), 0)) {
+            accepted++;
+        }
+        usb_tx_poll(&tx, 0);
+    }
+
+    EXPECT_EQ(usb_tx_state(&tx), USB_TX_BACKPRESSURE);
+    EXPECT_LT(usb_tx_free(&tx), sizeof(record));
+    EXPECT_EQ(tx.stats.records_queued, (uint32_t)accepted);
+    EXPECT_EQ(tx.stats.records_dropped, (uint32_t)(200 - accepted));
+    EXPECT_GT(tx.stats.records_dropped, 0u);
+
+    // Once the host reads again everything queued is delivered
+    mock_fifo_capacity = 1u << 20;
+    usb_tx_poll(&tx, 0);
+    usb_tx_flush(&tx);
+    EXPECT_EQ(mock_fifo.size(), (size_t)accepted * sizeof(record));
+}
+
+// Test that backpressure is reported only once the fill buffer cannot
+// take a record of the largest size while the other is still draining,
+// not as soon as it passes the flush threshold
+TEST_F(UsbTxTest, ReportsBackpressureAtFullBuffers) {
+    mock_fifo_capacity = 0;
+    std::vector<char> record(USB_TX_BUFFER_SIZE - USB_TX_MAX_RECORD, 'x');
+    ASSERT_TRUE(usb_tx_write(&tx, record.data(), 100, 0));
+    usb_tx_poll(&tx, 0);
+    EXPECT_EQ(usb_tx_state(&tx), USB_TX_DRAINING);
+
+    ASSERT_TRUE(usb_tx_write(&tx, record.data(), record.size(), 0));
+    usb_tx_poll(&tx, 0);
+    EXPECT_EQ(usb_tx_free(&tx), (size_t)USB_TX_MAX_RECORD);
+    EXPECT_EQ(usb_tx_state(&tx), USB_TX_DRAINING);
+
+    ASSERT_TRUE(usb_tx_write(&tx, "x", 1, 0));
+    EXPECT_EQ(usb_tx_state(&tx), USB_TX_BACKPRESSURE);
+    EXPECT_EQ(tx.stats.records_dropped, 0u);
+}
+
+// Test that a closed port is reported to the producer
+TEST_F(UsbTxTest, ReportsDisconnected) {
+    mock_connected = false;
+    EXPECT_EQ(usb_tx_state(&tx), USB_TX_DISCONNECTED);
+}
+
+// Test that oversized records are rejected rather than split
+TEST_F(UsbTxTest, RejectsOversizedRecord) {
+    std::vector<uint8_t> big(USB_TX_BUFFER_SIZE + 1, 'x');
+    EXPECT_FALSE(usb_tx_write(&tx, big.data(), big.size(), 0));
+    EXPECT_EQ(tx.stats.records_dropped, 1u);
+}
+
+// Test the formatted write helper
+TEST_F(UsbTxTest, PrintfQueuesFormattedRecord) {
+    ASSERT_TRUE(usb_tx_printf(&tx, 0, "Temperature: %d.%02d C\n", 23, 5));
+    usb_tx_flush(&tx);
+    EXPECT_EQ(mock_fifo, "Temperature: 23.05 C\n");
+}
+
+// Test that each instance writes to its own CDC interface
+TEST_F(UsbTxTest, WritesToConfiguredInterface) {
+    usb_tx_t control;
+    usb_tx_config_t config = {100, 10000, USB_ITF_CONTROL};
+    usb_tx_init(&control, &config);
+
+    ASSERT_TRUE(usb_tx_write(&tx, "data", 4, 0));
+    usb_tx_flush(&tx);
+    ASSERT_TRUE(usb_tx_write(&control, "ok\n", 3, 0));
+    usb_tx_flush(&control);
+
+    ASSERT_EQ(mock_itfs.size(), 2u);
+    EXPECT_EQ(mock_itfs[0], USB_ITF_DATA);
+    EXPECT_EQ(mock_itfs[1], USB_ITF_CONTROL);
+}
@@ -0,0 +1,342 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "veml6075.h"
+
+// A VEML6075 as the driver sees it over I2C: registers, active force
+// measurements that take the integration time on the sensor's own clock,
+// and a count of every transaction
+namespace {
+    // As acq_core.h: room kept before each sample for UV bus work
+    constexpr uint32_t kUvBusUs = 4000;
+    constexpr uint32_t kSpinStepUs = 100;
+
+    struct Measurement {
+        uint32_t start_us, end_us;
+        uint16_t uva;
+    };
+
+    struct SimVeml6075 {
+        uint32_t now_us = 0;
+        bool present = true;
+        uint16_t id = 0x0026;
+        double clock = 1.0;             // A measurement takes this times the integration time
+        // Light, in counts per 100 ms at normal dynamic; UVA rises with
+        // each measurement so every result is different
+        double uva = 1000, uvb = 2000, comp1 = 100, comp2 = 50, uva_step = 7;
+
+        uint16_t conf = VEML6075_CONF_SD;
+        uint16_t data[VEML6075_CHANNELS] = {};
+        bool measuring = false;
+        uint32_t done_us = 0;
+        std::vector<Measurement> measurements;
+
+        int reads = 0, writes = 0, failed = 0;
+        uint32_t most_regs = 0;         // Largest read transaction
+
+        uint16_t counts(double per_100ms) const {
+            unsigned it = (conf >> VEML6075_CONF_IT_SHIFT) & 7;
+            double c = per_100ms * (50 << it) / 100.0 / ((conf & VEML6075_CONF_HD) ? 2 : 1);
+            return uint16_t(std::min(65535.0, std::round(c)));
+        }
+
+        void update() {
+            if (measuring && int32_t(now_us - done_us) >= 0) {
+                double step = uva_step * double(measurements.size() - 1);
+                data[VEML6075_CH_UVA] = counts(uva + step);
+                data[VEML6075_CH_UVB] = counts(uvb);
+                data[VEML6075_CH_UVCOMP1] = counts(comp1);
+                data[VEML6075_CH_UVCOMP2] = counts(comp2);
+                measurements.back().uva = data[VEML6075_CH_UVA];
+                conf &= ~VEML6075_CONF_UV_TRIG;
+                measuring = false;
+            }
+        }
+
+        bool read(const uint8_t *regs, uint16_t *values, uint32_t count) {
+            update();
+            if (!present) {
+                failed++;
+                return false;
+            }
+            reads++;
+            most_regs = std::max(most_regs, count);
+            for (uint32_t i = 0; i < count; ++i) {
+                switch (regs[i]) {
+                    case VEML6075_UV_CONF: values[i] = conf; break;
+                    case VEML6075_UVA_DATA: values[i] = data[VEML6075_CH_UVA]; break;
+                    case VEML6075_UVB_DATA: values[i] = data[VEML6075_CH_UVB]; break;
+                    case VEML6075_UVCOMP1_DATA: values[i] = data[VEML6075_CH_UVCOMP1]; break;
+                    case VEML6075_UVCOMP2_DATA: values[i] = data[VEML6075_CH_UVCOMP2]; break;
+                    case VEML6075_ID: values[i] = id; break;
+                    default: values[i] = 0; break;
+                }
+            }
+            return true;
+        }
+
+        bool write(uint8_t reg, uint16_t value) {
+            update();
+            if (!present) {
+                failed++;
+                return false;
+            }
+            writes++;
+            if (reg != VEML6075_UV_CONF) {
+                return true;
+            }
+            conf = value & ~VEML6075_CONF_UV_TRIG;
+            bool trigger = (value & VEML6075_CONF_UV_TRIG) && (value & VEML6075_CONF_UV_AF) &&
+                           !(value & VEML6075_CONF_SD);
+            if (trigger && !measuring) {
+                unsigned it = (conf >> VEML6075_CONF_IT_SHIFT) & 7;
+                measuring = true;
+                done_us = now_us + uint32_t(std::lround(veml6075_integration_us(uint8_t(it)) * clock));
+                measurements.push_back({now_us, done_us, 0});
+            }
+            if (measuring) {
+                conf |= VEML6075_CONF_UV_TRIG;
+            }
+            return true;
+        }
+    };
+
+    bool sim_read(void *ctx, uint8_t address, const uint8_t *regs, uint16_t *values, uint32_t count) {
+        auto *sim = static_cast<SimVeml6075 *>(ctx);
+        return address == VEML6075_ADDRESS && sim->read(regs, values, count);
+    }
+
+    bool sim_write(void *ctx, uint8_t address, uint8_t reg, uint16_t value) {
+        auto *sim = static_cast<SimVeml6075 *>(ctx);
+        return address == VEML6075_ADDRESS && sim->write(reg, value);
+    }
+
+    struct Sampled {
+        uint32_t time_us;
+        bool has_uv;
+        veml6075_result_t uv;
+    };
+
+    // The sampling loop of acq_core.c: UV work in the idle time before a
+    // sample when it leaves room, the newest result taken with the
+    // sample, and the next measurement planned for the next sample
+    std::vector<Sampled> run_acquisition(SimVeml6075 &sim, veml6075_t *v, uint32_t period_us, int samples) {
+        std::vector<Sampled> out;
+        uint32_t next_us = sim.now_us;
+        for (int n = 0; n < samples; ++n) {
+            while (int32_t(next_us - sim.now_us) > 0) {
+                if (int32_t(next_us - sim.now_us) >= int32_t(kUvBusUs) && veml6075_due(v, sim.now_us)) {
+                    veml6075_poll(v, sim.now_us);
+                }
+                sim.now_us += std::min(kSpinStepUs, next_us - sim.now_us);
+            }
+            Sampled s = {sim.now_us, false, {}};
+            if (const veml6075_result_t *uv = veml6075_take(v)) {
+                s.has_uv = true;
+                s.uv = *uv;
+            }
+            out.push_back(s);
+            next_us += period_us;
+            veml6075_plan(v, next_us - kUvBusUs);
+        }
+        return out;
+    }
+
+    // The newest measurement finished by 'time_us'
+    const Measurement *finished_by(const SimVeml6075 &sim, uint32_t time_us) {
+        const Measurement *last = nullptr;
+        for (const Measurement &m : sim.measurements) {
+            if (int32_t(time_us - m.end_us) >= 0) {
+                last = &m;
+            }
+        }
+        return last;
+    }
+
+    // Vishay's formulas in floating point, with the published coefficients
+    struct Reference {
+        double uva, uvb, uv_index;
+    };
+
+    Reference reference(const uint16_t raw[VEML6075_CHANNELS], uint8_t it, bool hd) {
+        double c1 = raw[VEML6075_CH_UVCOMP1], c2 = raw[VEML6075_CH_UVCOMP2];
+        double uva = std::max(0.0, raw[VEML6075_CH_UVA] - 2.22 * c1 - 1.33 * c2);
+        double uvb = std::max(0.0, raw[VEML6075_CH_UVB] - 2.95 * c1 - 1.74 * c2);
+        double scale = 100000.0 / veml6075_integration_us(it) * (hd ? 2 : 1);
+        return {uva, uvb, (uva * 1.461 + uvb * 2.591) * scale / 2};
+    }
+}  // namespace
+
+// Test fixture for the VEML6075 driver on a simulated sensor
+class Veml6075Test : public ::testing::Test {
+protected:
+    SimVeml6075 sim;
+    veml6075_t uv;
+    veml6075_bus_t bus = {sim_read, sim_write, &sim};
+};
+
+// Test that init checks the ID and leaves the sensor powered up, waiting
+// for triggers, with the chosen integration time and dynamic range
+TEST_F(Veml6075Test, InitChecksIdAndConfigures) {
+    ASSERT_TRUE(veml6075_init(&uv, &bus, VEML6075_IT_200MS, true));
+    EXPECT_EQ(sim.conf, VEML6075_IT_200MS << VEML6075_CONF_IT_SHIFT | VEML6075_CONF_HD | VEML6075_CONF_UV_AF);
+    EXPECT_EQ(sim.reads, 1);
+    EXPECT_EQ(sim.writes, 1);
+    EXPECT_TRUE(sim.measurements.empty());
+    EXPECT_FALSE(veml6075_due(&uv, sim.now_us));
+
+    sim.id = 0x0027;
+    EXPECT_FALSE(veml6075_init(&uv, &bus, VEML6075_IT_100MS, false));
+    sim.id = 0x0026;
+    sim.present = false;
+    EXPECT_FALSE(veml6075_init(&uv, &bus, VEML6075_IT_100MS, false));
+}
+
+// Test the fixed-point compensation on a worked example and against the
+// floating-point formulas over random readings and every setting,
+// including full scale, where a 32-bit product could overflow
+TEST_F(Veml6075Test, CompensationMatchesFloatingPoint) {
+    veml6075_result_t r;
+    const uint16_t example[VEML6075_CHANNELS] = {1000, 2000, 100, 50};
+    veml6075_compensate(example, VEML6075_IT_100MS, false, &r);
+    EXPECT_EQ(r.uva, 711);              // 1000 - 222 - 66.5
+    EXPECT_EQ(r.uvb, 1618);             // 2000 - 295 - 87
+    EXPECT_EQ(r.uv_index, 2616);        // (711 * 1.461 + 1618 * 2.591) / 2
+
+    std::mt19937 rng(6075);
+    std::uniform_int_distribution<int> any(0, 65535), dim(0, 4000);
+    const uint16_t corners[] = {0, 1, 4095, 32768, 65535};
+    for (int n = 0; n < 200000; ++n) {
+        uint16_t raw[VEML6075_CHANNELS];
+        if (n < 625) {
+            for (int ch = 0, k = n; ch < VEML6075_CHANNELS; ++ch, k /= 5) {
+                raw[ch] = corners[k % 5];
+            }
+        } else {
+            raw[VEML6075_CH_UVA] = uint16_t(any(rng));
+            raw[VEML6075_CH_UVB] = uint16_t(any(rng));
+            raw[VEML6075_CH_UVCOMP1] = uint16_t(n % 2 ? dim(rng) : any(rng));
+            raw[VEML6075_CH_UVCOMP2] = uint16_t(n % 2 ? dim(rng) : any(rng));
+        }
+        uint8_t it = uint8_t(n % 5);
+        bool hd = (n / 5) % 2;
+        veml6075_compensate(raw, it, hd, &r);
+        Reference ref = reference(raw, it, hd);
+
+        // Rounding to counts, plus the Q12 coefficients' own error
+        double c1 = raw[VEML6075_CH_UVCOMP1], c2 = raw[VEML6075_CH_UVCOMP2];
+        double tol_a = 0.5 + 1e-6 + c1 * std::fabs(2.22 - 9093 / 4096.0) + c2 * std::fabs(1.33 - 5448 / 4096.0);
+        double tol_b = 0.5 + 1e-6 + c1 * std::fabs(2.95 - 12083 / 4096.0) + c2 * std::fabs(1.74 - 7127 / 4096.0);
+        ASSERT_GE(r.uva, 0);
+        ASSERT_GE(r.uvb, 0);
+        ASSERT_NEAR(r.uva, ref.uva, tol_a) << n;
+        ASSERT_NEAR(r.uvb, ref.uvb, tol_b) << n;
+
+        double scale = 100000.0 / veml6075_integration_us(it) * (hd ? 2 : 1);
+        double tol_i = 1 + (tol_a * 1.461 + tol_b * 2.591) * scale / 2 + ref.uv_index * 1e-5;
+        ASSERT_NEAR(r.uv_index, ref.uv_index, tol_i) << n;
+    }
+}
+
+// Test that with a sample period longer than the integration time, each
+// measurement is timed to end just before a sample and costs one trigger
+// and one read of all four channels together
+TEST_F(Veml6075Test, MeasuresJustBeforeEachSample) {
+    ASSERT_TRUE(veml6075_init(&uv, &bus, VEML6075_IT_100MS, false));
+    sim.reads = sim.writes = 0;
+    const uint32_t period_us = 1500000;
+    std::vector<Sampled> samples = run_acquisition(sim, &uv, period_us, 21);
+
+    EXPECT_FALSE(samples[0].has_uv);
+    for (size_t n = 1; n < samples.size(); ++n) {
+        ASSERT_TRUE(samples[n].has_uv) << n;
+        const Measurement *m = finished_by(sim, samples[n].time_us);
+        ASSERT_NE(m, nullptr);
+        EXPECT_EQ(samples[n].uv.raw[VEML6075_CH_UVA], m->uva) << n;
+        // Finished within the margin and the bus allowance of the sample
+        EXPECT_GE(m->start_us, samples[n - 1].time_us);
+        EXPECT_LE(samples[n].time_us - m->end_us, uv.measure_us - 100000 + kUvBusUs + kSpinStepUs) << n;
+    }
+    EXPECT_EQ(sim.measurements.size(), 20u);
+    EXPECT_EQ(sim.writes, 20);
+    EXPECT_EQ(sim.reads, 20);
+    EXPECT_EQ(sim.most_regs, uint32_t(VEML6075_READ_COUNT));
+    EXPECT_EQ(uv.stats.measurements, 20u);
+    EXPECT_EQ(uv.stats.early, 0u);
+    RecordProperty("bus_transactions_per_measurement", 2);
+}
+
+// Test that a sample period shorter than the integration time gets
+// measurements back to back, and every sample the newest finished one
+TEST_F(Veml6075Test, BackToBackWhenPeriodIsShort) {
+    ASSERT_TRUE(veml6075_init(&uv, &bus, VEML6075_IT_100MS, false));
+    const uint32_t period_us = 50000;
+    std::vector<Sampled> samples = run_acquisition(sim, &uv, period_us, 200);      // 10 s
+
+    // Never overlapping, and never idle for more than a spin step and a period
+    for (size_t i = 1; i < sim.measurements.size(); ++i) {
+        uint32_t gap = sim.measurements[i].start_us - sim.measurements[i - 1].end_us;
+        ASSERT_GE(int32_t(gap), 0);
+        ASSERT_LE(gap, uv.measure_us - 100000 + period_us) << i;
+    }
+    EXPECT_GE(sim.measurements.size(), 10000000u / (uv.measure_us + period_us));
+
+    uint16_t last = 0;
+    int with_uv = 0;
+    for (const Sampled &s : samples) {
+        if (!s.has_uv) {
+            continue;
+        }
+        with_uv++;
+        EXPECT_GT(s.uv.raw[VEML6075_CH_UVA], last);
+        last = s.uv.raw[VEML6075_CH_UVA];
+    }
+    EXPECT_EQ(with_uv, int(uv.stats.measurements));
+    EXPECT_EQ(uv.stats.early, 0u);
+}
+
+// Test that a sensor clock slower than the margin allows is caught by the
+// trigger bit read with the channels: the result is read once it is done,
+// and later measurements start early enough to be ready for their sample
+TEST_F(Veml6075Test, SlowSensorClockIsWaitedFor) {
+    ASSERT_TRUE(veml6075_init(&uv, &bus, VEML6075_IT_100MS, false));
+    sim.clock = 1.2;
+    std::vector<Sampled> samples = run_acquisition(sim, &uv, 1500000, 11);
+
+    // The first measurement misses its sample and goes with the next one
+    EXPECT_FALSE(samples[1].has_uv);
+    EXPECT_GT(uv.stats.early, 0u);
+    EXPECT_LE(uv.stats.early, 2u);
+    for (size_t n = 2; n < samples.size(); ++n) {
+        ASSERT_TRUE(samples[n].has_uv) << n;
+        const Measurement *m = finished_by(sim, samples[n].time_us);
+        ASSERT_NE(m, nullptr);
+        EXPECT_EQ(samples[n].uv.raw[VEML6075_CH_UVA], m->uva) << n;
+        if (n >= 3) {
+            EXPECT_GE(m->start_us, samples[n - 1].time_us) << n;
+        }
+    }
+    EXPECT_EQ(uv.stats.measurements, 10u);
+}
+
+// Test that a sensor that stops answering is retried once a measurement
+// time rather than on every pass of the loop, and picked up again
+TEST_F(Veml6075Test, RetriesMissingSensorSparingly) {
+    ASSERT_TRUE(veml6075_init(&uv, &bus, VEML6075_IT_50MS, false));
+    run_acquisition(sim, &uv, 20000, 50);
+    uint32_t before = uv.stats.measurements;
+    EXPECT_GT(before, 0u);
+
+    sim.present = false;
+    std::vector<Sampled> gone = run_acquisition(sim, &uv, 20000, 100);            // 2 s
+    EXPECT_GT(uv.stats.bus_errors, 0u);
+    EXPECT_LE(sim.failed, int(2000000 / uv.measure_us) + 2);
+    EXPECT_TRUE(std::none_of(gone.begin() + 1, gone.end(), [](const Sampled &s) { return s.has_uv; }));
+
+    sim.present = true;
+    run_acquisition(sim, &uv, 20000, 50);
+    EXPECT_GT(uv.stats.measurements, before);
+}
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "window_stats.h"
+
+// Test fixture for windowed aggregation
+class WindowStatsTest : public ::testing::Test {
+protected:
+    wstat_channel_t c;
+    wstat_result_t r;
+
+    void SetUp() override {
+        wstat_reset(&c, 0);
+    }
+
+    void TearDown() override {
+        // Cleanup if needed
+    }
+
+    static double q8(int32_t v) { return v / 256.0; }
+};
+
+// Test that an empty window reports nothing
+TEST_F(WindowStatsTest, EmptyWindow) {
+    wstat_result(&c, &r);
+    EXPECT_EQ(r.count, 0u);
+    EXPECT_EQ(r.stddev_q, 0);
+}
+
+// Test min/max/mean/stddev against a double-precision reference
+TEST_F(WindowStatsTest, MatchesFloatingPointReference) {
+    srand(7);
+    std::vector<int> values;
+    for (int i = 0; i < 1000; ++i) {
+        values.push_back(2900 + rand() % 200);   // Q7 temperatures around 23 °C
+    }
+
+    double sum = 0;
+    for (int v : values) {
+        wstat_add(&c, v);
+        sum += v;
+    }
+    double mean = sum / values.size();
+    double ss = 0;
+    for (int v : values) {
+        ss += (v - mean) * (v - mean);
+    }
+    double sd = std::sqrt(ss / (values.size() - 1));
+
+    wstat_result(&c, &r);
+    EXPECT_EQ(r.count, 1000u);
+    EXPECT_EQ(r.min, *std::min_element(values.begin(), values.end()));
+    EXPECT_EQ(r.max, *std::max_element(values.begin(), values.end()));
+    EXPECT_NEAR(q8(r.mean_q), mean, 0.05);
+    EXPECT_NEAR(q8(r.stddev_q), sd, 0.05);
+}
+
+// Test negative values (sub-zero temperatures, pitch and roll)
+TEST_F(WindowStatsTest, NegativeValues) {
+    for (int v : {-10, -20, -30}) {
+        wstat_add(&c, v);
+    }
+    wstat_result(&c, &r);
+    EXPECT_EQ(r.min, -30);
+    EXPECT_EQ(r.max, -10);
+    EXPECT_NEAR(q8(r.mean_q), -20.0, 0.01);
+    EXPECT_NEAR(q8(r.stddev_q), 10.0, 0.01);
+}
+
+// Test that a heading dithering across north averages to north
+TEST_F(WindowStatsTest, CircularMeanAcrossNorth) {
+    wstat_reset(&c, SAMPLE_HEADING_MODULUS);
+    for (int v : {3590, 10, 3595, 5, 3600 - 1, 1}) {
+        wstat_add(&c, v);
+    }
+    wstat_result(&c, &r);
+
+    double mean = q8(r.mean_q);
+    double err = std::fabs(mean < 1800 ? mean : mean - 3600);
+    EXPECT_LT(err, 0.5);
+    EXPECT_LT(q8(r.stddev_q), 10.0);   // Not ~1800 as a linear mean would give
+    EXPECT_EQ(r.min, 3590);
+    EXPECT_EQ(r.max, 10);
+}
+
+// Test that a slowly rotating heading keeps a sensible mean after a full turn
+TEST_F(WindowStatsTest, CircularMeanOfRotation) {
+    wstat_reset(&c, SAMPLE_HEADING_MODULUS);
+    for (int v = 3500; v < 3700; v += 2) {
+        wstat_add(&c, v % 3600);
+    }
+    wstat_result(&c, &r);
+    EXPECT_NEAR(q8(r.mean_q), 3599.0, 1.0);
+    EXPECT_GE(r.mean_q, 0);
+    EXPECT_LT(r.mean_q, 3600 * 256);
+}
+
+// Test windowing over samples with channels arriving at different rates
+TEST_F(WindowStatsTest, WindowCollectsAllChannels) {
+    window_stats_t ws;
+    window_record_t rec;
+    window_stats_init(&ws, 0);
+
+    for (int i = 0; i < 20; ++i) {
+        sample_t s;
+        sample_clear(&s, (uint64_t)i * 50000);
+        sample_set(&s, SAMPLE_CH_HEADING, 900 + i);
+        sample_set(&s, SAMPLE_CH_PITCH, i % 3);
+        if (i % 20 == 0) {
+            sample_set(&s, SAMPLE_CH_TEMP, 2998);   // TMP117 is much slower
+        }
+        window_stats_add(&ws, &s);
+    }
+    EXPECT_FALSE(window_stats_due(&ws, 999999, 1000));
+    EXPECT_TRUE(window_stats_due(&ws, 1000000, 1000));
+
+    window_stats_take(&ws, &rec, 1000000);
+    EXPECT_EQ(rec.start_us, 0u);
+    EXPECT_EQ(rec.end_us, 1000000u);
+    EXPECT_EQ(rec.valid, (1u << SAMPLE_CH_HEADING) | (1u << SAMPLE_CH_PITCH) | (1u << SAMPLE_CH_TEMP));
+    EXPECT_EQ(rec.ch[SAMPLE_CH_HEADING].count, 20u);
+    EXPECT_EQ(rec.ch[SAMPLE_CH_TEMP].count, 1u);
+    EXPECT_EQ(rec.ch[SAMPLE_CH_HEADING].min, 900);
+    EXPECT_EQ(rec.ch[SAMPLE_CH_HEADING].max, 919);
+
+    // The next window starts empty
+    EXPECT_EQ(ws.samples, 0u);
+    EXPECT_EQ(ws.start_us, 1000000u);
+
+    char line[512];
+    window_stats_format_text(&rec, line, sizeof(line));
+    EXPECT_NE(std::string(line).find("heading: 90.9 [90.0..91.9]"), std::string::npos);
+    EXPECT_NE(std::string(line).find("temperature: 23.42 [23.42..23.42] sd 0.00 n=1"), std::string::npos);
+}